@@ -31,12 +31,19 @@
 
 #include "bgpstream_int.h"
 #include "bgpstream_di_mgr.h"
+#include "bgpstream_dispatch.h"
+#include "bgpstream_format.h"
 #include "bgpstream_log.h"
+#include "bgpstream_plan.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Maximum number of records that bgpstream_run reads at a time */
+#define BGPSTREAM_RUN_BATCH 64
+
 struct bgpstream {
 
   /* filter manager instance */
@@ -84,6 +91,62 @@ int bgpstream_add_filter(bgpstream_t *bs, bgpstream_filter_type_t filter_type,
       filter_value);
 }
 
+int bgpstream_add_filter_list(bgpstream_t *bs,
+                              bgpstream_filter_type_t filter_type,
+                              const char *buf, size_t len)
+{
+  return bgpstream_filter_mgr_filter_list_add(bs->filter_mgr, -1, filter_type,
+                                              buf, len);
+}
+
+int bgpstream_add_filter_file(bgpstream_t *bs,
+                              bgpstream_filter_type_t filter_type,
+                              const char *path)
+{
+  return bgpstream_filter_mgr_filter_file_add(bs->filter_mgr, -1, filter_type,
+                                              path);
+}
+
+int bgpstream_add_filter_set(bgpstream_t *bs, const char *name)
+{
+  return bgpstream_filter_mgr_filter_set_add(bs->filter_mgr, name);
+}
+
+int bgpstream_add_filter_set_filter(bgpstream_t *bs, int set,
+                                    bgpstream_filter_type_t filter_type,
+                                    const char *filter_value)
+{
+  return bgpstream_filter_mgr_filter_set_filter_add(bs->filter_mgr, set,
+                                                    filter_type, filter_value);
+}
+
+int bgpstream_add_filter_set_filter_list(bgpstream_t *bs, int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *buf, size_t len)
+{
+  if (set < 0) {
+    return 0;
+  }
+  return bgpstream_filter_mgr_filter_list_add(bs->filter_mgr, set, filter_type,
+                                              buf, len);
+}
+
+int bgpstream_add_filter_set_filter_file(bgpstream_t *bs, int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *path)
+{
+  if (set < 0) {
+    return 0;
+  }
+  return bgpstream_filter_mgr_filter_file_add(bs->filter_mgr, set, filter_type,
+                                              path);
+}
+
+const char *bgpstream_get_filter_set_name(bgpstream_t *bs, int set)
+{
+  return bgpstream_filter_mgr_filter_set_name(bs->filter_mgr, set);
+}
+
 int bgpstream_add_rib_period_filter(bgpstream_t *bs, uint32_t period)
 {
   return bgpstream_filter_mgr_rib_period_filter_add(bs->filter_mgr, period);
@@ -202,6 +265,129 @@ void bgpstream_set_live_mode(bgpstream_t *bs)
   bgpstream_di_mgr_set_blocking(bs->di_mgr);
 }
 
+int bgpstream_set_reader_threads(bgpstream_t *bs, int threads)
+{
+  assert(!bs->started);
+  return bgpstream_di_mgr_set_reader_threads(bs->di_mgr, threads);
+}
+
+int bgpstream_set_prefetch_depth(bgpstream_t *bs, int depth)
+{
+  assert(!bs->started);
+  return bgpstream_di_mgr_set_prefetch_depth(bs->di_mgr, depth);
+}
+
+int bgpstream_set_download_ahead(bgpstream_t *bs, int depth,
+                                 uint64_t max_rate)
+{
+  assert(!bs->started);
+  return bgpstream_di_mgr_set_download_ahead(bs->di_mgr, depth, max_rate);
+}
+
+void bgpstream_set_memory_budget(bgpstream_t *bs, uint64_t bytes)
+{
+  assert(!bs->started);
+  bgpstream_di_mgr_set_memory_budget(bs->di_mgr, bytes);
+}
+
+void bgpstream_set_live_reorder_delay(bgpstream_t *bs, uint32_t delay)
+{
+  assert(!bs->started);
+  bgpstream_di_mgr_set_reorder_delay(bs->di_mgr, delay * 1000);
+}
+
+int bgpstream_set_rib_decode_threads(bgpstream_t *bs, int threads)
+{
+  assert(!bs->started);
+  if (threads < 0) {
+    return -1;
+  }
+  bgpstream_filter_mgr_decode_threads_set(bs->filter_mgr, threads);
+  return 0;
+}
+
+int bgpstream_set_bmp_decode_threads(bgpstream_t *bs, int threads)
+{
+  assert(!bs->started);
+  if (threads < 0) {
+    return -1;
+  }
+  bgpstream_filter_mgr_bmp_decode_threads_set(bs->filter_mgr, threads);
+  return 0;
+}
+
+int bgpstream_set_decompress_threads(bgpstream_t *bs, int threads)
+{
+  assert(!bs->started);
+  if (threads < 0) {
+    return -1;
+  }
+  bgpstream_filter_mgr_decompress_threads_set(bs->filter_mgr, threads);
+  return 0;
+}
+
+int bgpstream_set_io_depth(bgpstream_t *bs, int depth)
+{
+  assert(!bs->started);
+  if (depth < 0) {
+    return -1;
+  }
+  bgpstream_filter_mgr_io_depth_set(bs->filter_mgr, depth);
+  return 0;
+}
+
+int bgpstream_set_worker_cpus(bgpstream_t *bs, const char *cpus)
+{
+  assert(!bs->started);
+  return bgpstream_filter_mgr_worker_cpus_set(bs->filter_mgr, cpus);
+}
+
+int bgpstream_set_http_streams(bgpstream_t *bs, int streams)
+{
+  assert(!bs->started);
+  if (streams < 0) {
+    return -1;
+  }
+  bgpstream_filter_mgr_http_streams_set(bs->filter_mgr, streams);
+  return 0;
+}
+
+void bgpstream_set_keep_raw_records(bgpstream_t *bs, int enabled)
+{
+  assert(!bs->started);
+  bgpstream_filter_mgr_keep_raw_set(bs->filter_mgr, enabled != 0);
+}
+
+void bgpstream_set_rib_diff_mode(bgpstream_t *bs, int enabled)
+{
+  assert(!bs->started);
+  bgpstream_filter_mgr_rib_diff_set(bs->filter_mgr, enabled != 0);
+}
+
+void bgpstream_set_dedup_window(bgpstream_t *bs, uint32_t window)
+{
+  assert(!bs->started);
+  bgpstream_filter_mgr_dedup_window_set(bs->filter_mgr, window);
+}
+
+void bgpstream_set_elem_fields(bgpstream_t *bs, uint8_t fields)
+{
+  assert(!bs->started);
+  bgpstream_filter_mgr_elem_fields_set(bs->filter_mgr, fields);
+}
+
+int bgpstream_set_shard(bgpstream_t *bs, int index, int count)
+{
+  assert(!bs->started);
+  return bgpstream_di_mgr_set_shard(bs->di_mgr, index, count);
+}
+
+int bgpstream_set_checkpoint(bgpstream_t *bs, const char *checkpoint)
+{
+  assert(!bs->started);
+  return bgpstream_di_mgr_set_checkpoint(bs->di_mgr, checkpoint);
+}
+
 /* turn on the bgpstream interface, i.e.:
  * it makes the interface ready
  * for a new get next call
@@ -233,6 +419,141 @@ int bgpstream_get_next_record(bgpstream_t *bs, bgpstream_record_t **record)
   return bgpstream_di_mgr_get_next_record(bs->di_mgr, record);
 }
 
+int bgpstream_get_next_records(bgpstream_t *bs, bgpstream_record_t **records,
+                               int max)
+{
+  assert(bs->started);
+  // the DI manager holds on to the batch until we're called again
+  return bgpstream_di_mgr_get_next_records(bs->di_mgr, records, max);
+}
+
+int bgpstream_run_workers(bgpstream_t *bs, int workers,
+                          bgpstream_dispatch_key_t key,
+                          bgpstream_worker_cb_t cb, void *user)
+{
+  assert(bs->started);
+  return bgpstream_dispatch_run(bs, workers, key, cb, user);
+}
+
+int bgpstream_run(bgpstream_t *bs, bgpstream_record_cb_t record_cb,
+                  bgpstream_elem_cb_t elem_cb, void *user)
+{
+  bgpstream_record_t *records[BGPSTREAM_RUN_BATCH];
+  bgpstream_record_t *record;
+  bgpstream_elem_t *elem;
+  int i, n, rc;
+
+  assert(bs->started);
+
+  // read whatever is ready in one go rather than one record per call
+  while ((n = bgpstream_di_mgr_get_next_records(bs->di_mgr, records,
+                                                BGPSTREAM_RUN_BATCH)) > 0) {
+    for (i = 0; i < n; i++) {
+      record = records[i];
+      rc = 0;
+      if (record_cb != NULL && (rc = record_cb(record, user)) < 0) {
+        return 1;
+      }
+      if (rc > 0 || elem_cb == NULL ||
+          record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+        continue;
+      }
+      while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+        if (elem_cb(record, elem, user) != 0) {
+          return 1;
+        }
+      }
+      if (rc < 0) {
+        return -1;
+      }
+    }
+  }
+
+  return n;
+}
+
+int bgpstream_run_agg(bgpstream_t *bs, bgpstream_agg_t *agg)
+{
+  bgpstream_record_t *records[BGPSTREAM_RUN_BATCH];
+  bgpstream_elem_t *elem;
+  int i, n, rc;
+
+  assert(bs->started);
+
+  while ((n = bgpstream_di_mgr_get_next_records(bs->di_mgr, records,
+                                                BGPSTREAM_RUN_BATCH)) > 0) {
+    for (i = 0; i < n; i++) {
+      if (records[i]->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+        continue;
+      }
+      while ((rc = bgpstream_record_get_next_elem(records[i], &elem)) > 0) {
+        if ((rc = bgpstream_agg_add(agg, records[i], elem)) != 0) {
+          return rc;
+        }
+      }
+      if (rc < 0) {
+        return -1;
+      }
+    }
+  }
+  if (n < 0) {
+    return n;
+  }
+
+  return bgpstream_agg_flush(agg);
+}
+
+static int plan_add(bgpstream_resource_t *res, void *user)
+{
+  return bgpstream_plan_add((bgpstream_plan_t *)user, res) < 0 ? -1 : 0;
+}
+
+int bgpstream_plan_work_units(bgpstream_t *bs, int units, const char *prefix)
+{
+  bgpstream_plan_t *plan;
+  int rc = -1;
+
+  assert(bs->started);
+
+  if ((plan = bgpstream_plan_create(units)) == NULL) {
+    return -1;
+  }
+  if (bgpstream_di_mgr_list_resources(bs->di_mgr, plan_add, plan) < 0) {
+    goto done;
+  }
+  rc = bgpstream_plan_write(plan, prefix);
+
+done:
+  bgpstream_plan_destroy(plan);
+  return rc;
+}
+
+int bgpstream_get_checkpoint(bgpstream_t *bs, char *buf, size_t len)
+{
+  assert(bs->started);
+  return bgpstream_di_mgr_get_checkpoint(bs->di_mgr, buf, len);
+}
+
+void bgpstream_get_stats(bgpstream_stats_t *stats)
+{
+  bgpstream_stats_get(stats);
+}
+
+const char *bgpstream_stat_name(bgpstream_stat_t stat)
+{
+  return bgpstream_stats_name(stat);
+}
+
+void bgpstream_set_stats_timers(int enabled)
+{
+  bgpstream_stats_set_timers(enabled);
+}
+
+int bgpstream_get_kafka_stats(bgpstream_kafka_stats_t *stats, int stats_cnt)
+{
+  return bgpstream_stats_kafka_get(stats, stats_cnt);
+}
+
 /* destroy a bgpstream interface instance */
 void bgpstream_destroy(bgpstream_t *bs)
 {
@@ -246,6 +567,10 @@ void bgpstream_destroy(bgpstream_t *bs)
   bgpstream_filter_mgr_destroy(bs->filter_mgr);
   bs->filter_mgr = NULL;
 
+  // the readers destroyed above may have left parser messages and elems in
+  // the reuse cache of this thread
+  bgpstream_format_flush_caches();
+
   bs->started = 0;
 
   free(bs);
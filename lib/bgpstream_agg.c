@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include "bgpstream_agg.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_as_path.h"
+#include "bgpstream_utils_id_set.h"
+#include "bgpstream_utils_pfx_set.h"
+#include "bgpstream_utils_str_intern.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* the values of the keys an elem is grouped by (unused keys are 0) */
+typedef struct agg_key {
+  uint32_t project_id;
+  uint32_t collector_id;
+  uint32_t peer_asn;
+  uint32_t origin_asn;
+  bgpstream_ip_addr_t peer_ip;
+} agg_key_t;
+
+static inline khint32_t agg_key_hash(agg_key_t key)
+{
+  uint64_t h = ((uint64_t)key.collector_id << 32 | key.project_id) ^
+               ((uint64_t)key.origin_asn << 32 | key.peer_asn) * 0x9e3779b1;
+
+  if (key.peer_ip.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    h ^= bgpstream_addr_hash(&key.peer_ip);
+  }
+  return kh_int64_hash_func(h);
+}
+
+static inline int agg_key_equal(agg_key_t a, agg_key_t b)
+{
+  return a.project_id == b.project_id && a.collector_id == b.collector_id &&
+         a.peer_asn == b.peer_asn && a.origin_asn == b.origin_asn &&
+         (a.peer_ip.version == BGPSTREAM_ADDR_VERSION_UNKNOWN
+            ? b.peer_ip.version == BGPSTREAM_ADDR_VERSION_UNKNOWN
+            : bgpstream_addr_equal(&a.peer_ip, &b.peer_ip));
+}
+
+typedef struct agg_group {
+  agg_key_t key;
+  uint64_t elem_cnt[BGPSTREAM_AGG_ELEM_TYPE_CNT];
+  bgpstream_pfx_set_t *pfxs;
+  bgpstream_id_set_t *origins;
+} agg_group_t;
+
+KHASH_INIT(bsagg_groups, agg_key_t, agg_group_t *, 1, agg_key_hash,
+           agg_key_equal)
+
+struct bgpstream_agg {
+
+  uint32_t bin_size;
+  int keys;
+  bgpstream_agg_cb_t *cb;
+  void *user;
+
+  /* start of the current bin (valid once an elem has been added) */
+  uint32_t bin_time;
+  int bin_open;
+
+  bgpstream_str_intern_t *names;
+  bgpstream_str_intern_cache_t project_cache;
+  bgpstream_str_intern_cache_t collector_cache;
+
+  /* the groups of the current bin */
+  khash_t(bsagg_groups) * groups;
+
+  /* groups of previous bins, kept (with their sets) for reuse */
+  agg_group_t **free_groups;
+  int free_groups_cnt;
+  int free_groups_alloc_cnt;
+};
+
+static void group_destroy(agg_group_t *group)
+{
+  if (group == NULL) {
+    return;
+  }
+  bgpstream_pfx_set_destroy(group->pfxs);
+  bgpstream_id_set_destroy(group->origins);
+  free(group);
+}
+
+static agg_group_t *group_get(bgpstream_agg_t *agg, agg_key_t *key)
+{
+  khiter_t k;
+  int khret;
+  agg_group_t *group;
+
+  if ((k = kh_get(bsagg_groups, agg->groups, *key)) != kh_end(agg->groups)) {
+    return kh_val(agg->groups, k);
+  }
+
+  if (agg->free_groups_cnt > 0) {
+    group = agg->free_groups[--agg->free_groups_cnt];
+  } else if ((group = malloc_zero(sizeof(agg_group_t))) == NULL ||
+             (group->pfxs = bgpstream_pfx_set_create()) == NULL ||
+             (group->origins = bgpstream_id_set_create()) == NULL) {
+    group_destroy(group);
+    return NULL;
+  }
+  group->key = *key;
+
+  k = kh_put(bsagg_groups, agg->groups, group->key, &khret);
+  if (khret < 0) {
+    group_destroy(group);
+    return NULL;
+  }
+  kh_val(agg->groups, k) = group;
+  return group;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_agg_t *bgpstream_agg_create(uint32_t bin_size, int keys,
+                                      bgpstream_agg_cb_t *cb, void *user)
+{
+  bgpstream_agg_t *agg;
+
+  if (bin_size == 0 || cb == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid aggregation configuration");
+    return NULL;
+  }
+
+  if ((agg = malloc_zero(sizeof(bgpstream_agg_t))) == NULL) {
+    return NULL;
+  }
+  agg->bin_size = bin_size;
+  agg->keys = keys;
+  agg->cb = cb;
+  agg->user = user;
+  bgpstream_str_intern_cache_init(&agg->project_cache);
+  bgpstream_str_intern_cache_init(&agg->collector_cache);
+
+  if ((agg->names = bgpstream_str_intern_create()) == NULL ||
+      (agg->groups = kh_init(bsagg_groups)) == NULL) {
+    bgpstream_agg_destroy(agg);
+    return NULL;
+  }
+
+  return agg;
+}
+
+void bgpstream_agg_destroy(bgpstream_agg_t *agg)
+{
+  khiter_t k;
+  int i;
+
+  if (agg == NULL) {
+    return;
+  }
+  if (agg->groups != NULL) {
+    for (k = kh_begin(agg->groups); k != kh_end(agg->groups); ++k) {
+      if (kh_exist(agg->groups, k)) {
+        group_destroy(kh_val(agg->groups, k));
+      }
+    }
+    kh_destroy(bsagg_groups, agg->groups);
+  }
+  for (i = 0; i < agg->free_groups_cnt; i++) {
+    group_destroy(agg->free_groups[i]);
+  }
+  free(agg->free_groups);
+  bgpstream_str_intern_destroy(agg->names);
+  free(agg);
+}
+
+int bgpstream_agg_add(bgpstream_agg_t *agg, bgpstream_record_t *record,
+                      bgpstream_elem_t *elem)
+{
+  agg_key_t key;
+  agg_group_t *group;
+  uint32_t bin = record->time_sec - record->time_sec % agg->bin_size;
+  uint32_t origin = 0;
+  int has_origin = 0;
+  int rc = 0;
+
+  if (agg->bin_open == 0) {
+    agg->bin_time = bin;
+    agg->bin_open = 1;
+  } else if (bin > agg->bin_time) {
+    rc = bgpstream_agg_flush(agg);
+    agg->bin_time = bin;
+  }
+
+  if ((elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+       elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) &&
+      bgpstream_as_path_get_origin_val(elem->as_path, &origin) == 0) {
+    has_origin = 1;
+  }
+
+  memset(&key, 0, sizeof(key));
+  if (agg->keys & BGPSTREAM_AGG_KEY_COLLECTOR) {
+    if ((key.project_id = bgpstream_str_intern_cached(
+           agg->names, &agg->project_cache,
+           bgpstream_record_get_project_name(record))) ==
+          BGPSTREAM_STR_INTERN_NULL_ID ||
+        (key.collector_id = bgpstream_str_intern_cached(
+           agg->names, &agg->collector_cache,
+           bgpstream_record_get_collector_name(record))) ==
+          BGPSTREAM_STR_INTERN_NULL_ID) {
+      return -1;
+    }
+  }
+  if (agg->keys & BGPSTREAM_AGG_KEY_PEER) {
+    key.peer_asn = elem->peer_asn;
+    bgpstream_addr_copy(&key.peer_ip, &elem->peer_ip);
+  }
+  if (agg->keys & BGPSTREAM_AGG_KEY_ORIGIN) {
+    key.origin_asn = origin;
+  }
+
+  if ((group = group_get(agg, &key)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create aggregation group");
+    return -1;
+  }
+
+  if (elem->type < BGPSTREAM_AGG_ELEM_TYPE_CNT) {
+    group->elem_cnt[elem->type]++;
+  }
+  if ((elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+       elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT ||
+       elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL) &&
+      bgpstream_pfx_set_insert(group->pfxs, &elem->prefix) < 0) {
+    return -1;
+  }
+  if (has_origin && bgpstream_id_set_insert(group->origins, origin) < 0) {
+    return -1;
+  }
+
+  return rc;
+}
+
+int bgpstream_agg_flush(bgpstream_agg_t *agg)
+{
+  bgpstream_agg_result_t result;
+  agg_group_t *group;
+  agg_group_t **free_groups;
+  khiter_t k;
+  int alloc;
+  int stop = 0;
+
+  memset(&result, 0, sizeof(result));
+  result.bin_time = agg->bin_time;
+  result.bin_size = agg->bin_size;
+
+  // make room to keep every group for the next bin
+  if (kh_size(agg->groups) + agg->free_groups_cnt >
+      (khint_t)agg->free_groups_alloc_cnt) {
+    alloc = kh_size(agg->groups) + agg->free_groups_cnt;
+    if ((free_groups = realloc(agg->free_groups,
+                               sizeof(agg_group_t *) * alloc)) != NULL) {
+      agg->free_groups = free_groups;
+      agg->free_groups_alloc_cnt = alloc;
+    }
+  }
+
+  for (k = kh_begin(agg->groups); k != kh_end(agg->groups); ++k) {
+    if (!kh_exist(agg->groups, k)) {
+      continue;
+    }
+    group = kh_val(agg->groups, k);
+
+    if (stop == 0) {
+      result.project = bgpstream_str_intern_get(agg->names,
+                                                group->key.project_id);
+      result.collector = bgpstream_str_intern_get(agg->names,
+                                                  group->key.collector_id);
+      result.peer_asn = group->key.peer_asn;
+      bgpstream_addr_copy(&result.peer_ip, &group->key.peer_ip);
+      result.origin_asn = group->key.origin_asn;
+      memcpy(result.elem_cnt, group->elem_cnt, sizeof(result.elem_cnt));
+      result.pfx_cnt = bgpstream_pfx_set_size(group->pfxs);
+      result.origin_cnt = bgpstream_id_set_size(group->origins);
+      stop = agg->cb(&result, agg->user) != 0;
+    }
+
+    // keep the group (and the memory of its sets) for the next bin
+    if (agg->free_groups_cnt < agg->free_groups_alloc_cnt) {
+      memset(group->elem_cnt, 0, sizeof(group->elem_cnt));
+      bgpstream_pfx_set_clear(group->pfxs);
+      bgpstream_id_set_clear(group->origins);
+      agg->free_groups[agg->free_groups_cnt++] = group;
+    } else {
+      group_destroy(group);
+    }
+  }
+  kh_clear(bsagg_groups, agg->groups);
+
+  return stop;
+}
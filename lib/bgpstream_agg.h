@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_AGG_H_
+#define __BGPSTREAM_AGG_H_
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils_addr.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGPStream
+ * aggregation stage, which reduces elems to counts per time bin
+ *
+ * Elems are grouped by time bin (using the time of their record) and by any
+ * combination of collector, peer and origin ASN. When a bin ends, one result
+ * is reported for each group, with the number of elems of each type and the
+ * number of distinct prefixes and origin ASNs that were seen. Records are
+ * expected in (roughly) time order: a record older than the current bin is
+ * counted in the current bin.
+ */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Number of elem types counted in a result (indexed by
+ * bgpstream_elem_type_t) */
+#define BGPSTREAM_AGG_ELEM_TYPE_CNT (BGPSTREAM_ELEM_TYPE_PEERSTATE + 1)
+
+/** @} */
+
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** Keys that elems can be grouped by (may be OR-ed together) */
+typedef enum {
+
+  /** Group by the project and collector of the record */
+  BGPSTREAM_AGG_KEY_COLLECTOR = 0x1,
+
+  /** Group by peer ASN and peer address */
+  BGPSTREAM_AGG_KEY_PEER = 0x2,
+
+  /** Group by origin ASN (0 for elems without an AS path, or whose origin is
+      an AS set) */
+  BGPSTREAM_AGG_KEY_ORIGIN = 0x4,
+
+} bgpstream_agg_key_t;
+
+/** @} */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure representing an aggregation stage */
+typedef struct bgpstream_agg bgpstream_agg_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** The aggregates of one group in one time bin */
+typedef struct bgpstream_agg_result {
+
+  /** Start time of the bin (a multiple of the bin size) */
+  uint32_t bin_time;
+
+  /** Size of the bin, in seconds */
+  uint32_t bin_size;
+
+  /** Project and collector names (empty unless grouped by collector) */
+  const char *project;
+  const char *collector;
+
+  /** Peer ASN and address (0 and unknown unless grouped by peer) */
+  uint32_t peer_asn;
+  bgpstream_ip_addr_t peer_ip;
+
+  /** Origin ASN (0 unless grouped by origin) */
+  uint32_t origin_asn;
+
+  /** Number of elems of each type */
+  uint64_t elem_cnt[BGPSTREAM_AGG_ELEM_TYPE_CNT];
+
+  /** Number of distinct prefixes (of RIB, announcement and withdrawal
+      elems) */
+  uint32_t pfx_cnt;
+
+  /** Number of distinct origin ASNs */
+  uint32_t origin_cnt;
+
+} bgpstream_agg_result_t;
+
+/** @} */
+
+/**
+ * @name Public Callback Types
+ *
+ * @{ */
+
+/** Callback invoked for each group when a time bin ends
+ *
+ * @param result        borrowed pointer to the aggregates of the group (only
+ *                      valid until the callback returns)
+ * @param user          user pointer given to bgpstream_agg_create
+ * @return 0 to continue, or any other value to stop the stream
+ */
+typedef int(bgpstream_agg_cb_t)(const bgpstream_agg_result_t *result,
+                                void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new aggregation stage
+ *
+ * @param bin_size      size of the time bins, in seconds (must be > 0)
+ * @param keys          bitwise OR of the keys (bgpstream_agg_key_t) to group
+ *                      elems by, or 0 to aggregate all elems of a bin
+ *                      together
+ * @param cb            callback to invoke for each group of each bin
+ * @param user          user pointer to pass to the callback
+ * @return pointer to the aggregation stage if successful, NULL otherwise
+ */
+bgpstream_agg_t *bgpstream_agg_create(uint32_t bin_size, int keys,
+                                      bgpstream_agg_cb_t *cb, void *user);
+
+/** Destroy the given aggregation stage
+ *
+ * @param agg           pointer to the aggregation stage to destroy
+ *
+ * Groups of the current bin that were not flushed are dropped.
+ */
+void bgpstream_agg_destroy(bgpstream_agg_t *agg);
+
+/** Add an elem to the aggregates
+ *
+ * @param agg           pointer to the aggregation stage
+ * @param record        pointer to the record the elem belongs to
+ * @param elem          pointer to the elem to add
+ * @return 0 if the elem was added, 1 if the elem started a new bin and the
+ * callback asked to stop while reporting the previous one, -1 if an error
+ * occurred
+ */
+int bgpstream_agg_add(bgpstream_agg_t *agg, bgpstream_record_t *record,
+                      bgpstream_elem_t *elem);
+
+/** Report the groups of the current bin, and start an empty one
+ *
+ * @param agg           pointer to the aggregation stage
+ * @return 0 if all groups were reported, 1 if the callback asked to stop
+ *
+ * This should be called once the last elem has been added.
+ */
+int bgpstream_agg_flush(bgpstream_agg_t *agg);
+
+/** @} */
+
+#endif // __BGPSTREAM_AGG_H_
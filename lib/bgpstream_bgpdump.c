@@ -32,6 +32,7 @@
 #include "bgpstream_elem_int.h"
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_private.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -48,12 +49,38 @@
     written++;                                                                 \
   } while (0)
 
-#define SEEK_STR_END                                                           \
+#define ADD_STR(str)                                                           \
   do {                                                                         \
-    while (*buf_p != '\0') {                                                   \
-      written++;                                                               \
-      buf_p++;                                                                 \
+    c = bs_str_snprintf(buf_p, B_REMAIN, str, sizeof(str) - 1);                \
+    written += c;                                                              \
+    buf_p += c;                                                                \
+  } while (0)
+
+#define ADD_U32(val)                                                           \
+  do {                                                                         \
+    c = bs_u32_snprintf(buf_p, B_REMAIN, val);                                 \
+    written += c;                                                              \
+    buf_p += c;                                                                \
+  } while (0)
+
+#define ADD_ADDR(addr, err_msg)                                                \
+  do {                                                                         \
+    if ((c = bgpstream_addr_ntop_len(buf_p, B_REMAIN, addr)) < 0) {            \
+      bgpstream_log(BGPSTREAM_LOG_ERR, err_msg);                               \
+      return NULL;                                                             \
     }                                                                          \
+    written += c;                                                              \
+    buf_p += c;                                                                \
+  } while (0)
+
+#define ADD_PFX(pfx)                                                           \
+  do {                                                                         \
+    if ((c = bgpstream_pfx_snprintf_len(buf_p, B_REMAIN, pfx)) < 0) {          \
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix");                    \
+      return NULL;                                                             \
+    }                                                                          \
+    written += c;                                                              \
+    buf_p += c;                                                                \
   } while (0)
 
 char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
@@ -70,66 +97,51 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
   /* Record type */
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "TABLE_DUMP2|%" PRIu32, record->time_sec);
+    ADD_STR("TABLE_DUMP2|");
+    ADD_U32(record->time_sec);
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "BGP4MP|%" PRIu32, record->time_sec);
+    ADD_STR("BGP4MP|");
+    ADD_U32(record->time_sec);
     break;
   default:
-    c = 0;
     break;
   }
-  written += c;
-  buf_p += c;
   ADD_PIPE;
 
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "B");
+    ADD_STR("B");
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
-    c = snprintf(buf_p, B_REMAIN, "A");
+    ADD_STR("A");
     break;
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
-    c = snprintf(buf_p, B_REMAIN, "W");
+    ADD_STR("W");
     break;
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "STATE");
+    ADD_STR("STATE");
     break;
   default:
-    c = 0;
     break;
   }
-
-  written += c;
-  buf_p += c;
   ADD_PIPE;
 
   /* PEER IP */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed peer address");
-    return NULL;
-  }
-  SEEK_STR_END;
+  ADD_ADDR(&elem->peer_ip, "Malformed peer address");
   ADD_PIPE;
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
-  written += c;
-  buf_p += c;
+  ADD_U32(elem->peer_asn);
   ADD_PIPE;
 
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix");
-      return NULL;
-    }
-    SEEK_STR_END;
+    ADD_PFX(&elem->prefix);
     ADD_PIPE;
 
     /* AS PATH */
@@ -142,40 +154,29 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
     /* SOURCE (IGP) */
     switch (elem->origin) {
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_IGP:
-      c = snprintf(buf_p, B_REMAIN, "IGP");
+      ADD_STR("IGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_EGP:
-      c = snprintf(buf_p, B_REMAIN, "EGP");
+      ADD_STR("EGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_INCOMPLETE:
-      c = snprintf(buf_p, B_REMAIN, "INCOMPLETE");
+      ADD_STR("INCOMPLETE");
       break;
     default:
-      c = 0;
       break;
     }
-    written += c;
-    buf_p += c;
     ADD_PIPE;
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed next_hop IP address");
-      return NULL;
-    }
-    SEEK_STR_END;
+    ADD_ADDR(&elem->nexthop, "Malformed next_hop IP address");
     ADD_PIPE;
 
     /* LOCAL_PREF */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->local_pref);
-    written += c;
-    buf_p += c;
+    ADD_U32(elem->local_pref);
     ADD_PIPE;
 
     /* MED */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->med);
-    written += c;
-    buf_p += c;
+    ADD_U32(elem->med);
     ADD_PIPE;
 
     /* COMMUNITIES */
@@ -187,26 +188,18 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
 
     /* AGGREGATE AG/NAG */
     if (elem->atomic_aggregate == 1) {
-      c = snprintf(buf_p, B_REMAIN, "AG");
+      ADD_STR("AG");
     } else {
-      c = snprintf(buf_p, B_REMAIN, "NAG");
+      ADD_STR("NAG");
     }
-    written += c;
-    buf_p += c;
     ADD_PIPE;
 
     /* AGGREGATOR AS AND IP */
     if (elem->aggregator.has_aggregator > 0) {
-      c = snprintf(buf_p, B_REMAIN, "%" PRIu32 " ",
-                   elem->aggregator.aggregator_asn);
-      written += c;
-      buf_p += c;
-      if (bgpstream_addr_ntop(buf_p, B_REMAIN,
-                              &elem->aggregator.aggregator_addr) == NULL) {
-        bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed aggregator IP address");
-        return NULL;
-      }
-      SEEK_STR_END;
+      ADD_U32(elem->aggregator.aggregator_asn);
+      ADD_STR(" ");
+      ADD_ADDR(&elem->aggregator.aggregator_addr,
+               "Malformed aggregator IP address");
     }
 
     ADD_PIPE;
@@ -214,16 +207,12 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
     break;
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix");
-      return NULL;
-    }
-    SEEK_STR_END;
+    ADD_PFX(&elem->prefix);
     break;
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "%u|%u", elem->old_state, elem->new_state);
-    written += c;
-    buf_p += c;
+    ADD_U32(elem->old_state);
+    ADD_STR("|");
+    ADD_U32(elem->new_state);
     break;
   default:
     break;
@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_binary.h"
+#include "bgpstream_log.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <string.h>
+
+/* size of the scratch buffer used to rebuild an AS path while reading */
+#define PATH_BUF_LEN 8192
+
+/* names read from frames are interned in a table shared by all callers, since
+   the records they populate don't belong to a stream */
+static bgpstream_str_intern_t *frame_names = NULL;
+static pthread_once_t frame_names_once = PTHREAD_ONCE_INIT;
+
+static void frame_names_init(void)
+{
+  frame_names = bgpstream_str_intern_create();
+}
+
+#define PUT(bytes, src)                                                        \
+  do {                                                                         \
+    if (len - written < (bytes)) {                                             \
+      return -1;                                                               \
+    }                                                                          \
+    memcpy(buf + written, (src), (bytes));                                     \
+    written += (bytes);                                                        \
+  } while (0)
+
+#define PUT_U8(val)                                                            \
+  do {                                                                         \
+    uint8_t u8 = (val);                                                        \
+    PUT(1, &u8);                                                               \
+  } while (0)
+
+#define PUT_U16(val)                                                           \
+  do {                                                                         \
+    uint16_t u16 = htons(val);                                                 \
+    PUT(2, &u16);                                                              \
+  } while (0)
+
+#define PUT_U32(val)                                                           \
+  do {                                                                         \
+    uint32_t u32 = htonl(val);                                                 \
+    PUT(4, &u32);                                                              \
+  } while (0)
+
+#define GET(bytes, dst)                                                        \
+  do {                                                                         \
+    if (len - read < (bytes)) {                                                \
+      return -1;                                                               \
+    }                                                                          \
+    memcpy((dst), buf + read, (bytes));                                        \
+    read += (bytes);                                                           \
+  } while (0)
+
+#define GET_U8(dst)                                                            \
+  do {                                                                         \
+    uint8_t u8;                                                                \
+    GET(1, &u8);                                                               \
+    (dst) = u8;                                                                \
+  } while (0)
+
+#define GET_U16(dst)                                                           \
+  do {                                                                         \
+    uint16_t u16;                                                              \
+    GET(2, &u16);                                                              \
+    (dst) = ntohs(u16);                                                        \
+  } while (0)
+
+#define GET_U32(dst)                                                           \
+  do {                                                                         \
+    uint32_t u32;                                                              \
+    GET(4, &u32);                                                              \
+    (dst) = ntohl(u32);                                                        \
+  } while (0)
+
+static ssize_t write_str(uint8_t *buf, size_t len, const char *str)
+{
+  size_t written = 0;
+  size_t str_len = strnlen(str, BGPSTREAM_UTILS_STR_NAME_LEN - 1);
+  PUT_U8(str_len);
+  PUT(str_len, str);
+  return written;
+}
+
+static ssize_t write_addr(uint8_t *buf, size_t len,
+                          const bgpstream_ip_addr_t *addr)
+{
+  size_t written = 0;
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    PUT_U8(4);
+    PUT(sizeof(addr->bs_ipv4.addr), &addr->bs_ipv4.addr);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    PUT_U8(6);
+    PUT(sizeof(addr->bs_ipv6.addr), &addr->bs_ipv6.addr);
+    break;
+  default:
+    PUT_U8(0);
+    break;
+  }
+  return written;
+}
+
+static ssize_t write_as_path(uint8_t *buf, size_t len,
+                             const bgpstream_as_path_t *path)
+{
+  size_t written = 0;
+  bgpstream_as_path_iter_t iter;
+  bgpstream_as_path_seg_t *seg;
+  int i;
+
+  /* the segment count is written once we know it */
+  size_t cnt_offset = written;
+  uint16_t seg_cnt = 0;
+  PUT_U16(0);
+
+  bgpstream_as_path_iter_reset(&iter);
+  while ((seg = bgpstream_as_path_get_next_seg(path, &iter)) != NULL) {
+    PUT_U8(seg->type);
+    if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+      PUT_U8(1);
+      PUT_U32(seg->asn.asn);
+    } else {
+      PUT_U8(seg->set.asn_cnt);
+      for (i = 0; i < seg->set.asn_cnt; i++) {
+        PUT_U32(seg->set.asn[i]);
+      }
+    }
+    seg_cnt++;
+  }
+
+  seg_cnt = htons(seg_cnt);
+  memcpy(buf + cnt_offset, &seg_cnt, sizeof(seg_cnt));
+  return written;
+}
+
+static ssize_t write_communities(uint8_t *buf, size_t len,
+                                 const bgpstream_community_set_t *set)
+{
+  size_t written = 0;
+  const bgpstream_community_t *comm;
+  int cnt = bgpstream_community_set_size(set);
+  int i;
+
+  PUT_U16(cnt);
+  for (i = 0; i < cnt; i++) {
+    comm = bgpstream_community_set_get(set, i);
+    PUT_U16(comm->asn);
+    PUT_U16(comm->value);
+  }
+  return written;
+}
+
+#define PUT_FIELD(func, arg)                                                   \
+  do {                                                                         \
+    ssize_t rc;                                                                \
+    if ((rc = func(buf + written, len - written, (arg))) < 0) {                \
+      return -1;                                                               \
+    }                                                                          \
+    written += rc;                                                             \
+  } while (0)
+
+#define GET_FIELD(func, arg)                                                   \
+  do {                                                                         \
+    ssize_t rc;                                                                \
+    if ((rc = func(buf + read, len - read, (arg))) < 0) {                      \
+      return -1;                                                               \
+    }                                                                          \
+    read += rc;                                                                \
+  } while (0)
+
+static ssize_t read_str(const uint8_t *buf, size_t len, const char **str)
+{
+  size_t read = 0;
+  uint8_t str_len;
+  char tmp[BGPSTREAM_UTILS_STR_NAME_LEN];
+  uint32_t id;
+  GET_U8(str_len);
+  if (str_len >= BGPSTREAM_UTILS_STR_NAME_LEN) {
+    return -1;
+  }
+  GET(str_len, tmp);
+  tmp[str_len] = '\0';
+  pthread_once(&frame_names_once, frame_names_init);
+  if (frame_names == NULL ||
+      (id = bgpstream_str_intern(frame_names, tmp)) ==
+        BGPSTREAM_STR_INTERN_NULL_ID ||
+      (*str = bgpstream_str_intern_get(frame_names, id)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not intern frame name");
+    return -1;
+  }
+  return read;
+}
+
+static ssize_t read_addr(const uint8_t *buf, size_t len,
+                         bgpstream_ip_addr_t *addr)
+{
+  size_t read = 0;
+  uint8_t version;
+  GET_U8(version);
+  switch (version) {
+  case 4:
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    GET(sizeof(addr->bs_ipv4.addr), &addr->bs_ipv4.addr);
+    break;
+  case 6:
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    GET(sizeof(addr->bs_ipv6.addr), &addr->bs_ipv6.addr);
+    break;
+  case 0:
+    addr->version = BGPSTREAM_ADDR_VERSION_UNKNOWN;
+    break;
+  default:
+    return -1;
+  }
+  return read;
+}
+
+static ssize_t read_as_path(const uint8_t *buf, size_t len,
+                            bgpstream_as_path_t *path)
+{
+  size_t read = 0;
+  uint8_t path_buf[PATH_BUF_LEN];
+  size_t path_len = 0;
+  bgpstream_as_path_seg_asn_t asn_seg;
+  bgpstream_as_path_seg_set_t set_seg;
+  uint16_t seg_cnt;
+  uint8_t type, asn_cnt;
+  uint32_t asn;
+  int i, j;
+
+  GET_U16(seg_cnt);
+  for (i = 0; i < seg_cnt; i++) {
+    GET_U8(type);
+    GET_U8(asn_cnt);
+    if (type == BGPSTREAM_AS_PATH_SEG_ASN) {
+      if (asn_cnt != 1 || path_len + sizeof(asn_seg) > sizeof(path_buf)) {
+        return -1;
+      }
+      asn_seg.type = type;
+      GET_U32(asn_seg.asn);
+      memcpy(path_buf + path_len, &asn_seg, sizeof(asn_seg));
+      path_len += sizeof(asn_seg);
+    } else if (type == BGPSTREAM_AS_PATH_SEG_SET ||
+               type == BGPSTREAM_AS_PATH_SEG_CONFED_SEQ ||
+               type == BGPSTREAM_AS_PATH_SEG_CONFED_SET) {
+      if (path_len + sizeof(set_seg) + asn_cnt * sizeof(uint32_t) >
+          sizeof(path_buf)) {
+        return -1;
+      }
+      set_seg.type = type;
+      set_seg.asn_cnt = asn_cnt;
+      memcpy(path_buf + path_len, &set_seg, sizeof(set_seg));
+      path_len += sizeof(set_seg);
+      for (j = 0; j < asn_cnt; j++) {
+        GET_U32(asn);
+        memcpy(path_buf + path_len, &asn, sizeof(asn));
+        path_len += sizeof(asn);
+      }
+    } else {
+      return -1;
+    }
+  }
+
+  if (bgpstream_as_path_populate_from_data(path, path_buf, path_len) != 0) {
+    return -1;
+  }
+  return read;
+}
+
+static ssize_t read_communities(const uint8_t *buf, size_t len,
+                                bgpstream_community_set_t *set)
+{
+  size_t read = 0;
+  bgpstream_community_t comm;
+  uint16_t cnt;
+  int i;
+
+  bgpstream_community_set_clear(set);
+  GET_U16(cnt);
+  for (i = 0; i < cnt; i++) {
+    GET_U16(comm.asn);
+    GET_U16(comm.value);
+    if (bgpstream_community_set_insert(set, &comm) != 0) {
+      return -1;
+    }
+  }
+  return read;
+}
+
+/* the elem fields that follow the elem type */
+static ssize_t write_elem_body(uint8_t *buf, size_t len,
+                               const bgpstream_elem_t *elem)
+{
+  size_t written = 0;
+
+  PUT_U32(elem->orig_time_sec);
+  PUT_U32(elem->orig_time_usec);
+  PUT_FIELD(write_addr, &elem->peer_ip);
+  PUT_U32(elem->peer_asn);
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    PUT_FIELD(write_addr, &elem->prefix.address);
+    PUT_U8(elem->prefix.mask_len);
+    PUT_FIELD(write_addr, &elem->nexthop);
+    PUT_U8(elem->origin);
+    PUT_U32(elem->med);
+    PUT_U32(elem->local_pref);
+    PUT_U8(elem->atomic_aggregate);
+    PUT_U8(elem->aggregator.has_aggregator);
+    if (elem->aggregator.has_aggregator) {
+      PUT_U32(elem->aggregator.aggregator_asn);
+      PUT_FIELD(write_addr, &elem->aggregator.aggregator_addr);
+    }
+    PUT_FIELD(write_as_path, elem->as_path);
+    PUT_FIELD(write_communities, elem->communities);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    PUT_FIELD(write_addr, &elem->prefix.address);
+    PUT_U8(elem->prefix.mask_len);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    PUT_U8(elem->old_state);
+    PUT_U8(elem->new_state);
+    break;
+
+  default:
+    break;
+  }
+  return written;
+}
+
+/* the elem fields that follow the elem type (which must already be set) */
+static ssize_t read_elem_body(const uint8_t *buf, size_t len,
+                              bgpstream_elem_t *elem)
+{
+  size_t read = 0;
+
+  GET_U32(elem->orig_time_sec);
+  GET_U32(elem->orig_time_usec);
+  GET_FIELD(read_addr, &elem->peer_ip);
+  GET_U32(elem->peer_asn);
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    GET_FIELD(read_addr, &elem->prefix.address);
+    GET_U8(elem->prefix.mask_len);
+    GET_FIELD(read_addr, &elem->nexthop);
+    GET_U8(elem->origin);
+    GET_U32(elem->med);
+    GET_U32(elem->local_pref);
+    GET_U8(elem->atomic_aggregate);
+    GET_U8(elem->aggregator.has_aggregator);
+    if (elem->aggregator.has_aggregator) {
+      GET_U32(elem->aggregator.aggregator_asn);
+      GET_FIELD(read_addr, &elem->aggregator.aggregator_addr);
+    }
+    GET_FIELD(read_as_path, elem->as_path);
+    GET_FIELD(read_communities, elem->communities);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    GET_FIELD(read_addr, &elem->prefix.address);
+    GET_U8(elem->prefix.mask_len);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    GET_U8(elem->old_state);
+    GET_U8(elem->new_state);
+    break;
+
+  default:
+    break;
+  }
+  return read;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+ssize_t bgpstream_record_elem_binary_write(uint8_t *buf, size_t len,
+                                           const bgpstream_record_t *record,
+                                           const bgpstream_elem_t *elem)
+{
+  size_t written = 0;
+  uint32_t frame_len;
+
+  /* the length prefix is written once the frame is complete */
+  PUT_U32(0);
+
+  PUT_U8(BGPSTREAM_BINARY_VERSION);
+  PUT_U8(record->type);
+  PUT_U8(record->dump_pos);
+  PUT_U8(elem->type);
+  PUT_U32(record->time_sec);
+  PUT_U32(record->time_usec);
+  PUT_U32(record->dump_time_sec);
+  PUT_FIELD(write_str, bgpstream_record_get_project_name(record));
+  PUT_FIELD(write_str, bgpstream_record_get_collector_name(record));
+  PUT_FIELD(write_str, bgpstream_record_get_router_name(record));
+  PUT_FIELD(write_addr, &record->router_ip);
+
+  PUT_FIELD(write_elem_body, elem);
+
+  frame_len = htonl(written - BGPSTREAM_BINARY_HDR_LEN);
+  memcpy(buf, &frame_len, sizeof(frame_len));
+  return written;
+}
+
+ssize_t bgpstream_record_elem_binary_read(const uint8_t *buf, size_t len,
+                                          bgpstream_record_t *record,
+                                          bgpstream_elem_t *elem)
+{
+  size_t read = 0;
+  uint32_t frame_len;
+  uint8_t version;
+
+  if (len < BGPSTREAM_BINARY_HDR_LEN) {
+    return 0;
+  }
+  GET_U32(frame_len);
+  if (len - read < frame_len) {
+    return 0;
+  }
+  /* never read past the end of this frame */
+  len = read + frame_len;
+
+  GET_U8(version);
+  if (version != BGPSTREAM_BINARY_VERSION) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Unsupported binary frame version %d",
+                  version);
+    return -1;
+  }
+
+  bgpstream_elem_clear(elem);
+
+  GET_U8(record->type);
+  GET_U8(record->dump_pos);
+  GET_U8(elem->type);
+  if (record->type >= _BGPSTREAM_RECORD_TYPE_CNT ||
+      record->dump_pos > BGPSTREAM_DUMP_END ||
+      elem->type > BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return -1;
+  }
+  record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
+  GET_U32(record->time_sec);
+  GET_U32(record->time_usec);
+  GET_U32(record->dump_time_sec);
+  GET_FIELD(read_str, &record->project_name);
+  GET_FIELD(read_str, &record->collector_name);
+  GET_FIELD(read_str, &record->router_name);
+  GET_FIELD(read_addr, &record->router_ip);
+
+  GET_FIELD(read_elem_body, elem);
+
+  if (read != len) {
+    return -1;
+  }
+  return read;
+}
+
+ssize_t bgpstream_elem_binary_write(uint8_t *buf, size_t len,
+                                    const bgpstream_elem_t *elem)
+{
+  size_t written = 0;
+
+  PUT_U8(elem->type);
+  PUT_FIELD(write_elem_body, elem);
+  return written;
+}
+
+ssize_t bgpstream_elem_binary_read(const uint8_t *buf, size_t len,
+                                   bgpstream_elem_t *elem)
+{
+  size_t read = 0;
+
+  bgpstream_elem_clear(elem);
+
+  GET_U8(elem->type);
+  if (elem->type > BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return -1;
+  }
+  GET_FIELD(read_elem_body, elem);
+  return read;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_BINARY_H_
+#define __BGPSTREAM_BINARY_H_
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils.h"
+#include <sys/types.h>
+
+/** @file
+ *
+ * @brief Compact, length-prefixed binary encoding of record/elem pairs
+ *
+ * Each frame starts with a 32-bit length (network byte order) of the rest of
+ * the frame, followed by a version byte, the record header fields that are
+ * meaningful outside of BGPStream (type, dump position, times and names) and
+ * the elem. All integers are in network byte order, so frames can be passed
+ * between hosts.
+ */
+
+/** Version of the binary frame encoding */
+#define BGPSTREAM_BINARY_VERSION 1
+
+/** Length of the frame length prefix */
+#define BGPSTREAM_BINARY_HDR_LEN 4
+
+/** Write the binary representation of the record/elem into the provided
+ * buffer
+ *
+ * @param buf           pointer to a byte array
+ * @param len           length of the byte array
+ * @param record        pointer to a BGP Stream Record to encode
+ * @param elem          pointer to a BGP Stream Elem to encode
+ * @return the number of bytes written if successful, -1 if the buffer is too
+ * small
+ */
+ssize_t bgpstream_record_elem_binary_write(uint8_t *buf, size_t len,
+                                           const bgpstream_record_t *record,
+                                           const bgpstream_elem_t *elem);
+
+/** Read a binary record/elem frame from the provided buffer
+ *
+ * @param buf           pointer to a byte array holding (part of) a frame
+ * @param len           number of bytes in the byte array
+ * @param[out] record   pointer to a record to populate
+ * @param[out] elem     pointer to an elem (created with bgpstream_elem_create)
+ *                      to populate
+ * @return the number of bytes consumed if a frame was read, 0 if the buffer
+ * does not hold a complete frame, -1 if the frame is malformed
+ *
+ * Only the public header fields of the record are populated, so the record
+ * cannot be used to retrieve further elems.
+ */
+ssize_t bgpstream_record_elem_binary_read(const uint8_t *buf, size_t len,
+                                          bgpstream_record_t *record,
+                                          bgpstream_elem_t *elem);
+
+/** Write the binary representation of just the elem into the provided buffer
+ *
+ * @param buf           pointer to a byte array
+ * @param len           length of the byte array
+ * @param elem          pointer to a BGP Stream Elem to encode
+ * @return the number of bytes written if successful, -1 if the buffer is too
+ * small
+ *
+ * The elem is encoded exactly as in a record/elem frame, but without a length
+ * prefix, version or record header. This is for containers that store the
+ * record header (and length) themselves.
+ */
+ssize_t bgpstream_elem_binary_write(uint8_t *buf, size_t len,
+                                    const bgpstream_elem_t *elem);
+
+/** Read an elem written by bgpstream_elem_binary_write
+ *
+ * @param buf           pointer to a byte array
+ * @param len           number of bytes in the byte array
+ * @param[out] elem     pointer to an elem (created with bgpstream_elem_create)
+ *                      to populate
+ * @return the number of bytes consumed if successful, -1 if the elem is
+ * malformed or truncated
+ */
+ssize_t bgpstream_elem_binary_read(const uint8_t *buf, size_t len,
+                                   bgpstream_elem_t *elem);
+
+#endif // __BGPSTREAM_BINARY_H_
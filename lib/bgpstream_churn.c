@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_churn.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* a route removed by the end of a dump, waiting to be emitted */
+typedef struct removed_route {
+  bgpstream_peer_id_t peer_id;
+  bgpstream_pfx_t pfx;
+} removed_route_t;
+
+struct bgpstream_churn {
+
+  bgpstream_rib_t *rib;
+
+  /* the synthetic withdrawal elem */
+  bgpstream_elem_t *elem;
+
+  /* routes removed by the end of the current dump */
+  removed_route_t *removed;
+  size_t removed_cnt;
+  size_t removed_alloc_cnt;
+  size_t removed_next;
+  int draining;
+};
+
+static int add_removed(bgpstream_peer_id_t peer_id, const bgpstream_pfx_t *pfx,
+                       const bgpstream_rib_route_t *route, void *user)
+{
+  bgpstream_churn_t *churn = user;
+  removed_route_t *removed;
+
+  if (churn->removed_cnt == churn->removed_alloc_cnt) {
+    if ((removed = realloc(churn->removed,
+                           sizeof(removed_route_t) *
+                             (churn->removed_alloc_cnt * 2 + 64))) == NULL) {
+      // the route is still removed, it will just not be reported
+      bgpstream_log(BGPSTREAM_LOG_WARN, "Could not queue removed route");
+      return 0;
+    }
+    churn->removed = removed;
+    churn->removed_alloc_cnt = churn->removed_alloc_cnt * 2 + 64;
+  }
+  churn->removed[churn->removed_cnt].peer_id = peer_id;
+  bgpstream_pfx_copy(&churn->removed[churn->removed_cnt].pfx, pfx);
+  churn->removed_cnt++;
+  return 0;
+}
+
+bgpstream_churn_t *bgpstream_churn_create(void)
+{
+  bgpstream_churn_t *churn;
+
+  if ((churn = malloc_zero(sizeof(bgpstream_churn_t))) == NULL) {
+    return NULL;
+  }
+  if ((churn->rib = bgpstream_rib_create()) == NULL ||
+      (churn->elem = bgpstream_elem_create()) == NULL) {
+    bgpstream_churn_destroy(churn);
+    return NULL;
+  }
+  return churn;
+}
+
+void bgpstream_churn_destroy(bgpstream_churn_t *churn)
+{
+  if (churn == NULL) {
+    return;
+  }
+  bgpstream_rib_destroy(churn->rib);
+  bgpstream_elem_destroy(churn->elem);
+  free(churn->removed);
+  free(churn);
+}
+
+int bgpstream_churn_check(bgpstream_churn_t *churn, bgpstream_record_t *record,
+                          bgpstream_elem_t *elem)
+{
+  int rc;
+
+  if ((rc = bgpstream_rib_apply(churn->rib, record, elem)) < 0) {
+    return -1;
+  }
+  if (elem->type != BGPSTREAM_ELEM_TYPE_RIB) {
+    return 1;
+  }
+  if (rc == 0) {
+    return 0;
+  }
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  return 1;
+}
+
+int bgpstream_churn_get_removed(bgpstream_churn_t *churn,
+                                bgpstream_record_t *record,
+                                bgpstream_elem_t **elemp)
+{
+  removed_route_t *route;
+  bgpstream_peer_sig_t *sig;
+
+  *elemp = NULL;
+
+  if (record->type != BGPSTREAM_RIB || record->dump_pos != BGPSTREAM_DUMP_END) {
+    return 0;
+  }
+
+  if (churn->draining == 0) {
+    churn->removed_cnt = 0;
+    churn->removed_next = 0;
+    if (bgpstream_rib_expire(churn->rib,
+                             bgpstream_record_get_collector_name(record),
+                             record->dump_time_sec, add_removed, churn) < 0) {
+      return -1;
+    }
+    churn->draining = 1;
+  }
+
+  if (churn->removed_next == churn->removed_cnt) {
+    // the next call (e.g., for the next dump) starts over
+    churn->draining = 0;
+    return 0;
+  }
+
+  route = &churn->removed[churn->removed_next++];
+  if ((sig = bgpstream_peer_sig_map_get_sig(
+         bgpstream_rib_get_peer_sig_map(churn->rib), route->peer_id)) == NULL) {
+    return -1;
+  }
+  bgpstream_elem_clear(churn->elem);
+  churn->elem->type = BGPSTREAM_ELEM_TYPE_WITHDRAWAL;
+  churn->elem->orig_time_sec = record->time_sec;
+  bgpstream_addr_copy(&churn->elem->peer_ip, &sig->peer_ip_addr);
+  churn->elem->peer_asn = sig->peer_asnumber;
+  bgpstream_pfx_copy(&churn->elem->prefix, &route->pfx);
+  *elemp = churn->elem;
+  return 1;
+}
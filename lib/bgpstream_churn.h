@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_CHURN_H
+#define __BGPSTREAM_CHURN_H
+
+#include "bgpstream.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the private interface of the RIB diff
+ * mode, which reduces consecutive RIB dumps to the routes that changed
+ * between them
+ */
+
+/** Opaque structure holding the routes seen so far by a stream */
+typedef struct bgpstream_churn bgpstream_churn_t;
+
+/** Create a new, empty churn tracker
+ *
+ * @return pointer to the tracker if successful, NULL otherwise
+ */
+bgpstream_churn_t *bgpstream_churn_create(void);
+
+/** Destroy the given churn tracker
+ *
+ * @param churn         pointer to the tracker to destroy
+ */
+void bgpstream_churn_destroy(bgpstream_churn_t *churn);
+
+/** Apply an elem to the tracked routes, and decide whether to emit it
+ *
+ * @param churn         pointer to the tracker
+ * @param record        pointer to the record the elem belongs to
+ * @param elem          pointer to the elem
+ * @return 1 if the elem should be emitted, 0 if it should be skipped, -1 if
+ * an error occurred
+ *
+ * Update elems are always emitted. RIB elems are only emitted (as
+ * announcements) if the route is new or changed since the previous dump.
+ */
+int bgpstream_churn_check(bgpstream_churn_t *churn, bgpstream_record_t *record,
+                          bgpstream_elem_t *elem);
+
+/** Get the next route removed by the end of a RIB dump
+ *
+ * @param churn         pointer to the tracker
+ * @param record        pointer to the record whose elems were all read
+ * @param[out] elemp    set to a borrowed withdrawal elem
+ * @return 1 if a withdrawal was returned, 0 if there are no more, -1 if an
+ * error occurred
+ *
+ * This is called once the elems of a record have all been read. When the
+ * record ends a RIB dump, the routes of the collector that the dump did not
+ * refresh are returned as withdrawals, one per call.
+ */
+int bgpstream_churn_get_removed(bgpstream_churn_t *churn,
+                                bgpstream_record_t *record,
+                                bgpstream_elem_t **elemp);
+
+#endif /* __BGPSTREAM_CHURN_H */
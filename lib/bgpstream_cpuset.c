@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "bgpstream_cpuset.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// highest CPU number (+1) that can be named in a set
+#define CPUS_MAX 1024
+
+struct bgpstream_cpuset {
+
+  uint64_t mask[CPUS_MAX / 64];
+
+};
+
+// parse a CPU number, and return a pointer to the first character after it
+// (or NULL if there is no number)
+static const char *parse_cpu(const char *p, long *cpu)
+{
+  char *endp;
+
+  if (*p < '0' || *p > '9') {
+    return NULL;
+  }
+  *cpu = strtol(p, &endp, 10);
+  return endp;
+}
+
+/* ==================== PUBLIC API BELOW HERE ==================== */
+
+bgpstream_cpuset_t *bgpstream_cpuset_create(const char *list)
+{
+  bgpstream_cpuset_t *cpus;
+  long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+  long first, last, i;
+  const char *p = list;
+
+  if (ncpus <= 0 || ncpus > CPUS_MAX) {
+    ncpus = CPUS_MAX;
+  }
+
+  if ((cpus = malloc_zero(sizeof(bgpstream_cpuset_t))) == NULL) {
+    return NULL;
+  }
+
+  while (1) {
+    if ((p = parse_cpu(p, &first)) == NULL) {
+      goto err;
+    }
+    last = first;
+    if (*p == '-' && (p = parse_cpu(p + 1, &last)) == NULL) {
+      goto err;
+    }
+    if (last < first || last >= ncpus) {
+      goto err;
+    }
+    for (i = first; i <= last; i++) {
+      cpus->mask[i / 64] |= UINT64_C(1) << (i % 64);
+    }
+    if (*p == '\0') {
+      break;
+    }
+    if (*p++ != ',') {
+      goto err;
+    }
+  }
+
+  return cpus;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid CPU list '%s' (%ld CPUs)", list,
+                ncpus);
+  free(cpus);
+  return NULL;
+}
+
+void bgpstream_cpuset_destroy(bgpstream_cpuset_t *cpus)
+{
+  free(cpus);
+}
+
+int bgpstream_cpuset_thread_create(const bgpstream_cpuset_t *cpus,
+                                   pthread_t *thread, void *(*func)(void *),
+                                   void *user)
+{
+#ifdef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+  pthread_attr_t attr;
+  cpu_set_t set;
+  int i, ret;
+
+  if (cpus == NULL) {
+    return pthread_create(thread, NULL, func, user);
+  }
+
+  CPU_ZERO(&set);
+  for (i = 0; i < CPUS_MAX && i < CPU_SETSIZE; i++) {
+    if ((cpus->mask[i / 64] & (UINT64_C(1) << (i % 64))) != 0) {
+      CPU_SET(i, &set);
+    }
+  }
+  if ((ret = pthread_attr_init(&attr)) != 0) {
+    return ret;
+  }
+  if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not pin thread, running unpinned");
+    pthread_attr_destroy(&attr);
+    return pthread_create(thread, NULL, func, user);
+  }
+  ret = pthread_create(thread, &attr, func, user);
+  pthread_attr_destroy(&attr);
+  return ret;
+#else
+  (void)cpus;
+  return pthread_create(thread, NULL, func, user);
+#endif
+}
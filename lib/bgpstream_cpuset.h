@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_CPUSET_H
+#define __BGPSTREAM_CPUSET_H
+
+#include <pthread.h>
+
+/** @file
+ *
+ * @brief Header file for the set of CPUs that worker threads (resource
+ * openers, and parallel decoders and decompressors) are pinned to.
+ */
+
+/** Opaque structure representing a set of CPUs */
+typedef struct bgpstream_cpuset bgpstream_cpuset_t;
+
+/** Create a CPU set from a list of CPUs
+ *
+ * @param list          comma-separated list of CPU numbers and ranges (e.g.,
+ *                      "0-7,16-23")
+ * @return pointer to the CPU set if successful, NULL if the list is invalid,
+ * or names a CPU that this machine does not have
+ */
+bgpstream_cpuset_t *bgpstream_cpuset_create(const char *list);
+
+/** Destroy the given CPU set
+ *
+ * @param cpus          pointer to the CPU set to destroy
+ */
+void bgpstream_cpuset_destroy(bgpstream_cpuset_t *cpus);
+
+/** Start a thread that may only run on the given CPUs
+ *
+ * @param cpus          pointer to the CPU set, or NULL to let the thread run
+ *                      anywhere
+ * @param thread        set to the handle of the new thread
+ * @param func          function run by the thread
+ * @param user          user pointer passed to the function
+ * @return 0 if the thread was started, an error number otherwise (see
+ * pthread_create)
+ *
+ * The thread is pinned from its first instruction, so (with the default
+ * first-touch memory policy) the buffers that it allocates and fills are
+ * placed on the memory of the node that it runs on. If the platform cannot
+ * pin threads, the thread is started unpinned.
+ */
+int bgpstream_cpuset_thread_create(const bgpstream_cpuset_t *cpus,
+                                   pthread_t *thread, void *(*func)(void *),
+                                   void *user);
+
+#endif /* __BGPSTREAM_CPUSET_H */
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_dedup.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+
+/* the last update seen for a (peer, prefix) */
+typedef struct dedup_entry {
+  uint32_t hash;
+  uint32_t time;
+} dedup_entry_t;
+
+/* hash of (peer, prefix) -> last update */
+KHASH_INIT(bsdedup, uint64_t, dedup_entry_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+
+struct bgpstream_dedup {
+
+  uint32_t window;
+
+  /* updates of the current window, and of the previous one */
+  khash_t(bsdedup) * cur;
+  khash_t(bsdedup) * prev;
+
+  /* start time of the current window */
+  uint32_t cur_start;
+  int started;
+};
+
+static uint64_t mix64(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t key_hash(bgpstream_elem_t *elem)
+{
+  return mix64(bgpstream_addr_hash(&elem->peer_ip) ^
+               ((uint64_t)elem->peer_asn << 32)) ^
+         bgpstream_pfx_hash(&elem->prefix);
+}
+
+static uint32_t update_hash(bgpstream_elem_t *elem)
+{
+  uint64_t h = elem->type;
+
+  if (elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
+    h = mix64(h ^ bgpstream_as_path_hash64(elem->as_path));
+    h = mix64(h ^ bgpstream_community_set_hash(elem->communities));
+  }
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+bgpstream_dedup_t *bgpstream_dedup_create(uint32_t window)
+{
+  bgpstream_dedup_t *dedup;
+
+  if (window == 0 || (dedup = malloc_zero(sizeof(bgpstream_dedup_t))) == NULL) {
+    return NULL;
+  }
+  dedup->window = window;
+  if ((dedup->cur = kh_init(bsdedup)) == NULL ||
+      (dedup->prev = kh_init(bsdedup)) == NULL) {
+    bgpstream_dedup_destroy(dedup);
+    return NULL;
+  }
+  return dedup;
+}
+
+void bgpstream_dedup_destroy(bgpstream_dedup_t *dedup)
+{
+  if (dedup == NULL) {
+    return;
+  }
+  kh_destroy(bsdedup, dedup->cur);
+  kh_destroy(bsdedup, dedup->prev);
+  free(dedup);
+}
+
+int bgpstream_dedup_check(bgpstream_dedup_t *dedup, bgpstream_record_t *record,
+                          bgpstream_elem_t *elem)
+{
+  khash_t(bsdedup) * tmp;
+  dedup_entry_t *entry = NULL;
+  uint32_t now = record->time_sec;
+  uint64_t key;
+  uint32_t hash;
+  khiter_t k;
+  int khret;
+  int in_cur = 0;
+  int dup;
+
+  if (elem->type != BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT &&
+      elem->type != BGPSTREAM_ELEM_TYPE_WITHDRAWAL) {
+    return 0;
+  }
+
+  // start a new window (the current one becomes the previous one, and the
+  // previous one is forgotten)
+  if (dedup->started == 0) {
+    dedup->cur_start = now;
+    dedup->started = 1;
+  } else if (now >= dedup->cur_start + dedup->window) {
+    kh_clear(bsdedup, dedup->prev);
+    if (now < dedup->cur_start + 2 * dedup->window) {
+      tmp = dedup->prev;
+      dedup->prev = dedup->cur;
+      dedup->cur = tmp;
+    } else {
+      kh_clear(bsdedup, dedup->cur);
+    }
+    dedup->cur_start = now;
+  }
+
+  key = key_hash(elem);
+  hash = update_hash(elem);
+
+  if ((k = kh_get(bsdedup, dedup->cur, key)) != kh_end(dedup->cur)) {
+    entry = &kh_val(dedup->cur, k);
+    in_cur = 1;
+  } else if ((k = kh_get(bsdedup, dedup->prev, key)) != kh_end(dedup->prev)) {
+    entry = &kh_val(dedup->prev, k);
+  }
+  // records are not strictly in time order, so the time may go backwards
+  dup = entry != NULL && entry->hash == hash &&
+        (now > entry->time ? now - entry->time : entry->time - now) <=
+          dedup->window;
+
+  // the time of the first of a run of duplicates is kept, so that a steady
+  // stream of duplicates cannot keep an update alive forever
+  if (dup && in_cur) {
+    return 1;
+  }
+  if (!in_cur) {
+    k = kh_put(bsdedup, dedup->cur, key, &khret);
+    if (khret < 0) {
+      return -1;
+    }
+  }
+  if (dup) {
+    // moved up from the previous window
+    kh_val(dedup->cur, k) = *entry;
+    return 1;
+  }
+  kh_val(dedup->cur, k).hash = hash;
+  kh_val(dedup->cur, k).time = now;
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_DEDUP_H
+#define __BGPSTREAM_DEDUP_H
+
+#include "bgpstream.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the private interface of the duplicate
+ * update suppression stage
+ *
+ * The same update is often received several times: a peer may feed several
+ * collectors, and the same collector may be read from more than one source
+ * (e.g., RIS Live and the RIS MRT dumps). For each (peer, prefix), the stage
+ * remembers a hash of the last update (type, AS path and communities) and its
+ * time, and an update is a duplicate if it has the same hash as the last one
+ * seen within the time window. State older than the window is forgotten, so
+ * memory is bounded by the number of (peer, prefix) pairs updated within two
+ * windows.
+ */
+
+/** Opaque structure holding the state of the stage */
+typedef struct bgpstream_dedup bgpstream_dedup_t;
+
+/** Create a new duplicate suppression stage
+ *
+ * @param window        size of the time window, in seconds (must be > 0)
+ * @return pointer to the stage if successful, NULL otherwise
+ */
+bgpstream_dedup_t *bgpstream_dedup_create(uint32_t window);
+
+/** Destroy the given duplicate suppression stage
+ *
+ * @param dedup         pointer to the stage to destroy
+ */
+void bgpstream_dedup_destroy(bgpstream_dedup_t *dedup);
+
+/** Check whether an elem duplicates a recent one
+ *
+ * @param dedup         pointer to the stage
+ * @param record        pointer to the record the elem belongs to
+ * @param elem          pointer to the elem to check
+ * @return 1 if the elem is a duplicate, 0 if it is not, -1 if an error
+ * occurred
+ *
+ * Only announcements and withdrawals are checked, other elems are never
+ * duplicates.
+ */
+int bgpstream_dedup_check(bgpstream_dedup_t *dedup, bgpstream_record_t *record,
+                          bgpstream_elem_t *elem);
+
+#endif /* __BGPSTREAM_DEDUP_H */
@@ -26,12 +26,15 @@
 
 #include "bgpstream_di_mgr.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
 #include "config.h"
+#include "khash.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -54,6 +57,10 @@
 #include "bsdi_sqlite.h"
 #endif
 
+#ifdef WITH_DATA_INTERFACE_LOCALDIR
+#include "bsdi_localdir.h"
+#endif
+
 #ifdef WITH_DATA_INTERFACE_BROKER
 #include "bsdi_broker.h"
 #endif
@@ -65,12 +72,47 @@
 /* Wait at most 150 seconds if the broker has no new data for us */
 #define DATA_INTERFACE_BLOCKING_MAX_WAIT 150
 
+/* Poll this many seconds after a file is expected to have been published */
+#define CADENCE_POLL_SLACK 5
+/* Never wait more than 15 minutes for an expected file */
+#define CADENCE_MAX_WAIT 900
+/* Publication delays longer than an hour are from a backlog, not the
+   collector's usual latency */
+#define CADENCE_MAX_DELAY 3600
+/* Adopt a longer interval between dumps once it has been seen this many
+   times in a row */
+#define CADENCE_RELEARN_CNT 4
+
+/* What has been learnt about how often a collector publishes a type of dump,
+   and how long after the end of the dump it is listed */
+typedef struct cadence {
+  // start of the newest dump seen
+  uint32_t last_time;
+  // duration of the newest dump seen
+  uint32_t duration;
+  // interval between the start of consecutive dumps (0 until known)
+  uint32_t period;
+  // number of consecutive intervals longer than period
+  int slower_cnt;
+  // typical time between the end of a dump and it being listed
+  uint32_t delay;
+  int delay_known;
+} cadence_t;
+
+/* hash of (project, collector, record type) -> cadence */
+KHASH_INIT(bsdi_cadence, uint64_t, cadence_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+
 #define ACTIVE_DI (di_mgr->interfaces[di_mgr->active_di])
 
 struct bgpstream_di_mgr {
 
+  // interfaces are allocated the first time they are used
   bsdi_t *interfaces[_BGPSTREAM_DATA_INTERFACE_CNT];
 
+  // filter manager given to the interfaces when they are allocated
+  bgpstream_filter_mgr_t *filter_mgr;
+
   bgpstream_data_interface_id_t *available_dis;
   int available_dis_cnt;
 
@@ -92,6 +134,10 @@ struct bgpstream_di_mgr {
   int next_poll;
   int poll_freq;
   int poll_cnt;
+
+  // publication cadence of each collector, used to poll for new dumps just
+  // after they are expected
+  khash_t(bsdi_cadence) * cadence;
 };
 
 /** Convenience typedef for the interface alloc function type */
@@ -136,6 +182,12 @@ static const di_alloc_func_t di_alloc_functions[] = {
   NULL,
 #endif
 
+#ifdef WITH_DATA_INTERFACE_LOCALDIR
+  bsdi_localdir_alloc,
+#else
+  NULL,
+#endif
+
 };
 
 #define GET_DEFAULT_STR_VALUE(var_store, default_value)                        \
@@ -202,13 +254,149 @@ static bsdi_t *di_alloc(bgpstream_filter_mgr_t *filter_mgr,
   return di;
 }
 
+// get the static class of the given interface (info, options and methods),
+// without allocating it
+static bsdi_t *get_class(bgpstream_data_interface_id_t id)
+{
+  if (id > 0 && id < _BGPSTREAM_DATA_INTERFACE_CNT &&
+      di_alloc_functions[id] != NULL) {
+    return di_alloc_functions[id]();
+  }
+  return NULL;
+}
+
+// get the given interface, allocating it if this is the first time it is used
 static bsdi_t *get_di(bgpstream_di_mgr_t *di_mgr,
                       bgpstream_data_interface_id_t id)
 {
-  if (id > 0 && id < _BGPSTREAM_DATA_INTERFACE_CNT) {
-    return di_mgr->interfaces[id]; // could be NULL
+  if (get_class(id) == NULL) {
+    return NULL; // not enabled
   }
-  return NULL;
+  if (di_mgr->interfaces[id] == NULL) {
+    di_mgr->interfaces[id] = di_alloc(di_mgr->filter_mgr, di_mgr->res_mgr, id);
+  }
+  return di_mgr->interfaces[id]; // NULL if init failed
+}
+
+static uint64_t cadence_key(const bgpstream_resource_t *res)
+{
+  const char *strs[] = {res->project, res->collector};
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  const unsigned char *p;
+  unsigned i;
+
+  for (i = 0; i < ARR_CNT(strs); i++) {
+    for (p = (const unsigned char *)strs[i]; p != NULL && *p != '\0'; p++) {
+      h = (h ^ *p) * 1099511628211ULL;
+    }
+    h = (h ^ 0xff) * 1099511628211ULL; // separator
+  }
+  return (h ^ res->record_type) * 1099511628211ULL;
+}
+
+// told by the resource manager about each dump that is listed
+static void cadence_learn(const bgpstream_resource_t *res, void *user)
+{
+  bgpstream_di_mgr_t *di_mgr = (bgpstream_di_mgr_t *)user;
+  cadence_t *c;
+  khiter_t k;
+  int khret;
+  int64_t delay;
+  uint32_t gap;
+
+  k = kh_put(bsdi_cadence, di_mgr->cadence, cadence_key(res), &khret);
+  if (khret < 0) {
+    return; // only an optimization, so ignore the failure
+  }
+  c = &kh_val(di_mgr->cadence, k);
+  if (khret == 0) {
+    if (res->initial_time <= c->last_time) {
+      return; // an older dump listed late
+    }
+    gap = res->initial_time - c->last_time;
+    // missing dumps make the occasional gap longer, so only a run of them
+    // means that the collector has slowed down
+    if (c->period == 0 || gap < c->period) {
+      c->period = gap;
+      c->slower_cnt = 0;
+    } else if (gap > c->period) {
+      if (++c->slower_cnt >= CADENCE_RELEARN_CNT) {
+        c->period = gap;
+        c->slower_cnt = 0;
+      }
+    } else {
+      c->slower_cnt = 0;
+    }
+  } else {
+    memset(c, 0, sizeof(*c));
+  }
+  c->last_time = res->initial_time;
+  c->duration = res->duration;
+
+  // the listed time is only an upper bound on when the dump was published,
+  // so the delay follows decreases at once and increases slowly
+  delay = (int64_t)res->listed_time - res->initial_time - res->duration;
+  if (delay < 0) {
+    delay = 0;
+  }
+  if (delay > CADENCE_MAX_DELAY) {
+    return;
+  }
+  if (c->delay_known == 0 || delay < c->delay) {
+    c->delay = delay;
+    c->delay_known = 1;
+  } else {
+    c->delay = (7 * (uint64_t)c->delay + delay) / 8;
+  }
+}
+
+// the time at which the next dump of any collector is expected to be listed,
+// or 0 if no cadence is known. a dump that is overdue by more than one period
+// is assumed to be missing, and the one after it is expected instead.
+static uint32_t cadence_next(bgpstream_di_mgr_t *di_mgr, uint32_t now)
+{
+  cadence_t *c;
+  khiter_t k;
+  uint64_t next, best = 0;
+
+  for (k = kh_begin(di_mgr->cadence); k != kh_end(di_mgr->cadence); k++) {
+    if (!kh_exist(di_mgr->cadence, k)) {
+      continue;
+    }
+    c = &kh_val(di_mgr->cadence, k);
+    if (c->period == 0 || c->delay_known == 0) {
+      continue;
+    }
+    next = (uint64_t)c->last_time + c->period + c->duration + c->delay;
+    if (next + c->period < now) {
+      next += ((now - next) / c->period + 1) * c->period;
+    }
+    if (best == 0 || next < best) {
+      best = next;
+    }
+  }
+  return best > UINT32_MAX ? UINT32_MAX : best;
+}
+
+// how long to wait before asking the data interface for new resources. if
+// the collectors' cadence is known, poll just after the next dump is
+// expected, otherwise (or if it is late) use the given backoff
+static int poll_wait(bgpstream_di_mgr_t *di_mgr, int backoff)
+{
+  uint32_t now = epoch_sec();
+  uint32_t next = cadence_next(di_mgr, now);
+  uint32_t wait;
+
+  if (next <= now) {
+    return backoff;
+  }
+  wait = next - now + CADENCE_POLL_SLACK;
+  if (wait > CADENCE_MAX_WAIT) {
+    wait = CADENCE_MAX_WAIT;
+  }
+  bgpstream_log(BGPSTREAM_LOG_FINE, "Next dump expected in %" PRIu32 "s",
+                next - now);
+  return wait;
 }
 
 /* ========== PUBLIC FUNCTIONS BELOW HERE ========== */
@@ -226,11 +414,17 @@ bgpstream_di_mgr_t *bgpstream_di_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
   if ((mgr->res_mgr = bgpstream_resource_mgr_create(filter_mgr)) == NULL) {
     goto err;
   }
+  if ((mgr->cadence = kh_init(bsdi_cadence)) == NULL) {
+    goto err;
+  }
+  bgpstream_resource_mgr_set_push_cb(mgr->res_mgr, cadence_learn, mgr);
+  mgr->filter_mgr = filter_mgr;
   mgr->active_di = BGPSTREAM_DATA_INTERFACE_BROKER;
   mgr->backoff_time = DATA_INTERFACE_BLOCKING_MIN_WAIT;
   mgr->poll_freq = DATA_INTERFACE_BLOCKING_MIN_WAIT;
 
-  /* allocate the interfaces (some may/will be NULL) */
+  /* list the interfaces, but only allocate them once they are used, since
+     initializing some of them (e.g., kafka) is expensive */
   for (id = 0; id < _BGPSTREAM_DATA_INTERFACE_CNT; id++) {
     if ((mgr->available_dis = realloc(
            mgr->available_dis, sizeof(bgpstream_data_interface_id_t) *
@@ -238,7 +432,6 @@ bgpstream_di_mgr_t *bgpstream_di_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
       goto err;
     }
     mgr->available_dis[mgr->available_dis_cnt++] = id;
-    mgr->interfaces[id] = di_alloc(filter_mgr, mgr->res_mgr, id);
   }
 
   return mgr;
@@ -277,8 +470,8 @@ bgpstream_data_interface_info_t *
 bgpstream_di_mgr_get_data_interface_info(bgpstream_di_mgr_t *di_mgr,
                                          bgpstream_data_interface_id_t if_id)
 {
-  if (get_di(di_mgr, if_id) != NULL) {
-    return &get_di(di_mgr, if_id)->info;
+  if (get_class(if_id) != NULL) {
+    return &get_class(if_id)->info;
   }
   return NULL;
 }
@@ -287,9 +480,9 @@ int bgpstream_di_mgr_get_data_interface_options(
   bgpstream_di_mgr_t *di_mgr, bgpstream_data_interface_id_t if_id,
   bgpstream_data_interface_option_t **opts)
 {
-  if (get_di(di_mgr, if_id) != NULL) {
-    *opts = get_di(di_mgr, if_id)->opts;
-    return get_di(di_mgr, if_id)->opts_cnt;
+  if (get_class(if_id) != NULL) {
+    *opts = get_class(if_id)->opts;
+    return get_class(if_id)->opts_cnt;
   }
   *opts = NULL;
   return 0;
@@ -298,7 +491,7 @@ int bgpstream_di_mgr_get_data_interface_options(
 int bgpstream_di_mgr_set_data_interface(bgpstream_di_mgr_t *di_mgr,
                                         bgpstream_data_interface_id_t di_id)
 {
-  if (di_mgr->interfaces[di_id] == NULL) {
+  if (get_di(di_mgr, di_id) == NULL) {
     return -1;
   }
   di_mgr->active_di = di_id;
@@ -327,7 +520,8 @@ int bgpstream_di_mgr_set_data_interface_option(
 
 int bgpstream_di_mgr_start(bgpstream_di_mgr_t *di_mgr)
 {
-  if (di_mgr == NULL || ACTIVE_DI == NULL) {
+  // the default interface may not have been allocated yet
+  if (di_mgr == NULL || get_di(di_mgr, di_mgr->active_di) == NULL) {
     return -1;
   }
   return ACTIVE_DI->start(ACTIVE_DI);
@@ -338,6 +532,78 @@ void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr)
   di_mgr->blocking = 1;
 }
 
+int bgpstream_di_mgr_set_reader_threads(bgpstream_di_mgr_t *di_mgr,
+                                        int threads)
+{
+  return bgpstream_resource_mgr_set_reader_threads(di_mgr->res_mgr, threads);
+}
+
+int bgpstream_di_mgr_set_prefetch_depth(bgpstream_di_mgr_t *di_mgr, int depth)
+{
+  return bgpstream_resource_mgr_set_prefetch_depth(di_mgr->res_mgr, depth);
+}
+
+int bgpstream_di_mgr_set_download_ahead(bgpstream_di_mgr_t *di_mgr, int depth,
+                                        uint64_t max_rate)
+{
+  return bgpstream_resource_mgr_set_download_ahead(di_mgr->res_mgr, depth,
+                                                   max_rate);
+}
+
+void bgpstream_di_mgr_set_memory_budget(bgpstream_di_mgr_t *di_mgr,
+                                        uint64_t bytes)
+{
+  bgpstream_resource_mgr_set_memory_budget(di_mgr->res_mgr, bytes);
+}
+
+void bgpstream_di_mgr_set_reorder_delay(bgpstream_di_mgr_t *di_mgr,
+                                        uint32_t msec)
+{
+  bgpstream_resource_mgr_set_reorder_delay(di_mgr->res_mgr, msec);
+}
+
+int bgpstream_di_mgr_set_shard(bgpstream_di_mgr_t *di_mgr, int index,
+                               int count)
+{
+  return bgpstream_resource_mgr_set_shard(di_mgr->res_mgr, index, count);
+}
+
+int bgpstream_di_mgr_get_checkpoint(bgpstream_di_mgr_t *di_mgr, char *buf,
+                                    size_t len)
+{
+  return bgpstream_resource_mgr_get_checkpoint(di_mgr->res_mgr, buf, len);
+}
+
+int bgpstream_di_mgr_set_checkpoint(bgpstream_di_mgr_t *di_mgr,
+                                    const char *checkpoint)
+{
+  return bgpstream_resource_mgr_set_checkpoint(di_mgr->res_mgr, checkpoint);
+}
+
+// stamps a record that is about to be returned to the consumer and counts its
+// lags
+static void mark_delivered(bgpstream_record_t *record)
+{
+  struct timeval tv;
+
+  if (gettimeofday(&tv, NULL) != 0) {
+    return;
+  }
+  record->delivered_time_sec = tv.tv_sec;
+  record->delivered_time_usec = tv.tv_usec;
+
+  // the lags are only meaningful for records with a collection time
+  if (record->time_sec == 0) {
+    return;
+  }
+  bgpstream_stats_add_lag(BGPSTREAM_LAG_LISTED, (int64_t)record->listed_time_sec
+                                                  - record->time_sec);
+  bgpstream_stats_add_lag(BGPSTREAM_LAG_READ,
+                          (int64_t)record->read_time_sec - record->time_sec);
+  bgpstream_stats_add_lag(BGPSTREAM_LAG_DELIVERED,
+                          (int64_t)tv.tv_sec - record->time_sec);
+}
+
 int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
                                      bgpstream_record_t **record)
 {
@@ -373,7 +639,8 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
         }
         di_mgr->poll_cnt++;
       }
-      di_mgr->next_poll = epoch_sec() + di_mgr->poll_freq;
+      di_mgr->next_poll =
+        epoch_sec() + poll_wait(di_mgr, di_mgr->poll_freq);
     }
 
     // if the queue is not empty, then grab a record
@@ -384,6 +651,7 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
         return -1;
       }
       if (rc > 0) {
+        mark_delivered(*record);
         break;
       }
       // must be EOS, try immediately to refill the queue
@@ -399,7 +667,7 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
     assert(bgpstream_resource_mgr_empty(di_mgr->res_mgr) != 0);
 
     // we're in blocking mode, so we sleep
-    if (sleep(di_mgr->backoff_time) != 0) {
+    if (sleep(poll_wait(di_mgr, di_mgr->backoff_time)) != 0) {
       // interrupted
       return -1;
     }
@@ -419,6 +687,60 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
   return rc;
 }
 
+int bgpstream_di_mgr_list_resources(bgpstream_di_mgr_t *di_mgr,
+                                    bgpstream_resource_mgr_drain_cb_t *cb,
+                                    void *user)
+{
+  int cnt = 0, rc;
+
+  if (di_mgr->blocking != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Resources cannot be listed in live mode");
+    return -1;
+  }
+
+  while (1) {
+    if (ACTIVE_DI->update_resources(ACTIVE_DI) != 0) {
+      return -1;
+    }
+    if (bgpstream_resource_mgr_empty(di_mgr->res_mgr) != 0) {
+      // the interface has nothing more to offer
+      break;
+    }
+    if ((rc = bgpstream_resource_mgr_drain(di_mgr->res_mgr, cb, user)) < 0) {
+      return -1;
+    }
+    cnt += rc;
+  }
+
+  return cnt;
+}
+
+int bgpstream_di_mgr_get_next_records(bgpstream_di_mgr_t *di_mgr,
+                                      bgpstream_record_t **records, int max)
+{
+  int rc, i;
+
+  if (max <= 0) {
+    return 0;
+  }
+
+  bgpstream_resource_mgr_begin_batch(di_mgr->res_mgr);
+
+  // wait for the first record as usual, then take whatever else is ready
+  if ((rc = bgpstream_di_mgr_get_next_record(di_mgr, &records[0])) > 0 &&
+      (rc = bgpstream_resource_mgr_get_records(di_mgr->res_mgr, &records[1],
+                                               max - 1)) >= 0) {
+    for (i = 1; i <= rc; i++) {
+      mark_delivered(records[i]);
+    }
+    rc++;
+  }
+
+  bgpstream_resource_mgr_end_batch(di_mgr->res_mgr);
+  return rc;
+}
+
 void bgpstream_di_mgr_destroy(bgpstream_di_mgr_t *di_mgr)
 {
   if (di_mgr == NULL) {
@@ -428,6 +750,11 @@ void bgpstream_di_mgr_destroy(bgpstream_di_mgr_t *di_mgr)
   bgpstream_resource_mgr_destroy(di_mgr->res_mgr);
   di_mgr->res_mgr = NULL;
 
+  if (di_mgr->cadence != NULL) {
+    kh_destroy(bsdi_cadence, di_mgr->cadence);
+    di_mgr->cadence = NULL;
+  }
+
   free(di_mgr->available_dis);
   di_mgr->available_dis = NULL;
   di_mgr->available_dis_cnt = 0;
@@ -132,6 +132,80 @@ int bgpstream_di_mgr_set_data_interface_option(
  */
 void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr);
 
+/** Set the number of threads used to open resources
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param threads       number of opener threads, or 0 for one per resource
+ * @return 0 if the value was set successfully, -1 otherwise
+ */
+int bgpstream_di_mgr_set_reader_threads(bgpstream_di_mgr_t *di_mgr,
+                                        int threads);
+
+/** Set the number of records that each reader decodes in the background
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param depth         number of records to decode ahead, or 0 to disable
+ * @return 0 if the value was set successfully, -1 otherwise
+ */
+int bgpstream_di_mgr_set_prefetch_depth(bgpstream_di_mgr_t *di_mgr, int depth);
+
+/** Download cached resources ahead of the ones being read
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param depth         number of timestamps to download ahead, or 0 to disable
+ * @param max_rate      maximum download rate in bytes per second, or 0 for no
+ *                      limit
+ * @return 0 if the values were set successfully, -1 otherwise
+ */
+int bgpstream_di_mgr_set_download_ahead(bgpstream_di_mgr_t *di_mgr, int depth,
+                                        uint64_t max_rate);
+
+/** Set the approximate amount of memory that open readers may use
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param bytes         memory budget in bytes, or 0 for no limit
+ */
+void bgpstream_di_mgr_set_memory_budget(bgpstream_di_mgr_t *di_mgr,
+                                        uint64_t bytes);
+
+/** Set how long to wait for each resource to open before reading without it
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param msec          maximum wait in msec, or 0 to always wait
+ */
+void bgpstream_di_mgr_set_reorder_delay(bgpstream_di_mgr_t *di_mgr,
+                                        uint32_t msec);
+
+/** Only process the resources that belong to the given shard
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param index         index of this shard (0 to count-1)
+ * @param count         total number of shards, or 0 to disable sharding
+ * @return 0 if the shard was set successfully, -1 otherwise
+ */
+int bgpstream_di_mgr_set_shard(bgpstream_di_mgr_t *di_mgr, int index,
+                               int count);
+
+/** Serialize the position of the consumer in the stream
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param buf           buffer to write the checkpoint into
+ * @param len           length of the buffer
+ * @return the length of the checkpoint (truncated if >= len), or -1 if an
+ * error occurred
+ */
+int bgpstream_di_mgr_get_checkpoint(bgpstream_di_mgr_t *di_mgr, char *buf,
+                                    size_t len);
+
+/** Resume the stream from a checkpoint
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param checkpoint    borrowed pointer to the checkpoint string
+ * @return 0 if the checkpoint was loaded successfully, -1 otherwise
+ */
+int bgpstream_di_mgr_set_checkpoint(bgpstream_di_mgr_t *di_mgr,
+                                    const char *checkpoint);
+
 /** Start the data interface
  *
  * @param di_mgr        pointer to a data interface manager instance
@@ -141,6 +215,23 @@ void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr);
  */
 int bgpstream_di_mgr_start(bgpstream_di_mgr_t *di_mgr);
 
+/** List the resources of the stream without reading them
+ *
+ * @param di_mgr          pointer to a data interface manager instance
+ * @param cb              function called for each resource that matches the
+ *                        filters
+ * @param user            user data passed to the callback
+ * @return the number of resources listed, or -1 if an error occurred
+ *
+ * The data interface is polled until it has no more resources to offer, so
+ * this cannot be used in live mode. It is an alternative to reading records
+ * from the stream, and must not be mixed with
+ * bgpstream_di_mgr_get_next_record.
+ */
+int bgpstream_di_mgr_list_resources(bgpstream_di_mgr_t *di_mgr,
+                                    bgpstream_resource_mgr_drain_cb_t *cb,
+                                    void *user);
+
 /** Get the next record from the stream
  *
  * @param di_mgr          pointer to a data interface manager instance
@@ -155,6 +246,22 @@ int bgpstream_di_mgr_start(bgpstream_di_mgr_t *di_mgr);
 int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
                                      bgpstream_record_t **record);
 
+/** Get a batch of records from the stream
+ *
+ * @param di_mgr          pointer to a data interface manager instance
+ * @param[out] records    array of at least `max` record pointers, filled with
+ *                        borrowed pointers to records
+ * @param max             maximum number of records to get
+ * @return the number of records read (>0), 0 if end-of-stream has been
+ * reached, <0 if an error occurred.
+ *
+ * This blocks (as bgpstream_di_mgr_get_next_record does) only until the first
+ * record is available. All records in the batch remain valid until the next
+ * call to this function or to bgpstream_di_mgr_get_next_record.
+ */
+int bgpstream_di_mgr_get_next_records(bgpstream_di_mgr_t *di_mgr,
+                                      bgpstream_record_t **records, int max);
+
 /** Destroy the given data interface manager
  *
  * @param di_mgr        pointer to a data interface manager instance to destroy
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_dispatch.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of records to read (and keep valid) at a time */
+#define DISPATCH_BATCH 256
+
+/* Number of elems that can be queued for each worker (power of two) */
+#define DISPATCH_QUEUE_LEN 4096
+
+/* Number of times an idle worker polls its queue before it sleeps */
+#define DISPATCH_SPIN 256
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+struct dispatch_slot {
+  /** Borrowed record (valid until the end of the batch) */
+  bgpstream_record_t *record;
+
+  /** Copy of the elem (owned, reused) */
+  bgpstream_elem_t *elem;
+};
+
+struct dispatch;
+
+struct dispatch_worker {
+
+  struct dispatch *d;
+
+  int idx;
+
+  pthread_t thread;
+
+  /** Single-producer, single-consumer ring of elems */
+  struct dispatch_slot *slots;
+
+  /** Next slot to process (only written by the worker) */
+  uint32_t head __attribute__((aligned(64)));
+
+  /** Next slot to fill (only written by the dispatcher) */
+  uint32_t tail __attribute__((aligned(64)));
+
+  /** Set while the worker is (about to be) waiting on cond */
+  int sleeping;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+struct dispatch {
+
+  struct dispatch_worker *workers;
+  int workers_cnt;
+  int workers_started;
+
+  bgpstream_worker_cb_t cb;
+  void *user;
+
+  /** Set when a callback asks to stop */
+  int stop;
+
+  /** Set when the workers should exit */
+  int shutdown;
+
+  /** Set while the dispatcher is waiting for a worker to make progress */
+  int waiting;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+static void *worker_thread(void *user)
+{
+  struct dispatch_worker *w = (struct dispatch_worker *)user;
+  struct dispatch *d = w->d;
+  struct dispatch_slot *slot;
+  uint32_t head = w->head;
+  int spin = 0;
+
+  while (1) {
+    if (head == __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE)) {
+      if (LOAD(d->shutdown)) {
+        break;
+      }
+      if (spin++ < DISPATCH_SPIN) {
+        sched_yield();
+        continue;
+      }
+      // nothing queued, sleep until the dispatcher adds an elem
+      pthread_mutex_lock(&w->mutex);
+      STORE(w->sleeping, 1);
+      if (head == LOAD(w->tail) && !LOAD(d->shutdown)) {
+        pthread_cond_wait(&w->cond, &w->mutex);
+      }
+      STORE(w->sleeping, 0);
+      pthread_mutex_unlock(&w->mutex);
+      spin = 0;
+      continue;
+    }
+
+    slot = &w->slots[head & (DISPATCH_QUEUE_LEN - 1)];
+    // once asked to stop, the rest of the queue is discarded
+    if (!__atomic_load_n(&d->stop, __ATOMIC_RELAXED) &&
+        d->cb(w->idx, slot->record, slot->elem, d->user) != 0) {
+      STORE(d->stop, 1);
+    }
+    STORE(w->head, ++head);
+    spin = 0;
+
+    if (LOAD(d->waiting)) {
+      pthread_mutex_lock(&d->mutex);
+      pthread_cond_broadcast(&d->cond);
+      pthread_mutex_unlock(&d->mutex);
+    }
+  }
+
+  return NULL;
+}
+
+static void wake_worker(struct dispatch_worker *w)
+{
+  if (LOAD(w->sleeping)) {
+    pthread_mutex_lock(&w->mutex);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+  }
+}
+
+static int worker_full(struct dispatch_worker *w)
+{
+  return LOAD(w->tail) - LOAD(w->head) >= DISPATCH_QUEUE_LEN;
+}
+
+static int all_drained(struct dispatch *d)
+{
+  int i;
+  for (i = 0; i < d->workers_started; i++) {
+    if (LOAD(d->workers[i].head) != LOAD(d->workers[i].tail)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* wait until the given worker has room in its queue, or, if w is NULL, until
+   all the queues are empty */
+static void wait_workers(struct dispatch *d, struct dispatch_worker *w)
+{
+  if (w != NULL ? !worker_full(w) : all_drained(d)) {
+    return;
+  }
+  pthread_mutex_lock(&d->mutex);
+  STORE(d->waiting, 1);
+  while (w != NULL ? worker_full(w) : !all_drained(d)) {
+    pthread_cond_wait(&d->cond, &d->mutex);
+  }
+  STORE(d->waiting, 0);
+  pthread_mutex_unlock(&d->mutex);
+}
+
+static int push_elem(struct dispatch *d, struct dispatch_worker *w,
+                     bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  struct dispatch_slot *slot;
+
+  wait_workers(d, w);
+
+  slot = &w->slots[w->tail & (DISPATCH_QUEUE_LEN - 1)];
+  if (slot->elem == NULL && (slot->elem = bgpstream_elem_create()) == NULL) {
+    return -1;
+  }
+  if (bgpstream_elem_copy(slot->elem, elem) == NULL) {
+    return -1;
+  }
+  slot->record = record;
+
+  STORE(w->tail, w->tail + 1);
+  wake_worker(w);
+  return 0;
+}
+
+static uint64_t mix64(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t collector_hash(bgpstream_record_t *record)
+{
+  /* FNV-1a over the project and collector names */
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const char *c;
+  for (c = bgpstream_record_get_project_name(record); *c != '\0'; c++) {
+    h = (h ^ (uint8_t)*c) * 0x100000001b3ULL;
+  }
+  h = (h ^ '.') * 0x100000001b3ULL;
+  for (c = bgpstream_record_get_collector_name(record); *c != '\0'; c++) {
+    h = (h ^ (uint8_t)*c) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static uint64_t elem_key(bgpstream_dispatch_key_t key, uint64_t coll_hash,
+                         bgpstream_elem_t *elem)
+{
+  switch (key) {
+  case BGPSTREAM_DISPATCH_COLLECTOR:
+    return coll_hash;
+
+  case BGPSTREAM_DISPATCH_PREFIX:
+    if (elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+        elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT ||
+        elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL) {
+      return mix64(bgpstream_pfx_hash(&elem->prefix));
+    }
+    // fall through
+
+  case BGPSTREAM_DISPATCH_PEER:
+    return mix64(coll_hash ^ bgpstream_addr_hash(&elem->peer_ip) ^
+                 ((uint64_t)elem->peer_asn << 32));
+  }
+
+  return 0;
+}
+
+static void dispatch_destroy(struct dispatch *d)
+{
+  int i, j;
+
+  if (d == NULL) {
+    return;
+  }
+
+  STORE(d->shutdown, 1);
+  for (i = 0; i < d->workers_started; i++) {
+    pthread_mutex_lock(&d->workers[i].mutex);
+    pthread_cond_signal(&d->workers[i].cond);
+    pthread_mutex_unlock(&d->workers[i].mutex);
+    pthread_join(d->workers[i].thread, NULL);
+  }
+
+  if (d->workers != NULL) {
+    for (i = 0; i < d->workers_cnt; i++) {
+      if (d->workers[i].slots != NULL) {
+        for (j = 0; j < DISPATCH_QUEUE_LEN; j++) {
+          bgpstream_elem_destroy(d->workers[i].slots[j].elem);
+        }
+        free(d->workers[i].slots);
+      }
+      pthread_cond_destroy(&d->workers[i].cond);
+      pthread_mutex_destroy(&d->workers[i].mutex);
+    }
+    free(d->workers);
+  }
+
+  pthread_cond_destroy(&d->cond);
+  pthread_mutex_destroy(&d->mutex);
+  free(d);
+}
+
+static struct dispatch *dispatch_create(int workers, bgpstream_worker_cb_t cb,
+                                        void *user)
+{
+  struct dispatch *d;
+  struct dispatch_worker *w;
+  int i;
+
+  if ((d = malloc_zero(sizeof(struct dispatch))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&d->mutex, NULL);
+  pthread_cond_init(&d->cond, NULL);
+  d->cb = cb;
+  d->user = user;
+
+  if ((d->workers = malloc_zero(sizeof(struct dispatch_worker) * workers)) ==
+      NULL) {
+    goto err;
+  }
+  for (i = 0; i < workers; i++) {
+    w = &d->workers[i];
+    w->d = d;
+    w->idx = i;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    d->workers_cnt++;
+    if ((w->slots = malloc_zero(sizeof(struct dispatch_slot) *
+                                DISPATCH_QUEUE_LEN)) == NULL) {
+      goto err;
+    }
+  }
+
+  for (i = 0; i < workers; i++) {
+    if (pthread_create(&d->workers[i].thread, NULL, worker_thread,
+                       &d->workers[i]) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start dispatch worker");
+      goto err;
+    }
+    d->workers_started++;
+  }
+
+  return d;
+
+err:
+  dispatch_destroy(d);
+  return NULL;
+}
+
+/* ========== PUBLIC FUNCTIONS BELOW ========== */
+
+int bgpstream_dispatch_run(bgpstream_t *bs, int workers,
+                           bgpstream_dispatch_key_t key,
+                           bgpstream_worker_cb_t cb, void *user)
+{
+  bgpstream_record_t *records[DISPATCH_BATCH];
+  bgpstream_elem_t *elem;
+  struct dispatch *d;
+  uint64_t coll_hash;
+  int i, n, erc;
+  int rc = 0;
+
+  if (workers <= 0 || cb == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid dispatch worker configuration");
+    return -1;
+  }
+
+  if ((d = dispatch_create(workers, cb, user)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create dispatch workers");
+    return -1;
+  }
+
+  while (rc == 0 && !LOAD(d->stop)) {
+    if ((n = bgpstream_get_next_records(bs, records, DISPATCH_BATCH)) <= 0) {
+      rc = n;
+      break;
+    }
+
+    for (i = 0; rc == 0 && i < n && !LOAD(d->stop); i++) {
+      if (records[i]->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+        continue;
+      }
+      coll_hash = collector_hash(records[i]);
+      while ((erc = bgpstream_record_get_next_elem(records[i], &elem)) > 0) {
+        if (push_elem(d, &d->workers[elem_key(key, coll_hash, elem) % workers],
+                      records[i], elem) != 0) {
+          bgpstream_log(BGPSTREAM_LOG_ERR, "Could not queue elem");
+          rc = -1;
+          break;
+        }
+      }
+      if (erc < 0) {
+        rc = -1;
+      }
+    }
+
+    // the records are only valid until the next batch is read
+    wait_workers(d, NULL);
+  }
+
+  wait_workers(d, NULL);
+  if (rc == 0 && LOAD(d->stop)) {
+    rc = 1;
+  }
+  dispatch_destroy(d);
+  return rc;
+}
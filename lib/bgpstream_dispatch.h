@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_DISPATCH_H
+#define __BGPSTREAM_DISPATCH_H
+
+#include "bgpstream.h"
+
+/** Process the rest of the stream with callbacks on a pool of worker threads
+ *
+ * @param bs            pointer to a started BGP Stream instance
+ * @param workers       number of worker threads (must be > 0)
+ * @param key           key used to choose the worker for each elem
+ * @param cb            callback to run for every elem
+ * @param user          user pointer to pass to the callback
+ * @return 0 if end-of-stream was reached, 1 if a callback stopped the stream,
+ * or <0 if an error occurred.
+ *
+ * See bgpstream_run_workers.
+ */
+int bgpstream_dispatch_run(bgpstream_t *bs, int workers,
+                           bgpstream_dispatch_key_t key,
+                           bgpstream_worker_cb_t cb, void *user);
+
+#endif /* __BGPSTREAM_DISPATCH_H */
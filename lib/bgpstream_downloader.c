@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_downloader.h"
+#include "bgpstream_log.h"
+#include "bgpstream_reader_pool.h"
+#include "bgpstream_transport.h"
+#include "utils.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** Size of the buffer that downloads are read through */
+#define DOWNLOAD_BUFFER_LEN (64 * 1024)
+
+struct bgpstream_download {
+  /** The downloader this belongs to */
+  bgpstream_downloader_t *d;
+
+  /** Our own copy of the resource (the original may be destroyed first) */
+  bgpstream_resource_t *res;
+
+  /** Set (under the downloader mutex) once the download has completed */
+  int done;
+
+  /** Links in the downloader's list of unfinished downloads */
+  struct bgpstream_download *prev;
+  struct bgpstream_download *next;
+};
+
+struct bgpstream_downloader {
+  /** Single-thread pool that runs the downloads */
+  bgpstream_reader_pool_t *pool;
+
+  /** Borrowed pointer to the filter manager */
+  bgpstream_filter_mgr_t *filter_mgr;
+
+  /** Maximum download rate in bytes per second (0 for no limit) */
+  uint64_t max_rate;
+
+  /** Downloads that have not been finished (only used by the owner thread) */
+  bgpstream_download_t *downloads;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t done_cond;
+};
+
+static void download_destroy(bgpstream_download_t *dl)
+{
+  bgpstream_resource_destroy(dl->res);
+  free(dl);
+}
+
+// read the resource to the end so that its transport stores a local copy,
+// sleeping as needed to keep under the rate limit
+static void download(bgpstream_downloader_t *d, bgpstream_resource_t *res)
+{
+  bgpstream_transport_t *transport;
+  uint8_t *buf = NULL;
+  uint64_t start, due, now, total = 0;
+  int64_t rc = 0;
+
+  if ((transport = bgpstream_transport_create(res, d->filter_mgr)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not download %s", res->url);
+    return;
+  }
+  if (bgpstream_transport_is_caching(transport) == 0) {
+    // already cached (or can't be)
+    goto done;
+  }
+  if ((buf = malloc(DOWNLOAD_BUFFER_LEN)) == NULL) {
+    goto done;
+  }
+
+  start = epoch_msec();
+  while ((rc = bgpstream_transport_read(transport, buf, DOWNLOAD_BUFFER_LEN)) >
+         0) {
+    total += rc;
+    if (d->max_rate == 0) {
+      continue;
+    }
+    due = start + total * 1000 / d->max_rate;
+    if ((now = epoch_msec()) < due) {
+      usleep((due - now) * 1000);
+    }
+  }
+  bgpstream_log(BGPSTREAM_LOG_FINE,
+                "Downloaded %s ahead of time (%" PRIu64 " bytes in %" PRIu64
+                " ms)",
+                res->url, total, epoch_msec() - start);
+
+done:
+  free(buf);
+  bgpstream_transport_destroy(transport);
+}
+
+static void download_job(void *user)
+{
+  bgpstream_download_t *dl = (bgpstream_download_t *)user;
+  bgpstream_downloader_t *d = dl->d;
+
+  download(d, dl->res);
+
+  pthread_mutex_lock(&d->mutex);
+  dl->done = 1;
+  pthread_cond_broadcast(&d->done_cond);
+  pthread_mutex_unlock(&d->mutex);
+}
+
+static void unlink_download(bgpstream_downloader_t *d, bgpstream_download_t *dl)
+{
+  if (dl->prev != NULL) {
+    dl->prev->next = dl->next;
+  } else {
+    d->downloads = dl->next;
+  }
+  if (dl->next != NULL) {
+    dl->next->prev = dl->prev;
+  }
+  dl->prev = NULL;
+  dl->next = NULL;
+}
+
+/* ========== PUBLIC FUNCTIONS BELOW ========== */
+
+bgpstream_downloader_t *
+bgpstream_downloader_create(bgpstream_filter_mgr_t *filter_mgr,
+                            uint64_t max_rate)
+{
+  bgpstream_downloader_t *d;
+
+  if ((d = malloc_zero(sizeof(bgpstream_downloader_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&d->mutex, NULL);
+  pthread_cond_init(&d->done_cond, NULL);
+  d->filter_mgr = filter_mgr;
+  d->max_rate = max_rate;
+
+  // one download at a time, so that it doesn't compete with the readers (and
+  // the rate limit is simple to keep)
+  if ((d->pool = bgpstream_reader_pool_create(1, NULL)) == NULL) {
+    bgpstream_downloader_destroy(d);
+    return NULL;
+  }
+
+  return d;
+}
+
+void bgpstream_downloader_destroy(bgpstream_downloader_t *d)
+{
+  bgpstream_download_t *dl;
+
+  if (d == NULL) {
+    return;
+  }
+
+  // waits for the running download, and discards the rest
+  bgpstream_reader_pool_destroy(d->pool);
+  d->pool = NULL;
+
+  while ((dl = d->downloads) != NULL) {
+    unlink_download(d, dl);
+    download_destroy(dl);
+  }
+
+  pthread_mutex_destroy(&d->mutex);
+  pthread_cond_destroy(&d->done_cond);
+
+  free(d);
+}
+
+bgpstream_download_t *bgpstream_downloader_submit(bgpstream_downloader_t *d,
+                                                  bgpstream_resource_t *res)
+{
+  bgpstream_download_t *dl;
+
+  if ((dl = malloc_zero(sizeof(bgpstream_download_t))) == NULL) {
+    return NULL;
+  }
+  dl->d = d;
+  if ((dl->res = bgpstream_resource_dup(res)) == NULL) {
+    free(dl);
+    return NULL;
+  }
+
+  if (bgpstream_reader_pool_submit(d->pool, download_job, dl) != 0) {
+    download_destroy(dl);
+    return NULL;
+  }
+
+  dl->next = d->downloads;
+  if (dl->next != NULL) {
+    dl->next->prev = dl;
+  }
+  d->downloads = dl;
+
+  return dl;
+}
+
+void bgpstream_downloader_finish(bgpstream_downloader_t *d,
+                                 bgpstream_download_t *dl)
+{
+  if (bgpstream_reader_pool_cancel(d->pool, dl) == 0) {
+    // it has already started, so wait for it
+    pthread_mutex_lock(&d->mutex);
+    while (dl->done == 0) {
+      pthread_cond_wait(&d->done_cond, &d->mutex);
+    }
+    pthread_mutex_unlock(&d->mutex);
+  }
+
+  unlink_download(d, dl);
+  download_destroy(dl);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_DOWNLOADER_H
+#define __BGPSTREAM_DOWNLOADER_H
+
+#include "bgpstream_filter.h"
+#include "bgpstream_resource.h"
+#include <stdint.h>
+
+/** Opaque structure representing a background downloader that fills the
+ * local cache with resources before they are opened */
+typedef struct bgpstream_downloader bgpstream_downloader_t;
+
+/** Opaque structure representing one queued (or running) download */
+typedef struct bgpstream_download bgpstream_download_t;
+
+/** Create a new downloader
+ *
+ * @param filter_mgr    pointer to the filter manager to create transports
+ *                      with (must outlive the downloader)
+ * @param max_rate      maximum download rate in bytes per second, or 0 for no
+ *                      limit
+ * @return pointer to the created downloader if successful, NULL otherwise
+ *
+ * Downloads are run one at a time, in the order they are submitted, by a
+ * single background thread.
+ */
+bgpstream_downloader_t *
+bgpstream_downloader_create(bgpstream_filter_mgr_t *filter_mgr,
+                            uint64_t max_rate);
+
+/** Destroy the given downloader
+ *
+ * @param d             pointer to the downloader to destroy
+ *
+ * Downloads that have not yet started are discarded. This function blocks
+ * until a running download has completed. Any download handles that have not
+ * been finished are freed.
+ */
+void bgpstream_downloader_destroy(bgpstream_downloader_t *d);
+
+/** Queue the given resource to be downloaded into the local cache
+ *
+ * @param d             pointer to the downloader
+ * @param res           pointer to the resource to download (a copy is made)
+ * @return a handle to the download if successful, NULL otherwise
+ *
+ * Resources whose transport does not store a local copy (or that are already
+ * cached) are opened and then closed without being read.
+ */
+bgpstream_download_t *bgpstream_downloader_submit(bgpstream_downloader_t *d,
+                                                  bgpstream_resource_t *res);
+
+/** Finish with a download before its resource is opened
+ *
+ * @param d             pointer to the downloader
+ * @param dl            pointer to the download handle to finish
+ *
+ * If the download has not started it is cancelled (and the resource will be
+ * read from its source as usual), otherwise this blocks until it completes.
+ * The handle is freed.
+ */
+void bgpstream_downloader_finish(bgpstream_downloader_t *d,
+                                 bgpstream_download_t *dl);
+
+#endif /* __BGPSTREAM_DOWNLOADER_H */
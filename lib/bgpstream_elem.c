@@ -28,6 +28,8 @@
 #include "bgpstream_log.h"
 #include "bgpstream_record.h"
 #include "bgpstream_utils.h"
+#include "bgpstream_utils_mem_int.h"
+#include "bgpstream_utils_private.h"
 #include "bgpstream_int.h" // for bgpstream_char_snprintf()
 #include "config.h"
 #ifdef WITH_RPKI
@@ -49,8 +51,8 @@ bgpstream_elem_t *bgpstream_elem_create()
   // allocate memory for new element
   bgpstream_elem_t *elem = NULL;
 
-  if ((elem = (bgpstream_elem_t *)malloc_zero(sizeof(bgpstream_elem_t))) ==
-      NULL) {
+  if ((elem = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_ELEM,
+                                        sizeof(bgpstream_elem_t))) == NULL) {
     goto err;
   }
   // all fields are initialized to zero
@@ -85,7 +87,7 @@ void bgpstream_elem_destroy(bgpstream_elem_t *elem)
   bgpstream_community_set_destroy(elem->communities);
   elem->communities = NULL;
 
-  free(elem);
+  bgpstream_mem_free(BGPSTREAM_MEM_ELEM, elem);
 }
 
 void bgpstream_elem_clear(bgpstream_elem_t *elem)
@@ -211,20 +213,13 @@ int bgpstream_elem_peerstate_snprintf(char *buf, size_t len,
     written++;                                                                 \
   } while (0)
 
-#define SEEK_STR_END                                                           \
-  do {                                                                         \
-    while (*buf_p != '\0') {                                                   \
-      written++;                                                               \
-      buf_p++;                                                                 \
-    }                                                                          \
-  } while (0)
-
 char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
                                      bgpstream_elem_t const *elem,
                                      int print_type)
 {
   size_t written = 0; /* < how many bytes we wanted to write */
   size_t c = 0;       /* < how many chars were written */
+  int n;
   char *buf_p = buf;
   bgpstream_as_path_seg_t *seg;
 
@@ -242,7 +237,7 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
   }
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
+  c = bs_u32_snprintf(buf_p, B_REMAIN, elem->peer_asn);
   written += c;
   buf_p += c;
   ADD_PIPE;
@@ -253,11 +248,14 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
      this information for state change and open messages). This will
      result in an empty peer IP field.  But if it fails due to lack of
      space, we should fail too. */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL &&
-      errno == ENOSPC) {
-    return NULL;
+  if ((n = bgpstream_addr_ntop_len(buf_p, B_REMAIN, &elem->peer_ip)) < 0) {
+    if (errno == ENOSPC) {
+      return NULL;
+    }
+    n = 0;
   }
-  SEEK_STR_END;
+  written += n;
+  buf_p += n;
   ADD_PIPE;
 
   /* conditional fields */
@@ -266,20 +264,25 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
 
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
+    if ((n = bgpstream_pfx_snprintf_len(buf_p, B_REMAIN, &(elem->prefix))) <
+        0) {
       if (errno != ENOSPC)
         bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (R/A)");
       return NULL;
     }
-    SEEK_STR_END;
+    written += n;
+    buf_p += n;
     ADD_PIPE;
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL &&
-        errno == ENOSPC) {
-      return NULL;
+    if ((n = bgpstream_addr_ntop_len(buf_p, B_REMAIN, &elem->nexthop)) < 0) {
+      if (errno == ENOSPC) {
+        return NULL;
+      }
+      n = 0;
     }
-    SEEK_STR_END;
+    written += n;
+    buf_p += n;
     ADD_PIPE;
 
     /* AS PATH */
@@ -329,12 +332,14 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
 
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
+    if ((n = bgpstream_pfx_snprintf_len(buf_p, B_REMAIN, &(elem->prefix))) <
+        0) {
       if (errno != ENOSPC)
         bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (W)");
       return NULL;
     }
-    SEEK_STR_END;
+    written += n;
+    buf_p += n;
     ADD_PIPE;
     /* NEXT HOP (empty) */
     ADD_PIPE;
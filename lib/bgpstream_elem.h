@@ -44,6 +44,27 @@
 
 /** @} */
 
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Optional elem fields that may be left undecoded
+ *
+ * The prefix, peer, elem type and timestamps are always populated. Fields that
+ * are not selected (see bgpstream_set_elem_fields) are left empty.
+ */
+#define BGPSTREAM_ELEM_FIELD_AS_PATH 0x01
+#define BGPSTREAM_ELEM_FIELD_NEXT_HOP 0x02
+#define BGPSTREAM_ELEM_FIELD_COMMUNITIES 0x04
+#define BGPSTREAM_ELEM_FIELD_ORIGIN 0x08
+#define BGPSTREAM_ELEM_FIELD_MED 0x10
+#define BGPSTREAM_ELEM_FIELD_LOCAL_PREF 0x20
+#define BGPSTREAM_ELEM_FIELD_AGGREGATOR 0x40
+#define BGPSTREAM_ELEM_FIELD_ALL 0x7f
+
+/** @} */
+
 /**
  * @name Public Enums
  *
@@ -137,6 +158,14 @@ typedef struct struct_bgpstream_annotations_t {
   /** Record timestamp */
   uint32_t timestamp;
 
+  /** RPKI validation result cache (optional, may be NULL) */
+  struct bgpstream_rpki_cache *rpki_cache;
+
+  /** RPKI validation result computed ahead of time by an RPKI pipeline, or
+      NULL if the elem has not been validated yet. An empty string means that
+      the elem could not be validated. */
+  const char *rpki_result;
+
 } bgpstream_annotations_t;
 
 /** Elem aggregator object */
@@ -25,13 +25,17 @@
  */
 
 #include "bgpstream_elem_generator.h"
+#include "bgpstream_utils_mem_int.h"
 #include "utils.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 struct bgpstream_elem_generator {
 
-  /** Array of elems */
-  bgpstream_elem_t **elems;
+  /** Contiguous array of elems. Each slot owns an AS path and community set
+      that are created once and reused across records */
+  bgpstream_elem_t *elems;
 
   /** Number of elems that are active in the elems list */
   int elems_cnt;
@@ -45,18 +49,60 @@ struct bgpstream_elem_generator {
 
 /* ==================== PRIVATE FUNCTIONS ==================== */
 
+#define ELEMS_INIT_CNT 16
+
+static int grow_elems(bgpstream_elem_generator_t *self)
+{
+  int new_cnt = self->elems_alloc_cnt == 0 ? ELEMS_INIT_CNT
+                                           : self->elems_alloc_cnt * 2;
+  bgpstream_elem_t *new_elems;
+  int i;
+
+  if ((new_elems = bgpstream_mem_realloc(BGPSTREAM_MEM_ELEM_GENERATOR,
+                                         self->elems,
+                                         sizeof(bgpstream_elem_t) * new_cnt)) ==
+      NULL) {
+    return -1;
+  }
+  self->elems = new_elems;
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_ELEM_GENERATOR,
+                        sizeof(bgpstream_elem_t) *
+                          (new_cnt - self->elems_alloc_cnt));
+
+  for (i = self->elems_alloc_cnt; i < new_cnt; i++) {
+    memset(&self->elems[i], 0, sizeof(bgpstream_elem_t));
+    if ((self->elems[i].as_path = bgpstream_as_path_create()) == NULL ||
+        (self->elems[i].communities = bgpstream_community_set_create()) ==
+          NULL) {
+      /* keep the partially initialized slot so that destroy frees it */
+      self->elems_alloc_cnt = i + 1;
+      BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_ELEM_GENERATOR,
+                            -(int64_t)sizeof(bgpstream_elem_t) *
+                              (new_cnt - self->elems_alloc_cnt));
+      return -1;
+    }
+  }
+  self->elems_alloc_cnt = new_cnt;
+
+  return 0;
+}
+
 /* ==================== PROTECTED FUNCTIONS ==================== */
 
 bgpstream_elem_generator_t *bgpstream_elem_generator_create()
 {
   bgpstream_elem_generator_t *self;
 
-  if ((self = malloc_zero(sizeof(bgpstream_elem_generator_t))) == NULL) {
+  if ((self = bgpstream_mem_malloc_zero(
+         BGPSTREAM_MEM_ELEM_GENERATOR, sizeof(bgpstream_elem_generator_t))) ==
+      NULL) {
     return NULL;
   }
 
   /* indicates not populated */
   self->elems_cnt = -1;
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_ELEM_GENERATOR,
+                        sizeof(bgpstream_elem_generator_t));
 
   return self;
 }
@@ -68,17 +114,21 @@ void bgpstream_elem_generator_destroy(bgpstream_elem_generator_t *self)
     return;
   }
 
-  /* free all the alloc'd elems */
+  /* free the paths and community sets owned by each slot */
   for (i = 0; i < self->elems_alloc_cnt; i++) {
-    bgpstream_elem_destroy(self->elems[i]);
-    self->elems[i] = NULL;
+    bgpstream_as_path_destroy(self->elems[i].as_path);
+    bgpstream_community_set_destroy(self->elems[i].communities);
   }
 
-  free(self->elems);
+  bgpstream_mem_free(BGPSTREAM_MEM_ELEM_GENERATOR, self->elems);
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_ELEM_GENERATOR,
+                        -(int64_t)(sizeof(bgpstream_elem_generator_t) +
+                                   sizeof(bgpstream_elem_t) *
+                                     self->elems_alloc_cnt));
 
   self->elems_cnt = self->elems_alloc_cnt = self->iter = 0;
 
-  free(self);
+  bgpstream_mem_free(BGPSTREAM_MEM_ELEM_GENERATOR, self);
 }
 
 void bgpstream_elem_generator_clear(bgpstream_elem_generator_t *self)
@@ -106,25 +156,11 @@ bgpstream_elem_generator_get_new_elem(bgpstream_elem_generator_t *self)
   bgpstream_elem_t *elem = NULL;
 
   /* check if we need to alloc more elems */
-  if (self->elems_cnt + 1 >= self->elems_alloc_cnt) {
-
-    /* alloc more memory */
-    if ((self->elems = realloc(self->elems, sizeof(bgpstream_elem_t *) *
-                                              (self->elems_alloc_cnt + 1))) ==
-        NULL) {
-      return NULL;
-    }
-
-    /* create an elem */
-    if ((self->elems[self->elems_alloc_cnt] = bgpstream_elem_create()) ==
-        NULL) {
-      return NULL;
-    }
-
-    self->elems_alloc_cnt++;
+  if (self->elems_cnt >= self->elems_alloc_cnt && grow_elems(self) != 0) {
+    return NULL;
   }
 
-  elem = self->elems[self->elems_cnt];
+  elem = &self->elems[self->elems_cnt];
   bgpstream_elem_clear(elem);
   return elem;
 }
@@ -132,7 +168,7 @@ bgpstream_elem_generator_get_new_elem(bgpstream_elem_generator_t *self)
 void bgpstream_elem_generator_commit_elem(bgpstream_elem_generator_t *self,
                                           bgpstream_elem_t *el)
 {
-  assert(self->elems[self->elems_cnt] == el);
+  assert(&self->elems[self->elems_cnt] == el);
   self->elems_cnt++;
 }
 
@@ -142,7 +178,7 @@ bgpstream_elem_generator_get_next_elem(bgpstream_elem_generator_t *self)
   bgpstream_elem_t *elem = NULL;
 
   if (self->iter < self->elems_cnt) {
-    elem = self->elems[self->iter];
+    elem = &self->elems[self->iter];
     self->iter++;
   }
 
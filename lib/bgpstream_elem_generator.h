@@ -96,6 +96,10 @@ int bgpstream_elem_generator_is_populated(
  *
  * @param generator     pointer to the generator to get the elem from
  * @return pointer to a fresh elem structure if successful, NULL otherwise
+ *
+ * Elems are stored contiguously, so growing the generator may move elems that
+ * were committed earlier. Pointers to committed elems should only be held once
+ * the generator is fully populated.
  */
 bgpstream_elem_t *
 bgpstream_elem_generator_get_new_elem(bgpstream_elem_generator_t *generator);
@@ -32,23 +32,36 @@
 
 #include "bgpstream_filter.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_utils_mem_int.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* allocate memory for a new bgpstream filter */
 bgpstream_filter_mgr_t *bgpstream_filter_mgr_create()
 {
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR: create start");
-  bgpstream_filter_mgr_t *bs_filter_mgr =
-    (bgpstream_filter_mgr_t *)malloc_zero(sizeof(bgpstream_filter_mgr_t));
+  bgpstream_filter_mgr_t *bs_filter_mgr = bgpstream_mem_malloc_zero(
+    BGPSTREAM_MEM_FILTER, sizeof(bgpstream_filter_mgr_t));
   if (bs_filter_mgr == NULL) {
     return NULL; // can't allocate memory
   }
+  if ((bs_filter_mgr->names = bgpstream_str_intern_create()) == NULL) {
+    bgpstream_mem_free(BGPSTREAM_MEM_FILTER, bs_filter_mgr);
+    return NULL;
+  }
+  bs_filter_mgr->elem_fields = BGPSTREAM_ELEM_FIELD_ALL;
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FILTER, sizeof(bgpstream_filter_mgr_t));
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR: create end");
   return bs_filter_mgr;
 }
@@ -75,6 +88,377 @@ static int bsf_str_set_insert(bgpstream_str_set_t **setp, const char *value)
   return bgpstream_str_set_insert(*setp, value) >= 0;
 }
 
+// Insert a name into *setp, and its interned id into *idsp.
+// Returns 1 for success, 0 for failure.
+static int bsf_name_insert(bgpstream_filter_mgr_t *this,
+                           bgpstream_str_set_t **setp,
+                           bgpstream_id_set_t **idsp, const char *value)
+{
+  uint32_t id;
+
+  if (!bsf_str_set_insert(setp, value)) {
+    return 0;
+  }
+  if ((id = bgpstream_str_intern(this->names, value)) ==
+      BGPSTREAM_STR_INTERN_NULL_ID) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
+    return 0;
+  }
+  return bsf_id_set_insert(idsp, id);
+}
+
+static int cmp_asn(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// parse a decimal ASN, without leading zeros (which would not match the
+// string form of any ASN)
+static const char *parse_asn(const char *p, uint32_t *asn)
+{
+  uint64_t val = 0;
+
+  if (!isdigit(*p) || (*p == '0' && isdigit(p[1]))) {
+    return NULL;
+  }
+  while (isdigit(*p)) {
+    if ((val = val * 10 + (*(p++) - '0')) > UINT32_MAX) {
+      return NULL;
+    }
+  }
+  *asn = (uint32_t)val;
+  return p;
+}
+
+#define ITEM_GAP 0xff // ".*", before it is resolved into ANY and STAR
+
+// Try to compile a Cisco AS path regex into items that match the ASNs of a
+// path directly. This is only possible for expressions made of whole ASNs
+// ("174"), alternations of them ("(174|3356)"), any ASN ("[0-9]+") and gaps
+// (".*"), separated by "_" or " ", and bounded by "^" or "_" on the left and
+// "$" or "_" on the right; for a path of plain ASNs, such an expression
+// matches the ASN items exactly as the regex matches the string. Anything else
+// is left to regexec (and returns -1).
+static int aspath_compile(bgpstream_aspath_expr_t *expr, const char *re)
+{
+  bgpstream_aspath_tok_t items[BGPSTREAM_ASPATH_TOK_MAX + 1];
+  bgpstream_aspath_tok_t *toks = NULL;
+  uint32_t asns[UINT8_MAX];
+  int items_cnt = 0, toks_cnt = 0;
+  int anchor_start = 0, anchor_end = 0;
+  int asns_cnt, i;
+  const char *p = re;
+
+  memset(items, 0, sizeof(items));
+
+  if (*p == '^') {
+    anchor_start = 1;
+    p++;
+    if (*p == '$' && p[1] == '\0') {
+      // only matches the empty path
+      expr->anchor_start = expr->anchor_end = 1;
+      expr->toks_cnt = 0;
+      return (expr->toks = malloc_zero(sizeof(*expr->toks))) != NULL ? 0 : -1;
+    }
+    if (*p == '_') {
+      p++; // "^_" is the same as "^"
+    }
+  } else if (*p == '_') {
+    p++;
+  } else if (p[0] != '.' || p[1] != '*') {
+    return -1; // could match in the middle of an ASN
+  }
+
+  while (1) {
+    if (items_cnt == BGPSTREAM_ASPATH_TOK_MAX) {
+      goto err;
+    }
+    bgpstream_aspath_tok_t *item = &items[items_cnt++];
+
+    if (isdigit(*p)) {
+      if ((p = parse_asn(p, &asns[0])) == NULL) {
+        goto err;
+      }
+      asns_cnt = 1;
+    } else if (*p == '(') {
+      asns_cnt = 0;
+      do {
+        if (asns_cnt == UINT8_MAX ||
+            (p = parse_asn(p + 1, &asns[asns_cnt++])) == NULL) {
+          goto err;
+        }
+      } while (*p == '|');
+      if (*(p++) != ')') {
+        goto err;
+      }
+    } else if (strncmp(p, "[0-9]+", 6) == 0) {
+      item->type = BGPSTREAM_ASPATH_TOK_ANY;
+      asns_cnt = 0;
+      p += 6;
+    } else if (p[0] == '.' && p[1] == '*') {
+      if (items_cnt > 1 && items[items_cnt - 2].type == ITEM_GAP) {
+        goto err;
+      }
+      item->type = ITEM_GAP;
+      asns_cnt = 0;
+      p += 2;
+    } else {
+      goto err;
+    }
+    if (asns_cnt > 0) {
+      item->type = BGPSTREAM_ASPATH_TOK_ASN;
+      if ((item->asns = malloc(sizeof(uint32_t) * asns_cnt)) == NULL) {
+        goto err;
+      }
+      memcpy(item->asns, asns, sizeof(uint32_t) * asns_cnt);
+      qsort(item->asns, asns_cnt, sizeof(uint32_t), cmp_asn);
+      item->asns_cnt = asns_cnt;
+    }
+
+    // an item must end at an ASN boundary
+    if (*p == '\0' && item->type == ITEM_GAP) {
+      break;
+    } else if (*p == '$' && p[1] == '\0') {
+      anchor_end = 1;
+      break;
+    } else if (*p == '_' && p[1] == '\0') {
+      break;
+    } else if (*p == '_' && p[1] == '$' && p[2] == '\0') {
+      anchor_end = 1;
+      break;
+    } else if ((*p == '_' || *p == ' ') && p[1] != '\0') {
+      p++;
+    } else {
+      goto err;
+    }
+  }
+
+  // a gap at either end matches any number of ASNs (since "_" also matches
+  // the start and end of the string), so it just removes the anchor; a gap
+  // in the middle matches at least one ASN
+  if ((toks = malloc_zero(sizeof(*toks) * (items_cnt * 2 + 1))) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < items_cnt; i++) {
+    if (items[i].type != ITEM_GAP) {
+      toks[toks_cnt++] = items[i];
+    } else if (i == 0) {
+      anchor_start = 0;
+    } else if (i == items_cnt - 1) {
+      anchor_end = 0;
+    } else {
+      toks[toks_cnt++].type = BGPSTREAM_ASPATH_TOK_ANY;
+      toks[toks_cnt++].type = BGPSTREAM_ASPATH_TOK_STAR;
+    }
+  }
+  if (toks_cnt > BGPSTREAM_ASPATH_TOK_MAX) {
+    free(toks);
+    goto err;
+  }
+
+  expr->toks = toks;
+  expr->toks_cnt = toks_cnt;
+  expr->anchor_start = anchor_start;
+  expr->anchor_end = anchor_end;
+  return 0;
+
+err:
+  for (i = 0; i < items_cnt; i++) {
+    free(items[i].asns);
+  }
+  return -1;
+}
+
+static void aspath_expr_free(bgpstream_aspath_expr_t *expr)
+{
+  int i;
+
+  if (expr->re != NULL) {
+    regfree(expr->re);
+    free(expr->re);
+    expr->re = NULL;
+  }
+  for (i = 0; i < expr->toks_cnt; i++) {
+    free(expr->toks[i].asns);
+  }
+  free(expr->toks);
+  expr->toks = NULL;
+  expr->toks_cnt = 0;
+}
+
+// add the states that can be reached from the given ones without consuming
+// an ASN
+static uint64_t aspath_closure(const bgpstream_aspath_expr_t *expr,
+                               uint64_t states)
+{
+  int i;
+
+  if (expr->anchor_start == 0) {
+    states |= 1; // the match may start at any ASN
+  }
+  for (i = 0; i < expr->toks_cnt; i++) {
+    if ((states & (UINT64_C(1) << i)) != 0 &&
+        expr->toks[i].type == BGPSTREAM_ASPATH_TOK_STAR) {
+      states |= UINT64_C(1) << (i + 1);
+    }
+  }
+  return states;
+}
+
+// match a compiled expression against the ASNs of the path. Returns 1 if it
+// matches, 0 if not, and -1 if the path has sets or confederations (which
+// only the regex handles)
+static int aspath_toks_match(const bgpstream_aspath_expr_t *expr,
+                             const bgpstream_as_path_t *path)
+{
+  const uint64_t accept = UINT64_C(1) << expr->toks_cnt;
+  bgpstream_as_path_iter_t iter;
+  bgpstream_as_path_seg_t *seg;
+  const bgpstream_aspath_tok_t *tok;
+  uint64_t states, next;
+  uint32_t asn;
+  int i;
+
+  // state i means the first i items have been matched
+  states = aspath_closure(expr, 1);
+  bgpstream_as_path_iter_reset(&iter);
+  while ((seg = bgpstream_as_path_get_next_seg(path, &iter)) != NULL) {
+    if (seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
+      return -1;
+    }
+    asn = seg->asn.asn; // segments are packed
+    if (expr->anchor_end == 0 && (states & accept) != 0) {
+      return 1;
+    }
+    next = 0;
+    for (i = 0; i < expr->toks_cnt; i++) {
+      if ((states & (UINT64_C(1) << i)) == 0) {
+        continue;
+      }
+      tok = &expr->toks[i];
+      if (tok->type == BGPSTREAM_ASPATH_TOK_STAR) {
+        next |= UINT64_C(1) << i;
+      } else if (tok->type == BGPSTREAM_ASPATH_TOK_ANY ||
+                 bsearch(&asn, tok->asns, tok->asns_cnt,
+                         sizeof(uint32_t), cmp_asn) != NULL) {
+        next |= UINT64_C(1) << (i + 1);
+      }
+    }
+    if ((states = aspath_closure(expr, next)) == 0) {
+      return 0;
+    }
+  }
+  return (states & accept) != 0;
+}
+
+#define BITMAP_WORDS (1 << 16) / 64
+#define BITMAP_SET(bm, i) ((bm)[(i) / 64] |= UINT64_C(1) << ((i) % 64))
+#define BITMAP_TEST(bm, i) (((bm)[(i) / 64] >> ((i) % 64)) & 1)
+
+// add a community filter to the compiled index
+static int community_index_add(bgpstream_community_index_t *idx,
+                               bgpstream_community_t comm, int mask)
+{
+  bgpstream_community_t bits = comm;
+
+  switch (mask) {
+  case BGPSTREAM_COMMUNITY_FILTER_EXACT:
+    if (idx->exact == NULL && (idx->exact = bgpstream_id_set_create()) == NULL) {
+      return -1;
+    }
+    if (bgpstream_id_set_insert(idx->exact, comm.ui32) < 0) {
+      return -1;
+    }
+    break;
+
+  case BGPSTREAM_COMMUNITY_FILTER_ASN:
+    if (idx->asns == NULL &&
+        (idx->asns = malloc_zero(sizeof(uint64_t) * BITMAP_WORDS)) == NULL) {
+      return -1;
+    }
+    BITMAP_SET(idx->asns, comm.asn);
+    bits.value = 0;
+    break;
+
+  case BGPSTREAM_COMMUNITY_FILTER_VALUE:
+    if (idx->values == NULL &&
+        (idx->values = malloc_zero(sizeof(uint64_t) * BITMAP_WORDS)) == NULL) {
+      return -1;
+    }
+    BITMAP_SET(idx->values, comm.value);
+    bits.asn = 0;
+    break;
+
+  default:
+    idx->match_any = 1;
+    bits.ui32 = 0;
+    break;
+  }
+
+  idx->required.ui32 =
+    idx->filters_cnt++ == 0 ? bits.ui32 : (idx->required.ui32 & bits.ui32);
+  return 0;
+}
+
+// Get the prefix match type selected by a prefix filter type.
+// Parse an elem sample of the form "[prefix|peer] <num>/<den>".
+// Returns 1 for success, 0 for failure.
+static int bsf_sample_parse(bgpstream_filter_mgr_t *this, const char *value)
+{
+  const char *p = value;
+  unsigned long num, den;
+  char *endp;
+  uint8_t key = BGPSTREAM_FILTER_SAMPLE_PREFIX;
+
+  if (strncmp(p, "prefix", 6) == 0 && (isspace(p[6]) || p[6] == ':')) {
+    p += 7;
+  } else if (strncmp(p, "peer", 4) == 0 && (isspace(p[4]) || p[4] == ':')) {
+    key = BGPSTREAM_FILTER_SAMPLE_PEER;
+    p += 5;
+  }
+  while (isspace(*p))
+    p++;
+
+  errno = 0;
+  num = strtoul(p, &endp, 10);
+  if (errno || endp == p || *endp != '/') {
+    goto err;
+  }
+  p = endp + 1;
+  den = strtoul(p, &endp, 10);
+  if (errno || endp == p || *endp || den == 0 || den > UINT32_MAX ||
+      num == 0 || num > den) {
+    goto err;
+  }
+
+  this->sample_key = key;
+  this->sample_num = (uint32_t)num;
+  this->sample_den = (uint32_t)den;
+  return 1;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR,
+                "invalid sample '%s' (expected '[prefix|peer] <n>/<m>')",
+                value);
+  return 0;
+}
+
+static uint8_t bsf_prefix_matchtype(bgpstream_filter_type_t filter_type)
+{
+  switch (filter_type) {
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE:
+    return BGPSTREAM_PREFIX_MATCH_MORE;
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS:
+    return BGPSTREAM_PREFIX_MATCH_LESS;
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT:
+    return BGPSTREAM_PREFIX_MATCH_EXACT;
+  default:
+    return BGPSTREAM_PREFIX_MATCH_ANY;
+  }
+}
+
 int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
                                     bgpstream_filter_type_t filter_type,
                                     const char *filter_value)
@@ -86,6 +470,9 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
     return 1; // nothing to customize
   }
 
+  // the elem checks are recompiled the next time they are needed
+  this->elem_checks_valid = 0;
+
   switch (filter_type) {
   case BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN:
     errno = 0;
@@ -186,6 +573,7 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
       char errbuf[1024];
       regerror(rc, re, errbuf, sizeof(errbuf));
       bgpstream_log(BGPSTREAM_LOG_ERR, "regex error: %s", errbuf);
+      free(re);
       return 0;
     }
     if (++this->aspath_expr_cnt > this->aspath_expr_alloc_cnt) {
@@ -194,13 +582,21 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
       if (!tmp) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
         regfree(re);
+        free(re);
         return 0;
       }
       this->aspath_exprs = tmp;
       this->aspath_expr_alloc_cnt = this->aspath_expr_cnt;
     }
-    this->aspath_exprs[this->aspath_expr_cnt-1].re = re;
-    this->aspath_exprs[this->aspath_expr_cnt-1].negate = negate;
+    bgpstream_aspath_expr_t *expr = &this->aspath_exprs[this->aspath_expr_cnt-1];
+    memset(expr, 0, sizeof(*expr));
+    expr->re = re;
+    expr->negate = negate;
+    if (aspath_compile(expr, filter_value) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_FINE,
+          "regex \"%s\" will be matched against AS path strings",
+          filter_value);
+    }
     return 1;
   }
 
@@ -211,7 +607,6 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
   case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT:
   case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY: {
     bgpstream_pfx_t pfx;
-    uint8_t matchtype;
 
     if (this->prefixes == NULL) {
       if ((this->prefixes = bgpstream_patricia_tree_create(NULL)) ==
@@ -224,18 +619,7 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
       bgpstream_log(BGPSTREAM_LOG_ERR, "invalid prefix '%s'", filter_value);
       return 0;
     }
-    if (filter_type == BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE ||
-        filter_type == BGPSTREAM_FILTER_TYPE_ELEM_PREFIX) {
-      matchtype = BGPSTREAM_PREFIX_MATCH_MORE;
-    } else if (filter_type == BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS) {
-      matchtype = BGPSTREAM_PREFIX_MATCH_LESS;
-    } else if (filter_type == BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT) {
-      matchtype = BGPSTREAM_PREFIX_MATCH_EXACT;
-    } else {
-      matchtype = BGPSTREAM_PREFIX_MATCH_ANY;
-    }
-
-    pfx.allowed_matches = matchtype;
+    pfx.allowed_matches = bsf_prefix_matchtype(filter_type);
     if (bgpstream_patricia_tree_insert(this->prefixes, &pfx) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "can't add prefix");
       return 0;
@@ -248,6 +632,7 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
     int khret;
 
     bgpstream_community_t comm;
+    comm.ui32 = 0; // wildcard fields are not set by bgpstream_str2community
     if (this->communities == NULL) {
       if ((this->communities = kh_init(bgpstream_community_filter)) ==
           NULL) {
@@ -274,6 +659,12 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
      */
     kh_value(this->communities, k) =
       kh_value(this->communities, k) & mask;
+
+    /* the index does the same, by matching any of its filters */
+    if (community_index_add(&this->community_index, comm, mask) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
+      return 0;
+    }
     /* DEBUG: fprintf(stderr, "%s - %d\n",
      *                filter_value, kh_value(this->communities, k) );
      */
@@ -292,14 +683,20 @@ int bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *this,
     }
     return 1;
 
+  case BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE:
+    return bsf_sample_parse(this, filter_value);
+
   case BGPSTREAM_FILTER_TYPE_PROJECT:
-    return bsf_str_set_insert(&this->projects, filter_value);
+    return bsf_name_insert(this, &this->projects, &this->project_ids,
+                           filter_value);
 
   case BGPSTREAM_FILTER_TYPE_COLLECTOR:
-    return bsf_str_set_insert(&this->collectors, filter_value);
+    return bsf_name_insert(this, &this->collectors, &this->collector_ids,
+                           filter_value);
 
   case BGPSTREAM_FILTER_TYPE_ROUTER:
-    return bsf_str_set_insert(&this->routers, filter_value);
+    return bsf_name_insert(this, &this->routers, &this->router_ids,
+                           filter_value);
 
   case BGPSTREAM_FILTER_TYPE_RECORD_TYPE:
     if (strcmp(filter_value, "ribs") != 0 &&
@@ -344,66 +741,1234 @@ int bgpstream_filter_mgr_rib_period_filter_add(
   return 1;
 }
 
+int bgpstream_filter_mgr_aspath_match(bgpstream_filter_mgr_t *this,
+                                      bgpstream_as_path_t *path)
+{
+  bgpstream_aspath_cache_entry_t *entry = NULL;
+  char aspath[65536];
+  int rendered = 0;
+  int result = 1;
+  int i, rc;
+
+  // the same paths are seen over and over (e.g., in a RIB dump), so the
+  // result for each path is cached until another path with the same hash
+  // is seen
+  if (this->aspath_cache == NULL &&
+      (this->aspath_cache = bgpstream_mem_malloc_zero(
+         BGPSTREAM_MEM_FILTER,
+         sizeof(*this->aspath_cache) * BGPSTREAM_ASPATH_CACHE_SIZE)) != NULL) {
+    BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FILTER, sizeof(*this->aspath_cache) *
+                                                  BGPSTREAM_ASPATH_CACHE_SIZE);
+  }
+  if (this->aspath_cache != NULL) {
+    entry = &this->aspath_cache[bgpstream_as_path_hash(path) &
+                                (BGPSTREAM_ASPATH_CACHE_SIZE - 1)];
+    if (entry->path != NULL && bgpstream_as_path_equal(entry->path, path)) {
+      return entry->result;
+    }
+  }
+
+  for (i = 0; i < this->aspath_expr_cnt && result != 0; i++) {
+    rc = -1;
+    if (this->aspath_exprs[i].toks != NULL) {
+      rc = aspath_toks_match(&this->aspath_exprs[i], path);
+    }
+    if (rc < 0) {
+      if (rendered == 0) {
+        if (bgpstream_as_path_snprintf(aspath, sizeof(aspath), path) >=
+            (int)sizeof(aspath)) {
+          bgpstream_log(BGPSTREAM_LOG_WARN,
+                        "AS Path is too long? Filter may not work well.");
+        }
+        rendered = 1;
+      }
+      rc = regexec(this->aspath_exprs[i].re, aspath, 0, NULL, 0) == 0;
+    }
+    // All aspath regexes must match
+    if (rc != (this->aspath_exprs[i].negate == 0)) {
+      result = 0;
+    }
+  }
+
+  if (entry != NULL) {
+    if (entry->path == NULL) {
+      entry->path = bgpstream_as_path_create();
+    }
+    if (entry->path != NULL && bgpstream_as_path_copy(entry->path, path) == 0) {
+      entry->result = result;
+    } else if (entry->path != NULL) {
+      bgpstream_as_path_destroy(entry->path);
+      entry->path = NULL;
+    }
+  }
+  return result;
+}
+
+int bgpstream_filter_mgr_community_match(bgpstream_filter_mgr_t *this,
+                                         const bgpstream_community_set_t *set)
+{
+  const bgpstream_community_index_t *idx = &this->community_index;
+  const bgpstream_community_t *c;
+  bgpstream_community_t summary;
+  int i, n = bgpstream_community_set_size(set);
+
+  if (n == 0) {
+    return 0;
+  }
+  if (idx->match_any != 0) {
+    return 1;
+  }
+  summary = bgpstream_community_set_summary(set);
+  if ((summary.ui32 & idx->required.ui32) != idx->required.ui32) {
+    return 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    c = bgpstream_community_set_get(set, i);
+    if ((idx->asns != NULL && BITMAP_TEST(idx->asns, c->asn)) ||
+        (idx->values != NULL && BITMAP_TEST(idx->values, c->value)) ||
+        (idx->exact != NULL && bgpstream_id_set_exists(idx->exact, c->ui32))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void bgpstream_filter_mgr_elem_fields_set(bgpstream_filter_mgr_t *this,
+                                          uint8_t fields)
+{
+  assert(this != NULL);
+  this->elem_fields = fields & BGPSTREAM_ELEM_FIELD_ALL;
+}
+
+// get the elem fields that the elem filters of the given manager look at
+static uint8_t elem_filter_fields(bgpstream_filter_mgr_t *this)
+{
+  uint8_t fields = 0;
+
+  if (this->aspath_exprs != NULL || this->origin_asns != NULL) {
+    fields |= BGPSTREAM_ELEM_FIELD_AS_PATH;
+  }
+  if (this->communities != NULL) {
+    fields |= BGPSTREAM_ELEM_FIELD_COMMUNITIES;
+  }
+  return fields;
+}
+
+uint8_t bgpstream_filter_mgr_elem_fields(bgpstream_filter_mgr_t *this)
+{
+  uint8_t fields;
+  int i;
+
+  if (this == NULL) {
+    return BGPSTREAM_ELEM_FIELD_ALL;
+  }
+  fields = this->elem_fields;
+
+  // elem filters are applied after decoding, so whatever they look at must
+  // be decoded regardless of what the user asked for
+  fields |= elem_filter_fields(this);
+  for (i = 0; i < this->sets_cnt; i++) {
+    fields |= elem_filter_fields(this->sets[i].mgr);
+  }
+  return fields;
+}
+
+void bgpstream_filter_mgr_decode_threads_set(bgpstream_filter_mgr_t *this,
+                                             int threads)
+{
+  assert(this != NULL);
+  this->decode_threads = threads;
+}
+
+void bgpstream_filter_mgr_bmp_decode_threads_set(bgpstream_filter_mgr_t *this,
+                                                 int threads)
+{
+  assert(this != NULL);
+  this->bmp_decode_threads = threads;
+}
+
+void bgpstream_filter_mgr_decompress_threads_set(bgpstream_filter_mgr_t *this,
+                                                 int threads)
+{
+  assert(this != NULL);
+  this->decompress_threads = threads;
+}
+
+void bgpstream_filter_mgr_io_depth_set(bgpstream_filter_mgr_t *this,
+                                       int depth)
+{
+  assert(this != NULL);
+  this->io_depth = depth;
+}
+
+void bgpstream_filter_mgr_http_streams_set(bgpstream_filter_mgr_t *this,
+                                           int streams)
+{
+  assert(this != NULL);
+  this->http_streams = streams;
+}
+
+int bgpstream_filter_mgr_worker_cpus_set(bgpstream_filter_mgr_t *this,
+                                         const char *cpus)
+{
+  bgpstream_cpuset_t *set = NULL;
+
+  assert(this != NULL);
+  if (cpus != NULL && (set = bgpstream_cpuset_create(cpus)) == NULL) {
+    return -1;
+  }
+  bgpstream_cpuset_destroy(this->worker_cpus);
+  this->worker_cpus = set;
+  return 0;
+}
+
+void bgpstream_filter_mgr_keep_raw_set(bgpstream_filter_mgr_t *this,
+                                       int enabled)
+{
+  assert(this != NULL);
+  this->keep_raw = enabled;
+}
+
+void bgpstream_filter_mgr_rib_diff_set(bgpstream_filter_mgr_t *this,
+                                       int enabled)
+{
+  assert(this != NULL);
+  this->rib_diff = enabled;
+}
+
+void bgpstream_filter_mgr_dedup_window_set(bgpstream_filter_mgr_t *this,
+                                           uint32_t window)
+{
+  assert(this != NULL);
+  this->dedup_window = window;
+}
+
 int bgpstream_filter_mgr_interval_filter_add(
   bgpstream_filter_mgr_t *this, uint32_t begin_time, uint32_t end_time)
 {
+  bgpstream_interval_filter_t *tmp;
+  int alloc;
+
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: add_filter start");
   if (this == NULL) {
     return 1; // nothing to customize
   }
-  // create a new filter structure
-  bgpstream_interval_filter_t *f =
-    (bgpstream_interval_filter_t *)malloc(sizeof(bgpstream_interval_filter_t));
-  if (f == NULL) {
+  if (this->time_interval == NULL &&
+      (this->time_interval = malloc(sizeof(bgpstream_interval_filter_t))) ==
+        NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
     return 0;
   }
-  // copying filter values
-  f->begin_time = begin_time;
-  f->end_time = end_time;
-  this->time_interval = f;
+  if (this->time_windows_cnt == this->time_windows_alloc_cnt) {
+    alloc =
+      this->time_windows_alloc_cnt == 0 ? 4 : this->time_windows_alloc_cnt * 2;
+    if ((tmp = realloc(this->time_windows,
+                       sizeof(bgpstream_interval_filter_t) * alloc)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
+      return 0;
+    }
+    this->time_windows = tmp;
+    this->time_windows_alloc_cnt = alloc;
+  }
+  this->time_windows[this->time_windows_cnt].begin_time = begin_time;
+  this->time_windows[this->time_windows_cnt].end_time = end_time;
+  this->time_windows_cnt++;
+
+  // the covering interval is what the data interfaces query for
+  if (this->time_windows_cnt == 1) {
+    *this->time_interval = this->time_windows[0];
+  } else {
+    if (begin_time < this->time_interval->begin_time) {
+      this->time_interval->begin_time = begin_time;
+    }
+    if (end_time == BGPSTREAM_FOREVER ||
+        (this->time_interval->end_time != BGPSTREAM_FOREVER &&
+         end_time > this->time_interval->end_time)) {
+      this->time_interval->end_time = end_time;
+    }
+  }
 
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: add_filter stop");
   return 1;
 }
 
-int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *filter_mgr)
+// the last time of a time interval
+static uint32_t window_end(const bgpstream_interval_filter_t *w)
 {
-  /* currently we only validate the interval */
-  bgpstream_interval_filter_t *TIF = filter_mgr->time_interval;
-  if (TIF != NULL && (TIF->end_time != BGPSTREAM_FOREVER &&
-                      TIF->begin_time > TIF->end_time)) {
-    /* invalid interval */
-    bgpstream_log(BGPSTREAM_LOG_ERR,
-                  "Interval start %" PRIu32 " is later than end %" PRIu32 "\n",
-                  TIF->begin_time, TIF->end_time);
-    return -1;
-  }
+  return w->end_time == BGPSTREAM_FOREVER ? UINT32_MAX : w->end_time;
+}
 
+static int cmp_window(const void *a, const void *b)
+{
+  const bgpstream_interval_filter_t *wa = a, *wb = b;
+
+  if (wa->begin_time != wb->begin_time) {
+    return wa->begin_time < wb->begin_time ? -1 : 1;
+  }
   return 0;
 }
 
-/* destroy the memory allocated for bgpstream filter */
-void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *this)
+// sort the time intervals, and merge those that overlap or touch, so that
+// they can be binary searched
+static void merge_windows(bgpstream_filter_mgr_t *this)
 {
-  bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: destroy start");
-  if (this == NULL) {
-    return; // nothing to destroy
+  bgpstream_interval_filter_t *w = this->time_windows;
+  int i, cnt = 0;
+
+  if (this->time_windows_cnt < 2) {
+    return;
   }
-  // destroying filters
-  khiter_t k;
-  // projects
-  if (this->projects != NULL) {
-    bgpstream_str_set_destroy(this->projects);
+  qsort(w, this->time_windows_cnt, sizeof(bgpstream_interval_filter_t),
+        cmp_window);
+  for (i = 1; i < this->time_windows_cnt; i++) {
+    if (window_end(&w[cnt]) == UINT32_MAX ||
+        w[i].begin_time <= window_end(&w[cnt]) + 1) {
+      if (window_end(&w[i]) > window_end(&w[cnt])) {
+        w[cnt].end_time = w[i].end_time;
+      }
+    } else {
+      w[++cnt] = w[i];
+    }
   }
-  // collectors
-  if (this->collectors != NULL) {
-    bgpstream_str_set_destroy(this->collectors);
+  this->time_windows_cnt = cnt + 1;
+}
+
+// find the last time interval that begins at or before the given time (-1 if
+// there is none)
+static int find_window(const bgpstream_filter_mgr_t *this, uint32_t time)
+{
+  int lo = 0, hi = this->time_windows_cnt, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (this->time_windows[mid].begin_time <= time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo - 1;
+}
+
+int bgpstream_filter_mgr_time_wanted(const bgpstream_filter_mgr_t *this,
+                                     uint32_t time)
+{
+  int i;
+
+  if (this->time_windows_cnt == 0) {
+    return 1;
+  }
+  return (i = find_window(this, time)) >= 0 &&
+         time <= window_end(&this->time_windows[i]);
+}
+
+int bgpstream_filter_mgr_time_overlaps(const bgpstream_filter_mgr_t *this,
+                                       uint32_t begin_time, uint32_t end_time)
+{
+  int i;
+
+  if (this->time_windows_cnt == 0) {
+    return 1;
+  }
+  // the intervals are disjoint, so the last one to begin before the end is
+  // also the last one to end
+  return (i = find_window(this, end_time)) >= 0 &&
+         begin_time <= window_end(&this->time_windows[i]);
+}
+
+uint32_t bgpstream_filter_mgr_time_next(const bgpstream_filter_mgr_t *this,
+                                        uint32_t time)
+{
+  int i;
+
+  if (this->time_windows_cnt == 0) {
+    return time;
+  }
+  if ((i = find_window(this, time)) >= 0 &&
+      time <= window_end(&this->time_windows[i])) {
+    return time;
+  }
+  if (i + 1 < this->time_windows_cnt) {
+    return this->time_windows[i + 1].begin_time;
+  }
+  return 0;
+}
+
+void bgpstream_filter_mgr_time_clip(bgpstream_filter_mgr_t *this,
+                                    uint32_t time)
+{
+  bgpstream_interval_filter_t *w = this->time_windows;
+  int i, cnt = 0, last = -1;
+
+  if (this->time_windows_cnt == 0) {
+    return;
+  }
+  // the intervals may not have been sorted yet
+  for (i = 0; i < this->time_windows_cnt; i++) {
+    if (last < 0 || window_end(&w[i]) > window_end(&w[last])) {
+      last = i;
+    }
+  }
+  if (window_end(&w[last]) < time) {
+    w[0].begin_time = w[last].end_time;
+    w[0].end_time = w[last].end_time;
+    cnt = 1;
+  } else {
+    for (i = 0; i < this->time_windows_cnt; i++) {
+      if (window_end(&w[i]) < time) {
+        continue;
+      }
+      w[cnt] = w[i];
+      if (w[cnt].begin_time < time) {
+        w[cnt].begin_time = time;
+      }
+      cnt++;
+    }
+  }
+  this->time_windows_cnt = cnt;
+
+  // the covering interval starts with the earliest of the remaining ones
+  this->time_interval->begin_time = w[0].begin_time;
+  for (i = 1; i < cnt; i++) {
+    if (w[i].begin_time < this->time_interval->begin_time) {
+      this->time_interval->begin_time = w[i].begin_time;
+    }
+  }
+}
+
+static bgpstream_patricia_walk_cb_result_t pfx_exists(
+    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+    void *data)
+{
+  *(int*)data = 1;
+  return BGPSTREAM_PATRICIA_WALK_END_ALL;
+}
+
+static bgpstream_patricia_walk_cb_result_t pfx_allows_more_specifics(
+    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+    void *data)
+{
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
+      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_MORE) {
+    *(int*)data = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static bgpstream_patricia_walk_cb_result_t pfx_allows_less_specifics(
+    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+    void *data)
+{
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
+      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_LESS) {
+    *(int*)data = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static int bgpstream_elem_prefix_match(bgpstream_patricia_tree_t *prefixes,
+                                       bgpstream_pfx_t *search)
+{
+  int matched = 0;
+
+  bgpstream_patricia_tree_walk_up_down(prefixes, search, pfx_exists,
+      pfx_allows_more_specifics, pfx_allows_less_specifics, &matched);
+  return matched;
+}
+
+/* Elem checks. Each returns 1 if the elem passes the filter, 0 otherwise */
+
+static int check_elemtype(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+    return (this->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_RIB) != 0;
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    return (this->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT) != 0;
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    return (this->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL) != 0;
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    return (this->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE) != 0;
+  default:
+    return 1;
+  }
+}
+
+static int check_peer_asn(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  return bgpstream_id_set_exists(this->peer_asns, elem->peer_asn) != 0;
+}
+
+static int check_origin_asn(bgpstream_filter_mgr_t *this,
+                            bgpstream_elem_t *elem)
+{
+  uint32_t origin_asn;
+
+  if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+      elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE ||
+      bgpstream_as_path_get_origin_val(elem->as_path, &origin_asn) < 0) {
+    return 0;
+  }
+  return bgpstream_id_set_exists(this->origin_asns, origin_asn) != 0;
+}
+
+static int check_ipversion(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  return elem->type != BGPSTREAM_ELEM_TYPE_PEERSTATE &&
+         elem->prefix.address.version == this->ipversion;
+}
+
+static int check_prefix(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return 0;
+  }
+  if (this->pfx_index != NULL) {
+    return bgpstream_pfx_index_match(this->pfx_index, &elem->prefix);
+  }
+  return bgpstream_elem_prefix_match(this->prefixes, &elem->prefix) != 0;
+}
+
+static int check_aspath(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  return elem->type != BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
+         elem->type != BGPSTREAM_ELEM_TYPE_PEERSTATE &&
+         bgpstream_filter_mgr_aspath_match(this, elem->as_path) != 0;
+}
+
+static int check_community(bgpstream_filter_mgr_t *this,
+                           bgpstream_elem_t *elem)
+{
+  return elem->type != BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
+         elem->type != BGPSTREAM_ELEM_TYPE_PEERSTATE &&
+         bgpstream_filter_mgr_community_match(this, elem->communities) != 0;
+}
+
+// The sample is decided by a hash of fields that are the same for every
+// collector (and every run), so that a 1/N sample of the stream sees every
+// update of the prefixes (or peers) that it keeps. The weak low bits of the
+// khash-based hashes are mixed in before taking the modulo.
+static uint64_t sample_mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static int check_sample(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem)
+{
+  uint64_t h;
+
+  if (this->sample_key == BGPSTREAM_FILTER_SAMPLE_PEER) {
+    h = bgpstream_addr_hash(&elem->peer_ip) ^
+        ((uint64_t)elem->peer_asn << 32);
+  } else if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    // peer state changes have no prefix, and apply to all of them
+    return 1;
+  } else {
+    h = bgpstream_pfx_hash(&elem->prefix);
+  }
+  return sample_mix(h) % this->sample_den < this->sample_num;
+}
+
+static void add_elem_check(bgpstream_filter_mgr_t *this,
+                           bgpstream_elem_check_func_t *func, uint8_t needs,
+                           uint8_t cost, bgpstream_stat_t stat)
+{
+  bgpstream_elem_check_t *check = &this->elem_checks[this->elem_checks_cnt++];
+
+  assert(this->elem_checks_cnt <= BGPSTREAM_ELEM_CHECKS_MAX);
+  check->func = func;
+  check->needs = needs;
+  check->cost = cost;
+  check->stat = stat;
+  check->evals = 0;
+  check->rejects = 0;
+}
+
+// choose the elem filter function for the checks that are set (defined below)
+static bgpstream_elem_filter_func_t *
+select_elem_filter(bgpstream_filter_mgr_t *this);
+
+// compile the elem filters that are set into a list of checks, in order of
+// (estimated) cost
+static void compile_elem_checks(bgpstream_filter_mgr_t *this)
+{
+  this->elem_checks_cnt = 0;
+  this->elem_checks_run = 0;
+
+  // if the prefixes can't be compiled, the tree is walked instead
+  bgpstream_pfx_index_destroy(this->pfx_index);
+  this->pfx_index = NULL;
+  if (this->prefixes != NULL) {
+    this->pfx_index = bgpstream_pfx_index_create(this->prefixes);
+  }
+
+  if (this->elemtype_mask) {
+    add_elem_check(this, check_elemtype, 0, 1,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_ELEMTYPE);
+  }
+  if (this->ipversion) {
+    add_elem_check(this, check_ipversion, BGPSTREAM_ELEM_CHECK_PREFIX, 1,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_IPVERSION);
+  }
+  if (this->sample_den != 0) {
+    add_elem_check(this, check_sample,
+                   this->sample_key == BGPSTREAM_FILTER_SAMPLE_PEER
+                     ? BGPSTREAM_ELEM_CHECK_PEER
+                     : BGPSTREAM_ELEM_CHECK_PREFIX,
+                   1, BGPSTREAM_STAT_ELEMS_FILTERED_SAMPLE);
+  }
+  if (this->peer_asns != NULL && this->asns_indexed == 0) {
+    add_elem_check(this, check_peer_asn, BGPSTREAM_ELEM_CHECK_PEER, 2,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_PEER_ASN);
+  }
+  if (this->origin_asns != NULL && this->asns_indexed == 0) {
+    add_elem_check(this, check_origin_asn, BGPSTREAM_ELEM_CHECK_PATH, 3,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_ORIGIN_ASN);
+  }
+  if (this->communities != NULL) {
+    add_elem_check(this, check_community, BGPSTREAM_ELEM_CHECK_PATH, 4,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_COMMUNITY);
+  }
+  if (this->prefixes != NULL) {
+    add_elem_check(this, check_prefix, BGPSTREAM_ELEM_CHECK_PREFIX, 6,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_PREFIX);
+  }
+  if (this->aspath_exprs != NULL) {
+    add_elem_check(this, check_aspath, BGPSTREAM_ELEM_CHECK_PATH, 8,
+                   BGPSTREAM_STAT_ELEMS_FILTERED_ASPATH);
+  }
+  this->elem_filter = select_elem_filter(this);
+  this->elem_checks_valid = 1;
+}
+
+// is check a better run before check b? (the expected cost of running a
+// first is lower if cost_a / reject_rate_a < cost_b / reject_rate_b)
+static int elem_check_before(const bgpstream_elem_check_t *a,
+                             const bgpstream_elem_check_t *b)
+{
+  // the +1s avoid dividing by zero for checks that haven't run (or rejected)
+  return (double)a->cost * (a->evals + 1) * (b->rejects + 1) <
+         (double)b->cost * (b->evals + 1) * (a->rejects + 1);
+}
+
+// reorder the checks by their observed rejection rates, and age the counts so
+// that the order follows changes in the stream
+static void reorder_elem_checks(bgpstream_filter_mgr_t *this)
+{
+  bgpstream_elem_check_t tmp;
+  int i, j;
+
+  for (i = 1; i < this->elem_checks_cnt; i++) {
+    tmp = this->elem_checks[i];
+    for (j = i; j > 0 && elem_check_before(&tmp, &this->elem_checks[j - 1]);
+         j--) {
+      this->elem_checks[j] = this->elem_checks[j - 1];
+    }
+    this->elem_checks[j] = tmp;
+  }
+  for (i = 0; i < this->elem_checks_cnt; i++) {
+    this->elem_checks[i].evals /= 2;
+    this->elem_checks[i].rejects /= 2;
+  }
+}
+
+// the elem filter when several checks are set: run them all, in the order
+// that rejects elems soonest
+static int elem_filter_all(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem,
+                           int count)
+{
+  bgpstream_elem_check_t *check, *end;
+
+  if (++this->elem_checks_run == BGPSTREAM_ELEM_CHECKS_REORDER_INTERVAL) {
+    reorder_elem_checks(this);
+    this->elem_checks_run = 0;
+  }
+
+  end = this->elem_checks + this->elem_checks_cnt;
+  for (check = this->elem_checks; check < end; check++) {
+    check->evals++;
+    if (check->func(this, elem) == 0) {
+      check->rejects++;
+      if (count != 0) {
+        bgpstream_stats_add(check->stat, 1);
+      }
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// the elem filters when a single check is set, which needs no reordering (the
+// common ones call their check directly)
+static int elem_filter_one(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem,
+                           int count)
+{
+  if (this->elem_checks[0].func(this, elem) == 0) {
+    if (count != 0) {
+      bgpstream_stats_add(this->elem_checks[0].stat, 1);
+    }
+    return 0;
+  }
+  return 1;
+}
+
+#define ELEM_FILTER_ONE(name, check, stat)                                     \
+  static int name(bgpstream_filter_mgr_t *this, bgpstream_elem_t *elem,        \
+                  int count)                                                   \
+  {                                                                            \
+    if (check(this, elem) == 0) {                                              \
+      if (count != 0) {                                                        \
+        bgpstream_stats_add(stat, 1);                                          \
+      }                                                                        \
+      return 0;                                                                \
+    }                                                                          \
+    return 1;                                                                  \
+  }
+
+ELEM_FILTER_ONE(elem_filter_prefix, check_prefix,
+                BGPSTREAM_STAT_ELEMS_FILTERED_PREFIX)
+ELEM_FILTER_ONE(elem_filter_peer_asn, check_peer_asn,
+                BGPSTREAM_STAT_ELEMS_FILTERED_PEER_ASN)
+ELEM_FILTER_ONE(elem_filter_origin_asn, check_origin_asn,
+                BGPSTREAM_STAT_ELEMS_FILTERED_ORIGIN_ASN)
+
+// choose the elem filter function for the checks that are set
+static bgpstream_elem_filter_func_t *
+select_elem_filter(bgpstream_filter_mgr_t *this)
+{
+  if (this->elem_checks_cnt == 0) {
+    return NULL;
+  }
+  if (this->elem_checks_cnt > 1) {
+    return elem_filter_all;
+  }
+  if (this->elem_checks[0].func == check_prefix) {
+    return elem_filter_prefix;
+  }
+  if (this->elem_checks[0].func == check_peer_asn) {
+    return elem_filter_peer_asn;
+  }
+  if (this->elem_checks[0].func == check_origin_asn) {
+    return elem_filter_origin_asn;
+  }
+  return elem_filter_one;
+}
+
+// run the elem checks, and (unless the manager is a filter set, whose elems
+// are not dropped by a failed check) count the elems that are filtered out
+static int run_elem_checks(bgpstream_filter_mgr_t *this,
+                           bgpstream_elem_t *elem, int count)
+{
+  if (this->elem_checks_valid == 0) {
+    compile_elem_checks(this);
+  }
+  return this->elem_filter == NULL ? 1 : this->elem_filter(this, elem, count);
+}
+
+int bgpstream_filter_mgr_elem_check(bgpstream_filter_mgr_t *this,
+                                    bgpstream_elem_t *elem)
+{
+  return run_elem_checks(this, elem, 1);
+}
+
+bgpstream_elem_filter_func_t *
+bgpstream_filter_mgr_get_elem_filter(bgpstream_filter_mgr_t *this)
+{
+  if (this->elem_checks_valid == 0) {
+    compile_elem_checks(this);
+  }
+  return this->elem_filter;
+}
+
+int bgpstream_filter_mgr_elem_precheck(bgpstream_filter_mgr_t *this,
+                                       bgpstream_elem_t *elem, uint8_t known)
+{
+  int i;
+
+  if (this->elem_checks_valid == 0) {
+    compile_elem_checks(this);
+  }
+
+  // these checks don't count towards the rejection rates, since the elems
+  // that pass are checked again once they are complete. the elems they reject
+  // are counted as generated (and filtered) though, as they would have been
+  // without the early check
+  for (i = 0; i < this->elem_checks_cnt; i++) {
+    if ((this->elem_checks[i].needs & ~known) == 0 &&
+        this->elem_checks[i].func(this, elem) == 0) {
+      bgpstream_stats_add(BGPSTREAM_STAT_ELEMS_GENERATED, 1);
+      bgpstream_stats_add(this->elem_checks[i].stat, 1);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int bgpstream_filter_mgr_filter_set_add(bgpstream_filter_mgr_t *this,
+                                        const char *name)
+{
+  bgpstream_filter_set_t *set;
+  int i;
+
+  if (name == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Filter sets must be named");
+    return -1;
+  }
+  for (i = 0; i < this->sets_cnt; i++) {
+    if (strcmp(this->sets[i].name, name) == 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Duplicate filter set '%s'", name);
+      return -1;
+    }
+  }
+  if (this->sets_cnt == BGPSTREAM_FILTER_SETS_MAX) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "At most %d filter sets are supported",
+                  BGPSTREAM_FILTER_SETS_MAX);
+    return -1;
+  }
+  if (this->sets == NULL &&
+      (this->sets = malloc_zero(sizeof(bgpstream_filter_set_t) *
+                                BGPSTREAM_FILTER_SETS_MAX)) == NULL) {
+    return -1;
+  }
+
+  set = &this->sets[this->sets_cnt];
+  if ((set->mgr = bgpstream_filter_mgr_create()) == NULL) {
+    return -1;
+  }
+  if ((set->name = strdup(name)) == NULL) {
+    bgpstream_filter_mgr_destroy(set->mgr);
+    set->mgr = NULL;
+    return -1;
+  }
+  // the peer and origin ASN filters of all the sets are looked up at once in
+  // the indexes of this manager
+  set->mgr->asns_indexed = 1;
+  this->sets_index_valid = 0;
+  return this->sets_cnt++;
+}
+
+// Check that the given filter can be added to a filter set.
+// Returns 1 if it can, 0 otherwise.
+static int bsf_set_filter_check(bgpstream_filter_mgr_t *this, int set,
+                                bgpstream_filter_type_t filter_type)
+{
+  if (set < 0 || set >= this->sets_cnt) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid filter set %d", set);
+    return 0;
+  }
+
+  switch (filter_type) {
+  case BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN:
+  case BGPSTREAM_FILTER_TYPE_ELEM_ORIGIN_ASN:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY:
+  case BGPSTREAM_FILTER_TYPE_ELEM_COMMUNITY:
+  case BGPSTREAM_FILTER_TYPE_ELEM_ASPATH:
+  case BGPSTREAM_FILTER_TYPE_ELEM_IP_VERSION:
+  case BGPSTREAM_FILTER_TYPE_ELEM_TYPE:
+  case BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE:
+    return 1;
+
+  default:
+    // the sets share the records of the stream, so they can only select
+    // among their elems
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Only elem filters can be added to filter set '%s'",
+                  this->sets[set].name);
+    return 0;
+  }
+}
+
+int bgpstream_filter_mgr_filter_set_filter_add(
+  bgpstream_filter_mgr_t *this, int set, bgpstream_filter_type_t filter_type,
+  const char *filter_value)
+{
+  if (!bsf_set_filter_check(this, set, filter_type)) {
+    return 0;
+  }
+
+  this->sets_index_valid = 0;
+  return bgpstream_filter_mgr_filter_add(this->sets[set].mgr, filter_type,
+                                         filter_value);
+}
+
+// Get the next value of a filter list into value (of
+// BGPSTREAM_FILTER_LIST_VALUE_LEN bytes), skipping blank and comment lines.
+// Returns 1 if a value was found, 0 at the end of the list, -1 on error.
+static int bsf_list_next(const char **bufp, const char *end, char *value,
+                         int *line)
+{
+  const char *p = *bufp;
+  const char *q, *eol;
+
+  for (; p < end; p = eol + 1) {
+    (*line)++;
+    if ((eol = memchr(p, '\n', end - p)) == NULL) {
+      eol = end;
+    }
+    for (q = eol; q > p && isspace((unsigned char)q[-1]); q--)
+      ;
+    while (p < q && isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (p == q || *p == '#') {
+      continue;
+    }
+    if (q - p >= BGPSTREAM_FILTER_LIST_VALUE_LEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "filter value on line %d is too long",
+                    *line);
+      return -1;
+    }
+    memcpy(value, p, q - p);
+    value[q - p] = '\0';
+    *bufp = eol + 1;
+    return 1;
+  }
+  *bufp = end;
+  return 0;
+}
+
+// Add a list of prefixes in one pass: they are all parsed first, and then
+// inserted into the tree in sorted order.
+static int bsf_prefix_list_add(bgpstream_filter_mgr_t *this,
+                               bgpstream_filter_type_t filter_type,
+                               const char *buf, size_t len)
+{
+  bgpstream_pfx_t *pfxs = NULL, *tmp;
+  size_t pfxs_cnt = 0, pfxs_alloc_cnt = 0;
+  uint8_t matchtype = bsf_prefix_matchtype(filter_type);
+  char value[BGPSTREAM_FILTER_LIST_VALUE_LEN];
+  const char *end = buf + len;
+  int line = 0;
+  int ret;
+  int rc = 0;
+
+  while ((ret = bsf_list_next(&buf, end, value, &line)) > 0) {
+    if (pfxs_cnt == pfxs_alloc_cnt) {
+      pfxs_alloc_cnt = (pfxs_alloc_cnt == 0) ? 1024 : pfxs_alloc_cnt * 2;
+      if ((tmp = realloc(pfxs, sizeof(bgpstream_pfx_t) * pfxs_alloc_cnt)) ==
+          NULL) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
+        goto done;
+      }
+      pfxs = tmp;
+    }
+    if (!bgpstream_str2pfx(value, &pfxs[pfxs_cnt])) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "invalid prefix '%s' on line %d",
+                    value, line);
+      goto done;
+    }
+    pfxs[pfxs_cnt++].allowed_matches = matchtype;
+  }
+
+  if (ret < 0) {
+    goto done;
+  }
+  if (pfxs_cnt == 0) {
+    // like any other empty list, this adds no filter
+    rc = 1;
+    goto done;
+  }
+
+  if (this->prefixes == NULL &&
+      (this->prefixes = bgpstream_patricia_tree_create(NULL)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't allocate memory");
+    goto done;
+  }
+  if (bgpstream_patricia_tree_insert_bulk(this->prefixes, pfxs, pfxs_cnt) !=
+      0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't add prefix");
+    goto done;
+  }
+  bgpstream_log(BGPSTREAM_LOG_FINE, "added %zu prefixes", pfxs_cnt);
+  rc = 1;
+
+done:
+  free(pfxs);
+  return rc;
+}
+
+int bgpstream_filter_mgr_filter_list_add(bgpstream_filter_mgr_t *this, int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *buf, size_t len)
+{
+  char value[BGPSTREAM_FILTER_LIST_VALUE_LEN];
+  const char *end = buf + len;
+  int line = 0;
+  int ret;
+
+  if (set >= 0) {
+    if (!bsf_set_filter_check(this, set, filter_type)) {
+      return 0;
+    }
+    this->sets_index_valid = 0;
+    this = this->sets[set].mgr;
+  }
+
+  switch (filter_type) {
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT:
+  case BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY:
+    // the elem checks are recompiled the next time they are needed
+    this->elem_checks_valid = 0;
+    return bsf_prefix_list_add(this, filter_type, buf, len);
+
+  default:
+    break;
+  }
+
+  // other filters are cheap to add, so each value is added on its own
+  while ((ret = bsf_list_next(&buf, end, value, &line)) > 0) {
+    if (!bgpstream_filter_mgr_filter_add(this, filter_type, value)) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "invalid filter value on line %d",
+                    line);
+      return 0;
+    }
+  }
+  return ret == 0;
+}
+
+int bgpstream_filter_mgr_filter_file_add(bgpstream_filter_mgr_t *this, int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *path)
+{
+  struct stat st;
+  void *buf = NULL;
+  int fd;
+  int rc = 0;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "could not open filter file %s: %s", path,
+                  strerror(errno));
+    goto done;
+  }
+  if (st.st_size > 0 &&
+      (buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+        MAP_FAILED) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "could not map filter file %s: %s", path,
+                  strerror(errno));
+    buf = NULL;
+    goto done;
+  }
+  if (buf != NULL) {
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+  }
+
+  if ((rc = bgpstream_filter_mgr_filter_list_add(
+         this, set, filter_type, buf != NULL ? buf : "",
+         buf != NULL ? st.st_size : 0)) == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "could not load filter file %s", path);
+  }
+
+done:
+  if (buf != NULL) {
+    munmap(buf, st.st_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return rc;
+}
+
+const char *bgpstream_filter_mgr_filter_set_name(bgpstream_filter_mgr_t *this,
+                                                 int set)
+{
+  if (set < 0 || set >= this->sets_cnt) {
+    return NULL;
+  }
+  return this->sets[set].name;
+}
+
+// add the given ASNs to a filter set index, with the given set bit
+static int sets_index_add(bgpstream_filter_set_index_t **idxp,
+                          bgpstream_id_set_t *asns, uint64_t bit)
+{
+  uint32_t *asn;
+  khiter_t k;
+  int khret;
+
+  if (*idxp == NULL &&
+      (*idxp = kh_init(bgpstream_filter_set_index)) == NULL) {
+    return -1;
+  }
+  bgpstream_id_set_rewind(asns);
+  while ((asn = bgpstream_id_set_next(asns)) != NULL) {
+    k = kh_put(bgpstream_filter_set_index, *idxp, *asn, &khret);
+    if (khret < 0) {
+      return -1;
+    }
+    if (khret > 0) {
+      kh_val(*idxp, k) = 0;
+    }
+    kh_val(*idxp, k) |= bit;
+  }
+  return 0;
+}
+
+// (re)build the peer and origin ASN indexes of the filter sets
+static int build_sets_index(bgpstream_filter_mgr_t *this)
+{
+  bgpstream_filter_mgr_t *mgr;
+  uint64_t bit;
+  int i;
+
+  if (this->sets_peer_index != NULL) {
+    kh_clear(bgpstream_filter_set_index, this->sets_peer_index);
+  }
+  if (this->sets_origin_index != NULL) {
+    kh_clear(bgpstream_filter_set_index, this->sets_origin_index);
+  }
+  this->sets_peer_any = 0;
+  this->sets_origin_any = 0;
+
+  for (i = 0; i < this->sets_cnt; i++) {
+    mgr = this->sets[i].mgr;
+    bit = UINT64_C(1) << i;
+    if (mgr->peer_asns == NULL) {
+      this->sets_peer_any |= bit;
+    } else if (sets_index_add(&this->sets_peer_index, mgr->peer_asns, bit) !=
+               0) {
+      return -1;
+    }
+    if (mgr->origin_asns == NULL) {
+      this->sets_origin_any |= bit;
+    } else if (sets_index_add(&this->sets_origin_index, mgr->origin_asns,
+                              bit) != 0) {
+      return -1;
+    }
+  }
+  this->sets_index_valid = 1;
+  return 0;
+}
+
+// get the mask of the sets that an index selects for the given ASN
+static uint64_t sets_index_get(bgpstream_filter_set_index_t *idx, uint32_t asn)
+{
+  khiter_t k;
+
+  if (idx == NULL ||
+      (k = kh_get(bgpstream_filter_set_index, idx, asn)) == kh_end(idx)) {
+    return 0;
+  }
+  return kh_val(idx, k);
+}
+
+uint64_t bgpstream_filter_mgr_elem_sets_check(bgpstream_filter_mgr_t *this,
+                                              bgpstream_elem_t *elem)
+{
+  uint64_t candidates, origins, bit, mask = 0;
+  uint32_t origin_asn;
+  int i;
+
+  if (this->sets_cnt == 0) {
+    return 0;
+  }
+  if (this->sets_index_valid == 0 && build_sets_index(this) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not index filter sets");
+    return 0;
+  }
+
+  // narrow the sets down with one lookup per index, rather than one per set
+  candidates =
+    this->sets_peer_any | sets_index_get(this->sets_peer_index, elem->peer_asn);
+  if ((candidates & ~this->sets_origin_any) != 0) {
+    origins = this->sets_origin_any;
+    if (elem->type != BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
+        elem->type != BGPSTREAM_ELEM_TYPE_PEERSTATE &&
+        bgpstream_as_path_get_origin_val(elem->as_path, &origin_asn) == 0) {
+      origins |= sets_index_get(this->sets_origin_index, origin_asn);
+    }
+    candidates &= origins;
+  }
+
+  for (i = 0; i < this->sets_cnt && candidates != 0; i++) {
+    bit = UINT64_C(1) << i;
+    if ((candidates & bit) == 0) {
+      continue;
+    }
+    candidates &= ~bit;
+    if (run_elem_checks(this->sets[i].mgr, elem, 0) != 0) {
+      mask |= bit;
+    }
+  }
+  return mask;
+}
+
+int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *filter_mgr)
+{
+  /* currently we only validate the intervals */
+  bgpstream_interval_filter_t *TIF;
+  for (int i = 0; i < filter_mgr->time_windows_cnt; i++) {
+    TIF = &filter_mgr->time_windows[i];
+    if (TIF->end_time != BGPSTREAM_FOREVER &&
+        TIF->begin_time > TIF->end_time) {
+      /* invalid interval */
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Interval start %" PRIu32 " is later than end %" PRIu32
+                    "\n",
+                    TIF->begin_time, TIF->end_time);
+      return -1;
+    }
+  }
+  merge_windows(filter_mgr);
+
+  compile_elem_checks(filter_mgr);
+  for (int i = 0; i < filter_mgr->sets_cnt; i++) {
+    compile_elem_checks(filter_mgr->sets[i].mgr);
+  }
+  if (filter_mgr->sets_cnt > 0 && build_sets_index(filter_mgr) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+/* destroy the memory allocated for bgpstream filter */
+void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *this)
+{
+  bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: destroy start");
+  if (this == NULL) {
+    return; // nothing to destroy
+  }
+  // destroying filters
+  khiter_t k;
+  // projects
+  if (this->projects != NULL) {
+    bgpstream_str_set_destroy(this->projects);
+  }
+  // collectors
+  if (this->collectors != NULL) {
+    bgpstream_str_set_destroy(this->collectors);
   }
   // routers
   if (this->routers != NULL) {
     bgpstream_str_set_destroy(this->routers);
   }
+  // interned names
+  if (this->project_ids != NULL) {
+    bgpstream_id_set_destroy(this->project_ids);
+  }
+  if (this->collector_ids != NULL) {
+    bgpstream_id_set_destroy(this->collector_ids);
+  }
+  if (this->router_ids != NULL) {
+    bgpstream_id_set_destroy(this->router_ids);
+  }
+  bgpstream_str_intern_destroy(this->names);
   // bgp_types
   if (this->bgp_types != NULL) {
     bgpstream_str_set_destroy(this->bgp_types);
@@ -423,13 +1988,23 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *this)
   // aspath expressions
   if (this->aspath_exprs != NULL) {
     for (int i = 0; i < this->aspath_expr_cnt; i++) {
-      if (this->aspath_exprs[i].re) {
-        regfree(this->aspath_exprs[i].re);
-      }
+      aspath_expr_free(&this->aspath_exprs[i]);
     }
     free(this->aspath_exprs);
   }
+  if (this->aspath_cache != NULL) {
+    for (int i = 0; i < BGPSTREAM_ASPATH_CACHE_SIZE; i++) {
+      if (this->aspath_cache[i].path != NULL) {
+        bgpstream_as_path_destroy(this->aspath_cache[i].path);
+      }
+    }
+    BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FILTER,
+                          -(int64_t)(sizeof(*this->aspath_cache) *
+                                     BGPSTREAM_ASPATH_CACHE_SIZE));
+    bgpstream_mem_free(BGPSTREAM_MEM_FILTER, this->aspath_cache);
+  }
   // prefixes
+  bgpstream_pfx_index_destroy(this->pfx_index);
   if (this->prefixes != NULL) {
     bgpstream_patricia_tree_destroy(this->prefixes);
   }
@@ -437,10 +2012,30 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *this)
   if (this->communities != NULL) {
     kh_destroy(bgpstream_community_filter, this->communities);
   }
+  free(this->community_index.asns);
+  free(this->community_index.values);
+  if (this->community_index.exact != NULL) {
+    bgpstream_id_set_destroy(this->community_index.exact);
+  }
+  // filter sets
+  if (this->sets != NULL) {
+    for (int i = 0; i < this->sets_cnt; i++) {
+      free(this->sets[i].name);
+      bgpstream_filter_mgr_destroy(this->sets[i].mgr);
+    }
+    free(this->sets);
+  }
+  if (this->sets_peer_index != NULL) {
+    kh_destroy(bgpstream_filter_set_index, this->sets_peer_index);
+  }
+  if (this->sets_origin_index != NULL) {
+    kh_destroy(bgpstream_filter_set_index, this->sets_origin_index);
+  }
   // time_interval
   if (this->time_interval != NULL) {
     free(this->time_interval);
   }
+  free(this->time_windows);
   // rib/update frequency
   if (this->last_processed_ts != NULL) {
     for (k = kh_begin(this->last_processed_ts);
@@ -451,8 +2046,16 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *this)
     }
     kh_destroy(collector_ts, this->last_processed_ts);
   }
+  // rib diff mode
+  bgpstream_churn_destroy(this->churn);
+  // duplicate suppression
+  bgpstream_dedup_destroy(this->dedup);
+  // worker thread placement
+  bgpstream_cpuset_destroy(this->worker_cpus);
   // free the mgr structure
-  free(this);
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FILTER,
+                        -(int64_t)sizeof(bgpstream_filter_mgr_t));
+  bgpstream_mem_free(BGPSTREAM_MEM_FILTER, this);
   this = NULL;
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: destroy end");
 }
@@ -33,7 +33,11 @@
 #define _BGPSTREAM_FILTER_H
 
 #include "bgpstream.h"
+#include "bgpstream_churn.h"
 #include "bgpstream_constants.h"
+#include "bgpstream_cpuset.h"
+#include "bgpstream_dedup.h"
+#include "bgpstream_pfx_index.h"
 #include "khash.h"
 #include <regex.h>
 
@@ -48,6 +52,23 @@ KHASH_INIT(bgpstream_community_filter, bgpstream_community_t, uint8_t, 1,
            bgpstream_community_hash_value, bgpstream_community_equal_value)
 typedef khash_t(bgpstream_community_filter) bgpstream_community_filter_t;
 
+/* community filters compiled so that each community of an elem is only
+ * looked up once, rather than matched against every filter */
+typedef struct struct_bgpstream_community_index_t {
+  /* is there a "*:*" filter? */
+  uint8_t match_any;
+  /* bitmaps of the ASNs of "asn:*" filters and values of "*:value" filters
+   * (NULL if there are none) */
+  uint64_t *asns;
+  uint64_t *values;
+  /* communities of exact filters (NULL if there are none) */
+  bgpstream_id_set_t *exact;
+  /* bits that are set in every filter, which a community set must have in
+   * its summary to match any of them */
+  bgpstream_community_t required;
+  int filters_cnt;
+} bgpstream_community_index_t;
+
 typedef struct struct_bgpstream_interval_filter_t {
   uint32_t begin_time;
   uint32_t end_time;
@@ -58,29 +79,174 @@ KHASH_INIT(collector_ts, char *, uint32_t, 1, kh_str_hash_func,
 
 typedef khash_t(collector_ts) collector_ts_t;
 
+/* types of the items of a compiled AS path expression */
+#define BGPSTREAM_ASPATH_TOK_ASN 0  /* one ASN from a set */
+#define BGPSTREAM_ASPATH_TOK_ANY 1  /* any one ASN */
+#define BGPSTREAM_ASPATH_TOK_STAR 2 /* any number of ASNs */
+
+/* longest compiled AS path expression (the matcher keeps its states in a
+ * 64-bit mask) */
+#define BGPSTREAM_ASPATH_TOK_MAX 63
+
+typedef struct struct_bgpstream_aspath_tok_t {
+  uint8_t type;
+  /* sorted ASNs accepted by a BGPSTREAM_ASPATH_TOK_ASN item */
+  uint32_t *asns;
+  int asns_cnt;
+} bgpstream_aspath_tok_t;
+
 typedef struct struct_bgpstream_aspath_expr_t {
   regex_t *re;
   uint8_t negate;
+  /* the expression compiled into items that match the ASNs of a path
+   * directly, or NULL if it can only be matched against the string form of
+   * the path */
+  bgpstream_aspath_tok_t *toks;
+  int toks_cnt;
+  uint8_t anchor_start;
+  uint8_t anchor_end;
 } bgpstream_aspath_expr_t;
 
+/* number of entries in the cache of AS path filter results (power of 2) */
+#define BGPSTREAM_ASPATH_CACHE_SIZE 4096
+
+typedef struct struct_bgpstream_aspath_cache_entry_t {
+  bgpstream_as_path_t *path;
+  uint8_t result;
+} bgpstream_aspath_cache_entry_t;
+
+/* a compiled elem filter */
+struct struct_bgpstream_filter_mgr_t;
+typedef int(bgpstream_elem_check_func_t)(
+  struct struct_bgpstream_filter_mgr_t *filter_mgr, bgpstream_elem_t *elem);
+
+/* all the elem filters of a manager, specialized for the checks that are set
+ * (count is 0 for filter sets, whose rejections are not counted) */
+typedef int(bgpstream_elem_filter_func_t)(
+  struct struct_bgpstream_filter_mgr_t *filter_mgr, bgpstream_elem_t *elem,
+  int count);
+
+/* elem fields that a check looks at, besides the elem type (so that formats
+ * can run the checks that can already be decided while they are still
+ * populating an elem) */
+#define BGPSTREAM_ELEM_CHECK_PEER 0x1   /* peer ASN */
+#define BGPSTREAM_ELEM_CHECK_PREFIX 0x2 /* prefix */
+#define BGPSTREAM_ELEM_CHECK_PATH 0x4   /* AS path and communities */
+
+/* what the elem sample filter hashes */
+#define BGPSTREAM_FILTER_SAMPLE_PREFIX 0
+#define BGPSTREAM_FILTER_SAMPLE_PEER 1
+
+typedef struct struct_bgpstream_elem_check_t {
+  bgpstream_elem_check_func_t *func;
+  /* fields the check needs (BGPSTREAM_ELEM_CHECK_*) */
+  uint8_t needs;
+  /* estimated cost of the check */
+  uint8_t cost;
+  /* statistic counting the elems the check filters out */
+  bgpstream_stat_t stat;
+  /* number of elems checked, and rejected (aged at every reorder) */
+  uint64_t evals;
+  uint64_t rejects;
+} bgpstream_elem_check_t;
+
+/* number of kinds of elem filters */
+#define BGPSTREAM_ELEM_CHECKS_MAX 8
+
+/* number of elems between each reordering of the elem checks */
+#define BGPSTREAM_ELEM_CHECKS_REORDER_INTERVAL 4096
+
+/* maximum number of filter sets (each is one bit of a match mask) */
+#define BGPSTREAM_FILTER_SETS_MAX 64
+
+/* a named set of elem filters, matched independently of the other sets */
+struct struct_bgpstream_filter_mgr_t;
+typedef struct struct_bgpstream_filter_set_t {
+  char *name;
+  struct struct_bgpstream_filter_mgr_t *mgr;
+} bgpstream_filter_set_t;
+
+/* hash table shared by the filter sets:
+ * asn -> mask of the sets that list it */
+KHASH_INIT(bgpstream_filter_set_index, uint32_t, uint64_t, 1,
+           kh_int_hash_func, kh_int_hash_equal)
+typedef khash_t(bgpstream_filter_set_index) bgpstream_filter_set_index_t;
+
 typedef struct struct_bgpstream_filter_mgr_t {
   bgpstream_str_set_t *projects;
   bgpstream_str_set_t *collectors;
   bgpstream_str_set_t *routers;
+  /* interned project/collector/router names (shared with the records), and
+   * the ids of the names in the filters above */
+  bgpstream_str_intern_t *names;
+  bgpstream_id_set_t *project_ids;
+  bgpstream_id_set_t *collector_ids;
+  bgpstream_id_set_t *router_ids;
   bgpstream_str_set_t *bgp_types;
   bgpstream_str_set_t *res_types;
   bgpstream_aspath_expr_t *aspath_exprs;
   int aspath_expr_cnt;
   int aspath_expr_alloc_cnt;
+  bgpstream_aspath_cache_entry_t *aspath_cache;
   bgpstream_id_set_t *peer_asns;
   bgpstream_id_set_t *origin_asns;
   bgpstream_patricia_tree_t *prefixes;
+  /* the prefixes compiled for matching (rebuilt with the elem checks) */
+  bgpstream_pfx_index_t *pfx_index;
   bgpstream_community_filter_t *communities;
+  bgpstream_community_index_t community_index;
+  /* the smallest interval that covers all of the time intervals below */
   bgpstream_interval_filter_t *time_interval;
+  /* the time intervals (sorted and merged by _validate if there are several)
+   */
+  bgpstream_interval_filter_t *time_windows;
+  int time_windows_cnt;
+  int time_windows_alloc_cnt;
+  /* the elem filters that are set, cheapest and most selective first */
+  bgpstream_elem_check_t elem_checks[BGPSTREAM_ELEM_CHECKS_MAX];
+  int elem_checks_cnt;
+  int elem_checks_valid;
+  uint32_t elem_checks_run;
+  /* the function that runs the elem checks above (NULL if there are none) */
+  bgpstream_elem_filter_func_t *elem_filter;
+  /* are the peer and origin ASN filters resolved by the index of the parent
+   * manager (so that they are left out of the elem checks)? */
+  uint8_t asns_indexed;
+  /* the filter sets, and the indexes of their peer and origin ASN filters
+   * (with the masks of the sets that don't filter on them) */
+  bgpstream_filter_set_t *sets;
+  int sets_cnt;
+  bgpstream_filter_set_index_t *sets_peer_index;
+  bgpstream_filter_set_index_t *sets_origin_index;
+  uint64_t sets_peer_any;
+  uint64_t sets_origin_any;
+  int sets_index_valid;
   collector_ts_t *last_processed_ts;
   uint32_t rib_period;
   uint8_t ipversion;
   uint8_t elemtype_mask;
+  /* elem sample: keep the elems whose prefix (or peer) hashes to less than
+   * sample_num modulo sample_den (0 if not sampling) */
+  uint8_t sample_key;
+  uint32_t sample_num;
+  uint32_t sample_den;
+  uint8_t elem_fields;
+  int decode_threads;
+  int bmp_decode_threads;
+  int keep_raw;
+  /* RIB diff mode, and the routes it tracks (created on first use) */
+  int rib_diff;
+  bgpstream_churn_t *churn;
+  /* duplicate suppression window, and its state (created on first use) */
+  uint32_t dedup_window;
+  bgpstream_dedup_t *dedup;
+  int decompress_threads;
+
+  // number of background reads kept outstanding for each local dump file
+  int io_depth;
+  int http_streams;
+  /* CPUs that worker threads are pinned to (NULL to let them run anywhere) */
+  bgpstream_cpuset_t *worker_cpus;
 } bgpstream_filter_mgr_t;
 
 /* allocate memory for a new bgpstream filter */
@@ -98,6 +264,144 @@ int bgpstream_filter_mgr_interval_filter_add(
   bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t begin_time,
   uint32_t end_time);
 
+/* check whether the given time is in one of the time intervals (1 if it is,
+ * or if there are no intervals, 0 otherwise) */
+int bgpstream_filter_mgr_time_wanted(const bgpstream_filter_mgr_t *mgr,
+                                     uint32_t time);
+
+/* check whether [begin_time, end_time] overlaps one of the time intervals (1
+ * if it does, or if there are no intervals, 0 otherwise) */
+int bgpstream_filter_mgr_time_overlaps(
+  const bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t begin_time,
+  uint32_t end_time);
+
+/* get the first time, at or after the given one, that is in one of the time
+ * intervals (0 if there is none) */
+uint32_t
+bgpstream_filter_mgr_time_next(const bgpstream_filter_mgr_t *bs_filter_mgr,
+                               uint32_t time);
+
+/* raise the start of the time intervals to the given time (e.g., when resuming
+ * from a checkpoint), dropping the intervals that end before it. the last
+ * interval is kept (reduced to its end time) so that a stream whose intervals
+ * are all over stays bounded */
+void bgpstream_filter_mgr_time_clip(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                    uint32_t time);
+
+/* check whether the given elem passes all the elem filters (1 if it does, 0
+ * otherwise) */
+int bgpstream_filter_mgr_elem_check(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                    bgpstream_elem_t *elem);
+
+/* get the function that runs the elem filters (compiling them if needed), so
+ * that an elem loop can call it directly, or NULL if no elem filters are set.
+ * calling it with count set to 1 is the same as bgpstream_filter_mgr_elem_check
+ */
+bgpstream_elem_filter_func_t *
+bgpstream_filter_mgr_get_elem_filter(bgpstream_filter_mgr_t *bs_filter_mgr);
+
+/* add a filter set, returning its index (the bit of the set in the masks
+ * returned by bgpstream_filter_mgr_elem_sets_check), or -1 on error */
+int bgpstream_filter_mgr_filter_set_add(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                        const char *name);
+
+/* add an elem filter to the given filter set (1 if the filter was added, 0
+ * otherwise) */
+int bgpstream_filter_mgr_filter_set_filter_add(
+  bgpstream_filter_mgr_t *bs_filter_mgr, int set,
+  bgpstream_filter_type_t filter_type, const char *filter_value);
+
+/* longest value in a filter list */
+#define BGPSTREAM_FILTER_LIST_VALUE_LEN 1024
+
+/* add a list of filters of the given type, one value per line (blank lines
+ * and lines starting with '#' are skipped), to the given filter set, or to
+ * the manager itself if set is < 0 (1 if all the filters were added, 0
+ * otherwise) */
+int bgpstream_filter_mgr_filter_list_add(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                         int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *buf, size_t len);
+
+/* add a list of filters read from the given file (see
+ * bgpstream_filter_mgr_filter_list_add) */
+int bgpstream_filter_mgr_filter_file_add(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                         int set,
+                                         bgpstream_filter_type_t filter_type,
+                                         const char *path);
+
+/* get the name of the given filter set (NULL if there is no such set) */
+const char *
+bgpstream_filter_mgr_filter_set_name(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                     int set);
+
+/* get the mask of the filter sets that the given elem passes (0 if there are
+ * no sets) */
+uint64_t bgpstream_filter_mgr_elem_sets_check(
+  bgpstream_filter_mgr_t *bs_filter_mgr, bgpstream_elem_t *elem);
+
+/* check whether the given elem, of which only the type and the given fields
+ * (BGPSTREAM_ELEM_CHECK_*) are populated, may pass the elem filters (0 if it
+ * certainly won't, 1 otherwise) */
+int bgpstream_filter_mgr_elem_precheck(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                       bgpstream_elem_t *elem, uint8_t known);
+
+/* check whether the given AS path passes all the AS path expressions (1 if
+ * it does, 0 otherwise) */
+int bgpstream_filter_mgr_aspath_match(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                      bgpstream_as_path_t *path);
+
+/* check whether the given community set passes the community filters (1 if
+ * it does, 0 otherwise) */
+int bgpstream_filter_mgr_community_match(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                         const bgpstream_community_set_t *set);
+
+/* select the optional elem fields that the format layer should decode */
+void bgpstream_filter_mgr_elem_fields_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                          uint8_t fields);
+
+/* get the elem fields to decode: the selected fields plus any that the
+ * current filters need to inspect */
+uint8_t bgpstream_filter_mgr_elem_fields(bgpstream_filter_mgr_t *bs_filter_mgr);
+
+/* set the number of threads used to decode each RIB dump */
+void bgpstream_filter_mgr_decode_threads_set(
+  bgpstream_filter_mgr_t *bs_filter_mgr, int threads);
+
+/* set the number of threads used to decode each BMP feed */
+void bgpstream_filter_mgr_bmp_decode_threads_set(
+  bgpstream_filter_mgr_t *bs_filter_mgr, int threads);
+
+/* set whether the format layer should keep the raw bytes of each record */
+void bgpstream_filter_mgr_keep_raw_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                       int enabled);
+
+/* set whether only the routes that changed between RIB dumps are returned */
+void bgpstream_filter_mgr_rib_diff_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                       int enabled);
+
+/* set the window of the duplicate update suppression (0 to disable it) */
+void bgpstream_filter_mgr_dedup_window_set(
+  bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t window);
+
+/* set the number of threads used to decompress each local dump file */
+void bgpstream_filter_mgr_decompress_threads_set(
+  bgpstream_filter_mgr_t *bs_filter_mgr, int threads);
+
+/* set the number of background reads kept outstanding for each local dump
+ * file */
+void bgpstream_filter_mgr_io_depth_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                       int depth);
+
+/* set the number of concurrent range requests used to download each remote
+ * dump file */
+void bgpstream_filter_mgr_http_streams_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                           int streams);
+
+/* set the CPUs that worker threads are pinned to (NULL to unpin them) */
+int bgpstream_filter_mgr_worker_cpus_set(bgpstream_filter_mgr_t *bs_filter_mgr,
+                                         const char *cpus);
+
 /* validate the current filters */
 int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *mgr);
 
@@ -72,12 +72,16 @@ static const char *bgpstream_filter_type_to_string(bgpstream_filter_type_t type)
     return "Element Type";
   case BGPSTREAM_FILTER_TYPE_RESOURCE_TYPE:
     return "Resource Type";
+  case BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE:
+    return "Element Sample";
   }
 
   return "Unknown filter term ??";
 }
 
-static int instantiate_filter(bgpstream_t *bs, bgpstream_filter_item_t *item)
+// Add the filter to the given filter set, or to the stream if set is < 0.
+static int instantiate_filter(bgpstream_t *bs, int set,
+                              bgpstream_filter_item_t *item)
 {
   bgpstream_filter_type_t usetype = item->termtype;
 
@@ -97,9 +101,22 @@ static int instantiate_filter(bgpstream_t *bs, bgpstream_filter_item_t *item)
   case BGPSTREAM_FILTER_TYPE_ELEM_IP_VERSION:
   case BGPSTREAM_FILTER_TYPE_ELEM_TYPE:
   case BGPSTREAM_FILTER_TYPE_RESOURCE_TYPE:
+  case BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE:
+    if (item->value[0] == '@') {
+      // load the values of the term from a file
+      bgpstream_log(BGPSTREAM_LOG_FINE, "Adding filters: %s from '%s'",
+          bgpstream_filter_type_to_string(item->termtype), item->value + 1);
+      if (set < 0 ? !bgpstream_add_filter_file(bs, usetype, item->value + 1)
+                  : !bgpstream_add_filter_set_filter_file(bs, set, usetype,
+                                                          item->value + 1))
+        return 0;
+      break;
+    }
     bgpstream_log(BGPSTREAM_LOG_FINE, "Adding filter: %s '%s'",
         bgpstream_filter_type_to_string(item->termtype), item->value);
-    if (!bgpstream_add_filter(bs, usetype, item->value))
+    if (set < 0 ? !bgpstream_add_filter(bs, usetype, item->value)
+                : !bgpstream_add_filter_set_filter(bs, set, usetype,
+                                                   item->value))
       return 0;
     break;
 
@@ -132,6 +149,7 @@ static int instantiate_filter(bgpstream_t *bs, bgpstream_filter_item_t *item)
   X(1,  "extcommunity", "extc", ELEM_EXTENDED_COMMUNITY, VALUE) \
   X(1,  "ipversion",    "ipv",  ELEM_IP_VERSION,         VALUE) \
   X(1,  "elemtype",     NULL,   ELEM_TYPE,               VALUE) \
+  X(-1, "sample",       NULL,   ELEM_SAMPLE,             VALUE) \
   /* for state transition in bgpstream_parse_endvalue() */ \
   X(0,  "prefix",       NULL,   ELEM_PREFIX_ANY,         PREFIXEXT) \
   X(0,  "prefix",       NULL,   ELEM_PREFIX_MORE,        PREFIXEXT) \
@@ -202,6 +220,13 @@ static int bgpstream_parse_value(const char *value, size_t *lenp,
     curr->value = strndup(value + 1, len);
     *lenp = len + 2; // string plus 2 quotes
   } else {
+    if (curr->termtype == BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE &&
+        ((*lenp == 6 && strncmp(value, "prefix", 6) == 0) ||
+         (*lenp == 4 && strncmp(value, "peer", 4) == 0))) {
+      // "sample prefix 1/64": the key and the ratio make up one value
+      *lenp += strspn(value + *lenp, " ");
+      *lenp += strcspn(value + *lenp, " ");
+    }
     // unquoted single-word value
     curr->value = strndup(value, *lenp);
   }
@@ -273,7 +298,7 @@ static fp_state_t bgpstream_parse_endvalue(const char *conj, size_t len,
   }
 }
 
-int bgpstream_parse_filter_string(bgpstream_t *bs, const char *fstring)
+static int parse_filter_string(bgpstream_t *bs, int set, const char *fstring)
 {
   int repeatable[] = {
     #define TERM_REPEATABLE(repeatable, word, alt, termtype, state)   (repeatable),
@@ -310,7 +335,7 @@ retry_token:
         goto endparsing;
       }
       if (state == ENDVALUE) {
-        if (!instantiate_filter(bs, filteritem))
+        if (!instantiate_filter(bs, set, filteritem))
           goto endparsing;
       }
       break;
@@ -319,7 +344,7 @@ retry_token:
       if (bgpstream_parse_value(p, &len, &state, filteritem) == FAIL) {
         goto endparsing;
       }
-      if (!instantiate_filter(bs, filteritem))
+      if (!instantiate_filter(bs, set, filteritem))
         goto endparsing;
       break;
 
@@ -357,3 +382,14 @@ endparsing:
 
   return success;
 }
+
+int bgpstream_parse_filter_string(bgpstream_t *bs, const char *fstring)
+{
+  return parse_filter_string(bs, -1, fstring);
+}
+
+int bgpstream_parse_filter_set_string(bgpstream_t *bs, int set,
+                                      const char *fstring)
+{
+  return parse_filter_string(bs, set, fstring);
+}
@@ -27,10 +27,13 @@
 #include "bgpstream_format.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_parsebgp_common.h"
 #include "bgpstream_resource.h"
+#include "bgpstream_stats.h"
 #include "bgpstream_transport.h"
 #include "utils.h"
 #include <assert.h>
+#include <sys/time.h>
 
 #include "bs_format_bmp.h"
 #include "bs_format_mrt.h"
@@ -83,7 +86,8 @@ bgpstream_format_t *bgpstream_format_create(bgpstream_resource_t *res,
   format->res = res;
 
   // create the transport reader
-  if ((format->transport = bgpstream_transport_create(res)) == NULL) {
+  if ((format->transport = bgpstream_transport_create(res, filter_mgr)) ==
+      NULL) {
     goto err;
   }
 
@@ -104,9 +108,42 @@ bgpstream_format_status_t
 bgpstream_format_populate_record(bgpstream_format_t *format,
                                  bgpstream_record_t *record)
 {
+  bgpstream_format_status_t rc;
+  bgpstream_stat_t stat;
+  uint64_t start = bgpstream_stats_now();
+  struct timeval tv;
+
   // it is a programming error to use a record with a different format
   assert(record->__int->format == format);
-  return format->populate_record(format, record);
+  rc = format->populate_record(format, record);
+
+  if (gettimeofday(&tv, NULL) == 0) {
+    record->read_time_sec = tv.tv_sec;
+    record->read_time_usec = tv.tv_usec;
+  }
+
+  switch (rc) {
+  case BGPSTREAM_FORMAT_OK:
+    stat = BGPSTREAM_STAT_MRT_RECORDS;
+    break;
+  case BGPSTREAM_FORMAT_OUTSIDE_TIME_INTERVAL:
+    stat = BGPSTREAM_STAT_MRT_FILTERED;
+    break;
+  case BGPSTREAM_FORMAT_CORRUPTED_MSG:
+  case BGPSTREAM_FORMAT_CORRUPTED_DUMP:
+    stat = BGPSTREAM_STAT_MRT_CORRUPTED;
+    break;
+  default:
+    stat = _BGPSTREAM_STAT_CNT;
+    break;
+  }
+  if (stat != _BGPSTREAM_STAT_CNT &&
+      (int)format->res->format_type <= BGPSTREAM_RESOURCE_FORMAT_RISLIVE) {
+    bgpstream_stats_add(BGPSTREAM_STAT_FORMAT(stat, format->res->format_type),
+                        1);
+  }
+  bgpstream_stats_add_time(BGPSTREAM_STAT_DECODE_NS, start);
+  return rc;
 }
 
 int bgpstream_format_get_next_elem(bgpstream_format_t *format,
@@ -118,6 +155,11 @@ int bgpstream_format_get_next_elem(bgpstream_format_t *format,
   return format->get_next_elem(format, record, elem);
 }
 
+int bgpstream_format_get_fd(bgpstream_format_t *format)
+{
+  return bgpstream_transport_get_fd(format->transport);
+}
+
 #define DATA(record) ((record)->__int)
 
 int bgpstream_format_init_data(bgpstream_record_t *record)
@@ -161,3 +203,8 @@ void bgpstream_format_destroy(bgpstream_format_t *format)
 
   free(format);
 }
+
+void bgpstream_format_flush_caches(void)
+{
+  bgpstream_parsebgp_reuse_flush();
+}
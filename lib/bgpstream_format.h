@@ -86,6 +86,14 @@ int bgpstream_format_get_next_elem(bgpstream_format_t *format,
                                    bgpstream_record_t *record,
                                    bgpstream_elem_t **elem);
 
+/** Get a pollable file descriptor for the transport underlying this format
+ *
+ * @param format        pointer to the format object to use
+ * @return a file descriptor that becomes readable when new data is available,
+ * or -1 if readiness notification is not supported
+ */
+int bgpstream_format_get_fd(bgpstream_format_t *format);
+
 /** Initialize/create the format data in a given record
  *
  * @param record        pointer to the record to init data for
@@ -111,4 +119,9 @@ void bgpstream_format_destroy_data(bgpstream_record_t *record);
  */
 void bgpstream_format_destroy(bgpstream_format_t *format);
 
+/** Release the memory that the format modules keep for reuse by the calling
+ * thread (e.g., when the last stream it uses is destroyed)
+ */
+void bgpstream_format_flush_caches(void);
+
 #endif /* __BGPSTREAM_FORMAT_H */
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_http.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include "wandio.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// abort a connection that moves less than 1 byte/s for this many seconds
+#define STALL_TIMEOUT 60
+
+struct bgpstream_http {
+
+  // wandio reader, for URLs that are not requested using libcurl
+  io_t *io;
+
+#ifdef WITH_HTTP_POOL
+  CURLM *multi;
+
+  CURL *easy;
+
+  struct curl_slist *hdrs;
+
+  // body data received but not yet read
+  uint8_t *buf;
+  size_t buf_alloc;
+  size_t buf_len;
+  size_t buf_offset;
+
+  // set once the transfer has finished
+  int done;
+  CURLcode result;
+#endif
+};
+
+#ifdef WITH_HTTP_POOL
+
+static pthread_once_t share_once = PTHREAD_ONCE_INIT;
+
+static CURLSH *share = NULL;
+
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+static void share_lock(CURL *easy, curl_lock_data data,
+                       curl_lock_access access, void *user)
+{
+  pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *easy, curl_lock_data data, void *user)
+{
+  pthread_mutex_unlock(&share_locks[data]);
+}
+
+static void init_share(void)
+{
+  int i;
+
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+    pthread_mutex_init(&share_locks[i], NULL);
+  }
+  if ((share = curl_share_init()) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not create HTTP connection pool");
+    return;
+  }
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+void bgpstream_http_share(CURL *easy)
+{
+  pthread_once(&share_once, init_share);
+  if (share != NULL) {
+    curl_easy_setopt(easy, CURLOPT_SHARE, share);
+  }
+  // use HTTP/2 over TLS where the server supports it, and prefer waiting for
+  // a connection that can be multiplexed over opening a new one
+  curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+}
+
+static size_t write_cb(char *data, size_t size, size_t nmemb, void *user)
+{
+  bgpstream_http_t *http = user;
+  size_t len = size * nmemb;
+  size_t new_alloc;
+  uint8_t *new_buf;
+
+  if (http->buf_len + len > http->buf_alloc) {
+    new_alloc = http->buf_alloc == 0 ? CURL_MAX_WRITE_SIZE : http->buf_alloc;
+    while (new_alloc < http->buf_len + len) {
+      new_alloc *= 2;
+    }
+    if ((new_buf = realloc(http->buf, new_alloc)) == NULL) {
+      return 0;
+    }
+    http->buf = new_buf;
+    http->buf_alloc = new_alloc;
+  }
+  memcpy(http->buf + http->buf_len, data, len);
+  http->buf_len += len;
+  return len;
+}
+
+// run the transfer until there is body data to read, or it has finished
+static int fill(bgpstream_http_t *http)
+{
+  CURLMsg *msg;
+  int running, msgs;
+
+  if (http->buf_offset == http->buf_len) {
+    http->buf_offset = http->buf_len = 0;
+  }
+  while (http->buf_len == 0 && !http->done) {
+    if (curl_multi_perform(http->multi, &running) != CURLM_OK) {
+      return -1;
+    }
+    while ((msg = curl_multi_info_read(http->multi, &msgs)) != NULL) {
+      if (msg->msg == CURLMSG_DONE) {
+        http->done = 1;
+        http->result = msg->data.result;
+      }
+    }
+    if (http->buf_len == 0 && !http->done &&
+        curl_multi_wait(http->multi, NULL, 0, 1000, NULL) != CURLM_OK) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static bgpstream_http_t *curl_open(const char *url, char **hdrs, int hdrs_cnt)
+{
+  bgpstream_http_t *http;
+  struct curl_slist *l;
+  int i;
+
+  if ((http = malloc_zero(sizeof(bgpstream_http_t))) == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < hdrs_cnt; i++) {
+    if ((l = curl_slist_append(http->hdrs, hdrs[i])) == NULL) {
+      goto err;
+    }
+    http->hdrs = l;
+  }
+  if ((http->multi = curl_multi_init()) == NULL ||
+      (http->easy = curl_easy_init()) == NULL) {
+    goto err;
+  }
+  bgpstream_http_share(http->easy);
+  curl_easy_setopt(http->easy, CURLOPT_URL, url);
+  curl_easy_setopt(http->easy, CURLOPT_HTTPHEADER, http->hdrs);
+  curl_easy_setopt(http->easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(http->easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(http->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(http->easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(http->easy, CURLOPT_LOW_SPEED_TIME, (long)STALL_TIMEOUT);
+  curl_easy_setopt(http->easy, CURLOPT_WRITEFUNCTION, write_cb);
+  curl_easy_setopt(http->easy, CURLOPT_WRITEDATA, http);
+  if (curl_multi_add_handle(http->multi, http->easy) != CURLM_OK) {
+    goto err;
+  }
+
+  // wait for the response, so that failed requests are reported here
+  if (fill(http) != 0 || (http->done && http->result != CURLE_OK)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: HTTP request for %s failed: %s",
+                  url, http->done ? curl_easy_strerror(http->result) :
+                                    "transfer error");
+    goto err;
+  }
+  return http;
+
+err:
+  bgpstream_http_close(http);
+  return NULL;
+}
+
+#endif
+
+bgpstream_http_t *bgpstream_http_open(const char *url, char **hdrs,
+                                      int hdrs_cnt)
+{
+  bgpstream_http_t *http;
+
+#ifdef WITH_HTTP_POOL
+  if (strncmp(url, "http", 4) == 0) {
+    return curl_open(url, hdrs, hdrs_cnt);
+  }
+#endif
+
+  if ((http = malloc_zero(sizeof(bgpstream_http_t))) == NULL) {
+    return NULL;
+  }
+  if ((http->io = (strncmp(url, "http", 4) == 0) ?
+                    http_open_hdrs(url, hdrs, hdrs_cnt) :
+                    wandio_create(url)) == NULL) {
+    free(http);
+    return NULL;
+  }
+  return http;
+}
+
+int64_t bgpstream_http_read(bgpstream_http_t *http, uint8_t *buffer,
+                            int64_t len)
+{
+  if (http->io != NULL) {
+    return wandio_read(http->io, buffer, len);
+  }
+
+#ifdef WITH_HTTP_POOL
+  if (fill(http) != 0) {
+    return -1;
+  }
+  if (http->buf_len > http->buf_offset) {
+    if ((uint64_t)len > http->buf_len - http->buf_offset) {
+      len = http->buf_len - http->buf_offset;
+    }
+    memcpy(buffer, http->buf + http->buf_offset, len);
+    http->buf_offset += len;
+    return len;
+  }
+  if (http->result != CURLE_OK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: HTTP transfer failed: %s",
+                  curl_easy_strerror(http->result));
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+void bgpstream_http_close(bgpstream_http_t *http)
+{
+  if (http == NULL) {
+    return;
+  }
+  if (http->io != NULL) {
+    wandio_destroy(http->io);
+  }
+#ifdef WITH_HTTP_POOL
+  if (http->easy != NULL) {
+    // the connection stays open in the shared pool
+    if (http->multi != NULL) {
+      curl_multi_remove_handle(http->multi, http->easy);
+    }
+    curl_easy_cleanup(http->easy);
+  }
+  if (http->multi != NULL) {
+    curl_multi_cleanup(http->multi);
+  }
+  curl_slist_free_all(http->hdrs);
+  free(http->buf);
+#endif
+  free(http);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_HTTP_H
+#define __BGPSTREAM_HTTP_H
+
+#include "config.h"
+#include <stdint.h>
+#if defined(HAVE_LIBCURL) && defined(HAVE_CURL_CURL_H)
+#define WITH_HTTP_POOL
+#include <curl/curl.h>
+#endif
+
+/** @file
+ *
+ * @brief Header file for HTTP reads through a process-wide connection pool.
+ *
+ * Connections (and DNS and TLS session caches) are shared by every request
+ * that libbgpstream makes, so consecutive requests to the same archive or
+ * broker host reuse an open keep-alive (or HTTP/2) connection instead of paying
+ * for new TCP and TLS handshakes. When libbgpstream is built without libcurl,
+ * requests are made by wandio, one connection each.
+ */
+
+/** Opaque structure representing an HTTP response being read */
+typedef struct bgpstream_http bgpstream_http_t;
+
+/** Start a GET request for the given URL
+ *
+ * @param url           URL to request (if it is not an HTTP(S) URL, it is
+ *                      opened using wandio)
+ * @param hdrs          array of extra request headers (e.g., "User-Agent: x")
+ * @param hdrs_cnt      number of headers in hdrs
+ * @return pointer to the response if the request succeeded, NULL otherwise
+ *
+ * The response body is returned as is (i.e., it is not decompressed).
+ */
+bgpstream_http_t *bgpstream_http_open(const char *url, char **hdrs,
+                                      int hdrs_cnt);
+
+/** Read from the body of the given response
+ *
+ * @param http          pointer to the response to read from
+ * @param buffer        pointer to the buffer to read into
+ * @param len           length of the buffer
+ * @return the number of bytes read, 0 at the end of the body, or -1 if the
+ * transfer failed
+ */
+int64_t bgpstream_http_read(bgpstream_http_t *http, uint8_t *buffer,
+                            int64_t len);
+
+/** Finish the given response, returning its connection to the pool
+ *
+ * @param http          pointer to the response to close
+ */
+void bgpstream_http_close(bgpstream_http_t *http);
+
+#ifdef WITH_HTTP_POOL
+/** Configure a libcurl handle to use the shared connection pool
+ *
+ * @param easy          pointer to the libcurl handle to configure
+ */
+void bgpstream_http_share(CURL *easy);
+#endif
+
+#endif /* __BGPSTREAM_HTTP_H */
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include "bgpstream_origins.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_patricia.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The route that a peer has for a prefix */
+typedef struct origin_route {
+
+  uint32_t asn;
+
+  /* time (in seconds) of the record that last installed this route */
+  uint32_t time;
+
+} origin_route_t;
+
+/* prefix -> route of one peer */
+KHASH_INIT(bsorig_routes, bgpstream_pfx_t, origin_route_t, 1,
+           bgpstream_pfx_hash_val, bgpstream_pfx_equal_val)
+
+/* The origins of a prefix, which is the user pointer of its tree node */
+typedef struct origin_set {
+
+  uint32_t cnt;
+  uint32_t alloc_cnt;
+
+  /* sorted by ASN */
+  bgpstream_origins_entry_t entries[];
+
+} origin_set_t;
+
+struct bgpstream_origins {
+
+  bgpstream_peer_sig_map_t *peers;
+
+  /* indexed by peer ID */
+  khash_t(bsorig_routes) * *routes;
+  uint32_t routes_alloc_cnt;
+
+  bgpstream_patricia_tree_t *pt;
+
+  uint64_t pfx_cnt;
+};
+
+/* state of a query */
+typedef struct query_state {
+
+  const bgpstream_pfx_t *pfx;
+
+  bgpstream_origins_cb_t *cb;
+  void *user;
+
+  int stopped;
+
+} query_state_t;
+
+static void set_destroy(void *user)
+{
+  free(user);
+}
+
+/* returns the routes of the given peer, creating them if needed */
+static khash_t(bsorig_routes) *
+  get_routes(bgpstream_origins_t *origins, bgpstream_peer_id_t peer_id)
+{
+  khash_t(bsorig_routes) * *routes;
+  uint32_t alloc;
+
+  if (peer_id >= origins->routes_alloc_cnt) {
+    alloc = ((uint32_t)peer_id + 1) * 2;
+    if (alloc > (uint32_t)UINT16_MAX + 1) {
+      alloc = (uint32_t)UINT16_MAX + 1;
+    }
+    if ((routes = realloc(origins->routes, sizeof(*routes) * alloc)) == NULL) {
+      return NULL;
+    }
+    memset(&routes[origins->routes_alloc_cnt], 0,
+           sizeof(*routes) * (alloc - origins->routes_alloc_cnt));
+    origins->routes = routes;
+    origins->routes_alloc_cnt = alloc;
+  }
+
+  if (origins->routes[peer_id] == NULL) {
+    origins->routes[peer_id] = kh_init(bsorig_routes);
+  }
+  return origins->routes[peer_id];
+}
+
+/* finds the position of the given ASN in the set (or where it would be
+   inserted) */
+static uint32_t set_find(const origin_set_t *set, uint32_t asn)
+{
+  uint32_t lo = 0, hi = set->cnt, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (set->entries[mid].asn < asn) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* counts a peer for an origin of a prefix. returns 1 if the origin is new to
+   the prefix, 0 if it is not, -1 if an error occurred */
+static int origin_add(bgpstream_origins_t *origins, const bgpstream_pfx_t *pfx,
+                      uint32_t asn)
+{
+  bgpstream_patricia_node_t *node;
+  origin_set_t *set, *tmp;
+  uint32_t i, alloc;
+
+  if ((node = bgpstream_patricia_tree_insert(origins->pt, pfx)) == NULL) {
+    return -1;
+  }
+  if ((set = bgpstream_patricia_tree_get_user(node)) == NULL) {
+    // most prefixes only ever have one origin
+    if ((set = malloc(sizeof(origin_set_t) +
+                      sizeof(bgpstream_origins_entry_t))) == NULL) {
+      bgpstream_patricia_tree_remove_node(origins->pt, node);
+      return -1;
+    }
+    set->cnt = 0;
+    set->alloc_cnt = 1;
+    bgpstream_patricia_tree_set_user(origins->pt, node, set);
+    origins->pfx_cnt++;
+  }
+
+  i = set_find(set, asn);
+  if (i < set->cnt && set->entries[i].asn == asn) {
+    set->entries[i].peer_cnt++;
+    return 0;
+  }
+
+  if (set->cnt == set->alloc_cnt) {
+    // the tree frees the old set when the new one replaces it
+    alloc = set->alloc_cnt * 2;
+    if ((tmp = malloc(sizeof(origin_set_t) +
+                      sizeof(bgpstream_origins_entry_t) * alloc)) == NULL) {
+      return -1;
+    }
+    memcpy(tmp, set, sizeof(origin_set_t) +
+                       sizeof(bgpstream_origins_entry_t) * set->cnt);
+    tmp->alloc_cnt = alloc;
+    bgpstream_patricia_tree_set_user(origins->pt, node, tmp);
+    set = tmp;
+  }
+  memmove(&set->entries[i + 1], &set->entries[i],
+          sizeof(bgpstream_origins_entry_t) * (set->cnt - i));
+  set->entries[i].asn = asn;
+  set->entries[i].peer_cnt = 1;
+  set->cnt++;
+  return 1;
+}
+
+/* uncounts a peer for an origin of a prefix. returns 1 if the prefix lost
+   the origin, 0 otherwise */
+static int origin_del(bgpstream_origins_t *origins, const bgpstream_pfx_t *pfx,
+                      uint32_t asn)
+{
+  bgpstream_patricia_node_t *node;
+  origin_set_t *set;
+  uint32_t i;
+
+  if ((node = bgpstream_patricia_tree_search_exact(origins->pt, pfx)) ==
+        NULL ||
+      (set = bgpstream_patricia_tree_get_user(node)) == NULL) {
+    return 0;
+  }
+  i = set_find(set, asn);
+  if (i == set->cnt || set->entries[i].asn != asn) {
+    return 0;
+  }
+  if (--set->entries[i].peer_cnt > 0) {
+    return 0;
+  }
+
+  set->cnt--;
+  memmove(&set->entries[i], &set->entries[i + 1],
+          sizeof(bgpstream_origins_entry_t) * (set->cnt - i));
+  if (set->cnt == 0) {
+    // this frees the set
+    bgpstream_patricia_tree_remove_node(origins->pt, node);
+    origins->pfx_cnt--;
+  }
+  return 1;
+}
+
+/* removes all the routes of a peer, returns 1 if an origin was removed */
+static int peer_clear(bgpstream_origins_t *origins,
+                      khash_t(bsorig_routes) * routes)
+{
+  khiter_t k;
+  int changed = 0;
+
+  for (k = kh_begin(routes); k != kh_end(routes); ++k) {
+    if (kh_exist(routes, k)) {
+      changed |=
+        origin_del(origins, &kh_key(routes, k), kh_val(routes, k).asn);
+    }
+  }
+  kh_clear(bsorig_routes, routes);
+  return changed;
+}
+
+static int route_upsert(bgpstream_origins_t *origins,
+                        khash_t(bsorig_routes) * routes,
+                        bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  origin_route_t *route;
+  uint32_t asn;
+  khiter_t k;
+  int khret, added, changed = 0;
+
+  if (bgpstream_as_path_get_origin_val(elem->as_path, &asn) != 0) {
+    // not indexed, but it still replaces the previous route
+    if ((k = kh_get(bsorig_routes, routes, elem->prefix)) == kh_end(routes)) {
+      return 0;
+    }
+    changed = origin_del(origins, &elem->prefix, kh_val(routes, k).asn);
+    kh_del(bsorig_routes, routes, k);
+    return changed;
+  }
+
+  if ((k = kh_put(bsorig_routes, routes, elem->prefix, &khret)) ==
+      kh_end(routes)) {
+    return -1;
+  }
+  route = &kh_val(routes, k);
+  if (khret == 0) {
+    if (route->asn == asn) {
+      route->time = record->time_sec;
+      return 0;
+    }
+    changed = origin_del(origins, &elem->prefix, route->asn);
+  }
+  if ((added = origin_add(origins, &elem->prefix, asn)) < 0) {
+    // forget the route rather than leave it counted for its old origin
+    kh_del(bsorig_routes, routes, k);
+    return -1;
+  }
+  route->asn = asn;
+  route->time = record->time_sec;
+  return changed | added;
+}
+
+static int route_remove(bgpstream_origins_t *origins,
+                        khash_t(bsorig_routes) * routes,
+                        const bgpstream_pfx_t *pfx)
+{
+  khiter_t k;
+  int changed;
+
+  if ((k = kh_get(bsorig_routes, routes, *pfx)) == kh_end(routes)) {
+    return 0;
+  }
+  changed = origin_del(origins, pfx, kh_val(routes, k).asn);
+  kh_del(bsorig_routes, routes, k);
+  return changed;
+}
+
+/* removes the routes of a collector's peers that were installed before the
+   given time, returns 1 if an origin was removed */
+static int expire(bgpstream_origins_t *origins, const char *collector,
+                  uint32_t before)
+{
+  khash_t(bsorig_routes) * routes;
+  bgpstream_peer_sig_t *sig;
+  khiter_t k;
+  uint32_t id;
+  int changed = 0;
+
+  for (id = 1; id < origins->routes_alloc_cnt; id++) {
+    if ((routes = origins->routes[id]) == NULL || kh_size(routes) == 0 ||
+        (sig = bgpstream_peer_sig_map_get_sig(origins->peers, id)) == NULL ||
+        strcmp(sig->collector_str, collector) != 0) {
+      continue;
+    }
+    // deleting does not move the other entries, so it is safe to carry on
+    for (k = kh_begin(routes); k != kh_end(routes); ++k) {
+      if (kh_exist(routes, k) && kh_val(routes, k).time < before) {
+        changed |=
+          origin_del(origins, &kh_key(routes, k), kh_val(routes, k).asn);
+        kh_del(bsorig_routes, routes, k);
+      }
+    }
+  }
+  return changed;
+}
+
+static bgpstream_patricia_walk_cb_result_t
+query_node(const bgpstream_patricia_tree_t *pt,
+           const bgpstream_patricia_node_t *node, void *data)
+{
+  query_state_t *state = data;
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  const origin_set_t *set =
+    bgpstream_patricia_tree_get_user(bgpstream_nonconst_node(node));
+
+  if (set == NULL) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+  if (state->cb(pfx, set->entries, set->cnt, state->user) != 0) {
+    state->stopped = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static bgpstream_patricia_walk_cb_result_t
+query_more_specific(const bgpstream_patricia_tree_t *pt,
+                    const bgpstream_patricia_node_t *node, void *data)
+{
+  query_state_t *state = data;
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+
+  if (pfx->mask_len == state->pfx->mask_len ||
+      bgpstream_pfx_contains(state->pfx, pfx) == 0) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+  return query_node(pt, node, data);
+}
+
+static bgpstream_patricia_walk_cb_result_t
+query_covering(const bgpstream_patricia_tree_t *pt,
+               const bgpstream_patricia_node_t *node, void *data)
+{
+  query_state_t *state = data;
+
+  if (bgpstream_pfx_contains(bgpstream_patricia_tree_get_pfx(node),
+                             state->pfx) == 0) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+  return query_node(pt, node, data);
+}
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+bgpstream_origins_t *bgpstream_origins_create(void)
+{
+  bgpstream_origins_t *origins;
+
+  if ((origins = malloc_zero(sizeof(bgpstream_origins_t))) == NULL) {
+    return NULL;
+  }
+  if ((origins->peers = bgpstream_peer_sig_map_create()) == NULL ||
+      (origins->pt = bgpstream_patricia_tree_create(set_destroy)) == NULL) {
+    bgpstream_origins_destroy(origins);
+    return NULL;
+  }
+  return origins;
+}
+
+void bgpstream_origins_destroy(bgpstream_origins_t *origins)
+{
+  uint32_t i;
+
+  if (origins == NULL) {
+    return;
+  }
+  for (i = 0; i < origins->routes_alloc_cnt; i++) {
+    if (origins->routes[i] != NULL) {
+      kh_destroy(bsorig_routes, origins->routes[i]);
+    }
+  }
+  free(origins->routes);
+  if (origins->pt != NULL) {
+    bgpstream_patricia_tree_destroy(origins->pt);
+  }
+  bgpstream_peer_sig_map_destroy(origins->peers);
+  free(origins);
+}
+
+int bgpstream_origins_apply(bgpstream_origins_t *origins,
+                            bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  bgpstream_peer_id_t peer_id;
+  khash_t(bsorig_routes) * routes;
+
+  if (elem == NULL) {
+    if (record->type != BGPSTREAM_RIB ||
+        record->dump_pos != BGPSTREAM_DUMP_END) {
+      return 0;
+    }
+    // the dump just ended: routes it did not refresh are gone
+    return expire(origins, bgpstream_record_get_collector_name(record),
+                  record->dump_time_sec);
+  }
+
+  if ((peer_id = bgpstream_peer_sig_map_get_id(
+         origins->peers, bgpstream_record_get_collector_name(record),
+         &elem->peer_ip, elem->peer_asn)) == 0 ||
+      (routes = get_routes(origins, peer_id)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get origin index peer");
+    return -1;
+  }
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    return route_upsert(origins, routes, record, elem);
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    return route_remove(origins, routes, &elem->prefix);
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    if (elem->new_state != BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED) {
+      return peer_clear(origins, routes);
+    }
+    return 0;
+
+  default:
+    return 0;
+  }
+}
+
+int bgpstream_origins_lookup(const bgpstream_origins_t *origins,
+                             const bgpstream_pfx_t *pfx,
+                             const bgpstream_origins_entry_t **entries)
+{
+  const bgpstream_patricia_node_t *node;
+  const origin_set_t *set;
+
+  *entries = NULL;
+  if ((node = bgpstream_patricia_tree_search_exact_const(origins->pt, pfx)) ==
+        NULL ||
+      (set = bgpstream_patricia_tree_get_user(
+         bgpstream_nonconst_node(node))) == NULL) {
+    return 0;
+  }
+  *entries = set->entries;
+  return set->cnt;
+}
+
+int bgpstream_origins_get_covering(const bgpstream_origins_t *origins,
+                                   const bgpstream_pfx_t *pfx,
+                                   bgpstream_origins_cb_t *cb, void *user)
+{
+  query_state_t state = {pfx, cb, user, 0};
+
+  bgpstream_patricia_tree_walk_up_down(origins->pt, pfx, query_covering,
+                                       query_covering, NULL, &state);
+  return state.stopped;
+}
+
+int bgpstream_origins_get_more_specifics(const bgpstream_origins_t *origins,
+                                         const bgpstream_pfx_t *pfx,
+                                         bgpstream_origins_cb_t *cb,
+                                         void *user)
+{
+  query_state_t state = {pfx, cb, user, 0};
+
+  bgpstream_patricia_tree_walk_up_down(origins->pt, pfx, NULL, NULL,
+                                       query_more_specific, &state);
+  return state.stopped;
+}
+
+uint64_t bgpstream_origins_get_pfx_cnt(const bgpstream_origins_t *origins)
+{
+  return origins->pfx_cnt;
+}
+
+bgpstream_peer_sig_map_t *
+bgpstream_origins_get_peer_sig_map(const bgpstream_origins_t *origins)
+{
+  return origins->peers;
+}
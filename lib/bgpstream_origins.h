@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_ORIGINS_H_
+#define __BGPSTREAM_ORIGINS_H_
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils_peer_sig_map.h"
+#include "bgpstream_utils_pfx.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGPStream
+ * origin index: the origin ASes of every prefix observed in a stream
+ *
+ * The index is fed with the records and elems of a stream as they are read,
+ * like a RIB (see bgpstream_rib.h). It remembers the origin AS of the route
+ * that each peer has for each prefix, and keeps, for each prefix, the set of
+ * origin ASes along with the number of peers that route the prefix to each of
+ * them. Prefixes are kept in a Patricia tree, so the origins of a prefix, of
+ * the prefixes that cover it, and of its more specifics are found without
+ * walking all the routes.
+ */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure representing an origin index */
+typedef struct bgpstream_origins bgpstream_origins_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** An origin AS of a prefix */
+typedef struct bgpstream_origins_entry {
+
+  /** Origin ASN */
+  uint32_t asn;
+
+  /** Number of peers that have a route for the prefix from this origin */
+  uint32_t peer_cnt;
+
+} bgpstream_origins_entry_t;
+
+/** @} */
+
+/**
+ * @name Public Callback Types
+ *
+ * @{ */
+
+/** Callback invoked for each prefix visited by an origin index query
+ *
+ * @param pfx           prefix that was found
+ * @param origins       origins of the prefix, in increasing ASN order
+ * @param origins_cnt   number of origins (at least one)
+ * @param user          user pointer given to the query
+ * @return 0 to continue the query, any other value to stop it
+ */
+typedef int(bgpstream_origins_cb_t)(const bgpstream_pfx_t *pfx,
+                                    const bgpstream_origins_entry_t *origins,
+                                    int origins_cnt, void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new, empty origin index
+ *
+ * @return pointer to the index if successful, NULL otherwise
+ */
+bgpstream_origins_t *bgpstream_origins_create(void);
+
+/** Destroy the given origin index
+ *
+ * @param origins       pointer to the index to destroy
+ */
+void bgpstream_origins_destroy(bgpstream_origins_t *origins);
+
+/** Apply a record, or one of its elems, to the origin index
+ *
+ * @param origins       pointer to the index to update
+ * @param record        pointer to the record being processed
+ * @param elem          pointer to an elem of the record, or NULL
+ * @return 1 if an origin was added to or removed from a prefix, 0 if the
+ * origins are unchanged, -1 if an error occurred
+ *
+ * As with bgpstream_rib_apply, applications should call this once for each
+ * elem of a record, and once with a NULL elem after the last elem of the
+ * record, so that routes that a new RIB dump did not refresh are removed.
+ * RIB dump elems and announcements replace the route of their peer for their
+ * prefix, withdrawals remove it, and a peer leaving the established state
+ * loses all of its routes. A route whose origin is an AS set (or a
+ * confederation) is not indexed.
+ */
+int bgpstream_origins_apply(bgpstream_origins_t *origins,
+                            bgpstream_record_t *record, bgpstream_elem_t *elem);
+
+/** Look up the origins of a prefix
+ *
+ * @param origins       pointer to the index to query
+ * @param pfx           pointer to the prefix to look up (exact match)
+ * @param[out] entries  set to the origins of the prefix, in increasing ASN
+ *                      order
+ * @return the number of origins, 0 if the prefix is not routed
+ *
+ * The returned entries are only valid until the index is next updated.
+ */
+int bgpstream_origins_lookup(const bgpstream_origins_t *origins,
+                             const bgpstream_pfx_t *pfx,
+                             const bgpstream_origins_entry_t **entries);
+
+/** Find the routed prefixes that cover a prefix
+ *
+ * @param origins       pointer to the index to query
+ * @param pfx           pointer to the prefix to look up
+ * @param cb            callback to invoke for each covering prefix
+ * @param user          user pointer to pass to the callback
+ * @return 0 if all covering prefixes were visited, 1 if the callback stopped
+ * the query
+ *
+ * The prefix itself (if it is routed) is visited first, followed by its less
+ * specifics, from the most to the least specific.
+ */
+int bgpstream_origins_get_covering(const bgpstream_origins_t *origins,
+                                   const bgpstream_pfx_t *pfx,
+                                   bgpstream_origins_cb_t *cb, void *user);
+
+/** Find the routed prefixes that are more specific than a prefix
+ *
+ * @param origins       pointer to the index to query
+ * @param pfx           pointer to the prefix to look up
+ * @param cb            callback to invoke for each more specific prefix
+ * @param user          user pointer to pass to the callback
+ * @return 0 if all more specific prefixes were visited, 1 if the callback
+ * stopped the query
+ *
+ * The prefix itself is not visited.
+ */
+int bgpstream_origins_get_more_specifics(const bgpstream_origins_t *origins,
+                                         const bgpstream_pfx_t *pfx,
+                                         bgpstream_origins_cb_t *cb,
+                                         void *user);
+
+/** Get the number of routed prefixes in the origin index
+ *
+ * @param origins       pointer to the index
+ * @return the number of prefixes that have at least one origin
+ */
+uint64_t bgpstream_origins_get_pfx_cnt(const bgpstream_origins_t *origins);
+
+/** Get the peer signature map used to number the peers of the origin index
+ *
+ * @param origins       pointer to the index
+ * @return borrowed pointer to the peer signature map
+ */
+bgpstream_peer_sig_map_t *
+bgpstream_origins_get_peer_sig_map(const bgpstream_origins_t *origins);
+
+/** @} */
+
+#endif // __BGPSTREAM_ORIGINS_H_
@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_pfx_index.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
+#include "khash.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* An IPv6 prefix as a pair of host-order integers */
+typedef struct pfx6_key {
+  uint64_t hi;
+  uint64_t lo;
+  uint8_t len;
+} pfx6_key_t;
+
+static inline khint_t pfx6_key_hash(pfx6_key_t k)
+{
+  return kh_int64_hash_func(k.hi ^ (k.lo * 0x9e3779b97f4a7c15ULL) ^ k.len);
+}
+
+static inline int pfx6_key_equal(pfx6_key_t a, pfx6_key_t b)
+{
+  return a.hi == b.hi && a.lo == b.lo && a.len == b.len;
+}
+
+/* hash of IPv4 (address << 8 | length) -> allowed matches */
+KHASH_INIT(bspi_v4, uint64_t, uint8_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+
+/* hash of IPv6 prefix -> allowed matches */
+KHASH_INIT(bspi_v6, pfx6_key_t, uint8_t, 1, pfx6_key_hash, pfx6_key_equal)
+
+struct bgpstream_pfx_index {
+
+  // all of the IPv4 filters
+  khash_t(bspi_v4) * v4;
+
+  // bit l is set if there is an IPv4 filter of length l that allows more
+  // specifics
+  uint64_t v4_more_lens;
+
+  // sorted keys of the IPv4 filters that allow less specifics
+  uint64_t *v4_less;
+  int v4_less_cnt;
+  int v4_less_alloc_cnt;
+
+  // all of the IPv6 filters
+  khash_t(bspi_v6) * v6;
+
+  // as v4_more_lens, for lengths 0 to 128
+  uint64_t v6_more_lens[3];
+
+  // sorted IPv6 filters that allow less specifics
+  pfx6_key_t *v6_less;
+  int v6_less_cnt;
+  int v6_less_alloc_cnt;
+
+  // set if building the index failed
+  int err;
+};
+
+static uint32_t mask4(uint32_t addr, uint8_t len)
+{
+  return len == 0 ? 0 : len >= 32 ? addr : addr & (~(uint32_t)0 << (32 - len));
+}
+
+static uint64_t key4(uint32_t addr, uint8_t len)
+{
+  return ((uint64_t)mask4(addr, len) << 8) | len;
+}
+
+static pfx6_key_t key6(uint64_t hi, uint64_t lo, uint8_t len)
+{
+  pfx6_key_t k;
+
+  memset(&k, 0, sizeof(k));
+  if (len > 128) {
+    len = 128;
+  }
+  if (len == 0) {
+    hi = lo = 0;
+  } else if (len < 64) {
+    hi &= ~(uint64_t)0 << (64 - len);
+    lo = 0;
+  } else if (len == 64) {
+    lo = 0;
+  } else if (len < 128) {
+    lo &= ~(uint64_t)0 << (128 - len);
+  }
+  k.hi = hi;
+  k.lo = lo;
+  k.len = len;
+  return k;
+}
+
+static void addr6_split(const bgpstream_ipv6_addr_t *addr, uint64_t *hi,
+                        uint64_t *lo)
+{
+  int i;
+
+  *hi = *lo = 0;
+  for (i = 0; i < 8; i++) {
+    *hi = (*hi << 8) | addr->addr.s6_addr[i];
+    *lo = (*lo << 8) | addr->addr.s6_addr[i + 8];
+  }
+}
+
+static int key6_cmp(const pfx6_key_t *a, const pfx6_key_t *b)
+{
+  if (a->hi != b->hi) {
+    return a->hi < b->hi ? -1 : 1;
+  }
+  if (a->lo != b->lo) {
+    return a->lo < b->lo ? -1 : 1;
+  }
+  return (int)a->len - (int)b->len;
+}
+
+static int key4_qcmp(const void *a, const void *b)
+{
+  uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+  return ka < kb ? -1 : ka > kb;
+}
+
+static int key6_qcmp(const void *a, const void *b)
+{
+  return key6_cmp(a, b);
+}
+
+static int allows_more(uint8_t allowed)
+{
+  return allowed == BGPSTREAM_PREFIX_MATCH_ANY ||
+         allowed == BGPSTREAM_PREFIX_MATCH_MORE;
+}
+
+static int allows_less(uint8_t allowed)
+{
+  return allowed == BGPSTREAM_PREFIX_MATCH_ANY ||
+         allowed == BGPSTREAM_PREFIX_MATCH_LESS;
+}
+
+static int add_v4(bgpstream_pfx_index_t *idx, const bgpstream_ipv4_pfx_t *pfx)
+{
+  uint8_t len = pfx->mask_len > 32 ? 32 : pfx->mask_len;
+  uint64_t key = key4(ntohl(pfx->address.addr.s_addr), len);
+  khiter_t k;
+  int khret;
+
+  k = kh_put(bspi_v4, idx->v4, key, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  kh_val(idx->v4, k) = pfx->allowed_matches;
+
+  if (allows_more(pfx->allowed_matches)) {
+    idx->v4_more_lens |= (uint64_t)1 << len;
+  }
+  if (allows_less(pfx->allowed_matches)) {
+    if (idx->v4_less_cnt == idx->v4_less_alloc_cnt) {
+      int new_cnt = idx->v4_less_alloc_cnt ? idx->v4_less_alloc_cnt * 2 : 64;
+      uint64_t *tmp = bgpstream_mem_realloc(BGPSTREAM_MEM_FILTER, idx->v4_less,
+                                            sizeof(uint64_t) * new_cnt);
+      if (tmp == NULL) {
+        return -1;
+      }
+      idx->v4_less = tmp;
+      idx->v4_less_alloc_cnt = new_cnt;
+    }
+    idx->v4_less[idx->v4_less_cnt++] = key;
+  }
+  return 0;
+}
+
+static int add_v6(bgpstream_pfx_index_t *idx, const bgpstream_ipv6_pfx_t *pfx)
+{
+  uint64_t hi, lo;
+  pfx6_key_t key;
+  khiter_t k;
+  int khret;
+
+  addr6_split(&pfx->address, &hi, &lo);
+  key = key6(hi, lo, pfx->mask_len);
+
+  k = kh_put(bspi_v6, idx->v6, key, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  kh_val(idx->v6, k) = pfx->allowed_matches;
+
+  if (allows_more(pfx->allowed_matches)) {
+    idx->v6_more_lens[key.len / 64] |= (uint64_t)1 << (key.len % 64);
+  }
+  if (allows_less(pfx->allowed_matches)) {
+    if (idx->v6_less_cnt == idx->v6_less_alloc_cnt) {
+      int new_cnt = idx->v6_less_alloc_cnt ? idx->v6_less_alloc_cnt * 2 : 64;
+      pfx6_key_t *tmp = bgpstream_mem_realloc(
+        BGPSTREAM_MEM_FILTER, idx->v6_less, sizeof(pfx6_key_t) * new_cnt);
+      if (tmp == NULL) {
+        return -1;
+      }
+      idx->v6_less = tmp;
+      idx->v6_less_alloc_cnt = new_cnt;
+    }
+    idx->v6_less[idx->v6_less_cnt++] = key;
+  }
+  return 0;
+}
+
+static bgpstream_patricia_walk_cb_result_t
+add_node(const bgpstream_patricia_tree_t *pt,
+         const bgpstream_patricia_node_t *node, void *data)
+{
+  bgpstream_pfx_index_t *idx = (bgpstream_pfx_index_t *)data;
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  int rc = 0;
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    rc = add_v4(idx, &pfx->bs_ipv4);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    rc = add_v6(idx, &pfx->bs_ipv6);
+  }
+  if (rc != 0) {
+    idx->err = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static int match_v4(const bgpstream_pfx_index_t *idx,
+                    const bgpstream_ipv4_pfx_t *pfx)
+{
+  uint8_t len = pfx->mask_len > 32 ? 32 : pfx->mask_len;
+  uint32_t addr = ntohl(pfx->address.addr.s_addr), last;
+  uint64_t lens, key;
+  khiter_t k;
+  int l, lo, hi, mid;
+
+  // exact match with any filter
+  if (kh_get(bspi_v4, idx->v4, key4(addr, len)) != kh_end(idx->v4)) {
+    return 1;
+  }
+
+  // more specific than a filter that allows it
+  lens = idx->v4_more_lens & (((uint64_t)1 << len) - 1);
+  while (lens != 0) {
+    l = __builtin_ctzll(lens);
+    lens &= lens - 1;
+    k = kh_get(bspi_v4, idx->v4, key4(addr, l));
+    if (k != kh_end(idx->v4) && allows_more(kh_val(idx->v4, k))) {
+      return 1;
+    }
+  }
+
+  // less specific than a filter that allows it: the first filter after
+  // (addr, len) in the sorted order is more specific than the prefix if it
+  // falls within it
+  if (idx->v4_less_cnt == 0 || len == 32) {
+    return 0;
+  }
+  key = key4(addr, len) + 1;
+  lo = 0;
+  hi = idx->v4_less_cnt;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (idx->v4_less[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  last = mask4(addr, len) | (len == 0 ? ~(uint32_t)0 : ~(uint32_t)0 >> len);
+  return lo < idx->v4_less_cnt && (idx->v4_less[lo] >> 8) <= last;
+}
+
+static int match_v6(const bgpstream_pfx_index_t *idx,
+                    const bgpstream_ipv6_pfx_t *pfx)
+{
+  uint64_t hi, lo, lens;
+  pfx6_key_t key, end;
+  khiter_t k;
+  int i, l, left, right, mid;
+
+  addr6_split(&pfx->address, &hi, &lo);
+  key = key6(hi, lo, pfx->mask_len);
+
+  // exact match with any filter
+  if (kh_get(bspi_v6, idx->v6, key) != kh_end(idx->v6)) {
+    return 1;
+  }
+
+  // more specific than a filter that allows it
+  for (i = 0; i * 64 < key.len; i++) {
+    lens = idx->v6_more_lens[i];
+    if (key.len - i * 64 < 64) {
+      lens &= ((uint64_t)1 << (key.len - i * 64)) - 1;
+    }
+    while (lens != 0) {
+      l = i * 64 + __builtin_ctzll(lens);
+      lens &= lens - 1;
+      k = kh_get(bspi_v6, idx->v6, key6(hi, lo, l));
+      if (k != kh_end(idx->v6) && allows_more(kh_val(idx->v6, k))) {
+        return 1;
+      }
+    }
+  }
+
+  // less specific than a filter that allows it (see match_v4)
+  if (idx->v6_less_cnt == 0 || key.len == 128) {
+    return 0;
+  }
+  key.len++;
+  left = 0;
+  right = idx->v6_less_cnt;
+  while (left < right) {
+    mid = left + (right - left) / 2;
+    if (key6_cmp(&idx->v6_less[mid], &key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == idx->v6_less_cnt) {
+    return 0;
+  }
+  // the last address of the prefix
+  l = key.len - 1;
+  end.hi = key.hi;
+  end.lo = key.lo;
+  end.len = 128;
+  if (l < 64) {
+    end.hi |= l == 0 ? ~(uint64_t)0 : ~(uint64_t)0 >> l;
+    end.lo = ~(uint64_t)0;
+  } else {
+    end.lo |= l == 64 ? ~(uint64_t)0 : ~(uint64_t)0 >> (l - 64);
+  }
+  return key6_cmp(&idx->v6_less[left], &end) <= 0;
+}
+
+/* ========== PUBLIC FUNCTIONS BELOW HERE ========== */
+
+bgpstream_pfx_index_t *
+bgpstream_pfx_index_create(const bgpstream_patricia_tree_t *prefixes)
+{
+  bgpstream_pfx_index_t *idx;
+
+  if ((idx = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_FILTER,
+                                       sizeof(bgpstream_pfx_index_t))) ==
+      NULL) {
+    return NULL;
+  }
+  if ((idx->v4 = kh_init(bspi_v4)) == NULL ||
+      (idx->v6 = kh_init(bspi_v6)) == NULL) {
+    goto err;
+  }
+
+  bgpstream_patricia_tree_walk(prefixes, add_node, idx);
+  if (idx->err != 0) {
+    goto err;
+  }
+
+  if (idx->v4_less_cnt > 0) {
+    qsort(idx->v4_less, idx->v4_less_cnt, sizeof(uint64_t), key4_qcmp);
+  }
+  if (idx->v6_less_cnt > 0) {
+    qsort(idx->v6_less, idx->v6_less_cnt, sizeof(pfx6_key_t), key6_qcmp);
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_FINE,
+                "compiled %d IPv4 and %d IPv6 prefix filters",
+                (int)kh_size(idx->v4), (int)kh_size(idx->v6));
+  return idx;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "could not compile the prefix filters");
+  bgpstream_pfx_index_destroy(idx);
+  return NULL;
+}
+
+void bgpstream_pfx_index_destroy(bgpstream_pfx_index_t *idx)
+{
+  if (idx == NULL) {
+    return;
+  }
+  if (idx->v4 != NULL) {
+    kh_destroy(bspi_v4, idx->v4);
+  }
+  if (idx->v6 != NULL) {
+    kh_destroy(bspi_v6, idx->v6);
+  }
+  bgpstream_mem_free(BGPSTREAM_MEM_FILTER, idx->v4_less);
+  bgpstream_mem_free(BGPSTREAM_MEM_FILTER, idx->v6_less);
+  bgpstream_mem_free(BGPSTREAM_MEM_FILTER, idx);
+}
+
+int bgpstream_pfx_index_match(const bgpstream_pfx_index_t *idx,
+                              const bgpstream_pfx_t *pfx)
+{
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return match_v4(idx, &pfx->bs_ipv4);
+  }
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    return match_v6(idx, &pfx->bs_ipv6);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PFX_INDEX_H
+#define __BGPSTREAM_PFX_INDEX_H
+
+#include "bgpstream_utils_patricia.h"
+#include "bgpstream_utils_pfx.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the private interface of the compiled
+ * prefix filter
+ *
+ * Matching an elem against the prefix filters with a walk of the patricia
+ * tree costs a callback for every node visited. Once the filters are known,
+ * they are compiled into flat tables, separately for IPv4 and IPv6: a hash of
+ * all the filter prefixes (for exact matches, and for the filters that allow
+ * more specifics, which are looked up once for each of their distinct
+ * lengths that is shorter than the elem prefix), and a sorted array of the
+ * filters that allow less specifics (for which a binary search finds whether
+ * one falls within the elem prefix).
+ */
+
+/** Opaque structure holding the compiled filters */
+typedef struct bgpstream_pfx_index bgpstream_pfx_index_t;
+
+/** Compile the prefix filters held in a patricia tree
+ *
+ * @param prefixes      pointer to the tree of prefix filters, each with its
+ *                      allowed_matches set
+ * @return pointer to the compiled filters if successful, NULL otherwise
+ *
+ * The tree is not referenced by the compiled filters, which must be compiled
+ * again if it changes.
+ */
+bgpstream_pfx_index_t *
+bgpstream_pfx_index_create(const bgpstream_patricia_tree_t *prefixes);
+
+/** Destroy the given compiled filters
+ *
+ * @param idx           pointer to the compiled filters to destroy
+ */
+void bgpstream_pfx_index_destroy(bgpstream_pfx_index_t *idx);
+
+/** Check whether a prefix matches the compiled filters
+ *
+ * @param idx           pointer to the compiled filters
+ * @param pfx           pointer to the prefix to check
+ * @return 1 if the prefix is one of the filters, is more specific than a
+ * filter that allows more specifics, or is less specific than a filter that
+ * allows less specifics, 0 otherwise
+ */
+int bgpstream_pfx_index_match(const bgpstream_pfx_index_t *idx,
+                              const bgpstream_pfx_t *pfx);
+
+#endif /* __BGPSTREAM_PFX_INDEX_H */
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_plan.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* Estimated size of the updates of one second, for resources that cannot be
+   stat'ed (a 15 minute updates dump is a few MB) */
+#define PLAN_UPDATES_BYTES_PER_SEC 4096
+
+/* Estimated size of a RIB dump that cannot be stat'ed */
+#define PLAN_RIB_BYTES (96 * 1024 * 1024)
+
+/* Maximum length of the path of a work unit file */
+#define PLAN_PATH_LEN 4096
+
+typedef struct plan_res {
+  char *url;
+  char *project;
+  char *collector;
+  bgpstream_record_type_t record_type;
+  uint32_t initial_time;
+  uint32_t duration;
+
+  /* (estimated) size of the resource, and the unit it is assigned to */
+  uint64_t weight;
+  int unit;
+} plan_res_t;
+
+struct bgpstream_plan {
+
+  int units;
+
+  /* total weight of each unit */
+  uint64_t *unit_weights;
+
+  plan_res_t *res;
+  int res_cnt;
+  int res_alloc_cnt;
+
+  /* have the resources been assigned since the last one was added? */
+  int assigned;
+};
+
+static uint64_t res_weight(bgpstream_resource_t *res)
+{
+  struct stat st;
+
+  if (stat(res->url, &st) == 0 && S_ISREG(st.st_mode)) {
+    return st.st_size;
+  }
+  if (res->record_type == BGPSTREAM_RIB) {
+    return PLAN_RIB_BYTES;
+  }
+  return (uint64_t)res->duration * PLAN_UPDATES_BYTES_PER_SEC;
+}
+
+bgpstream_plan_t *bgpstream_plan_create(int units)
+{
+  bgpstream_plan_t *plan;
+
+  if (units <= 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid number of work units %d",
+                  units);
+    return NULL;
+  }
+  if ((plan = malloc_zero(sizeof(bgpstream_plan_t))) == NULL ||
+      (plan->unit_weights = malloc_zero(sizeof(uint64_t) * units)) == NULL) {
+    free(plan);
+    return NULL;
+  }
+  plan->units = units;
+  return plan;
+}
+
+void bgpstream_plan_destroy(bgpstream_plan_t *plan)
+{
+  int i;
+
+  if (plan == NULL) {
+    return;
+  }
+  for (i = 0; i < plan->res_cnt; i++) {
+    free(plan->res[i].url);
+    free(plan->res[i].project);
+    free(plan->res[i].collector);
+  }
+  free(plan->res);
+  free(plan->unit_weights);
+  free(plan);
+}
+
+int bgpstream_plan_add(bgpstream_plan_t *plan, bgpstream_resource_t *res)
+{
+  plan_res_t *pr, *tmp;
+  int alloc_cnt;
+
+  // work units are read by the csvfile data interface, which only reads MRT
+  // dump files
+  if (res->duration == BGPSTREAM_FOREVER ||
+      res->format_type != BGPSTREAM_RESOURCE_FORMAT_MRT ||
+      (res->transport_type != BGPSTREAM_RESOURCE_TRANSPORT_FILE &&
+       res->transport_type != BGPSTREAM_RESOURCE_TRANSPORT_HTTP)) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Resource %s cannot be part of a work unit, skipping it",
+                  res->url);
+    return 0;
+  }
+
+  if (plan->res_cnt == plan->res_alloc_cnt) {
+    alloc_cnt = plan->res_alloc_cnt == 0 ? 64 : plan->res_alloc_cnt * 2;
+    if ((tmp = realloc(plan->res, sizeof(plan_res_t) * alloc_cnt)) == NULL) {
+      return -1;
+    }
+    plan->res = tmp;
+    plan->res_alloc_cnt = alloc_cnt;
+  }
+  pr = &plan->res[plan->res_cnt];
+  memset(pr, 0, sizeof(*pr));
+  if ((pr->url = strdup(res->url)) == NULL ||
+      (pr->project = strdup(res->project != NULL ? res->project : "")) ==
+        NULL ||
+      (pr->collector = strdup(res->collector != NULL ? res->collector : "")) ==
+        NULL) {
+    free(pr->url);
+    free(pr->project);
+    return -1;
+  }
+  pr->record_type = res->record_type;
+  pr->initial_time = res->initial_time;
+  pr->duration = res->duration;
+  pr->weight = res_weight(res);
+  plan->res_cnt++;
+  plan->assigned = 0;
+  return 1;
+}
+
+// heaviest first (ties are broken by url so that plans are reproducible)
+static int cmp_weight(const void *a, const void *b)
+{
+  const plan_res_t *ra = a, *rb = b;
+
+  if (ra->weight != rb->weight) {
+    return ra->weight > rb->weight ? -1 : 1;
+  }
+  return strcmp(ra->url, rb->url);
+}
+
+// by unit, then in time order
+static int cmp_unit_time(const void *a, const void *b)
+{
+  const plan_res_t *ra = a, *rb = b;
+
+  if (ra->unit != rb->unit) {
+    return ra->unit < rb->unit ? -1 : 1;
+  }
+  if (ra->initial_time != rb->initial_time) {
+    return ra->initial_time < rb->initial_time ? -1 : 1;
+  }
+  return strcmp(ra->url, rb->url);
+}
+
+void bgpstream_plan_assign(bgpstream_plan_t *plan)
+{
+  int i, u, best;
+
+  if (plan->assigned != 0) {
+    return;
+  }
+
+  // greedily give the heaviest resource left to the lightest unit, which
+  // keeps every unit within the size of one resource of the others
+  qsort(plan->res, plan->res_cnt, sizeof(plan_res_t), cmp_weight);
+  memset(plan->unit_weights, 0, sizeof(uint64_t) * plan->units);
+  for (i = 0; i < plan->res_cnt; i++) {
+    best = 0;
+    for (u = 1; u < plan->units; u++) {
+      if (plan->unit_weights[u] < plan->unit_weights[best]) {
+        best = u;
+      }
+    }
+    plan->res[i].unit = best;
+    plan->unit_weights[best] += plan->res[i].weight;
+  }
+  qsort(plan->res, plan->res_cnt, sizeof(plan_res_t), cmp_unit_time);
+  plan->assigned = 1;
+}
+
+uint64_t bgpstream_plan_get_unit_weight(bgpstream_plan_t *plan, int unit)
+{
+  if (unit < 0 || unit >= plan->units) {
+    return 0;
+  }
+  return plan->unit_weights[unit];
+}
+
+// write a CSV field, quoting it if needed
+static void write_field(FILE *f, const char *s)
+{
+  if (strpbrk(s, ",\"\r\n") == NULL) {
+    fputs(s, f);
+    return;
+  }
+  fputc('"', f);
+  for (; *s != '\0'; s++) {
+    if (*s == '"') {
+      fputc('"', f);
+    }
+    fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+static int write_unit(bgpstream_plan_t *plan, const char *prefix, int unit,
+                      int *ip)
+{
+  char path[PLAN_PATH_LEN];
+  plan_res_t *pr;
+  FILE *f;
+  int cnt = 0;
+
+  if (snprintf(path, sizeof(path), "%s-%d.csv", prefix, unit) >=
+      (int)sizeof(path)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Work unit path is too long");
+    return -1;
+  }
+  if ((f = fopen(path, "w")) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create %s: %s", path,
+                  strerror(errno));
+    return -1;
+  }
+
+  for (; *ip < plan->res_cnt && plan->res[*ip].unit == unit; (*ip)++) {
+    pr = &plan->res[*ip];
+    write_field(f, pr->url);
+    fputc(',', f);
+    write_field(f, pr->project);
+    fprintf(f, ",%s,", pr->record_type == BGPSTREAM_RIB ? "ribs" : "updates");
+    write_field(f, pr->collector);
+    // the last column is the time the row was added, and the csvfile
+    // interface only reads rows added (strictly) after time 0 and before it
+    // started
+    fprintf(f, ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n", pr->initial_time,
+            pr->duration, pr->initial_time != 0 ? pr->initial_time : 1);
+    cnt++;
+  }
+
+  if (fclose(f) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write %s: %s", path,
+                  strerror(errno));
+    return -1;
+  }
+  bgpstream_log(BGPSTREAM_LOG_INFO,
+                "Work unit %s: %d resources, %" PRIu64 " bytes", path, cnt,
+                plan->unit_weights[unit]);
+  return cnt;
+}
+
+int bgpstream_plan_write(bgpstream_plan_t *plan, const char *prefix)
+{
+  int i = 0, u;
+
+  bgpstream_plan_assign(plan);
+  for (u = 0; u < plan->units; u++) {
+    if (write_unit(plan, prefix, u, &i) < 0) {
+      return -1;
+    }
+  }
+  return plan->res_cnt;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PLAN_H
+#define __BGPSTREAM_PLAN_H
+
+#include "bgpstream.h"
+#include "bgpstream_resource.h"
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private interface of the work unit
+ * planner
+ *
+ * The planner splits the resources of a (non-live) stream into a number of
+ * work units of about the same size, so that a backfill can be spread over
+ * several processes or nodes. Resources are weighed by their file size when
+ * they can be stat'ed locally, and by an estimate based on their type and
+ * duration otherwise, and are assigned heaviest first to the lightest unit.
+ * Each unit is written as a CSV file that the csvfile data interface can
+ * read.
+ */
+
+/** Opaque structure holding the state of the planner */
+typedef struct bgpstream_plan bgpstream_plan_t;
+
+/** Create a new planner
+ *
+ * @param units         number of work units to split the resources into
+ *                      (must be > 0)
+ * @return pointer to the planner if successful, NULL otherwise
+ */
+bgpstream_plan_t *bgpstream_plan_create(int units);
+
+/** Destroy the given planner
+ *
+ * @param plan          pointer to the planner to destroy
+ */
+void bgpstream_plan_destroy(bgpstream_plan_t *plan);
+
+/** Add a resource to the plan
+ *
+ * @param plan          pointer to the planner
+ * @param res           borrowed pointer to the resource to add
+ * @return 1 if the resource was added, 0 if it cannot be part of a work unit
+ * (e.g., it is a stream), -1 if an error occurred
+ */
+int bgpstream_plan_add(bgpstream_plan_t *plan, bgpstream_resource_t *res);
+
+/** Assign the resources to the work units
+ *
+ * @param plan          pointer to the planner
+ *
+ * This is also done by bgpstream_plan_write, and only needs to be called
+ * before bgpstream_plan_get_unit_weight.
+ */
+void bgpstream_plan_assign(bgpstream_plan_t *plan);
+
+/** Get the total (estimated) size of the resources of a work unit
+ *
+ * @param plan          pointer to the planner
+ * @param unit          index of the work unit (0 to units-1)
+ * @return the total size of the resources assigned to the unit, in bytes
+ */
+uint64_t bgpstream_plan_get_unit_weight(bgpstream_plan_t *plan, int unit);
+
+/** Write the work units to CSV files
+ *
+ * @param plan          pointer to the planner
+ * @param prefix        path prefix of the files (unit i is written to
+ *                      `<prefix>-<i>.csv`)
+ * @return the number of resources written, or -1 if an error occurred
+ *
+ * The resources of each unit are listed in time order, in the format read by
+ * the csvfile data interface.
+ */
+int bgpstream_plan_write(bgpstream_plan_t *plan, const char *prefix);
+
+#endif /* __BGPSTREAM_PLAN_H */
@@ -25,11 +25,18 @@
  */
 
 #include "bgpstream_reader.h"
+#include "bgpstream_reader_pool.h"
+#include "bgpstream_record_pool.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_trace.h"
+#include "bgpstream_utils_mem_int.h"
 #include "utils.h"
 #include <assert.h>
+#include <errno.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 #define DUMP_OPEN_MAX_RETRIES 5
@@ -38,6 +45,14 @@
 #define PREFETCH_IDX (reader->rec_buf_prefetch_idx)
 #define EXPORTED_IDX ((reader->rec_buf_prefetch_idx + 1) % 2)
 
+/* The ring needs at least two decoded records so that we can look ahead one
+   record to fix up the dump position of the record we're about to export */
+#define RING_MIN_DEPTH 2
+
+/* Number of ring slots that the decoder may currently fill */
+#define RING_CAPACITY(reader)                                                  \
+  ((reader)->ring_size - ((reader)->ring_exported >= 0 ? 1 : 0))
+
 struct bgpstream_reader {
 
   // borrowed pointer to the resource that we have opened
@@ -46,6 +61,12 @@ struct bgpstream_reader {
   // borrowed pointer to a filter manager instance
   bgpstream_filter_mgr_t *filter_mgr;
 
+  // interned ids (and strings) of the resource project and collector names
+  uint32_t project_id;
+  uint32_t collector_id;
+  const char *project_name;
+  const char *collector_name;
+
   // internal flip-flop buffers for storing records
   bgpstream_record_t *rec_buf[2];
   int rec_buf_filled[2];
@@ -57,7 +78,15 @@ struct bgpstream_reader {
   // status of the underlying reader
   bgpstream_format_status_t status;
 
-  // handle for the thread that will do the actual opening
+  // borrowed pointer to the pool that will do the actual opening (if NULL, a
+  // dedicated thread is used)
+  bgpstream_reader_pool_t *pool;
+
+  // borrowed pointer to the pool that records are recycled through (may be
+  // NULL)
+  bgpstream_record_pool_t *record_pool;
+
+  // handle for the thread that will do the actual opening (only if no pool)
   pthread_t opener_thread;
 
   // ALL BELOW HERE MUST USE MUTEX
@@ -75,6 +104,44 @@ struct bgpstream_reader {
 
   // what is the time of the next record (PREFETCH)
   uint32_t next_time;
+
+  // asynchronous prefetch ring (only used if ring_size > 0, in which case
+  // rec_buf is unused)
+
+  // ring of records (one more than the prefetch depth to hold the exported
+  // record)
+  bgpstream_record_t **ring;
+  // the time that should be reported for each record in the ring
+  uint32_t *ring_time;
+  int ring_size;
+
+  // index of the oldest decoded record (the next to be exported)
+  int ring_head;
+
+  // number of decoded records waiting to be exported
+  int ring_filled;
+
+  // index of the record currently exported to the user (-1 if none)
+  int ring_exported;
+
+  // is there a decode job queued or running?
+  int decoding;
+
+  // has the decoder reached the end of the dump (or an error)?
+  int ring_done;
+
+  // did the decoder stop because a stream resource had no data ready? (it is
+  // restarted by the next call to get_next_record)
+  int ring_idle;
+
+  // time of the last record decoded (reported for corrupted records)
+  uint32_t ring_last_time;
+
+  // set when the reader is being destroyed
+  int shutdown;
+
+  // signalled whenever the ring state changes
+  pthread_cond_t ring_cond;
 };
 
 static int prefetch_record(bgpstream_reader_t *reader)
@@ -138,17 +205,142 @@ static int prefetch_record(bgpstream_reader_t *reader)
   return 0;
 }
 
+// decode records into free ring slots until `want` records are waiting (or
+// the ring is full), or the dump ends. must be called with the reader mutex
+// held (it is released while decoding).
+static void ring_decode(bgpstream_reader_t *reader, int want)
+{
+  bgpstream_record_t *record;
+  bgpstream_format_status_t status;
+  int slot, prev;
+
+  while (reader->shutdown == 0 && reader->ring_done == 0 &&
+         reader->ring_idle == 0 && reader->ring_filled < want &&
+         reader->ring_filled < RING_CAPACITY(reader)) {
+    slot = (reader->ring_head + reader->ring_filled) % reader->ring_size;
+    record = reader->ring[slot];
+
+    // this slot is ours until we mark it as filled, so decode without the
+    // lock to let the consumer keep reading from other slots
+    pthread_mutex_unlock(&reader->mutex);
+    bgpstream_record_clear(record);
+    status = bgpstream_format_populate_record(reader->format, record);
+    pthread_mutex_lock(&reader->mutex);
+
+    // see the comment in prefetch_record. a stream that has no data ready is
+    // not done, but there is no point in asking it again right away.
+    if (reader->res->duration == BGPSTREAM_FOREVER &&
+        (status == BGPSTREAM_FORMAT_END_OF_DUMP ||
+         status == BGPSTREAM_FORMAT_FILTERED_DUMP ||
+         status == BGPSTREAM_FORMAT_EMPTY_DUMP ||
+         status == BGPSTREAM_FORMAT_CORRUPTED_DUMP)) {
+      reader->ring_idle = 1;
+      reader->status = BGPSTREAM_FORMAT_OK;
+      break;
+    }
+
+    switch (status) {
+    case BGPSTREAM_FORMAT_OK:
+      reader->ring_last_time = record->time_sec;
+      reader->ring_time[slot] = reader->ring_last_time;
+      reader->ring_filled++;
+      break;
+
+    case BGPSTREAM_FORMAT_CORRUPTED_MSG:
+    case BGPSTREAM_FORMAT_UNSUPPORTED_MSG:
+      // still export these, but keep reading
+      reader->ring_time[slot] = reader->ring_last_time;
+      reader->ring_filled++;
+      status = BGPSTREAM_FORMAT_OK;
+      break;
+
+    case BGPSTREAM_FORMAT_READ_ERROR:
+      reader->ring_done = 1;
+      break;
+
+    case BGPSTREAM_FORMAT_END_OF_DUMP:
+      // see the comment in prefetch_record. the consumer always leaves at
+      // least one decoded record in the ring until we are done, so the
+      // previous record is still ours to update.
+      if (record->dump_pos == BGPSTREAM_DUMP_END && reader->ring_filled > 0) {
+        prev = (slot + reader->ring_size - 1) % reader->ring_size;
+        reader->ring[prev]->dump_pos = BGPSTREAM_DUMP_END;
+      }
+      reader->ring_done = 1;
+      break;
+
+    default:
+      // export a meta record, and then stop
+      reader->ring_last_time = record->time_sec;
+      reader->ring_time[slot] = reader->ring_last_time;
+      reader->ring_filled++;
+      reader->ring_done = 1;
+      break;
+    }
+    reader->status = status;
+    pthread_cond_broadcast(&reader->ring_cond);
+  }
+
+  reader->decoding = 0;
+  pthread_cond_broadcast(&reader->ring_cond);
+}
+
+static void decode_job(void *user)
+{
+  bgpstream_reader_t *reader = (bgpstream_reader_t *)user;
+
+  pthread_mutex_lock(&reader->mutex);
+  ring_decode(reader, reader->ring_size);
+  pthread_mutex_unlock(&reader->mutex);
+}
+
+// queue a decode job if there is space in the ring and no job running. must
+// be called with the reader mutex held.
+static int ring_kick(bgpstream_reader_t *reader)
+{
+  if (reader->decoding != 0 || reader->ring_done != 0 ||
+      reader->ring_idle != 0 || reader->ring_filled >= RING_CAPACITY(reader)) {
+    return 0;
+  }
+  if (bgpstream_reader_pool_submit(reader->pool, decode_job, reader) != 0) {
+    return -1;
+  }
+  reader->decoding = 1;
+  return 0;
+}
+
+// wait for the decoder to make progress. if our decode job is still sitting in
+// the pool queue (e.g., behind jobs for other readers), steal it and decode on
+// this thread rather than leaving it idle. must be called with the reader
+// mutex held.
+static void ring_wait(bgpstream_reader_t *reader, int want)
+{
+  if (reader->decoding != 0 &&
+      bgpstream_reader_pool_cancel(reader->pool, reader) != 0) {
+    // only decode what we need, and hand the rest back to the pool
+    ring_decode(reader, want);
+    ring_kick(reader);
+    return;
+  }
+  pthread_cond_wait(&reader->ring_cond, &reader->mutex);
+}
+
 // fills the record with resource-level info that doesn't change per-record
 static int prepopulate_record(bgpstream_record_t *record,
-                              bgpstream_resource_t *res)
+                              bgpstream_reader_t *reader)
 {
+  bgpstream_resource_t *res = reader->res;
+
   // project
-  strncpy(record->project_name, res->project, BGPSTREAM_UTILS_STR_NAME_LEN);
-  record->project_name[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+  record->project_name = reader->project_name;
+  record->__int->project_id = reader->project_id;
 
   // collector
-  strncpy(record->collector_name, res->collector, BGPSTREAM_UTILS_STR_NAME_LEN);
-  record->collector_name[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+  record->collector_name = reader->collector_name;
+  record->__int->collector_id = reader->collector_id;
+
+  // router (set per message by the formats that know it)
+  record->router_name = "";
 
   // dump type
   record->type = res->record_type;
@@ -156,10 +348,18 @@ static int prepopulate_record(bgpstream_record_t *record,
   // dump time
   record->dump_time_sec = res->initial_time;
 
+  // listing time
+  record->listed_time_sec = res->listed_time;
+
   return 0;
 }
 
-static void *threaded_opener(void *user)
+// memory held by a reader (the records are accounted when they are created)
+#define READER_MEM(reader)                                                     \
+  (sizeof(bgpstream_reader_t) +                                                \
+   (sizeof(bgpstream_record_t *) + sizeof(uint32_t)) * (reader)->ring_size)
+
+static void open_resource(void *user)
 {
   bgpstream_reader_t *reader = (bgpstream_reader_t *)user;
   int retries = 0;
@@ -180,6 +380,12 @@ static void *threaded_opener(void *user)
       }
     }
   }
+  if (reader->format != NULL) {
+    bgpstream_stats_add(BGPSTREAM_STAT_RESOURCES_OPENED, 1);
+  }
+  BGPSTREAM_TRACE4(resource__open, reader->res->url,
+                   (int)reader->res->transport_type,
+                   (int)reader->res->format_type, reader->format != NULL);
 
   pthread_mutex_lock(&reader->mutex);
   if (reader->format == NULL) {
@@ -187,12 +393,24 @@ static void *threaded_opener(void *user)
                   "Could not open dumpfile (%s) after %d attempts. Giving up.",
                   reader->res->url, DUMP_OPEN_MAX_RETRIES);
     reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
+  } else if (reader->ring_size > 0) {
+    // create the ring of records
+    for (i = 0; i < reader->ring_size; i++) {
+      if ((reader->ring[i] = bgpstream_record_pool_get(reader->record_pool,
+                                                       reader->format)) ==
+            NULL ||
+          prepopulate_record(reader->ring[i], reader) != 0) {
+        reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
+        break;
+      }
+    }
   } else {
     // create the pair of records
     for (i = 0; i < 2; i++) {
-      if ((reader->rec_buf[i] = bgpstream_record_create(reader->format)) ==
+      if ((reader->rec_buf[i] = bgpstream_record_pool_get(reader->record_pool,
+                                                          reader->format)) ==
             NULL ||
-          prepopulate_record(reader->rec_buf[i], reader->res) != 0) {
+          prepopulate_record(reader->rec_buf[i], reader) != 0) {
         reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
         break;
       }
@@ -206,40 +424,180 @@ static void *threaded_opener(void *user)
   }
   reader->dump_ready = 1;
   pthread_cond_signal(&reader->dump_ready_cond);
+
+  // in async mode we carry on decoding as far as the ring will let us
+  if (reader->ring_size > 0) {
+    if (reader->status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
+      reader->ring_done = 1;
+    }
+    ring_decode(reader, reader->ring_size);
+  }
   pthread_mutex_unlock(&reader->mutex);
+}
 
+static void *threaded_opener(void *user)
+{
+  open_resource(user);
   return NULL;
 }
 
+static bgpstream_reader_status_t
+ring_get_next_record(bgpstream_reader_t *reader, bgpstream_record_t **record)
+{
+  bgpstream_reader_status_t rs = BGPSTREAM_READER_STATUS_OK;
+  int stream = reader->res->duration == BGPSTREAM_FOREVER;
+  // a stream has no end of dump to look ahead for
+  int want = stream ? 1 : 2;
+
+  pthread_mutex_lock(&reader->mutex);
+
+  // the previously exported record can now be reused by the decoder, and an
+  // idle stream may have data by now
+  reader->ring_exported = -1;
+  reader->ring_idle = 0;
+  if (ring_kick(reader) != 0) {
+    rs = BGPSTREAM_READER_STATUS_ERROR;
+    goto done;
+  }
+
+  // wait until we can look one record past the one we're about to export
+  // (or, for a stream, until the decoder finds there is nothing to export)
+  while (reader->ring_filled < want && reader->ring_done == 0 &&
+         (reader->ring_idle == 0 || reader->decoding != 0)) {
+    ring_wait(reader, want);
+  }
+
+  if (reader->status == BGPSTREAM_FORMAT_READ_ERROR) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Prefetch failed");
+    rs = BGPSTREAM_READER_STATUS_ERROR;
+    goto done;
+  }
+
+  if (reader->ring_filled == 0) {
+    rs = (stream && reader->ring_done == 0) ? BGPSTREAM_READER_STATUS_AGAIN :
+                                              BGPSTREAM_READER_STATUS_EOS;
+    goto done;
+  }
+
+  // export the oldest record
+  reader->ring_exported = reader->ring_head;
+  reader->ring_head = (reader->ring_head + 1) % reader->ring_size;
+  reader->ring_filled--;
+  if (reader->ring_filled > 0) {
+    reader->next_time = reader->ring_time[reader->ring_head];
+  }
+  *record = reader->ring[reader->ring_exported];
+
+  // and keep the decoder busy
+  if (ring_kick(reader) != 0) {
+    rs = BGPSTREAM_READER_STATUS_ERROR;
+  }
+
+done:
+  pthread_mutex_unlock(&reader->mutex);
+  return rs;
+}
+
 /* ========== PUBLIC FUNCTIONS BELOW ========== */
 
 bgpstream_reader_t *bgpstream_reader_create(bgpstream_resource_t *resource,
-                                            bgpstream_filter_mgr_t *filter_mgr)
+                                            bgpstream_filter_mgr_t *filter_mgr,
+                                            bgpstream_reader_pool_t *pool,
+                                            int prefetch_depth,
+                                            bgpstream_record_pool_t *record_pool)
 {
   bgpstream_reader_t *reader;
 
-  if ((reader = malloc_zero(sizeof(bgpstream_reader_t))) == NULL) {
+  if ((reader = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_READER,
+                                          sizeof(bgpstream_reader_t))) ==
+      NULL) {
     return NULL;
   }
 
   reader->res = resource;
   reader->filter_mgr = filter_mgr;
+  reader->pool = pool;
+  reader->record_pool = record_pool;
   reader->status = BGPSTREAM_FORMAT_OK;
+  reader->ring_exported = -1;
+
+  // intern the names once, so that the records (and the name filters) only
+  // deal with their ids
+  reader->project_id =
+    bgpstream_str_intern(filter_mgr->names, resource->project);
+  reader->collector_id =
+    bgpstream_str_intern(filter_mgr->names, resource->collector);
+  // (the strings outlive the reader, so records can point to them)
+  if ((reader->project_name = bgpstream_str_intern_get(
+         filter_mgr->names, reader->project_id)) == NULL ||
+      (reader->collector_name = bgpstream_str_intern_get(
+         filter_mgr->names, reader->collector_id)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not intern resource names");
+    goto err;
+  }
 
-  // initialize and start the thread to open the resource
+  // async prefetching needs a pool to decode on. stream resources may have no
+  // data ready, in which case the decoder goes idle until the next read.
+  if (pool != NULL && prefetch_depth >= RING_MIN_DEPTH) {
+    reader->ring_size = prefetch_depth + 1;
+    if ((reader->ring = malloc_zero(sizeof(bgpstream_record_t *) *
+                                    reader->ring_size)) == NULL ||
+        (reader->ring_time =
+           malloc_zero(sizeof(uint32_t) * reader->ring_size)) == NULL) {
+      free(reader->ring);
+      bgpstream_mem_free(BGPSTREAM_MEM_READER, reader);
+      return NULL;
+    }
+    // the open job will start decoding
+    reader->decoding = 1;
+  }
+
+  // initialize and start the job to open the resource
   // this will also pre-fetch the first record
   pthread_mutex_init(&reader->mutex, NULL);
   pthread_cond_init(&reader->dump_ready_cond, NULL);
+  pthread_cond_init(&reader->ring_cond, NULL);
   reader->dump_ready = 0;
   reader->skip_dump_check = 0;
-  pthread_create(&reader->opener_thread, NULL, threaded_opener, reader);
+  if (pool != NULL) {
+    if (bgpstream_reader_pool_submit(pool, open_resource, reader) != 0) {
+      goto err;
+    }
+  } else if (bgpstream_cpuset_thread_create(filter_mgr->worker_cpus,
+                                            &reader->opener_thread,
+                                            threaded_opener, reader) != 0) {
+    goto err;
+  }
 
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_READER, READER_MEM(reader));
   return reader;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start opening %s",
+                resource->url);
+  pthread_mutex_destroy(&reader->mutex);
+  pthread_cond_destroy(&reader->dump_ready_cond);
+  pthread_cond_destroy(&reader->ring_cond);
+  free(reader->ring);
+  free(reader->ring_time);
+  bgpstream_mem_free(BGPSTREAM_MEM_READER, reader);
+  return NULL;
 }
 
 uint32_t bgpstream_reader_get_next_time(bgpstream_reader_t *reader)
 {
   assert(bgpstream_reader_open_wait(reader) == 0);
+  if (reader->ring_size > 0) {
+    pthread_mutex_lock(&reader->mutex);
+    while (reader->ring_filled == 0 && reader->ring_done == 0 &&
+           (reader->ring_idle == 0 || reader->decoding != 0)) {
+      ring_wait(reader, 1);
+    }
+    if (reader->ring_filled > 0) {
+      reader->next_time = reader->ring_time[reader->ring_head];
+    }
+    pthread_mutex_unlock(&reader->mutex);
+  }
   return reader->next_time;
 }
 
@@ -248,36 +606,94 @@ void bgpstream_reader_destroy(bgpstream_reader_t *reader)
   if (reader == NULL) {
     return;
   }
+  BGPSTREAM_TRACE1(resource__close, reader->res->url);
 
-  // Ensure the thread is done
-  pthread_join(reader->opener_thread, NULL);
+  // Ensure the opener is done
+  if (reader->pool == NULL) {
+    pthread_join(reader->opener_thread, NULL);
+  } else {
+    // ask any running decoder to stop early
+    pthread_mutex_lock(&reader->mutex);
+    reader->shutdown = 1;
+    pthread_mutex_unlock(&reader->mutex);
+
+    if (bgpstream_reader_pool_cancel(reader->pool, reader) == 0) {
+      // the job has already been picked up by a worker, so wait for it
+      pthread_mutex_lock(&reader->mutex);
+      while (reader->dump_ready == 0) {
+        pthread_cond_wait(&reader->dump_ready_cond, &reader->mutex);
+      }
+      while (reader->decoding != 0) {
+        pthread_cond_wait(&reader->ring_cond, &reader->mutex);
+      }
+      pthread_mutex_unlock(&reader->mutex);
+    }
+  }
   pthread_mutex_destroy(&reader->mutex);
   pthread_cond_destroy(&reader->dump_ready_cond);
+  pthread_cond_destroy(&reader->ring_cond);
 
   int i;
   for (i = 0; i < 2; i++) {
-    bgpstream_record_destroy(reader->rec_buf[i]);
+    bgpstream_record_pool_put(reader->record_pool, reader->rec_buf[i]);
     reader->rec_buf[i] = NULL;
   }
+  for (i = 0; i < reader->ring_size; i++) {
+    bgpstream_record_pool_put(reader->record_pool, reader->ring[i]);
+  }
+  free(reader->ring);
+  reader->ring = NULL;
+  free(reader->ring_time);
+  reader->ring_time = NULL;
 
+  if (reader->format != NULL) {
+    bgpstream_stats_add(BGPSTREAM_STAT_RESOURCES_CLOSED, 1);
+  }
   bgpstream_format_destroy(reader->format);
 
-  free(reader);
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_READER, -(int64_t)READER_MEM(reader));
+  bgpstream_mem_free(BGPSTREAM_MEM_READER, reader);
 }
 
 int bgpstream_reader_open_wait(bgpstream_reader_t *reader)
 {
+  return bgpstream_reader_open_timedwait(reader, UINT64_MAX);
+}
+
+int bgpstream_reader_open_timedwait(bgpstream_reader_t *reader,
+                                    uint64_t deadline)
+{
+  bgpstream_format_status_t status;
+  struct timespec ts;
+  uint64_t start;
+
   if (reader->skip_dump_check != 0) {
     return 0;
   }
+  start = bgpstream_stats_now();
+
+  ts.tv_sec = deadline / 1000;
+  ts.tv_nsec = (deadline % 1000) * 1000000;
 
   pthread_mutex_lock(&reader->mutex);
   while (reader->dump_ready == 0) {
-    pthread_cond_wait(&reader->dump_ready_cond, &reader->mutex);
+    if (deadline == UINT64_MAX) {
+      pthread_cond_wait(&reader->dump_ready_cond, &reader->mutex);
+    } else if (pthread_cond_timedwait(&reader->dump_ready_cond, &reader->mutex,
+                                      &ts) == ETIMEDOUT &&
+               reader->dump_ready == 0) {
+      // still opening
+      pthread_mutex_unlock(&reader->mutex);
+      bgpstream_stats_add_time(BGPSTREAM_STAT_OPEN_WAIT_NS, start);
+      return 1;
+    }
   }
+  // in async mode the decoder may already be updating the status
+  status = reader->status;
   pthread_mutex_unlock(&reader->mutex);
+  bgpstream_stats_add_time(BGPSTREAM_STAT_OPEN_WAIT_NS, start);
 
-  if (reader->status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
+  if (status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
     return -1;
   }
 
@@ -300,6 +716,10 @@ int bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
     return BGPSTREAM_READER_STATUS_EOS;
   }
 
+  if (reader->ring_size > 0) {
+    return ring_get_next_record(reader, record);
+  }
+
   // mark the previous record as unfilled (about to become PREFETCH_IDX)
   reader->rec_buf_filled[EXPORTED_IDX] = 0;
   // the record contents will be cleared by the next prefetch
@@ -330,3 +750,42 @@ int bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
 
   return BGPSTREAM_READER_STATUS_OK;
 }
+
+bgpstream_record_t *bgpstream_reader_detach_record(bgpstream_reader_t *reader)
+{
+  bgpstream_record_t *fresh, *detached = NULL;
+
+  // the replacement doesn't need anything from the decoder
+  if ((fresh = bgpstream_record_pool_get(reader->record_pool,
+                                         reader->format)) == NULL ||
+      prepopulate_record(fresh, reader) != 0) {
+    bgpstream_record_pool_put(reader->record_pool, fresh);
+    return NULL;
+  }
+
+  if (reader->ring_size > 0) {
+    pthread_mutex_lock(&reader->mutex);
+    if (reader->ring_exported >= 0) {
+      detached = reader->ring[reader->ring_exported];
+      reader->ring[reader->ring_exported] = fresh;
+    }
+    pthread_mutex_unlock(&reader->mutex);
+  } else if (reader->rec_buf_filled[EXPORTED_IDX] != 0) {
+    detached = reader->rec_buf[EXPORTED_IDX];
+    reader->rec_buf[EXPORTED_IDX] = fresh;
+  }
+
+  if (detached == NULL) {
+    // nothing was exported
+    bgpstream_record_pool_put(reader->record_pool, fresh);
+  }
+  return detached;
+}
+
+int bgpstream_reader_get_fd(bgpstream_reader_t *reader)
+{
+  if (bgpstream_reader_open_wait(reader) != 0 || reader->format == NULL) {
+    return -1;
+  }
+  return bgpstream_format_get_fd(reader->format);
+}
@@ -28,6 +28,8 @@
 #define __BGPSTREAM_READER_H
 
 #include "bgpstream_filter.h"
+#include "bgpstream_reader_pool.h"
+#include "bgpstream_record_pool.h"
 #include "bgpstream_resource.h"
 
 /** Opaque structure representing a reader instance */
@@ -50,9 +52,29 @@ typedef enum {
 
 } bgpstream_reader_status_t;
 
-/** Create a new reader for the given resource */
+/** Create a new reader for the given resource
+ *
+ * @param resource      borrowed pointer to the resource to read from
+ * @param filter_mgr    borrowed pointer to a filter manager instance
+ * @param pool          borrowed pointer to a pool that will open the
+ *                      resource, or NULL to use a dedicated thread
+ * @param prefetch_depth number of records to decode ahead in the background,
+ *                      or 0 to decode on the calling thread
+ * @param record_pool   borrowed pointer to a pool to take records from (and
+ *                      return them to when the reader is destroyed), or NULL
+ * @return pointer to the created reader if successful, NULL otherwise
+ *
+ * The resource is opened (and the first record pre-fetched) asynchronously.
+ * Use bgpstream_reader_open_wait to block until this has completed.
+ *
+ * Background decoding is only used if a pool is given and the resource is not
+ * a stream. A prefetch depth of less than 2 disables it.
+ */
 bgpstream_reader_t *bgpstream_reader_create(bgpstream_resource_t *resource,
-                                            bgpstream_filter_mgr_t *filter_mgr);
+                                            bgpstream_filter_mgr_t *filter_mgr,
+                                            bgpstream_reader_pool_t *pool,
+                                            int prefetch_depth,
+                                            bgpstream_record_pool_t *record_pool);
 
 /** Get the time of the next record available in the reader
  *
@@ -64,6 +86,17 @@ uint32_t bgpstream_reader_get_next_time(bgpstream_reader_t *reader);
 /** Block until the resource has opened */
 int bgpstream_reader_open_wait(bgpstream_reader_t *reader);
 
+/** Block until the resource has opened, or until the given deadline
+ *
+ * @param reader        pointer to a reader instance
+ * @param deadline      time (in msec since the epoch) to give up waiting at,
+ *                      (a time in the past just checks if it is open)
+ * @return 0 if the resource is open, 1 if it is still being opened at the
+ * deadline, -1 if it could not be opened
+ */
+int bgpstream_reader_open_timedwait(bgpstream_reader_t *reader,
+                                    uint64_t deadline);
+
 /** Destroy the given reader */
 void bgpstream_reader_destroy(bgpstream_reader_t *reader);
 
@@ -82,4 +115,29 @@ bgpstream_reader_status_t
 bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
                                  bgpstream_record_t **record);
 
+/** Take ownership of the record most recently exported by the reader
+ *
+ * @param reader        pointer to a reader instance
+ * @return the previously exported record, or NULL if there is none (or a
+ * replacement could not be allocated)
+ *
+ * The reader's slot is refilled with a fresh record, so the detached record
+ * stays valid across later calls to bgpstream_reader_get_next_record. It must
+ * be returned to the reader's record pool (using bgpstream_record_pool_put)
+ * before the reader is destroyed, since its data still refers to the reader's
+ * format.
+ */
+bgpstream_record_t *bgpstream_reader_detach_record(bgpstream_reader_t *reader);
+
+/** Get a file descriptor that becomes readable when the reader has new data
+ *
+ * @param reader        pointer to a reader instance
+ * @return a pollable file descriptor, or -1 if the reader's transport does not
+ * support readiness notification (or the resource could not be opened)
+ *
+ * This is intended for use after bgpstream_reader_get_next_record has
+ * returned AGAIN, so that the caller can sleep until data arrives.
+ */
+int bgpstream_reader_get_fd(bgpstream_reader_t *reader);
+
 #endif /* __BGPSTREAM_READER_H */
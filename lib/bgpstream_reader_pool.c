@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_reader_pool.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Opening a resource is mostly waiting on the network, so we allow a few more
+   workers than there are CPUs */
+#define POOL_THREADS_PER_CPU 2
+#define POOL_MIN_THREADS 4
+#define POOL_MAX_THREADS 64
+
+struct pool_job {
+  /** Function to run */
+  bgpstream_reader_pool_job_func_t func;
+
+  /** User pointer to pass to the function */
+  void *user;
+
+  /** Next job in the queue */
+  struct pool_job *next;
+};
+
+struct bgpstream_reader_pool {
+
+  /** Worker thread handles */
+  pthread_t *workers;
+
+  /** Number of workers that were started */
+  int workers_cnt;
+
+  // ALL BELOW HERE MUST USE MUTEX
+
+  /** FIFO queue of jobs waiting for a worker */
+  struct pool_job *head;
+  struct pool_job *tail;
+
+  /** Set when the pool is being destroyed */
+  int shutdown;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t job_cond;
+};
+
+static void *worker_thread(void *user)
+{
+  bgpstream_reader_pool_t *pool = (bgpstream_reader_pool_t *)user;
+  struct pool_job *job;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (pool->head == NULL && pool->shutdown == 0) {
+      pthread_cond_wait(&pool->job_cond, &pool->mutex);
+    }
+    if (pool->shutdown != 0) {
+      break;
+    }
+
+    // dequeue the oldest job
+    job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL) {
+      pool->tail = NULL;
+    }
+
+    // and run it without holding the lock
+    pthread_mutex_unlock(&pool->mutex);
+    job->func(job->user);
+    free(job);
+    pthread_mutex_lock(&pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+/* ========== PUBLIC FUNCTIONS BELOW ========== */
+
+bgpstream_reader_pool_t *
+bgpstream_reader_pool_create(int threads, const bgpstream_cpuset_t *cpus)
+{
+  bgpstream_reader_pool_t *pool;
+  int i;
+
+  assert(threads > 0);
+
+  if ((pool = malloc_zero(sizeof(bgpstream_reader_pool_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->job_cond, NULL);
+
+  if ((pool->workers = malloc(sizeof(pthread_t) * threads)) == NULL) {
+    goto err;
+  }
+
+  for (i = 0; i < threads; i++) {
+    if (bgpstream_cpuset_thread_create(cpus, &pool->workers[i], worker_thread,
+                                       pool) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start reader pool worker");
+      goto err;
+    }
+    pool->workers_cnt++;
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_FINE, "Started reader pool with %d workers",
+                pool->workers_cnt);
+  return pool;
+
+err:
+  bgpstream_reader_pool_destroy(pool);
+  return NULL;
+}
+
+void bgpstream_reader_pool_destroy(bgpstream_reader_pool_t *pool)
+{
+  struct pool_job *job;
+  int i;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->job_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (i = 0; i < pool->workers_cnt; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+  free(pool->workers);
+  pool->workers = NULL;
+  pool->workers_cnt = 0;
+
+  // discard any jobs that were never started
+  while ((job = pool->head) != NULL) {
+    pool->head = job->next;
+    free(job);
+  }
+  pool->tail = NULL;
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->job_cond);
+
+  free(pool);
+}
+
+int bgpstream_reader_pool_submit(bgpstream_reader_pool_t *pool,
+                                 bgpstream_reader_pool_job_func_t func,
+                                 void *user)
+{
+  struct pool_job *job;
+
+  if ((job = malloc_zero(sizeof(struct pool_job))) == NULL) {
+    return -1;
+  }
+  job->func = func;
+  job->user = user;
+
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->tail == NULL) {
+    pool->head = job;
+  } else {
+    pool->tail->next = job;
+  }
+  pool->tail = job;
+  pthread_cond_signal(&pool->job_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  return 0;
+}
+
+int bgpstream_reader_pool_cancel(bgpstream_reader_pool_t *pool, void *user)
+{
+  struct pool_job *job, *prev = NULL;
+  int found = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  for (job = pool->head; job != NULL; prev = job, job = job->next) {
+    if (job->user != user) {
+      continue;
+    }
+    if (prev == NULL) {
+      pool->head = job->next;
+    } else {
+      prev->next = job->next;
+    }
+    if (pool->tail == job) {
+      pool->tail = prev;
+    }
+    free(job);
+    found = 1;
+    break;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return found;
+}
+
+int bgpstream_reader_pool_default_threads(void)
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  long threads;
+
+  if (cpus < 1) {
+    cpus = 1;
+  }
+  threads = cpus * POOL_THREADS_PER_CPU;
+  if (threads < POOL_MIN_THREADS) {
+    threads = POOL_MIN_THREADS;
+  }
+  if (threads > POOL_MAX_THREADS) {
+    threads = POOL_MAX_THREADS;
+  }
+  return (int)threads;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_READER_POOL_H
+#define __BGPSTREAM_READER_POOL_H
+
+#include "bgpstream_cpuset.h"
+
+/** Opaque structure representing a pool of worker threads that readers use to
+ * open (and pre-fetch from) their resources */
+typedef struct bgpstream_reader_pool bgpstream_reader_pool_t;
+
+/** Signature of a job that can be run by the pool */
+typedef void (*bgpstream_reader_pool_job_func_t)(void *user);
+
+/** Create a new pool with the given number of worker threads
+ *
+ * @param threads       number of worker threads to start (must be > 0)
+ * @param cpus          set of CPUs to pin the workers to (NULL to let them run
+ *                      anywhere)
+ * @return pointer to the created pool if successful, NULL otherwise
+ */
+bgpstream_reader_pool_t *
+bgpstream_reader_pool_create(int threads, const bgpstream_cpuset_t *cpus);
+
+/** Destroy the given pool
+ *
+ * @param pool          pointer to the pool to destroy
+ *
+ * Jobs that have not yet been started are discarded. This function blocks
+ * until all running jobs have completed.
+ */
+void bgpstream_reader_pool_destroy(bgpstream_reader_pool_t *pool);
+
+/** Queue a job to be run by one of the pool workers
+ *
+ * @param pool          pointer to the pool
+ * @param func          function to run
+ * @param user          user pointer that will be passed to the function
+ * @return 0 if the job was queued successfully, -1 otherwise
+ *
+ * Jobs are started in the same order that they are submitted.
+ */
+int bgpstream_reader_pool_submit(bgpstream_reader_pool_t *pool,
+                                 bgpstream_reader_pool_job_func_t func,
+                                 void *user);
+
+/** Remove a job from the pool's queue if it has not yet been started
+ *
+ * @param pool          pointer to the pool
+ * @param user          user pointer that the job was submitted with
+ * @return 1 if the job was removed before it started, 0 if no matching job
+ * was queued (i.e., it has already been started, or has completed)
+ */
+int bgpstream_reader_pool_cancel(bgpstream_reader_pool_t *pool, void *user);
+
+/** Get the default number of worker threads for a pool
+ *
+ * @return the number of threads to use when the user has not configured one
+ */
+int bgpstream_reader_pool_default_threads(void);
+
+#endif /* __BGPSTREAM_READER_POOL_H */
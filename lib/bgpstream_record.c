@@ -34,27 +34,37 @@
 #include "bgpstream_format_interface.h" // to access filter mgr
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_utils_mem_int.h"
+#include "bgpstream_utils_private.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
-#include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 bgpstream_record_t *bgpstream_record_create(bgpstream_format_t *format)
 {
   bgpstream_record_t *record;
 
-  if ((record = (bgpstream_record_t *)malloc_zero(
-         sizeof(bgpstream_record_t))) == NULL ||
-      (record->__int = malloc_zero(sizeof(bgpstream_record_internal_t))) ==
-        NULL) {
+  if ((record = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_READER,
+                                          sizeof(bgpstream_record_t))) ==
+        NULL ||
+      (record->__int = bgpstream_mem_malloc_zero(
+         BGPSTREAM_MEM_READER, sizeof(bgpstream_record_internal_t))) == NULL) {
     bgpstream_record_destroy(record);
     return NULL;
   }
 
   record->__int->format = format;
+  record->project_name = "";
+  record->collector_name = "";
+  record->router_name = "";
   bgpstream_format_init_data(record);
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_READER,
+                        sizeof(bgpstream_record_t) +
+                          sizeof(bgpstream_record_internal_t));
 
   return record;
 }
@@ -67,8 +77,14 @@ void bgpstream_record_destroy(bgpstream_record_t *record)
 
   bgpstream_format_destroy_data(record);
 
-  free(record->__int);
-  free(record);
+  if (record->__int != NULL) {
+    BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_READER,
+                          -(int64_t)(sizeof(bgpstream_record_t) +
+                                     sizeof(bgpstream_record_internal_t)));
+    bgpstream_mem_free(BGPSTREAM_MEM_READER, record->__int->raw);
+  }
+  bgpstream_mem_free(BGPSTREAM_MEM_READER, record->__int);
+  bgpstream_mem_free(BGPSTREAM_MEM_READER, record);
 }
 
 /* NOTE: this function deliberately does not reset many of the fields in a
@@ -78,209 +94,309 @@ void bgpstream_record_clear(bgpstream_record_t *record)
 {
   bgpstream_format_clear_data(record);
 
+  // keep the raw buffer for the next record
+  record->__int->raw_len = 0;
+  record->__int->raw_preamble_len = 0;
+
   // reset the record timestamps
   record->time_sec = 0;
   record->time_usec = 0;
-}
 
-static bgpstream_patricia_walk_cb_result_t pfx_exists(
-    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
-    void *data)
-{
-  *(int*)data = 1;
-  return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  record->__int->elem_cnt_hint = 0;
 }
 
-static bgpstream_patricia_walk_cb_result_t pfx_allows_more_specifics(
-    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
-    void *data)
+int bgpstream_record_set_raw(bgpstream_record_t *record,
+                             const uint8_t *preamble, size_t preamble_len,
+                             const uint8_t *raw, size_t raw_len)
 {
-  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
-  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
-      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_MORE) {
-    *(int*)data = 1;
-    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  bgpstream_record_internal_t *ri = record->__int;
+  size_t len = preamble_len + raw_len;
+  uint8_t *tmp;
+
+  if (len > ri->raw_alloc) {
+    if ((tmp = bgpstream_mem_realloc(BGPSTREAM_MEM_READER, ri->raw, len)) ==
+        NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate raw record buffer");
+      return -1;
+    }
+    ri->raw = tmp;
+    ri->raw_alloc = len;
   }
-  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
-}
 
-static bgpstream_patricia_walk_cb_result_t pfx_allows_less_specifics(
-    const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
-    void *data)
-{
-  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
-  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
-      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_LESS) {
-    *(int*)data = 1;
-    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  if (preamble_len > 0) {
+    memcpy(ri->raw, preamble, preamble_len);
   }
-  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  memcpy(ri->raw + preamble_len, raw, raw_len);
+  ri->raw_preamble_len = preamble_len;
+  ri->raw_len = len;
+  return 0;
 }
 
-static int bgpstream_elem_prefix_match(bgpstream_patricia_tree_t *prefixes,
-                                       bgpstream_pfx_t *search)
+// the state of the duplicate suppression and of the RIB diff mode (NULL if
+// they are disabled), returns -1 if it could not be created
+static int get_stages(bgpstream_record_t *record, bgpstream_dedup_t **dedup,
+                      bgpstream_churn_t **churn)
 {
-  int matched = 0;
+  bgpstream_filter_mgr_t *filter_mgr = record->__int->format->filter_mgr;
 
-  bgpstream_patricia_tree_walk_up_down(prefixes, search, pfx_exists,
-      pfx_allows_more_specifics, pfx_allows_less_specifics, &matched);
-  return matched;
+  if (filter_mgr->dedup_window != 0 && filter_mgr->dedup == NULL &&
+      (filter_mgr->dedup = bgpstream_dedup_create(filter_mgr->dedup_window)) ==
+        NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create duplicate filter");
+    return -1;
+  }
+  if (filter_mgr->rib_diff != 0 && filter_mgr->churn == NULL &&
+      (filter_mgr->churn = bgpstream_churn_create()) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create RIB diff state");
+    return -1;
+  }
+  *dedup = filter_mgr->dedup;
+  *churn = filter_mgr->churn;
+  return 0;
 }
 
-static int elem_check_filters(bgpstream_record_t *record,
-                              bgpstream_elem_t *elem)
+int bgpstream_record_get_next_elem(bgpstream_record_t *record,
+                                   bgpstream_elem_t **elemp)
 {
-  bgpstream_filter_mgr_t *filter_mgr = record->__int->format->filter_mgr;
-
-  /* First up, check if this element is the right type */
-  if (filter_mgr->elemtype_mask) {
-
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE)) {
-      return 0;
-    }
-
-    if (elem->type == BGPSTREAM_ELEM_TYPE_RIB &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_RIB)) {
-      return 0;
-    }
-
-    if (elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT &&
-        !(filter_mgr->elemtype_mask &
-          BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT)) {
-      return 0;
-    }
+  int rc;
+  bgpstream_elem_t *elem = NULL;
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_elem_filter_func_t *elem_filter;
+  bgpstream_dedup_t *dedup;
+  bgpstream_churn_t *churn;
+  *elemp = NULL;
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL)) {
-      return 0;
-    }
+  if (record == NULL ||
+      record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
+      record->__int->format == NULL) {
+    return 0; // treat as end-of-elems
   }
-
-  /* Checking peer ASNs: if the filter is on and the peer asn is not in the
-   * set, return 0 */
-  if (filter_mgr->peer_asns &&
-      bgpstream_id_set_exists(filter_mgr->peer_asns, elem->peer_asn) == 0) {
-    return 0;
+  if (get_stages(record, &dedup, &churn) != 0) {
+    return -1;
   }
+  // (NULL when no elem filters are set, so the loop below skips them)
+  filter_mgr = record->__int->format->filter_mgr;
+  elem_filter = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
 
-  /* Checking origin ASN */
-  if (filter_mgr->origin_asns) {
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
-    uint32_t origin_asn;
-
-    if (bgpstream_as_path_get_origin_val(elem->as_path, &origin_asn) < 0) {
-      return 0;
+  while (elem == NULL) {
+    if ((rc = bgpstream_format_get_next_elem(record->__int->format, record,
+                                             &elem)) <= 0) {
+      // either error or end-of-elems (after which the end of a RIB dump
+      // reports the routes it removed)
+      if (rc == 0 && churn != NULL) {
+        return bgpstream_churn_get_removed(churn, record, elemp);
+      }
+      return rc;
     }
+    bgpstream_stats_add(BGPSTREAM_STAT_ELEMS_GENERATED, 1);
 
-    if (bgpstream_id_set_exists(filter_mgr->origin_asns, origin_asn) == 0) {
-      return 0;
+    if (elem_filter != NULL && elem_filter(filter_mgr, elem, 1) == 0) {
+      elem = NULL;
+    } else if (dedup != NULL &&
+               (rc = bgpstream_dedup_check(dedup, record, elem)) != 0) {
+      if (rc < 0) {
+        return -1;
+      }
+      bgpstream_stats_add(BGPSTREAM_STAT_ELEMS_DUPLICATE, 1);
+      elem = NULL;
+    } else if (churn != NULL &&
+               (rc = bgpstream_churn_check(churn, record, elem)) <= 0) {
+      if (rc < 0) {
+        return -1;
+      }
+      elem = NULL;
     }
   }
 
-  if (filter_mgr->ipversion) {
-    /* Determine address version for the element prefix */
+  *elemp = elem;
+  return 1;
+}
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
+int bgpstream_record_get_next_elem_sets(bgpstream_record_t *record,
+                                        bgpstream_elem_t **elemp,
+                                        uint64_t *sets)
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  int rc;
 
-    if (elem->prefix.address.version != filter_mgr->ipversion)
-      return 0;
+  *sets = 0;
+  if ((rc = bgpstream_record_get_next_elem(record, elemp)) <= 0) {
+    return rc;
+  }
+  filter_mgr = record->__int->format->filter_mgr;
+  if (filter_mgr == NULL || filter_mgr->sets_cnt == 0) {
+    return rc;
   }
 
-  if (filter_mgr->prefixes) {
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
+  while ((*sets = bgpstream_filter_mgr_elem_sets_check(filter_mgr, *elemp)) ==
+         0) {
+    if ((rc = bgpstream_record_get_next_elem(record, elemp)) <= 0) {
+      return rc;
     }
-    if (bgpstream_elem_prefix_match(filter_mgr->prefixes, &elem->prefix) == 0)
-      return 0;
   }
+  return 1;
+}
 
-  /* Checking AS Path expressions */
-  if (filter_mgr->aspath_exprs) {
-    char aspath[65536];
-    int pathlen;
+static uint8_t batch_addr(uint8_t *dst, const bgpstream_ip_addr_t *addr)
+{
+  memset(dst, 0, BGPSTREAM_ELEM_BATCH_ADDR_LEN);
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    memcpy(dst, &addr->bs_ipv4.addr, sizeof(addr->bs_ipv4.addr));
+    return 4;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    memcpy(dst, &addr->bs_ipv6.addr, sizeof(addr->bs_ipv6.addr));
+    return 6;
+  default:
+    return 0;
+  }
+}
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
+int bgpstream_record_get_elem_batch(bgpstream_record_t *record,
+                                    bgpstream_elem_batch_t *batch)
+{
+  bgpstream_elem_t *elem;
+  uint8_t tmp[BGPSTREAM_ELEM_BATCH_ADDR_LEN];
+  uint8_t ver;
+  uint32_t asn;
+  int i = 0;
+  int rc;
 
-    pathlen = bgpstream_as_path_snprintf(aspath, sizeof(aspath), elem->as_path);
+  batch->cnt = 0;
 
-    if (pathlen >= sizeof(aspath)) {
-      bgpstream_log(BGPSTREAM_LOG_WARN,
-                    "AS Path is too long? Filter may not work well.");
+  while (i < batch->capacity) {
+    if ((rc = bgpstream_record_get_next_elem(record, &elem)) < 0) {
+      return -1;
     }
-
-    for (int i = 0; i < filter_mgr->aspath_expr_cnt; i++) {
-      int result = regexec(filter_mgr->aspath_exprs[i].re, aspath, 0, NULL, 0);
-      // All aspath regexes must match
-      if ((result == 0) != (filter_mgr->aspath_exprs[i].negate == 0)) {
-        return 0;
-      }
+    if (rc == 0) {
+      break;
     }
-  }
 
-  /* Checking communities (unless it is a withdrawal message) */
-  if (filter_mgr->communities) {
-    int pass = 0;
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
+    if (batch->time_sec != NULL) {
+      batch->time_sec[i] = elem->orig_time_sec;
+    }
+    if (batch->time_usec != NULL) {
+      batch->time_usec[i] = elem->orig_time_usec;
+    }
+    if (batch->type != NULL) {
+      batch->type[i] = elem->type;
+    }
+    if (batch->peer_asn != NULL) {
+      batch->peer_asn[i] = elem->peer_asn;
+    }
+    if (batch->peer_ip_version != NULL || batch->peer_ip != NULL) {
+      ver = batch_addr(batch->peer_ip != NULL ? batch->peer_ip[i] : tmp,
+                       &elem->peer_ip);
+      if (batch->peer_ip_version != NULL) {
+        batch->peer_ip_version[i] = ver;
+      }
     }
 
-    bgpstream_community_t *c;
-    khiter_t k;
-    for (k = kh_begin(filter_mgr->communities);
-         k != kh_end(filter_mgr->communities); ++k) {
-      if (kh_exist(filter_mgr->communities, k)) {
-        c = &(kh_key(filter_mgr->communities, k));
-        if (bgpstream_community_set_match(
-              elem->communities, c, kh_value(filter_mgr->communities, k))) {
-          pass = 1;
-          break;
+    if (elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+        elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT ||
+        elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL) {
+      if (batch->prefix_ip_version != NULL || batch->prefix_addr != NULL) {
+        ver =
+          batch_addr(batch->prefix_addr != NULL ? batch->prefix_addr[i] : tmp,
+                     &elem->prefix.address);
+        if (batch->prefix_ip_version != NULL) {
+          batch->prefix_ip_version[i] = ver;
         }
       }
+      if (batch->prefix_len != NULL) {
+        batch->prefix_len[i] = elem->prefix.mask_len;
+      }
+    } else {
+      if (batch->prefix_ip_version != NULL) {
+        batch->prefix_ip_version[i] = 0;
+      }
+      if (batch->prefix_addr != NULL) {
+        memset(batch->prefix_addr[i], 0, BGPSTREAM_ELEM_BATCH_ADDR_LEN);
+      }
+      if (batch->prefix_len != NULL) {
+        batch->prefix_len[i] = 0;
+      }
     }
-    if (pass == 0) {
-      return 0;
+
+    if (elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+        elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
+      if (batch->origin_asn != NULL) {
+        batch->origin_asn[i] =
+          bgpstream_as_path_get_origin_val(elem->as_path, &asn) == 0 ? asn : 0;
+      }
+      if (batch->path_id != NULL) {
+        batch->path_id[i] = bgpstream_as_path_get_len(elem->as_path) > 0
+                              ? bgpstream_as_path_hash(elem->as_path)
+                              : 0;
+      }
+    } else {
+      if (batch->origin_asn != NULL) {
+        batch->origin_asn[i] = 0;
+      }
+      if (batch->path_id != NULL) {
+        batch->path_id[i] = 0;
+      }
     }
+
+    i++;
   }
 
-  return 1;
+  batch->cnt = i;
+  return i;
 }
 
-int bgpstream_record_get_next_elem(bgpstream_record_t *record,
-                                   bgpstream_elem_t **elemp)
+uint32_t bgpstream_record_get_elem_cnt_hint(const bgpstream_record_t *record)
 {
-  int rc;
-  bgpstream_elem_t *elem = NULL;
-  *elemp = NULL;
-
-  if (record == NULL ||
-      record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
-      record->__int->format == NULL) {
-    return 0; // treat as end-of-elems
+  if (record == NULL || record->__int == NULL ||
+      record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+    return 0;
   }
+  return record->__int->elem_cnt_hint;
+}
 
-  while (elem == NULL) {
-    if ((rc = bgpstream_format_get_next_elem(record->__int->format, record,
-                                             &elem)) <= 0) {
-      // either error or end-of-elems
-      return rc;
-    }
+const char *bgpstream_record_get_project_name(const bgpstream_record_t *record)
+{
+  return record->project_name != NULL ? record->project_name : "";
+}
 
-    if (elem_check_filters(record, elem) == 0) {
-      elem = NULL;
-    }
+const char *
+bgpstream_record_get_collector_name(const bgpstream_record_t *record)
+{
+  return record->collector_name != NULL ? record->collector_name : "";
+}
+
+const char *bgpstream_record_get_router_name(const bgpstream_record_t *record)
+{
+  return record->router_name != NULL ? record->router_name : "";
+}
+
+int bgpstream_record_get_raw(const bgpstream_record_t *record,
+                             const uint8_t **buf, size_t *len)
+{
+  const bgpstream_record_internal_t *ri = record->__int;
+
+  if (ri->raw_len == ri->raw_preamble_len) {
+    *buf = NULL;
+    *len = 0;
+    return 0;
   }
+  *buf = ri->raw + ri->raw_preamble_len;
+  *len = ri->raw_len - ri->raw_preamble_len;
+  return 1;
+}
 
-  *elemp = elem;
+int bgpstream_record_get_raw_preamble(const bgpstream_record_t *record,
+                                      const uint8_t **buf, size_t *len)
+{
+  const bgpstream_record_internal_t *ri = record->__int;
+
+  if (ri->raw_preamble_len == 0) {
+    *buf = NULL;
+    *len = 0;
+    return 0;
+  }
+  *buf = ri->raw;
+  *len = ri->raw_preamble_len;
   return 1;
 }
 
@@ -353,11 +469,53 @@ int bgpstream_record_status_snprintf(char *buf, size_t len,
     written++;                                                                 \
   } while (0)
 
-#define SEEK_STR_END                                                           \
+/* same output as snprintf(buf, len, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
+   time_sec, time_usec, project_name, collector_name, router_name) */
+static int time_names_snprintf(char *buf, size_t len,
+                               const bgpstream_record_t *record)
+{
+  const char *project = bgpstream_record_get_project_name(record);
+  const char *collector = bgpstream_record_get_collector_name(record);
+  const char *router = bgpstream_record_get_router_name(record);
+  size_t project_len = strlen(project);
+  size_t collector_len = strlen(collector);
+  size_t router_len = strlen(router);
+  int n;
+
+  if (record->time_usec >= 1000000 ||
+      len <= BS_U32_STR_LEN + 11 + project_len + collector_len + router_len) {
+    return snprintf(buf, len, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
+                    record->time_sec, record->time_usec, project, collector,
+                    router);
+  }
+
+  n = bs_u32_to_str(buf, record->time_sec);
+  buf[n++] = '.';
+  n += bs_u32_to_str_pad6(buf + n, record->time_usec);
+  buf[n++] = '|';
+  memcpy(buf + n, project, project_len);
+  n += project_len;
+  buf[n++] = '|';
+  memcpy(buf + n, collector, collector_len);
+  n += collector_len;
+  buf[n++] = '|';
+  memcpy(buf + n, router, router_len);
+  n += router_len;
+  buf[n++] = '|';
+  buf[n] = '\0';
+  return n;
+}
+
+#define ADD_ROUTER_IP                                                          \
   do {                                                                         \
-    while (*buf_p != '\0') {                                                   \
-      written++;                                                               \
-      buf_p++;                                                                 \
+    if (record->router_ip.version != 0) {                                      \
+      if ((c = bgpstream_addr_ntop_len(buf_p, B_REMAIN, &record->router_ip)) < \
+          0) {                                                                 \
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");      \
+        return NULL;                                                           \
+      }                                                                        \
+      written += c;                                                            \
+      buf_p += c;                                                              \
     }                                                                          \
   } while (0)
 
@@ -385,20 +543,12 @@ char *bgpstream_record_snprintf(char *buf, size_t len,
   ADD_PIPE;
 
   /* Record timestamp, project, collector, router names */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
-               record->time_sec, record->time_usec, record->project_name,
-               record->collector_name, record->router_name);
+  c = time_names_snprintf(buf_p, B_REMAIN, record);
   written += c;
   buf_p += c;
 
   /* Router IP */
-  if (record->router_ip.version != 0) {
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");
-      return NULL;
-    }
-    SEEK_STR_END;
-  }
+  ADD_ROUTER_IP;
   ADD_PIPE;
 
   /* record status */
@@ -407,7 +557,10 @@ char *bgpstream_record_snprintf(char *buf, size_t len,
   buf_p += c;
 
   /* dump time */
-  c = snprintf(buf_p, B_REMAIN, "|%" PRIu32, record->dump_time_sec);
+  c = bgpstream_char_snprintf(buf_p, B_REMAIN, '|');
+  written += c;
+  buf_p += c;
+  c = bs_u32_snprintf(buf_p, B_REMAIN, record->dump_time_sec);
   written += c;
   buf_p += c;
 
@@ -440,20 +593,12 @@ char *bgpstream_record_elem_snprintf(char *buf, size_t len,
   ADD_PIPE;
 
   /* Record timestamp, project, collector, router names */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
-               record->time_sec, record->time_usec, record->project_name,
-               record->collector_name, record->router_name);
+  c = time_names_snprintf(buf_p, B_REMAIN, record);
   written += c;
   buf_p += c;
 
   /* Router IP */
-  if (record->router_ip.version != 0) {
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");
-      return NULL;
-    }
-    SEEK_STR_END;
-  }
+  ADD_ROUTER_IP;
   ADD_PIPE;
 
   if (bgpstream_elem_custom_snprintf(buf_p, B_REMAIN, elem, 0) == NULL) {
@@ -166,8 +166,13 @@ typedef struct bgpstream_record {
    * adminstrative organization that operates the BGP collector that collected
    * this information. That is, "projects" operate "collectors", which collect
    * data from "routers", who have "peers".
+   *
+   * Names are interned rather than copied into each record, so this points to
+   * a string shared by all records with the same project, which stays valid
+   * until the stream is destroyed. It is never NULL for a record returned by
+   * BGPStream (see bgpstream_record_get_project_name).
    */
-  char project_name[BGPSTREAM_UTILS_STR_NAME_LEN];
+  const char *project_name;
 
   /** Collector name
    *
@@ -178,18 +183,20 @@ typedef struct bgpstream_record {
    * project. When processing data directly from an OpenBMP kafka stream, the
    * collector name is the "Admin ID" configured on the collector, which is set
    * by the collection operator (the "project"). When using other data
-   * interfaces, this collector name is normally set manually.
+   * interfaces, this collector name is normally set manually. Like the project
+   * name, it points to an interned string.
    */
-  char collector_name[BGPSTREAM_UTILS_STR_NAME_LEN];
+  const char *collector_name;
 
   /** Router name
    *
    * This field is only used when processing data obtained from an OpenBMP kafka
    * stream (e.g., bmp.bgpstream.caida.org). It is a name set by the collection
    * "project", and is unique for a given collector. If unused or unknown, it
-   * will be set to the empty string.
+   * will be set to the empty string. Like the project name, it points to an
+   * interned string.
    */
-  char router_name[BGPSTREAM_UTILS_STR_NAME_LEN];
+  const char *router_name;
 
   /** Router IP
    *
@@ -203,6 +210,44 @@ typedef struct bgpstream_record {
    */
   bgpstream_ip_addr_t router_ip;
 
+  /** Late flag
+   *
+   * Set if records with a later time had already been returned when this
+   * record was read. This only happens when a reorder delay is set (see
+   * bgpstream_set_live_reorder_delay) and the resource this record came from
+   * took longer than that to open.
+   */
+  uint8_t late;
+
+  /** Listing time
+   *
+   * The wall-clock time (in seconds) when the data interface listed the
+   * resource this record came from (e.g., when the broker returned the dump
+   * file). Together with the read and delivery times below, this tells where
+   * a live record spent its time between the collector and the consumer (see
+   * the lag histograms of bgpstream_get_stats).
+   */
+  uint32_t listed_time_sec;
+
+  /** Read time (seconds component)
+   *
+   * The wall-clock time when the record was read from its resource.
+   */
+  uint32_t read_time_sec;
+
+  /** Read time (microseconds component) */
+  uint32_t read_time_usec;
+
+  /** Delivery time (seconds component)
+   *
+   * The wall-clock time when BGPStream returned the record to the consumer.
+   * The elems of the record are extracted after this time.
+   */
+  uint32_t delivered_time_sec;
+
+  /** Delivery time (microseconds component) */
+  uint32_t delivered_time_usec;
+
   /* ---------- DUMP-ONLY FIELDS: ---------- */
 
   /** Position of this record in the dump */
@@ -220,6 +265,51 @@ typedef struct bgpstream_record {
 
 } bgpstream_record_t;
 
+/** Width of an address in an elem batch column */
+#define BGPSTREAM_ELEM_BATCH_ADDR_LEN 16
+
+/** Caller-owned, column-oriented batch of elems
+ *
+ * Each column is an array of at least `capacity` entries that is allocated by
+ * the caller. Columns that are set to NULL are not filled. Addresses are stored
+ * as 16-byte values (IPv4 addresses use the first 4 bytes and the rest is
+ * zero) with the IP version (4 or 6) in a separate column, which maps directly
+ * onto fixed-width (e.g., Arrow FixedSizeBinary) columns.
+ */
+typedef struct bgpstream_elem_batch {
+
+  /** Number of entries allocated in each column */
+  int capacity;
+
+  /** Number of entries filled by the last call to
+      bgpstream_record_get_elem_batch */
+  int cnt;
+
+  /** Original time of each elem (seconds and microseconds) */
+  uint32_t *time_sec;
+  uint32_t *time_usec;
+
+  /** Elem type (bgpstream_elem_type_t) */
+  uint8_t *type;
+
+  /** Peer ASN and address */
+  uint32_t *peer_asn;
+  uint8_t *peer_ip_version;
+  uint8_t (*peer_ip)[BGPSTREAM_ELEM_BATCH_ADDR_LEN];
+
+  /** Prefix address and length (zero for elems without a prefix) */
+  uint8_t *prefix_ip_version;
+  uint8_t (*prefix_addr)[BGPSTREAM_ELEM_BATCH_ADDR_LEN];
+  uint8_t *prefix_len;
+
+  /** Origin ASN, or 0 if the path has no simple origin ASN */
+  uint32_t *origin_asn;
+
+  /** Hash of the AS path, or 0 if the elem has no path */
+  uint32_t *path_id;
+
+} bgpstream_elem_batch_t;
+
 /** @} */
 
 /**
@@ -244,6 +334,114 @@ typedef struct bgpstream_record {
 int bgpstream_record_get_next_elem(bgpstream_record_t *record,
                                    bgpstream_elem_t **elem);
 
+/** Retrieve the next elem from the record that passes at least one filter set
+ *
+ * @param record        pointer to the BGP Stream Record to retrieve the elem
+ *                      from
+ * @param[out] elem     set to point to a borrowed elem structure, or NULL if
+ *                      there are no more elems
+ * @param[out] sets     set to the mask of the filter sets that the elem passes
+ * @return 1 if a valid elem was returned, 0 if there are no more elems, -1 if
+ * an error occurred
+ *
+ * Elems are first filtered as with bgpstream_record_get_next_elem, then
+ * matched against every set added with bgpstream_add_filter_set, so that a
+ * single pass over the stream answers all of the queries. Elems that pass no
+ * set are skipped. If no sets were added, this behaves like
+ * bgpstream_record_get_next_elem and the mask is always 0.
+ */
+int bgpstream_record_get_next_elem_sets(bgpstream_record_t *record,
+                                        bgpstream_elem_t **elem,
+                                        uint64_t *sets);
+
+/** Fill a batch with the next elems from the record
+ *
+ * @param record        pointer to the BGP Stream Record to retrieve elems from
+ * @param batch         pointer to a caller-owned batch to fill
+ * @return the number of elems written to the batch (also stored in
+ * batch->cnt), 0 if there are no more elems, -1 if an error occurred
+ *
+ * Elems are filtered exactly as with bgpstream_record_get_next_elem, and the
+ * two functions share the same position in the record, so successive calls
+ * continue where the previous one stopped.
+ */
+int bgpstream_record_get_elem_batch(bgpstream_record_t *record,
+                                    bgpstream_elem_batch_t *batch);
+
+/** Get the number of elems the record is expected to contain
+ *
+ * @param record        pointer to the BGP Stream Record to check
+ * @return the number of elems in the record before any elem filters are
+ * applied, or 0 if it is not known
+ *
+ * The count is taken from the prefix and RIB entry counts of the decoded
+ * message, so it is available before any elem has been extracted, and can be
+ * used to size a batch for bgpstream_record_get_elem_batch. Elem filters and
+ * duplicate suppression may return fewer elems, and the end of a RIB dump in
+ * RIB diff mode may return more (see bgpstream_set_rib_diff_mode).
+ */
+uint32_t bgpstream_record_get_elem_cnt_hint(const bgpstream_record_t *record);
+
+/** Get the project name of the record
+ *
+ * @param record        pointer to the BGP Stream Record to get the name of
+ * @return a borrowed pointer to the project name (never NULL)
+ *
+ * Unlike the project_name field, this also works for records that were built
+ * by the caller and whose names were never set.
+ */
+const char *bgpstream_record_get_project_name(const bgpstream_record_t *record);
+
+/** Get the collector name of the record
+ *
+ * @param record        pointer to the BGP Stream Record to get the name of
+ * @return a borrowed pointer to the collector name (never NULL)
+ */
+const char *
+bgpstream_record_get_collector_name(const bgpstream_record_t *record);
+
+/** Get the router name of the record
+ *
+ * @param record        pointer to the BGP Stream Record to get the name of
+ * @return a borrowed pointer to the router name, which is empty if the record
+ * has no router (never NULL)
+ */
+const char *bgpstream_record_get_router_name(const bgpstream_record_t *record);
+
+/** Get the raw MRT bytes of the record
+ *
+ * @param record        pointer to the BGP Stream Record to get the bytes of
+ * @param[out] buf      set to point to the raw message
+ * @param[out] len      set to the length of the raw message
+ * @return 1 if the raw bytes are available, 0 otherwise
+ *
+ * Raw bytes are only kept if enabled with bgpstream_set_keep_raw_records, and
+ * only for records read from MRT dumps. The message is exactly as it was read
+ * from the dump, so writing the raw bytes of successive records to a file
+ * (after any preamble, see bgpstream_record_get_raw_preamble) produces a valid
+ * MRT dump. The bytes are owned by the record, and are only valid until the
+ * next call to bgpstream_get_next_record.
+ */
+int bgpstream_record_get_raw(const bgpstream_record_t *record,
+                             const uint8_t **buf, size_t *len);
+
+/** Get the raw MRT messages that must be written before the record
+ *
+ * @param record        pointer to the BGP Stream Record to get the bytes of
+ * @param[out] buf      set to point to the raw messages
+ * @param[out] len      set to the length of the raw messages
+ * @return 1 if the record has a preamble, 0 otherwise
+ *
+ * The entries of a TABLE_DUMP_V2 RIB record refer to peers in the
+ * PEER_INDEX_TABLE message at the start of the dump, which BGPStream does not
+ * return as a record. Instead, when raw bytes are kept, the first record
+ * returned after a peer index table carries it as a preamble. To write a valid
+ * dump, the preamble must be written whenever it is present, even if the
+ * record itself is not.
+ */
+int bgpstream_record_get_raw_preamble(const bgpstream_record_t *record,
+                                      const uint8_t **buf, size_t *len);
+
 /** Write the string representation of the record type into the provided buffer
  *
  * @param buf           pointer to a char array
@@ -52,6 +52,23 @@ struct bgpstream_record_internal {
 
   /** Private data-structure (optionally) populated by the format module */
   void *data;
+
+  /** Raw bytes of the record (only populated if raw records are kept). The
+      first raw_preamble_len bytes are the preamble, the rest is the record */
+  uint8_t *raw;
+  size_t raw_len;
+  size_t raw_preamble_len;
+  size_t raw_alloc;
+
+  /** Ids of the project, collector and router names in the filter manager's
+      intern table (so that name filters compare integers) */
+  uint32_t project_id;
+  uint32_t collector_id;
+  uint32_t router_id;
+
+  /** Number of elems the format expects the record to yield before any elem
+      filters are applied (0 if it doesn't know) */
+  uint32_t elem_cnt_hint;
 };
 
 /** @} */
@@ -86,6 +103,22 @@ void bgpstream_record_destroy(bgpstream_record_t *record);
  */
 void bgpstream_record_clear(bgpstream_record_t *record);
 
+/** Store the raw bytes of the given record
+ *
+ * @param record        pointer to the record to store the bytes in
+ * @param preamble      pointer to the raw bytes that must precede the record
+ *                      (may be NULL)
+ * @param preamble_len  length of the preamble
+ * @param raw           pointer to the raw bytes of the record
+ * @param raw_len       length of the raw bytes
+ * @return 0 if successful, -1 otherwise
+ *
+ * The bytes are copied into the record, and are dropped when it is cleared.
+ */
+int bgpstream_record_set_raw(bgpstream_record_t *record,
+                             const uint8_t *preamble, size_t preamble_len,
+                             const uint8_t *raw, size_t raw_len);
+
 /** @} */
 
 #endif /* __BGPSTREAM_RECORD_INT_H */
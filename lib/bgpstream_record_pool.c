@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_record_pool.h"
+#include "bgpstream_format_interface.h"
+#include "bgpstream_record_int.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Maximum number of idle records to keep for each format type */
+#define RECORD_POOL_MAX_IDLE 256
+
+struct pool_bucket {
+  /** The format type that these records were created for */
+  bgpstream_resource_format_type_t type;
+
+  /** Copy of the format methods (without any instance state) so that idle
+      records can still be cleared/destroyed after their format is gone */
+  bgpstream_format_t proto;
+
+  /** Idle records */
+  bgpstream_record_t *idle[RECORD_POOL_MAX_IDLE];
+  int idle_cnt;
+
+  struct pool_bucket *next;
+};
+
+struct bgpstream_record_pool {
+  /** One bucket per format type seen so far */
+  struct pool_bucket *buckets;
+
+  /** Protects the buckets (records are returned from the consumer thread, and
+      taken from the reader threads) */
+  pthread_mutex_t mutex;
+};
+
+static struct pool_bucket *get_bucket(bgpstream_record_pool_t *pool,
+                                      bgpstream_format_t *format, int create)
+{
+  struct pool_bucket *b;
+
+  for (b = pool->buckets; b != NULL; b = b->next) {
+    if (b->type == format->res->format_type) {
+      return b;
+    }
+  }
+  if (create == 0 || (b = malloc_zero(sizeof(struct pool_bucket))) == NULL) {
+    return NULL;
+  }
+
+  b->type = format->res->format_type;
+  // only the method pointers are useful
+  b->proto = *format;
+  b->proto.res = NULL;
+  b->proto.transport = NULL;
+  b->proto.filter_mgr = NULL;
+  b->proto.state = NULL;
+
+  b->next = pool->buckets;
+  pool->buckets = b;
+  return b;
+}
+
+bgpstream_record_pool_t *bgpstream_record_pool_create(void)
+{
+  bgpstream_record_pool_t *pool;
+
+  if ((pool = malloc_zero(sizeof(bgpstream_record_pool_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+
+  return pool;
+}
+
+void bgpstream_record_pool_destroy(bgpstream_record_pool_t *pool)
+{
+  struct pool_bucket *b;
+  int i;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  while ((b = pool->buckets) != NULL) {
+    pool->buckets = b->next;
+    for (i = 0; i < b->idle_cnt; i++) {
+      bgpstream_record_destroy(b->idle[i]);
+    }
+    free(b);
+  }
+
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool);
+}
+
+bgpstream_record_t *bgpstream_record_pool_get(bgpstream_record_pool_t *pool,
+                                              bgpstream_format_t *format)
+{
+  struct pool_bucket *b;
+  bgpstream_record_t *record = NULL;
+  bgpstream_record_internal_t *internal;
+
+  if (pool == NULL) {
+    return bgpstream_record_create(format);
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  if ((b = get_bucket(pool, format, 0)) != NULL && b->idle_cnt > 0) {
+    record = b->idle[--b->idle_cnt];
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (record == NULL) {
+    return bgpstream_record_create(format);
+  }
+
+  // make the record look freshly created, but keep the (already cleared)
+  // format data
+  internal = record->__int;
+  memset(record, 0, sizeof(bgpstream_record_t));
+  record->__int = internal;
+  internal->format = format;
+  record->project_name = "";
+  record->collector_name = "";
+  record->router_name = "";
+
+  return record;
+}
+
+void bgpstream_record_pool_put(bgpstream_record_pool_t *pool,
+                               bgpstream_record_t *record)
+{
+  struct pool_bucket *b;
+  bgpstream_format_t *format;
+
+  if (record == NULL) {
+    return;
+  }
+  format = record->__int->format;
+  if (pool == NULL || format == NULL) {
+    bgpstream_record_destroy(record);
+    return;
+  }
+
+  // clear the data while the format is still around
+  bgpstream_record_clear(record);
+
+  pthread_mutex_lock(&pool->mutex);
+  if ((b = get_bucket(pool, format, 1)) != NULL &&
+      b->idle_cnt < RECORD_POOL_MAX_IDLE) {
+    record->__int->format = &b->proto;
+    b->idle[b->idle_cnt++] = record;
+    record = NULL;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  // no room
+  bgpstream_record_destroy(record);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_RECORD_POOL_H
+#define __BGPSTREAM_RECORD_POOL_H
+
+#include "bgpstream_format.h"
+#include "bgpstream_record.h"
+
+/** Opaque structure representing a pool of records (along with their
+ * format-specific data) that can be recycled between readers */
+typedef struct bgpstream_record_pool bgpstream_record_pool_t;
+
+/** Create a new, empty record pool
+ *
+ * @return pointer to the created pool if successful, NULL otherwise
+ */
+bgpstream_record_pool_t *bgpstream_record_pool_create(void);
+
+/** Destroy the given pool, and all the records it holds
+ *
+ * @param pool          pointer to the pool to destroy
+ */
+void bgpstream_record_pool_destroy(bgpstream_record_pool_t *pool);
+
+/** Get a record for use with the given format
+ *
+ * @param pool          pointer to the pool (may be NULL)
+ * @param format        pointer to the format the record will be used with
+ * @return pointer to a record if successful, NULL otherwise
+ *
+ * If the pool has a record previously used with a format of the same type, it
+ * is reset and returned, otherwise a new record is created.
+ */
+bgpstream_record_t *bgpstream_record_pool_get(bgpstream_record_pool_t *pool,
+                                              bgpstream_format_t *format);
+
+/** Return a record to the pool
+ *
+ * @param pool          pointer to the pool (may be NULL)
+ * @param record        pointer to the record to return (may be NULL)
+ *
+ * This must be called before the format that the record was obtained for is
+ * destroyed. If the pool is NULL, or already full, the record is destroyed.
+ * This function is thread safe.
+ */
+void bgpstream_record_pool_put(bgpstream_record_pool_t *pool,
+                               bgpstream_record_t *record);
+
+#endif /* __BGPSTREAM_RECORD_POOL_H */
@@ -69,6 +69,7 @@ bgpstream_resource_t *bgpstream_resource_create(
   }
   res->initial_time = initial_time;
   res->duration = duration;
+  res->listed_time = epoch_sec();
   if ((res->project = strdup(project)) == NULL) {
     goto err;
   }
@@ -84,6 +85,31 @@ err:
   return NULL;
 }
 
+bgpstream_resource_t *bgpstream_resource_dup(bgpstream_resource_t *resource)
+{
+  bgpstream_resource_t *res;
+  int i;
+
+  if ((res = bgpstream_resource_create(
+         resource->transport_type, resource->format_type, resource->url,
+         resource->initial_time, resource->duration, resource->project,
+         resource->collector, resource->record_type)) == NULL) {
+    return NULL;
+  }
+  res->listed_time = resource->listed_time;
+  res->size = resource->size;
+
+  for (i = 0; i < _BGPSTREAM_RESOURCE_ATTR_CNT; i++) {
+    if (resource->attrs[i] != NULL &&
+        bgpstream_resource_set_attr(res, i, resource->attrs[i]->value) != 0) {
+      bgpstream_resource_destroy(res);
+      return NULL;
+    }
+  }
+
+  return res;
+}
+
 void bgpstream_resource_destroy(bgpstream_resource_t *resource)
 {
   int i;
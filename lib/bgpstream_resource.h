@@ -44,15 +44,15 @@ typedef enum {
   /** Data is served from a Kafka queue */
   BGPSTREAM_RESOURCE_TRANSPORT_KAFKA = 1,
 
-  /** Data is streamed via websockets */
-  //  BGPSTREAM_RESOURCE_TRANSPORT_WEBSOCKET = 2,
-
   /** Data is locally cached */
   BGPSTREAM_RESOURCE_TRANSPORT_CACHE = 2,
 
   /** Data is streamed via http */
   BGPSTREAM_RESOURCE_TRANSPORT_HTTP = 3,
 
+  /** Data is streamed via websockets (e.g., RIS Live) */
+  BGPSTREAM_RESOURCE_TRANSPORT_WEBSOCKET = 4,
+
 } bgpstream_resource_transport_type_t;
 
 /** Encapsulation/encoding formats supported */
@@ -87,6 +87,33 @@ typedef enum bgpstream_resource_attr_type {
   /** The path toward a local cache */
   BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH = 3,
 
+  /** The codec to store local cache files with ("gzip", "zstd", "lz4" or
+      "none"). If unset, defaults to gzip */
+  BGPSTREAM_RESOURCE_ATTR_CACHE_COMPRESSION = 4,
+
+  /** Whether to also cache the decoded records of dumps ("on" or "off"). If
+      unset, defaults to off */
+  BGPSTREAM_RESOURCE_ATTR_CACHE_DECODED = 5,
+
+  /** The maximum total size (in bytes) of the local cache, beyond which the
+      least recently used resources are evicted. If unset, the cache is not
+      limited */
+  BGPSTREAM_RESOURCE_ATTR_CACHE_MAX_SIZE = 6,
+
+  /** The maximum number of Kafka messages to consume at once. If unset,
+      defaults to BGPSTREAM_TRANSPORT_KAFKA_DEFAULT_BATCH_SIZE */
+  BGPSTREAM_RESOURCE_ATTR_KAFKA_BATCH_SIZE = 7,
+
+  /** The maximum number of bytes fetched from each partition per request
+      (rdkafka "fetch.message.max.bytes"). If unset, the rdkafka default is
+      used */
+  BGPSTREAM_RESOURCE_ATTR_KAFKA_FETCH_MAX_BYTES = 8,
+
+  /** The maximum size (in KiB) of the local queue of prefetched messages
+      (rdkafka "queued.max.messages.kbytes"). If unset, the rdkafka default is
+      used */
+  BGPSTREAM_RESOURCE_ATTR_KAFKA_QUEUE_MAX_KBYTES = 9,
+
   /** INTERNAL: The total number of attribute types in use */
   _BGPSTREAM_RESOURCE_ATTR_CNT,
 
@@ -122,6 +149,15 @@ typedef struct bgpstream_resource {
       continue to be polled even after EOS is returned. */
   uint32_t duration;
 
+  /** Wall-clock time when the data interface listed the resource (e.g., when
+      the broker returned it). Used to measure the live latency of records. */
+  uint32_t listed_time;
+
+  /** Size (in bytes) of the data offered by the resource, as reported by the
+      data interface. A value of 0 indicates that the size is unknown. Used to
+      open the largest resources of a batch first. */
+  uint64_t size;
+
   /** The name of the collection project */
   char *project;
 
@@ -148,6 +184,10 @@ bgpstream_resource_t *bgpstream_resource_create(
   uint32_t initial_time, uint32_t duration, const char *project,
   const char *collector, bgpstream_record_type_t record_type);
 
+/** Create a copy of the given resource metadata object (including its
+ * attributes) */
+bgpstream_resource_t *bgpstream_resource_dup(bgpstream_resource_t *resource);
+
 /** Destroy the given resource metadata object */
 void bgpstream_resource_destroy(bgpstream_resource_t *resource);
 
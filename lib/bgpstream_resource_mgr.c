@@ -25,23 +25,80 @@
  */
 
 #include "bgpstream_resource_mgr.h"
+#include "bgpstream_downloader.h"
 #include "bgpstream_filter.h"
 #include "bgpstream_log.h"
 #include "bgpstream_reader.h"
+#include "bgpstream_reader_pool.h"
+#include "bgpstream_record_pool.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_trace.h"
 #include "config.h"
+#include "khash.h"
 #include "utils.h"
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #define BUFFER_LEN 1024
 
+/** First line of a serialized checkpoint */
+#define CHECKPOINT_MAGIC "BGPSTREAM-CHECKPOINT 1"
+
 /** Approximately how frequently should stream resources that return AGAIN be
     polled? (in msec) */
 #define AGAIN_POLL_INTERVAL 500
-#define MSEC_TO_NSEC 1000000
+
+/** How long should stream resources that can notify us when data arrives be
+    left to sleep before they are polled anyway? (in msec) */
+#define AGAIN_IDLE_INTERVAL 10000
+
+/** Rough estimate of the memory used by an open reader (decode buffer,
+    decompression buffers and records), in bytes */
+#define READER_MEM_ESTIMATE (4 * 1024 * 1024)
+
+/** Rough estimate of the memory used by each background-decoded record, in
+    bytes */
+#define PREFETCH_MEM_ESTIMATE (16 * 1024)
+
+/** Rough estimate of the size of a RIB dump whose size is unknown, in bytes */
+#define RIB_SIZE_ESTIMATE (128 * 1024 * 1024)
+
+/** Rough estimate of the size of an hour of updates whose size is unknown, in
+    bytes */
+#define UPDATES_SIZE_ESTIMATE (16 * 1024 * 1024)
+
+/** Maximum number of levels in the group skip list. With a 1/4 promotion
+    probability this comfortably indexes millions of groups */
+#define GROUP_SKIP_LEVELS 12
+
+/** How long (in seconds) after the end of the newest resource pushed the
+    index of pushed resources still remembers an older resource. Data
+    interfaces that poll (e.g., the broker in live mode) only list resources
+    again within a much shorter window */
+#define PUSHED_HORIZON (2 * 86400)
+
+/** Minimum number of entries in the index of pushed resources before it is
+    pruned */
+#define PUSHED_PRUNE_MIN 4096
+
+/** How long (in seconds) after the nominal end of a resource it may still
+    contain records (the same slack that the data interfaces allow) */
+#define RESOURCE_TIME_SLACK 120
+
+/** Get/set the forward link of a group at the given skip list level (level 0
+    is the ordinary `next` pointer) */
+#define GROUP_LINK(gp, lvl) (*((lvl) == 0 ? &(gp)->next : &(gp)->skip[(lvl)-1]))
+#define QUEUE_LINK(q, pred, lvl)                                               \
+  (*((pred) == NULL ? ((lvl) == 0 ? &(q)->head : &(q)->skip_head[(lvl)-1])     \
+                    : &GROUP_LINK(pred, lvl)))
 
 struct res_list_elem {
   /** The resource info */
@@ -57,6 +114,21 @@ struct res_list_elem {
       immediately) */
   uint64_t next_poll;
 
+  /** The batch in which this resource last exported a record */
+  uint64_t batch_gen;
+
+  /** Time in ms after which we stop waiting for this resource to open (if 0
+      then wait for as long as it takes) */
+  uint64_t open_deadline;
+
+  /** Background download of this resource into the cache (NULL if none was
+      started) */
+  bgpstream_download_t *download;
+
+  /** Estimated size of the resource in bytes (0 until it has been estimated),
+      used to open the largest resources of a batch first */
+  uint64_t size;
+
   /** Previous list elem */
   struct res_list_elem *prev;
 
@@ -64,6 +136,35 @@ struct res_list_elem {
   struct res_list_elem *next;
 };
 
+/** Number of records at the checkpoint time read from one resource */
+struct ckpt_res {
+  /** The resource the records came from (NULL once it has reached EOS) */
+  struct res_list_elem *el;
+
+  /** The URL of the resource */
+  char *url;
+
+  /** Number of records with the checkpoint time */
+  uint32_t cnt;
+};
+
+/** Index of the resources pushed so far: key of the resource -> time its
+    data ends */
+KHASH_INIT(bsrm_pushed, uint64_t, uint32_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+
+/** A closed resource of the batch that is about to be opened */
+struct open_cand {
+  struct res_list_elem *el;
+
+  /** The group the resource belongs to */
+  struct res_group *gp;
+
+  /** Position of the resource in the queue (to keep the queue order among
+      resources of the same size) */
+  int idx;
+};
+
 struct res_group {
   /** The common "intial_time" of these resources */
   uint32_t time;
@@ -92,6 +193,12 @@ struct res_group {
 
   /** Next group (older timestamp) */
   struct res_group *next;
+
+  /** Number of skip list levels this group is linked into (>= 1) */
+  int levels;
+
+  /** Forward links for skip list levels 1 and up */
+  struct res_group *skip[GROUP_SKIP_LEVELS - 1];
 };
 
 struct bgpstream_resource_mgr {
@@ -102,6 +209,17 @@ struct bgpstream_resource_mgr {
 
   struct res_group *tail;
 
+  /** Skip list index over the groups (levels 1 and up, level 0 is `head`) so
+      that finding the position of a resource is O(log n) in the number of
+      groups rather than a linear walk */
+  struct res_group *skip_head[GROUP_SKIP_LEVELS - 1];
+
+  /** Number of levels currently in use by the skip list */
+  int skip_levels;
+
+  /** State for choosing skip list levels */
+  uint32_t skip_rand;
+
   // the number of resources in the queue
   int res_cnt;
 
@@ -113,6 +231,102 @@ struct bgpstream_resource_mgr {
 
   // borrowed pointer to a filter manager instance
   bgpstream_filter_mgr_t *filter_mgr;
+
+  // number of threads to use for opening resources (0 means one thread per
+  // resource)
+  int reader_threads;
+
+  // pool of threads shared by all readers (created when the first resource is
+  // opened)
+  bgpstream_reader_pool_t *reader_pool;
+
+  // number of records each reader should decode ahead in the background (0
+  // to decode on demand)
+  int prefetch_depth;
+
+  // records (and their format data) left over from closed readers, to be
+  // reused by new ones
+  bgpstream_record_pool_t *record_pool;
+
+  // approximate amount of memory (in bytes) that open readers may use (0 for
+  // no limit)
+  uint64_t mem_budget;
+
+  // set if the last open_batch left some overlapping resources closed because
+  // of the memory budget
+  int open_deferred;
+
+  // told about every new dump resource that is pushed
+  bgpstream_resource_mgr_push_cb_t *push_cb;
+  void *push_user;
+
+  // scratch space for ordering the resources of a batch before opening them
+  struct open_cand *open_cands;
+  int open_cands_alloc;
+
+  // how long (in msec) to wait for a resource to open before reading the others
+  // without it (0 to always wait)
+  uint64_t reorder_delay;
+
+  // number of groups past the current batch whose cached resources are
+  // downloaded in the background (0 to disable), and the maximum download
+  // rate in bytes per second (0 for no limit)
+  int download_ahead;
+  uint64_t download_rate;
+
+  // background downloader (created when the first download is started)
+  bgpstream_downloader_t *downloader;
+
+  // resources that took too long to open. they are put back in the queue once
+  // they have opened
+  struct res_list_elem *stragglers;
+
+  // the latest record time returned so far (used to flag late records)
+  uint32_t max_time;
+
+  // only keep resources that hash to this shard (out of shard_cnt, 0 for no
+  // sharding)
+  int shard_idx;
+  int shard_cnt;
+
+  // index of the (non-stream) resources that have been queued, so that a
+  // resource listed again by a later poll is not read twice. entries are
+  // pruned once the index reaches pushed_prune_at entries
+  khash_t(bsrm_pushed) * pushed;
+  uint32_t pushed_max_end;
+  khint_t pushed_prune_at;
+
+  // scratch space for waiting on stream resources that returned AGAIN
+  struct pollfd *pollfds;
+  int pollfds_alloc;
+
+  // set while a batch of records is being collected
+  int batching;
+
+  // the current batch (incremented each time a batch begins)
+  uint64_t batch_gen;
+
+  // records from the last batch that have been detached from their readers
+  bgpstream_record_t **held;
+  int held_cnt;
+  int held_alloc;
+
+  // resources that reached EOS during the last batch. their readers are kept
+  // until the held records (which use their formats) have been released
+  struct res_list_elem *retired;
+
+  // position of the consumer in the stream: the time of the last record
+  // returned, and how many records with that time came from each resource
+  uint32_t ckpt_time;
+  struct ckpt_res *ckpt_res;
+  int ckpt_res_cnt;
+  int ckpt_res_alloc;
+
+  // position to resume from (if resume_time is not 0). records before it are
+  // dropped, as are the given number of records at it from each resource
+  uint32_t resume_time;
+  struct ckpt_res *resume_res;
+  int resume_res_cnt;
 };
 
 static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp);
@@ -155,48 +369,275 @@ static struct res_list_elem *res_list_elem_create(bgpstream_resource_t *res)
   return el;
 }
 
-static int open_res_list(bgpstream_resource_mgr_t *q, struct res_group *gp,
-                         struct res_list_elem *el)
+// give back the records from the last batch, and close the readers they
+// belonged to if those have since reached EOS
+static void release_batch(bgpstream_resource_mgr_t *q)
 {
-  while (el != NULL) {
-    assert(el->res != NULL);
-    // it is possible that this is already open (because of re-sorting)
-    if (el->reader != NULL) {
-      el = el->next;
-      continue;
-    }
-    // open this resource
-    if ((el->reader = bgpstream_reader_create(el->res, q->filter_mgr)) ==
+  int i;
+
+  for (i = 0; i < q->held_cnt; i++) {
+    bgpstream_record_pool_put(q->record_pool, q->held[i]);
+    q->held[i] = NULL;
+  }
+  q->held_cnt = 0;
+
+  res_list_destroy(q->retired, 1);
+  q->retired = NULL;
+}
+
+// keep the record that the given resource exported earlier in this batch valid
+// while we read another one from it
+static int hold_exported(bgpstream_resource_mgr_t *q, struct res_list_elem *el)
+{
+  bgpstream_record_t **tmp;
+  int alloc;
+
+  if (q->held_cnt == q->held_alloc) {
+    alloc = (q->held_alloc == 0) ? 8 : q->held_alloc * 2;
+    if ((tmp = realloc(q->held, sizeof(bgpstream_record_t *) * alloc)) ==
         NULL) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to open resource: %s",
-                    el->res->url);
       return -1;
     }
-    // update stats
-    q->res_open_cnt++;
-    gp->res_open_cnt++;
-    el = el->next;
+    q->held = tmp;
+    q->held_alloc = alloc;
+  }
+
+  if ((q->held[q->held_cnt] = bgpstream_reader_detach_record(el->reader)) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not detach record from reader");
+    return -1;
+  }
+  q->held_cnt++;
+  return 0;
+}
+
+static void ckpt_res_clear(struct ckpt_res *cr, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    free(cr[i].url);
+    cr[i].url = NULL;
+  }
+}
+
+// count a record returned to the consumer for the checkpoint
+static int ckpt_update(bgpstream_resource_mgr_t *q, struct res_list_elem *el,
+                       bgpstream_record_t *record)
+{
+  struct ckpt_res *tmp;
+  int alloc;
+  int i;
+
+  if (record->time_sec != q->ckpt_time) {
+    ckpt_res_clear(q->ckpt_res, q->ckpt_res_cnt);
+    q->ckpt_res_cnt = 0;
+    q->ckpt_time = record->time_sec;
   }
 
+  // only a handful of resources will have records with the same time
+  for (i = 0; i < q->ckpt_res_cnt; i++) {
+    if (q->ckpt_res[i].el == el) {
+      q->ckpt_res[i].cnt++;
+      return 0;
+    }
+  }
+
+  if (q->ckpt_res_cnt == q->ckpt_res_alloc) {
+    alloc = (q->ckpt_res_alloc == 0) ? 8 : q->ckpt_res_alloc * 2;
+    if ((tmp = realloc(q->ckpt_res, sizeof(struct ckpt_res) * alloc)) ==
+        NULL) {
+      return -1;
+    }
+    q->ckpt_res = tmp;
+    q->ckpt_res_alloc = alloc;
+  }
+  if ((q->ckpt_res[i].url = strdup(el->res->url)) == NULL) {
+    return -1;
+  }
+  q->ckpt_res[i].el = el;
+  q->ckpt_res[i].cnt = 1;
+  q->ckpt_res_cnt++;
   return 0;
 }
 
-static int open_group(bgpstream_resource_mgr_t *q, struct res_group *gp)
+// the resource won't return any more records, so make sure that a new one that
+// happens to reuse its memory isn't counted with it
+static void ckpt_forget(bgpstream_resource_mgr_t *q, struct res_list_elem *el)
+{
+  int i;
+
+  for (i = 0; i < q->ckpt_res_cnt; i++) {
+    if (q->ckpt_res[i].el == el) {
+      q->ckpt_res[i].el = NULL;
+    }
+  }
+}
+
+// should this record be dropped because it was returned before the checkpoint
+// that we're resuming from was taken?
+static int resume_skip(bgpstream_resource_mgr_t *q, struct res_list_elem *el,
+                       bgpstream_record_t *record)
 {
-  // do nothing if everything is open
-  if (gp->res_open_cnt == gp->res_cnt) {
+  int i;
+
+  if (record->time_sec < q->resume_time) {
+    return 1;
+  }
+  if (record->time_sec > q->resume_time) {
+    // we're past the checkpoint, so stop checking
+    ckpt_res_clear(q->resume_res, q->resume_res_cnt);
+    free(q->resume_res);
+    q->resume_res = NULL;
+    q->resume_res_cnt = 0;
+    q->resume_time = 0;
     return 0;
   }
+  for (i = 0; i < q->resume_res_cnt; i++) {
+    if (q->resume_res[i].cnt > 0 &&
+        strcmp(q->resume_res[i].url, el->res->url) == 0) {
+      q->resume_res[i].cnt--;
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  // first open RIBs
-  if (open_res_list(q, gp, gp->res_list[BGPSTREAM_RIB]) != 0) {
+// append to a checkpoint buffer, snprintf-style
+static int ckpt_printf(char *buf, size_t len, size_t *written,
+                       const char *fmt, ...)
+{
+  va_list ap;
+  int rc;
+
+  va_start(ap, fmt);
+  rc = vsnprintf((*written < len) ? buf + *written : NULL,
+                 (*written < len) ? len - *written : 0, fmt, ap);
+  va_end(ap);
+  if (rc < 0) {
     return -1;
   }
+  *written += rc;
+  return 0;
+}
 
-  // then open updates
-  if (open_res_list(q, gp, gp->res_list[BGPSTREAM_UPDATE]) != 0) {
+// can another reader be opened without exceeding the memory budget?
+static int mem_budget_available(bgpstream_resource_mgr_t *q)
+{
+  uint64_t reader_mem =
+    READER_MEM_ESTIMATE + (uint64_t)q->prefetch_depth * PREFETCH_MEM_ESTIMATE;
+
+  return q->mem_budget == 0 ||
+         (uint64_t)(q->res_open_cnt + 1) * reader_mem <= q->mem_budget;
+}
+
+// open a single (closed) resource of the given group
+static int open_res(bgpstream_resource_mgr_t *q, struct res_group *gp,
+                    struct res_list_elem *el)
+{
+  assert(el->res != NULL && el->reader == NULL);
+
+  // don't race a download of this resource into the cache
+  if (el->download != NULL) {
+    bgpstream_downloader_finish(q->downloader, el->download);
+    el->download = NULL;
+  }
+  // start the opener pool if we haven't already
+  if (q->reader_pool == NULL && q->reader_threads > 0 &&
+      (q->reader_pool = bgpstream_reader_pool_create(
+         q->reader_threads, q->filter_mgr->worker_cpus)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create reader pool");
     return -1;
   }
+  // open this resource
+  if ((el->reader = bgpstream_reader_create(el->res, q->filter_mgr,
+                                            q->reader_pool, q->prefetch_depth,
+                                            q->record_pool)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to open resource: %s",
+                  el->res->url);
+    return -1;
+  }
+  if (q->reorder_delay != 0) {
+    el->open_deadline = epoch_msec() + q->reorder_delay;
+  }
+  // update stats
+  q->res_open_cnt++;
+  gp->res_open_cnt++;
+
+  return 0;
+}
+
+// estimate the size of a resource (i.e., how long it will take to read). the
+// data interface may have told us, local files can be checked, and otherwise
+// it is guessed from the type and duration of the dump.
+static uint64_t res_size(struct res_list_elem *el)
+{
+  bgpstream_resource_t *res = el->res;
+  struct stat st;
+
+  if (el->size != 0) {
+    return el->size;
+  }
+
+  if (res->size != 0) {
+    el->size = res->size;
+  } else if (res->transport_type == BGPSTREAM_RESOURCE_TRANSPORT_FILE &&
+             strstr(res->url, "://") == NULL && stat(res->url, &st) == 0 &&
+             st.st_size > 0) {
+    el->size = st.st_size;
+  } else if (res->record_type == BGPSTREAM_RIB) {
+    el->size = RIB_SIZE_ESTIMATE;
+  } else if (res->duration != BGPSTREAM_FOREVER) {
+    el->size = (uint64_t)UPDATES_SIZE_ESTIMATE * res->duration / 3600;
+  }
+
+  if (el->size == 0) {
+    el->size = 1;
+  }
+  return el->size;
+}
+
+// largest resources first, keeping the queue order among equals
+static int open_cand_cmp(const void *a, const void *b)
+{
+  const struct open_cand *ca = a, *cb = b;
+  uint64_t sa = res_size(ca->el), sb = res_size(cb->el);
+
+  if (sa != sb) {
+    return sa > sb ? -1 : 1;
+  }
+  return ca->idx - cb->idx;
+}
+
+// add the closed resources of a group to the list of resources to open
+static int add_open_cands(bgpstream_resource_mgr_t *q, struct res_group *gp,
+                          int *cnt)
+{
+  struct res_list_elem *el;
+  struct open_cand *tmp;
+  int type;
+
+  for (type = 0; type < _BGPSTREAM_RECORD_TYPE_CNT; type++) {
+    for (el = gp->res_list[type]; el != NULL; el = el->next) {
+      // it is possible that this is already open (because of re-sorting)
+      if (el->reader != NULL) {
+        continue;
+      }
+      if (*cnt == q->open_cands_alloc) {
+        if ((tmp = realloc(q->open_cands, sizeof(struct open_cand) *
+                                            (q->open_cands_alloc * 2 + 16))) ==
+            NULL) {
+          return -1;
+        }
+        q->open_cands = tmp;
+        q->open_cands_alloc = q->open_cands_alloc * 2 + 16;
+      }
+      q->open_cands[*cnt].el = el;
+      q->open_cands[*cnt].gp = gp;
+      q->open_cands[*cnt].idx = *cnt;
+      (*cnt)++;
+    }
+  }
 
   return 0;
 }
@@ -354,84 +795,116 @@ static void queue_dump(struct res_group *head)
 }
 #endif
 
-/** Insert a result into the queue from either end
- *
- * FROMEND = {head, tail};
- * TOEND = {tail, head};
- * CMP = {<, >};
- * TODIR = {next, prev};
- * FROMDIR = {prev, next};
- */
-#define QUEUE_PUSH(el, FROMEND, TOEND, CMPOP, TODIR, FROMDIR)                  \
-  do {                                                                         \
-    cur = q->FROMEND;                                                          \
-    last = NULL;                                                               \
-    while (cur != NULL && cur->time CMPOP get_next_time(el)) {                 \
-      last = cur;                                                              \
-      cur = cur->TODIR;                                                        \
-    }                                                                          \
-    if (cur != NULL && cur->time == get_next_time(el)) {                       \
-      /* just add to the current group */                                      \
-      if ((is_dirty = res_group_add(q, cur, el)) < 0) {                        \
-        goto err;                                                              \
-      }                                                                        \
-      dirty_cnt += is_dirty;                                                   \
-    } else {                                                                   \
-      /* we first need to create a new group */                                \
-      if ((gp = res_group_create(el)) == NULL) {                               \
-        goto err;                                                              \
-      }                                                                        \
-      gp->TODIR = cur;                                                         \
-      gp->FROMDIR = last;                                                      \
-      if (cur == NULL) {                                                       \
-        /* creating a new TOEND */                                             \
-        assert(last == q->TOEND);                                              \
-        last->TODIR = gp;                                                      \
-        q->TOEND = gp;                                                         \
-      } else if (last == NULL) {                                               \
-        /* creating a new FROMEND */                                           \
-        assert(q->FROMEND == cur);                                             \
-        cur->FROMDIR = gp;                                                     \
-        q->FROMEND = gp;                                                       \
-      } else {                                                                 \
-        /* splicing into the list */                                           \
-        cur->FROMDIR = gp;                                                     \
-        last->TODIR = gp;                                                      \
-      }                                                                        \
-    }                                                                          \
-  } while (0)
+// pick the number of levels for a new group (geometric with p = 1/4). this
+// uses a private xorshift generator so that the queue layout is deterministic.
+static int group_random_levels(bgpstream_resource_mgr_t *q)
+{
+  int levels = 1;
+  uint32_t r;
+
+  r = q->skip_rand;
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  q->skip_rand = r;
+
+  while (levels < GROUP_SKIP_LEVELS && (r & 0x3) == 0) {
+    levels++;
+    r >>= 2;
+  }
+  return levels;
+}
+
+// find the last group with a time less than `time` at every level of the skip
+// list (NULL means the head of that level). returns the first group with a
+// time >= `time` (or NULL).
+static struct res_group *group_find(bgpstream_resource_mgr_t *q, uint32_t time,
+                                    struct res_group **update)
+{
+  struct res_group *pred = NULL, *nxt = NULL;
+  int lvl;
+
+  for (lvl = q->skip_levels - 1; lvl >= 0; lvl--) {
+    while ((nxt = QUEUE_LINK(q, pred, lvl)) != NULL && nxt->time < time) {
+      pred = nxt;
+    }
+    update[lvl] = pred;
+  }
+  return QUEUE_LINK(q, pred, 0);
+}
+
+// link a new group into the queue just before `cur` (which was returned by
+// group_find along with `update`)
+static void group_link(bgpstream_resource_mgr_t *q, struct res_group *gp,
+                       struct res_group *cur, struct res_group **update)
+{
+  int lvl;
+
+  gp->levels = group_random_levels(q);
+  while (q->skip_levels < gp->levels) {
+    update[q->skip_levels++] = NULL;
+  }
+
+  for (lvl = 0; lvl < gp->levels; lvl++) {
+    GROUP_LINK(gp, lvl) = QUEUE_LINK(q, update[lvl], lvl);
+    QUEUE_LINK(q, update[lvl], lvl) = gp;
+  }
+
+  // maintain the back links and the tail
+  gp->prev = update[0];
+  if (cur != NULL) {
+    cur->prev = gp;
+  } else {
+    q->tail = gp;
+  }
+}
+
+// remove a group from the queue (does not destroy it)
+static void group_unlink(bgpstream_resource_mgr_t *q, struct res_group *gp)
+{
+  struct res_group *update[GROUP_SKIP_LEVELS];
+  struct res_group *nxt = gp->next;
+  int lvl;
+
+  group_find(q, gp->time, update);
+  for (lvl = 0; lvl < gp->levels; lvl++) {
+    assert(QUEUE_LINK(q, update[lvl], lvl) == gp);
+    QUEUE_LINK(q, update[lvl], lvl) = GROUP_LINK(gp, lvl);
+    GROUP_LINK(gp, lvl) = NULL;
+  }
+  while (q->skip_levels > 1 && q->skip_head[q->skip_levels - 2] == NULL) {
+    q->skip_levels--;
+  }
+
+  if (nxt != NULL) {
+    nxt->prev = gp->prev;
+  }
+  if (q->tail == gp) {
+    q->tail = gp->prev;
+  }
+  gp->prev = NULL;
+}
 
 static int insert_resource_elem(bgpstream_resource_mgr_t *q,
                                 struct res_list_elem *el)
 {
-  struct res_group *gp = NULL, *cur = NULL, *last = NULL;
-  int dirty_cnt = 0, is_dirty = 0;
-
-  // is the list empty?
-  if (q->head == NULL) {
-    assert(q->tail == NULL);
+  struct res_group *update[GROUP_SKIP_LEVELS];
+  struct res_group *gp = NULL, *cur = NULL;
+  uint32_t time = get_next_time(el);
+  int dirty_cnt = 0;
 
-    // create a new res group
-    if ((gp = res_group_create(el)) == NULL) {
-      return -1;
+  cur = group_find(q, time, update);
+  if (cur != NULL && cur->time == time) {
+    // just add to the current group
+    if ((dirty_cnt = res_group_add(q, cur, el)) < 0) {
+      goto err;
     }
-
-    // and make it the head/tail
-    q->head = q->tail = gp;
   } else {
-    // by here head AND tail are guaranteed to be set
-    assert(q->head != NULL && q->tail != NULL);
-
-    // which end of the list is this record closer to?
-    // can probably be optimized somewhat, lists are not my specialty...
-    if (abs((int)get_next_time(el) - (int)q->head->time) <
-        abs((int)get_next_time(el) - (int)q->tail->time)) {
-      // closer to the head of the list
-      QUEUE_PUSH(el, head, tail, <, next, prev);
-    } else {
-      // equidistant, or closer to the tail
-      QUEUE_PUSH(el, tail, head, >, prev, next);
+    // we first need to create a new group
+    if ((gp = res_group_create(el)) == NULL) {
+      goto err;
     }
+    group_link(q, gp, cur, update);
   }
 
   // count the resource
@@ -503,23 +976,8 @@ static void reap_groups(bgpstream_resource_mgr_t *q)
     nxt = gp->next;
 
     if (gp->res_cnt == 0) {
-      if (gp->next != NULL) {
-        gp->next->prev = gp->prev;
-      }
-      if (gp->prev != NULL) {
-        gp->prev->next = gp->next;
-      }
-
-      if (q->head == gp) {
-        q->head = gp->next;
-      }
-      if (q->tail == gp) {
-        q->tail = gp->prev;
-      }
-
+      group_unlink(q, gp);
       // and destroy the group
-      gp->prev = NULL;
-      gp->next = NULL;
       res_group_destroy(gp, 0);
     }
 
@@ -527,11 +985,57 @@ static void reap_groups(bgpstream_resource_mgr_t *q)
   }
 }
 
+// take a resource that is still opening out of the queue until it is ready
+static void set_aside(bgpstream_resource_mgr_t *q, struct res_group *gp,
+                      struct res_list_elem *el)
+{
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Not waiting for %s to open",
+                el->res->url);
+  pop_res_el(q, gp, el);
+  // it has a reader, but pop_res_el only counts checked resources as open
+  gp->res_open_cnt--;
+  q->res_open_cnt--;
+  el->next = q->stragglers;
+  q->stragglers = el;
+}
+
+// put resources that have finished opening back into the queue. if there is
+// nothing else to read, then wait for the first one
+static int check_stragglers(bgpstream_resource_mgr_t *q)
+{
+  struct res_list_elem **prev = &q->stragglers;
+  struct res_list_elem *el;
+  int rc;
+
+  while ((el = *prev) != NULL) {
+    rc = (q->res_cnt == 0 && el == q->stragglers)
+           ? bgpstream_reader_open_wait(el->reader)
+           : bgpstream_reader_open_timedwait(el->reader, 0);
+    if (rc < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to open resource: %s",
+                    el->res->url);
+      return -1;
+    }
+    if (rc > 0) {
+      prev = &el->next;
+      continue;
+    }
+    *prev = el->next;
+    el->next = NULL;
+    el->open = 1;
+    if (insert_resource_elem(q, el) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 static int sort_res_list(bgpstream_resource_mgr_t *q, struct res_group *gp,
                          struct res_list_elem *el)
 {
   struct res_list_elem *el_nxt;
   int dirty_cnt = 0;
+  int rc;
 
   while (el != NULL) {
     el_nxt = el->next;
@@ -540,9 +1044,20 @@ static int sort_res_list(bgpstream_resource_mgr_t *q, struct res_group *gp,
       continue;
     }
 
-    if (bgpstream_reader_open_wait(el->reader) != 0) {
+    if (el->open_deadline == 0) {
+      rc = bgpstream_reader_open_wait(el->reader);
+    } else {
+      rc = bgpstream_reader_open_timedwait(el->reader, el->open_deadline);
+    }
+    if (rc < 0) {
       return -1;
     }
+    if (rc > 0) {
+      // don't let this one hold everything else up
+      set_aside(q, gp, el);
+      el = el_nxt;
+      continue;
+    }
     el->open = 1;
     gp->res_open_checked_cnt++;
     if (get_next_time(el) != el->res->initial_time) {
@@ -612,24 +1127,71 @@ static int sort_batch(bgpstream_resource_mgr_t *q)
   return dirty_cnt_total;
 }
 
+// start downloading the cached resources of the groups that follow the batch
+// (beginning at `gp`), so that they are local by the time they are opened
+static void download_ahead(bgpstream_resource_mgr_t *q, struct res_group *gp)
+{
+  struct res_list_elem *el;
+  int i, type;
+
+  for (i = 0; gp != NULL && i < q->download_ahead; i++, gp = gp->next) {
+    for (type = 0; type < _BGPSTREAM_RECORD_TYPE_CNT; type++) {
+      for (el = gp->res_list[type]; el != NULL; el = el->next) {
+        if (el->reader != NULL || el->download != NULL ||
+            el->res->transport_type != BGPSTREAM_RESOURCE_TRANSPORT_CACHE) {
+          continue;
+        }
+        if (q->downloader == NULL &&
+            (q->downloader = bgpstream_downloader_create(
+               q->filter_mgr, q->download_rate)) == NULL) {
+          bgpstream_log(BGPSTREAM_LOG_WARN,
+                        "Could not start downloader, disabling download-ahead");
+          q->download_ahead = 0;
+          return;
+        }
+        // failing to download ahead is not fatal
+        el->download = bgpstream_downloader_submit(q->downloader, el->res);
+      }
+    }
+  }
+}
+
 // open all overlapping resources. does not modify the queue
+//
+// the first group is always opened in full since we can't read anything
+// without it, but the rest of the batch is only opened as far as the memory
+// budget allows. anything left over is opened later once earlier readers have
+// finished (or once it reaches the head of the queue).
+//
+// the batch can't be read faster than its slowest resource, so resources are
+// opened largest first (e.g., RIBs before the updates around them). that way
+// the large ones start downloading straight away, and the small ones fill in
+// the rest of the opener pool while they do.
 static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp)
 {
-  // start from the head of the queue and open resources until we
+  // start from the head of the queue and collect resources until we
   // find a group that does not overlap with the previous ones
   struct res_group *cur = gp;
+  struct res_group *deferred = NULL;
   int first = 1;
   uint32_t last_overlap_end = 0;
+  int cnt = 0, first_cnt = 0;
+  int i, j;
+
+  q->open_deferred = 0;
 
   while (cur != NULL && (first != 0 || last_overlap_end > cur->overlap_start)) {
     // this is included in the batch
-
-    if (open_group(q, cur) != 0) {
+    if (cur->res_open_cnt != cur->res_cnt &&
+        add_open_cands(q, cur, &cnt) != 0) {
       return -1;
     }
 
     // update our overlap calculation
     if (first != 0 || cur->overlap_end > last_overlap_end) {
+      if (first != 0) {
+        first_cnt = cnt;
+      }
       first = 0;
       last_overlap_end = cur->overlap_end;
     }
@@ -637,6 +1199,117 @@ static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp)
     cur = cur->next;
   }
 
+  // the first group is opened in full, so it goes first regardless of size
+  qsort(q->open_cands, first_cnt, sizeof(struct open_cand), open_cand_cmp);
+  qsort(q->open_cands + first_cnt, cnt - first_cnt, sizeof(struct open_cand),
+        open_cand_cmp);
+
+  for (i = 0; i < cnt; i++) {
+    if (i >= first_cnt && mem_budget_available(q) == 0) {
+      // out of budget. download ahead from the oldest group left closed
+      q->open_deferred = 1;
+      deferred = q->open_cands[i].gp;
+      for (j = i + 1; j < cnt; j++) {
+        if (q->open_cands[j].gp->time < deferred->time) {
+          deferred = q->open_cands[j].gp;
+        }
+      }
+      break;
+    }
+    if (open_res(q, q->open_cands[i].gp, q->open_cands[i].el) != 0) {
+      return -1;
+    }
+  }
+
+  if (q->download_ahead > 0) {
+    download_ahead(q, deferred != NULL ? deferred : cur);
+  }
+
+  return 0;
+}
+
+// move the given list elem to the front of its list
+static void move_to_front(struct res_list_elem **list,
+                          struct res_list_elem *el)
+{
+  if (el->prev == NULL) {
+    assert(*list == el);
+    return;
+  }
+  el->prev->next = el->next;
+  if (el->next != NULL) {
+    el->next->prev = el->prev;
+  }
+  el->prev = NULL;
+  el->next = *list;
+  (*list)->prev = el;
+  *list = el;
+}
+
+// sleep until one of the resources in the given list that returned AGAIN has
+// data ready, or its poll timer has expired, and move that resource to the
+// front of the list. resources whose transport can't tell us when data arrives
+// are simply woken when their timer expires.
+static int wait_for_data(bgpstream_resource_mgr_t *q,
+                         struct res_list_elem **list)
+{
+  struct res_list_elem *el;
+  struct pollfd *tmp;
+  uint64_t now = epoch_msec();
+  uint64_t deadline = UINT64_MAX;
+  int cnt = 0;
+  int i;
+
+  // is anybody ready already?
+  for (el = *list; el != NULL; el = el->next) {
+    if (el->next_poll <= now) {
+      el->next_poll = 0;
+      move_to_front(list, el);
+      return 0;
+    }
+    if (el->next_poll < deadline) {
+      deadline = el->next_poll;
+    }
+    cnt++;
+  }
+
+  if (cnt > q->pollfds_alloc) {
+    if ((tmp = realloc(q->pollfds, sizeof(struct pollfd) * cnt)) == NULL) {
+      return -1;
+    }
+    q->pollfds = tmp;
+    q->pollfds_alloc = cnt;
+  }
+  // poll ignores negative fds, so resources without one just add nothing
+  for (el = *list, i = 0; el != NULL; el = el->next, i++) {
+    q->pollfds[i].fd = bgpstream_reader_get_fd(el->reader);
+    q->pollfds[i].events = POLLIN;
+    q->pollfds[i].revents = 0;
+  }
+
+  if (poll(q->pollfds, cnt, deadline - now) < 0) {
+    if (errno != EINTR) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to wait for stream resources");
+    }
+    // interrupted
+    return -1;
+  }
+
+  // anybody whose data arrived or whose timer expired can be read now
+  now = epoch_msec();
+  for (el = *list, i = 0; el != NULL; el = el->next, i++) {
+    if (q->pollfds[i].revents != 0 || el->next_poll <= now) {
+      el->next_poll = 0;
+    }
+  }
+  for (el = *list; el != NULL; el = el->next) {
+    if (el->next_poll == 0) {
+      move_to_front(list, el);
+      return 0;
+    }
+  }
+  // woken early for no reason, just try the head again
+  (*list)->next_poll = 0;
   return 0;
 }
 
@@ -651,37 +1324,36 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   bgpstream_reader_status_t rs;
   struct res_list_elem *el = NULL;
   struct res_group *gp = NULL;
-  uint64_t now;
-  uint64_t sleep_nsec;
-  struct timespec rqtp;
+  struct res_list_elem **list;
 
   // the resource we want to read from MUST be in the first group (q->head), and
   // will either be the head of the RIBS list if there are any ribs, otherwise
   // it will be the head of the updates list
   if (q->head->res_list[BGPSTREAM_RIB] != NULL) {
-    el = q->head->res_list[BGPSTREAM_RIB];
+    list = &q->head->res_list[BGPSTREAM_RIB];
   } else {
-    el = q->head->res_list[BGPSTREAM_UPDATE];
+    list = &q->head->res_list[BGPSTREAM_UPDATE];
+  }
+
+  // we assume that if this resource has a poll timer set that has not expired
+  // then since it would have been pushed to the end of the group and as such
+  // all other resources already polled. so wait until one of them has
+  // something for us (which may bring it to the front)
+  if ((*list)->next_poll > 0 && wait_for_data(q, list) != 0) {
+    return -1;
   }
+
+  el = *list;
   assert(el != NULL && el->res != NULL);
   assert(el->prev == NULL);
   assert(el->open != 0);
+  assert(el->next_poll == 0);
 
-  // we assume that if this resource has a poll timer set that has not expired
-  // then since it would have been pushed to the end of the group and as such
-  // all other resources already polled.
-  if (el->next_poll > 0) {
-    now = epoch_msec();
-    if (el->next_poll > now) {
-      sleep_nsec = (el->next_poll - now) * MSEC_TO_NSEC;
-      rqtp.tv_sec = sleep_nsec / 1000000000;
-      rqtp.tv_nsec = sleep_nsec % 1000000000;
-      if (nanosleep(&rqtp, NULL) != 0) {
-        // interrupted
-        return -1;
-      }
-    }
-    el->next_poll = 0;
+  // if we already returned a record from this resource in the current batch,
+  // then the reader must not reuse it
+  if (q->batching != 0 && el->batch_gen == q->batch_gen &&
+      hold_exported(q, el) != 0) {
+    return BGPSTREAM_READER_STATUS_ERROR;
   }
 
   // cache the current time so we can check if we need to remove and re-insert
@@ -724,7 +1396,11 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
     }
     // and then tell the caller that while we didn't get anything useful, they
     // should try again soon
-    el->next_poll = epoch_msec() + AGAIN_POLL_INTERVAL;
+    // if the transport can wake us up when data arrives then we only need to
+    // check on it occasionally
+    el->next_poll = epoch_msec() + (bgpstream_reader_get_fd(el->reader) >= 0
+                                      ? AGAIN_IDLE_INTERVAL
+                                      : AGAIN_POLL_INTERVAL);
     assert(q->head->res_list[el->res->record_type]->prev == NULL);
     return rs;
   }
@@ -732,6 +1408,10 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   // otherwise we must valid, or EOS
   assert(rs == BGPSTREAM_READER_STATUS_EOS || rs == BGPSTREAM_READER_STATUS_OK);
 
+  if (rs == BGPSTREAM_READER_STATUS_EOS) {
+    ckpt_forget(q, el);
+  }
+
   // if the time has changed or we've reached EOS, pop from the queue
   if (get_next_time(el) != prev_time || rs == BGPSTREAM_READER_STATUS_EOS) {
     // first, remove this list elem from the group
@@ -740,30 +1420,47 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
     // if we have emptied the group, remove the group
     if (q->head->res_cnt == 0) {
       gp = q->head;
-      q->head = gp->next;
-      if (q->head != NULL) {
-        q->head->prev = NULL;
-      }
-      if (q->tail == gp) {
-        q->tail = q->head;
-      }
+      group_unlink(q, gp);
 
       // and then destroy the group
-      gp->next = NULL;
       res_group_destroy(gp, 0);
     }
 
-    if (rs == BGPSTREAM_READER_STATUS_EOS) {
+    if (rs == BGPSTREAM_READER_STATUS_EOS && q->batching != 0) {
+      // we're at EOS, but records from this batch may still need the reader
+      el->next = q->retired;
+      q->retired = el;
+    } else if (rs == BGPSTREAM_READER_STATUS_EOS) {
       // we're at EOS, so destroy the resource
       res_list_destroy(el, 1);
     } else if (get_next_time(el) != prev_time) {
       // time has changed, so we need to re-insert
+      BGPSTREAM_TRACE3(resource__reinsert, el->res->url, prev_time,
+                       get_next_time(el));
       if (insert_resource_elem(q, el) < 0) {
         return -1;
       }
     }
   }
 
+  if (rs == BGPSTREAM_READER_STATUS_OK) {
+    if (q->resume_time != 0 && resume_skip(q, el, *record) != 0) {
+      // the consumer saw this one before the checkpoint, so tell the caller
+      // to look for another record, just as if this resource had finished
+      return BGPSTREAM_READER_STATUS_EOS;
+    }
+    el->batch_gen = q->batch_gen;
+    // with a reorder delay, resources that opened late can fall behind
+    (*record)->late =
+      (q->reorder_delay != 0 && (*record)->time_sec < q->max_time);
+    if ((*record)->time_sec > q->max_time) {
+      q->max_time = (*record)->time_sec;
+    }
+    if (ckpt_update(q, el, *record) != 0) {
+      return BGPSTREAM_READER_STATUS_ERROR;
+    }
+  }
+
   // all is well
   return rs;
 }
@@ -802,6 +1499,31 @@ static int wanted_resource(bgpstream_resource_t *res,
   return 1;
 }
 
+// assign the resource to a shard using only what every process will see the
+// same way (i.e. not the URL, which may point at a mirror or a local cache)
+static int shard_of(bgpstream_resource_t *res, int shard_cnt)
+{
+  const char *strs[] = {res->project, res->collector};
+  uint32_t vals[] = {res->record_type, res->initial_time};
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  const unsigned char *p;
+  unsigned i, j;
+
+  for (i = 0; i < ARR_CNT(strs); i++) {
+    for (p = (const unsigned char *)strs[i]; *p != '\0'; p++) {
+      h = (h ^ *p) * 1099511628211ULL;
+    }
+    h = (h ^ '.') * 1099511628211ULL;
+  }
+  for (i = 0; i < ARR_CNT(vals); i++) {
+    for (j = 0; j < 4; j++) {
+      h = (h ^ ((vals[i] >> (j * 8)) & 0xff)) * 1099511628211ULL;
+    }
+  }
+
+  return h % shard_cnt;
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 bgpstream_resource_mgr_t *
@@ -814,6 +1536,14 @@ bgpstream_resource_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
   }
 
   q->filter_mgr = filter_mgr;
+  q->skip_levels = 1;
+  q->skip_rand = 0x9e3779b9;
+  q->reader_threads = bgpstream_reader_pool_default_threads();
+
+  if ((q->record_pool = bgpstream_record_pool_create()) == NULL) {
+    free(q);
+    return NULL;
+  }
 
   return q;
 }
@@ -825,6 +1555,10 @@ void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
   }
   struct res_group *cur = q->head;
 
+  // this also frees the download handles of the resources below
+  bgpstream_downloader_destroy(q->downloader);
+  q->downloader = NULL;
+
   while (cur != NULL) {
     q->head = cur->next;
     res_group_destroy(cur, 1);
@@ -832,12 +1566,168 @@ void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
   }
   q->tail = NULL;
 
+  res_list_destroy(q->stragglers, 1);
+  q->stragglers = NULL;
+
+  release_batch(q);
+  free(q->held);
+  q->held = NULL;
+
+  ckpt_res_clear(q->ckpt_res, q->ckpt_res_cnt);
+  free(q->ckpt_res);
+  q->ckpt_res = NULL;
+  ckpt_res_clear(q->resume_res, q->resume_res_cnt);
+  free(q->resume_res);
+  q->resume_res = NULL;
+
+  // all readers are gone, so nobody is using the pool anymore
+  bgpstream_reader_pool_destroy(q->reader_pool);
+  q->reader_pool = NULL;
+
+  free(q->pollfds);
+  q->pollfds = NULL;
+
+  free(q->open_cands);
+  q->open_cands = NULL;
+
+  if (q->pushed != NULL) {
+    kh_destroy(bsrm_pushed, q->pushed);
+    q->pushed = NULL;
+  }
+
+  // readers have returned their records
+  bgpstream_record_pool_destroy(q->record_pool);
+  q->record_pool = NULL;
+
   // filter manager is a borrowed pointer
   q->filter_mgr = NULL;
 
   free(q);
 }
 
+int bgpstream_resource_mgr_set_reader_threads(bgpstream_resource_mgr_t *q,
+                                              int threads)
+{
+  if (threads < 0 || q->reader_pool != NULL) {
+    return -1;
+  }
+  q->reader_threads = threads;
+  return 0;
+}
+
+int bgpstream_resource_mgr_set_prefetch_depth(bgpstream_resource_mgr_t *q,
+                                              int depth)
+{
+  if (depth < 0) {
+    return -1;
+  }
+  q->prefetch_depth = depth;
+  return 0;
+}
+
+int bgpstream_resource_mgr_set_download_ahead(bgpstream_resource_mgr_t *q,
+                                              int depth, uint64_t max_rate)
+{
+  if (depth < 0 || q->downloader != NULL) {
+    return -1;
+  }
+  q->download_ahead = depth;
+  q->download_rate = max_rate;
+  return 0;
+}
+
+void bgpstream_resource_mgr_set_memory_budget(bgpstream_resource_mgr_t *q,
+                                              uint64_t bytes)
+{
+  q->mem_budget = bytes;
+}
+
+void bgpstream_resource_mgr_set_reorder_delay(bgpstream_resource_mgr_t *q,
+                                              uint32_t msec)
+{
+  q->reorder_delay = msec;
+}
+
+int bgpstream_resource_mgr_set_shard(bgpstream_resource_mgr_t *q, int index,
+                                     int count)
+{
+  if (count < 0 || (count > 0 && (index < 0 || index >= count))) {
+    return -1;
+  }
+  q->shard_idx = index;
+  q->shard_cnt = count;
+  return 0;
+}
+
+// key of a resource in the index of pushed resources. the same file may be
+// pushed again with a new initial time once it has new data (e.g., by the
+// singlefile interface), so the time is part of the key
+static uint64_t pushed_key(const char *url, uint32_t initial_time,
+                           uint32_t duration,
+                           bgpstream_record_type_t record_type)
+{
+  uint32_t vals[] = {record_type, initial_time, duration};
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  const unsigned char *p;
+  unsigned i, j;
+
+  for (p = (const unsigned char *)url; *p != '\0'; p++) {
+    h = (h ^ *p) * 1099511628211ULL;
+  }
+  for (i = 0; i < ARR_CNT(vals); i++) {
+    for (j = 0; j < 4; j++) {
+      h = (h ^ ((vals[i] >> (j * 8)) & 0xff)) * 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+// forget the resources that ended long before the newest one
+static void pushed_prune(bgpstream_resource_mgr_t *q)
+{
+  khiter_t k;
+
+  if (q->pushed_max_end > PUSHED_HORIZON) {
+    for (k = kh_begin(q->pushed); k != kh_end(q->pushed); k++) {
+      if (kh_exist(q->pushed, k) &&
+          kh_val(q->pushed, k) < q->pushed_max_end - PUSHED_HORIZON) {
+        kh_del(bsrm_pushed, q->pushed, k);
+      }
+    }
+  }
+  q->pushed_prune_at = kh_size(q->pushed) * 2;
+  if (q->pushed_prune_at < PUSHED_PRUNE_MIN) {
+    q->pushed_prune_at = PUSHED_PRUNE_MIN;
+  }
+}
+
+// add a queued resource to the index. this is only an optimization, so
+// running out of memory here is not an error
+static void pushed_add(bgpstream_resource_mgr_t *q, uint64_t key,
+                       bgpstream_resource_t *res)
+{
+  uint32_t end = res->initial_time + res->duration;
+  khiter_t k;
+  int khret;
+
+  if (q->pushed == NULL) {
+    if ((q->pushed = kh_init(bsrm_pushed)) == NULL) {
+      return;
+    }
+    q->pushed_prune_at = PUSHED_PRUNE_MIN;
+  }
+  if (end > q->pushed_max_end) {
+    q->pushed_max_end = end;
+  }
+  if (kh_size(q->pushed) >= q->pushed_prune_at) {
+    pushed_prune(q);
+  }
+  k = kh_put(bsrm_pushed, q->pushed, key, &khret);
+  if (khret >= 0) {
+    kh_val(q->pushed, k) = end;
+  }
+}
+
 int bgpstream_resource_mgr_push(
   bgpstream_resource_mgr_t *q,
   bgpstream_resource_transport_type_t transport_type,
@@ -848,10 +1738,24 @@ int bgpstream_resource_mgr_push(
 {
   bgpstream_resource_t *res = NULL;
   struct res_list_elem *el = NULL;
+  uint64_t key = 0;
   if (resp != NULL) {
     *resp = NULL;
   }
 
+  // drop resources that have already been queued (streams are identified by
+  // attributes that are only set after the push, so they are not checked)
+  if (duration != BGPSTREAM_FOREVER) {
+    key = pushed_key(url, initial_time, duration, record_type);
+    if (q->pushed != NULL &&
+        kh_get(bsrm_pushed, q->pushed, key) != kh_end(q->pushed)) {
+      bgpstream_log(BGPSTREAM_LOG_FINE, "Dropping duplicate resource %s",
+                    url);
+      bgpstream_stats_add(BGPSTREAM_STAT_RESOURCES_DUPLICATE, 1);
+      return 0;
+    }
+  }
+
   // first create the resource
   if ((res = bgpstream_resource_create(transport_type, format_type, url,
                                        initial_time, duration, project,
@@ -859,6 +1763,20 @@ int bgpstream_resource_mgr_push(
     return -1;
   }
 
+  if (q->push_cb != NULL && res->duration != BGPSTREAM_FOREVER) {
+    q->push_cb(res, q->push_user);
+  }
+
+  // with several time intervals, the data interface may only have been able
+  // to select the resources that overlap the interval covering them all
+  if (res->duration != BGPSTREAM_FOREVER &&
+      bgpstream_filter_mgr_time_overlaps(
+        q->filter_mgr, res->initial_time,
+        res->initial_time + res->duration + RESOURCE_TIME_SLACK) == 0) {
+    bgpstream_resource_destroy(res);
+    return 0;
+  }
+
   // before we insert, lets check if it matches our RIB period filter (if we
   // have one)
   if (wanted_resource(res, q->filter_mgr) == 0) {
@@ -866,6 +1784,20 @@ int bgpstream_resource_mgr_push(
     return 0;
   }
 
+  // the RIB period check above must see every resource so that all shards
+  // agree on which RIBs are wanted
+  if (q->shard_cnt > 1 && shard_of(res, q->shard_cnt) != q->shard_idx) {
+    bgpstream_resource_destroy(res);
+    return 0;
+  }
+
+  // nothing in this resource is after the checkpoint we're resuming from
+  if (q->resume_time != 0 && res->duration != BGPSTREAM_FOREVER &&
+      res->initial_time + res->duration < q->resume_time) {
+    bgpstream_resource_destroy(res);
+    return 0;
+  }
+
   // now create a list element to hold the resource
   if ((el = res_list_elem_create(res)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create list element");
@@ -877,6 +1809,9 @@ int bgpstream_resource_mgr_push(
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not insert resource into queue");
     goto err;
   }
+  if (res->duration != BGPSTREAM_FOREVER) {
+    pushed_add(q, key, res);
+  }
 
   if (resp != NULL) {
     *resp = res;
@@ -889,9 +1824,47 @@ err:
   return -1;
 }
 
+void bgpstream_resource_mgr_set_push_cb(bgpstream_resource_mgr_t *q,
+                                        bgpstream_resource_mgr_push_cb_t *cb,
+                                        void *user)
+{
+  q->push_cb = cb;
+  q->push_user = user;
+}
+
+int bgpstream_resource_mgr_drain(bgpstream_resource_mgr_t *q,
+                                 bgpstream_resource_mgr_drain_cb_t *cb,
+                                 void *user)
+{
+  struct res_group *gp;
+  struct res_list_elem *el;
+  int cnt = 0, err = 0;
+  int i;
+
+  assert(q->res_open_cnt == 0 && q->stragglers == NULL);
+
+  while ((gp = q->head) != NULL) {
+    group_unlink(q, gp);
+    for (i = 0; i < _BGPSTREAM_RECORD_TYPE_CNT; i++) {
+      for (el = gp->res_list[i]; el != NULL; el = el->next) {
+        if (err == 0 && cb(el->res, user) != 0) {
+          err = 1;
+        }
+        cnt++;
+      }
+    }
+    q->res_cnt -= gp->res_cnt;
+    res_group_destroy(gp, 1);
+  }
+  assert(q->res_cnt == 0);
+  q->res_stream_cnt = 0;
+
+  return err != 0 ? -1 : cnt;
+}
+
 int bgpstream_resource_mgr_empty(bgpstream_resource_mgr_t *q)
 {
-  return (q->head == NULL);
+  return (q->head == NULL && q->stragglers == NULL);
 }
 
 int bgpstream_resource_mgr_stream_only(bgpstream_resource_mgr_t *q)
@@ -899,26 +1872,43 @@ int bgpstream_resource_mgr_stream_only(bgpstream_resource_mgr_t *q)
   return (q->res_stream_cnt == q->res_cnt);
 }
 
-int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
-                                      bgpstream_record_t **record)
+static int get_record(bgpstream_resource_mgr_t *q, bgpstream_record_t **record,
+                      int nowait)
 {
+  struct res_list_elem *el;
   int rs = BGPSTREAM_READER_STATUS_EOS;
   int dirty_cnt = 0;
 
   // don't let EOF mean EOS until we have no more resources left
   while (rs == BGPSTREAM_READER_STATUS_EOS ||
          rs == BGPSTREAM_READER_STATUS_AGAIN) {
+    if (q->stragglers != NULL && (nowait == 0 || q->res_cnt != 0) &&
+        check_stragglers(q) != 0) {
+      goto err;
+    }
     if (q->res_cnt == 0) {
       // we have nothing in the queue, so now we can return EOS
       return 0;
     }
 
+    // opening resources or waiting for stream data could block
+    if (nowait != 0 &&
+        (rs == BGPSTREAM_READER_STATUS_AGAIN ||
+         q->head->res_open_cnt != q->head->res_cnt ||
+         (q->open_deferred != 0 && mem_budget_available(q) != 0))) {
+      return 0;
+    }
+
     // we know we have something in the queue, but if we have nothing open, then
     // it is time to open some resources!
     // we do this inside a loop since in some cases the first batch we open get
     // sorted elsewhere in the queue, leaving the head still unopened.
+    // if some of the batch was left closed because of the memory budget, then
+    // also open more of it if earlier readers have freed up enough space.
     dirty_cnt = 0;
-    while (q->head->res_open_cnt != q->head->res_cnt || dirty_cnt > 0) {
+    while (q->head != NULL &&
+           (q->head->res_open_cnt != q->head->res_cnt || dirty_cnt > 0 ||
+            (q->open_deferred != 0 && mem_budget_available(q) != 0))) {
       if (open_batch(q, q->head) != 0) {
         goto err;
       }
@@ -930,11 +1920,25 @@ int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
         goto err;
       }
     }
+    if (q->head == NULL) {
+      // everything we opened was too slow and has been set aside
+      continue;
+    }
     // its possible that we failed to open all the files, perhaps in that case
     // we shouldn't abort, but instead return EOS and let the caller decide what
     // to do, but for now:
     assert(q->res_open_cnt != 0);
 
+    // the resource we would read from is waiting for stream data
+    if (nowait != 0) {
+      el = (q->head->res_list[BGPSTREAM_RIB] != NULL)
+             ? q->head->res_list[BGPSTREAM_RIB]
+             : q->head->res_list[BGPSTREAM_UPDATE];
+      if (el->next_poll > epoch_msec()) {
+        return 0;
+      }
+    }
+
     // we now know that we have open resources to read from, lets do it
     if ((rs = pop_record(q, record)) == BGPSTREAM_READER_STATUS_ERROR) {
       return -1;
@@ -948,3 +1952,165 @@ int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
 err:
   return -1;
 }
+
+int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
+                                      bgpstream_record_t **record)
+{
+  // records from an earlier batch are only valid until the next read
+  if (q->batching == 0 && (q->held_cnt != 0 || q->retired != NULL)) {
+    release_batch(q);
+  }
+  return get_record(q, record, 0);
+}
+
+int bgpstream_resource_mgr_get_checkpoint(bgpstream_resource_mgr_t *q,
+                                          char *buf, size_t len)
+{
+  collector_ts_t *ts = q->filter_mgr->last_processed_ts;
+  size_t written = 0;
+  khiter_t k;
+  int i;
+
+  if (ckpt_printf(buf, len, &written, CHECKPOINT_MAGIC "\n") != 0 ||
+      ckpt_printf(buf, len, &written, "time %" PRIu32 "\n", q->ckpt_time) !=
+        0) {
+    return -1;
+  }
+  for (i = 0; i < q->ckpt_res_cnt; i++) {
+    if (ckpt_printf(buf, len, &written, "res %" PRIu32 " %s\n",
+                    q->ckpt_res[i].cnt, q->ckpt_res[i].url) != 0) {
+      return -1;
+    }
+  }
+  // so that the RIB period filter picks up where it left off
+  if (ts != NULL) {
+    for (k = kh_begin(ts); k != kh_end(ts); ++k) {
+      if (kh_exist(ts, k) &&
+          ckpt_printf(buf, len, &written, "rib %" PRIu32 " %s\n",
+                      kh_value(ts, k), kh_key(ts, k)) != 0) {
+        return -1;
+      }
+    }
+  }
+
+  return written;
+}
+
+int bgpstream_resource_mgr_set_checkpoint(bgpstream_resource_mgr_t *q,
+                                          const char *checkpoint)
+{
+  collector_ts_t *ts = q->filter_mgr->last_processed_ts;
+  struct ckpt_res *tmp;
+  char *copy = NULL;
+  char *line, *name, *endp, *saveptr = NULL;
+  unsigned long val;
+  uint32_t resume_time = 0;
+  khiter_t k;
+  int khret;
+
+  if ((copy = strdup(checkpoint)) == NULL) {
+    return -1;
+  }
+  if ((line = strtok_r(copy, "\n", &saveptr)) == NULL ||
+      strcmp(line, CHECKPOINT_MAGIC) != 0) {
+    goto corrupt;
+  }
+
+  // each line is "<key> <number>[ <name>]"
+  while ((line = strtok_r(NULL, "\n", &saveptr)) != NULL) {
+    if ((name = strchr(line, ' ')) == NULL) {
+      goto corrupt;
+    }
+    *(name++) = '\0';
+    val = strtoul(name, &endp, 10);
+    if (endp == name || val > UINT32_MAX) {
+      goto corrupt;
+    }
+
+    if (strcmp(line, "time") == 0) {
+      if (*endp != '\0') {
+        goto corrupt;
+      }
+      resume_time = val;
+      continue;
+    }
+
+    if (*endp != ' ' || *(endp + 1) == '\0') {
+      goto corrupt;
+    }
+    name = endp + 1;
+
+    if (strcmp(line, "res") == 0) {
+      if ((tmp = realloc(q->resume_res, sizeof(struct ckpt_res) *
+                                          (q->resume_res_cnt + 1))) == NULL) {
+        goto err;
+      }
+      q->resume_res = tmp;
+      tmp = &q->resume_res[q->resume_res_cnt];
+      if ((tmp->url = strdup(name)) == NULL) {
+        goto err;
+      }
+      tmp->el = NULL;
+      tmp->cnt = val;
+      q->resume_res_cnt++;
+    } else if (strcmp(line, "rib") == 0) {
+      if (ts == NULL) {
+        // no RIB period filter, so nothing to restore
+        continue;
+      }
+      if ((k = kh_get(collector_ts, ts, name)) == kh_end(ts)) {
+        if ((name = strdup(name)) == NULL) {
+          goto err;
+        }
+        k = kh_put(collector_ts, ts, name, &khret);
+      }
+      kh_value(ts, k) = val;
+    } else {
+      goto corrupt;
+    }
+  }
+  free(copy);
+
+  q->resume_time = resume_time;
+  // let the data interface, the record filters and the MRT time index skip
+  // everything before the checkpoint
+  bgpstream_filter_mgr_time_clip(q->filter_mgr, resume_time);
+  return 0;
+
+corrupt:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupt checkpoint");
+err:
+  free(copy);
+  ckpt_res_clear(q->resume_res, q->resume_res_cnt);
+  q->resume_res_cnt = 0;
+  return -1;
+}
+
+void bgpstream_resource_mgr_begin_batch(bgpstream_resource_mgr_t *q)
+{
+  release_batch(q);
+  q->batch_gen++;
+  q->batching = 1;
+}
+
+int bgpstream_resource_mgr_get_records(bgpstream_resource_mgr_t *q,
+                                       bgpstream_record_t **records, int max)
+{
+  int cnt = 0;
+  int rc = 0;
+
+  assert(q->batching != 0);
+
+  while (cnt < max && (rc = get_record(q, &records[cnt], 1)) > 0) {
+    cnt++;
+  }
+  if (rc < 0) {
+    return -1;
+  }
+  return cnt;
+}
+
+void bgpstream_resource_mgr_end_batch(bgpstream_resource_mgr_t *q)
+{
+  q->batching = 0;
+}
@@ -44,6 +44,91 @@ bgpstream_resource_mgr_create(bgpstream_filter_mgr_t *filter_mgr);
 /** Destroy the given resource queue */
 void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q);
 
+/** Set the number of threads used to open resources
+ *
+ * @param q             pointer to the queue
+ * @param threads       number of threads to share between all resources, or 0
+ *                      to use a dedicated thread for each resource
+ * @return 0 if the value was set successfully, -1 otherwise
+ *
+ * This must be called before any resources have been opened.
+ */
+int bgpstream_resource_mgr_set_reader_threads(bgpstream_resource_mgr_t *q,
+                                              int threads);
+
+/** Set the number of records that each reader decodes in the background
+ *
+ * @param q             pointer to the queue
+ * @param depth         number of records to decode ahead of the consumer, or 0
+ *                      to decode records on demand
+ * @return 0 if the value was set successfully, -1 otherwise
+ *
+ * Background decoding uses the reader thread pool, so it is disabled if the
+ * number of reader threads has been set to 0. Only resources opened after
+ * this call are affected.
+ */
+int bgpstream_resource_mgr_set_prefetch_depth(bgpstream_resource_mgr_t *q,
+                                              int depth);
+
+/** Download cached resources ahead of the ones being read
+ *
+ * @param q             pointer to the queue
+ * @param depth         number of timestamps (past the ones being read) whose
+ *                      resources should be downloaded, or 0 to disable
+ * @param max_rate      maximum download rate in bytes per second, or 0 for no
+ *                      limit
+ * @return 0 if the values were set successfully, -1 otherwise
+ *
+ * Only resources read through the cache transport are downloaded, by a single
+ * background thread. When a resource that is being downloaded is opened, the
+ * queue waits for the download to finish (downloads that have not started are
+ * cancelled instead). This must be called before any downloads have started.
+ */
+int bgpstream_resource_mgr_set_download_ahead(bgpstream_resource_mgr_t *q,
+                                              int depth, uint64_t max_rate);
+
+/** Set the approximate amount of memory that open readers may use
+ *
+ * @param q             pointer to the queue
+ * @param bytes         memory budget in bytes, or 0 for no limit
+ *
+ * Overlapping resources are normally all opened at once. With a budget set,
+ * only as many are opened as (by a rough per-reader estimate) fit within the
+ * budget, and the rest are opened as earlier readers finish. Resources that
+ * share the oldest timestamp in the queue are always opened, so the budget may
+ * be exceeded if there are many of them.
+ */
+void bgpstream_resource_mgr_set_memory_budget(bgpstream_resource_mgr_t *q,
+                                              uint64_t bytes);
+
+/** Set how long to wait for a resource to open before reading without it
+ *
+ * @param q             pointer to the queue
+ * @param msec          maximum time to wait for each resource to open, or 0
+ *                      (the default) to always wait
+ *
+ * Resources that take longer than this to open are set aside so that records
+ * from the rest can be returned, and are put back into the queue once they
+ * have opened. Their records may then be older than records that have already
+ * been returned, in which case they are flagged as late.
+ */
+void bgpstream_resource_mgr_set_reorder_delay(bgpstream_resource_mgr_t *q,
+                                              uint32_t msec);
+
+/** Only keep the resources that belong to the given shard
+ *
+ * @param q             pointer to the queue
+ * @param index         index of this shard (0 to count-1)
+ * @param count         total number of shards, or 0 to disable sharding
+ * @return 0 if the shard was set successfully, -1 if it is invalid
+ *
+ * Resources are assigned to shards by a hash of their project, collector,
+ * type and initial time, so independent queues configured with the same
+ * options and shard count divide the resources between them without overlap.
+ */
+int bgpstream_resource_mgr_set_shard(bgpstream_resource_mgr_t *q, int index,
+                                     int count);
+
 /** Add a resource item to the queue
  *
  * @param q               pointer to the queue
@@ -67,6 +152,28 @@ int bgpstream_resource_mgr_push(
   const char *collector, bgpstream_record_type_t record_type,
   bgpstream_resource_t **res);
 
+/** Callback for bgpstream_resource_mgr_set_push_cb
+ *
+ * @param res           borrowed pointer to the resource that was pushed
+ * @param user          user data passed to bgpstream_resource_mgr_set_push_cb
+ */
+typedef void(bgpstream_resource_mgr_push_cb_t)(const bgpstream_resource_t *res,
+                                               void *user);
+
+/** Set a function to be told about every new resource pushed to the queue
+ *
+ * @param q             pointer to the queue
+ * @param cb            function to call, or NULL to disable
+ * @param user          user data passed to the callback
+ *
+ * The callback is given each dump resource (i.e., not streams) that was not
+ * already in the queue, before it is filtered, so that it sees the
+ * publication of every file that the data interface lists.
+ */
+void bgpstream_resource_mgr_set_push_cb(bgpstream_resource_mgr_t *q,
+                                        bgpstream_resource_mgr_push_cb_t *cb,
+                                        void *user);
+
 /** Check if the resource manager queue contains any resources
  *
  * @param q             pointer to the queue
@@ -81,6 +188,29 @@ int bgpstream_resource_mgr_empty(bgpstream_resource_mgr_t *q);
  */
 int bgpstream_resource_mgr_stream_only(bgpstream_resource_mgr_t *q);
 
+/** Callback for bgpstream_resource_mgr_drain
+ *
+ * @param res           borrowed pointer to a resource
+ * @param user          user data passed to bgpstream_resource_mgr_drain
+ * @return 0 to continue, -1 to report an error
+ */
+typedef int(bgpstream_resource_mgr_drain_cb_t)(bgpstream_resource_t *res,
+                                                void *user);
+
+/** Remove all the resources from the queue without reading them
+ *
+ * @param q             pointer to the queue
+ * @param cb            function called for each resource, oldest first
+ * @param user          user data passed to the callback
+ * @return the number of resources removed, or -1 if the callback reported an
+ * error (the queue is emptied regardless)
+ *
+ * This must not be used once records have been read from the queue.
+ */
+int bgpstream_resource_mgr_drain(bgpstream_resource_mgr_t *q,
+                                 bgpstream_resource_mgr_drain_cb_t *cb,
+                                 void *user);
+
 /** Get the next record from the stream
  *
  * @param q             pointer to the queue
@@ -93,4 +223,70 @@ int bgpstream_resource_mgr_stream_only(bgpstream_resource_mgr_t *q);
 int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
                                       bgpstream_record_t **record);
 
+/** Serialize the position of the consumer in the stream
+ *
+ * @param q             pointer to the queue
+ * @param buf           buffer to write the checkpoint into (may be NULL if
+ *                      len is 0)
+ * @param len           length of the buffer
+ * @return the length of the checkpoint (as snprintf does, so the checkpoint
+ * was truncated if this is >= len), or -1 if an error occurred
+ *
+ * The checkpoint is a short piece of text listing the time of the last record
+ * returned, the number of records with that time returned from each resource,
+ * and the state of the RIB period filter.
+ */
+int bgpstream_resource_mgr_get_checkpoint(bgpstream_resource_mgr_t *q,
+                                          char *buf, size_t len);
+
+/** Resume from a checkpoint created by bgpstream_resource_mgr_get_checkpoint
+ *
+ * @param q             pointer to the queue
+ * @param checkpoint    borrowed pointer to the checkpoint string
+ * @return 0 if the checkpoint was loaded successfully, -1 otherwise
+ *
+ * Records that were returned before the checkpoint was taken are dropped, and
+ * resources that end before it are not opened at all. The start of the filter
+ * time interval (if any) is moved up to the time of the checkpoint so that the
+ * data interface and the formats can skip as much as possible. This must be
+ * called after the filters have been configured and before any resources have
+ * been added.
+ */
+int bgpstream_resource_mgr_set_checkpoint(bgpstream_resource_mgr_t *q,
+                                          const char *checkpoint);
+
+/** Start collecting a batch of records
+ *
+ * @param q             pointer to the queue
+ *
+ * Records returned by bgpstream_resource_mgr_get_record and
+ * bgpstream_resource_mgr_get_records until the batch is ended all remain
+ * valid, even if several come from the same resource. Records from the
+ * previous batch are released when the next batch begins, or on the next call
+ * to bgpstream_resource_mgr_get_record outside of a batch.
+ */
+void bgpstream_resource_mgr_begin_batch(bgpstream_resource_mgr_t *q);
+
+/** Get the records that are available without waiting
+ *
+ * @param q             pointer to the queue
+ * @param[out] records  array of at least `max` record pointers, filled with
+ *                      borrowed pointers to records
+ * @param max           maximum number of records to get
+ * @return the number of records retrieved (possibly 0), or -1 if an error
+ * occurred
+ *
+ * This stops early rather than opening more resources or waiting for stream
+ * resources, so a return of 0 does not mean end-of-stream. It may only be
+ * called inside a batch.
+ */
+int bgpstream_resource_mgr_get_records(bgpstream_resource_mgr_t *q,
+                                       bgpstream_record_t **records, int max);
+
+/** Stop collecting a batch of records
+ *
+ * @param q             pointer to the queue
+ */
+void bgpstream_resource_mgr_end_batch(bgpstream_resource_mgr_t *q);
+
 #endif /* __BGPSTREAM_RESOURCE_MGR_H */
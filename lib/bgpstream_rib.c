@@ -0,0 +1,751 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include "bgpstream_rib.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_patricia.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* community set -> id (the keys are the sets in the comms array) */
+KHASH_INIT(bsrib_comms, bgpstream_community_set_t *, uint32_t, 1,
+           bgpstream_community_set_hash, bgpstream_community_set_equal)
+
+/* Stores shared by a RIB and all of its snapshots */
+typedef struct rib_shared {
+
+  int refcnt;
+
+  bgpstream_as_path_store_t *paths;
+
+  bgpstream_peer_sig_map_t *peers;
+
+  khash_t(bsrib_comms) * comms_hash;
+
+  /* id-1 -> community set */
+  bgpstream_community_set_t **comms;
+  uint32_t comms_cnt;
+  uint32_t comms_alloc_cnt;
+
+} rib_shared_t;
+
+/* The routes of one peer. The user pointer of each node of the tree is the
+   index of its route in the routes array, plus one. */
+typedef struct rib_peer {
+
+  bgpstream_patricia_tree_t *pt;
+
+  bgpstream_rib_route_t *routes;
+  uint32_t routes_used;
+  uint32_t routes_alloc_cnt;
+
+  /* indexes of the unused entries below routes_used */
+  uint32_t *free_slots;
+  uint32_t free_cnt;
+  uint32_t free_alloc_cnt;
+
+  uint64_t route_cnt;
+
+} rib_peer_t;
+
+struct bgpstream_rib {
+
+  rib_shared_t *shared;
+
+  /* indexed by peer ID */
+  rib_peer_t *peers;
+  uint32_t peers_alloc_cnt;
+};
+
+#define NODE_SLOT(node)                                                        \
+  ((uint32_t)((uintptr_t)bgpstream_patricia_tree_get_user(node) - 1))
+
+static rib_shared_t *shared_create(void)
+{
+  rib_shared_t *shared;
+
+  if ((shared = malloc_zero(sizeof(rib_shared_t))) == NULL) {
+    return NULL;
+  }
+  shared->refcnt = 1;
+
+  if ((shared->paths = bgpstream_as_path_store_create()) == NULL ||
+      (shared->peers = bgpstream_peer_sig_map_create()) == NULL ||
+      (shared->comms_hash = kh_init(bsrib_comms)) == NULL) {
+    goto err;
+  }
+
+  return shared;
+
+err:
+  bgpstream_as_path_store_destroy(shared->paths);
+  bgpstream_peer_sig_map_destroy(shared->peers);
+  free(shared);
+  return NULL;
+}
+
+static void shared_release(rib_shared_t *shared)
+{
+  uint32_t i;
+
+  if (shared == NULL || --shared->refcnt > 0) {
+    return;
+  }
+
+  bgpstream_as_path_store_destroy(shared->paths);
+  bgpstream_peer_sig_map_destroy(shared->peers);
+  kh_destroy(bsrib_comms, shared->comms_hash);
+  for (i = 0; i < shared->comms_cnt; i++) {
+    bgpstream_community_set_destroy(shared->comms[i]);
+  }
+  free(shared->comms);
+  free(shared);
+}
+
+/* returns the id of the given set (0 for no communities), interning it if
+   needed, or -1 if an error occurred */
+static int64_t comms_intern(rib_shared_t *shared,
+                            bgpstream_community_set_t *set)
+{
+  khiter_t k;
+  int khret;
+  bgpstream_community_set_t *cpy = NULL;
+  bgpstream_community_set_t **comms;
+
+  if (set == NULL || bgpstream_community_set_size(set) == 0) {
+    return 0;
+  }
+
+  if ((k = kh_get(bsrib_comms, shared->comms_hash, set)) !=
+      kh_end(shared->comms_hash)) {
+    return kh_val(shared->comms_hash, k);
+  }
+
+  if (shared->comms_cnt == shared->comms_alloc_cnt) {
+    if ((comms = realloc(shared->comms,
+                         sizeof(bgpstream_community_set_t *) *
+                           (shared->comms_alloc_cnt * 2 + 16))) == NULL) {
+      return -1;
+    }
+    shared->comms = comms;
+    shared->comms_alloc_cnt = shared->comms_alloc_cnt * 2 + 16;
+  }
+
+  if ((cpy = bgpstream_community_set_create()) == NULL ||
+      bgpstream_community_set_copy(cpy, set) != 0) {
+    goto err;
+  }
+  k = kh_put(bsrib_comms, shared->comms_hash, cpy, &khret);
+  if (khret < 0) {
+    goto err;
+  }
+  shared->comms[shared->comms_cnt++] = cpy;
+  kh_val(shared->comms_hash, k) = shared->comms_cnt;
+  return shared->comms_cnt;
+
+err:
+  bgpstream_community_set_destroy(cpy);
+  return -1;
+}
+
+static void peer_clear(rib_peer_t *peer)
+{
+  if (peer->pt != NULL) {
+    bgpstream_patricia_tree_clear(peer->pt);
+  }
+  peer->routes_used = 0;
+  peer->free_cnt = 0;
+  peer->route_cnt = 0;
+}
+
+static void peer_free(rib_peer_t *peer)
+{
+  bgpstream_patricia_tree_destroy(peer->pt);
+  free(peer->routes);
+  free(peer->free_slots);
+}
+
+/* returns the peer structure for the given ID, creating it if needed */
+static rib_peer_t *get_peer(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id)
+{
+  rib_peer_t *peers;
+  uint32_t alloc;
+  rib_peer_t *peer;
+
+  if (peer_id >= rib->peers_alloc_cnt) {
+    alloc = ((uint32_t)peer_id + 1) * 2;
+    if (alloc > (uint32_t)UINT16_MAX + 1) {
+      alloc = (uint32_t)UINT16_MAX + 1;
+    }
+    if ((peers = realloc(rib->peers, sizeof(rib_peer_t) * alloc)) == NULL) {
+      return NULL;
+    }
+    memset(&peers[rib->peers_alloc_cnt], 0,
+           sizeof(rib_peer_t) * (alloc - rib->peers_alloc_cnt));
+    rib->peers = peers;
+    rib->peers_alloc_cnt = alloc;
+  }
+
+  peer = &rib->peers[peer_id];
+  if (peer->pt == NULL &&
+      (peer->pt = bgpstream_patricia_tree_create(NULL)) == NULL) {
+    return NULL;
+  }
+  return peer;
+}
+
+static const rib_peer_t *find_peer(const bgpstream_rib_t *rib,
+                                   bgpstream_peer_id_t peer_id)
+{
+  if (peer_id >= rib->peers_alloc_cnt || rib->peers[peer_id].pt == NULL) {
+    return NULL;
+  }
+  return &rib->peers[peer_id];
+}
+
+static int64_t slot_alloc(rib_peer_t *peer)
+{
+  bgpstream_rib_route_t *routes;
+
+  if (peer->free_cnt > 0) {
+    return peer->free_slots[--peer->free_cnt];
+  }
+
+  if (peer->routes_used == peer->routes_alloc_cnt) {
+    if ((routes = realloc(peer->routes, sizeof(bgpstream_rib_route_t) *
+                                          (peer->routes_alloc_cnt * 2 + 64))) ==
+        NULL) {
+      return -1;
+    }
+    peer->routes = routes;
+    peer->routes_alloc_cnt = peer->routes_alloc_cnt * 2 + 64;
+  }
+  return peer->routes_used++;
+}
+
+static int slot_free(rib_peer_t *peer, uint32_t slot)
+{
+  uint32_t *slots;
+
+  if (peer->free_cnt == peer->free_alloc_cnt) {
+    if ((slots = realloc(peer->free_slots,
+                         sizeof(uint32_t) * (peer->free_alloc_cnt * 2 + 64))) ==
+        NULL) {
+      return -1;
+    }
+    peer->free_slots = slots;
+    peer->free_alloc_cnt = peer->free_alloc_cnt * 2 + 64;
+  }
+  peer->free_slots[peer->free_cnt++] = slot;
+  return 0;
+}
+
+static int route_upsert(bgpstream_rib_t *rib, rib_peer_t *peer,
+                        bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  bgpstream_rib_route_t route, *old;
+  bgpstream_patricia_node_t *node;
+  int64_t comms_id;
+  int64_t slot;
+  int changed;
+
+  if (bgpstream_as_path_store_get_path_id(
+        rib->shared->paths, elem->as_path, elem->peer_asn, &route.path_id) !=
+      0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not store AS path");
+    return -1;
+  }
+  if ((comms_id = comms_intern(rib->shared, elem->communities)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not store community set");
+    return -1;
+  }
+  route.comms_id = comms_id;
+  route.time = record->time_sec;
+
+  if ((node = bgpstream_patricia_tree_search_exact(peer->pt, &elem->prefix)) !=
+      NULL) {
+    old = &peer->routes[NODE_SLOT(node)];
+    changed = old->path_id.path_idx != route.path_id.path_idx ||
+              old->comms_id != route.comms_id;
+    *old = route;
+    return changed;
+  }
+
+  if ((slot = slot_alloc(peer)) < 0 ||
+      (node = bgpstream_patricia_tree_insert(peer->pt, &elem->prefix)) ==
+        NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not insert route");
+    return -1;
+  }
+  bgpstream_patricia_tree_set_user(peer->pt, node,
+                                   (void *)(uintptr_t)(slot + 1));
+  peer->routes[slot] = route;
+  peer->route_cnt++;
+  return 1;
+}
+
+static int route_remove(rib_peer_t *peer, const bgpstream_pfx_t *pfx)
+{
+  bgpstream_patricia_node_t *node;
+
+  if ((node = bgpstream_patricia_tree_search_exact(peer->pt, pfx)) == NULL) {
+    return 0;
+  }
+  if (slot_free(peer, NODE_SLOT(node)) != 0) {
+    return -1;
+  }
+  bgpstream_patricia_tree_remove_node(peer->pt, node);
+  peer->route_cnt--;
+  return 1;
+}
+
+typedef struct stale_state {
+  const rib_peer_t *peer;
+  uint32_t before;
+  bgpstream_pfx_t *pfxs;
+  size_t pfxs_cnt;
+  size_t pfxs_alloc_cnt;
+  int64_t removed;
+  int err;
+} stale_state_t;
+
+static bgpstream_patricia_walk_cb_result_t
+find_stale(const bgpstream_patricia_tree_t *pt,
+           const bgpstream_patricia_node_t *node, void *data)
+{
+  stale_state_t *state = data;
+  bgpstream_pfx_t *pfxs;
+  bgpstream_patricia_node_t *n = bgpstream_nonconst_node(node);
+
+  if (state->peer->routes[NODE_SLOT(n)].time >= state->before) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+
+  if (state->pfxs_cnt == state->pfxs_alloc_cnt) {
+    if ((pfxs = realloc(state->pfxs, sizeof(bgpstream_pfx_t) *
+                                       (state->pfxs_alloc_cnt * 2 + 64))) ==
+        NULL) {
+      state->err = 1;
+      return BGPSTREAM_PATRICIA_WALK_END_ALL;
+    }
+    state->pfxs = pfxs;
+    state->pfxs_alloc_cnt = state->pfxs_alloc_cnt * 2 + 64;
+  }
+  bgpstream_pfx_copy(&state->pfxs[state->pfxs_cnt++],
+                     bgpstream_patricia_tree_get_pfx(node));
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_rib_t *bgpstream_rib_create(void)
+{
+  bgpstream_rib_t *rib;
+
+  if ((rib = malloc_zero(sizeof(bgpstream_rib_t))) == NULL) {
+    return NULL;
+  }
+  if ((rib->shared = shared_create()) == NULL) {
+    free(rib);
+    return NULL;
+  }
+  return rib;
+}
+
+bgpstream_rib_t *bgpstream_rib_snapshot(const bgpstream_rib_t *rib)
+{
+  bgpstream_rib_t *snap;
+  const rib_peer_t *src;
+  rib_peer_t *dst;
+  uint32_t id;
+
+  if ((snap = malloc_zero(sizeof(bgpstream_rib_t))) == NULL) {
+    return NULL;
+  }
+  snap->shared = rib->shared;
+  snap->shared->refcnt++;
+
+  if (rib->peers_alloc_cnt == 0) {
+    return snap;
+  }
+  if ((snap->peers = malloc_zero(sizeof(rib_peer_t) * rib->peers_alloc_cnt)) ==
+      NULL) {
+    goto err;
+  }
+  snap->peers_alloc_cnt = rib->peers_alloc_cnt;
+
+  for (id = 0; id < rib->peers_alloc_cnt; id++) {
+    src = &rib->peers[id];
+    dst = &snap->peers[id];
+    if (src->pt == NULL) {
+      continue;
+    }
+    if ((dst->pt = bgpstream_patricia_tree_copy(src->pt)) == NULL) {
+      goto err;
+    }
+    if (src->routes_used > 0) {
+      if ((dst->routes = malloc(sizeof(bgpstream_rib_route_t) *
+                                src->routes_used)) == NULL) {
+        goto err;
+      }
+      memcpy(dst->routes, src->routes,
+             sizeof(bgpstream_rib_route_t) * src->routes_used);
+      dst->routes_used = dst->routes_alloc_cnt = src->routes_used;
+    }
+    if (src->free_cnt > 0) {
+      if ((dst->free_slots = malloc(sizeof(uint32_t) * src->free_cnt)) ==
+          NULL) {
+        goto err;
+      }
+      memcpy(dst->free_slots, src->free_slots,
+             sizeof(uint32_t) * src->free_cnt);
+      dst->free_cnt = dst->free_alloc_cnt = src->free_cnt;
+    }
+    dst->route_cnt = src->route_cnt;
+  }
+
+  return snap;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not snapshot RIB");
+  bgpstream_rib_destroy(snap);
+  return NULL;
+}
+
+void bgpstream_rib_destroy(bgpstream_rib_t *rib)
+{
+  uint32_t id;
+
+  if (rib == NULL) {
+    return;
+  }
+  for (id = 0; id < rib->peers_alloc_cnt; id++) {
+    peer_free(&rib->peers[id]);
+  }
+  free(rib->peers);
+  shared_release(rib->shared);
+  free(rib);
+}
+
+int bgpstream_rib_apply(bgpstream_rib_t *rib, bgpstream_record_t *record,
+                        bgpstream_elem_t *elem)
+{
+  bgpstream_peer_id_t peer_id;
+  rib_peer_t *peer;
+  int64_t removed;
+
+  if (elem == NULL) {
+    if (record->type != BGPSTREAM_RIB ||
+        record->dump_pos != BGPSTREAM_DUMP_END) {
+      return 0;
+    }
+    // the dump just ended: routes it did not refresh are gone
+    if ((removed = bgpstream_rib_expire(
+           rib, bgpstream_record_get_collector_name(record),
+           record->dump_time_sec, NULL, NULL)) < 0) {
+      return -1;
+    }
+    return removed > 0;
+  }
+
+  if ((peer_id = bgpstream_peer_sig_map_get_id(
+         rib->shared->peers, bgpstream_record_get_collector_name(record),
+         &elem->peer_ip, elem->peer_asn)) == 0 ||
+      (peer = get_peer(rib, peer_id)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get RIB peer");
+    return -1;
+  }
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    return route_upsert(rib, peer, record, elem);
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    return route_remove(peer, &elem->prefix);
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    if (elem->new_state != BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED &&
+        peer->route_cnt > 0) {
+      peer_clear(peer);
+      return 1;
+    }
+    return 0;
+
+  default:
+    return 0;
+  }
+}
+
+int64_t bgpstream_rib_expire(bgpstream_rib_t *rib, const char *collector,
+                             uint32_t before, bgpstream_rib_walk_cb_t *cb,
+                             void *user)
+{
+  stale_state_t state = {0};
+  bgpstream_peer_sig_t *sig;
+  rib_peer_t *peer;
+  bgpstream_patricia_node_t *node;
+  int64_t removed = -1;
+  uint32_t id;
+  size_t i;
+
+  state.before = before;
+
+  for (id = 1; id < rib->peers_alloc_cnt; id++) {
+    peer = &rib->peers[id];
+    if (peer->route_cnt == 0 ||
+        (sig = bgpstream_peer_sig_map_get_sig(rib->shared->peers, id)) ==
+          NULL ||
+        strcmp(sig->collector_str, collector) != 0) {
+      continue;
+    }
+
+    // routes cannot be removed while the tree is walked
+    state.peer = peer;
+    bgpstream_patricia_tree_walk(peer->pt, find_stale, &state);
+    if (state.err != 0) {
+      goto done;
+    }
+    for (i = 0; i < state.pfxs_cnt; i++) {
+      if (cb != NULL &&
+          (node = bgpstream_patricia_tree_search_exact(peer->pt,
+                                                       &state.pfxs[i])) !=
+            NULL) {
+        cb(id, &state.pfxs[i], &peer->routes[NODE_SLOT(node)], user);
+      }
+      if (route_remove(peer, &state.pfxs[i]) < 0) {
+        goto done;
+      }
+    }
+    state.removed += state.pfxs_cnt;
+    state.pfxs_cnt = 0;
+  }
+  removed = state.removed;
+
+done:
+  free(state.pfxs);
+  return removed;
+}
+
+const bgpstream_rib_route_t *bgpstream_rib_lookup(const bgpstream_rib_t *rib,
+                                                  bgpstream_peer_id_t peer_id,
+                                                  const bgpstream_pfx_t *pfx)
+{
+  const rib_peer_t *peer;
+  const bgpstream_patricia_node_t *node;
+
+  if ((peer = find_peer(rib, peer_id)) == NULL ||
+      (node = bgpstream_patricia_tree_search_exact_const(peer->pt, pfx)) ==
+        NULL) {
+    return NULL;
+  }
+  return &peer->routes[NODE_SLOT(bgpstream_nonconst_node(node))];
+}
+
+uint64_t bgpstream_rib_get_route_cnt(const bgpstream_rib_t *rib,
+                                     bgpstream_peer_id_t peer_id)
+{
+  const rib_peer_t *peer;
+  uint64_t cnt = 0;
+  uint32_t id;
+
+  if (peer_id != 0) {
+    return (peer = find_peer(rib, peer_id)) == NULL ? 0 : peer->route_cnt;
+  }
+  for (id = 0; id < rib->peers_alloc_cnt; id++) {
+    cnt += rib->peers[id].route_cnt;
+  }
+  return cnt;
+}
+
+bgpstream_peer_sig_map_t *
+bgpstream_rib_get_peer_sig_map(const bgpstream_rib_t *rib)
+{
+  return rib->shared->peers;
+}
+
+bgpstream_as_path_store_t *
+bgpstream_rib_get_as_path_store(const bgpstream_rib_t *rib)
+{
+  return rib->shared->paths;
+}
+
+const bgpstream_community_set_t *
+bgpstream_rib_get_communities(const bgpstream_rib_t *rib, uint32_t comms_id)
+{
+  if (comms_id == 0 || comms_id > rib->shared->comms_cnt) {
+    return NULL;
+  }
+  return rib->shared->comms[comms_id - 1];
+}
+
+typedef struct walk_state {
+  const rib_peer_t *peer;
+  bgpstream_peer_id_t peer_id;
+  bgpstream_rib_walk_cb_t *cb;
+  void *user;
+  int stopped;
+} walk_state_t;
+
+static bgpstream_patricia_walk_cb_result_t
+walk_node(const bgpstream_patricia_tree_t *pt,
+          const bgpstream_patricia_node_t *node, void *data)
+{
+  walk_state_t *state = data;
+
+  if (state->cb(state->peer_id, bgpstream_patricia_tree_get_pfx(node),
+                &state->peer->routes[NODE_SLOT(bgpstream_nonconst_node(node))],
+                state->user) != 0) {
+    state->stopped = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+int bgpstream_rib_walk(const bgpstream_rib_t *rib, bgpstream_rib_walk_cb_t *cb,
+                       void *user)
+{
+  walk_state_t state = {NULL, 0, cb, user, 0};
+  uint32_t id;
+
+  for (id = 0; id < rib->peers_alloc_cnt && state.stopped == 0; id++) {
+    if (rib->peers[id].route_cnt == 0) {
+      continue;
+    }
+    state.peer = &rib->peers[id];
+    state.peer_id = id;
+    bgpstream_patricia_tree_walk(state.peer->pt, walk_node, &state);
+  }
+  return state.stopped;
+}
+
+typedef struct diff_state {
+  /* the peer whose tree is walked, and the peer it is compared to (NULL if
+     it has no routes) */
+  const rib_peer_t *walked;
+  const rib_peer_t *other;
+  /* non-zero if the walked peer is from the old RIB */
+  int walking_old;
+  bgpstream_peer_id_t peer_id;
+  bgpstream_rib_diff_cb_t *cb;
+  void *user;
+  int stopped;
+} diff_state_t;
+
+static bgpstream_patricia_walk_cb_result_t
+diff_node(const bgpstream_patricia_tree_t *pt,
+          const bgpstream_patricia_node_t *node, void *data)
+{
+  diff_state_t *state = data;
+  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  const bgpstream_patricia_node_t *other_node = NULL;
+  const bgpstream_rib_route_t *route, *other = NULL;
+  int ret = 0;
+
+  route = &state->walked->routes[NODE_SLOT(bgpstream_nonconst_node(node))];
+  if (state->other != NULL &&
+      (other_node = bgpstream_patricia_tree_search_exact_const(
+         state->other->pt, pfx)) != NULL) {
+    other = &state->other->routes[NODE_SLOT(
+      bgpstream_nonconst_node(other_node))];
+  }
+
+  if (state->walking_old) {
+    if (other == NULL) {
+      ret = state->cb(BGPSTREAM_RIB_DIFF_REMOVED, state->peer_id, pfx, route,
+                      NULL, state->user);
+    } else if (route->path_id.path_idx != other->path_id.path_idx ||
+               route->comms_id != other->comms_id) {
+      ret = state->cb(BGPSTREAM_RIB_DIFF_CHANGED, state->peer_id, pfx, route,
+                      other, state->user);
+    }
+  } else if (other == NULL) {
+    ret = state->cb(BGPSTREAM_RIB_DIFF_ADDED, state->peer_id, pfx, NULL, route,
+                    state->user);
+  }
+
+  if (ret != 0) {
+    state->stopped = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+int bgpstream_rib_diff(const bgpstream_rib_t *old_rib,
+                       const bgpstream_rib_t *new_rib,
+                       bgpstream_rib_diff_cb_t *cb, void *user)
+{
+  diff_state_t state = {0};
+  const rib_peer_t *old_peer, *new_peer;
+  uint32_t id, max;
+
+  if (old_rib->shared != new_rib->shared) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Cannot diff RIBs that do not share their stores");
+    return -1;
+  }
+
+  state.cb = cb;
+  state.user = user;
+  max = old_rib->peers_alloc_cnt > new_rib->peers_alloc_cnt
+          ? old_rib->peers_alloc_cnt
+          : new_rib->peers_alloc_cnt;
+
+  for (id = 1; id < max && state.stopped == 0; id++) {
+    old_peer = find_peer(old_rib, id);
+    new_peer = find_peer(new_rib, id);
+    if (old_peer != NULL && old_peer->route_cnt == 0) {
+      old_peer = NULL;
+    }
+    if (new_peer != NULL && new_peer->route_cnt == 0) {
+      new_peer = NULL;
+    }
+    state.peer_id = id;
+
+    /* removed and changed routes */
+    if (old_peer != NULL) {
+      state.walked = old_peer;
+      state.other = new_peer;
+      state.walking_old = 1;
+      bgpstream_patricia_tree_walk(old_peer->pt, diff_node, &state);
+    }
+
+    /* added routes */
+    if (new_peer != NULL && state.stopped == 0) {
+      state.walked = new_peer;
+      state.other = old_peer;
+      state.walking_old = 0;
+      bgpstream_patricia_tree_walk(new_peer->pt, diff_node, &state);
+    }
+  }
+
+  return state.stopped;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_RIB_H_
+#define __BGPSTREAM_RIB_H_
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils_as_path_store.h"
+#include "bgpstream_utils_community.h"
+#include "bgpstream_utils_peer_sig_map.h"
+#include "bgpstream_utils_pfx.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGPStream RIB
+ * engine: an incremental, per-peer view of the routing tables observed in a
+ * stream
+ *
+ * The RIB is fed with the records and elems of a stream as they are read.
+ * RIB dump elems and announcements install routes, withdrawals remove them,
+ * and a peer leaving the established state drops all of its routes. When a
+ * collector's RIB dump ends, routes of that collector's peers that were not
+ * refreshed by the dump are removed.
+ *
+ * AS paths and community sets are interned in stores that are shared by a RIB
+ * and all of its snapshots, so each route only costs a few integers.
+ */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure representing a RIB */
+typedef struct bgpstream_rib bgpstream_rib_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** A single route in the RIB of a peer */
+typedef struct bgpstream_rib_route {
+
+  /** ID of the AS path of this route in the RIB's AS path store */
+  bgpstream_as_path_store_path_id_t path_id;
+
+  /** ID of the community set of this route (0 if it has no communities)
+   *
+   * @see bgpstream_rib_get_communities
+   */
+  uint32_t comms_id;
+
+  /** Time (in seconds) of the record that last installed this route */
+  uint32_t time;
+
+} bgpstream_rib_route_t;
+
+/** @} */
+
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** Type of a difference between two RIBs */
+typedef enum {
+
+  /** The route only exists in the new RIB */
+  BGPSTREAM_RIB_DIFF_ADDED = 0,
+
+  /** The route only exists in the old RIB */
+  BGPSTREAM_RIB_DIFF_REMOVED = 1,
+
+  /** The route exists in both RIBs, with a different path or communities */
+  BGPSTREAM_RIB_DIFF_CHANGED = 2,
+
+} bgpstream_rib_diff_type_t;
+
+/** @} */
+
+/**
+ * @name Public Callback Types
+ *
+ * @{ */
+
+/** Callback invoked for each route visited by bgpstream_rib_walk
+ *
+ * @param peer_id       ID of the peer the route belongs to
+ * @param pfx           prefix of the route
+ * @param route         pointer to the route
+ * @param user          user pointer given to bgpstream_rib_walk
+ * @return 0 to continue the walk, any other value to stop it
+ */
+typedef int(bgpstream_rib_walk_cb_t)(bgpstream_peer_id_t peer_id,
+                                     const bgpstream_pfx_t *pfx,
+                                     const bgpstream_rib_route_t *route,
+                                     void *user);
+
+/** Callback invoked for each difference found by bgpstream_rib_diff
+ *
+ * @param type          type of the difference
+ * @param peer_id       ID of the peer the route belongs to
+ * @param pfx           prefix of the route
+ * @param old_route     route in the old RIB (NULL if the route was added)
+ * @param new_route     route in the new RIB (NULL if the route was removed)
+ * @param user          user pointer given to bgpstream_rib_diff
+ * @return 0 to continue, any other value to stop the diff
+ */
+typedef int(bgpstream_rib_diff_cb_t)(bgpstream_rib_diff_type_t type,
+                                     bgpstream_peer_id_t peer_id,
+                                     const bgpstream_pfx_t *pfx,
+                                     const bgpstream_rib_route_t *old_route,
+                                     const bgpstream_rib_route_t *new_route,
+                                     void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new, empty RIB
+ *
+ * @return pointer to the RIB if successful, NULL otherwise
+ */
+bgpstream_rib_t *bgpstream_rib_create(void);
+
+/** Take a snapshot of a RIB
+ *
+ * @param rib           pointer to the RIB to snapshot
+ * @return pointer to an independent copy of the RIB, NULL if an error occurred
+ *
+ * The snapshot shares the AS path, community and peer stores of the original
+ * RIB, and may be updated with bgpstream_rib_apply like any other RIB. Two
+ * RIBs can only be compared with bgpstream_rib_diff if one is a snapshot of
+ * the other (or both are snapshots of the same RIB).
+ */
+bgpstream_rib_t *bgpstream_rib_snapshot(const bgpstream_rib_t *rib);
+
+/** Destroy the given RIB
+ *
+ * @param rib           pointer to the RIB to destroy
+ *
+ * The shared stores are destroyed along with the last RIB that uses them.
+ */
+void bgpstream_rib_destroy(bgpstream_rib_t *rib);
+
+/** Apply a record, or one of its elems, to the RIB
+ *
+ * @param rib           pointer to the RIB to update
+ * @param record        pointer to the record being processed
+ * @param elem          pointer to an elem of the record, or NULL
+ * @return 1 if routes were added, changed or removed, 0 if the routes are
+ * unchanged (apart from their time), -1 if an error occurred
+ *
+ * Applications should call this once for each elem of a record, and once
+ * with a NULL elem after the last elem of the record: this is when the end of
+ * a RIB dump is detected and stale routes are removed.
+ */
+int bgpstream_rib_apply(bgpstream_rib_t *rib, bgpstream_record_t *record,
+                        bgpstream_elem_t *elem);
+
+/** Remove the routes of a collector that were installed before a given time
+ *
+ * @param rib           pointer to the RIB to update
+ * @param collector     name of the collector whose peers should be expired
+ * @param before        routes installed before this time are removed
+ * @param cb            callback to invoke for each route before it is
+ *                      removed (may be NULL)
+ * @param user          user pointer to pass to the callback
+ * @return the number of routes removed, -1 if an error occurred
+ *
+ * This is what bgpstream_rib_apply does at the end of a RIB dump (with the
+ * dump time), and the return value of the callback is ignored.
+ */
+int64_t bgpstream_rib_expire(bgpstream_rib_t *rib, const char *collector,
+                             uint32_t before, bgpstream_rib_walk_cb_t *cb,
+                             void *user);
+
+/** Look up the route a peer has for a prefix
+ *
+ * @param rib           pointer to the RIB to query
+ * @param peer_id       ID of the peer
+ * @param pfx           pointer to the prefix to look up (exact match)
+ * @return pointer to the route, NULL if the peer has no route for the prefix
+ *
+ * The returned pointer is only valid until the RIB is next updated.
+ */
+const bgpstream_rib_route_t *bgpstream_rib_lookup(const bgpstream_rib_t *rib,
+                                                  bgpstream_peer_id_t peer_id,
+                                                  const bgpstream_pfx_t *pfx);
+
+/** Get the number of routes in the RIB
+ *
+ * @param rib           pointer to the RIB to query
+ * @param peer_id       ID of the peer to count routes of, 0 for all peers
+ * @return the number of routes
+ */
+uint64_t bgpstream_rib_get_route_cnt(const bgpstream_rib_t *rib,
+                                     bgpstream_peer_id_t peer_id);
+
+/** Get the peer signature map used to number the peers of the RIB
+ *
+ * @param rib           pointer to the RIB
+ * @return borrowed pointer to the peer signature map
+ */
+bgpstream_peer_sig_map_t *
+bgpstream_rib_get_peer_sig_map(const bgpstream_rib_t *rib);
+
+/** Get the AS path store that holds the paths of the RIB's routes
+ *
+ * @param rib           pointer to the RIB
+ * @return borrowed pointer to the AS path store
+ */
+bgpstream_as_path_store_t *
+bgpstream_rib_get_as_path_store(const bgpstream_rib_t *rib);
+
+/** Get the community set with the given ID
+ *
+ * @param rib           pointer to the RIB
+ * @param comms_id      community set ID (from a route)
+ * @return borrowed pointer to the community set, NULL if the ID is 0 (no
+ * communities) or unknown
+ */
+const bgpstream_community_set_t *
+bgpstream_rib_get_communities(const bgpstream_rib_t *rib, uint32_t comms_id);
+
+/** Walk all the routes of the RIB
+ *
+ * @param rib           pointer to the RIB to walk
+ * @param cb            callback to invoke for each route
+ * @param user          user pointer to pass to the callback
+ * @return 0 if all routes were visited, 1 if the callback stopped the walk
+ *
+ * Routes are visited peer by peer, in increasing order of peer ID.
+ */
+int bgpstream_rib_walk(const bgpstream_rib_t *rib, bgpstream_rib_walk_cb_t *cb,
+                       void *user);
+
+/** Find the differences between two RIBs
+ *
+ * @param old_rib       pointer to the older RIB
+ * @param new_rib       pointer to the newer RIB
+ * @param cb            callback to invoke for each difference
+ * @param user          user pointer to pass to the callback
+ * @return 0 if all differences were reported, 1 if the callback stopped the
+ * diff, -1 if the RIBs do not share their stores
+ */
+int bgpstream_rib_diff(const bgpstream_rib_t *old_rib,
+                       const bgpstream_rib_t *new_rib,
+                       bgpstream_rib_diff_cb_t *cb, void *user);
+
+/** @} */
+
+#endif // __BGPSTREAM_RIB_H_
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_stats.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+__thread bgpstream_stats_block_t *bgpstream_stats_local = NULL;
+
+/* Non-zero if the timing statistics are collected */
+static int bgpstream_stats_timers = 0;
+
+/* Blocks of the running threads, and the totals of the threads that exited */
+static bgpstream_stats_block_t *blocks = NULL;
+static uint64_t retired[_BGPSTREAM_STAT_CNT];
+static uint64_t retired_lag[_BGPSTREAM_LAG_CNT][BGPSTREAM_LAG_BUCKET_CNT];
+static pthread_mutex_t blocks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Key used to retire the block of a thread when it exits */
+static pthread_key_t block_key;
+static pthread_once_t block_key_once = PTHREAD_ONCE_INIT;
+
+/* Rates of the kafka partitions are measured over at least this long */
+#define KAFKA_RATE_INTERVAL_MSEC 1000
+
+/* Statistics of a kafka partition, along with the totals at the start of the
+   current rate interval */
+typedef struct kafka_part {
+  bgpstream_kafka_stats_t stats;
+  uint64_t rate_time;
+  uint64_t rate_msgs;
+  uint64_t rate_bytes;
+} kafka_part_t;
+
+static kafka_part_t *kafka_parts = NULL;
+static int kafka_parts_cnt = 0;
+static int kafka_parts_alloc_cnt = 0;
+static pthread_mutex_t kafka_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *stat_names[] = {
+  "broker-queries",
+  "broker-ns",
+  "resources-opened",
+  "resources-closed",
+  "resources-duplicate",
+  "open-wait-ns",
+  "file-bytes",
+  "kafka-bytes",
+  "cache-bytes",
+  "http-bytes",
+  "websocket-bytes",
+  "transport-read-ns",
+  "mrt-records",
+  "mrt-filtered",
+  "mrt-corrupted",
+  "bmp-records",
+  "bmp-filtered",
+  "bmp-corrupted",
+  "rislive-records",
+  "rislive-filtered",
+  "rislive-corrupted",
+  "decode-ns",
+  "elems-generated",
+  "elems-filtered-elemtype",
+  "elems-filtered-ipversion",
+  "elems-filtered-peer-asn",
+  "elems-filtered-origin-asn",
+  "elems-filtered-community",
+  "elems-filtered-prefix",
+  "elems-filtered-aspath",
+  "elems-filtered-sample",
+  "elems-duplicate",
+};
+
+static void retire_block(void *user)
+{
+  bgpstream_stats_block_t *b = (bgpstream_stats_block_t *)user;
+  bgpstream_stats_block_t **p;
+  int i, j;
+
+  pthread_mutex_lock(&blocks_mutex);
+  for (p = &blocks; *p != NULL; p = &(*p)->next) {
+    if (*p == b) {
+      *p = b->next;
+      break;
+    }
+  }
+  for (i = 0; i < _BGPSTREAM_STAT_CNT; i++) {
+    retired[i] += b->values[i];
+  }
+  for (i = 0; i < _BGPSTREAM_LAG_CNT; i++) {
+    for (j = 0; j < BGPSTREAM_LAG_BUCKET_CNT; j++) {
+      retired_lag[i][j] += b->lag[i][j];
+    }
+  }
+  pthread_mutex_unlock(&blocks_mutex);
+
+  bgpstream_stats_local = NULL;
+  free(b);
+}
+
+static void create_block_key(void)
+{
+  if (pthread_key_create(&block_key, retire_block) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not create the stats thread key");
+  }
+}
+
+bgpstream_stats_block_t *bgpstream_stats_local_create(void)
+{
+  bgpstream_stats_block_t *b;
+
+  pthread_once(&block_key_once, create_block_key);
+
+  if ((b = malloc_zero(sizeof(bgpstream_stats_block_t))) == NULL) {
+    return NULL;
+  }
+  if (pthread_setspecific(block_key, b) != 0) {
+    free(b);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&blocks_mutex);
+  b->next = blocks;
+  blocks = b;
+  pthread_mutex_unlock(&blocks_mutex);
+
+  bgpstream_stats_local = b;
+  return b;
+}
+
+uint64_t bgpstream_stats_now(void)
+{
+  struct timespec ts;
+
+  if (__atomic_load_n(&bgpstream_stats_timers, __ATOMIC_RELAXED) == 0 ||
+      clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bgpstream_stats_get(bgpstream_stats_t *stats)
+{
+  bgpstream_stats_block_t *b;
+  int i, j;
+
+  pthread_mutex_lock(&blocks_mutex);
+  memcpy(stats->values, retired, sizeof(stats->values));
+  memcpy(stats->lag, retired_lag, sizeof(stats->lag));
+  for (b = blocks; b != NULL; b = b->next) {
+    for (i = 0; i < _BGPSTREAM_STAT_CNT; i++) {
+      stats->values[i] += __atomic_load_n(&b->values[i], __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < _BGPSTREAM_LAG_CNT; i++) {
+      for (j = 0; j < BGPSTREAM_LAG_BUCKET_CNT; j++) {
+        stats->lag[i][j] += __atomic_load_n(&b->lag[i][j], __ATOMIC_RELAXED);
+      }
+    }
+  }
+  pthread_mutex_unlock(&blocks_mutex);
+}
+
+const char *bgpstream_stats_name(bgpstream_stat_t stat)
+{
+  if ((int)stat < 0 || (int)stat >= ARR_CNT(stat_names)) {
+    return NULL;
+  }
+  return stat_names[stat];
+}
+
+void bgpstream_stats_set_timers(int enabled)
+{
+  __atomic_store_n(&bgpstream_stats_timers, enabled != 0, __ATOMIC_RELAXED);
+}
+
+static kafka_part_t *get_kafka_part(const char *topic, int32_t partition)
+{
+  kafka_part_t *p;
+  int i;
+
+  for (i = 0; i < kafka_parts_cnt; i++) {
+    p = &kafka_parts[i];
+    if (p->stats.partition == partition &&
+        strncmp(p->stats.topic, topic, sizeof(p->stats.topic) - 1) == 0) {
+      return p;
+    }
+  }
+
+  if (kafka_parts_cnt == kafka_parts_alloc_cnt) {
+    int new_cnt = kafka_parts_alloc_cnt ? kafka_parts_alloc_cnt * 2 : 8;
+    if ((p = realloc(kafka_parts, sizeof(kafka_part_t) * new_cnt)) == NULL) {
+      return NULL;
+    }
+    kafka_parts = p;
+    kafka_parts_alloc_cnt = new_cnt;
+  }
+  p = &kafka_parts[kafka_parts_cnt++];
+  memset(p, 0, sizeof(*p));
+  strncpy(p->stats.topic, topic, sizeof(p->stats.topic) - 1);
+  p->stats.partition = partition;
+  p->stats.consumer_lag = -1;
+  return p;
+}
+
+void bgpstream_stats_kafka_update(const char *topic, int32_t partition,
+                                  int64_t lag, uint64_t msgs, uint64_t bytes)
+{
+  kafka_part_t *p;
+  uint64_t now = epoch_msec();
+
+  pthread_mutex_lock(&kafka_mutex);
+  if ((p = get_kafka_part(topic, partition)) == NULL) {
+    pthread_mutex_unlock(&kafka_mutex);
+    return;
+  }
+  p->stats.consumer_lag = lag;
+  p->stats.msgs += msgs;
+  p->stats.bytes += bytes;
+  if (p->rate_time == 0) {
+    p->rate_time = now;
+  } else if (now - p->rate_time >= KAFKA_RATE_INTERVAL_MSEC) {
+    p->stats.msgs_per_sec =
+      (p->stats.msgs - p->rate_msgs) * 1000.0 / (now - p->rate_time);
+    p->stats.bytes_per_sec =
+      (p->stats.bytes - p->rate_bytes) * 1000.0 / (now - p->rate_time);
+    p->rate_time = now;
+    p->rate_msgs = p->stats.msgs;
+    p->rate_bytes = p->stats.bytes;
+  }
+  pthread_mutex_unlock(&kafka_mutex);
+}
+
+int bgpstream_stats_kafka_get(bgpstream_kafka_stats_t *stats, int stats_cnt)
+{
+  int i, cnt;
+
+  pthread_mutex_lock(&kafka_mutex);
+  for (i = 0; i < kafka_parts_cnt && i < stats_cnt; i++) {
+    stats[i] = kafka_parts[i].stats;
+  }
+  cnt = kafka_parts_cnt;
+  pthread_mutex_unlock(&kafka_mutex);
+  return cnt;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_STATS_H
+#define __BGPSTREAM_STATS_H
+
+#include "bgpstream.h"
+#include <stdint.h>
+
+/** Counters of one thread (only written by that thread) */
+typedef struct bgpstream_stats_block {
+
+  uint64_t values[_BGPSTREAM_STAT_CNT];
+
+  uint64_t lag[_BGPSTREAM_LAG_CNT][BGPSTREAM_LAG_BUCKET_CNT];
+
+  /** The next block of the list of live threads */
+  struct bgpstream_stats_block *next;
+
+} bgpstream_stats_block_t;
+
+/** The counters of the calling thread (NULL until it counts something) */
+extern __thread bgpstream_stats_block_t *bgpstream_stats_local;
+
+/** Create (and register) the counters of the calling thread
+ *
+ * @return pointer to the counters, or NULL if they could not be created
+ */
+bgpstream_stats_block_t *bgpstream_stats_local_create(void);
+
+/** Get a per-format statistic
+ *
+ * @param mrt_stat      the MRT version of the statistic (e.g.
+ *                      BGPSTREAM_STAT_MRT_RECORDS)
+ * @param format_type   the bgpstream_resource_format_type_t of the format
+ *
+ * The per-format statistics are in the same order as the format types.
+ */
+#define BGPSTREAM_STAT_FORMAT(mrt_stat, format_type)                           \
+  ((bgpstream_stat_t)((mrt_stat) + 3 * (format_type)))
+
+/** Get the current time in ns for a timing statistic
+ *
+ * @return the time, or 0 if timers are disabled
+ */
+uint64_t bgpstream_stats_now(void);
+
+/** Get a snapshot of the statistics of all threads
+ *
+ * @param stats         pointer to a structure to fill with the statistics
+ */
+void bgpstream_stats_get(bgpstream_stats_t *stats);
+
+/** Get the name of a statistic
+ *
+ * @param stat          the statistic to get the name of
+ * @return borrowed pointer to the name, or NULL if the statistic is not valid
+ */
+const char *bgpstream_stats_name(bgpstream_stat_t stat);
+
+/** Enable or disable the timing statistics
+ *
+ * @param enabled       if non-zero, the timing statistics are collected
+ */
+void bgpstream_stats_set_timers(int enabled);
+
+/** Report the consumption of a kafka partition since the last report
+ *
+ * @param topic         name of the topic
+ * @param partition     partition of the topic
+ * @param lag           consumer lag of the partition (-1 if not known)
+ * @param msgs          number of messages consumed since the last report
+ * @param bytes         number of bytes consumed since the last report
+ */
+void bgpstream_stats_kafka_update(const char *topic, int32_t partition,
+                                  int64_t lag, uint64_t msgs, uint64_t bytes);
+
+/** Get a snapshot of the kafka partition statistics
+ *
+ * @param stats         pointer to an array to fill with the statistics
+ * @param stats_cnt     number of elements in the array
+ * @return the number of partitions known
+ */
+int bgpstream_stats_kafka_get(bgpstream_kafka_stats_t *stats, int stats_cnt);
+
+/** Add to a statistic of the calling thread
+ *
+ * @param stat          the statistic to add to
+ * @param n             the amount to add
+ */
+static inline void bgpstream_stats_add(bgpstream_stat_t stat, uint64_t n)
+{
+  bgpstream_stats_block_t *b = bgpstream_stats_local;
+
+  if (b == NULL && (b = bgpstream_stats_local_create()) == NULL) {
+    return;
+  }
+  // only this thread writes the counter, but others may read it
+  __atomic_store_n(&b->values[stat], b->values[stat] + n, __ATOMIC_RELAXED);
+}
+
+/** Add the time since start to a timing statistic
+ *
+ * @param stat          the statistic to add to
+ * @param start         the value returned by bgpstream_stats_now at the start
+ */
+static inline void bgpstream_stats_add_time(bgpstream_stat_t stat,
+                                            uint64_t start)
+{
+  uint64_t now;
+
+  if (start != 0 && (now = bgpstream_stats_now()) > start) {
+    bgpstream_stats_add(stat, now - start);
+  }
+}
+
+/** Count a lag in a lag histogram of the calling thread
+ *
+ * @param lag           the lag histogram to count in
+ * @param seconds       the lag in seconds (negative lags, i.e. clock skew, are
+ *                      counted as no lag)
+ */
+static inline void bgpstream_stats_add_lag(bgpstream_lag_t lag,
+                                           int64_t seconds)
+{
+  bgpstream_stats_block_t *b = bgpstream_stats_local;
+  int bucket = 0;
+
+  if (b == NULL && (b = bgpstream_stats_local_create()) == NULL) {
+    return;
+  }
+  if (seconds > 0) {
+    bucket = (seconds >= (1LL << (BGPSTREAM_LAG_BUCKET_CNT - 2)))
+               ? BGPSTREAM_LAG_BUCKET_CNT - 1
+               : 32 - __builtin_clz((uint32_t)seconds);
+  }
+  __atomic_store_n(&b->lag[lag][bucket], b->lag[lag][bucket] + 1,
+                   __ATOMIC_RELAXED);
+}
+
+#endif /* __BGPSTREAM_STATS_H */
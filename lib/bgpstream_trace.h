@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_TRACE_H
+#define __BGPSTREAM_TRACE_H
+
+#include "config.h"
+
+/** @file
+ *
+ * Static (USDT) tracepoints at the stage boundaries of the pipeline.
+ *
+ * When configured with --enable-usdt, each tracepoint is a SystemTap-style
+ * probe in the "bgpstream" provider, which is a single nop until a tracer
+ * (e.g. bpftrace or perf) attaches to it. Otherwise the tracepoints (and their
+ * arguments) are compiled out. The probes are:
+ *
+ * - resource__open(url, transport_type, format_type, ok): a resource was
+ *   opened (or could not be opened, if ok is 0) by a reader
+ * - resource__close(url): a reader was destroyed
+ * - buffer__refill(url, len): len bytes were read into a parsebgp buffer
+ * - record__populate__start(url): parsebgp started populating a record
+ * - record__populate__done(url, status, time_sec): parsebgp populated a
+ *   record (status is a bgpstream_format_status_t)
+ * - resource__reinsert(url, prev_time, next_time): a resource was moved in
+ *   the resource queue because the time of its next record changed
+ * - broker__query__start(url): a query was sent to the broker
+ * - broker__query__done(url, rc): a broker query completed (rc is 0 on
+ *   success)
+ *
+ * e.g.:
+ *   bpftrace -e 'usdt:libbgpstream.so:bgpstream:buffer__refill
+ *                { @bytes[str(arg0)] = sum(arg1); }'
+ */
+
+#ifdef WITH_USDT
+
+#include <sys/sdt.h>
+
+#define BGPSTREAM_TRACE1(name, a) DTRACE_PROBE1(bgpstream, name, a)
+#define BGPSTREAM_TRACE2(name, a, b) DTRACE_PROBE2(bgpstream, name, a, b)
+#define BGPSTREAM_TRACE3(name, a, b, c) DTRACE_PROBE3(bgpstream, name, a, b, c)
+#define BGPSTREAM_TRACE4(name, a, b, c, d)                                     \
+  DTRACE_PROBE4(bgpstream, name, a, b, c, d)
+
+#else
+
+#define BGPSTREAM_TRACE1(name, a)                                              \
+  do {                                                                         \
+  } while (0)
+#define BGPSTREAM_TRACE2(name, a, b)                                           \
+  do {                                                                         \
+  } while (0)
+#define BGPSTREAM_TRACE3(name, a, b, c)                                        \
+  do {                                                                         \
+  } while (0)
+#define BGPSTREAM_TRACE4(name, a, b, c, d)                                     \
+  do {                                                                         \
+  } while (0)
+
+#endif
+
+#endif /* __BGPSTREAM_TRACE_H */
@@ -32,11 +32,13 @@
 #include "bgpstream_transport.h"
 #include "bgpstream_log.h"
 #include "bgpstream_resource.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 
 #include "bs_transport_cache.h"
 #include "bs_transport_file.h"
 #include "bs_transport_http.h"
+#include "bs_transport_websocket.h"
 
 #ifdef WITH_KAFKA
 #include "bs_transport_kafka.h"
@@ -62,9 +64,13 @@ static const transport_create_func_t create_functions[] = {
   bs_transport_cache_create,
 
   bs_transport_http_create,
+
+  bs_transport_websocket_create,
 };
 
-bgpstream_transport_t *bgpstream_transport_create(bgpstream_resource_t *res)
+bgpstream_transport_t *
+bgpstream_transport_create(bgpstream_resource_t *res,
+                           bgpstream_filter_mgr_t *filter_mgr)
 {
   bgpstream_transport_t *transport = NULL;
 
@@ -92,6 +98,7 @@ bgpstream_transport_t *bgpstream_transport_create(bgpstream_resource_t *res)
 
   // store a pointer to the resource
   transport->res = res;
+  transport->filter_mgr = filter_mgr;
 
   if (create_functions[res->transport_type](transport) != 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open resource (%s)", res->url);
@@ -105,10 +112,28 @@ err:
   return NULL;
 }
 
+// count the bytes read from a transport (the stats are in the same order as
+// the transport types)
+static void count_read(bgpstream_transport_t *transport, int64_t len,
+                       uint64_t start)
+{
+  if (len > 0 && (int)transport->res->transport_type <=
+                   BGPSTREAM_RESOURCE_TRANSPORT_WEBSOCKET) {
+    bgpstream_stats_add(BGPSTREAM_STAT_FILE_BYTES +
+                          transport->res->transport_type,
+                        len);
+  }
+  bgpstream_stats_add_time(BGPSTREAM_STAT_TRANSPORT_READ_NS, start);
+}
+
 int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
                                  int64_t len)
 {
-  return transport->read(transport, buffer, len);
+  uint64_t start = bgpstream_stats_now();
+  int64_t rc = transport->read(transport, buffer, len);
+
+  count_read(transport, rc, start);
+  return rc;
 }
 
 void bgpstream_transport_destroy(bgpstream_transport_t *transport)
@@ -125,5 +150,70 @@ void bgpstream_transport_destroy(bgpstream_transport_t *transport)
 int64_t bgpstream_transport_readline(bgpstream_transport_t *transport,
                                      void *buffer, int64_t len)
 {
-  return transport->readline(transport, buffer, len);
+  uint64_t start = bgpstream_stats_now();
+  int64_t rc = transport->readline(transport, buffer, len);
+
+  count_read(transport, rc, start);
+  return rc;
+}
+
+int bgpstream_transport_get_fd(bgpstream_transport_t *transport)
+{
+  return transport->get_fd(transport);
+}
+
+const char *bgpstream_transport_get_index_path(bgpstream_transport_t *transport)
+{
+  if (transport->get_index_path == NULL) {
+    return NULL;
+  }
+  return transport->get_index_path(transport);
+}
+
+const char *
+bgpstream_transport_get_decoded_path(bgpstream_transport_t *transport)
+{
+  if (transport->get_decoded_path == NULL) {
+    return NULL;
+  }
+  return transport->get_decoded_path(transport);
+}
+
+int bgpstream_transport_is_caching(bgpstream_transport_t *transport)
+{
+  if (transport->is_caching == NULL) {
+    return 0;
+  }
+  return transport->is_caching(transport);
+}
+
+const uint8_t *bgpstream_transport_get_contents(bgpstream_transport_t *transport,
+                                                size_t *len)
+{
+  *len = 0;
+  if (transport->get_contents == NULL) {
+    return NULL;
+  }
+  return transport->get_contents(transport, len);
+}
+
+int bgpstream_transport_can_lend(bgpstream_transport_t *transport)
+{
+  return transport->read_lent != NULL;
+}
+
+int64_t bgpstream_transport_read_lent(bgpstream_transport_t *transport,
+                                      const uint8_t **buffer)
+{
+  uint64_t start;
+  int64_t rc;
+
+  *buffer = NULL;
+  if (transport->read_lent == NULL) {
+    return -1;
+  }
+  start = bgpstream_stats_now();
+  rc = transport->read_lent(transport, buffer);
+  count_read(transport, rc, start);
+  return rc;
 }
@@ -32,6 +32,7 @@
 #ifndef __BGPSTREAM_TRANSPORT_H
 #define __BGPSTREAM_TRANSPORT_H
 
+#include "bgpstream_filter.h"
 #include "bgpstream_resource.h"
 
 /** Generic interface to specific data transport modules */
@@ -40,9 +41,13 @@ typedef struct bgpstream_transport bgpstream_transport_t;
 /** Create a transport handler for the given resource
  *
  * @param res           pointer to a resource
+ * @param filter_mgr    pointer to the filter manager (which also carries the
+ *                      transport options)
  * @return pointer to a transport module instance if successful, NULL otherwise
  */
-bgpstream_transport_t *bgpstream_transport_create(bgpstream_resource_t *res);
+bgpstream_transport_t *
+bgpstream_transport_create(bgpstream_resource_t *res,
+                           bgpstream_filter_mgr_t *filter_mgr);
 
 /** Read from the given transport handler
  *
@@ -60,6 +65,67 @@ int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
 int64_t bgpstream_transport_readline(bgpstream_transport_t *transport,
                                      void *buffer, int64_t len);
 
+/** Get a pollable file descriptor for the given transport handler
+ *
+ * @param transport     pointer to a transport handler
+ * @return a file descriptor that becomes readable when new data is available,
+ * or -1 if the transport does not support readiness notification
+ */
+int bgpstream_transport_get_fd(bgpstream_transport_t *transport);
+
+/** Get the path of a sidecar index file for the given transport handler
+ *
+ * @param transport     pointer to a transport handler
+ * @return borrowed pointer to a path that an index of the resource contents
+ * may be loaded from and saved to, or NULL if not supported
+ */
+const char *bgpstream_transport_get_index_path(bgpstream_transport_t *transport);
+
+/** Get the path of a sidecar decoded record cache for the given transport
+ * handler
+ *
+ * @param transport     pointer to a transport handler
+ * @return borrowed pointer to a path that the decoded records of the resource
+ * may be loaded from and saved to, or NULL if not enabled
+ */
+const char *
+bgpstream_transport_get_decoded_path(bgpstream_transport_t *transport);
+
+/** Check whether reading the given transport handler to the end will store a
+ * local copy of its resource
+ *
+ * @param transport     pointer to a transport handler
+ * @return 1 if a local copy is being written, 0 otherwise
+ */
+int bgpstream_transport_is_caching(bgpstream_transport_t *transport);
+
+/** Get the entire contents of the resource read by the given transport handler
+ * @param transport     pointer to a transport handler
+ * @param[out] len      set to the length of the contents
+ * @return borrowed pointer to the contents (valid until the transport is
+ * destroyed), or NULL if the transport has to be read from instead
+ */
+const uint8_t *bgpstream_transport_get_contents(bgpstream_transport_t *transport,
+                                                size_t *len);
+
+/** Check whether the given transport handler can lend its messages
+ *
+ * @param transport     pointer to a transport handler
+ * @return 1 if bgpstream_transport_read_lent may be used, 0 otherwise
+ */
+int bgpstream_transport_can_lend(bgpstream_transport_t *transport);
+
+/** Read the next message from the given transport handler without copying it
+ *
+ * @param transport     pointer to a transport handler to read from
+ * @param[out] buffer   set to a borrowed pointer to the message (valid until
+ *                      the next read from the transport)
+ * @return the length of the message if successful, 0 if no message is
+ * available, -1 otherwise
+ */
+int64_t bgpstream_transport_read_lent(bgpstream_transport_t *transport,
+                                      const uint8_t **buffer);
+
 /** Shutdown and destroy the given transport handler
  *
  * @param transport     pointer to a transport handler to destroy
@@ -53,12 +53,14 @@
                                      uint8_t *buffer, int64_t len);            \
   int64_t bs_transport_##name##_readline(bgpstream_transport_t *t,             \
                                          uint8_t *buffer, int64_t len);        \
+  int bs_transport_##name##_get_fd(bgpstream_transport_t *t);                  \
   void bs_transport_##name##_destroy(bgpstream_transport_t *t);
 
 #define BS_TRANSPORT_SET_METHODS(classname, transport)                         \
   do {                                                                         \
     (transport)->read = bs_transport_##classname##_read;                       \
     (transport)->readline = bs_transport_##classname##_readline;               \
+    (transport)->get_fd = bs_transport_##classname##_get_fd;                   \
     (transport)->destroy = bs_transport_##classname##_destroy;                 \
   } while (0)
 
@@ -89,6 +91,84 @@ struct bgpstream_transport {
   int64_t (*readline)(struct bgpstream_transport *t, uint8_t *buffer,
                       int64_t len);
 
+  /** Get a file descriptor that becomes readable when new data arrives
+   *
+   * @param t           The data transport object to get the descriptor for
+   * @return a pollable file descriptor, or -1 if the transport does not
+   * support readiness notification
+   *
+   * This is only useful for stream transports that may have no data ready
+   * (i.e., cause the reader to return AGAIN). The descriptor is owned by the
+   * transport and must not be read from or closed by the caller.
+   */
+  int (*get_fd)(struct bgpstream_transport *t);
+
+  /** Get the path of a sidecar file that formats may use to store an index of
+   * this resource's contents (optional, may be NULL)
+   *
+   * @param t           The data transport object to get the path for
+   * @return borrowed pointer to a path, or NULL if no index can be stored
+   *
+   * Transports that keep a persistent copy of the resource (i.e., the cache
+   * transport) set this so that the index can be reused when the resource is
+   * read again.
+   */
+  const char *(*get_index_path)(struct bgpstream_transport *t);
+
+  /** Get the path of a sidecar file that formats may use to store the
+   * decoded records of this resource (optional, may be NULL)
+   *
+   * @param t           The data transport object to get the path for
+   * @return borrowed pointer to a path, or NULL if decoded records should not
+   * be stored
+   *
+   * Like get_index_path, but a path is only returned when the user has asked
+   * for decoded records to be cached, since they take much more space than
+   * the index.
+   */
+  const char *(*get_decoded_path)(struct bgpstream_transport *t);
+
+  /** Check whether reading this resource to the end will store a local copy
+   * of it (optional, may be NULL)
+   *
+   * @param t           The data transport object to check
+   * @return 1 if a local copy is being written, 0 otherwise
+   *
+   * This lets resources be downloaded ahead of time: if the cache transport
+   * finds the resource already cached, there is nothing to do.
+   */
+  int (*is_caching)(struct bgpstream_transport *t);
+
+  /** Get the entire contents of this resource as one block of memory
+   * (optional, may be NULL)
+   *
+   * @param t           The data transport object to get the contents of
+   * @param[out] len    set to the length of the contents
+   * @return borrowed pointer to the contents, or NULL if not available
+   *
+   * Transports that can provide the (uncompressed) resource without copying it
+   * (i.e., the file transport for local uncompressed files, using mmap) set
+   * this so that formats can parse the data in place. The contents remain
+   * valid until the transport is destroyed. Once a caller has used the
+   * contents it must not also use the read methods.
+   */
+  const uint8_t *(*get_contents)(struct bgpstream_transport *t, size_t *len);
+
+  /** Read the next message from this transport without copying it
+   * (optional, may be NULL)
+   *
+   * @param t           The data transport object to read from
+   * @param[out] buffer set to a borrowed pointer to the message
+   * @return the length of the message if successful, 0 if there is no message
+   * available, -1 otherwise
+   *
+   * Message-based transports (i.e., Kafka) set this so that formats can parse
+   * each message from the transport's own buffer. The message is held by the
+   * transport until the next read (of either kind) or until the transport is
+   * destroyed, at which point it is released.
+   */
+  int64_t (*read_lent)(struct bgpstream_transport *t, const uint8_t **buffer);
+
   /** Shutdown and free this data transport
    *
    * @param transport   The data transport object to free
@@ -110,6 +190,10 @@ struct bgpstream_transport {
   /** Pointer to the resource the transport is reading from */
   bgpstream_resource_t *res;
 
+  /** Pointer to the filter manager, which also carries the transport options
+      (e.g., the number of decompression threads) */
+  bgpstream_filter_mgr_t *filter_mgr;
+
   /** An opaque pointer to transport-specific state if needed by the
       transport */
   void *state;
@@ -30,7 +30,10 @@
  */
 
 #include "bsdi_broker.h"
+#include "bgpstream_http.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_trace.h"
 #include "config.h"
 #include "utils.h"
 #include "jsmn_utils.h"
@@ -42,10 +45,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
-#include <wandio.h>
 
 #if WITH_KAFKA
 #include "transports/bs_transport_kafka.h"
@@ -61,6 +65,9 @@ enum {
   OPTION_BROKER_URL,
   OPTION_PARAM,
   OPTION_CACHE_DIR,
+  OPTION_CACHE_COMPRESSION,
+  OPTION_CACHE_DECODED,
+  OPTION_CACHE_MAX_SIZE,
 #if WITH_KAFKA
   OPTION_KAFKA_GROUP,
   OPTION_KAFKA_OFFSET,
@@ -85,10 +92,36 @@ static bgpstream_data_interface_option_t options[] = {
   },
   /* Broker Cache */
   {
-    BGPSTREAM_DATA_INTERFACE_BROKER,             // interface ID
-    OPTION_CACHE_DIR,                            // internal ID
-    "cache-dir",                                 // name
-    "Enable local cache at provided directory.", // description
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_DIR,                // internal ID
+    "cache-dir",                     // name
+    "Enable local cache at provided directory (broker responses for "
+    "windows that ended over a day ago are cached too).", // description
+  },
+  /* Broker Cache compression */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_COMPRESSION,        // internal ID
+    "cache-compression",             // name
+    "Codec to store cache files with: gzip (default), zstd, lz4 or none "
+    "(zstd and lz4 are much faster to read back).", // description
+  },
+  /* Broker Cache of decoded records */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_DECODED,            // internal ID
+    "cache-decoded",                 // name
+    "Also cache decoded MRT records, so that cached dumps are read back "
+    "without parsing them: on or off (default).", // description
+  },
+  /* Broker Cache size limit */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_MAX_SIZE,           // internal ID
+    "cache-max-size",                // name
+    "Evict least recently used files once the cache is larger than this "
+    "many bytes (K, M, G and T suffixes allowed; default: unlimited).",
+    // description
   },
 #if WITH_KAFKA
   /* Kafka group */
@@ -123,6 +156,34 @@ BSDI_CREATE_CLASS(
    this) */
 #define URL_BUFLEN 4096
 
+/* A broker query that runs in the background while the resources returned
+   by the previous query are being read */
+typedef struct prefetch {
+
+  pthread_t thread;
+
+  // protects cancelled and done
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  // query url (including the window parameters)
+  char *url;
+
+  // time before which the query should not be sent (0 to send it right away)
+  uint32_t not_before;
+
+  // has the query been abandoned?
+  int cancelled;
+
+  // has the thread finished?
+  int done;
+
+  // response body (NULL if the query failed)
+  char *js;
+  size_t jslen;
+
+} prefetch_t;
+
 typedef struct bsdi_broker_state {
 
   /* user-provided options: */
@@ -139,6 +200,15 @@ typedef struct bsdi_broker_state {
   // User-specified location for cache: NULL means cache disabled
   char *cache_dir;
 
+  // User-specified codec for cache files: NULL means the default
+  char *cache_compression;
+
+  // Should decoded records also be cached?
+  int cache_decoded;
+
+  // User-specified cache size limit in bytes: NULL means unlimited
+  char *cache_max_size;
+
 #if WITH_KAFKA
   // Kafka group name
   char *kafka_group;
@@ -166,11 +236,31 @@ typedef struct bsdi_broker_state {
   // the max (file_time + duration) that we have seen
   uint32_t current_window_end;
 
+  // the duration of the file that set current_window_end
+  uint32_t current_window_duration;
+
+  // number of resources in the last response from the broker
+  int last_response_cnt;
+
+  // query for the next window
+  prefetch_t *prefetch;
+
 } bsdi_broker_state_t;
 
 // the max time we will wait between retries to the broker
 #define MAX_WAIT_TIME 900
 
+// in live mode, the min time between (background) queries that return nothing
+#define LIVE_MIN_WAIT_TIME 15
+
+// files may still be added to windows that ended less than this long ago, so
+// responses for them are not cached
+#define RESPONSE_CACHE_MIN_AGE 86400
+
+// most time intervals that are sent to the broker one by one (each takes ~35
+// bytes of the query url)
+#define MAX_QUERY_INTERVALS 64
+
 enum {
   ERR_FATAL = -1,
   ERR_RETRY = -2,
@@ -212,17 +302,12 @@ static void unescape_char(char *url, char c)
 
 #define NEXT_TOK t++
 
-static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
-                        size_t count)
+// push the resource described by the dumpFile object at t
+static int process_resource(bsdi_t *di, const char *js, jsmntok_t *t)
 {
-  int i, j, k, l, m;
-  jsmntok_t *t = root_tok + 1;
-
-  int arr_len, obj_len, attr_len;
-
-  int time_set = 0;
+  int k, m;
+  int obj_len, attr_len;
 
-  // per-file info
   char *url = NULL;
   size_t url_len = 0;
   int url_set = 0;
@@ -240,12 +325,302 @@ static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
   int initial_time_set = 0;
   unsigned long duration = 0;
   int duration_set = 0;
+  unsigned long size = 0;
   char *kafka_topic = NULL;
   size_t topic_len = 0;
 
   // local cache related variables.
   bgpstream_resource_t *res = NULL;
 
+  jsmn_type_assert(t, JSMN_OBJECT);
+  obj_len = t->size;
+  NEXT_TOK;
+
+  for (k = 0; k < obj_len; k++) {
+    if (jsmn_streq(js, t, "url") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      if (url_len < (t->end - t->start + 1)) {
+        url_len = t->end - t->start + 1;
+        if ((url = realloc(url, url_len)) == NULL) {
+          bgpstream_log(BGPSTREAM_LOG_ERR,
+                        "Could not realloc URL string");
+          goto err;
+        }
+      }
+      jsmn_strcpy(url, t, js);
+      unescape_char(url,'/');
+      url_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "project") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      jsmn_strcpy(project, t, js);
+      project_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "collector") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      jsmn_strcpy(collector, t, js);
+      collector_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "type") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      if (jsmn_streq(js, t, "ribs") == 1) {
+        type = BGPSTREAM_RIB;
+      } else if (jsmn_streq(js, t, "updates") == 1) {
+        type = BGPSTREAM_UPDATE;
+      } else {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid type '%.*s'",
+                      t->end - t->start, js + t->start);
+        goto err;
+      }
+      type_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "initialTime") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_PRIMITIVE);
+      jsmn_strtoul(&initial_time, js, t);
+      initial_time_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "duration") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_PRIMITIVE);
+      jsmn_strtoul(&duration, js, t);
+      duration_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "size") == 1) {
+      // optional
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_PRIMITIVE);
+      jsmn_strtoul(&size, js, t);
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "transport") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      if (jsmn_streq(js, t, "file") == 1) {
+        transport_type = BGPSTREAM_RESOURCE_TRANSPORT_FILE;
+      } else if (jsmn_streq(js, t, "http") == 1) {
+        transport_type = BGPSTREAM_RESOURCE_TRANSPORT_HTTP;
+      } else if (jsmn_streq(js, t, "kafka") == 1) {
+        transport_type = BGPSTREAM_RESOURCE_TRANSPORT_KAFKA;
+      } else if (jsmn_streq(js, t, "websocket") == 1) {
+        transport_type = BGPSTREAM_RESOURCE_TRANSPORT_WEBSOCKET;
+      } else {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid transport type '%.*s'",
+                      t->end - t->start, js + t->start);
+        goto err;
+      }
+      transport_type_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "format") == 1) {
+      NEXT_TOK;
+      jsmn_type_assert(t, JSMN_STRING);
+      if (jsmn_streq(js, t, "mrt") == 1) {
+        format_type = BGPSTREAM_RESOURCE_FORMAT_MRT;
+      } else if (jsmn_streq(js, t, "ris-live") == 1) {
+        format_type = BGPSTREAM_RESOURCE_FORMAT_RISLIVE;
+      } else if (jsmn_streq(js, t, "bmp") == 1) {
+        format_type = BGPSTREAM_RESOURCE_FORMAT_BMP;
+      } else {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid format type '%.*s'",
+                      t->end - t->start, js + t->start);
+        goto err;
+      }
+      format_type_set = 1;
+      NEXT_TOK;
+    } else if (jsmn_streq(js, t, "attr") == 1) {
+      NEXT_TOK;
+      attr_len = t->size;
+      NEXT_TOK;
+      for (m = 0; m < attr_len; m++) {
+        if (jsmn_streq(js, t, "kafka-topics") == 1) {
+          NEXT_TOK;
+          jsmn_type_assert(t, JSMN_STRING);
+          if (topic_len < (t->end - t->start + 1)) {
+            topic_len = t->end - t->start + 1;
+            if ((kafka_topic = realloc(kafka_topic, topic_len)) == NULL) {
+              bgpstream_log(BGPSTREAM_LOG_ERR,
+                            "Could not realloc kafka topic string");
+              goto err;
+            }
+          }
+          jsmn_strcpy(kafka_topic, t, js);
+          unescape_char(kafka_topic, '\\');
+          url_set = 1;
+          NEXT_TOK;
+        } else {
+          bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown field '%.*s'",
+                        t->end - t->start, js + t->start);
+          goto err;
+        }
+      }
+    } else {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown field '%.*s'",
+                    t->end - t->start, js + t->start);
+      goto err;
+    }
+  }
+
+#ifdef BROKER_DEBUG
+  bgpstream_log(BGPSTREAM_LOG_INFO, "----------");
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Transport Type: %d", transport_type);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Format Type: %d", format_type);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "URL: %s", url);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Project: %s", project);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Collector: %s", collector);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Type: %d", type);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "InitialTime: %lu", initial_time);
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Duration: %lu", duration);
+  if(kafka_topic != NULL){
+    bgpstream_log(BGPSTREAM_LOG_INFO, "Kafka topic: %s", kafka_topic);
+  }
+#endif
+  if (url_set == 0 || project_set == 0 || collector_set == 0 ||
+      type_set == 0 || initial_time_set == 0 || duration_set == 0 ||
+      format_type_set == 0 || transport_type_set == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid resource record");
+    goto retry;
+  }
+
+
+#ifndef WITH_KAFKA
+  // we are built without kafka support, so ignore kafka resources
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_KAFKA) {
+    bgpstream_log(
+      BGPSTREAM_LOG_WARN,
+      "Skipping unsuported kafka-based resource (rebuild libbgpstream "
+      "with kafka support to handle this resource)");
+    goto done;
+  }
+#endif
+
+  // do we need to update our current_window_end?
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_FILE){
+
+    if(initial_time + duration > STATE->current_window_end) {
+      STATE->current_window_end = (initial_time + duration);
+      STATE->current_window_duration = duration;
+    }
+
+    if(STATE->cache_dir != NULL){
+      transport_type = BGPSTREAM_RESOURCE_TRANSPORT_CACHE;
+    }
+  }
+
+  if (bgpstream_resource_mgr_push(BSDI_GET_RES_MGR(di), transport_type,
+                                  format_type, url,
+                                  initial_time, duration, project,
+                                  collector, type, &res) < 0) {
+
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Unable to push resource");
+    goto err;
+  }
+  STATE->last_response_cnt++;
+  if (res != NULL) {
+    res->size = size;
+  }
+
+#if WITH_KAFKA
+  // handle kafka-specific configuration
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_KAFKA) {
+    if (kafka_topic == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Missing bmp kafka topic from the broker");
+      goto err;
+    }
+    if (bgpstream_resource_set_attr(
+          res, BGPSTREAM_RESOURCE_ATTR_KAFKA_TOPICS, kafka_topic) !=
+        0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Unable to set kafka topic to %s", kafka_topic);
+      goto err;
+    }
+
+    if (STATE->kafka_group != NULL &&
+        bgpstream_resource_set_attr(
+          res, BGPSTREAM_RESOURCE_ATTR_KAFKA_CONSUMER_GROUP,
+          STATE->kafka_group) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Unable to set kafka group to %s", STATE->kafka_group);
+      goto err;
+    }
+
+    if (STATE->kafka_offset != NULL &&
+        bgpstream_resource_set_attr(
+          res, BGPSTREAM_RESOURCE_ATTR_KAFKA_INIT_OFFSET,
+          STATE->kafka_offset) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Unable to set kafka offset to %s",
+                    STATE->kafka_offset);
+      goto err;
+    }
+  }
+#endif
+
+  // set cache attribute to resource
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+      bgpstream_resource_set_attr(res,
+                                  BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH,
+                                  STATE->cache_dir) != 0) {
+    goto fatal;
+  }
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+      STATE->cache_compression != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_CACHE_COMPRESSION,
+        STATE->cache_compression) != 0) {
+    goto fatal;
+  }
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+      STATE->cache_decoded != 0 &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_CACHE_DECODED, "on") != 0) {
+    goto fatal;
+  }
+  if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+      STATE->cache_max_size != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_CACHE_MAX_SIZE,
+        STATE->cache_max_size) != 0) {
+    goto fatal;
+  }
+
+done:
+  free(url);
+  free(kafka_topic);
+  return 0;
+
+retry:
+  free(url);
+  free(kafka_topic);
+  return ERR_RETRY;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR,
+                "Invalid JSON response received from broker");
+  free(url);
+  free(kafka_topic);
+  return ERR_RETRY;
+
+fatal:
+  free(url);
+  free(kafka_topic);
+  return ERR_FATAL;
+}
+
+static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
+                        size_t count)
+{
+  int i, j, l;
+  jsmntok_t *t = root_tok + 1;
+
+  int arr_len;
+  int rc;
+
+  int time_set = 0;
+
   if (count == 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Empty JSON response from broker");
     goto retry;
@@ -304,234 +679,10 @@ static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
         arr_len = t->size; // number of dump files
         NEXT_TOK;          // first elem in array
         for (j = 0; j < arr_len; j++) {
-          jsmn_type_assert(t, JSMN_OBJECT);
-          obj_len = t->size;
-          NEXT_TOK;
-
-          url_set = 0;
-          project_set = 0;
-          collector_set = 0;
-          type_set = 0;
-          initial_time_set = 0;
-          duration_set = 0;
-
-          for (k = 0; k < obj_len; k++) {
-            if (jsmn_streq(js, t, "url") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              if (url_len < (t->end - t->start + 1)) {
-                url_len = t->end - t->start + 1;
-                if ((url = realloc(url, url_len)) == NULL) {
-                  bgpstream_log(BGPSTREAM_LOG_ERR,
-                                "Could not realloc URL string");
-                  goto err;
-                }
-              }
-              jsmn_strcpy(url, t, js);
-              unescape_char(url,'/');
-              url_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "project") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              jsmn_strcpy(project, t, js);
-              project_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "collector") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              jsmn_strcpy(collector, t, js);
-              collector_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "type") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              if (jsmn_streq(js, t, "ribs") == 1) {
-                type = BGPSTREAM_RIB;
-              } else if (jsmn_streq(js, t, "updates") == 1) {
-                type = BGPSTREAM_UPDATE;
-              } else {
-                bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid type '%.*s'",
-                              t->end - t->start, js + t->start);
-                goto err;
-              }
-              type_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "initialTime") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_PRIMITIVE);
-              jsmn_strtoul(&initial_time, js, t);
-              initial_time_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "duration") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_PRIMITIVE);
-              jsmn_strtoul(&duration, js, t);
-              duration_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "transport") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              if (jsmn_streq(js, t, "file") == 1) {
-                transport_type = BGPSTREAM_RESOURCE_TRANSPORT_FILE;
-              } else if (jsmn_streq(js, t, "http") == 1) {
-                transport_type = BGPSTREAM_RESOURCE_TRANSPORT_HTTP;
-              } else if (jsmn_streq(js, t, "kafka") == 1) {
-                transport_type = BGPSTREAM_RESOURCE_TRANSPORT_KAFKA;
-              } else {
-                bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid transport type '%.*s'",
-                              t->end - t->start, js + t->start);
-                goto err;
-              }
-              transport_type_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "format") == 1) {
-              NEXT_TOK;
-              jsmn_type_assert(t, JSMN_STRING);
-              if (jsmn_streq(js, t, "mrt") == 1) {
-                format_type = BGPSTREAM_RESOURCE_FORMAT_MRT;
-              } else if (jsmn_streq(js, t, "ris-live") == 1) {
-                format_type = BGPSTREAM_RESOURCE_FORMAT_RISLIVE;
-              } else if (jsmn_streq(js, t, "bmp") == 1) {
-                format_type = BGPSTREAM_RESOURCE_FORMAT_BMP;
-              } else {
-                bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid format type '%.*s'",
-                              t->end - t->start, js + t->start);
-                goto err;
-              }
-              format_type_set = 1;
-              NEXT_TOK;
-            } else if (jsmn_streq(js, t, "attr") == 1) {
-              NEXT_TOK;
-              attr_len = t->size;
-              NEXT_TOK;
-              for (m = 0; m < attr_len; m++) {
-                if (jsmn_streq(js, t, "kafka-topics") == 1) {
-                  NEXT_TOK;
-                  jsmn_type_assert(t, JSMN_STRING);
-                  if (topic_len < (t->end - t->start + 1)) {
-                    topic_len = t->end - t->start + 1;
-                    if ((kafka_topic = realloc(kafka_topic, topic_len)) == NULL) {
-                      bgpstream_log(BGPSTREAM_LOG_ERR,
-                                    "Could not realloc kafka topic string");
-                      goto err;
-                    }
-                  }
-                  jsmn_strcpy(kafka_topic, t, js);
-                  unescape_char(kafka_topic, '\\');
-                  url_set = 1;
-                  NEXT_TOK;
-                } else {
-                  bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown field '%.*s'",
-                                t->end - t->start, js + t->start);
-                  goto err;
-                }
-              }
-            } else {
-              bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown field '%.*s'",
-                            t->end - t->start, js + t->start);
-              goto err;
-            }
-          }
-
-#ifdef BROKER_DEBUG
-          bgpstream_log(BGPSTREAM_LOG_INFO, "----------");
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Transport Type: %d", transport_type);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Format Type: %d", format_type);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "URL: %s", url);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Project: %s", project);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Collector: %s", collector);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Type: %d", type);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "InitialTime: %lu", initial_time);
-          bgpstream_log(BGPSTREAM_LOG_INFO, "Duration: %lu", duration);
-          if(kafka_topic != NULL){
-            bgpstream_log(BGPSTREAM_LOG_INFO, "Kafka topic: %s", kafka_topic);
-          }
-#endif
-          if (url_set == 0 || project_set == 0 || collector_set == 0 ||
-              type_set == 0 || initial_time_set == 0 || duration_set == 0 ||
-              format_type_set == 0 || transport_type_set == 0) {
-            bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid resource record");
-            goto retry;
-          }
-
-
-#ifndef WITH_KAFKA
-          // we are built without kafka support, so ignore kafka resources
-          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_KAFKA) {
-            bgpstream_log(
-              BGPSTREAM_LOG_WARN,
-              "Skipping unsuported kafka-based resource (rebuild libbgpstream "
-              "with kafka support to handle this resource)");
-            continue;
-          }
-#endif
-
-          // do we need to update our current_window_end?
-          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_FILE){
-
-            if(initial_time + duration > STATE->current_window_end) {
-              STATE->current_window_end = (initial_time + duration);
-            }
-
-            if(STATE->cache_dir != NULL){
-              transport_type = BGPSTREAM_RESOURCE_TRANSPORT_CACHE;
-            }
-          }
-
-          if (bgpstream_resource_mgr_push(BSDI_GET_RES_MGR(di), transport_type,
-                                          format_type, url,
-                                          initial_time, duration, project,
-                                          collector, type, &res) < 0) {
-
-            bgpstream_log(BGPSTREAM_LOG_ERR, "Unable to push resource");
-            goto err;
-          }
-
-#if WITH_KAFKA
-          // handle kafka-specific configuration
-          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_KAFKA) {
-            if (kafka_topic == NULL) {
-              bgpstream_log(BGPSTREAM_LOG_ERR,
-                            "Missing bmp kafka topic from the broker");
-              goto err;
-            }
-            if (bgpstream_resource_set_attr(
-                  res, BGPSTREAM_RESOURCE_ATTR_KAFKA_TOPICS, kafka_topic) !=
-                0) {
-              bgpstream_log(BGPSTREAM_LOG_ERR,
-                            "Unable to set kafka topic to %s", kafka_topic);
-              goto err;
-            }
-
-            if (STATE->kafka_group != NULL &&
-                bgpstream_resource_set_attr(
-                  res, BGPSTREAM_RESOURCE_ATTR_KAFKA_CONSUMER_GROUP,
-                  STATE->kafka_group) != 0) {
-              bgpstream_log(BGPSTREAM_LOG_ERR,
-                            "Unable to set kafka group to %s", STATE->kafka_group);
-              goto err;
-            }
-
-            if (STATE->kafka_offset != NULL &&
-                bgpstream_resource_set_attr(
-                  res, BGPSTREAM_RESOURCE_ATTR_KAFKA_INIT_OFFSET,
-                  STATE->kafka_offset) != 0) {
-              bgpstream_log(BGPSTREAM_LOG_ERR,
-                            "Unable to set kafka offset to %s",
-                            STATE->kafka_offset);
-              goto err;
-            }
-          }
-#endif
-
-          // set cache attribute to resource
-          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
-              bgpstream_resource_set_attr(res,
-                                          BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH,
-                                          STATE->cache_dir) != 0) {
-            return -1;
+          if ((rc = process_resource(di, js, t)) != 0) {
+            return rc;
           }
+          t = jsmn_skip(t);
         }
       }
     }
@@ -540,46 +691,39 @@ static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
     goto err;
   }
 
-  free(url);
-  free(kafka_topic);
   return 0;
 
 retry:
-  free(url);
   return ERR_RETRY;
 
 err:
   bgpstream_log(BGPSTREAM_LOG_ERR,
                 "Invalid JSON response received from broker");
-  free(url);
   return ERR_RETRY;
 }
 
-static int read_json(bsdi_t *di, io_t *jsonfile)
+// download the whole response to the given query. the caller must free js
+static int fetch_json(const char *url, char **js, size_t *jslen)
 {
-  jsmn_parser p;
-  jsmntok_t *tok = NULL;
-  size_t tokcount = 128;
-
-  int ret;
-  char *js = NULL;
-  size_t jslen = 0;
+  bgpstream_http_t *jsonfile;
+  char *tmp;
+  int64_t ret;
 #define BUFSIZE 1024
   char buf[BUFSIZE];
 
-  // prepare parser
-  jsmn_init(&p);
+  *js = NULL;
+  *jslen = 0;
 
-  // allocate some tokens to start
-  if ((tok = malloc(sizeof(jsmntok_t) * tokcount)) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not malloc initial tokens");
-    goto err;
+  // queries reuse the (keep-alive) connection of the previous query
+  if ((jsonfile = bgpstream_http_open(url, NULL, 0)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading", url);
+    return ERR_RETRY;
   }
 
   // slurp the whole file into a buffer
   while (1) {
     /* do a read */
-    ret = wandio_read(jsonfile, buf, BUFSIZE);
+    ret = bgpstream_http_read(jsonfile, (uint8_t *)buf, BUFSIZE);
     if (ret < 0) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Reading from broker failed");
       goto err;
@@ -588,48 +732,462 @@ static int read_json(bsdi_t *di, io_t *jsonfile)
       // we're done
       break;
     }
-    if ((js = realloc(js, jslen + ret + 1)) == NULL) {
+    if ((tmp = realloc(*js, *jslen + ret + 1)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc json string");
       goto err;
     }
-    strncpy(js + jslen, buf, ret);
-    jslen += ret;
+    *js = tmp;
+    memcpy(*js + *jslen, buf, ret);
+    *jslen += ret;
+  }
+  if (*js == NULL && (*js = malloc(1)) == NULL) {
+    goto err;
   }
-  js[jslen] = '\0';
+  (*js)[*jslen] = '\0';
+
+  bgpstream_http_close(jsonfile);
+  return 0;
+
+err:
+  bgpstream_http_close(jsonfile);
+  free(*js);
+  *js = NULL;
+  *jslen = 0;
+  return ERR_FATAL;
+}
+
+/* The state of a broker response that is being parsed as it is read. Each
+   dumpFile object in data.resources is parsed (and its resource pushed) as
+   soon as it is complete, so only the rest of the response is kept until the
+   end. */
+typedef struct json_splitter {
+
+  // the response so far, with the dumpFile objects removed
+  char *rest;
+  size_t rest_len;
+  size_t rest_alloc;
+
+  // the dumpFile object currently being read
+  char *obj;
+  size_t obj_len;
+  size_t obj_alloc;
+
+  // nesting depth of the current character
+  int depth;
+
+  // are we inside a string, and was the last character an escape?
+  int in_str;
+  int escaped;
+
+  // the last string seen in the root object, and whether we are in the value
+  // of its "data" key
+  char key[16];
+  size_t key_len;
+  int in_data;
+
+  // tokens, reused for each object
+  jsmntok_t *tok;
+  size_t tokcount;
+
+} json_splitter_t;
+
+static int append_char(char **buf, size_t *len, size_t *alloc, char c)
+{
+  char *tmp;
+
+  if (*len + 1 >= *alloc) {
+    if ((tmp = realloc(*buf, *alloc == 0 ? 1024 : *alloc * 2)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc json string");
+      return -1;
+    }
+    *buf = tmp;
+    *alloc = *alloc == 0 ? 1024 : *alloc * 2;
+  }
+  (*buf)[(*len)++] = c;
+  (*buf)[*len] = '\0';
+  return 0;
+}
+
+// tokenize the given string, returning the number of tokens
+static int tokenize(json_splitter_t *js, const char *str, size_t len)
+{
+  jsmn_parser p;
+  jsmntok_t *tmp;
+  int ret;
 
 again:
-  if ((ret = jsmn_parse(&p, js, jslen, tok, tokcount)) < 0) {
+  jsmn_init(&p);
+  if ((ret = jsmn_parse(&p, str, len, js->tok, js->tokcount)) < 0) {
     if (ret == JSMN_ERROR_NOMEM) {
-      tokcount *= 2;
-      if ((tok = realloc(tok, sizeof(jsmntok_t) * tokcount)) == NULL) {
+      if ((tmp = realloc(js->tok, sizeof(jsmntok_t) * js->tokcount * 2)) ==
+          NULL) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc tokens");
-        goto err;
+        return ERR_FATAL;
       }
+      js->tok = tmp;
+      js->tokcount *= 2;
       goto again;
     }
     if (ret == JSMN_ERROR_INVAL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid character in JSON string");
-      goto err;
+      return ERR_FATAL;
     }
     bgpstream_log(BGPSTREAM_LOG_ERR, "JSON parser returned %d", ret);
-    goto err;
+    return ERR_FATAL;
   }
-  ret = process_json(di, js, tok, p.toknext);
+  return (int)p.toknext;
+}
+
+static int split_json(bsdi_t *di, json_splitter_t *js, const char *buf,
+                      size_t len)
+{
+  size_t i;
+  char c;
+  int ret;
+
+  for (i = 0; i < len; i++) {
+    c = buf[i];
+
+    if (js->in_str != 0) {
+      if (js->escaped != 0) {
+        js->escaped = 0;
+      } else if (c == '\\') {
+        js->escaped = 1;
+      } else if (c == '"') {
+        js->in_str = 0;
+      } else if (js->depth == 1 && js->key_len < sizeof(js->key) - 1) {
+        js->key[js->key_len++] = c;
+        js->key[js->key_len] = '\0';
+      }
+    } else {
+      switch (c) {
+      case '"':
+        js->in_str = 1;
+        if (js->depth == 1) {
+          js->key_len = 0;
+          js->key[0] = '\0';
+        }
+        break;
+
+      case '{':
+      case '[':
+        js->depth++;
+        if (js->in_data != 0 && js->depth == 4) {
+          js->obj_len = 0;
+        }
+        break;
+
+      case '}':
+      case ']':
+        if (js->in_data != 0 && js->depth == 4) {
+          // this dumpFile object is complete
+          if (append_char(&js->obj, &js->obj_len, &js->obj_alloc, c) != 0 ||
+              (ret = tokenize(js, js->obj, js->obj_len)) < 0) {
+            return ERR_FATAL;
+          }
+          if (ret == 0 || (ret = process_resource(di, js->obj, js->tok)) != 0) {
+            return ret == 0 ? ERR_RETRY : ret;
+          }
+          js->depth--;
+          continue;
+        }
+        js->depth--;
+        break;
+
+      case ':':
+        if (js->depth == 1) {
+          js->in_data = (strcmp(js->key, "data") == 0);
+        }
+        break;
 
-  free(js);
-  free(tok);
+      case ',':
+        if (js->in_data != 0 && js->depth == 3) {
+          // the objects are removed, so the commas between them must be too
+          continue;
+        }
+        break;
+      }
+    }
+
+    if (js->in_data != 0 && js->depth >= 4) {
+      ret = append_char(&js->obj, &js->obj_len, &js->obj_alloc, c);
+    } else {
+      ret = append_char(&js->rest, &js->rest_len, &js->rest_alloc, c);
+    }
+    if (ret != 0) {
+      return ERR_FATAL;
+    }
+  }
+
+  return 0;
+}
+
+// parse a broker response, either as it is read from jsonfile (also copying
+// it to tee, if not NULL), or from the given (already downloaded) string
+static int read_json(bsdi_t *di, bgpstream_http_t *jsonfile, FILE *tee,
+                     const char *str, size_t len)
+{
+  json_splitter_t js;
+  int64_t ret;
+#define BUFSIZE 1024
+  char buf[BUFSIZE];
+
+  memset(&js, 0, sizeof(js));
+
+  // allocate some tokens to start
+  js.tokcount = 128;
+  if ((js.tok = malloc(sizeof(jsmntok_t) * js.tokcount)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not malloc initial tokens");
+    ret = ERR_FATAL;
+    goto done;
+  }
+
+  if (jsonfile == NULL) {
+    if ((ret = split_json(di, &js, str, len)) != 0) {
+      goto done;
+    }
+  } else {
+    while (1) {
+      /* do a read */
+      ret = bgpstream_http_read(jsonfile, (uint8_t *)buf, BUFSIZE);
+      if (ret < 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Reading from broker failed");
+        ret = ERR_FATAL;
+        goto done;
+      }
+      if (ret == 0) {
+        // we're done
+        break;
+      }
+      if (tee != NULL) {
+        // errors are caught when the file is closed
+        fwrite(buf, 1, ret, tee);
+      }
+      if ((ret = split_json(di, &js, buf, ret)) != 0) {
+        goto done;
+      }
+    }
+  }
+
+  // now handle the rest of the response
+  if (js.rest == NULL && append_char(&js.rest, &js.rest_len, &js.rest_alloc,
+                                     ' ') != 0) {
+    ret = ERR_FATAL;
+    goto done;
+  }
+  if ((ret = tokenize(&js, js.rest, js.rest_len)) < 0) {
+    goto done;
+  }
+  ret = process_json(di, js.rest, js.tok, ret);
+
+done:
+  free(js.rest);
+  free(js.obj);
+  free(js.tok);
   if (ret == ERR_FATAL) {
     bgpstream_log(BGPSTREAM_LOG_ERR,
                   "Received fatal error from process_json");
   }
   return ret;
+}
+
+// get the path that the response to the given query may be cached at, or NULL
+// if it should not be cached. the caller must free the path
+static char *response_cache_path(bsdi_t *di, const char *url)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  uint64_t hash = 14695981039346656037ULL;
+  const char *p;
+  char *path;
+  size_t len;
+
+  // only cache queries for windows that are over
+  if (STATE->cache_dir == NULL || TIF == NULL ||
+      TIF->end_time == BGPSTREAM_FOREVER ||
+      (uint64_t)TIF->end_time + RESPONSE_CACHE_MIN_AGE > (uint64_t)time(NULL)) {
+    return NULL;
+  }
+
+  // FNV-1a hash of the query url. the url is also stored in the file so that
+  // collisions can be detected
+  for (p = url; *p != '\0'; p++) {
+    hash ^= (uint8_t)*p;
+    hash *= 1099511628211ULL;
+  }
+
+  len = strlen(STATE->cache_dir) + sizeof("/broker.0123456789abcdef.json");
+  if ((path = malloc(len)) == NULL) {
+    return NULL;
+  }
+  snprintf(path, len, "%s/broker.%016" PRIx64 ".json", STATE->cache_dir, hash);
+  return path;
+}
+
+// load a cached response to the given query. returns 0 if it was found
+static int load_response(const char *path, const char *url, char **js,
+                         size_t *jslen)
+{
+  FILE *fh;
+  long size;
+  size_t url_len = strlen(url);
+  char *buf = NULL;
+
+  if ((fh = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  if (fseek(fh, 0, SEEK_END) != 0 || (size = ftell(fh)) < 0 ||
+      (size_t)size < url_len + 1 || fseek(fh, 0, SEEK_SET) != 0 ||
+      (buf = malloc(size + 1)) == NULL ||
+      fread(buf, 1, size, fh) != (size_t)size) {
+    goto err;
+  }
+  buf[size] = '\0';
+  fclose(fh);
+
+  // the first line is the query that this is the response to
+  if (strncmp(buf, url, url_len) != 0 || buf[url_len] != '\n') {
+    free(buf);
+    return -1;
+  }
+  *jslen = size - url_len - 1;
+  memmove(buf, buf + url_len + 1, *jslen + 1);
+  *js = buf;
+  return 0;
 
 err:
-  free(js);
-  free(tok);
-  bgpstream_log(BGPSTREAM_LOG_ERR, "%s: Returning fatal error code",
-                __func__);
-  return ERR_FATAL;
+  free(buf);
+  fclose(fh);
+  return -1;
+}
+
+// start writing the response to the given query to the cache. the response is
+// only moved into place by close_response once it has been read successfully
+static FILE *open_response(const char *path, const char *url)
+{
+  char tmp_path[URL_BUFLEN];
+  FILE *fh;
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.temp", path) >=
+        (int)sizeof(tmp_path) ||
+      (fh = fopen(tmp_path, "w")) == NULL) {
+    // not fatal, the response just isn't cached
+    bgpstream_log(BGPSTREAM_LOG_FINE, "Could not cache broker response in %s",
+                  path);
+    return NULL;
+  }
+  fprintf(fh, "%s\n", url);
+  return fh;
+}
+
+static void close_response(const char *path, FILE *fh, int complete)
+{
+  char tmp_path[URL_BUFLEN];
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.temp", path);
+  if (ferror(fh) != 0) {
+    complete = 0;
+  }
+  if (fclose(fh) != 0 || complete == 0 || rename(tmp_path, path) != 0) {
+    remove(tmp_path);
+  }
+}
+
+static void save_response(const char *path, const char *url, const char *js,
+                          size_t jslen)
+{
+  FILE *fh;
+
+  if ((fh = open_response(path, url)) == NULL) {
+    return;
+  }
+  fwrite(js, 1, jslen, fh);
+  close_response(path, fh, 1);
+}
+
+static void *prefetch_thread(void *user)
+{
+  prefetch_t *pf = user;
+  struct timespec ts = {pf->not_before, 0};
+
+  pthread_mutex_lock(&pf->mutex);
+  // in live mode, wait until there could be something new to ask about
+  while (pf->cancelled == 0 && (uint32_t)time(NULL) < pf->not_before) {
+    pthread_cond_timedwait(&pf->cond, &pf->mutex, &ts);
+  }
+  if (pf->cancelled == 0) {
+    pthread_mutex_unlock(&pf->mutex);
+    // if this fails the query is simply made again (with retries) when the
+    // response is needed
+    bgpstream_stats_add(BGPSTREAM_STAT_BROKER_QUERIES, 1);
+    BGPSTREAM_TRACE1(broker__query__start, pf->url);
+    fetch_json(pf->url, &pf->js, &pf->jslen);
+    BGPSTREAM_TRACE2(broker__query__done, pf->url, pf->js != NULL ? 0 : -1);
+    pthread_mutex_lock(&pf->mutex);
+  }
+  pf->done = 1;
+  pthread_mutex_unlock(&pf->mutex);
+  return NULL;
+}
+
+static int prefetch_done(prefetch_t *pf)
+{
+  int done;
+
+  pthread_mutex_lock(&pf->mutex);
+  done = pf->done;
+  pthread_mutex_unlock(&pf->mutex);
+  return done;
+}
+
+// wait for the query to finish (or abandon it) and free it. if js is not NULL,
+// it is set to the response (which the caller must free)
+static void prefetch_destroy(prefetch_t *pf, int cancel, char **js,
+                             size_t *jslen)
+{
+  if (pf == NULL) {
+    return;
+  }
+  if (cancel != 0) {
+    pthread_mutex_lock(&pf->mutex);
+    pf->cancelled = 1;
+    pthread_cond_signal(&pf->cond);
+    pthread_mutex_unlock(&pf->mutex);
+  }
+  pthread_join(pf->thread, NULL);
+  if (js != NULL) {
+    *js = pf->js;
+    *jslen = pf->jslen;
+    pf->js = NULL;
+  }
+  pthread_mutex_destroy(&pf->mutex);
+  pthread_cond_destroy(&pf->cond);
+  free(pf->url);
+  free(pf->js);
+  free(pf);
+}
+
+static prefetch_t *prefetch_create(const char *url, uint32_t not_before)
+{
+  prefetch_t *pf;
+
+  if ((pf = malloc_zero(sizeof(prefetch_t))) == NULL) {
+    return NULL;
+  }
+  if ((pf->url = strdup(url)) == NULL) {
+    free(pf);
+    return NULL;
+  }
+  pf->not_before = not_before;
+  pthread_mutex_init(&pf->mutex, NULL);
+  pthread_cond_init(&pf->cond, NULL);
+  if (pthread_create(&pf->thread, NULL, prefetch_thread, pf) != 0) {
+    pthread_mutex_destroy(&pf->mutex);
+    pthread_cond_destroy(&pf->cond);
+    free(pf->url);
+    free(pf);
+    return NULL;
+  }
+  return pf;
 }
 
 static int update_query_url(bsdi_t *di)
@@ -726,20 +1284,32 @@ static int update_query_url(bsdi_t *di)
 // time_interval
 #define BUFLEN 20
   char int_buf[BUFLEN];
-  if (TIF != NULL) {
+  // ask for each interval if there are only a few of them, otherwise for the
+  // interval that covers them all (and the resources that fall between the
+  // intervals are dropped when they are queued)
+  bgpstream_interval_filter_t *windows = TIF;
+  int windows_cnt = (TIF != NULL);
+  if (filter_mgr->time_windows_cnt > 1 &&
+      filter_mgr->time_windows_cnt <= MAX_QUERY_INTERVALS) {
+    windows = filter_mgr->time_windows;
+    windows_cnt = filter_mgr->time_windows_cnt;
+  }
+  for (i = 0; i < windows_cnt; i++) {
 
     AMPORQ;
     APPEND_STR("intervals[]=");
 
     // BEGIN TIME
-    if (snprintf(int_buf, BUFLEN, "%" PRIu32, TIF->begin_time) >= BUFLEN) {
+    if (snprintf(int_buf, BUFLEN, "%" PRIu32, windows[i].begin_time) >=
+        BUFLEN) {
       goto err;
     }
     APPEND_STR(int_buf);
     APPEND_STR(",");
 
     // END TIME
-    if (snprintf(int_buf, BUFLEN, "%" PRIu32, TIF->end_time) >= BUFLEN) {
+    if (snprintf(int_buf, BUFLEN, "%" PRIu32, windows[i].end_time) >=
+        BUFLEN) {
       goto err;
     }
     APPEND_STR(int_buf);
@@ -756,6 +1326,93 @@ err:
   return -1;
 }
 
+// parse a byte count with an optional K, M, G or T (binary) suffix
+static int parse_size(const char *str, uint64_t *size)
+{
+  char *end;
+  unsigned long long val;
+  int shift = 0;
+
+  errno = 0;
+  val = strtoull(str, &end, 10);
+  if (errno != 0 || end == str || *str == '-') {
+    return -1;
+  }
+  switch (*end) {
+  case 'T':
+  case 't':
+    shift += 10;
+    // fall through
+  case 'G':
+  case 'g':
+    shift += 10;
+    // fall through
+  case 'M':
+  case 'm':
+    shift += 10;
+    // fall through
+  case 'K':
+  case 'k':
+    shift += 10;
+    end++;
+    break;
+  }
+  if (*end != '\0' || val == 0 || val > (UINT64_MAX >> shift)) {
+    return -1;
+  }
+  *size = (uint64_t)val << shift;
+  return 0;
+}
+
+// add the parameters that select the next window to the query url
+static int append_window_params(bsdi_t *di)
+{
+  // we need to set two parameters:
+  //  - dataAddedSince ("time" from last response we got)
+  //  - minInitialTime (max("initialTime"+"duration") of any file we've ever
+  //  seen)
+
+#define BUFLEN 20
+  char buf[BUFLEN];
+
+  if (STATE->last_response_time > 0) {
+    // need to add dataAddedSince
+    if (snprintf(buf, BUFLEN, "%" PRIu32, STATE->last_response_time) >=
+        BUFLEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Could not build dataAddedSince param string");
+      goto err;
+    }
+    AMPORQ;
+    APPEND_STR("dataAddedSince=");
+    APPEND_STR(buf);
+  }
+  if (STATE->current_window_end > 0) {
+    // need to add minInitialTime
+    if (snprintf(buf, BUFLEN, "%" PRIu32, STATE->current_window_end) >=
+        BUFLEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Could not build minInitialTime param string");
+      goto err;
+    }
+    AMPORQ;
+    APPEND_STR("minInitialTime=");
+    APPEND_STR(buf);
+  }
+  return 0;
+
+err:
+  return -1;
+}
+
+// remove the window parameters from the query url
+static void reset_query_url(bsdi_t *di)
+{
+  *STATE->query_url_end = '\0';
+  STATE->query_url_remaining = URL_BUFLEN - strlen(STATE->query_url_buf);
+  STATE->first_param = (strchr(STATE->query_url_buf, '?') == NULL);
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 int bsdi_broker_init(bsdi_t *di)
@@ -787,6 +1444,9 @@ int bsdi_broker_set_option(bsdi_t *di,
                            const bgpstream_data_interface_option_t *option_type,
                            const char *option_value)
 {
+  uint64_t max_size;
+  char size_buf[32];
+
   switch (option_type->id) {
   case OPTION_BROKER_URL:
     // replaces our current URL
@@ -822,6 +1482,47 @@ int bsdi_broker_set_option(bsdi_t *di,
     }
     break;
 
+  case OPTION_CACHE_COMPRESSION:
+    if (strcmp(option_value, "gzip") != 0 &&
+        strcmp(option_value, "zstd") != 0 &&
+        strcmp(option_value, "lz4") != 0 &&
+        strcmp(option_value, "none") != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown cache compression '%s'",
+                    option_value);
+      return -1;
+    }
+    free(STATE->cache_compression);
+    if ((STATE->cache_compression = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    break;
+
+  case OPTION_CACHE_DECODED:
+    if (strcmp(option_value, "on") == 0) {
+      STATE->cache_decoded = 1;
+    } else if (strcmp(option_value, "off") == 0) {
+      STATE->cache_decoded = 0;
+    } else {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Invalid cache-decoded value '%s' (expecting on or off)",
+                    option_value);
+      return -1;
+    }
+    break;
+
+  case OPTION_CACHE_MAX_SIZE:
+    if (parse_size(option_value, &max_size) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid cache size '%s'", option_value);
+      return -1;
+    }
+    // the transport is given the size in plain bytes
+    snprintf(size_buf, sizeof(size_buf), "%" PRIu64, max_size);
+    free(STATE->cache_max_size);
+    if ((STATE->cache_max_size = strdup(size_buf)) == NULL) {
+      return -1;
+    }
+    break;
+
 #if WITH_KAFKA
   case OPTION_KAFKA_GROUP:
     // replaces our current group
@@ -861,6 +1562,9 @@ void bsdi_broker_destroy(bsdi_t *di)
     return;
   }
 
+  prefetch_destroy(STATE->prefetch, 1, NULL, NULL);
+  STATE->prefetch = NULL;
+
   free(STATE->broker_url);
   STATE->broker_url = NULL;
 
@@ -874,6 +1578,12 @@ void bsdi_broker_destroy(bsdi_t *di)
   free(STATE->cache_dir);
   STATE->cache_dir = NULL;
 
+  free(STATE->cache_compression);
+  STATE->cache_compression = NULL;
+
+  free(STATE->cache_max_size);
+  STATE->cache_max_size = NULL;
+
 #if WITH_KAFKA
   free(STATE->kafka_group);
   STATE->kafka_group = NULL;
@@ -888,49 +1598,77 @@ void bsdi_broker_destroy(bsdi_t *di)
 
 int bsdi_broker_update_resources(bsdi_t *di)
 {
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  int live = (TIF != NULL && TIF->end_time == BGPSTREAM_FOREVER);
+  uint32_t now;
+  uint32_t not_before = 0;
 
-  // we need to set two parameters:
-  //  - dataAddedSince ("time" from last response we got)
-  //  - minInitialTime (max("initialTime"+"duration") of any file we've ever
-  //  seen)
-
-#define BUFLEN 20
-  char buf[BUFLEN];
+  bgpstream_http_t *jsonfile = NULL;
+  char *js = NULL;
+  size_t jslen = 0;
 
-  io_t *jsonfile = NULL;
+  char *cache_path = NULL;
+  int from_cache = 0;
+  FILE *tee;
 
   int rc;
   int attempts = 0;
   int wait_time = 1;
 
   int success = 0;
+  uint64_t start = bgpstream_stats_now();
 
-  if (STATE->last_response_time > 0) {
-    // need to add dataAddedSince
-    if (snprintf(buf, BUFLEN, "%" PRIu32, STATE->last_response_time) >=
-        BUFLEN) {
-      bgpstream_log(BGPSTREAM_LOG_ERR,
-                    "Could not build dataAddedSince param string");
-      goto err;
+  if (append_window_params(di) != 0) {
+    goto err;
+  }
+
+  // responses to queries for closed windows never change, so they may be
+  // loaded from the cache rather than asking the broker again
+  if ((cache_path = response_cache_path(di, STATE->query_url_buf)) != NULL &&
+      load_response(cache_path, STATE->query_url_buf, &js, &jslen) == 0) {
+    bgpstream_log(BGPSTREAM_LOG_FINE, "Using cached broker response %s",
+                  cache_path);
+    from_cache = 1;
+    prefetch_destroy(STATE->prefetch, 1, NULL, NULL);
+    STATE->prefetch = NULL;
+  }
+
+  if (STATE->prefetch != NULL) {
+    if (strcmp(STATE->prefetch->url, STATE->query_url_buf) != 0) {
+      // we've moved on since this query was started
+      prefetch_destroy(STATE->prefetch, 1, NULL, NULL);
+    } else if (live != 0 && prefetch_done(STATE->prefetch) == 0) {
+      // the broker hasn't been asked (or hasn't answered) yet. rather than
+      // blocking the stream, report that there is nothing new for now
+      reset_query_url(di);
+      free(cache_path);
+      return 0;
+    } else {
+      // wait for the response (if it hasn't already arrived) and use it
+      prefetch_destroy(STATE->prefetch, 0, &js, &jslen);
     }
-    AMPORQ;
-    APPEND_STR("dataAddedSince=");
-    APPEND_STR(buf);
+    STATE->prefetch = NULL;
   }
-  if (STATE->current_window_end > 0) {
-    // need to add minInitialTime
-    if (snprintf(buf, BUFLEN, "%" PRIu32, STATE->current_window_end) >=
-        BUFLEN) {
+
+  STATE->last_response_cnt = 0;
+  if (js != NULL) {
+    rc = read_json(di, NULL, NULL, js, jslen);
+    if (rc == 0 && from_cache == 0 && cache_path != NULL) {
+      save_response(cache_path, STATE->query_url_buf, js, jslen);
+    }
+    free(js);
+    js = NULL;
+    if (rc == ERR_FATAL) {
       bgpstream_log(BGPSTREAM_LOG_ERR,
-                    "Could not build minInitialTime param string");
+                    "Received fatal error code from read_json");
       goto err;
+    } else if (rc == 0) {
+      success = 1;
     }
-    AMPORQ;
-    APPEND_STR("minInitialTime=");
-    APPEND_STR(buf);
+    // otherwise, make the query again in the usual way
   }
 
-  do {
+  while (success == 0) {
     if (attempts > 0) {
       bgpstream_log(BGPSTREAM_LOG_WARN,
                     "WARN: Broker request failed, waiting %ds before retry",
@@ -941,45 +1679,86 @@ int bsdi_broker_update_resources(bsdi_t *di)
       }
     }
     attempts++;
+    bgpstream_stats_add(BGPSTREAM_STAT_BROKER_QUERIES, 1);
 
 #ifdef BROKER_DEBUG
     bgpstream_log(BGPSTREAM_LOG_INFO, "Query URL: \"%s\"",
                   STATE->query_url_buf);
 #endif
 
-    if ((jsonfile = wandio_create(STATE->query_url_buf)) == NULL) {
+    // queries reuse the (keep-alive) connection of the previous query
+    BGPSTREAM_TRACE1(broker__query__start, STATE->query_url_buf);
+    if ((jsonfile = bgpstream_http_open(STATE->query_url_buf, NULL, 0)) ==
+        NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
                     STATE->query_url_buf);
-      goto retry;
+      BGPSTREAM_TRACE2(broker__query__done, STATE->query_url_buf, -1);
+      continue;
     }
-
-    if ((rc = read_json(di, jsonfile)) == ERR_FATAL) {
+    tee = (cache_path != NULL) ? open_response(cache_path, STATE->query_url_buf)
+                               : NULL;
+    STATE->last_response_cnt = 0;
+    rc = read_json(di, jsonfile, tee, NULL, 0);
+    bgpstream_http_close(jsonfile);
+    jsonfile = NULL;
+    BGPSTREAM_TRACE2(broker__query__done, STATE->query_url_buf, rc);
+    if (tee != NULL) {
+      close_response(cache_path, tee, rc == 0);
+    }
+    if (rc == ERR_FATAL) {
       bgpstream_log(BGPSTREAM_LOG_ERR,
                     "Received fatal error code from read_json");
       goto err;
-    } else if (rc == ERR_RETRY) {
-      goto retry;
-    } else {
+    } else if (rc == 0) {
       // success!
       success = 1;
     }
-
-  retry:
-    if (jsonfile != NULL) {
-      wandio_destroy(jsonfile);
-      jsonfile = NULL;
-    }
-  } while (success == 0);
+  }
 
   // reset the variable params
-  *STATE->query_url_end = '\0';
-  STATE->query_url_remaining = URL_BUFLEN - strlen(STATE->query_url_end);
+  reset_query_url(di);
+  free(cache_path);
+  cache_path = NULL;
+  bgpstream_stats_add_time(BGPSTREAM_STAT_BROKER_NS, start);
+
+  // start the query for the next window now so that it is (hopefully) ready
+  // by the time these resources have been read. in historical mode there is
+  // nothing more to ask for once the broker has returned everything
+  if (live == 0 &&
+      (STATE->last_response_cnt == 0 ||
+       (TIF != NULL && STATE->current_window_end > TIF->end_time))) {
+    return 0;
+  }
+  if (live != 0 && STATE->last_response_cnt == 0) {
+    // we're caught up, so there is no point in asking again until the next
+    // file is due to be published
+    now = (uint32_t)time(NULL);
+    not_before = STATE->current_window_end + STATE->current_window_duration;
+    if (not_before < now + LIVE_MIN_WAIT_TIME) {
+      not_before = now + LIVE_MIN_WAIT_TIME;
+    }
+  }
+  if (append_window_params(di) != 0) {
+    goto err;
+  }
+  // there is nothing to fetch if the response is already in the cache
+  if ((cache_path = response_cache_path(di, STATE->query_url_buf)) != NULL &&
+      access(cache_path, R_OK) == 0) {
+    reset_query_url(di);
+    free(cache_path);
+    return 0;
+  }
+  if ((STATE->prefetch = prefetch_create(STATE->query_url_buf, not_before)) ==
+      NULL) {
+    // not fatal, we'll make the query when we need it
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not start next broker query");
+  }
+  reset_query_url(di);
+  free(cache_path);
   return 0;
 
 err:
   bgpstream_log(BGPSTREAM_LOG_ERR, "Fatal error in broker data source");
-  if (jsonfile != NULL) {
-    wandio_destroy(jsonfile);
-  }
+  free(cache_path);
   return -1;
 }
@@ -33,6 +33,8 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -95,6 +97,15 @@ typedef struct bsdi_csvfile_state {
   uint32_t last_processed_ts;
   /* maximum timestamp accepted in the current round */
   uint32_t max_accepted_ts;
+
+  /* offset to resume parsing from at the next round (i.e., the end of the
+     last complete row that does not need to be read again) */
+  uint64_t resume_offset;
+  /* has a row in the current round been left for the next round? */
+  int row_deferred;
+  /* identity of the file that resume_offset refers to */
+  dev_t file_dev;
+  ino_t file_ino;
 } bsdi_csvfile_state_t;
 
 enum {
@@ -237,6 +248,11 @@ static void parse_rowend(int c, void *user_data)
   /* ensure fields read is compliant with the expected file format */
   assert(STATE->current_field == CSVFILE_FIELDCNT);
 
+  /* rows that are too new are read again in the next round */
+  if (STATE->timestamp > STATE->max_accepted_ts) {
+    STATE->row_deferred = 1;
+  }
+
   /* check if the timestamp is acceptable */
   if (STATE->timestamp > STATE->last_processed_ts &&
       STATE->timestamp <= STATE->max_accepted_ts) {
@@ -257,6 +273,65 @@ static void parse_rowend(int c, void *user_data)
   STATE->current_field = 0;
 }
 
+#define BUFFER_LEN 1024
+
+// check whether the file is the one that we have already read part of,
+// returning the offset to start reading from
+static uint64_t get_start_offset(bsdi_t *di)
+{
+  struct stat st;
+
+  if (stat(STATE->csv_file, &st) != 0) {
+    // not a local file, so we can't tell whether it has been rotated. if it
+    // has been truncated we'll find out when we try to skip ahead
+    return STATE->resume_offset;
+  }
+  if (st.st_dev != STATE->file_dev || st.st_ino != STATE->file_ino ||
+      (uint64_t)st.st_size < STATE->resume_offset) {
+    // the file has been rotated or truncated, so start again from the top
+    // (rows that have already been processed are skipped by timestamp)
+    STATE->file_dev = st.st_dev;
+    STATE->file_ino = st.st_ino;
+    STATE->resume_offset = 0;
+  }
+  return STATE->resume_offset;
+}
+
+// skip to the given offset, returning 0 if the file is at least that long
+static int skip_to(io_t *file_io, uint64_t offset)
+{
+  char buffer[BUFFER_LEN];
+  int64_t read;
+
+  if (offset == 0 ||
+      wandio_seek(file_io, offset, SEEK_SET) == (int64_t)offset) {
+    return 0;
+  }
+  // not seekable (e.g., compressed), so read up to the offset without
+  // parsing it
+  while (offset > 0) {
+    read = wandio_read(file_io, buffer,
+                       offset < BUFFER_LEN ? (int64_t)offset : BUFFER_LEN);
+    if (read <= 0) {
+      return -1;
+    }
+    offset -= read;
+  }
+  return 0;
+}
+
+// start parsing afresh, discarding any partial row
+static int reset_parser(bsdi_t *di)
+{
+  csv_free(&STATE->parser);
+  if (csv_init(&(STATE->parser), (CSV_STRICT | CSV_REPALL_NL | CSV_STRICT_FINI |
+                                  CSV_APPEND_NULL | CSV_EMPTY_IS_NULL)) != 0) {
+    return -1;
+  }
+  STATE->current_field = CSVFILE_PATH;
+  return 0;
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 int bsdi_csvfile_init(bsdi_t *di)
@@ -333,41 +408,90 @@ void bsdi_csvfile_destroy(bsdi_t *di)
 
 int bsdi_csvfile_update_resources(bsdi_t *di)
 {
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
   io_t *file_io = NULL;
-#define BUFFER_LEN 1024
   char buffer[BUFFER_LEN];
-  int read = 0;
+  int64_t read = 0;
+  uint64_t offset;
+  char *nl;
+  size_t len, done;
 
   /* we accept all timestamp earlier than now() - 1 second */
   STATE->max_accepted_ts = epoch_sec() - 1;
 
   STATE->max_ts_infile = 0;
+  STATE->row_deferred = 0;
 
   if ((file_io = wandio_create(STATE->csv_file)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file %s", STATE->csv_file);
     goto err;
   }
 
-  while ((read = wandio_read(file_io, &buffer, BUFFER_LEN)) > 0) {
-    if (csv_parse(&(STATE->parser), buffer, read, parse_field, parse_rowend,
-                  di) != read) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
-                    csv_strerror(csv_error(&STATE->parser)));
+  /* only parse what has been added since the last round */
+  offset = get_start_offset(di);
+  if (skip_to(file_io, offset) != 0) {
+    // shorter than it was, so it must have been replaced
+    wandio_destroy(file_io);
+    STATE->resume_offset = 0;
+    if ((file_io = wandio_create(STATE->csv_file)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file %s", STATE->csv_file);
       goto err;
     }
+    offset = 0;
   }
 
-  if (csv_fini(&(STATE->parser), parse_field, parse_rowend, di) != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
-                  csv_strerror(csv_error(&STATE->parser)));
+  while ((read = wandio_read(file_io, &buffer, BUFFER_LEN)) > 0) {
+    // parse one row at a time so that we know where the last complete row
+    // (that doesn't need to be read again) ends
+    done = 0;
+    while (done < (size_t)read) {
+      nl = memchr(buffer + done, '\n', read - done);
+      len = (nl != NULL) ? (size_t)(nl - (buffer + done)) + 1 : read - done;
+      if (csv_parse(&(STATE->parser), buffer + done, len, parse_field,
+                    parse_rowend, di) != len) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
+                      csv_strerror(csv_error(&STATE->parser)));
+        goto err;
+      }
+      done += len;
+      if (nl != NULL && STATE->row_deferred == 0) {
+        STATE->resume_offset = offset + done;
+      }
+    }
+    offset += read;
+  }
+  if (read < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't read file %s", STATE->csv_file);
     goto err;
   }
 
+  if (TIF != NULL && TIF->end_time == BGPSTREAM_FOREVER) {
+    // the last row may still be being written, so leave it for the next round
+    if (reset_parser(di) != 0) {
+      goto err;
+    }
+  } else {
+    if (csv_fini(&(STATE->parser), parse_field, parse_rowend, di) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
+                    csv_strerror(csv_error(&STATE->parser)));
+      goto err;
+    }
+    if (STATE->row_deferred == 0) {
+      STATE->resume_offset = offset;
+    }
+  }
+
   wandio_destroy(file_io);
 
-  STATE->last_processed_ts = STATE->max_ts_infile;
+  if (STATE->max_ts_infile > STATE->last_processed_ts) {
+    STATE->last_processed_ts = STATE->max_ts_infile;
+  }
   return 0;
 
 err:
+  if (file_io != NULL) {
+    wandio_destroy(file_io);
+  }
+  reset_parser(di);
   return -1;
 }
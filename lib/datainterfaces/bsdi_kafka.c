@@ -63,6 +63,10 @@ enum {
   OPTION_DATA_TYPE,      //
   OPTION_PROJECT,        //
   OPTION_COLLECTOR,      //
+  OPTION_BATCH_SIZE,     // stored in kafka_batch_size res attribute
+  OPTION_FETCH_MAX_BYTES, // stored in kafka_fetch_max_bytes res attribute
+  OPTION_QUEUE_MAX_KBYTES, // stored in kafka_queue_max_kbytes res attribute
+  OPTION_CONSUMERS,      // number of resources (consumers) to create
 };
 
 /* define the options this data interface accepts */
@@ -116,6 +120,35 @@ static bgpstream_data_interface_option_t options[] = {
     "collector",                    // name
     "set collector name (default: unset)",
   },
+  /* Batch size */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_BATCH_SIZE,              // internal ID
+    "batch-size",                   // name
+    "maximum number of messages to consume at once (default: 1000)",
+  },
+  /* Fetch size */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_FETCH_MAX_BYTES,         // internal ID
+    "fetch-max-bytes",              // name
+    "maximum bytes to fetch per partition per request (default: rdkafka's)",
+  },
+  /* Queue size */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_QUEUE_MAX_KBYTES,        // internal ID
+    "queue-max-kbytes",             // name
+    "maximum KiB of messages to prefetch (default: rdkafka's)",
+  },
+  /* Consumers */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_CONSUMERS,               // internal ID
+    "consumers",                    // name
+    "number of consumers to split the topic partitions between, each decoded "
+    "separately and merged by time (default: 1)",
+  },
 };
 
 /* create the class structure for this data interface */
@@ -146,9 +179,17 @@ typedef struct bsdi_kafka_state {
   // explicitly set collector name
   char *collector;
 
+  // consumer batch, fetch and queue sizes (NULL for the defaults)
+  char *batch_size;
+  char *fetch_max_bytes;
+  char *queue_max_kbytes;
+
   // Type of the data to be consumed
   bgpstream_resource_format_type_t data_type;
 
+  // Number of consumers (resources) to create
+  int consumers;
+
   // we only ever yield one resource
   int done;
 
@@ -167,6 +208,7 @@ int bsdi_kafka_init(bsdi_t *di)
 
   /* set default state */
   state->data_type = BGPSTREAM_RESOURCE_FORMAT_BMP;
+  state->consumers = 1;
   state->project = strdup(DEFAULT_PROJECT);
   state->collector = strdup(DEFAULT_COLLECTOR);
 
@@ -198,6 +240,8 @@ int bsdi_kafka_set_option(bsdi_t *di,
                           const char *option_value)
 {
   int found = 0;
+  char **size_opt;
+  char *endp;
 
   switch (option_type->id) {
   case OPTION_BROKERS:
@@ -269,6 +313,34 @@ int bsdi_kafka_set_option(bsdi_t *di,
     }
     break;
 
+  case OPTION_BATCH_SIZE:
+  case OPTION_FETCH_MAX_BYTES:
+  case OPTION_QUEUE_MAX_KBYTES:
+    if (strtol(option_value, &endp, 10) <= 0 || *endp != '\0') {
+      fprintf(stderr, "ERROR: Invalid value '%s' for the %s option\n",
+              option_value, option_type->name);
+      return -1;
+    }
+    size_opt = option_type->id == OPTION_BATCH_SIZE ?
+                 &STATE->batch_size :
+                 option_type->id == OPTION_FETCH_MAX_BYTES ?
+                 &STATE->fetch_max_bytes :
+                 &STATE->queue_max_kbytes;
+    free(*size_opt);
+    if ((*size_opt = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    break;
+
+  case OPTION_CONSUMERS:
+    if ((STATE->consumers = strtol(option_value, &endp, 10)) <= 0 ||
+        *endp != '\0') {
+      fprintf(stderr, "ERROR: Invalid number of consumers '%s'\n",
+              option_value);
+      return -1;
+    }
+    break;
+
   default:
     return -1;
   }
@@ -300,21 +372,24 @@ void bsdi_kafka_destroy(bsdi_t *di)
   free(STATE->collector);
   STATE->collector = NULL;
 
+  free(STATE->batch_size);
+  STATE->batch_size = NULL;
+
+  free(STATE->fetch_max_bytes);
+  STATE->fetch_max_bytes = NULL;
+
+  free(STATE->queue_max_kbytes);
+  STATE->queue_max_kbytes = NULL;
+
   free(STATE);
   BSDI_SET_STATE(di, NULL);
 }
 
-int bsdi_kafka_update_resources(bsdi_t *di)
+static int push_consumer(bsdi_t *di)
 {
   int rc;
   bgpstream_resource_t *res = NULL;
 
-  // we only ever yield one resource
-  if (STATE->done != 0) {
-    return 0;
-  }
-  STATE->done = 1;
-
   // we treat kafka as having data from <recent> to <forever>
   if ((rc = bgpstream_resource_mgr_push(
          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_KAFKA,
@@ -343,5 +418,59 @@ int bsdi_kafka_update_resources(bsdi_t *di)
     return -1;
   }
 
+  if (STATE->batch_size != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_BATCH_SIZE, STATE->batch_size) != 0) {
+    return -1;
+  }
+
+  if (STATE->fetch_max_bytes != NULL &&
+      bgpstream_resource_set_attr(res,
+                                  BGPSTREAM_RESOURCE_ATTR_KAFKA_FETCH_MAX_BYTES,
+                                  STATE->fetch_max_bytes) != 0) {
+    return -1;
+  }
+
+  if (STATE->queue_max_kbytes != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_QUEUE_MAX_KBYTES,
+        STATE->queue_max_kbytes) != 0) {
+    return -1;
+  }
+
+  return 1;
+}
+
+int bsdi_kafka_update_resources(bsdi_t *di)
+{
+  char buf[1024];
+  uint64_t ts;
+  int rc, i;
+
+  // we only ever yield one set of resources
+  if (STATE->done != 0) {
+    return 0;
+  }
+  STATE->done = 1;
+
+  // consumers split the partitions between them only if they are in the same
+  // group, so don't let each of them pick a random one
+  if (STATE->consumers > 1 && STATE->group == NULL) {
+    ts = epoch_msec();
+    srand(ts);
+    snprintf(buf, sizeof(buf), "bgpstream-%" PRIx64 "-%x", ts, rand());
+    if ((STATE->group = strdup(buf)) == NULL) {
+      return -1;
+    }
+  }
+
+  // each consumer is a separate stream resource with its own decoder, and the
+  // resource manager merges their records by time
+  for (i = 0; i < STATE->consumers; i++) {
+    if ((rc = push_consumer(di)) <= 0) {
+      return rc;
+    }
+  }
+
   return 0;
 }
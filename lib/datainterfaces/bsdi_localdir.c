@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bsdi_localdir.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATE (BSDI_GET_STATE(di, localdir))
+#define TIF filter_mgr->time_interval
+
+/* ---------- START CLASS DEFINITION ---------- */
+
+/* define the internal option ID values */
+enum {
+  OPTION_DIR,
+};
+
+/* define the options this data interface accepts */
+static bgpstream_data_interface_option_t options[] = {
+  /* Archive mirror directory */
+  {
+    BGPSTREAM_DATA_INTERFACE_LOCALDIR, // interface ID
+    OPTION_DIR,                        // internal ID
+    "dir",                             // name
+    "root of a local mirror of the RouteViews and/or RIS archives",
+  },
+};
+
+/* create the class structure for this data interface */
+BSDI_CREATE_CLASS(localdir, BGPSTREAM_DATA_INTERFACE_LOCALDIR,
+                  "Watch a local mirror of the RouteViews/RIS archives for "
+                  "new dump files",
+                  options)
+
+/* ---------- END CLASS DEFINITION ---------- */
+
+/* time spanned by each kind of dump */
+#define RIB_DURATION 120
+#define ROUTEVIEWS_UPDATES_DURATION 900
+#define RIS_UPDATES_DURATION 300
+
+/* events that may mean a dump file is complete (written in place, or renamed
+   into place as rsync does by default), or that a directory was added */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+
+typedef struct bsdi_localdir_state {
+  /* user-provided options: */
+
+  // Root of the archive mirror
+  char *dir;
+
+  /* internal state: */
+
+  // are we in live mode (i.e., watching for new files)?
+  int live;
+
+  // has the initial scan been done?
+  int scanned;
+
+  // inotify instance
+  int inotify_fd;
+
+  // path (relative to dir) of the directory watched by each watch descriptor
+  char **watch_paths;
+  int watch_paths_cnt;
+
+  // files found by the initial scan that were modified while it ran, and so
+  // may be reported by inotify too
+  bgpstream_str_set_t *recent;
+
+  // time the initial scan started
+  time_t scan_start;
+
+} bsdi_localdir_state_t;
+
+/* metadata of a dump file, worked out from its path */
+typedef struct dump_info {
+  char project[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char collector[BGPSTREAM_UTILS_STR_NAME_LEN];
+  bgpstream_record_type_t type;
+  uint32_t file_time;
+  uint32_t duration;
+} dump_info_t;
+
+// work out the metadata of a dump from its path (relative to the root of the
+// mirror). RouteViews dumps are at
+// [<collector>/]bgpdata/YYYY.MM/{RIBS,UPDATES}/{rib,updates}.YYYYMMDD.HHMM.bz2
+// (route-views2 has no collector directory), and RIS dumps are at
+// <collector>/YYYY.MM/{bview,updates}.YYYYMMDD.HHMM.gz
+static int parse_path(const char *path, dump_info_t *info)
+{
+  const char *base;
+  const char *bgpdata;
+  const char *slash;
+  char kind[16];
+  struct tm tm;
+  size_t len;
+
+  base = ((base = strrchr(path, '/')) != NULL) ? base + 1 : path;
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(base, "%15[a-z].%4d%2d%2d.%2d%2d", kind, &tm.tm_year, &tm.tm_mon,
+             &tm.tm_mday, &tm.tm_hour, &tm.tm_min) != 6) {
+    return -1;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  info->file_time = (uint32_t)timegm(&tm);
+
+  if (strncmp(path, "bgpdata/", 8) == 0) {
+    strcpy(info->project, "routeviews");
+    strcpy(info->collector, "route-views2");
+  } else if ((bgpdata = strstr(path, "/bgpdata/")) != NULL) {
+    strcpy(info->project, "routeviews");
+    if ((slash = memrchr(path, '/', bgpdata - path)) == NULL) {
+      slash = path - 1;
+    }
+    if ((len = bgpdata - (slash + 1)) >= sizeof(info->collector)) {
+      return -1;
+    }
+    memcpy(info->collector, slash + 1, len);
+    info->collector[len] = '\0';
+  } else {
+    strcpy(info->project, "ris");
+    if ((slash = strchr(path, '/')) == NULL ||
+        (len = slash - path) >= sizeof(info->collector)) {
+      return -1;
+    }
+    memcpy(info->collector, path, len);
+    info->collector[len] = '\0';
+  }
+
+  if (strcmp(kind, "rib") == 0 || strcmp(kind, "bview") == 0) {
+    info->type = BGPSTREAM_RIB;
+    info->duration = RIB_DURATION;
+  } else if (strcmp(kind, "updates") == 0) {
+    info->type = BGPSTREAM_UPDATE;
+    info->duration = strcmp(info->project, "routeviews") == 0
+                       ? ROUTEVIEWS_UPDATES_DURATION
+                       : RIS_UPDATES_DURATION;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static int filters_match(bsdi_t *di, dump_info_t *info)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+
+  if (filter_mgr->projects != NULL &&
+      bgpstream_str_set_exists(filter_mgr->projects, info->project) == 0) {
+    return 0;
+  }
+  if (filter_mgr->collectors != NULL &&
+      bgpstream_str_set_exists(filter_mgr->collectors, info->collector) == 0) {
+    return 0;
+  }
+  if (filter_mgr->bgp_types != NULL &&
+      bgpstream_str_set_exists(filter_mgr->bgp_types,
+                               info->type == BGPSTREAM_RIB ? "ribs"
+                                                           : "updates") == 0) {
+    return 0;
+  }
+  // like the other data interfaces, allow 120 seconds of slack for dumps
+  // whose names don't quite match the time they were started
+  if (TIF != NULL &&
+      ((uint64_t)info->file_time + info->duration + 120 < TIF->begin_time ||
+       (TIF->end_time != BGPSTREAM_FOREVER &&
+        info->file_time > TIF->end_time))) {
+    return 0;
+  }
+  return 1;
+}
+
+// check whether a YYYY.MM directory can be skipped because no dump in it
+// could be in the time interval
+static int skip_month(bsdi_t *di, const char *name)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  struct tm tm;
+  time_t start, end;
+  char c;
+
+  memset(&tm, 0, sizeof(tm));
+  if (TIF == NULL || strlen(name) != 7 ||
+      sscanf(name, "%4d.%2d%c", &tm.tm_year, &tm.tm_mon, &c) != 2) {
+    return 0;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  tm.tm_mday = 1;
+  start = timegm(&tm);
+  tm.tm_mon++;
+  end = timegm(&tm);
+
+  return (uint64_t)end + ROUTEVIEWS_UPDATES_DURATION + 120 < TIF->begin_time ||
+         (TIF->end_time != BGPSTREAM_FOREVER && start > TIF->end_time);
+}
+
+static int push_file(bsdi_t *di, const char *path, int *cnt)
+{
+  dump_info_t info;
+  char full_path[PATH_MAX];
+
+  if (parse_path(path, &info) != 0 || filters_match(di, &info) == 0) {
+    return 0;
+  }
+  if (snprintf(full_path, sizeof(full_path), "%s/%s", STATE->dir, path) >=
+      (int)sizeof(full_path)) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Skipping %s/%s: path too long",
+                  STATE->dir, path);
+    return 0;
+  }
+  if (bgpstream_resource_mgr_push(
+        BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+        BGPSTREAM_RESOURCE_FORMAT_MRT, full_path, info.file_time, info.duration,
+        info.project, info.collector, info.type, NULL) < 0) {
+    return -1;
+  }
+  (*cnt)++;
+  return 0;
+}
+
+static int add_watch(bsdi_t *di, const char *path, const char *full_path)
+{
+  int wd;
+  char **tmp;
+
+  if ((wd = inotify_add_watch(STATE->inotify_fd, full_path, WATCH_EVENTS)) <
+      0) {
+    // not fatal, but files added here will be missed
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not watch %s: %s", full_path,
+                  strerror(errno));
+    return 0;
+  }
+  if (wd >= STATE->watch_paths_cnt) {
+    if ((tmp = realloc(STATE->watch_paths, sizeof(char *) * (wd + 1))) ==
+        NULL) {
+      return -1;
+    }
+    memset(tmp + STATE->watch_paths_cnt, 0,
+           sizeof(char *) * (wd + 1 - STATE->watch_paths_cnt));
+    STATE->watch_paths = tmp;
+    STATE->watch_paths_cnt = wd + 1;
+  }
+  free(STATE->watch_paths[wd]);
+  if ((STATE->watch_paths[wd] = strdup(path)) == NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+// push the dumps under the given directory (relative to the root of the
+// mirror), watching it and its subdirectories if we are in live mode
+static int scan_dir(bsdi_t *di, const char *path, int *cnt)
+{
+  char full_path[PATH_MAX];
+  char child[PATH_MAX];
+  DIR *dir;
+  struct dirent *de;
+  struct stat st;
+  int ret = -1;
+
+  snprintf(full_path, sizeof(full_path), "%s%s%s", STATE->dir,
+           path[0] != '\0' ? "/" : "", path);
+
+  // watch before listing, so that no file is missed in between
+  if (STATE->live != 0 && add_watch(di, path, full_path) != 0) {
+    return -1;
+  }
+  if ((dir = opendir(full_path)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not open %s: %s", full_path,
+                  strerror(errno));
+    return 0;
+  }
+
+  while ((de = readdir(dir)) != NULL) {
+    // skip '.', '..', and the temporary files that rsync writes to
+    if (de->d_name[0] == '.' ||
+        snprintf(child, sizeof(child), "%s%s%s", path,
+                 path[0] != '\0' ? "/" : "",
+                 de->d_name) >= (int)sizeof(child) ||
+        fstatat(dirfd(dir), de->d_name, &st, 0) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      if (skip_month(di, de->d_name) == 0 && scan_dir(di, child, cnt) != 0) {
+        goto done;
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      if (push_file(di, child, cnt) != 0) {
+        goto done;
+      }
+      if (STATE->live != 0 && st.st_mtime >= STATE->scan_start - 1 &&
+          bgpstream_str_set_insert(STATE->recent, child) < 0) {
+        goto done;
+      }
+    }
+  }
+  ret = 0;
+
+done:
+  closedir(dir);
+  return ret;
+}
+
+// handle the inotify events that are waiting
+static int handle_events(bsdi_t *di, int *cnt)
+{
+  char buf[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *ev;
+  char child[PATH_MAX];
+  const char *dir;
+  ssize_t len;
+  char *p;
+
+  while ((len = read(STATE->inotify_fd, buf, sizeof(buf))) > 0) {
+    for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+      ev = (const struct inotify_event *)p;
+
+      if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_WARN,
+                      "Too many changes under %s, some files were missed",
+                      STATE->dir);
+        continue;
+      }
+      if (ev->wd < 0 || ev->wd >= STATE->watch_paths_cnt ||
+          (dir = STATE->watch_paths[ev->wd]) == NULL) {
+        continue;
+      }
+      if ((ev->mask & IN_IGNORED) != 0) {
+        // the directory is gone
+        free(STATE->watch_paths[ev->wd]);
+        STATE->watch_paths[ev->wd] = NULL;
+        continue;
+      }
+      if (ev->len == 0 || ev->name[0] == '.' ||
+          snprintf(child, sizeof(child), "%s%s%s", dir,
+                   dir[0] != '\0' ? "/" : "", ev->name) >= (int)sizeof(child)) {
+        continue;
+      }
+
+      if ((ev->mask & IN_ISDIR) != 0) {
+        // a new directory: watch it, and push anything already written to it
+        if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0 &&
+            scan_dir(di, child, cnt) != 0) {
+          return -1;
+        }
+      } else if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0 &&
+                 bgpstream_str_set_exists(STATE->recent, child) == 0) {
+        if (push_file(di, child, cnt) != 0) {
+          return -1;
+        }
+      }
+    }
+  }
+  if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not read inotify events: %s",
+                  strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+int bsdi_localdir_init(bsdi_t *di)
+{
+  bsdi_localdir_state_t *state;
+
+  if ((state = malloc_zero(sizeof(bsdi_localdir_state_t))) == NULL) {
+    goto err;
+  }
+  BSDI_SET_STATE(di, state);
+
+  /* set default state */
+  state->inotify_fd = -1;
+
+  if ((state->recent = bgpstream_str_set_create()) == NULL) {
+    goto err;
+  }
+
+  return 0;
+err:
+  bsdi_localdir_destroy(di);
+  return -1;
+}
+
+int bsdi_localdir_start(bsdi_t *di)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+
+  if (STATE->dir == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "The 'dir' option must be set");
+    return -1;
+  }
+
+  STATE->live = (TIF != NULL && TIF->end_time == BGPSTREAM_FOREVER);
+  if (STATE->live != 0 &&
+      (STATE->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create inotify instance: %s",
+                  strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+int bsdi_localdir_set_option(
+  bsdi_t *di, const bgpstream_data_interface_option_t *option_type,
+  const char *option_value)
+{
+  size_t len;
+
+  switch (option_type->id) {
+  case OPTION_DIR:
+    free(STATE->dir);
+    if ((STATE->dir = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    // paths are built as <dir>/<path>
+    len = strlen(STATE->dir);
+    while (len > 1 && STATE->dir[len - 1] == '/') {
+      STATE->dir[--len] = '\0';
+    }
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+void bsdi_localdir_destroy(bsdi_t *di)
+{
+  int i;
+
+  if (di == NULL || STATE == NULL) {
+    return;
+  }
+
+  free(STATE->dir);
+  STATE->dir = NULL;
+
+  if (STATE->inotify_fd >= 0) {
+    close(STATE->inotify_fd);
+    STATE->inotify_fd = -1;
+  }
+
+  for (i = 0; i < STATE->watch_paths_cnt; i++) {
+    free(STATE->watch_paths[i]);
+  }
+  free(STATE->watch_paths);
+  STATE->watch_paths = NULL;
+  STATE->watch_paths_cnt = 0;
+
+  bgpstream_str_set_destroy(STATE->recent);
+  STATE->recent = NULL;
+
+  free(STATE);
+  BSDI_SET_STATE(di, NULL);
+}
+
+int bsdi_localdir_update_resources(bsdi_t *di)
+{
+  struct pollfd pfd;
+  int cnt = 0;
+
+  if (STATE->scanned == 0) {
+    STATE->scan_start = time(NULL);
+    if (scan_dir(di, "", &cnt) != 0) {
+      return -1;
+    }
+    STATE->scanned = 1;
+    if (STATE->live == 0 || cnt > 0) {
+      return 0;
+    }
+  }
+  if (STATE->live == 0) {
+    // everything was pushed by the scan
+    return 0;
+  }
+
+  while (1) {
+    if (handle_events(di, &cnt) != 0) {
+      return -1;
+    }
+    // any file written during the scan has now been reported by inotify
+    bgpstream_str_set_clear(STATE->recent);
+    if (cnt > 0) {
+      return 0;
+    }
+    // nothing yet, so sleep until the mirror changes
+    pfd.fd = STATE->inotify_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, -1) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not wait for inotify events: %s",
+                    strerror(errno));
+      return -1;
+    }
+  }
+}
@@ -28,10 +28,13 @@
 #include "bgpstream_log.h"
 #include "config.h"
 #include "utils.h"
+#include <arpa/inet.h>
+#include <glob.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -63,7 +66,8 @@ static bgpstream_data_interface_option_t options[] = {
     BGPSTREAM_DATA_INTERFACE_SINGLEFILE, // interface ID
     OPTION_RIB_FILE,                     // internal ID
     "rib-file",                          // name
-    "rib mrt file to read (default: " STR(BGPSTREAM_DI_SINGLEFILE_RIB_FILE) ")",
+    "rib mrt file to read, or a comma-separated list of files and glob "
+    "patterns (default: " STR(BGPSTREAM_DI_SINGLEFILE_RIB_FILE) ")",
   },
   /* RIB file type */
   {
@@ -77,7 +81,8 @@ static bgpstream_data_interface_option_t options[] = {
     BGPSTREAM_DATA_INTERFACE_SINGLEFILE, // interface ID
     OPTION_UPDATE_FILE,                  // internal ID
     "upd-file",                          // name
-    "updates mrt file to read (default: " STR(
+    "updates mrt file to read, a comma-separated list of files and glob "
+    "patterns, or ws:// URL of a stream (default: " STR(
       BGPSTREAM_DI_SINGLEFILE_UPDATE_FILE) ")",
   },
   /* Update file type */
@@ -91,7 +96,7 @@ static bgpstream_data_interface_option_t options[] = {
 
 /* create the class structure for this data interface */
 BSDI_CREATE_CLASS(singlefile, BGPSTREAM_DATA_INTERFACE_SINGLEFILE,
-                  "Read a single mrt data file (RIB and/or updates)", options)
+                  "Read local mrt data files (RIB and/or updates)", options)
 
 /* ---------- END CLASS DEFINITION ---------- */
 
@@ -104,6 +109,21 @@ BSDI_CREATE_CLASS(singlefile, BGPSTREAM_DATA_INTERFACE_SINGLEFILE,
 /* max number of bytes to read from file header (to detect file changes) */
 #define MAX_HEADER_READ_BYTES 1024
 
+/* all records of a RIB dump carry (about) the time the dump started */
+#define MULTI_RIB_DURATION 120
+
+/* duration of the last update file of a list, when it can't be told from the
+   gap to the previous file */
+#define MULTI_UPDATE_DURATION 900
+
+/* one file of a multi-file list */
+typedef struct multi_file {
+  char *path;
+
+  // time of the first record in the file
+  uint32_t time;
+} multi_file_t;
+
 typedef struct bsdi_singlefile_state {
   /* user-provided options: */
 
@@ -121,6 +141,18 @@ typedef struct bsdi_singlefile_state {
 
   /* internal state: */
 
+  // files matched when the RIB option names more than one file (NULL when
+  // reading a single RIB file)
+  multi_file_t *rib_files;
+  int rib_files_cnt;
+
+  // files matched when the update option names more than one file
+  multi_file_t *update_files;
+  int update_files_cnt;
+
+  // set once the matched files have been queued
+  int files_pushed;
+
   // a few bytes from the beginning of the RIB file (used to tell if a symlink
   // has been updated)
   char rib_header[MAX_HEADER_READ_BYTES];
@@ -134,8 +166,18 @@ typedef struct bsdi_singlefile_state {
 
   // timestamp of the last updates read
   uint32_t last_update_filetime;
+
+  // set once the update stream (if the update file is a websocket URL) has
+  // been queued
+  int update_stream_pushed;
 } bsdi_singlefile_state_t;
 
+// is the given "file" the URL of a websocket stream?
+static int is_stream_url(const char *url)
+{
+  return strncmp(url, "ws://", 5) == 0 || strncmp(url, "wss://", 6) == 0;
+}
+
 static int same_header(char *filename, char *prev_hdr)
 {
   char buffer[MAX_HEADER_READ_BYTES];
@@ -165,6 +207,166 @@ static int same_header(char *filename, char *prev_hdr)
   return 0; // not the same header
 }
 
+static void multi_files_destroy(multi_file_t *files, int cnt)
+{
+  int i;
+  for (i = 0; i < cnt; i++) {
+    free(files[i].path);
+  }
+  free(files);
+}
+
+static int multi_file_cmp(const void *a, const void *b)
+{
+  const multi_file_t *fa = a;
+  const multi_file_t *fb = b;
+  if (fa->time != fb->time) {
+    return fa->time < fb->time ? -1 : 1;
+  }
+  return strcmp(fa->path, fb->path);
+}
+
+// time of the first record in the given file: the timestamp of the first MRT
+// header if there is one, and the modification time of the file otherwise
+static int file_start_time(const char *path,
+                           bgpstream_resource_format_type_t type,
+                           uint32_t *time)
+{
+  struct stat st;
+  uint32_t ts;
+  io_t *io_h;
+
+  if (type == BGPSTREAM_RESOURCE_FORMAT_MRT) {
+    if ((io_h = wandio_create(path)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file '%s'", path);
+      return -1;
+    }
+    if (wandio_read(io_h, &ts, sizeof(ts)) == sizeof(ts)) {
+      wandio_destroy(io_h);
+      *time = ntohl(ts);
+      return 0;
+    }
+    wandio_destroy(io_h);
+  }
+
+  if (stat(path, &st) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't stat file '%s'", path);
+    return -1;
+  }
+  *time = st.st_mtime;
+  return 0;
+}
+
+// expand a comma-separated list of files and glob patterns. returns the number
+// of files found, and sets *files unless the spec is a plain file name (which
+// keeps the single file behaviour).
+static int expand_files(const char *spec,
+                        bgpstream_resource_format_type_t type,
+                        multi_file_t **files)
+{
+  glob_t gl;
+  char *copy = NULL;
+  char *tok, *saveptr = NULL;
+  int flags = GLOB_NOCHECK;
+  int cnt = 0;
+  size_t i;
+
+  *files = NULL;
+  if (is_stream_url(spec) ||
+      (strchr(spec, ',') == NULL && strpbrk(spec, "*?[") == NULL)) {
+    return 1;
+  }
+
+  memset(&gl, 0, sizeof(gl));
+  if ((copy = strdup(spec)) == NULL) {
+    return -1;
+  }
+  for (tok = strtok_r(copy, ",", &saveptr); tok != NULL;
+       tok = strtok_r(NULL, ",", &saveptr)) {
+    if (*tok == '\0') {
+      continue;
+    }
+    if (glob(tok, flags, NULL, &gl) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "could not expand '%s'", tok);
+      goto err;
+    }
+    flags |= GLOB_APPEND;
+  }
+  free(copy);
+  copy = NULL;
+
+  if (gl.gl_pathc == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "no files in '%s'", spec);
+    goto err;
+  }
+  if ((*files = malloc_zero(sizeof(multi_file_t) * gl.gl_pathc)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < gl.gl_pathc; i++) {
+    if (file_start_time(gl.gl_pathv[i], type, &(*files)[cnt].time) != 0) {
+      continue;
+    }
+    if (((*files)[cnt].path = strdup(gl.gl_pathv[i])) == NULL) {
+      goto err;
+    }
+    cnt++;
+  }
+  globfree(&gl);
+  memset(&gl, 0, sizeof(gl));
+
+  if (cnt == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "no readable files in '%s'", spec);
+    free(*files);
+    *files = NULL;
+    return -1;
+  }
+  qsort(*files, cnt, sizeof(multi_file_t), multi_file_cmp);
+  return cnt;
+
+err:
+  free(copy);
+  globfree(&gl);
+  multi_files_destroy(*files, cnt);
+  *files = NULL;
+  return -1;
+}
+
+// queue each of the given (sorted) files once. an update file is taken to
+// last until the next file starts, so that the resource manager opens files
+// that overlap in time (e.g., from several collectors) together.
+static int push_files(bsdi_t *di, multi_file_t *files, int cnt,
+                      bgpstream_resource_format_type_t type,
+                      bgpstream_record_type_t record_type)
+{
+  uint32_t duration = MULTI_UPDATE_DURATION;
+  int i, j;
+
+  for (i = 0; i < cnt; i++) {
+    if (record_type == BGPSTREAM_RIB) {
+      duration = MULTI_RIB_DURATION;
+    } else {
+      // files starting at the same time share the gap to the next start
+      for (j = i + 1; j < cnt && files[j].time == files[i].time; j++)
+        ;
+      // the last files keep the gap seen before them
+      if (j < cnt) {
+        duration = files[j].time - files[i].time;
+      }
+    }
+
+    if (bgpstream_resource_mgr_push(
+          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE, type,
+          files[i].path, files[i].time, duration, "singlefile", "singlefile",
+          record_type, NULL) < 0) {
+      return -1;
+    }
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_INFO, "queued %d %s files", cnt,
+                record_type == BGPSTREAM_RIB ? "rib" : "update");
+  return 0;
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 int bsdi_singlefile_init(bsdi_t *di)
@@ -188,14 +390,31 @@ err:
 
 int bsdi_singlefile_start(bsdi_t *di)
 {
-  if (STATE->rib_file || STATE->update_file) {
-    return 0;
-  } else {
+  int cnt;
+
+  if (STATE->rib_file == NULL && STATE->update_file == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR,
                   "At least one of the 'rib-file' and 'upd-file' "
                   "options must be set\n");
     return -1;
   }
+
+  if (STATE->rib_file != NULL) {
+    if ((cnt = expand_files(STATE->rib_file, STATE->rib_type,
+                            &STATE->rib_files)) < 0) {
+      return -1;
+    }
+    STATE->rib_files_cnt = STATE->rib_files != NULL ? cnt : 0;
+  }
+  if (STATE->update_file != NULL) {
+    if ((cnt = expand_files(STATE->update_file, STATE->update_type,
+                            &STATE->update_files)) < 0) {
+      return -1;
+    }
+    STATE->update_files_cnt = STATE->update_files != NULL ? cnt : 0;
+  }
+
+  return 0;
 }
 
 int bsdi_singlefile_set_option(
@@ -278,6 +497,12 @@ void bsdi_singlefile_destroy(bsdi_t *di)
   free(STATE->update_file);
   STATE->update_file = NULL;
 
+  multi_files_destroy(STATE->rib_files, STATE->rib_files_cnt);
+  STATE->rib_files = NULL;
+
+  multi_files_destroy(STATE->update_files, STATE->update_files_cnt);
+  STATE->update_files = NULL;
+
   free(STATE);
   BSDI_SET_STATE(di, NULL);
 }
@@ -286,10 +511,26 @@ int bsdi_singlefile_update_resources(bsdi_t *di)
 {
   uint32_t now = epoch_sec();
 
+  /* lists of files are queued all at once, and read in time order */
+  if (STATE->files_pushed == 0 &&
+      (STATE->rib_files != NULL || STATE->update_files != NULL)) {
+    STATE->files_pushed = 1;
+    if (STATE->rib_files != NULL &&
+        push_files(di, STATE->rib_files, STATE->rib_files_cnt,
+                   STATE->rib_type, BGPSTREAM_RIB) != 0) {
+      goto err;
+    }
+    if (STATE->update_files != NULL &&
+        push_files(di, STATE->update_files, STATE->update_files_cnt,
+                   STATE->update_type, BGPSTREAM_UPDATE) != 0) {
+      goto err;
+    }
+  }
+
   /* if this is the first time we've read the file, then add it to the queue,
      otherwise check the header to see if it has changed */
 
-  if (STATE->rib_file != NULL &&
+  if (STATE->rib_file != NULL && STATE->rib_files == NULL &&
       (now - STATE->last_rib_filetime) > RIB_FREQUENCY_CHECK &&
       same_header(STATE->rib_file, STATE->rib_header) == 0) {
     STATE->last_rib_filetime = now;
@@ -303,9 +544,20 @@ int bsdi_singlefile_update_resources(bsdi_t *di)
     }
   }
 
-  if (STATE->update_file != NULL &&
-      (now - STATE->last_update_filetime) > UPDATE_FREQUENCY_CHECK &&
-      same_header(STATE->update_file, STATE->update_header) == 0) {
+  // a stream is queued once and then read for as long as it lasts
+  if (STATE->update_file != NULL && is_stream_url(STATE->update_file)) {
+    if (STATE->update_stream_pushed == 0) {
+      STATE->update_stream_pushed = 1;
+      if (bgpstream_resource_mgr_push(
+            BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_WEBSOCKET,
+            STATE->update_type, STATE->update_file, now, BGPSTREAM_FOREVER,
+            "singlefile", "singlefile", BGPSTREAM_UPDATE, NULL) < 0) {
+        goto err;
+      }
+    }
+  } else if (STATE->update_file != NULL && STATE->update_files == NULL &&
+             (now - STATE->last_update_filetime) > UPDATE_FREQUENCY_CHECK &&
+             same_header(STATE->update_file, STATE->update_header) == 0) {
     STATE->last_update_filetime = now;
 
     if (bgpstream_resource_mgr_push(
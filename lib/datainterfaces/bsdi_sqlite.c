@@ -68,6 +68,10 @@ BSDI_CREATE_CLASS(sqlite, BGPSTREAM_DATA_INTERFACE_SQLITE,
 
 #define MAX_QUERY_LEN 2048
 
+/* Historical data is read in windows of this many seconds of file time, so
+   that the first files can be opened without waiting for the whole result */
+#define WINDOW_LEN 7200
+
 typedef struct bsdi_sqlite_state {
   /* user-provided options: */
 
@@ -81,6 +85,12 @@ typedef struct bsdi_sqlite_state {
   // statement handle
   sqlite3_stmt *stmt;
 
+  // statement that finds the first file time of the next non-empty window
+  sqlite3_stmt *next_stmt;
+
+  // index of the first of the window parameters of stmt
+  int window_param;
+
   // buffer for building queries XXX
   char query_buf[MAX_QUERY_LEN];
 
@@ -90,9 +100,13 @@ typedef struct bsdi_sqlite_state {
   // last timestamp
   uint32_t last_ts;
 
-} bsdi_sqlite_state_t;
+  // are we still paging through the data that was in the DB when we started?
+  int paging;
 
-#define MAX_INTERVAL_LEN 16
+  // start of the next window to read while paging
+  int64_t window_start;
+
+} bsdi_sqlite_state_t;
 
 #define APPEND_STR(str)                                                        \
   do {                                                                         \
@@ -104,48 +118,34 @@ typedef struct bsdi_sqlite_state {
     rem_buf_space -= len;                                                      \
   } while (0)
 
-static int prepare_db(bsdi_t *di)
-{
-  if (sqlite3_open_v2(STATE->db_file, &STATE->db, SQLITE_OPEN_READONLY, NULL) !=
-      SQLITE_OK) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "can't open database: %s",
-                  sqlite3_errmsg(STATE->db));
-    return -1;
-  }
-
-  if (sqlite3_prepare_v2(STATE->db, STATE->query_buf, -1, &STATE->stmt, NULL) !=
-      SQLITE_OK) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "failed to prepare statement: %s",
-                  sqlite3_errmsg(STATE->db));
-    return -1;
-  }
-  return 0;
-}
-
-/* ========== PUBLIC METHODS BELOW HERE ========== */
-
-int bsdi_sqlite_init(bsdi_t *di)
-{
-  bsdi_sqlite_state_t *state;
-
-  if ((state = malloc_zero(sizeof(bsdi_sqlite_state_t))) == NULL) {
-    goto err;
-  }
-  BSDI_SET_STATE(di, state);
-
-  /* set default state */
-  // none
+// append an IN list with one placeholder per value of the given set
+#define APPEND_IN_LIST(column, set)                                            \
+  do {                                                                         \
+    first = 1;                                                                 \
+    APPEND_STR(" AND " column " IN (");                                        \
+    bgpstream_str_set_rewind(set);                                             \
+    while (bgpstream_str_set_next(set) != NULL) {                              \
+      APPEND_STR(first ? "?" : ", ?");                                         \
+      first = 0;                                                               \
+    }                                                                          \
+    APPEND_STR(" ) ");                                                         \
+  } while (0)
 
-  return 0;
-err:
-  bsdi_sqlite_destroy(di);
-  return -1;
-}
+// bind the values of the given set to consecutive placeholders
+#define BIND_SET(set)                                                          \
+  do {                                                                         \
+    bgpstream_str_set_rewind(set);                                             \
+    while ((f = bgpstream_str_set_next(set)) != NULL) {                        \
+      if (sqlite3_bind_text(STATE->stmt, param++, f, -1, SQLITE_TRANSIENT) !=  \
+          SQLITE_OK) {                                                         \
+        goto err;                                                              \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
 
 static int build_query(bsdi_t *di)
 {
   size_t rem_buf_space = MAX_QUERY_LEN;
-  char interval_str[MAX_INTERVAL_LEN];
 
   /* reset the query buffer. probably unnecessary, but lets do it anyway */
   STATE->query_buf[0] = '\0';
@@ -160,91 +160,27 @@ static int build_query(bsdi_t *di)
     "bgp_data.type_id = time_span.bgp_type_id ");
 
   // projects, collectors, bgp_types, and time_interval are used as filters
-  // only if they are provided by the user
+  // only if they are provided by the user. their values are bound to the
+  // placeholders by prepare_db
   bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
   int first;
-  char *f;
 
-  // projects
-  first = 1;
   if (filter_mgr->projects != NULL) {
-    APPEND_STR(" AND collectors.project IN (");
-    bgpstream_str_set_rewind(filter_mgr->projects);
-    while ((f = bgpstream_str_set_next(filter_mgr->projects)) != NULL) {
-      if (!first) {
-        APPEND_STR(", ");
-      }
-      APPEND_STR("'");
-      APPEND_STR(f);
-      APPEND_STR("'");
-      first = 0;
-    }
-    APPEND_STR(" ) ");
+    APPEND_IN_LIST("collectors.project", filter_mgr->projects);
   }
-
-  // collectors
-  first = 1;
   if (filter_mgr->collectors != NULL) {
-    APPEND_STR(" AND collectors.name IN (");
-    bgpstream_str_set_rewind(filter_mgr->collectors);
-    while ((f = bgpstream_str_set_next(filter_mgr->collectors)) != NULL) {
-      if (!first) {
-        APPEND_STR(", ");
-      }
-      APPEND_STR("'");
-      APPEND_STR(f);
-      APPEND_STR("'");
-      first = 0;
-    }
-    APPEND_STR(" ) ");
+    APPEND_IN_LIST("collectors.name", filter_mgr->collectors);
   }
-
-  // bgp_types
-  first = 1;
   if (filter_mgr->bgp_types != NULL) {
-    APPEND_STR(" AND bgp_types.name IN (");
-    bgpstream_str_set_rewind(filter_mgr->bgp_types);
-    while ((f = bgpstream_str_set_next(filter_mgr->bgp_types)) != NULL) {
-      if (!first) {
-        APPEND_STR(", ");
-      }
-      APPEND_STR("'");
-      APPEND_STR(f);
-      APPEND_STR("'");
-      first = 0;
-    }
-    APPEND_STR(" ) ");
+    APPEND_IN_LIST("bgp_types.name", filter_mgr->bgp_types);
   }
 
   // time_interval
-  int written = 0;
   if (TIF != NULL) {
-    APPEND_STR(" AND ( ");
-
-    APPEND_STR(" ( ");
-
-    // BEGIN TIME
-    APPEND_STR(" (bgp_data.file_time >=  ");
-    interval_str[0] = '\0';
-    if ((written = snprintf(interval_str, MAX_INTERVAL_LEN, "%" PRIu32,
-                            TIF->begin_time)) < MAX_INTERVAL_LEN) {
-      APPEND_STR(interval_str);
-    }
-    APPEND_STR("  - time_span.time_span - 120 )");
-    APPEND_STR("  AND  ");
-
-    // END TIME
+    APPEND_STR(" AND bgp_data.file_time >= ? - time_span.time_span - 120");
     if (TIF->end_time != BGPSTREAM_FOREVER) {
-      APPEND_STR(" (bgp_data.file_time <=  ");
-      interval_str[0] = '\0';
-      if ((written = snprintf(interval_str, MAX_INTERVAL_LEN, "%" PRIu32,
-                              TIF->end_time)) < MAX_INTERVAL_LEN) {
-        APPEND_STR(interval_str);
-      }
-      APPEND_STR(") ");
-      APPEND_STR(" ) ");
+      APPEND_STR(" AND bgp_data.file_time <= ?");
     }
-    APPEND_STR(" )");
   }
 
   /*  comment on 120 seconds: */
@@ -254,7 +190,9 @@ static int build_query(bsdi_t *di)
   /*  in order to compensate for this kind of situations we  */
   /*  retrieve data that are 120 seconds older than the requested  */
 
-  // minimum timestamp and current timestamp are the two placeholders
+  // the window of file times, then the minimum timestamp and current
+  // timestamp are the last four placeholders
+  APPEND_STR(" AND bgp_data.file_time >= ? AND bgp_data.file_time < ?");
   APPEND_STR(" AND bgp_data.ts > ? AND bgp_data.ts <= ?");
   // order by filetime and bgptypes in reverse order: this way the
   // input insertions are always "head" insertions, i.e. queue insertion is
@@ -267,6 +205,166 @@ err:
   return -1;
 }
 
+static int prepare_db(bsdi_t *di)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  sqlite3_stmt *span_stmt = NULL;
+  int param = 1;
+  int max_span = 0;
+  char *f;
+
+  if (sqlite3_open_v2(STATE->db_file, &STATE->db, SQLITE_OPEN_READONLY, NULL) !=
+      SQLITE_OK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't open database: %s",
+                  sqlite3_errmsg(STATE->db));
+    return -1;
+  }
+
+  if (sqlite3_prepare_v2(STATE->db, STATE->query_buf, -1, &STATE->stmt, NULL) !=
+        SQLITE_OK ||
+      sqlite3_prepare_v2(STATE->db,
+                         "SELECT MIN(file_time) FROM bgp_data "
+                         "WHERE file_time >= ? AND ts <= ?",
+                         -1, &STATE->next_stmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(STATE->db, "SELECT MAX(time_span) FROM time_span", -1,
+                         &span_stmt, NULL) != SQLITE_OK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "failed to prepare statement: %s",
+                  sqlite3_errmsg(STATE->db));
+    sqlite3_finalize(span_stmt);
+    return -1;
+  }
+
+  // the filter values never change, so they are bound once
+  if (filter_mgr->projects != NULL) {
+    BIND_SET(filter_mgr->projects);
+  }
+  if (filter_mgr->collectors != NULL) {
+    BIND_SET(filter_mgr->collectors);
+  }
+  if (filter_mgr->bgp_types != NULL) {
+    BIND_SET(filter_mgr->bgp_types);
+  }
+  if (TIF != NULL) {
+    if (sqlite3_bind_int64(STATE->stmt, param++, TIF->begin_time) !=
+          SQLITE_OK ||
+        (TIF->end_time != BGPSTREAM_FOREVER &&
+         sqlite3_bind_int64(STATE->stmt, param++, TIF->end_time) !=
+           SQLITE_OK)) {
+      goto err;
+    }
+  }
+  STATE->window_param = param;
+
+  // the first window starts early enough to include the files that the
+  // interval filter lets in
+  if (sqlite3_step(span_stmt) == SQLITE_ROW) {
+    max_span = sqlite3_column_int(span_stmt, 0);
+  }
+  sqlite3_finalize(span_stmt);
+  STATE->window_start =
+    (TIF != NULL) ? (int64_t)TIF->begin_time - max_span - 120 : 0;
+  STATE->paging = 1;
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "failed to bind query parameters: %s",
+                sqlite3_errmsg(STATE->db));
+  return -1;
+}
+
+// push the files with file times in [win_start, win_end) that were added in
+// (min_ts, max_ts]. returns the number of files pushed, or -1 on error
+static int run_query(bsdi_t *di, int64_t win_start, int64_t win_end,
+                     uint32_t min_ts, uint32_t max_ts)
+{
+  int rc;
+  int cnt = 0;
+  int param = STATE->window_param;
+
+  sqlite3_bind_int64(STATE->stmt, param, win_start);
+  sqlite3_bind_int64(STATE->stmt, param + 1, win_end);
+  sqlite3_bind_int64(STATE->stmt, param + 2, min_ts);
+  sqlite3_bind_int64(STATE->stmt, param + 3, max_ts);
+
+  while ((rc = sqlite3_step(STATE->stmt)) != SQLITE_DONE) {
+    if (rc != SQLITE_ROW) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "error while stepping through results");
+      goto err;
+    }
+
+    const char *path = (const char *)sqlite3_column_text(STATE->stmt, 0);
+    const char *proj = (const char *)sqlite3_column_text(STATE->stmt, 1);
+    const char *coll = (const char *)sqlite3_column_text(STATE->stmt, 2);
+    const char *type_str = (const char *)sqlite3_column_text(STATE->stmt, 3);
+    bgpstream_record_dump_type_t type;
+    if (strcmp("ribs", type_str) == 0) {
+      type = BGPSTREAM_RIB;
+    } else if (strcmp("updates", type_str) == 0) {
+      type = BGPSTREAM_UPDATE;
+    } else {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "invalid record type found '%s'",
+                    type_str);
+      goto err;
+    }
+    uint32_t file_time = sqlite3_column_int(STATE->stmt, 5);
+    uint32_t duration = sqlite3_column_int(STATE->stmt, 4);
+
+    if (bgpstream_resource_mgr_push(
+          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+          BGPSTREAM_RESOURCE_FORMAT_MRT, path, file_time, duration, proj, coll,
+          type, NULL) < 0) {
+      goto err;
+    }
+    cnt++;
+  }
+
+  sqlite3_reset(STATE->stmt);
+  return cnt;
+
+err:
+  sqlite3_reset(STATE->stmt);
+  return -1;
+}
+
+// find the first file time at or after the start of the next window. returns
+// 1 if there is one, 0 if there are no more files
+static int next_window(bsdi_t *di, int64_t *file_time)
+{
+  int rc;
+
+  sqlite3_bind_int64(STATE->next_stmt, 1, STATE->window_start);
+  sqlite3_bind_int64(STATE->next_stmt, 2, STATE->current_ts);
+  if ((rc = sqlite3_step(STATE->next_stmt)) != SQLITE_ROW) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "error while finding the next window");
+    sqlite3_reset(STATE->next_stmt);
+    return -1;
+  }
+  rc = sqlite3_column_type(STATE->next_stmt, 0) != SQLITE_NULL;
+  *file_time = sqlite3_column_int64(STATE->next_stmt, 0);
+  sqlite3_reset(STATE->next_stmt);
+  return rc;
+}
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+int bsdi_sqlite_init(bsdi_t *di)
+{
+  bsdi_sqlite_state_t *state;
+
+  if ((state = malloc_zero(sizeof(bsdi_sqlite_state_t))) == NULL) {
+    goto err;
+  }
+  BSDI_SET_STATE(di, state);
+
+  /* set default state */
+  // none
+
+  return 0;
+err:
+  bsdi_sqlite_destroy(di);
+  return -1;
+}
+
 int bsdi_sqlite_start(bsdi_t *di)
 {
   /* check user-provided options */
@@ -315,6 +413,7 @@ void bsdi_sqlite_destroy(bsdi_t *di)
   STATE->db_file = NULL;
 
   sqlite3_finalize(STATE->stmt);
+  sqlite3_finalize(STATE->next_stmt);
   sqlite3_close(STATE->db);
 
   free(STATE);
@@ -323,47 +422,45 @@ void bsdi_sqlite_destroy(bsdi_t *di)
 
 int bsdi_sqlite_update_resources(bsdi_t *di)
 {
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  int64_t file_time;
   int rc;
 
+  if (STATE->paging != 0) {
+    // page through what is in the DB now, one window of file time at a
+    // time. files added while we do this are picked up afterwards.
+    if (STATE->current_ts == 0) {
+      STATE->current_ts = epoch_sec() - 1; // now() - 1 second
+    }
+    while (1) {
+      if ((rc = next_window(di, &file_time)) < 0) {
+        goto err;
+      }
+      if (rc == 0 || (TIF != NULL && TIF->end_time != BGPSTREAM_FOREVER &&
+                      file_time > TIF->end_time)) {
+        STATE->paging = 0;
+        break;
+      }
+      STATE->window_start = file_time + WINDOW_LEN;
+      if ((rc = run_query(di, file_time, STATE->window_start, 0,
+                          STATE->current_ts)) < 0) {
+        goto err;
+      }
+      if (rc > 0) {
+        return 0;
+      }
+      // nothing in this window passed the filters, so try the next one
+    }
+  }
+
   STATE->last_ts = STATE->current_ts;
   // update current_timestamp - we always ask for data 1 second old at least
   STATE->current_ts = epoch_sec() - 1; // now() - 1 second
 
-  sqlite3_bind_int(STATE->stmt, 1, STATE->last_ts);
-  sqlite3_bind_int(STATE->stmt, 2, STATE->current_ts);
-
-  while ((rc = sqlite3_step(STATE->stmt)) != SQLITE_DONE) {
-    if (rc != SQLITE_ROW) {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "error while stepping through results");
-      goto err;
-    }
-
-    const char *path = (const char *)sqlite3_column_text(STATE->stmt, 0);
-    const char *proj = (const char *)sqlite3_column_text(STATE->stmt, 1);
-    const char *coll = (const char *)sqlite3_column_text(STATE->stmt, 2);
-    const char *type_str = (const char *)sqlite3_column_text(STATE->stmt, 3);
-    bgpstream_record_dump_type_t type;
-    if (strcmp("ribs", type_str) == 0) {
-      type = BGPSTREAM_RIB;
-    } else if (strcmp("updates", type_str) == 0) {
-      type = BGPSTREAM_UPDATE;
-    } else {
-      bgpstream_log(BGPSTREAM_LOG_ERR, "invalid record type found '%s'",
-                    type_str);
-      goto err;
-    }
-    uint32_t file_time = sqlite3_column_int(STATE->stmt, 5);
-    uint32_t duration = sqlite3_column_int(STATE->stmt, 4);
-
-    if (bgpstream_resource_mgr_push(
-          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
-          BGPSTREAM_RESOURCE_FORMAT_MRT, path, file_time, duration, proj, coll,
-          type, NULL) < 0) {
-      goto err;
-    }
+  if (run_query(di, INT64_MIN, INT64_MAX, STATE->last_ts, STATE->current_ts) <
+      0) {
+    goto err;
   }
-
-  sqlite3_reset(STATE->stmt);
   return 0;
 
 err:
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_decoded_cache.h"
+#include "bgpstream_binary.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DECODED_MAGIC "BSDC"
+#define DECODED_VERSION 1
+
+/** Header: magic (4), cache version (4), elem encoding version (4) */
+#define DECODED_HDR_LEN 12
+
+/** Record header: time_sec (4), time_usec (4), elems length (4) */
+#define DECODED_REC_HDR_LEN 12
+
+/** Sanity limit on the encoded size of a single elem */
+#define DECODED_MAX_ELEM_LEN (16 * 1024 * 1024)
+
+struct bgpstream_decoded_writer {
+  char path[1024];
+  char tmp_path[1024];
+  FILE *fp;
+
+  /** Is there a record waiting to be flushed? */
+  int rec_open;
+  uint32_t rec_hdr[3];
+
+  /** Encoded elems of the current record */
+  uint8_t *buf;
+  size_t buf_len;
+  size_t buf_alloc;
+};
+
+struct bgpstream_decoded_reader {
+  uint8_t *map;
+  size_t map_len;
+
+  /** Offset of the next record in the mapping */
+  size_t offset;
+};
+
+static int flush_record(bgpstream_decoded_writer_t *w)
+{
+  if (w->rec_open == 0) {
+    return 0;
+  }
+  w->rec_hdr[2] = htonl(w->buf_len);
+  if (fwrite(w->rec_hdr, sizeof(w->rec_hdr), 1, w->fp) != 1 ||
+      (w->buf_len > 0 && fwrite(w->buf, w->buf_len, 1, w->fp) != 1)) {
+    return -1;
+  }
+  w->rec_open = 0;
+  w->buf_len = 0;
+  return 0;
+}
+
+bgpstream_decoded_writer_t *bgpstream_decoded_writer_create(const char *path)
+{
+  bgpstream_decoded_writer_t *w;
+  uint32_t hdr[2];
+
+  if ((w = malloc_zero(sizeof(bgpstream_decoded_writer_t))) == NULL) {
+    return NULL;
+  }
+
+  if (snprintf(w->path, sizeof(w->path), "%s", path) >= sizeof(w->path) ||
+      snprintf(w->tmp_path, sizeof(w->tmp_path), "%s.%d.temp", path,
+               getpid()) >= sizeof(w->tmp_path) ||
+      (w->fp = fopen(w->tmp_path, "w")) == NULL) {
+    free(w);
+    return NULL;
+  }
+
+  hdr[0] = htonl(DECODED_VERSION);
+  hdr[1] = htonl(BGPSTREAM_BINARY_VERSION);
+  if (fwrite(DECODED_MAGIC, 4, 1, w->fp) != 1 ||
+      fwrite(hdr, sizeof(hdr), 1, w->fp) != 1) {
+    bgpstream_decoded_writer_destroy(w);
+    return NULL;
+  }
+
+  return w;
+}
+
+int bgpstream_decoded_writer_add_record(bgpstream_decoded_writer_t *w,
+                                        uint32_t time_sec, uint32_t time_usec)
+{
+  if (flush_record(w) != 0) {
+    return -1;
+  }
+  w->rec_hdr[0] = htonl(time_sec);
+  w->rec_hdr[1] = htonl(time_usec);
+  w->rec_open = 1;
+  return 0;
+}
+
+int bgpstream_decoded_writer_add_elem(bgpstream_decoded_writer_t *w,
+                                      const bgpstream_elem_t *elem)
+{
+  ssize_t rc;
+  size_t new_alloc;
+  uint8_t *tmp;
+
+  assert(w->rec_open != 0);
+
+  // grow the buffer until the elem fits
+  while ((rc = bgpstream_elem_binary_write(w->buf + w->buf_len,
+                                           w->buf_alloc - w->buf_len, elem)) <
+         0) {
+    if (w->buf_alloc - w->buf_len >= DECODED_MAX_ELEM_LEN) {
+      return -1;
+    }
+    new_alloc = (w->buf_alloc == 0) ? 4096 : w->buf_alloc * 2;
+    if ((tmp = realloc(w->buf, new_alloc)) == NULL) {
+      return -1;
+    }
+    w->buf = tmp;
+    w->buf_alloc = new_alloc;
+  }
+  w->buf_len += rc;
+  return 0;
+}
+
+int bgpstream_decoded_writer_commit(bgpstream_decoded_writer_t *w)
+{
+  int rc = -1;
+
+  if (flush_record(w) != 0) {
+    goto done;
+  }
+  if (fclose(w->fp) != 0) {
+    w->fp = NULL;
+    goto done;
+  }
+  w->fp = NULL;
+
+  if (rename(w->tmp_path, w->path) != 0) {
+    goto done;
+  }
+  // nothing left to clean up
+  w->tmp_path[0] = '\0';
+  rc = 0;
+
+done:
+  if (rc != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not write decoded cache %s",
+                  w->path);
+  }
+  bgpstream_decoded_writer_destroy(w);
+  return rc;
+}
+
+void bgpstream_decoded_writer_destroy(bgpstream_decoded_writer_t *w)
+{
+  if (w == NULL) {
+    return;
+  }
+  if (w->fp != NULL) {
+    fclose(w->fp);
+  }
+  if (w->tmp_path[0] != '\0') {
+    remove(w->tmp_path);
+  }
+  free(w->buf);
+  free(w);
+}
+
+bgpstream_decoded_reader_t *bgpstream_decoded_reader_open(const char *path)
+{
+  bgpstream_decoded_reader_t *r = NULL;
+  struct stat st;
+  uint32_t hdr[2];
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < DECODED_HDR_LEN ||
+      (r = malloc_zero(sizeof(bgpstream_decoded_reader_t))) == NULL) {
+    goto err;
+  }
+  r->map_len = st.st_size;
+  if ((r->map = mmap(NULL, r->map_len, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+      MAP_FAILED) {
+    r->map = NULL;
+    goto err;
+  }
+  close(fd);
+  fd = -1;
+
+  memcpy(hdr, r->map + 4, sizeof(hdr));
+  if (memcmp(r->map, DECODED_MAGIC, 4) != 0 ||
+      ntohl(hdr[0]) != DECODED_VERSION ||
+      ntohl(hdr[1]) != BGPSTREAM_BINARY_VERSION) {
+    goto err;
+  }
+  madvise(r->map, r->map_len, MADV_SEQUENTIAL);
+  r->offset = DECODED_HDR_LEN;
+  return r;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Ignoring invalid decoded cache %s", path);
+  if (fd >= 0) {
+    close(fd);
+  }
+  bgpstream_decoded_reader_destroy(r);
+  return NULL;
+}
+
+int bgpstream_decoded_reader_next(bgpstream_decoded_reader_t *r,
+                                  uint32_t *time_sec, uint32_t *time_usec,
+                                  const uint8_t **elems, size_t *elems_len)
+{
+  uint32_t hdr[3];
+
+  if (r->offset == r->map_len) {
+    return 0;
+  }
+  if (r->map_len - r->offset < DECODED_REC_HDR_LEN) {
+    return -1;
+  }
+  memcpy(hdr, r->map + r->offset, sizeof(hdr));
+  r->offset += DECODED_REC_HDR_LEN;
+  if (r->map_len - r->offset < ntohl(hdr[2])) {
+    return -1;
+  }
+
+  *time_sec = ntohl(hdr[0]);
+  *time_usec = ntohl(hdr[1]);
+  *elems = r->map + r->offset;
+  *elems_len = ntohl(hdr[2]);
+  r->offset += *elems_len;
+  return 1;
+}
+
+void bgpstream_decoded_reader_destroy(bgpstream_decoded_reader_t *r)
+{
+  if (r == NULL) {
+    return;
+  }
+  if (r->map != NULL) {
+    munmap(r->map, r->map_len);
+  }
+  free(r);
+}
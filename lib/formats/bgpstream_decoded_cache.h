@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_DECODED_CACHE_H
+#define __BGPSTREAM_DECODED_CACHE_H
+
+#include "bgpstream_elem.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for the sidecar cache of decoded records, used to read a
+ * cached dump back without decompressing or parsing it.
+ *
+ * The cache is a header followed by one entry per (unfiltered) message of the
+ * dump: the record time (seconds and microseconds), the length of its elems,
+ * and then the elems themselves, encoded with bgpstream_elem_binary_write. The
+ * file is meant to be mmap'ed, so elems are decoded straight from the mapping
+ * as they are asked for.
+ */
+
+/** Opaque structure representing a decoded cache being written */
+typedef struct bgpstream_decoded_writer bgpstream_decoded_writer_t;
+
+/** Opaque structure representing a decoded cache being read */
+typedef struct bgpstream_decoded_reader bgpstream_decoded_reader_t;
+
+/** Start writing a decoded cache
+ *
+ * @param path          path of the cache file
+ * @return pointer to the writer if successful, NULL otherwise
+ *
+ * The cache is written to a temporary file that is only renamed into place by
+ * bgpstream_decoded_writer_commit, so that concurrent readers never see a
+ * partial cache.
+ */
+bgpstream_decoded_writer_t *bgpstream_decoded_writer_create(const char *path);
+
+/** Start a new record in the cache
+ *
+ * @param w             pointer to the writer
+ * @param time_sec      record time (seconds)
+ * @param time_usec     record time (microseconds)
+ * @return 0 if successful, -1 otherwise
+ */
+int bgpstream_decoded_writer_add_record(bgpstream_decoded_writer_t *w,
+                                        uint32_t time_sec, uint32_t time_usec);
+
+/** Add an elem to the current record
+ *
+ * @param w             pointer to the writer
+ * @param elem          pointer to the elem to add
+ * @return 0 if successful, -1 otherwise
+ */
+int bgpstream_decoded_writer_add_elem(bgpstream_decoded_writer_t *w,
+                                      const bgpstream_elem_t *elem);
+
+/** Finish writing the cache and move it into place
+ *
+ * @param w             pointer to the writer
+ * @return 0 if the cache was saved, -1 otherwise
+ *
+ * The writer is destroyed in either case.
+ */
+int bgpstream_decoded_writer_commit(bgpstream_decoded_writer_t *w);
+
+/** Destroy the given writer, discarding the cache unless it was committed
+ *
+ * @param w             pointer to the writer to destroy
+ */
+void bgpstream_decoded_writer_destroy(bgpstream_decoded_writer_t *w);
+
+/** Open an existing decoded cache
+ *
+ * @param path          path of the cache file
+ * @return pointer to the reader if successful, NULL if the cache doesn't exist
+ * or is invalid
+ */
+bgpstream_decoded_reader_t *bgpstream_decoded_reader_open(const char *path);
+
+/** Get the next record from the cache
+ *
+ * @param r             pointer to the reader
+ * @param[out] time_sec     set to the record time (seconds)
+ * @param[out] time_usec    set to the record time (microseconds)
+ * @param[out] elems        set to point to the encoded elems of the record
+ *                          (valid until the reader is destroyed)
+ * @param[out] elems_len    set to the length of the encoded elems
+ * @return 1 if a record was returned, 0 at the end of the cache, -1 if the
+ * cache is corrupted
+ */
+int bgpstream_decoded_reader_next(bgpstream_decoded_reader_t *r,
+                                  uint32_t *time_sec, uint32_t *time_usec,
+                                  const uint8_t **elems, size_t *elems_len);
+
+/** Destroy the given reader
+ *
+ * @param r             pointer to the reader to destroy
+ */
+void bgpstream_decoded_reader_destroy(bgpstream_decoded_reader_t *r);
+
+#endif /* __BGPSTREAM_DECODED_CACHE_H */
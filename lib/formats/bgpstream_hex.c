@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_hex.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HEX_NEON
+#endif
+
+/* All of the vector versions work the same way:
+ *  - digits: d = c - '0' is in [0, 9]
+ *  - letters: l = (c | 0x20) - 'a' is in [0, 5] (folding upper to lower case)
+ *  - any character that is neither makes the string invalid
+ *  - nybble = digit ? d : l + 10
+ *  - adjacent nybble pairs (high first) are then merged into bytes
+ */
+
+#if defined(__AVX2__)
+
+// number of characters decoded per iteration of the wide loop
+#define HEX_WIDE_BLOCK 64
+
+static int decode_wide_block(uint8_t *buf, const char *hex)
+{
+  const __m256i zero_c = _mm256_set1_epi8('0');
+  const __m256i a_c = _mm256_set1_epi8('a');
+  const __m256i case_c = _mm256_set1_epi8(0x20);
+  const __m256i nine = _mm256_set1_epi8(9);
+  const __m256i five = _mm256_set1_epi8(5);
+  const __m256i ten = _mm256_set1_epi8(10);
+  const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+  __m256i c, d, l, dm, lm, n, w[2];
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    c = _mm256_loadu_si256((const __m256i *)(hex + i * 32));
+    d = _mm256_sub_epi8(c, zero_c);
+    l = _mm256_sub_epi8(_mm256_or_si256(c, case_c), a_c);
+    dm = _mm256_cmpeq_epi8(_mm256_min_epu8(d, nine), d);
+    lm = _mm256_cmpeq_epi8(_mm256_min_epu8(l, five), l);
+    if (_mm256_movemask_epi8(_mm256_or_si256(dm, lm)) != -1) {
+      return -1;
+    }
+    n = _mm256_or_si256(_mm256_and_si256(d, dm),
+                        _mm256_and_si256(_mm256_add_epi8(l, ten), lm));
+    // each 16-bit lane holds (high nybble, low nybble)
+    w[i] = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(n, lo_mask), 4),
+                           _mm256_srli_epi16(n, 8));
+  }
+  // packus works within 128-bit lanes, so put the lanes back in order
+  n = _mm256_permute4x64_epi64(_mm256_packus_epi16(w[0], w[1]), 0xd8);
+  _mm256_storeu_si256((__m256i *)buf, n);
+  return 0;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+// number of characters decoded per iteration
+#define HEX_BLOCK 32
+
+static int decode_block(uint8_t *buf, const char *hex)
+{
+  const __m128i zero_c = _mm_set1_epi8('0');
+  const __m128i a_c = _mm_set1_epi8('a');
+  const __m128i case_c = _mm_set1_epi8(0x20);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i five = _mm_set1_epi8(5);
+  const __m128i ten = _mm_set1_epi8(10);
+  const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+  __m128i c, d, l, dm, lm, n, w[2];
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    c = _mm_loadu_si128((const __m128i *)(hex + i * 16));
+    d = _mm_sub_epi8(c, zero_c);
+    l = _mm_sub_epi8(_mm_or_si128(c, case_c), a_c);
+    dm = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+    lm = _mm_cmpeq_epi8(_mm_min_epu8(l, five), l);
+    if (_mm_movemask_epi8(_mm_or_si128(dm, lm)) != 0xffff) {
+      return -1;
+    }
+    n = _mm_or_si128(_mm_and_si128(d, dm),
+                     _mm_and_si128(_mm_add_epi8(l, ten), lm));
+    // each 16-bit lane holds (high nybble, low nybble)
+    w[i] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, lo_mask), 4),
+                        _mm_srli_epi16(n, 8));
+  }
+  _mm_storeu_si128((__m128i *)buf, _mm_packus_epi16(w[0], w[1]));
+  return 0;
+}
+
+#elif defined(HEX_NEON)
+
+// number of characters decoded per iteration
+#define HEX_BLOCK 32
+
+static int decode_block(uint8_t *buf, const char *hex)
+{
+  // vld2 splits the characters into high (even) and low (odd) nybbles
+  uint8x16x2_t c = vld2q_u8((const uint8_t *)hex);
+  uint8x16_t n[2], d, l, dm, lm;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    d = vsubq_u8(c.val[i], vdupq_n_u8('0'));
+    l = vsubq_u8(vorrq_u8(c.val[i], vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    dm = vcleq_u8(d, vdupq_n_u8(9));
+    lm = vcleq_u8(l, vdupq_n_u8(5));
+    if (vminvq_u8(vorrq_u8(dm, lm)) == 0) {
+      return -1;
+    }
+    n[i] = vorrq_u8(vandq_u8(d, dm),
+                    vandq_u8(vaddq_u8(l, vdupq_n_u8(10)), lm));
+  }
+  vst1q_u8(buf, vorrq_u8(vshlq_n_u8(n[0], 4), n[1]));
+  return 0;
+}
+
+#endif
+
+int bgpstream_hex_decode_scalar(uint8_t *buf, const char *hex, size_t hex_len)
+{
+  size_t i;
+  char c;
+  for (i = 0; i < hex_len; i++) {
+    c = hex[i];
+    // sanity check on input characters
+    if (c < '0' || (c > '9' && c < 'A') || (c > 'F' && c < 'a') || c > 'f') {
+      return -1;
+    }
+    if (c >= 'a') {
+      c -= ('a' - '9' - 1);
+    } else if (c >= 'A') {
+      c -= ('A' - '9' - 1);
+    }
+    c -= '0';
+
+    if ((i & 0x1) == 0) {
+      // high-order
+      *buf = c << 4;
+    } else {
+      // low-order
+      *(buf++) |= c;
+    }
+  }
+  return 0;
+}
+
+int bgpstream_hex_decode(uint8_t *buf, const char *hex, size_t hex_len)
+{
+#ifdef HEX_WIDE_BLOCK
+  while (hex_len >= HEX_WIDE_BLOCK) {
+    if (decode_wide_block(buf, hex) != 0) {
+      return -1;
+    }
+    buf += HEX_WIDE_BLOCK / 2;
+    hex += HEX_WIDE_BLOCK;
+    hex_len -= HEX_WIDE_BLOCK;
+  }
+#endif
+#ifdef HEX_BLOCK
+  while (hex_len >= HEX_BLOCK) {
+    if (decode_block(buf, hex) != 0) {
+      return -1;
+    }
+    buf += HEX_BLOCK / 2;
+    hex += HEX_BLOCK;
+    hex_len -= HEX_BLOCK;
+  }
+#endif
+  return bgpstream_hex_decode_scalar(buf, hex, hex_len);
+}
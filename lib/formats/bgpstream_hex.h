@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_HEX_H
+#define __BGPSTREAM_HEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for the hex string decoder used by the RIS Live format.
+ *
+ * The decoder uses SSE2 or AVX2 (on x86) or NEON (on 64-bit ARM) when the compiler
+ * targets them, and a portable scalar loop otherwise.
+ */
+
+/** Decode a string of hex characters into bytes
+ *
+ * @param buf           pointer to the buffer to write (hex_len + 1) / 2 bytes
+ *                      into
+ * @param hex           pointer to the hex characters (upper or lower case)
+ * @param hex_len       number of hex characters to decode
+ * @return 0 if the string was decoded, -1 if it contains a non-hex character
+ *
+ * If hex_len is odd, the last character becomes the high-order nybble of the
+ * last byte. If the string is invalid, the contents of buf are undefined.
+ */
+int bgpstream_hex_decode(uint8_t *buf, const char *hex, size_t hex_len);
+
+/** Decode a string of hex characters into bytes, one character at a time
+ *
+ * This is the same as bgpstream_hex_decode, but never uses vector
+ * instructions. It is used for the end of strings that are too short for the
+ * vector code, and as a reference for testing and benchmarking.
+ */
+int bgpstream_hex_decode_scalar(uint8_t *buf, const char *hex,
+                                size_t hex_len);
+
+#endif /* __BGPSTREAM_HEX_H */
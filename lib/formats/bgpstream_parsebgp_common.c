@@ -31,9 +31,16 @@
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_utils_community_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_trace.h"
+#include "bgpstream_utils_mem_int.h"
+#include "bgpstream_parsebgp_pdecode.h"
+#include "utils.h"
+#include <arpa/inet.h>
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 // if the parser encounters an "invalid" message, it will be written to
 // "debug.msg" if this is set
@@ -42,6 +49,24 @@
 #include <stdio.h>
 #endif
 
+// number of messages (and elems) that each thread keeps for reuse
+#define REUSE_CACHE_MAX 32
+
+// messages and elems released by a thread, kept for reuse by it
+typedef struct reuse_cache {
+  parsebgp_msg_t *msgs[REUSE_CACHE_MAX];
+  int msgs_cnt;
+  bgpstream_elem_t *elems[REUSE_CACHE_MAX];
+  int elems_cnt;
+} reuse_cache_t;
+
+static __thread reuse_cache_t *reuse_cache = NULL;
+
+/* Key used to free the cache of a thread when it exits */
+static pthread_key_t reuse_cache_key;
+static pthread_once_t reuse_cache_key_once = PTHREAD_ONCE_INIT;
+static int reuse_cache_key_ok = 0;
+
 static bgpstream_as_path_seg_type_t as_path_types[] = {
   BGPSTREAM_AS_PATH_SEG_INVALID,    // INVALID
   BGPSTREAM_AS_PATH_SEG_SET,        // PARSEBGP_BGP_UPDATE_AS_PATH_SEG_AS_SET
@@ -179,31 +204,128 @@ static int handle_as_paths(bgpstream_as_path_t *path,
   return 0;
 }
 
+static void check_contents(bgpstream_parsebgp_decode_state_t *state,
+                           bgpstream_transport_t *transport)
+{
+  state->contents_checked = 1;
+  state->contents =
+    bgpstream_transport_get_contents(transport, &state->contents_len);
+  state->lends = bgpstream_transport_can_lend(transport);
+}
+
 static ssize_t refill_buffer(bgpstream_parsebgp_decode_state_t *state,
                              bgpstream_transport_t *transport)
 {
-  size_t len = 0;
+  size_t used;
   int64_t new_read = 0;
 
-  if (state->remain > 0) {
-    // need to move remaining data to start of buffer
-    memmove(state->buffer,
-            state->buffer + BGPSTREAM_PARSEBGP_BUFLEN - state->remain,
-            state->remain);
-    len += state->remain;
+  if (state->contents_checked == 0) {
+    check_contents(state, transport);
+  }
+  if (state->contents != NULL) {
+    if (state->read_offset == 0) {
+      // the whole resource is available at once. the parser doesn't modify
+      // its input, so it is safe to drop the const
+      state->ptr = (uint8_t *)state->contents;
+      state->read_offset = state->contents_len;
+      return state->contents_len;
+    }
+    // and there is nothing more after it
+    return state->remain;
   }
 
+  if (state->lends != 0) {
+    if (state->remain == 0) {
+      // parse the next message where the transport holds it. it is released
+      // when we ask for the one after it
+      const uint8_t *lent;
+      if ((new_read = bgpstream_transport_read_lent(transport, &lent)) <= 0) {
+        return new_read;
+      }
+      state->ptr = (uint8_t *)lent;
+      state->ptr_lent = 1;
+      state->read_offset += new_read;
+      BGPSTREAM_TRACE2(buffer__refill, transport->res->url, new_read);
+      return new_read;
+    }
+    if (state->ptr_lent != 0) {
+      // a message continues into the next one, so save what we have before
+      // the transport releases it, and copy from here on
+      assert(state->remain <= BGPSTREAM_PARSEBGP_BUFLEN);
+      memcpy(state->buffer, state->ptr, state->remain);
+      state->ptr = state->buffer;
+      state->ptr_lent = 0;
+    }
+  }
+
+  if (state->remain == 0) {
+    state->ptr = state->buffer;
+  } else if (state->ptr != state->buffer &&
+             (size_t)(state->buffer + BGPSTREAM_PARSEBGP_BUFLEN -
+                      (state->ptr + state->remain)) <
+               BGPSTREAM_PARSEBGP_REFILL_MIN) {
+    // not much space after the partial message, so move it to the start of the
+    // buffer. otherwise we just read in after it and parse it where it is.
+    memmove(state->buffer, state->ptr, state->remain);
+    state->ptr = state->buffer;
+  }
+  used = (state->ptr - state->buffer) + state->remain;
+
   // try and do a read
-  if ((new_read = bgpstream_transport_read(transport, state->buffer + len,
-                                           BGPSTREAM_PARSEBGP_BUFLEN - len)) <
+  if ((new_read = bgpstream_transport_read(transport, state->buffer + used,
+                                           BGPSTREAM_PARSEBGP_BUFLEN - used)) <
       0) {
     // read failed
     return new_read;
   }
+  state->read_offset += new_read;
+  BGPSTREAM_TRACE2(buffer__refill, transport->res->url, new_read);
 
   // new_read could be 0, indicating EOF, so need to check returned len is
   // larger than passed in remain
-  return len + new_read;
+  return state->remain + new_read;
+}
+
+// work out the length of the next message from its header so that we don't
+// waste time parsing a message that has been cut off by the end of the buffer.
+// returns 0 if the length can't be known without parsing
+static size_t peek_msg_len(bgpstream_parsebgp_decode_state_t *state)
+{
+  uint32_t len;
+
+  switch (state->msg_type) {
+  case PARSEBGP_MSG_TYPE_MRT:
+    // timestamp (4), type (2), subtype (2), length (4, excluding the header)
+    if (state->remain < 12) {
+      return 12;
+    }
+    memcpy(&len, state->ptr + 8, sizeof(len));
+    return 12 + (size_t)ntohl(len);
+
+  case PARSEBGP_MSG_TYPE_BMP:
+    // version (1), then for v3 the length (4) of the entire message
+    if (state->remain < 5) {
+      return 5;
+    }
+    if (state->ptr[0] != 3) {
+      return 0;
+    }
+    memcpy(&len, state->ptr + 1, sizeof(len));
+    return ntohl(len);
+
+  default:
+    return 0;
+  }
+}
+
+// count a message that the format filtered out
+static void count_filtered(bgpstream_format_t *format)
+{
+  if ((int)format->res->format_type <= BGPSTREAM_RESOURCE_FORMAT_RISLIVE) {
+    bgpstream_stats_add(BGPSTREAM_STAT_FORMAT(BGPSTREAM_STAT_MRT_FILTERED,
+                                              format->res->format_type),
+                        1);
+  }
 }
 
 static bgpstream_format_status_t
@@ -274,6 +396,12 @@ static int handle_prefix(bgpstream_elem_t *elem,
         bgpstream_log(BGPSTREAM_LOG_ERR, "Could not extract withdrawal elem"); \
         return -1;                                                             \
       }                                                                        \
+      if (rc != 0 && filter_mgr != NULL &&                                     \
+          bgpstream_filter_mgr_elem_precheck(                                  \
+            filter_mgr, elem,                                                  \
+            BGPSTREAM_ELEM_CHECK_PEER | BGPSTREAM_ELEM_CHECK_PREFIX) == 0) {   \
+        rc = 0; /* skip it */                                                  \
+      }                                                                        \
       upd_state->withdrawal_##nlri_type##_cnt--;                               \
       upd_state->withdrawal_##nlri_type##_idx++;                               \
     }                                                                          \
@@ -302,6 +430,12 @@ static int handle_prefix(bgpstream_elem_t *elem,
                       "Could not extract announcement elem");                  \
         return -1;                                                             \
       }                                                                        \
+      if (rc != 0 && filter_mgr != NULL &&                                     \
+          bgpstream_filter_mgr_elem_precheck(filter_mgr, elem,                 \
+                                             BGPSTREAM_ELEM_CHECK_PREFIX) ==   \
+            0) {                                                               \
+        rc = 0; /* skip it */                                                  \
+      }                                                                        \
       upd_state->announce_##nlri_type##_cnt--;                                 \
       upd_state->announce_##nlri_type##_idx++;                                 \
     }                                                                          \
@@ -311,6 +445,7 @@ static int handle_prefix(bgpstream_elem_t *elem,
   } while (0)
 
 int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
+                                      bgpstream_filter_mgr_t *filter_mgr,
                                       bgpstream_elem_t *elem,
                                       parsebgp_bgp_msg_t *bgp)
 {
@@ -374,6 +509,18 @@ int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
       return -1;
     }
     upd_state->path_attr_done = 1;
+
+    // all the announcements share the path attributes, so if they can't pass
+    // the filters then none of the announcements can
+    elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+    if (filter_mgr != NULL &&
+        bgpstream_filter_mgr_elem_precheck(
+          filter_mgr, elem,
+          BGPSTREAM_ELEM_CHECK_PEER | BGPSTREAM_ELEM_CHECK_PATH) == 0) {
+      upd_state->announce_v4_cnt = 0;
+      upd_state->announce_v6_cnt = 0;
+      return 0;
+    }
   }
 
   // IPv4 Announcements (will also trigger next-hop extraction)
@@ -471,6 +618,32 @@ int bgpstream_parsebgp_process_path_attrs(
   return 0;
 }
 
+uint32_t bgpstream_parsebgp_update_elem_cnt(parsebgp_bgp_msg_t *bgp)
+{
+  parsebgp_bgp_update_t *update = bgp->types.update;
+  parsebgp_bgp_update_path_attr_t *attrs;
+  uint32_t cnt;
+
+  if (bgp->type != PARSEBGP_BGP_TYPE_UPDATE || update == NULL) {
+    return 0;
+  }
+  attrs = update->path_attrs.attrs;
+
+  cnt = update->withdrawn_nlris.prefixes_cnt +
+        update->announced_nlris.prefixes_cnt;
+  if (attrs[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_UNREACH_NLRI].type ==
+      PARSEBGP_BGP_PATH_ATTR_TYPE_MP_UNREACH_NLRI) {
+    cnt += attrs[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_UNREACH_NLRI]
+             .data.mp_unreach->withdrawn_nlris_cnt;
+  }
+  if (attrs[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_REACH_NLRI].type ==
+      PARSEBGP_BGP_PATH_ATTR_TYPE_MP_REACH_NLRI) {
+    cnt += attrs[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_REACH_NLRI]
+             .data.mp_reach->nlris_cnt;
+  }
+  return cnt;
+}
+
 int bgpstream_parsebgp_process_next_hop(bgpstream_elem_t *el,
                                         parsebgp_bgp_update_path_attr_t *attrs,
                                         int is_mp_pfx)
@@ -496,17 +669,94 @@ int bgpstream_parsebgp_process_next_hop(bgpstream_elem_t *el,
   return 0;
 }
 
-bgpstream_format_status_t bgpstream_parsebgp_populate_record(
-  bgpstream_parsebgp_decode_state_t *state, parsebgp_msg_t *msg,
-  bgpstream_format_t *format, bgpstream_record_t *record,
-  bgpstream_parsebgp_prep_buf_cb_t *prep_cb,
-  bgpstream_parsebgp_check_filter_cb_t *filter_cb)
+// queue as many complete messages from the buffer as the parallel decoder will
+// take, then wait for the oldest one to be decoded. returns 1 if a decoded
+// message was swapped into msg, 0 if no more messages can be decoded in
+// parallel (the rest of the buffer must be decoded by the caller), -1 on error
+static int pdecode_next(bgpstream_parsebgp_decode_state_t *state,
+                        bgpstream_format_t *format,
+                        bgpstream_parsebgp_demux_cb_t *demux_cb,
+                        parsebgp_msg_t *msg, parsebgp_error_t *err,
+                        const uint8_t **raw, size_t *raw_len, size_t *hdr_len,
+                        uint64_t *skipped_cnt)
+{
+  bgpstream_parsebgp_check_filter_rc_t demux_rc = BGPSTREAM_PARSEBGP_KEEP;
+  ssize_t fill_len;
+  size_t len, msg_len;
+
+  while (state->pdec_drained == 0 &&
+         bgpstream_parsebgp_pdecode_full(state->pdec) == 0) {
+    *hdr_len = 0;
+    if (demux_cb != NULL && state->remain > 0) {
+      demux_rc = demux_cb(format, state->ptr, state->remain, hdr_len, &msg_len);
+      if (demux_rc == BGPSTREAM_PARSEBGP_FILTER_ERROR) {
+        return -1;
+      }
+      len = msg_len == 0 ? 0 : *hdr_len + msg_len;
+    } else {
+      len = peek_msg_len(state);
+    }
+    if (len == 0 && state->remain > 0) {
+      // we can't frame this message without parsing it
+      state->pdec_drained = 1;
+      break;
+    }
+    if (len > 0 && len <= state->remain) {
+      if (demux_rc == BGPSTREAM_PARSEBGP_EOS) {
+        // leave it for the caller, who will find the same
+        state->pdec_drained = 1;
+        break;
+      }
+      if (demux_rc == BGPSTREAM_PARSEBGP_FILTER_OUT) {
+        if (*skipped_cnt == UINT64_MAX) {
+          *skipped_cnt = 0;
+        }
+        (*skipped_cnt)++;
+        state->successful_read_cnt++;
+        count_filtered(format);
+      } else if (bgpstream_parsebgp_pdecode_push(
+                   state->pdec, state->ptr, len, *hdr_len,
+                   state->read_offset - state->remain) != 0) {
+        return -1;
+      }
+      state->ptr += len;
+      state->remain -= len;
+      continue;
+    }
+    // we need more data for the next message
+    if ((fill_len = refill_buffer(state, format->transport)) <=
+        (ssize_t)state->remain) {
+      // EOF, a read error, or a truncated message: leave whatever is left for
+      // the caller to deal with in the usual way
+      state->pdec_drained = 1;
+      break;
+    }
+    state->remain = fill_len;
+  }
+
+  if (bgpstream_parsebgp_pdecode_empty(state->pdec)) {
+    return 0;
+  }
+  *err = bgpstream_parsebgp_pdecode_pop(state->pdec, msg, raw, raw_len,
+                                        hdr_len, &state->msg_offset);
+  return 1;
+}
+
+static bgpstream_format_status_t
+populate_record(bgpstream_parsebgp_decode_state_t *state, parsebgp_msg_t *msg,
+                bgpstream_format_t *format, bgpstream_record_t *record,
+                bgpstream_parsebgp_prep_buf_cb_t *prep_cb,
+                bgpstream_parsebgp_prefilter_cb_t *prefilter_cb,
+                bgpstream_parsebgp_check_filter_cb_t *filter_cb,
+                bgpstream_parsebgp_demux_cb_t *demux_cb)
 {
   assert(record->__int->format == format);
 
   int refill = 0;
   ssize_t fill_len = 0;
-  size_t dec_len = 0, hdr_len = 0;
+  size_t dec_len = 0, hdr_len = 0, msg_len = 0, prep_len;
+  const uint8_t *raw = NULL;
+  int predecoded = 0, pdec_rc;
   uint64_t skipped_cnt = 0;
   parsebgp_error_t err;
   bgpstream_parsebgp_check_filter_rc_t filter_rc;
@@ -516,13 +766,43 @@ bgpstream_format_status_t bgpstream_parsebgp_populate_record(
   assert(record->time_sec == 0);
 
 refill:
+  // in parallel mode, messages are decoded ahead of time by the decoding
+  // threads. once no more can be queued, the rest is decoded here
+  predecoded = 0;
+  if (state->pdec != NULL) {
+    pdec_rc = pdecode_next(state, format, demux_cb, msg, &err, &raw, &msg_len,
+                           &hdr_len, &skipped_cnt);
+    if (pdec_rc < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not queue message for decoding");
+      return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+    }
+    if (pdec_rc > 0) {
+      predecoded = 1;
+      if (hdr_len > 0) {
+        // the header was only framed when the message was queued, so let the
+        // caller parse it into the record now. the parser doesn't modify its
+        // input, so it is safe to drop the const
+        prep_len = hdr_len;
+        if (prep_cb != NULL &&
+            prep_cb(format, (uint8_t *)raw, &prep_len, record) != 0) {
+          bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to prep data buffer");
+          return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+        }
+        raw += hdr_len;
+        msg_len -= hdr_len;
+      }
+      goto prefilter;
+    }
+  }
+
   // if there's nothing left in the buffer, it could just be because we happened
   // to empty it, so let's try and get some more data from the transport just in
   // case.
   // on the other hand, if there are some bytes left in the buffer, but we've
   // got to the end, and there's a partial message left, the "refill" flag will
-  // be set which causes us to do a forced refill (the remaining bytes will be
-  // shifted to the beginning of the buffer, and the rest filled).
+  // be set which causes us to do a forced refill (more data is read in after
+  // the remaining bytes, which are shifted to the beginning of the buffer
+  // first if needed).
   if (state->remain == 0 || refill != 0) {
     // try to refill the buffer
     if ((fill_len = refill_buffer(state, format->transport)) == 0) {
@@ -548,9 +828,8 @@ refill:
       record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
       return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
     }
-    // here we have something new to read
+    // here we have something new to read (starting at state->ptr)
     state->remain = fill_len;
-    state->ptr = state->buffer;
 
     // reset the "force refill" flag
     refill = 0;
@@ -573,9 +852,59 @@ refill:
     state->remain -= hdr_len;
   }
 
-  dec_len = state->remain;
-  err = parsebgp_decode(state->parser_opts, state->msg_type, msg,
-                             state->ptr, &dec_len);
+  // we can tell if the message is complete without trying to parse it (unless a
+  // prep callback has already consumed a header from it)
+  msg_len = peek_msg_len(state);
+  if (prep_cb == NULL && msg_len > state->remain) {
+    refill = 1;
+    goto refill;
+  }
+
+  state->msg_offset = state->read_offset - state->remain;
+  raw = state->ptr;
+
+prefilter:
+  // give the caller a chance to reject a complete message from its raw
+  // headers, before we pay for decoding all of its attributes and NLRIs
+  if (prefilter_cb != NULL && msg_len > 0 &&
+      (predecoded != 0 || msg_len <= state->remain)) {
+    filter_rc = prefilter_cb(format, record, raw, msg_len);
+    if (filter_rc == BGPSTREAM_PARSEBGP_FILTER_ERROR) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Format-specific pre-filtering failed");
+      return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+    }
+    if (filter_rc == BGPSTREAM_PARSEBGP_EOS) {
+      if (state->successful_read_cnt > 0) {
+        record->dump_pos = BGPSTREAM_DUMP_MIDDLE;
+      }
+      record->status = BGPSTREAM_RECORD_STATUS_OUTSIDE_TIME_INTERVAL;
+      return BGPSTREAM_FORMAT_OUTSIDE_TIME_INTERVAL;
+    }
+    if (filter_rc != BGPSTREAM_PARSEBGP_KEEP) {
+      if (predecoded != 0) {
+        parsebgp_clear_msg(msg);
+      } else {
+        state->ptr += msg_len;
+        state->remain -= msg_len;
+      }
+      if (filter_rc == BGPSTREAM_PARSEBGP_FILTER_OUT) {
+        if (skipped_cnt == UINT64_MAX) {
+          skipped_cnt = 0;
+        }
+        skipped_cnt++;
+        state->successful_read_cnt++;
+        count_filtered(format);
+      }
+      goto refill;
+    }
+    // else: we still don't know, so decode it and let filter_cb decide
+  }
+
+  if (predecoded == 0) {
+    dec_len = state->remain;
+    err = parsebgp_decode(state->parser_opts, state->msg_type, msg, state->ptr,
+                          &dec_len);
+  }
   if (err == PARSEBGP_TRUNCATED_MSG) {
     bgpstream_log(BGPSTREAM_LOG_WARN,
                   "Read truncated record %"PRIu64" from '%s'",
@@ -583,7 +912,7 @@ refill:
                   format->res->url);
   } else if (err != PARSEBGP_OK) {
     parsebgp_clear_msg(msg);
-    if (err == PARSEBGP_PARTIAL_MSG) {
+    if (err == PARSEBGP_PARTIAL_MSG && predecoded == 0) {
       // refill the buffer and try again
       refill = 1;
       goto refill;
@@ -603,12 +932,18 @@ refill:
     return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
   }
   // else: successful read
-  state->ptr += dec_len;
-  state->remain -= dec_len;
+  if (predecoded == 0) {
+    state->ptr += dec_len;
+    state->remain -= dec_len;
+  }
 
   // got a message!
   // let the caller decide if they want it
+  state->msg_raw = raw;
+  state->msg_raw_len = predecoded != 0 ? msg_len : dec_len;
   filter_rc = filter_cb(format, record, msg);
+  state->msg_raw = NULL;
+  state->msg_raw_len = 0;
   if (filter_rc == BGPSTREAM_PARSEBGP_FILTER_ERROR) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Format-specific filtering failed");
     return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
@@ -638,6 +973,7 @@ refill:
       }
       skipped_cnt++;
       state->successful_read_cnt++;
+      count_filtered(format);
     }
     parsebgp_clear_msg(msg);
     // there is a cool corner case here when our buffer ends perfectly at the
@@ -669,22 +1005,122 @@ refill:
   return BGPSTREAM_FORMAT_OK;
 }
 
-void bgpstream_parsebgp_opts_init(parsebgp_opts_t *opts)
+bgpstream_format_status_t bgpstream_parsebgp_populate_record(
+  bgpstream_parsebgp_decode_state_t *state, parsebgp_msg_t *msg,
+  bgpstream_format_t *format, bgpstream_record_t *record,
+  bgpstream_parsebgp_prep_buf_cb_t *prep_cb,
+  bgpstream_parsebgp_prefilter_cb_t *prefilter_cb,
+  bgpstream_parsebgp_check_filter_cb_t *filter_cb,
+  bgpstream_parsebgp_demux_cb_t *demux_cb)
+{
+  bgpstream_format_status_t rc;
+
+  BGPSTREAM_TRACE1(record__populate__start, format->res->url);
+  rc = populate_record(state, msg, format, record, prep_cb, prefilter_cb,
+                       filter_cb, demux_cb);
+  BGPSTREAM_TRACE3(record__populate__done, format->res->url, (int)rc,
+                   record->time_sec);
+  return rc;
+}
+
+int bgpstream_parsebgp_skip(bgpstream_parsebgp_decode_state_t *state,
+                            bgpstream_transport_t *transport, uint64_t len)
 {
-  // select only the Path Attributes that we care about
+  int64_t new_read;
+
+  assert(state->read_offset == 0 && state->remain == 0);
+
+  if (state->contents_checked == 0) {
+    check_contents(state, transport);
+  }
+  if (state->contents != NULL) {
+    if (len > state->contents_len) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not skip to offset %" PRIu64,
+                    len);
+      return -1;
+    }
+    // just start parsing from the new offset
+    state->ptr = (uint8_t *)state->contents + len;
+    state->remain = state->contents_len - len;
+    state->read_offset = state->contents_len;
+  }
+
+  while (state->read_offset < len) {
+    // the buffer is empty, so we can use it as scratch space
+    new_read = len - state->read_offset;
+    if (new_read > BGPSTREAM_PARSEBGP_BUFLEN) {
+      new_read = BGPSTREAM_PARSEBGP_BUFLEN;
+    }
+    if ((new_read = bgpstream_transport_read(transport, state->buffer,
+                                             new_read)) <= 0) {
+      // the dump is shorter than we were told
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not skip to offset %" PRIu64,
+                    len);
+      return -1;
+    }
+    state->read_offset += new_read;
+  }
+
+  // there were records in what we skipped (so the dump isn't empty), but the
+  // caller didn't want them
+  if (len > 0) {
+    state->successful_read_cnt++;
+  }
+  return 0;
+}
+
+int bgpstream_parsebgp_threads_start(bgpstream_parsebgp_decode_state_t *state,
+                                     int threads,
+                                     const bgpstream_cpuset_t *cpus)
+{
+  assert(state->pdec == NULL);
+  if ((state->pdec = bgpstream_parsebgp_pdecode_create(
+         &state->parser_opts, state->msg_type, threads, cpus)) == NULL) {
+    return -1;
+  }
+  state->pdec_drained = 0;
+  return 0;
+}
+
+void bgpstream_parsebgp_threads_stop(bgpstream_parsebgp_decode_state_t *state)
+{
+  bgpstream_parsebgp_pdecode_destroy(state->pdec);
+  state->pdec = NULL;
+}
+
+void bgpstream_parsebgp_opts_init(parsebgp_opts_t *opts, uint8_t fields)
+{
+  // select only the Path Attributes that we care about (the NLRI attributes
+  // are always needed since they carry the prefixes)
   opts->bgp.path_attr_filter_enabled = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_ORIGIN] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS_PATH] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_NEXT_HOP] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_MED] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_LOCAL_PREF] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_ATOMIC_AGGREGATE] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AGGREGATOR] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_COMMUNITIES] = 1;
   opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_REACH_NLRI] = 1;
   opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_MP_UNREACH_NLRI] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS4_PATH] = 1;
-  opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS4_AGGREGATOR] = 1;
+
+  if (fields & BGPSTREAM_ELEM_FIELD_AS_PATH) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS_PATH] = 1;
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS4_PATH] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_NEXT_HOP) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_NEXT_HOP] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_COMMUNITIES) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_COMMUNITIES] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_ORIGIN) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_ORIGIN] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_MED) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_MED] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_LOCAL_PREF) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_LOCAL_PREF] = 1;
+  }
+  if (fields & BGPSTREAM_ELEM_FIELD_AGGREGATOR) {
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_ATOMIC_AGGREGATE] =
+      1;
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AGGREGATOR] = 1;
+    opts->bgp.path_attr_filter[PARSEBGP_BGP_PATH_ATTR_TYPE_AS4_AGGREGATOR] = 1;
+  }
 
   // and ask for shallow parsing of communities
   opts->bgp.path_attr_raw_enabled = 1;
@@ -697,3 +1133,114 @@ void bgpstream_parsebgp_opts_init(parsebgp_opts_t *opts)
   opts->silence_not_implemented = 1;
 #endif
 }
+
+static void reuse_cache_free(void *user)
+{
+  reuse_cache_t *cache = (reuse_cache_t *)user;
+  int i;
+
+  for (i = 0; i < cache->msgs_cnt; i++) {
+    parsebgp_destroy_msg(cache->msgs[i]);
+  }
+  for (i = 0; i < cache->elems_cnt; i++) {
+    bgpstream_elem_destroy(cache->elems[i]);
+  }
+  free(cache);
+  reuse_cache = NULL;
+}
+
+static void create_reuse_cache_key(void)
+{
+  if (pthread_key_create(&reuse_cache_key, reuse_cache_free) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not create the reuse thread key");
+    return;
+  }
+  reuse_cache_key_ok = 1;
+}
+
+// the cache of the calling thread, or NULL if it can't have one (in which
+// case nothing is reused)
+static reuse_cache_t *get_reuse_cache(void)
+{
+  reuse_cache_t *cache;
+
+  if (reuse_cache != NULL) {
+    return reuse_cache;
+  }
+  // kept messages and elems would outlive the streams that allocated them,
+  // and so the arenas of an application-provided allocator
+  if (bgpstream_mem_allocator.alloc != NULL) {
+    return NULL;
+  }
+  pthread_once(&reuse_cache_key_once, create_reuse_cache_key);
+  if (reuse_cache_key_ok == 0 ||
+      (cache = malloc_zero(sizeof(reuse_cache_t))) == NULL) {
+    return NULL;
+  }
+  if (pthread_setspecific(reuse_cache_key, cache) != 0) {
+    free(cache);
+    return NULL;
+  }
+  return (reuse_cache = cache);
+}
+
+void bgpstream_parsebgp_reuse_flush(void)
+{
+  if (reuse_cache == NULL) {
+    return;
+  }
+  pthread_setspecific(reuse_cache_key, NULL);
+  reuse_cache_free(reuse_cache);
+}
+
+parsebgp_msg_t *bgpstream_parsebgp_msg_get(void)
+{
+  reuse_cache_t *cache = reuse_cache;
+
+  if (cache != NULL && cache->msgs_cnt > 0) {
+    return cache->msgs[--cache->msgs_cnt];
+  }
+  return parsebgp_create_msg();
+}
+
+void bgpstream_parsebgp_msg_put(parsebgp_msg_t *msg)
+{
+  reuse_cache_t *cache;
+
+  if (msg == NULL) {
+    return;
+  }
+  if ((cache = get_reuse_cache()) == NULL ||
+      cache->msgs_cnt == REUSE_CACHE_MAX) {
+    parsebgp_destroy_msg(msg);
+    return;
+  }
+  parsebgp_clear_msg(msg);
+  cache->msgs[cache->msgs_cnt++] = msg;
+}
+
+bgpstream_elem_t *bgpstream_parsebgp_elem_get(void)
+{
+  reuse_cache_t *cache = reuse_cache;
+
+  if (cache != NULL && cache->elems_cnt > 0) {
+    return cache->elems[--cache->elems_cnt];
+  }
+  return bgpstream_elem_create();
+}
+
+void bgpstream_parsebgp_elem_put(bgpstream_elem_t *elem)
+{
+  reuse_cache_t *cache;
+
+  if (elem == NULL) {
+    return;
+  }
+  if ((cache = get_reuse_cache()) == NULL ||
+      cache->elems_cnt == REUSE_CACHE_MAX) {
+    bgpstream_elem_destroy(elem);
+    return;
+  }
+  bgpstream_elem_clear(elem);
+  cache->elems[cache->elems_cnt++] = elem;
+}
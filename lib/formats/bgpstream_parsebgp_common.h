@@ -29,6 +29,8 @@
 
 #include "bgpstream_elem.h"
 #include "bgpstream_format.h"
+#include "bgpstream_transport.h"
+#include "bgpstream_parsebgp_pdecode.h"
 #include "parsebgp.h"
 
 #define COPY_IP(dst, afi, src, do_unknown)                                     \
@@ -52,6 +54,11 @@
 // might help reduce the time waiting for locks
 #define BGPSTREAM_PARSEBGP_BUFLEN 1024 * 1024
 
+// when the buffer runs out part way through a message, the message stays where
+// it is and more data is read in after it, unless there is less than this much
+// space left at the end of the buffer
+#define BGPSTREAM_PARSEBGP_REFILL_MIN (64 * 1024)
+
 /** Process the given path attributes and populate the given elem
  *
  * @param el            pointer to the elem to populate
@@ -120,15 +127,38 @@ void bgpstream_parsebgp_upd_state_reset(
 /** Process the given UPDATE message and extract a single elem from it
  *
  * @param upd_state     pointer to the generator state
+ * @param filter_mgr    pointer to the filter manager used to skip elems that
+ *                      could not pass the elem filters (may be NULL)
  * @param elem          pointer to the elem to populate
  * @param bgp           pointer to a parsed BGP message
  * @return 1 if the elem was populated, 0 if there are no more elems, -1 if an
  * error occurred.
+ *
+ * The elem's peer fields must be populated before the first call. The path
+ * attributes are checked against the filters once for all the announcements
+ * of the message.
+ *
+ * Path attributes and next-hops are extracted into the elem only once per
+ * message and are shared by every elem it yields, so callers must pass the
+ * same elem for each call with a given upd_state and must not modify its
+ * attribute fields between calls.
  */
 int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
+                                      bgpstream_filter_mgr_t *filter_mgr,
                                       bgpstream_elem_t *elem,
                                       parsebgp_bgp_msg_t *bgp);
 
+/** Count the elems that the given BGP message could yield
+ *
+ * @param bgp           pointer to a parsed BGP message
+ * @return the number of prefixes withdrawn and announced by the message if it
+ * is an UPDATE, 0 otherwise
+ *
+ * The counts come straight from the parsed NLRIs, so this is cheap enough to
+ * call for every message, before any elem has been extracted.
+ */
+uint32_t bgpstream_parsebgp_update_elem_cnt(parsebgp_bgp_msg_t *bgp);
+
 typedef struct bgpstream_parsebgp_decode_state {
 
   // outer message type to decode (MRT or BMP)
@@ -143,15 +173,43 @@ typedef struct bgpstream_parsebgp_decode_state {
   // number of bytes left to read in the buffer
   size_t remain;
 
-  // pointer into buffer
+  // pointer into buffer (or into contents)
   uint8_t *ptr;
 
+  // the entire resource, if the transport can provide it without copying. in
+  // this case it is parsed in place and the buffer is not used
+  const uint8_t *contents;
+  size_t contents_len;
+  int contents_checked;
+
+  // can the transport lend us its messages (so that they are parsed in place
+  // rather than copied into the buffer), and does ptr point into one?
+  int lends;
+  int ptr_lent;
+
+  // total number of bytes read from the transport
+  uint64_t read_offset;
+
+  // offset (from the start of the dump) of the message currently being decoded
+  uint64_t msg_offset;
+
+  // raw bytes of the message currently being passed to the filter callback
+  // (only valid until the callback returns)
+  const uint8_t *msg_raw;
+  size_t msg_raw_len;
+
   // the total number of successful (filtered and not) reads
   uint64_t successful_read_cnt;
 
   // the number of non-filtered reads (i.e. "useful")
   uint64_t valid_read_cnt;
 
+  // parallel decoder (NULL unless decoding threads have been started)
+  bgpstream_parsebgp_pdecode_t *pdec;
+
+  // set once the parallel decoder can't queue any more messages
+  int pdec_drained;
+
 } bgpstream_parsebgp_decode_state_t;
 
 typedef enum {
@@ -185,6 +243,8 @@ typedef enum {
  * error occurred.
  *
  * It is the responsibility of the callee to set the record timestamp fields.
+ * The raw bytes of the message are available to the callee in the msg_raw and
+ * msg_raw_len fields of the decode state.
  */
 typedef bgpstream_parsebgp_check_filter_rc_t(
   bgpstream_parsebgp_check_filter_cb_t)(bgpstream_format_t *format,
@@ -206,14 +266,150 @@ typedef int(bgpstream_parsebgp_prep_buf_cb_t)(bgpstream_format_t *format,
                                               uint8_t *buf, size_t *len,
                                               bgpstream_record_t *record);
 
-/** Use libparsebgp to decode a message */
+/** Called before a complete message is passed to parsebgp, to let the caller
+ * reject it based only on its raw headers
+ *
+ * @param format        pointer to the format that originally called
+ *                      _populate_record
+ * @param record        pointer to the record being populated
+ * @param buf           pointer to the raw message
+ * @param len           length of the raw message
+ * @return BGPSTREAM_PARSEBGP_KEEP if the message should be decoded (and then
+ * checked by the filter callback), any other value to handle the message as
+ * the filter callback would without decoding it.
+ *
+ * This is only called when the whole message is in the buffer and its length
+ * can be read from its header.
+ */
+typedef bgpstream_parsebgp_check_filter_rc_t(
+  bgpstream_parsebgp_prefilter_cb_t)(bgpstream_format_t *format,
+                                     bgpstream_record_t *record,
+                                     const uint8_t *buf, size_t len);
+
+/** Called before a message is queued to be decoded by the decoding threads,
+ * to find where it starts and ends, and to let the caller reject it without
+ * queueing it
+ *
+ * @param format        pointer to the format that originally called
+ *                      _populate_record
+ * @param buf           pointer to the raw data buffer
+ * @param len           number of bytes in the buffer
+ * @param[out] hdr_len  set to the length of any non-standard header
+ *                      encapsulating the message (e.g., OpenBMP)
+ * @param[out] msg_len  set to the length of the message following the header,
+ *                      or 0 if the message can't be framed without decoding it
+ * @return BGPSTREAM_PARSEBGP_KEEP if the message should be queued,
+ * BGPSTREAM_PARSEBGP_FILTER_OUT if it should be dropped,
+ * BGPSTREAM_PARSEBGP_EOS if no more messages should be queued, or
+ * BGPSTREAM_PARSEBGP_FILTER_ERROR if an error occurred.
+ *
+ * If hdr_len + msg_len is larger than len, more data is read and the callback
+ * is called again, so its return value is only used once the whole message is
+ * in the buffer. Messages with a header are passed to the prep callback again
+ * when they are handed back, so that it can populate the record.
+ */
+typedef bgpstream_parsebgp_check_filter_rc_t(bgpstream_parsebgp_demux_cb_t)(
+  bgpstream_format_t *format, const uint8_t *buf, size_t len, size_t *hdr_len,
+  size_t *msg_len);
+
+/** Use libparsebgp to decode a message
+ *
+ * The demux callback is only used when decoding threads have been started,
+ * and may be NULL if the messages are not encapsulated in any other header.
+ */
 bgpstream_format_status_t bgpstream_parsebgp_populate_record(
   bgpstream_parsebgp_decode_state_t *state, parsebgp_msg_t *msg,
   bgpstream_format_t *format, bgpstream_record_t *record,
   bgpstream_parsebgp_prep_buf_cb_t *prep_cb,
-  bgpstream_parsebgp_check_filter_cb_t *filter_cb);
+  bgpstream_parsebgp_prefilter_cb_t *prefilter_cb,
+  bgpstream_parsebgp_check_filter_cb_t *filter_cb,
+  bgpstream_parsebgp_demux_cb_t *demux_cb);
 
-/** Set options specific to how we use libparsebgp in BGPStream */
-void bgpstream_parsebgp_opts_init(parsebgp_opts_t *opts);
+/** Skip over the given number of bytes at the start of the dump
+ *
+ * @param state         pointer to the decode state
+ * @param transport     pointer to the transport to read from
+ * @param len           number of bytes to skip
+ * @return 0 if successful, -1 otherwise
+ *
+ * This must be called before the first call to _populate_record. The skipped
+ * bytes are assumed to contain only uninteresting (but valid) records.
+ */
+int bgpstream_parsebgp_skip(bgpstream_parsebgp_decode_state_t *state,
+                            bgpstream_transport_t *transport, uint64_t len);
+
+/** Start threads to decode messages in parallel
+ *
+ * @param state         pointer to the decode state
+ * @param threads       number of decoding threads to start
+ * @param cpus          set of CPUs to pin the threads to (NULL to let them run
+ *                      anywhere)
+ * @return 0 if the threads were started, -1 otherwise
+ *
+ * Messages are read ahead and decoded by the threads, but are still returned
+ * by _populate_record in dump order. The parser options must already be set,
+ * and must not change afterwards.
+ */
+int bgpstream_parsebgp_threads_start(bgpstream_parsebgp_decode_state_t *state,
+                                     int threads,
+                                     const bgpstream_cpuset_t *cpus);
+
+/** Stop any decoding threads started for the given decode state
+ *
+ * @param state         pointer to the decode state
+ */
+void bgpstream_parsebgp_threads_stop(bgpstream_parsebgp_decode_state_t *state);
+
+/** Set options specific to how we use libparsebgp in BGPStream
+ *
+ * @param opts          pointer to the parser options to initialize
+ * @param fields        mask of BGPSTREAM_ELEM_FIELD_* values to decode
+ *
+ * Path attributes that only feed unselected elem fields are skipped by the
+ * parser, leaving the corresponding elem fields empty.
+ */
+void bgpstream_parsebgp_opts_init(parsebgp_opts_t *opts, uint8_t fields);
+
+/** Get a parser message, reusing one released by this thread if possible
+ *
+ * @return pointer to an empty message, or NULL if one could not be created
+ *
+ * A reused message keeps the buffers it allocated while parsing, so that a
+ * thread decoding records in the steady state does not allocate any.
+ */
+parsebgp_msg_t *bgpstream_parsebgp_msg_get(void);
+
+/** Release a message obtained with bgpstream_parsebgp_msg_get
+ *
+ * @param msg           pointer to the message to release (may be NULL)
+ *
+ * The message is cleared and kept for reuse by this thread, or destroyed if
+ * enough messages are already kept or an allocator has been set with
+ * bgpstream_mem_set_allocator.
+ */
+void bgpstream_parsebgp_msg_put(parsebgp_msg_t *msg);
+
+/** Get an elem, reusing one released by this thread if possible
+ *
+ * @return pointer to an empty elem, or NULL if one could not be created
+ *
+ * As with messages, a reused elem keeps the capacity of its AS path and
+ * community set.
+ */
+bgpstream_elem_t *bgpstream_parsebgp_elem_get(void);
+
+/** Release an elem obtained with bgpstream_parsebgp_elem_get
+ *
+ * @param elem          pointer to the elem to release (may be NULL)
+ */
+void bgpstream_parsebgp_elem_put(bgpstream_elem_t *elem);
+
+/** Destroy the messages and elems kept for reuse by this thread
+ *
+ * The caches of the reader threads are destroyed when the threads exit, but
+ * the thread that creates a stream usually outlives it, so its cache is
+ * flushed when the stream is destroyed.
+ */
+void bgpstream_parsebgp_reuse_flush(void);
 
 #endif /* __BGPSTREAM_PARSEBGP_COMMON_H */
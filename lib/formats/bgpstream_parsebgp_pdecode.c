@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_parsebgp_pdecode.h"
+#include "bgpstream_log.h"
+#include "bgpstream_parsebgp_common.h"
+#include "utils.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// number of messages that may be queued for each thread, so that a thread can
+// move on to another message while the oldest one is being consumed
+#define SLOTS_PER_THREAD 16
+
+typedef struct slot {
+
+  // copy of the raw message
+  uint8_t *buf;
+  size_t len;
+  size_t alloc;
+
+  // length of the encapsulating header (e.g., OpenBMP) at the start of buf,
+  // which is not decoded
+  size_t hdr_len;
+
+  // offset of the message from the start of the dump
+  uint64_t offset;
+
+  // decoded message (swapped with the caller's message by _pop)
+  parsebgp_msg_t *msg;
+
+  // result of decoding the message
+  parsebgp_error_t err;
+
+  // has the message been decoded
+  int done;
+
+} slot_t;
+
+struct bgpstream_parsebgp_pdecode {
+
+  // parser configuration
+  parsebgp_opts_t opts;
+  parsebgp_msg_type_t msg_type;
+
+  // ring of queued messages. messages are numbered in queue order, and message
+  // N lives in slot N % slots_cnt
+  slot_t *slots;
+  int slots_cnt;
+
+  // number of the next message to be returned by _pop
+  uint64_t head;
+
+  // number of the next message to be decoded by a thread
+  uint64_t next;
+
+  // number of the next message to be queued by _push
+  uint64_t tail;
+
+  // is the message before head still held by the caller
+  int holding;
+
+  // decoding threads
+  pthread_t *threads;
+  int threads_cnt;
+
+  pthread_mutex_t mutex;
+
+  // signalled when a message is queued (or on shutdown)
+  pthread_cond_t queued_cond;
+
+  // signalled when a message has been decoded
+  pthread_cond_t decoded_cond;
+
+  int shutdown;
+};
+
+static void *decode_thread(void *user)
+{
+  bgpstream_parsebgp_pdecode_t *pd = user;
+  slot_t *slot;
+  size_t dec_len;
+
+  pthread_mutex_lock(&pd->mutex);
+  while (1) {
+    while (pd->shutdown == 0 && pd->next == pd->tail) {
+      pthread_cond_wait(&pd->queued_cond, &pd->mutex);
+    }
+    if (pd->shutdown != 0) {
+      break;
+    }
+    slot = &pd->slots[pd->next % pd->slots_cnt];
+    pd->next++;
+    pthread_mutex_unlock(&pd->mutex);
+
+    parsebgp_clear_msg(slot->msg);
+    dec_len = slot->len - slot->hdr_len;
+    slot->err = parsebgp_decode(pd->opts, pd->msg_type, slot->msg,
+                                slot->buf + slot->hdr_len, &dec_len);
+
+    pthread_mutex_lock(&pd->mutex);
+    slot->done = 1;
+    pthread_cond_broadcast(&pd->decoded_cond);
+  }
+  pthread_mutex_unlock(&pd->mutex);
+  return NULL;
+}
+
+/* ==================== PUBLIC API BELOW HERE ==================== */
+
+bgpstream_parsebgp_pdecode_t *
+bgpstream_parsebgp_pdecode_create(parsebgp_opts_t *opts,
+                                  parsebgp_msg_type_t msg_type, int threads,
+                                  const bgpstream_cpuset_t *cpus)
+{
+  bgpstream_parsebgp_pdecode_t *pd;
+  int i;
+
+  assert(threads > 0);
+
+  if ((pd = malloc_zero(sizeof(bgpstream_parsebgp_pdecode_t))) == NULL) {
+    return NULL;
+  }
+  pd->opts = *opts;
+  pd->msg_type = msg_type;
+  pthread_mutex_init(&pd->mutex, NULL);
+  pthread_cond_init(&pd->queued_cond, NULL);
+  pthread_cond_init(&pd->decoded_cond, NULL);
+
+  pd->slots_cnt = threads * SLOTS_PER_THREAD;
+  if ((pd->slots = malloc_zero(sizeof(slot_t) * pd->slots_cnt)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < pd->slots_cnt; i++) {
+    if ((pd->slots[i].msg = bgpstream_parsebgp_msg_get()) == NULL) {
+      goto err;
+    }
+  }
+
+  if ((pd->threads = malloc_zero(sizeof(pthread_t) * threads)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < threads; i++) {
+    if (bgpstream_cpuset_thread_create(cpus, &pd->threads[i], decode_thread,
+                                       pd) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start decoding thread");
+      goto err;
+    }
+    pd->threads_cnt++;
+  }
+
+  return pd;
+
+err:
+  bgpstream_parsebgp_pdecode_destroy(pd);
+  return NULL;
+}
+
+void bgpstream_parsebgp_pdecode_destroy(bgpstream_parsebgp_pdecode_t *pd)
+{
+  int i;
+
+  if (pd == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pd->mutex);
+  pd->shutdown = 1;
+  pthread_cond_broadcast(&pd->queued_cond);
+  pthread_mutex_unlock(&pd->mutex);
+  for (i = 0; i < pd->threads_cnt; i++) {
+    pthread_join(pd->threads[i], NULL);
+  }
+  free(pd->threads);
+
+  if (pd->slots != NULL) {
+    for (i = 0; i < pd->slots_cnt; i++) {
+      free(pd->slots[i].buf);
+      bgpstream_parsebgp_msg_put(pd->slots[i].msg);
+    }
+    free(pd->slots);
+  }
+
+  pthread_cond_destroy(&pd->queued_cond);
+  pthread_cond_destroy(&pd->decoded_cond);
+  pthread_mutex_destroy(&pd->mutex);
+  free(pd);
+}
+
+int bgpstream_parsebgp_pdecode_full(bgpstream_parsebgp_pdecode_t *pd)
+{
+  // only the caller changes tail and head, so no need to lock
+  return (pd->tail - pd->head + pd->holding) >= (uint64_t)pd->slots_cnt;
+}
+
+int bgpstream_parsebgp_pdecode_empty(bgpstream_parsebgp_pdecode_t *pd)
+{
+  return pd->tail == pd->head;
+}
+
+int bgpstream_parsebgp_pdecode_push(bgpstream_parsebgp_pdecode_t *pd,
+                                    const uint8_t *buf, size_t len,
+                                    size_t hdr_len, uint64_t offset)
+{
+  slot_t *slot;
+  uint8_t *tmp;
+
+  assert(bgpstream_parsebgp_pdecode_full(pd) == 0);
+  assert(hdr_len <= len);
+  // no thread can be looking at this slot: it is neither queued nor held
+  slot = &pd->slots[pd->tail % pd->slots_cnt];
+
+  if (len > slot->alloc) {
+    if ((tmp = realloc(slot->buf, len)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate message buffer");
+      return -1;
+    }
+    slot->buf = tmp;
+    slot->alloc = len;
+  }
+  memcpy(slot->buf, buf, len);
+  slot->len = len;
+  slot->hdr_len = hdr_len;
+  slot->offset = offset;
+  slot->done = 0;
+
+  pthread_mutex_lock(&pd->mutex);
+  pd->tail++;
+  pthread_cond_signal(&pd->queued_cond);
+  pthread_mutex_unlock(&pd->mutex);
+  return 0;
+}
+
+parsebgp_error_t bgpstream_parsebgp_pdecode_pop(
+  bgpstream_parsebgp_pdecode_t *pd, parsebgp_msg_t *msg, const uint8_t **buf,
+  size_t *len, size_t *hdr_len, uint64_t *offset)
+{
+  slot_t *slot;
+  parsebgp_msg_t tmp;
+
+  assert(bgpstream_parsebgp_pdecode_empty(pd) == 0);
+  slot = &pd->slots[pd->head % pd->slots_cnt];
+
+  pthread_mutex_lock(&pd->mutex);
+  while (slot->done == 0) {
+    pthread_cond_wait(&pd->decoded_cond, &pd->mutex);
+  }
+  pthread_mutex_unlock(&pd->mutex);
+
+  // hand the decoded message over, and take the caller's (cleared) message to
+  // decode into next time
+  tmp = *msg;
+  *msg = *slot->msg;
+  *slot->msg = tmp;
+
+  *buf = slot->buf;
+  *len = slot->len;
+  *hdr_len = slot->hdr_len;
+  *offset = slot->offset;
+
+  // the previously held slot is now free, and this one is held instead
+  pd->head++;
+  pd->holding = 1;
+  return slot->err;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PARSEBGP_PDECODE_H
+#define __BGPSTREAM_PARSEBGP_PDECODE_H
+
+#include "bgpstream_cpuset.h"
+#include "parsebgp.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for a pool of threads that decode complete raw messages
+ * in parallel.
+ *
+ * Messages are queued in dump order, and are handed back (decoded) in exactly
+ * the same order, so the records produced from a dump do not depend on the
+ * number of threads or on how they are scheduled.
+ */
+
+/** Opaque structure representing a parallel decoder */
+typedef struct bgpstream_parsebgp_pdecode bgpstream_parsebgp_pdecode_t;
+
+/** Create a parallel decoder and start its threads
+ *
+ * @param opts          parser options to decode with (copied)
+ * @param msg_type      outer message type to decode (MRT or BMP)
+ * @param threads       number of decoding threads to start
+ * @param cpus          set of CPUs to pin the threads to (NULL to let them run
+ *                      anywhere)
+ * @return pointer to the decoder if successful, NULL otherwise
+ */
+bgpstream_parsebgp_pdecode_t *
+bgpstream_parsebgp_pdecode_create(parsebgp_opts_t *opts,
+                                  parsebgp_msg_type_t msg_type, int threads,
+                                  const bgpstream_cpuset_t *cpus);
+
+/** Stop the threads of the given decoder and destroy it
+ *
+ * @param pd            pointer to the decoder to destroy
+ */
+void bgpstream_parsebgp_pdecode_destroy(bgpstream_parsebgp_pdecode_t *pd);
+
+/** Check whether more messages can be queued
+ *
+ * @param pd            pointer to the decoder
+ * @return 1 if the queue is full, 0 otherwise
+ */
+int bgpstream_parsebgp_pdecode_full(bgpstream_parsebgp_pdecode_t *pd);
+
+/** Check whether any messages are queued
+ *
+ * @param pd            pointer to the decoder
+ * @return 1 if there are no queued messages, 0 otherwise
+ */
+int bgpstream_parsebgp_pdecode_empty(bgpstream_parsebgp_pdecode_t *pd);
+
+/** Queue a copy of a complete raw message to be decoded
+ *
+ * @param pd            pointer to the decoder
+ * @param buf           pointer to the raw message
+ * @param len           length of the raw message
+ * @param hdr_len       length of a format-specific header at the start of the
+ *                      message that is not to be decoded (e.g., OpenBMP)
+ * @param offset        offset of the message from the start of the dump
+ * @return 0 if the message was queued, -1 otherwise
+ *
+ * The queue must not be full.
+ */
+int bgpstream_parsebgp_pdecode_push(bgpstream_parsebgp_pdecode_t *pd,
+                                    const uint8_t *buf, size_t len,
+                                    size_t hdr_len, uint64_t offset);
+
+/** Wait for the oldest queued message to be decoded, and return it
+ *
+ * @param pd            pointer to the decoder
+ * @param msg           pointer to a message to swap the decoded message into
+ * @param[out] buf      set to point to the raw message
+ * @param[out] len      set to the length of the raw message
+ * @param[out] hdr_len  set to the length of the header that was not decoded
+ * @param[out] offset   set to the offset of the raw message
+ * @return the result of decoding the message
+ *
+ * The queue must not be empty. The raw message remains valid until the next
+ * call to _pop.
+ */
+parsebgp_error_t bgpstream_parsebgp_pdecode_pop(
+  bgpstream_parsebgp_pdecode_t *pd, parsebgp_msg_t *msg, const uint8_t **buf,
+  size_t *len, size_t *hdr_len, uint64_t *offset);
+
+#endif /* __BGPSTREAM_PARSEBGP_PDECODE_H */
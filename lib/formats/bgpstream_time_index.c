@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_time_index.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "BSTI"
+#define INDEX_VERSION 1
+
+/** Sanity limit on the number of points we will load from a file */
+#define INDEX_MAX_POINTS (16 * 1024 * 1024)
+
+/** On-disk representation of a point (all values in network byte order) */
+struct index_point_disk {
+  uint32_t offset_hi;
+  uint32_t offset_lo;
+  uint32_t time;
+};
+
+struct index_point {
+  uint64_t offset;
+  uint32_t time;
+};
+
+struct bgpstream_time_index {
+  struct index_point *points;
+  int points_cnt;
+  int points_alloc;
+};
+
+bgpstream_time_index_t *bgpstream_time_index_create(void)
+{
+  return malloc_zero(sizeof(bgpstream_time_index_t));
+}
+
+void bgpstream_time_index_destroy(bgpstream_time_index_t *idx)
+{
+  if (idx == NULL) {
+    return;
+  }
+  free(idx->points);
+  free(idx);
+}
+
+int bgpstream_time_index_add(bgpstream_time_index_t *idx, uint64_t offset,
+                             uint32_t time)
+{
+  struct index_point *tmp;
+  struct index_point *last = NULL;
+
+  if (idx->points_cnt > 0) {
+    last = &idx->points[idx->points_cnt - 1];
+    if (offset <= last->offset || time < last->time) {
+      return -1;
+    }
+  }
+
+  if (idx->points_cnt == idx->points_alloc) {
+    int new_alloc = (idx->points_alloc == 0) ? 64 : idx->points_alloc * 2;
+    if ((tmp = realloc(idx->points, sizeof(struct index_point) * new_alloc)) ==
+        NULL) {
+      return -1;
+    }
+    idx->points = tmp;
+    idx->points_alloc = new_alloc;
+  }
+
+  idx->points[idx->points_cnt].offset = offset;
+  idx->points[idx->points_cnt].time = time;
+  idx->points_cnt++;
+  return 0;
+}
+
+uint64_t bgpstream_time_index_lookup(bgpstream_time_index_t *idx,
+                                     uint32_t time)
+{
+  int lo = 0, hi = idx->points_cnt, mid;
+
+  // find the first point where the records before it may include `time`
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (idx->points[mid].time < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // the one before that is where we can safely skip to
+  return (lo == 0) ? 0 : idx->points[lo - 1].offset;
+}
+
+int bgpstream_time_index_load(bgpstream_time_index_t *idx, const char *path)
+{
+  FILE *fp = NULL;
+  char magic[4];
+  uint32_t hdr[2];
+  struct index_point_disk pd;
+  uint32_t i;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+
+  if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+      memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+      fread(hdr, sizeof(hdr), 1, fp) != 1 ||
+      ntohl(hdr[0]) != INDEX_VERSION || ntohl(hdr[1]) > INDEX_MAX_POINTS) {
+    goto err;
+  }
+
+  for (i = 0; i < ntohl(hdr[1]); i++) {
+    if (fread(&pd, sizeof(pd), 1, fp) != 1 ||
+        bgpstream_time_index_add(idx,
+                                 ((uint64_t)ntohl(pd.offset_hi) << 32) |
+                                   ntohl(pd.offset_lo),
+                                 ntohl(pd.time)) != 0) {
+      goto err;
+    }
+  }
+
+  fclose(fp);
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Ignoring invalid time index %s", path);
+  fclose(fp);
+  idx->points_cnt = 0;
+  return -1;
+}
+
+int bgpstream_time_index_save(bgpstream_time_index_t *idx, const char *path)
+{
+  char tmp_path[1024];
+  FILE *fp = NULL;
+  uint32_t hdr[2];
+  struct index_point_disk pd;
+  int i;
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d.temp", path, getpid()) >=
+        sizeof(tmp_path) ||
+      (fp = fopen(tmp_path, "w")) == NULL) {
+    return -1;
+  }
+
+  hdr[0] = htonl(INDEX_VERSION);
+  hdr[1] = htonl(idx->points_cnt);
+  if (fwrite(INDEX_MAGIC, 4, 1, fp) != 1 ||
+      fwrite(hdr, sizeof(hdr), 1, fp) != 1) {
+    goto err;
+  }
+
+  for (i = 0; i < idx->points_cnt; i++) {
+    pd.offset_hi = htonl(idx->points[i].offset >> 32);
+    pd.offset_lo = htonl(idx->points[i].offset & 0xffffffff);
+    pd.time = htonl(idx->points[i].time);
+    if (fwrite(&pd, sizeof(pd), 1, fp) != 1) {
+      goto err;
+    }
+  }
+
+  if (fclose(fp) != 0) {
+    fp = NULL;
+    goto err;
+  }
+  fp = NULL;
+
+  if (rename(tmp_path, path) != 0) {
+    goto err;
+  }
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Could not write time index %s", path);
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  remove(tmp_path);
+  return -1;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_TIME_INDEX_H
+#define __BGPSTREAM_TIME_INDEX_H
+
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for the sidecar time index used to skip over records at
+ * the beginning of a dump that fall before the start of an interval filter.
+ *
+ * The index is a list of (offset, time) points, where the offset is a byte
+ * offset into the (decompressed) dump, and the time is the latest record time
+ * seen before that offset. Since each point records the maximum time seen so
+ * far, rather than the time of the record at that offset, the index is safe to
+ * use even if record times are not strictly ordered.
+ */
+
+/** Opaque structure representing a time index */
+typedef struct bgpstream_time_index bgpstream_time_index_t;
+
+/** Create an empty time index
+ *
+ * @return pointer to the index if successful, NULL otherwise
+ */
+bgpstream_time_index_t *bgpstream_time_index_create(void);
+
+/** Destroy the given time index
+ *
+ * @param idx           pointer to the index to destroy
+ */
+void bgpstream_time_index_destroy(bgpstream_time_index_t *idx);
+
+/** Add a point to the index
+ *
+ * @param idx           pointer to the index to add to
+ * @param offset        byte offset of a record in the dump
+ * @param time          latest time of all records before this offset
+ * @return 0 if successful, -1 otherwise
+ *
+ * Points must be added in increasing offset (and non-decreasing time) order.
+ */
+int bgpstream_time_index_add(bgpstream_time_index_t *idx, uint64_t offset,
+                             uint32_t time);
+
+/** Find how far into the dump can be skipped without missing any records at
+ * or after the given time
+ *
+ * @param idx           pointer to the index to search
+ * @param time          time of the first wanted record
+ * @return the byte offset to skip to (0 if nothing can be skipped)
+ */
+uint64_t bgpstream_time_index_lookup(bgpstream_time_index_t *idx,
+                                     uint32_t time);
+
+/** Load an index from a file
+ *
+ * @param idx           pointer to an empty index to load into
+ * @param path          path of the index file
+ * @return 0 if the index was loaded, -1 if it doesn't exist or is invalid
+ */
+int bgpstream_time_index_load(bgpstream_time_index_t *idx, const char *path);
+
+/** Save an index to a file
+ *
+ * @param idx           pointer to the index to save
+ * @param path          path of the index file
+ * @return 0 if the index was saved, -1 otherwise
+ *
+ * The index is written to a temporary file that is then renamed into place,
+ * so that concurrent readers never see a partial index.
+ */
+int bgpstream_time_index_save(bgpstream_time_index_t *idx, const char *path);
+
+#endif /* __BGPSTREAM_TIME_INDEX_H */
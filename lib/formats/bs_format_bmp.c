@@ -28,6 +28,7 @@
 #include "bgpstream_format_interface.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
 #include "bgpstream_parsebgp_common.h"
 #include "utils.h"
 #include <assert.h>
@@ -62,14 +63,24 @@ typedef struct state {
   // parsebgp decode wrapper state
   bgpstream_parsebgp_decode_state_t decoder;
 
+  // the last collector and router names that were interned (consecutive
+  // messages almost always share them)
+  bgpstream_str_intern_cache_t collector_cache;
+  bgpstream_str_intern_cache_t router_cache;
+
+  // scratch record that the headers of messages are parsed into when they are
+  // queued for the decoding threads (NULL unless the threads were started)
+  bgpstream_record_t *demux_rec;
+
 } state_t;
 
-static int handle_update(rec_data_t *rd, parsebgp_bgp_msg_t *bgp)
+static int handle_update(rec_data_t *rd, bgpstream_filter_mgr_t *filter_mgr,
+                         parsebgp_bgp_msg_t *bgp)
 {
   int rc;
 
-  if ((rc = bgpstream_parsebgp_process_update(&rd->upd_state, rd->elem, bgp)) <
-      0) {
+  if ((rc = bgpstream_parsebgp_process_update(&rd->upd_state, filter_mgr,
+                                              rd->elem, bgp)) < 0) {
     return rc;
   }
   if (rc == 0) {
@@ -115,17 +126,17 @@ static int check_filters(bgpstream_record_t *record,
                          bgpstream_filter_mgr_t *filter_mgr)
 {
   // Collector
-  if (filter_mgr->collectors != NULL) {
-    if (bgpstream_str_set_exists(filter_mgr->collectors,
-                                 record->collector_name) == 0) {
+  if (filter_mgr->collector_ids != NULL) {
+    if (bgpstream_id_set_exists(filter_mgr->collector_ids,
+                                record->__int->collector_id) == 0) {
       return 0;
     }
   }
 
   // Router
-  if (filter_mgr->routers != NULL) {
-    if (bgpstream_str_set_exists(filter_mgr->routers, record->router_name) ==
-        0) {
+  if (filter_mgr->router_ids != NULL) {
+    if (bgpstream_id_set_exists(filter_mgr->router_ids,
+                                record->__int->router_id) == 0) {
       return 0;
     }
   }
@@ -136,14 +147,8 @@ static int check_filters(bgpstream_record_t *record,
 static int is_wanted_time(uint32_t record_time,
                           bgpstream_filter_mgr_t *filter_mgr)
 {
-  if (TIF==NULL ||
-      (record_time >= TIF->begin_time &&
-      (TIF->end_time == BGPSTREAM_FOREVER || record_time <= TIF->end_time))) {
-    // matches a filter interval
-    return 1;
-  }
-
-  return 0;
+  // matches a filter interval (if there are any)
+  return bgpstream_filter_mgr_time_wanted(filter_mgr, record_time);
 }
 
 #define DESERIALIZE_VAL(to)                                                    \
@@ -168,6 +173,7 @@ static int populate_prep_cb(bgpstream_format_t *format, uint8_t *buf,
   uint16_t u16;
   uint32_t u32;
   int name_len = 0;
+  char name[BGPSTREAM_UTILS_STR_NAME_LEN];
 
   // we want at least a few bytes to do header checks
   if (len < 4) {
@@ -260,8 +266,13 @@ static int populate_prep_cb(bgpstream_format_t *format, uint8_t *buf,
   if ((len - nread) < u16) {
     return -1;
   }
-  memcpy(record->collector_name, buf, name_len);
-  record->collector_name[name_len] = '\0';
+  memcpy(name, buf, name_len);
+  name[name_len] = '\0';
+  if ((record->collector_name = bgpstream_str_intern_cached_str(
+         format->filter_mgr->names, &STATE->collector_cache, name,
+         &record->__int->collector_id)) == NULL) {
+    return -1;
+  }
   nread += u16;
   buf += u16;
 
@@ -297,8 +308,13 @@ static int populate_prep_cb(bgpstream_format_t *format, uint8_t *buf,
   if ((len - nread) < u16) {
     return -1;
   }
-  memcpy(record->router_name, buf, name_len);
-  record->router_name[name_len] = '\0';
+  memcpy(name, buf, name_len);
+  name[name_len] = '\0';
+  if ((record->router_name = bgpstream_str_intern_cached_str(
+         format->filter_mgr->names, &STATE->router_cache, name,
+         &record->__int->router_id)) == NULL) {
+    return -1;
+  }
   nread += u16;
   buf += u16;
 
@@ -310,6 +326,76 @@ static int populate_prep_cb(bgpstream_format_t *format, uint8_t *buf,
   return 0;
 }
 
+// BMP v3 common header: version (1), length (4), type (1)
+#define BMP_HDR_LEN 6
+
+// per-peer header: type (1), flags (1), distinguisher (8), address (16)
+#define BMP_PEER_ASN_OFFSET (BMP_HDR_LEN + 1 + 1 + 8 + 16)
+
+// ... then ASN (4), BGP ID (4), timestamp (8)
+#define BMP_PEER_HDR_END (BMP_PEER_ASN_OFFSET + 4 + 4 + 8)
+
+// BGP header: marker (16), length (2), type (1)
+#define BGP_HDR_TYPE_OFFSET 18
+
+// look at the raw BMP headers to reject messages that could not pass the
+// filters without decoding them
+static bgpstream_parsebgp_check_filter_rc_t
+populate_prefilter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
+                      const uint8_t *buf, size_t len)
+{
+  bgpstream_filter_mgr_t *filter_mgr = format->filter_mgr;
+  uint32_t ts_sec = record->time_sec;
+  uint32_t peer_asn;
+  uint8_t type, elemtype_mask;
+
+  if (len < BMP_PEER_HDR_END || buf[0] != 3) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+  type = buf[BMP_HDR_LEN - 1];
+
+  // the same checks as populate_filter_cb, but on the raw message
+  if (type != PARSEBGP_BMP_TYPE_ROUTE_MON &&
+      type != PARSEBGP_BMP_TYPE_PEER_DOWN &&
+      type != PARSEBGP_BMP_TYPE_PEER_UP) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  if (type == PARSEBGP_BMP_TYPE_ROUTE_MON &&
+      len > BMP_PEER_HDR_END + BGP_HDR_TYPE_OFFSET &&
+      buf[BMP_PEER_HDR_END + BGP_HDR_TYPE_OFFSET] != PARSEBGP_BGP_TYPE_UPDATE) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  if (check_filters(record, filter_mgr) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  if (format->TIF != NULL && format->TIF->end_time != BGPSTREAM_FOREVER &&
+      ts_sec > format->TIF->end_time) {
+    return BGPSTREAM_PARSEBGP_EOS;
+  }
+  if (is_wanted_time(ts_sec, filter_mgr) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+
+  // all elems in the message are of the same kind and from the same peer, so
+  // if the elem filters reject that, no elem would be returned anyway
+  elemtype_mask = (type == PARSEBGP_BMP_TYPE_ROUTE_MON)
+                    ? (BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT |
+                       BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL)
+                    : BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE;
+  if (filter_mgr->elemtype_mask != 0 &&
+      (filter_mgr->elemtype_mask & elemtype_mask) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  if (filter_mgr->peer_asns != NULL) {
+    memcpy(&peer_asn, buf + BMP_PEER_ASN_OFFSET, sizeof(peer_asn));
+    if (bgpstream_id_set_exists(filter_mgr->peer_asns, ntohl(peer_asn)) == 0) {
+      return BGPSTREAM_PARSEBGP_FILTER_OUT;
+    }
+  }
+
+  return BGPSTREAM_PARSEBGP_KEEP;
+}
+
 static bgpstream_parsebgp_check_filter_rc_t
 populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
                    parsebgp_msg_t *msg)
@@ -355,6 +441,83 @@ populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
   }
 }
 
+// enough of an OpenBMP binary header to find its length, and the type of the
+// message it encapsulates
+#define OBMP_HDR_MIN_LEN 14
+
+// when the messages are decoded by the decoding threads, each one is framed
+// (with its OpenBMP header) and checked against the record filters before it
+// is queued. messages from routers (or collectors) that were not asked for
+// never reach the threads. the decoded messages are handed back in feed
+// order, so the records of each router stay in the order the router sent them
+static bgpstream_parsebgp_check_filter_rc_t
+populate_demux_cb(bgpstream_format_t *format, const uint8_t *buf, size_t len,
+                  size_t *hdr_len, size_t *msg_len)
+{
+  bgpstream_record_t *rec = STATE->demux_rec;
+  size_t prep_len;
+  uint32_t u32;
+  uint16_t u16;
+
+  *hdr_len = 0;
+  if (len < OBMP_HDR_MIN_LEN) {
+    // ask for enough data to look at whichever header is there
+    *msg_len = OBMP_HDR_MIN_LEN;
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  if (memcmp(buf, "OBMP", 4) == 0) {
+    if (buf[4] != 1 || buf[5] != 7) {
+      // let the serial decoder deal with it
+      *msg_len = 0;
+      return BGPSTREAM_PARSEBGP_KEEP;
+    }
+    memcpy(&u16, buf + 6, sizeof(u16));
+    memcpy(&u32, buf + 8, sizeof(u32));
+    *hdr_len = ntohs(u16);
+    *msg_len = ntohl(u32);
+    if (*msg_len == 0 || *hdr_len + *msg_len > len) {
+      return BGPSTREAM_PARSEBGP_KEEP;
+    }
+    // we only want BMP RAW messages
+    if ((buf[12] & 0x80) == 0 || buf[13] != 12) {
+      return BGPSTREAM_PARSEBGP_FILTER_OUT;
+    }
+  } else if (buf[0] == 3) {
+    // raw BMP
+    memcpy(&u32, buf + 1, sizeof(u32));
+    *msg_len = ntohl(u32);
+    if (*msg_len > len) {
+      return BGPSTREAM_PARSEBGP_KEEP;
+    }
+  } else {
+    // e.g., an OpenBMP text header, whose end can only be found by scanning
+    *msg_len = 0;
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  rec->time_sec = 0;
+  rec->time_usec = 0;
+  rec->router_name = "";
+  rec->__int->router_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
+  rec->router_ip.version = 0;
+  if (*hdr_len > 0) {
+    // the header is parsed again, into the real record, when the decoded
+    // message is handed back
+    prep_len = *hdr_len;
+    if (populate_prep_cb(format, (uint8_t *)buf, &prep_len, rec) != 0) {
+      return BGPSTREAM_PARSEBGP_FILTER_ERROR;
+    }
+    if (prep_len != *hdr_len) {
+      // the header isn't what it claims to be
+      *msg_len = 0;
+      return BGPSTREAM_PARSEBGP_KEEP;
+    }
+  }
+
+  return populate_prefilter_cb(format, rec, buf + *hdr_len, *msg_len);
+}
+
 /* ==================== PUBLIC API BELOW HERE ==================== */
 
 int bs_format_bmp_create(bgpstream_format_t *format, bgpstream_resource_t *res)
@@ -362,21 +525,41 @@ int bs_format_bmp_create(bgpstream_format_t *format, bgpstream_resource_t *res)
   BS_FORMAT_SET_METHODS(bmp, format);
   parsebgp_opts_t *opts = NULL;
 
-  if ((format->state = malloc_zero(sizeof(state_t))) == NULL) {
+  // the state holds the buffer that every message is decoded from
+  if ((format->state = bgpstream_mem_malloc_buffer(BGPSTREAM_MEM_FORMAT,
+                                                   sizeof(state_t))) == NULL) {
     return -1;
   }
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, sizeof(state_t));
 
   STATE->decoder.msg_type = PARSEBGP_MSG_TYPE_BMP;
+  bgpstream_str_intern_cache_init(&STATE->collector_cache);
+  bgpstream_str_intern_cache_init(&STATE->router_cache);
 
   opts = &STATE->decoder.parser_opts;
   parsebgp_opts_init(opts);
-  bgpstream_parsebgp_opts_init(opts);
+  bgpstream_parsebgp_opts_init(
+    opts, bgpstream_filter_mgr_elem_fields(format->filter_mgr));
 
   // DEBUG: force parsebgp to ignore things that it doesn't know about
   opts->ignore_not_implemented = 1;
   // and not be chatty about them
   opts->silence_not_implemented = 1;
 
+  // a feed multiplexes many routers, so decode their messages in parallel
+  if (format->filter_mgr->bmp_decode_threads > 0 &&
+      ((STATE->demux_rec = bgpstream_record_create(format)) == NULL ||
+       bgpstream_parsebgp_threads_start(&STATE->decoder,
+                                        format->filter_mgr->bmp_decode_threads,
+                                        format->filter_mgr->worker_cpus) !=
+         0)) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Could not start decoding threads for %s, decoding serially",
+                  res->url);
+    bgpstream_record_destroy(STATE->demux_rec);
+    STATE->demux_rec = NULL;
+  }
+
   return 0;
 }
 
@@ -384,12 +567,22 @@ bgpstream_format_status_t
 bs_format_bmp_populate_record(bgpstream_format_t *format,
                               bgpstream_record_t *record)
 {
+  parsebgp_bmp_msg_t *bmp;
   bgpstream_format_status_t rc = bgpstream_parsebgp_populate_record(
     &STATE->decoder, RDATA->msg, format, record, populate_prep_cb,
-    populate_filter_cb);
+    populate_prefilter_cb, populate_filter_cb, populate_demux_cb);
+
+  if (rc == BGPSTREAM_FORMAT_OK) {
+    bmp = RDATA->msg->types.bmp;
+    record->__int->elem_cnt_hint =
+      bmp->type == PARSEBGP_BMP_TYPE_ROUTE_MON
+        ? bgpstream_parsebgp_update_elem_cnt(bmp->types.route_mon)
+        : 1;
+  }
 
   if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
-    record->router_name[0] = '\0';
+    record->router_name = "";
+    record->__int->router_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
     record->router_ip.version = 0;
   }
 
@@ -421,7 +614,7 @@ int bs_format_bmp_get_next_elem(bgpstream_format_t *format,
   // what kind of BMP message are we dealing with?
   switch (bmp->type) {
   case PARSEBGP_BMP_TYPE_ROUTE_MON:
-    rc = handle_update(RDATA, bmp->types.route_mon);
+    rc = handle_update(RDATA, format->filter_mgr, bmp->types.route_mon);
     break;
 
   case PARSEBGP_BMP_TYPE_PEER_DOWN:
@@ -454,11 +647,9 @@ int bs_format_bmp_init_data(bgpstream_format_t *format, void **data)
     return -1;
   }
 
-  if ((rd->elem = bgpstream_elem_create()) == NULL) {
-    return -1;
-  }
-
-  if ((rd->msg = parsebgp_create_msg()) == NULL) {
+  if ((rd->elem = bgpstream_parsebgp_elem_get()) == NULL ||
+      (rd->msg = bgpstream_parsebgp_msg_get()) == NULL) {
+    bs_format_bmp_destroy_data(format, rd);
     return -1;
   }
 
@@ -483,15 +674,20 @@ void bs_format_bmp_destroy_data(bgpstream_format_t *format, void *data)
   if (rd == NULL) {
     return;
   }
-  bgpstream_elem_destroy(rd->elem);
+  bgpstream_parsebgp_elem_put(rd->elem);
   rd->elem = NULL;
-  parsebgp_destroy_msg(rd->msg);
+  bgpstream_parsebgp_msg_put(rd->msg);
   rd->msg = NULL;
   free(data);
 }
 
 void bs_format_bmp_destroy(bgpstream_format_t *format)
 {
-  free(format->state);
+  bgpstream_parsebgp_threads_stop(&STATE->decoder);
+  bgpstream_record_destroy(STATE->demux_rec);
+  STATE->demux_rec = NULL;
+
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, -(int64_t)sizeof(state_t));
+  bgpstream_mem_free_buffer(BGPSTREAM_MEM_FORMAT, format->state);
   format->state = NULL;
 }
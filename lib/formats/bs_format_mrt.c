@@ -27,9 +27,16 @@
 #include "bs_format_mrt.h"
 #include "bgpstream_format_interface.h"
 #include "bgpstream_record_int.h"
+#include "bgpstream_binary.h"
+#include "bgpstream_decoded_cache.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
 #include "bgpstream_parsebgp_common.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_time_index.h"
+#include "bgpstream_transport.h"
 #include "utils.h"
+#include <arpa/inet.h>
 #include <assert.h>
 
 #define STATE ((state_t *)(format->state))
@@ -38,6 +45,12 @@
 
 #define TIF filter_mgr->time_interval
 
+// MRT common header: timestamp (4), type (2), subtype (2), length (4)
+#define MRT_HDR_LEN 12
+
+// BGP header: marker (16), length (2), type (1)
+#define BGP_HDR_TYPE_OFFSET 18
+
 typedef struct peer_index_entry {
 
   /** Peer ASN */
@@ -48,8 +61,17 @@ typedef struct peer_index_entry {
 
 } peer_index_entry_t;
 
-KHASH_INIT(td2_peer, int, peer_index_entry_t, 1, kh_int_hash_func,
-           kh_int_hash_equal)
+/* TDv2 peer indexes are dense (0 to peer_count-1), so the peer index table is
+   stored as a flat array indexed by peer index */
+typedef struct peer_table {
+
+  /** Number of peers in the table */
+  int peer_cnt;
+
+  /** Peers, indexed by peer index */
+  peer_index_entry_t peers[];
+
+} peer_table_t;
 
 typedef struct rec_data {
 
@@ -68,6 +90,10 @@ typedef struct rec_data {
   // reusable parser message structure
   parsebgp_msg_t *msg;
 
+  // encoded elems left to read (only when reading from a decoded cache)
+  const uint8_t *dec_elems;
+  size_t dec_elems_len;
+
 } rec_data_t;
 
 typedef struct state {
@@ -76,7 +102,36 @@ typedef struct state {
   bgpstream_parsebgp_decode_state_t decoder;
 
   // state to store the "peer index table" when reading TABLE_DUMP_V2 records
-  khash_t(td2_peer) * peer_table;
+  peer_table_t *peer_table;
+
+  // have we checked for a time index yet?
+  int index_checked;
+
+  // time index being built as we read the dump (NULL if we're not building)
+  bgpstream_time_index_t *index;
+
+  // latest record time seen so far (used when building the index)
+  uint32_t index_max_time;
+
+  // raw copy of the latest peer index table (only if raw records are kept)
+  uint8_t *peer_index_raw;
+  size_t peer_index_raw_len;
+  size_t peer_index_raw_alloc;
+
+  // set until the raw peer index table has been attached to a record
+  int peer_index_pending;
+
+  // decoded cache we are reading records from instead of parsing the dump
+  // (NULL if we're parsing)
+  bgpstream_decoded_reader_t *dec_reader;
+
+  // decoded cache being built as we parse the dump (NULL if we're not
+  // building)
+  bgpstream_decoded_writer_t *dec_writer;
+
+  // number of records read from the decoded cache, and how many were kept
+  uint64_t dec_read_cnt;
+  uint64_t dec_valid_cnt;
 
 } state_t;
 
@@ -113,29 +168,39 @@ static int handle_table_dump(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
   return 1;
 }
 
-static int handle_td2_rib_entry(rec_data_t *rd, khash_t(td2_peer) * peer_table,
+// populate the elem from the given RIB entry. Returns 0 if it was populated,
+// 1 if the entry was skipped because it could not pass the filters, and -1
+// if an error occurred
+static int handle_td2_rib_entry(rec_data_t *rd,
+                                bgpstream_filter_mgr_t *filter_mgr,
+                                peer_table_t *peer_table,
                                 parsebgp_mrt_msg_t *mrt, parsebgp_bgp_afi_t afi,
                                 parsebgp_mrt_table_dump_v2_rib_entry_t *re)
 {
   peer_index_entry_t *bs_pie;
-  khiter_t k;
 
   rd->elem->orig_time_sec = re->originated_time;
   rd->elem->orig_time_usec = 0;
 
   // look the peer up in the peer index table
-  if ((k = kh_get(td2_peer, peer_table, re->peer_index)) ==
-      kh_end(peer_table)) {
+  if (re->peer_index >= peer_table->peer_cnt) {
     bgpstream_log(BGPSTREAM_LOG_ERR,
                   "Missing Peer Index Table entry for Peer ID %d",
                   re->peer_index);
     return -1;
   }
-  bs_pie = &kh_val(peer_table, k);
+  bs_pie = &peer_table->peers[re->peer_index];
   bgpstream_addr_copy(&rd->elem->peer_ip, &bs_pie->peer_ip);
 
   rd->elem->peer_asn = bs_pie->peer_asn;
 
+  // don't bother extracting the attributes of entries from unwanted peers
+  if (filter_mgr != NULL &&
+      bgpstream_filter_mgr_elem_precheck(filter_mgr, rd->elem,
+                                         BGPSTREAM_ELEM_CHECK_PEER) == 0) {
+    return 1;
+  }
+
   if (bgpstream_parsebgp_process_next_hop(
         rd->elem, re->path_attrs.attrs, afi == PARSEBGP_BGP_AFI_IPV6 ? 1 : 0) !=
       0) {
@@ -147,14 +212,23 @@ static int handle_td2_rib_entry(rec_data_t *rd, khash_t(td2_peer) * peer_table,
     return -1;
   }
 
+  if (filter_mgr != NULL &&
+      bgpstream_filter_mgr_elem_precheck(filter_mgr, rd->elem,
+                                         BGPSTREAM_ELEM_CHECK_PATH) == 0) {
+    return 1;
+  }
+
   return 0;
 }
 
 static int
-handle_td2_afi_safi_rib(rec_data_t *rd, khash_t(td2_peer) * peer_table,
-                        parsebgp_mrt_msg_t *mrt, parsebgp_bgp_afi_t afi,
+handle_td2_afi_safi_rib(rec_data_t *rd, bgpstream_filter_mgr_t *filter_mgr,
+                        peer_table_t *peer_table, parsebgp_mrt_msg_t *mrt,
+                        parsebgp_bgp_afi_t afi,
                         parsebgp_mrt_table_dump_v2_afi_safi_rib_t *asr)
 {
+  int rc = 1;
+
   // if this is the first time we've been called, prep the elem
   if (rd->next_re == 0) {
     rd->elem->type = BGPSTREAM_ELEM_TYPE_RIB;
@@ -168,24 +242,36 @@ handle_td2_afi_safi_rib(rec_data_t *rd, khash_t(td2_peer) * peer_table,
                     "Missing Peer Index Table, skipping RIB entry");
       return -1;
     }
-  }
 
-  // since this is a generator, we just process one rib entry each time
-  if (handle_td2_rib_entry(rd, peer_table, mrt, afi,
-                           &asr->entries[rd->next_re]) != 0) {
-    return -1;
+    // all the entries share the prefix, so check it just once
+    if (filter_mgr != NULL &&
+        bgpstream_filter_mgr_elem_precheck(filter_mgr, rd->elem,
+                                           BGPSTREAM_ELEM_CHECK_PREFIX) == 0) {
+      rd->end_of_elems = 1;
+      return 0;
+    }
   }
 
-  // move on to the next rib entry
-  rd->next_re++;
+  // since this is a generator, we just process one (wanted) rib entry each
+  // time
+  while (rc == 1 && rd->next_re < asr->entry_count) {
+    if ((rc = handle_td2_rib_entry(rd, filter_mgr, peer_table, mrt, afi,
+                                   &asr->entries[rd->next_re])) < 0) {
+      return -1;
+    }
+    // move on to the next rib entry
+    rd->next_re++;
+  }
   if (rd->next_re == asr->entry_count) {
     rd->end_of_elems = 1;
   }
 
-  return 1;
+  return rc == 0 ? 1 : 0;
 }
 
-static int handle_table_dump_v2(rec_data_t *rd, khash_t(td2_peer) * peer_table,
+static int handle_table_dump_v2(rec_data_t *rd,
+                                bgpstream_filter_mgr_t *filter_mgr,
+                                peer_table_t *peer_table,
                                 parsebgp_mrt_msg_t *mrt)
 {
   parsebgp_mrt_table_dump_v2_t *td2 = mrt->types.table_dump_v2;
@@ -202,11 +288,11 @@ static int handle_table_dump_v2(rec_data_t *rd, khash_t(td2_peer) * peer_table,
     break;
 
   case PARSEBGP_MRT_TABLE_DUMP_V2_RIB_IPV4_UNICAST:
-    return handle_td2_afi_safi_rib(rd, peer_table, mrt, PARSEBGP_BGP_AFI_IPV4,
-                                   &td2->afi_safi_rib);
+    return handle_td2_afi_safi_rib(rd, filter_mgr, peer_table, mrt,
+                                   PARSEBGP_BGP_AFI_IPV4, &td2->afi_safi_rib);
   case PARSEBGP_MRT_TABLE_DUMP_V2_RIB_IPV6_UNICAST:
-    return handle_td2_afi_safi_rib(rd, peer_table, mrt, PARSEBGP_BGP_AFI_IPV6,
-                                   &td2->afi_safi_rib);
+    return handle_td2_afi_safi_rib(rd, filter_mgr, peer_table, mrt,
+                                   PARSEBGP_BGP_AFI_IPV6, &td2->afi_safi_rib);
 
   default:
     // do nothing
@@ -226,7 +312,8 @@ static int handle_bgp4mp_state_change(rec_data_t *rd,
   return 1;
 }
 
-static int handle_bgp4mp(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
+static int handle_bgp4mp(rec_data_t *rd, bgpstream_filter_mgr_t *filter_mgr,
+                         parsebgp_mrt_msg_t *mrt)
 {
   int rc = 0;
   parsebgp_mrt_bgp4mp_t *bgp4mp = mrt->types.bgp4mp;
@@ -252,8 +339,8 @@ static int handle_bgp4mp(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
   case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4:
   case PARSEBGP_MRT_BGP4MP_MESSAGE_LOCAL:
   case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4_LOCAL:
-    rc = bgpstream_parsebgp_process_update(&rd->upd_state, rd->elem,
-                                           bgp4mp->data.bgp_msg);
+    rc = bgpstream_parsebgp_process_update(&rd->upd_state, filter_mgr,
+                                           rd->elem, bgp4mp->data.bgp_msg);
     if (rc == 0) {
       rd->end_of_elems = 1;
     }
@@ -268,44 +355,73 @@ static int handle_bgp4mp(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
   return rc;
 }
 
+// number of elems the given (decoded) message could yield
+static uint32_t elem_cnt(parsebgp_mrt_msg_t *mrt)
+{
+  switch (mrt->type) {
+  case PARSEBGP_MRT_TYPE_TABLE_DUMP:
+    return 1;
+
+  case PARSEBGP_MRT_TYPE_TABLE_DUMP_V2:
+    if (mrt->subtype == PARSEBGP_MRT_TABLE_DUMP_V2_RIB_IPV4_UNICAST ||
+        mrt->subtype == PARSEBGP_MRT_TABLE_DUMP_V2_RIB_IPV6_UNICAST) {
+      return mrt->types.table_dump_v2->afi_safi_rib.entry_count;
+    }
+    return 0;
+
+  case PARSEBGP_MRT_TYPE_BGP4MP:
+  case PARSEBGP_MRT_TYPE_BGP4MP_ET:
+    switch (mrt->subtype) {
+    case PARSEBGP_MRT_BGP4MP_STATE_CHANGE:
+    case PARSEBGP_MRT_BGP4MP_STATE_CHANGE_AS4:
+      return 1;
+    case PARSEBGP_MRT_BGP4MP_MESSAGE:
+    case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4:
+    case PARSEBGP_MRT_BGP4MP_MESSAGE_LOCAL:
+    case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4_LOCAL:
+      return bgpstream_parsebgp_update_elem_cnt(
+        mrt->types.bgp4mp->data.bgp_msg);
+    default:
+      return 0;
+    }
+
+  default:
+    return 0;
+  }
+}
+
 /* -------------------- RECORD FILTERING -------------------- */
 
 static int is_wanted_time(uint32_t record_time,
                           bgpstream_filter_mgr_t *filter_mgr)
 {
-  if (TIF==NULL ||
-      (record_time >= TIF->begin_time &&
-      (TIF->end_time == BGPSTREAM_FOREVER || record_time <= TIF->end_time))) {
-    // matches a filter interval
-    return 1;
-  }
-
-  return 0;
+  // matches a filter interval (if there are any)
+  return bgpstream_filter_mgr_time_wanted(filter_mgr, record_time);
 }
 
 static int handle_td2_peer_index(bgpstream_format_t *format,
                                  parsebgp_mrt_table_dump_v2_peer_index_t *pi)
 {
   int i;
-  khiter_t k;
-  int khret;
   peer_index_entry_t *bs_pie;
   parsebgp_mrt_table_dump_v2_peer_entry_t *pie;
 
-  // alloc the table hash
-  if ((STATE->peer_table = kh_init(td2_peer)) == NULL) {
+  // replace any table from earlier in the dump
+  free(STATE->peer_table);
+
+  // alloc the table (peers are resolved once here, and then just copied into
+  // each elem)
+  if ((STATE->peer_table = malloc_zero(
+         sizeof(peer_table_t) + pi->peer_count * sizeof(peer_index_entry_t))) ==
+      NULL) {
     return -1;
   }
+  STATE->peer_table->peer_cnt = pi->peer_count;
 
   // add peers to the table
   for (i = 0; i < pi->peer_count; i++) {
-    k = kh_put(td2_peer, STATE->peer_table, i, &khret);
-    if (khret == -1) {
-      return -1;
-    }
-
     pie = &pi->peer_entries[i];
-    bs_pie = &kh_val(STATE->peer_table, k);
+    bs_pie = &STATE->peer_table->peers[i];
 
     bs_pie->peer_asn = pie->asn;
     COPY_IP(&bs_pie->peer_ip, pie->ip_afi, pie->ip, return -1);
@@ -314,6 +430,300 @@ static int handle_td2_peer_index(bgpstream_format_t *format,
   return 0;
 }
 
+// keep a copy of the raw peer index table, so that it can be written out
+// before the RIB records that refer to it
+static int save_peer_index_raw(bgpstream_format_t *format)
+{
+  size_t len = STATE->decoder.msg_raw_len;
+  uint8_t *tmp;
+
+  if (len > STATE->peer_index_raw_alloc) {
+    if ((tmp = realloc(STATE->peer_index_raw, len)) == NULL) {
+      return -1;
+    }
+    STATE->peer_index_raw = tmp;
+    STATE->peer_index_raw_alloc = len;
+  }
+  memcpy(STATE->peer_index_raw, STATE->decoder.msg_raw, len);
+  STATE->peer_index_raw_len = len;
+  STATE->peer_index_pending = 1;
+  return 0;
+}
+
+// add an index point each time we move on to a new second
+static int update_index(bgpstream_format_t *format, int type, uint32_t ts_sec)
+{
+  if (STATE->index == NULL || ts_sec <= STATE->index_max_time) {
+    return 0;
+  }
+  if (type == PARSEBGP_MRT_TYPE_TABLE_DUMP_V2) {
+    // TDv2 records depend on the peer index table at the start of the dump,
+    // so we can never skip to the middle
+    bgpstream_time_index_destroy(STATE->index);
+    STATE->index = NULL;
+    return 0;
+  }
+  if (STATE->index_max_time != 0 &&
+      bgpstream_time_index_add(STATE->index, STATE->decoder.msg_offset,
+                               STATE->index_max_time) != 0) {
+    return -1;
+  }
+  STATE->index_max_time = ts_sec;
+  return 0;
+}
+
+static uint16_t raw_u16(const uint8_t *buf)
+{
+  uint16_t u16;
+  memcpy(&u16, buf, sizeof(u16));
+  return ntohs(u16);
+}
+
+static uint32_t raw_u32(const uint8_t *buf)
+{
+  uint32_t u32;
+  memcpy(&u32, buf, sizeof(u32));
+  return ntohl(u32);
+}
+
+// check the elem type and peer ASN filters against a message that can only
+// produce elems of the given type from the given peer
+static bgpstream_parsebgp_check_filter_rc_t
+check_elem_filters(bgpstream_filter_mgr_t *filter_mgr, uint8_t elemtype_mask,
+                   uint32_t peer_asn)
+{
+  if (filter_mgr->elemtype_mask != 0 &&
+      (filter_mgr->elemtype_mask & elemtype_mask) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  if (filter_mgr->peer_asns != NULL &&
+      bgpstream_id_set_exists(filter_mgr->peer_asns, peer_asn) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  return BGPSTREAM_PARSEBGP_KEEP;
+}
+
+static bgpstream_parsebgp_check_filter_rc_t
+prefilter_bgp4mp(bgpstream_filter_mgr_t *filter_mgr, const uint8_t *buf,
+                 size_t len, size_t off, uint16_t subtype)
+{
+  int as4, is_msg;
+  uint32_t peer_asn;
+  size_t ip_len;
+
+  switch (subtype) {
+  case PARSEBGP_MRT_BGP4MP_STATE_CHANGE:
+    as4 = 0;
+    is_msg = 0;
+    break;
+  case PARSEBGP_MRT_BGP4MP_STATE_CHANGE_AS4:
+    as4 = 1;
+    is_msg = 0;
+    break;
+  case PARSEBGP_MRT_BGP4MP_MESSAGE:
+  case PARSEBGP_MRT_BGP4MP_MESSAGE_LOCAL:
+    as4 = 0;
+    is_msg = 1;
+    break;
+  case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4:
+  case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4_LOCAL:
+    as4 = 1;
+    is_msg = 1;
+    break;
+  default:
+    // leave anything else to the parser
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  // peer ASN, local ASN, interface index (2), AFI (2)
+  if (len < off + (as4 ? 8 : 4) + 4) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+  peer_asn = as4 ? raw_u32(buf + off) : raw_u16(buf + off);
+  off += (as4 ? 8 : 4) + 2;
+  switch (raw_u16(buf + off)) {
+  case PARSEBGP_BGP_AFI_IPV4:
+    ip_len = 4;
+    break;
+  case PARSEBGP_BGP_AFI_IPV6:
+    ip_len = 16;
+    break;
+  default:
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+  // AFI, peer IP, local IP
+  off += 2 + 2 * ip_len;
+
+  if (is_msg == 0) {
+    return check_elem_filters(filter_mgr, BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE,
+                              peer_asn);
+  }
+
+  // only UPDATE messages have elems
+  if (len > off + BGP_HDR_TYPE_OFFSET &&
+      buf[off + BGP_HDR_TYPE_OFFSET] != PARSEBGP_BGP_TYPE_UPDATE) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+  return check_elem_filters(filter_mgr,
+                            BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT |
+                              BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL,
+                            peer_asn);
+}
+
+static bgpstream_parsebgp_check_filter_rc_t
+prefilter_table_dump(bgpstream_filter_mgr_t *filter_mgr, const uint8_t *buf,
+                     size_t len, uint16_t subtype)
+{
+  size_t off = MRT_HDR_LEN, ip_len;
+
+  switch (subtype) {
+  case PARSEBGP_BGP_AFI_IPV4:
+    ip_len = 4;
+    break;
+  case PARSEBGP_BGP_AFI_IPV6:
+    ip_len = 16;
+    break;
+  default:
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  // view (2), sequence (2), prefix, prefix length (1), status (1),
+  // originated time (4), peer IP, peer ASN (2)
+  off += 2 + 2 + ip_len + 1 + 1 + 4 + ip_len;
+  if (len < off + 2) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+  return check_elem_filters(filter_mgr, BGPSTREAM_FILTER_ELEM_TYPE_RIB,
+                            raw_u16(buf + off));
+}
+
+// look at the raw MRT headers to reject messages that could not pass the
+// filters without decoding them
+static bgpstream_parsebgp_check_filter_rc_t
+populate_prefilter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
+                      const uint8_t *buf, size_t len)
+{
+  bgpstream_filter_mgr_t *filter_mgr = format->filter_mgr;
+  uint32_t ts_sec;
+  uint16_t type, subtype;
+
+  // the decoded cache needs every message, so let filter_cb decide
+  if (len < MRT_HDR_LEN || STATE->dec_writer != NULL) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+  ts_sec = raw_u32(buf);
+  type = raw_u16(buf + 4);
+  subtype = raw_u16(buf + 6);
+
+  // the peer index table is needed by every RIB entry that follows it
+  if (type == PARSEBGP_MRT_TYPE_TABLE_DUMP_V2 &&
+      subtype == PARSEBGP_MRT_TABLE_DUMP_V2_PEER_INDEX_TABLE) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  // skipped messages must still be indexed
+  if (update_index(format, type, ts_sec) != 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_ERROR;
+  }
+
+  record->time_sec = ts_sec;
+  record->time_usec = 0;
+
+  // is this above our interval
+  if (format->TIF != NULL && format->TIF->end_time != BGPSTREAM_FOREVER &&
+      ts_sec > format->TIF->end_time) {
+    return BGPSTREAM_PARSEBGP_EOS;
+  }
+  if (is_wanted_time(ts_sec, filter_mgr) == 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_OUT;
+  }
+
+  // the remaining checks reject messages that cannot produce any elem that
+  // would pass the elem filters, so without elem filters we keep everything
+  // (even messages without elems)
+  if (filter_mgr->elemtype_mask == 0 && filter_mgr->peer_asns == NULL) {
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+
+  switch (type) {
+  case PARSEBGP_MRT_TYPE_BGP4MP:
+    return prefilter_bgp4mp(filter_mgr, buf, len, MRT_HDR_LEN, subtype);
+  case PARSEBGP_MRT_TYPE_BGP4MP_ET:
+    // extended timestamp (microseconds) comes first
+    return prefilter_bgp4mp(filter_mgr, buf, len, MRT_HDR_LEN + 4, subtype);
+  case PARSEBGP_MRT_TYPE_TABLE_DUMP:
+    return prefilter_table_dump(filter_mgr, buf, len, subtype);
+  case PARSEBGP_MRT_TYPE_TABLE_DUMP_V2:
+    // RIB entries from many peers share a message, so only the type can be
+    // checked here
+    if (filter_mgr->elemtype_mask != 0 &&
+        (filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_RIB) == 0) {
+      return BGPSTREAM_PARSEBGP_FILTER_OUT;
+    }
+    return BGPSTREAM_PARSEBGP_KEEP;
+  default:
+    return BGPSTREAM_PARSEBGP_KEEP;
+  }
+}
+
+// copy the raw message into the record, along with the peer index table if
+// this is the first record to be kept since it was read
+static int keep_raw(bgpstream_format_t *format, bgpstream_record_t *record)
+{
+  size_t preamble_len = 0;
+
+  if (STATE->peer_index_pending != 0) {
+    preamble_len = STATE->peer_index_raw_len;
+  }
+  if (bgpstream_record_set_raw(record, STATE->peer_index_raw, preamble_len,
+                               STATE->decoder.msg_raw,
+                               STATE->decoder.msg_raw_len) != 0) {
+    return -1;
+  }
+  STATE->peer_index_pending = 0;
+  return 0;
+}
+
+// rewind the elem extraction state of a record to its first elem
+static void rewind_elems(bgpstream_record_t *record)
+{
+  bgpstream_elem_clear(RDATA->elem);
+  RDATA->end_of_elems = 0;
+  RDATA->next_re = 0;
+  bgpstream_parsebgp_upd_state_reset(&RDATA->upd_state);
+}
+
+// write all the elems of this message to the decoded cache, and then rewind
+// the record so that the user can extract them again
+static void add_decoded(bgpstream_format_t *format, bgpstream_record_t *record)
+{
+  bgpstream_elem_t *elem;
+  int rc;
+
+  if (bgpstream_decoded_writer_add_record(STATE->dec_writer, record->time_sec,
+                                          record->time_usec) != 0) {
+    goto err;
+  }
+  while ((rc = bs_format_mrt_get_next_elem(format, record, &elem)) > 0) {
+    if (bgpstream_decoded_writer_add_elem(STATE->dec_writer, elem) != 0) {
+      goto err;
+    }
+  }
+  if (rc < 0) {
+    goto err;
+  }
+  rewind_elems(record);
+  return;
+
+err:
+  // not fatal, the dump is just not cached
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Could not cache decoded records of %s",
+                format->res->url);
+  bgpstream_decoded_writer_destroy(STATE->dec_writer);
+  STATE->dec_writer = NULL;
+  rewind_elems(record);
+}
+
 static bgpstream_parsebgp_check_filter_rc_t
 populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
                    parsebgp_msg_t *msg)
@@ -332,6 +742,10 @@ populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
       bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to process Peer Index Table");
       return BGPSTREAM_PARSEBGP_FILTER_ERROR;
     }
+    if (format->filter_mgr->keep_raw != 0 && save_peer_index_raw(format) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to copy raw Peer Index Table");
+      return BGPSTREAM_PARSEBGP_FILTER_ERROR;
+    }
     // indicate that we want this message SKIPPED
     return BGPSTREAM_PARSEBGP_SKIP;
   }
@@ -340,10 +754,20 @@ populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
   ts_sec = record->time_sec = msg->types.mrt->timestamp_sec;
   record->time_usec = msg->types.mrt->timestamp_usec;
 
+  if (update_index(format, msg->types.mrt->type, ts_sec) != 0) {
+    return BGPSTREAM_PARSEBGP_FILTER_ERROR;
+  }
+
   // ensure the router fields are unset
-  record->router_name[0] = '\0';
+  record->router_name = "";
+  record->__int->router_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
   record->router_ip.version = 0;
 
+  // the decoded cache holds every message, whether we want it or not
+  if (STATE->dec_writer != NULL) {
+    add_decoded(format, record);
+  }
+
   // check the filters
 
   // is this above our interval
@@ -356,12 +780,178 @@ populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
 
   if (is_wanted_time(ts_sec, format->filter_mgr) != 0) {
     // we want this entry
+    if (format->filter_mgr->keep_raw != 0 && keep_raw(format, record) != 0) {
+      return BGPSTREAM_PARSEBGP_FILTER_ERROR;
+    }
     return BGPSTREAM_PARSEBGP_KEEP;
   } else {
     return BGPSTREAM_PARSEBGP_FILTER_OUT;
   }
 }
 
+// if the transport can store a time index for this dump, then either use an
+// existing index to skip over records before our interval, or build one as we
+// read the dump
+static int check_index(bgpstream_format_t *format)
+{
+  const char *path;
+  uint64_t offset;
+  uint32_t skip_to;
+
+  STATE->index_checked = 1;
+
+  if ((path = bgpstream_transport_get_index_path(format->transport)) == NULL ||
+      (STATE->index = bgpstream_time_index_create()) == NULL) {
+    return 0;
+  }
+
+  if (bgpstream_time_index_load(STATE->index, path) != 0) {
+    // no usable index, so build one (the index is left in the state)
+    return 0;
+  }
+
+  // we have an index, so we don't need to build one (and we can't skip ahead
+  // while building a decoded cache). skip to the first interval that the dump
+  // overlaps, which may begin after the dump does
+  if (STATE->dec_writer == NULL && format->TIF != NULL &&
+      (skip_to = bgpstream_filter_mgr_time_next(
+         format->filter_mgr, format->res->initial_time)) != 0 &&
+      (offset = bgpstream_time_index_lookup(STATE->index, skip_to)) > 0) {
+    bgpstream_log(BGPSTREAM_LOG_FINE, "Skipping %" PRIu64 " bytes of %s",
+                  offset, format->res->url);
+    if (bgpstream_parsebgp_skip(&STATE->decoder, format->transport, offset) !=
+        0) {
+      return -1;
+    }
+  }
+  bgpstream_time_index_destroy(STATE->index);
+  STATE->index = NULL;
+  return 0;
+}
+
+// if the user asked to cache decoded records, then either read the records
+// from an existing decoded cache, or build one as we parse the dump
+static void check_decoded(bgpstream_format_t *format)
+{
+  const char *path;
+
+  // raw records can only come from the dump itself
+  if (format->filter_mgr->keep_raw != 0 ||
+      (path = bgpstream_transport_get_decoded_path(format->transport)) ==
+        NULL) {
+    return;
+  }
+
+  if ((STATE->dec_reader = bgpstream_decoded_reader_open(path)) != NULL) {
+    bgpstream_log(BGPSTREAM_LOG_FINE, "Reading decoded records of %s from %s",
+                  format->res->url, path);
+    return;
+  }
+
+  // the cache must be usable with any elem fields, so decode all of them
+  if ((STATE->dec_writer = bgpstream_decoded_writer_create(path)) != NULL) {
+    bgpstream_parsebgp_opts_init(&STATE->decoder.parser_opts,
+                                 BGPSTREAM_ELEM_FIELD_ALL);
+  }
+}
+
+// populate a record from the decoded cache. this mirrors the filtering and
+// dump position logic of bgpstream_parsebgp_populate_record
+static bgpstream_format_status_t
+populate_decoded(bgpstream_format_t *format, bgpstream_record_t *record)
+{
+  uint32_t ts_sec, ts_usec;
+  const uint8_t *elems;
+  size_t elems_len;
+  uint64_t skipped_cnt = 0;
+  int rc;
+
+  record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_SOURCE;
+
+  while ((rc = bgpstream_decoded_reader_next(STATE->dec_reader, &ts_sec,
+                                             &ts_usec, &elems, &elems_len)) >
+         0) {
+    // is this above our interval
+    if (format->TIF != NULL && format->TIF->end_time != BGPSTREAM_FOREVER &&
+        ts_sec > format->TIF->end_time) {
+      if (STATE->dec_read_cnt > 0) {
+        record->dump_pos = BGPSTREAM_DUMP_MIDDLE;
+      }
+      record->status = BGPSTREAM_RECORD_STATUS_OUTSIDE_TIME_INTERVAL;
+      return BGPSTREAM_FORMAT_OUTSIDE_TIME_INTERVAL;
+    }
+
+    STATE->dec_read_cnt++;
+    if (is_wanted_time(ts_sec, format->filter_mgr) == 0) {
+      skipped_cnt++;
+      bgpstream_stats_add(BGPSTREAM_STAT_MRT_FILTERED, 1);
+      continue;
+    }
+    STATE->dec_valid_cnt++;
+
+    record->time_sec = ts_sec;
+    record->time_usec = ts_usec;
+    record->router_name = "";
+    record->__int->router_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
+    record->router_ip.version = 0;
+    record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
+    if (STATE->dec_valid_cnt == 1 && STATE->dec_read_cnt == 1) {
+      record->dump_pos = BGPSTREAM_DUMP_START;
+    } else {
+      record->dump_pos = BGPSTREAM_DUMP_MIDDLE;
+    }
+    RDATA->dec_elems = elems;
+    RDATA->dec_elems_len = elems_len;
+    return BGPSTREAM_FORMAT_OK;
+  }
+
+  if (rc < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupted decoded cache for %s",
+                  format->res->url);
+    record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+
+  // EOF
+  record->time_sec = record->dump_time_sec;
+  if (skipped_cnt == 0) {
+    record->dump_pos = BGPSTREAM_DUMP_END;
+  }
+  if (STATE->dec_read_cnt == 0) {
+    record->status = BGPSTREAM_RECORD_STATUS_EMPTY_SOURCE;
+    record->dump_pos = BGPSTREAM_DUMP_END;
+    return BGPSTREAM_FORMAT_EMPTY_DUMP;
+  }
+  if (STATE->dec_valid_cnt == 0) {
+    record->status = BGPSTREAM_RECORD_STATUS_FILTERED_SOURCE;
+    record->dump_pos = BGPSTREAM_DUMP_END;
+    return BGPSTREAM_FORMAT_FILTERED_DUMP;
+  }
+  return BGPSTREAM_FORMAT_END_OF_DUMP;
+}
+
+static int get_next_decoded_elem(bgpstream_format_t *format,
+                                 bgpstream_record_t *record,
+                                 bgpstream_elem_t **elem)
+{
+  ssize_t len;
+
+  if (RDATA->dec_elems_len == 0) {
+    return 0;
+  }
+  if ((len = bgpstream_elem_binary_read(RDATA->dec_elems, RDATA->dec_elems_len,
+                                        RDATA->elem)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupted elem in decoded cache for %s",
+                  format->res->url);
+    return -1;
+  }
+  RDATA->dec_elems += len;
+  RDATA->dec_elems_len -= len;
+
+  *elem = RDATA->elem;
+  return 1;
+}
+
 /* ==================== PUBLIC API BELOW HERE ==================== */
 
 int bs_format_mrt_create(bgpstream_format_t *format, bgpstream_resource_t *res)
@@ -369,15 +959,37 @@ int bs_format_mrt_create(bgpstream_format_t *format, bgpstream_resource_t *res)
   BS_FORMAT_SET_METHODS(mrt, format);
   parsebgp_opts_t *opts = NULL;
 
-  if ((format->state = malloc_zero(sizeof(state_t))) == NULL) {
+  // the state holds the buffer that every message is decoded from
+  if ((format->state = bgpstream_mem_malloc_buffer(BGPSTREAM_MEM_FORMAT,
+                                                   sizeof(state_t))) == NULL) {
     return -1;
   }
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, sizeof(state_t));
 
   STATE->decoder.msg_type = PARSEBGP_MSG_TYPE_MRT;
 
   opts = &STATE->decoder.parser_opts;
   parsebgp_opts_init(opts);
-  bgpstream_parsebgp_opts_init(opts);
+  bgpstream_parsebgp_opts_init(
+    opts, bgpstream_filter_mgr_elem_fields(format->filter_mgr));
+
+  check_decoded(format);
+  if (STATE->dec_reader != NULL) {
+    // nothing will be parsed
+    return 0;
+  }
+
+  // RIB dumps are made of large, independent messages, so they can be decoded
+  // by several threads at once
+  if (res->record_type == BGPSTREAM_RIB &&
+      format->filter_mgr->decode_threads > 0 &&
+      bgpstream_parsebgp_threads_start(&STATE->decoder,
+                                       format->filter_mgr->decode_threads,
+                                       format->filter_mgr->worker_cpus) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Could not start decoding threads for %s, decoding serially",
+                  res->url);
+  }
 
   return 0;
 }
@@ -386,24 +998,70 @@ bgpstream_format_status_t
 bs_format_mrt_populate_record(bgpstream_format_t *format,
                               bgpstream_record_t *record)
 {
-  return bgpstream_parsebgp_populate_record(&STATE->decoder, RDATA->msg, format,
-                                            record, NULL, populate_filter_cb);
+  bgpstream_format_status_t rc;
+
+  if (STATE->dec_reader != NULL) {
+    return populate_decoded(format, record);
+  }
+
+  if (STATE->index_checked == 0 && check_index(format) != 0) {
+    return BGPSTREAM_FORMAT_READ_ERROR;
+  }
+
+  rc = bgpstream_parsebgp_populate_record(&STATE->decoder, RDATA->msg, format,
+                                          record, NULL, populate_prefilter_cb,
+                                          populate_filter_cb, NULL);
+  if (rc == BGPSTREAM_FORMAT_OK) {
+    record->__int->elem_cnt_hint = elem_cnt(RDATA->msg->types.mrt);
+  }
+
+  // only save an index once we've seen the whole dump
+  if (STATE->index != NULL && (rc == BGPSTREAM_FORMAT_END_OF_DUMP ||
+                               rc == BGPSTREAM_FORMAT_FILTERED_DUMP)) {
+    bgpstream_time_index_save(
+      STATE->index, bgpstream_transport_get_index_path(format->transport));
+    bgpstream_time_index_destroy(STATE->index);
+    STATE->index = NULL;
+  }
+
+  // likewise for the decoded cache, which is discarded if we stop early
+  if (STATE->dec_writer != NULL && rc >= BGPSTREAM_FORMAT_FILTERED_DUMP) {
+    if (rc == BGPSTREAM_FORMAT_END_OF_DUMP ||
+        rc == BGPSTREAM_FORMAT_FILTERED_DUMP ||
+        rc == BGPSTREAM_FORMAT_EMPTY_DUMP) {
+      bgpstream_decoded_writer_commit(STATE->dec_writer);
+    } else {
+      bgpstream_decoded_writer_destroy(STATE->dec_writer);
+    }
+    STATE->dec_writer = NULL;
+  }
+
+  return rc;
 }
 
 int bs_format_mrt_get_next_elem(bgpstream_format_t *format,
                                 bgpstream_record_t *record,
                                 bgpstream_elem_t **elem)
 {
+  bgpstream_filter_mgr_t *filter_mgr;
   parsebgp_mrt_msg_t *mrt;
   int rc;
 
   *elem = NULL;
 
+  if (RDATA != NULL && STATE->dec_reader != NULL) {
+    return get_next_decoded_elem(format, record, elem);
+  }
+
   if (RDATA == NULL || RDATA->end_of_elems != 0) {
     // end-of-elems
     return 0;
   }
 
+  // skip elems that can't pass the filters as early as possible, unless
+  // they are all needed for the decoded cache
+  filter_mgr = STATE->dec_writer == NULL ? format->filter_mgr : NULL;
+
   mrt = RDATA->msg->types.mrt;
   switch (mrt->type) {
   case PARSEBGP_MRT_TYPE_TABLE_DUMP:
@@ -411,12 +1069,12 @@ int bs_format_mrt_get_next_elem(bgpstream_format_t *format,
     break;
 
   case PARSEBGP_MRT_TYPE_TABLE_DUMP_V2:
-    rc = handle_table_dump_v2(RDATA, STATE->peer_table, mrt);
+    rc = handle_table_dump_v2(RDATA, filter_mgr, STATE->peer_table, mrt);
     break;
 
   case PARSEBGP_MRT_TYPE_BGP4MP:
   case PARSEBGP_MRT_TYPE_BGP4MP_ET:
-    rc = handle_bgp4mp(RDATA, mrt);
+    rc = handle_bgp4mp(RDATA, filter_mgr, mrt);
     break;
 
   default:
@@ -445,11 +1103,9 @@ int bs_format_mrt_init_data(bgpstream_format_t *format, void **data)
     return -1;
   }
 
-  if ((rd->elem = bgpstream_elem_create()) == NULL) {
-    return -1;
-  }
-
-  if ((rd->msg = parsebgp_create_msg()) == NULL) {
+  if ((rd->elem = bgpstream_parsebgp_elem_get()) == NULL ||
+      (rd->msg = bgpstream_parsebgp_msg_get()) == NULL) {
+    bs_format_mrt_destroy_data(format, rd);
     return -1;
   }
 
@@ -466,6 +1122,8 @@ void bs_format_mrt_clear_data(bgpstream_format_t *format, void *data)
   rd->next_re = 0;
   bgpstream_parsebgp_upd_state_reset(&rd->upd_state);
   parsebgp_clear_msg(rd->msg);
+  rd->dec_elems = NULL;
+  rd->dec_elems_len = 0;
 }
 
 void bs_format_mrt_destroy_data(bgpstream_format_t *format, void *data)
@@ -474,20 +1132,35 @@ void bs_format_mrt_destroy_data(bgpstream_format_t *format, void *data)
   if (rd == NULL) {
     return;
   }
-  bgpstream_elem_destroy(rd->elem);
+  bgpstream_parsebgp_elem_put(rd->elem);
   rd->elem = NULL;
-  parsebgp_destroy_msg(rd->msg);
+  bgpstream_parsebgp_msg_put(rd->msg);
   rd->msg = NULL;
   free(data);
 }
 
 void bs_format_mrt_destroy(bgpstream_format_t *format)
 {
+  bgpstream_parsebgp_threads_stop(&STATE->decoder);
+
   if (STATE->peer_table != NULL) {
-    kh_destroy(td2_peer, STATE->peer_table);
+    free(STATE->peer_table);
     STATE->peer_table = NULL;
   }
 
-  free(format->state);
+  bgpstream_time_index_destroy(STATE->index);
+  STATE->index = NULL;
+
+  free(STATE->peer_index_raw);
+  STATE->peer_index_raw = NULL;
+
+  bgpstream_decoded_reader_destroy(STATE->dec_reader);
+  STATE->dec_reader = NULL;
+
+  bgpstream_decoded_writer_destroy(STATE->dec_writer);
+  STATE->dec_writer = NULL;
+
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, -(int64_t)sizeof(state_t));
+  bgpstream_mem_free_buffer(BGPSTREAM_MEM_FORMAT, format->state);
   format->state = NULL;
 }
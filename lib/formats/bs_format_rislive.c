@@ -26,14 +26,17 @@
 
 #include "bs_format_rislive.h"
 #include "bgpstream_format_interface.h"
+#include "bgpstream_hex.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
 #include "bgpstream_parsebgp_common.h"
 #include "utils.h"
 #include "jsmn_utils.h"
 #include "libjsmn/jsmn.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #define STATE ((state_t *)(format->state))
 #define RDATA ((rec_data_t *)(record->__int->data))
@@ -111,10 +114,19 @@ typedef struct state {
   // json bgp message fields
   json_field_ptrs_t json_fields;
 
+  // json tokens, reused (and only ever grown) from one message to the next
+  jsmntok_t *toks;
+  unsigned int toks_cnt;
+
+  // the last collector name that was interned
+  bgpstream_str_intern_cache_t collector_cache;
+
 } state_t;
 
 #define JSON_BUFLEN 1024*1024 // 1 MB buffer
 
+#define JSON_INIT_TOKCOUNT 128
+
 /* ======================================================== */
 /* ======================================================== */
 /* ==================== JSON UTILITIES ==================== */
@@ -133,35 +145,6 @@ typedef struct state {
     FIELDPTR(field)[FIELDLEN(field)] = tmp;                                    \
   } while (0)
 
-// convert char array to bytes
-static int hexstr_to_bytes(uint8_t *buf, const char *hexstr, size_t hexstr_len)
-{
-  size_t i;
-  char c;
-  for (i = 0; i < hexstr_len; i++) {
-    c = hexstr[i];
-    // sanity check on input characters
-    if (c < '0' || (c > '9' && c < 'A') || (c > 'F' && c < 'a') || c > 'f') {
-      return -1;
-    }
-    if (c >= 'a') {
-      c -= ('a' - '9' - 1);
-    } else if (c >= 'A') {
-      c -= ('A' - '9' - 1);
-    }
-    c -= '0';
-
-    if ((i & 0x1) == 0) {
-      // high-order
-      *buf = c << 4;
-    } else {
-      // low-order
-      *(buf++) |= c;
-    }
-  }
-  return 0;
-}
-
 // convert bgp message hex string to char (byte) array, with added header marker
 // by @alistairking
 static ssize_t hexstr_to_bgpmsg(uint8_t *buf, size_t buflen, const char *hexstr,
@@ -178,8 +161,7 @@ static ssize_t hexstr_to_bgpmsg(uint8_t *buf, size_t buflen, const char *hexstr,
                   "RIS Live raw BGP message too long (%"PRIu16" bytes)", msg_len);
     return -1;
   }
-  // parse the hex string, one nybble at a time
-  if (hexstr_to_bytes(buf, hexstr, hexstr_len) < 0) {
+  if (bgpstream_hex_decode(buf, hexstr, hexstr_len) < 0) {
     return -1;
   }
   return msg_len;
@@ -200,15 +182,30 @@ static ssize_t hexstr_to_bgpmsg(uint8_t *buf, size_t buflen, const char *hexstr,
 static int process_common_fields(bgpstream_format_t *format,
                                  bgpstream_record_t *record)
 {
-  // populate collector name
-  memcpy(record->collector_name, FIELDPTR(host), FIELDLEN(host));
-  record->collector_name[FIELDLEN(host)] = '\0';
+  // fields are reset per message, so a missing one has a NULL pointer
+  if (FIELDPTR(host) == NULL || FIELDPTR(peer) == NULL ||
+      FIELDPTR(peer_asn) == NULL || FIELDPTR(timestamp) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "RIS Live message missing header fields");
+    return -1;
+  }
+
+  // populate collector name (interned straight from the message buffer)
+  char tmp;
+  tmp = FIELDPTR(host)[FIELDLEN(host)];
+  FIELDPTR(host)[FIELDLEN(host)] = '\0';
+  record->collector_name = bgpstream_str_intern_cached_str(
+    format->filter_mgr->names, &STATE->collector_cache, FIELDPTR(host),
+    &record->__int->collector_id);
+  FIELDPTR(host)[FIELDLEN(host)] = tmp;
+  if (record->collector_name == NULL) {
+    record->collector_name = "";
+    return -1;
+  }
 
   // populate peer asn
   STRTOUL(peer_asn, RDATA->elem->peer_asn);
 
   // populate peer ip
-  char tmp;
   tmp = FIELDPTR(peer)[FIELDLEN(peer)];
   FIELDPTR(peer)[FIELDLEN(peer)] = '\0';
   if (bgpstream_str2addr((char *)FIELDPTR(peer), &RDATA->elem->peer_ip) ==
@@ -301,7 +298,8 @@ process_unsupported_message(bgpstream_format_t *format,
   bgpstream_log(BGPSTREAM_LOG_WARN, "Unsupported RIS Live message: %s",
                 STATE->json_string_buffer);
   record->status = BGPSTREAM_RECORD_STATUS_UNSUPPORTED_RECORD;
-  record->collector_name[0] = '\0';
+  record->collector_name = "";
+  record->__int->collector_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
   return BGPSTREAM_FORMAT_UNSUPPORTED_MSG;
 }
 
@@ -312,25 +310,54 @@ process_corrupted_message(bgpstream_format_t *format,
   bgpstream_log(BGPSTREAM_LOG_WARN, "Corrupted RIS Live message: %s",
                 STATE->json_string_buffer);
   record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
-  record->collector_name[0] = '\0';
+  record->collector_name = "";
+  record->__int->collector_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
   return BGPSTREAM_FORMAT_CORRUPTED_MSG;
 }
 
 #define NEXT_TOK t++
 
-#define PARSEFIELD(field)                                                      \
-  if (jsmn_streq(STATE->json_string_buffer, t, STR(field)) == 1) {             \
-    NEXT_TOK;                                                                  \
-    STATE->json_fields.field.ptr = STATE->json_string_buffer + t->start;\
-    STATE->json_fields.field.len = t->end - t->start;                  \
-    NEXT_TOK;                                                                  \
+#define KEY_IS(str)                                                            \
+  (memcmp(key, str, sizeof(str) - 1) == 0)
+
+// find the field to store the value of the given "data" key in (or NULL if we
+// don't care about the key). keys are told apart by length (and first
+// character) so that each needs at most one string compare
+static json_field_t *data_field(bgpstream_format_t *format, jsmntok_t *t)
+{
+  const char *key = STATE->json_string_buffer + t->start;
+  json_field_ptrs_t *f = &STATE->json_fields;
+
+  switch (t->end - t->start) {
+  case 3:
+    return KEY_IS("raw") ? &f->raw : NULL;
+  case 4:
+    switch (key[0]) {
+    case 'h':
+      return KEY_IS("host") ? &f->host : NULL;
+    case 'p':
+      return KEY_IS("peer") ? &f->peer : NULL;
+    case 't':
+      return KEY_IS("type") ? &f->type : NULL;
+    }
+    return NULL;
+  case 5:
+    return KEY_IS("state") ? &f->state : NULL;
+  case 8:
+    return KEY_IS("peer_asn") ? &f->peer_asn : NULL;
+  case 9:
+    return KEY_IS("timestamp") ? &f->timestamp : NULL;
+  default:
+    return NULL;
   }
+}
 
 static int process_data(bgpstream_format_t *format,
                         jsmntok_t *root_tok)
 {
   int i;
   jsmntok_t *t = root_tok + 1;
+  json_field_t *field;
 
   for (i = 0; i < root_tok->size; i++) {
     // all keys must be strings
@@ -340,15 +367,12 @@ static int process_data(bgpstream_format_t *format,
                     t->end - t->start, STATE->json_string_buffer + t->start);
       return -1;
     }
-    PARSEFIELD(raw) //
-    else PARSEFIELD(timestamp)  //
-      else PARSEFIELD(host)     //
-      else PARSEFIELD(peer_asn) //
-      else PARSEFIELD(peer)     //
-      else PARSEFIELD(type)     //
-      else PARSEFIELD(state)    //
-      else
-    {
+    if ((field = data_field(format, t)) != NULL) {
+      NEXT_TOK;
+      field->ptr = STATE->json_string_buffer + t->start;
+      field->len = t->end - t->start;
+      NEXT_TOK;
+    } else {
       NEXT_TOK; // move past the key
       t = jsmn_skip(t); // skip the value
     }
@@ -365,27 +389,29 @@ bs_format_process_json_fields(bgpstream_format_t *format,
   bgpstream_format_status_t rc;
   jsmn_parser p;
 
-  jsmntok_t *t, *root_tok;
-  size_t tokcount = 128;
+  jsmntok_t *t, *root_tok, *tmp;
 
   // prepare parser
   jsmn_init(&p);
 
-  // allocate some tokens to start
-  if ((root_tok = malloc(sizeof(jsmntok_t) * tokcount)) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "RIS Live: Could not malloc initial tokens");
-    goto corrupted;
-  }
+  // forget the fields of the previous message
+  memset(&STATE->json_fields, 0, sizeof(STATE->json_fields));
 
 again:
+  // the token array stays as large as the largest message seen so far, so
+  // that (once warmed up) messages are parsed in a single pass
   if ((r = jsmn_parse(&p, STATE->json_string_buffer,
-                      STATE->json_string_buffer_len, root_tok, tokcount)) < 0) {
+                      STATE->json_string_buffer_len, STATE->toks,
+                      STATE->toks_cnt)) < 0) {
     if (r == JSMN_ERROR_NOMEM) {
-      tokcount *= 2;
-      if ((root_tok = realloc(root_tok, sizeof(jsmntok_t) * tokcount)) == NULL) {
+      // jsmn resumes where it left off once it has more tokens
+      if ((tmp = realloc(STATE->toks, sizeof(jsmntok_t) * STATE->toks_cnt *
+                                        2)) == NULL) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "RIS Live: Could not realloc tokens");
         goto corrupted;
       }
+      STATE->toks = tmp;
+      STATE->toks_cnt *= 2;
       goto again;
     }
     if (r == JSMN_ERROR_INVAL) {
@@ -397,6 +423,8 @@ again:
     goto corrupted;
   }
 
+  root_tok = STATE->toks;
+
   /* Assume the top-level element is an object */
   if (p.toknext < 1 || root_tok->type != JSMN_OBJECT) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "RIS Live: JSON top-level not object");
@@ -493,16 +521,13 @@ again:
   }
 
 ok:
-  free(root_tok);
   return BGPSTREAM_FORMAT_OK;
 
 err:
 corrupted:
-  free(root_tok);
   return process_corrupted_message(format, record);
 
 unsupported:
-  free(root_tok);
   return process_unsupported_message(format, record);
 }
 
@@ -512,25 +537,23 @@ static bgpstream_parsebgp_check_filter_rc_t
 check_filters(bgpstream_record_t *record, bgpstream_filter_mgr_t *filter_mgr)
 {
   // Collector
-  if (filter_mgr->collectors != NULL) {
-    if (bgpstream_str_set_exists(filter_mgr->collectors,
-                                 record->collector_name) == 0) {
+  if (filter_mgr->collector_ids != NULL) {
+    if (bgpstream_id_set_exists(filter_mgr->collector_ids,
+                                record->__int->collector_id) == 0) {
       return BGPSTREAM_PARSEBGP_FILTER_OUT;
     }
   }
 
   // Project
-  if (filter_mgr->projects != NULL) {
-    if (bgpstream_str_set_exists(filter_mgr->projects,
-                                 record->project_name) == 0) {
+  if (filter_mgr->project_ids != NULL) {
+    if (bgpstream_id_set_exists(filter_mgr->project_ids,
+                                record->__int->project_id) == 0) {
       return BGPSTREAM_PARSEBGP_FILTER_OUT;
     }
   }
 
   // Time window
-  if (TIF!=NULL &&
-      (record->time_sec < TIF->begin_time ||
-       (TIF->end_time != BGPSTREAM_FOREVER && record->time_sec > TIF->end_time))){
+  if (bgpstream_filter_mgr_time_wanted(filter_mgr, record->time_sec) == 0) {
       return BGPSTREAM_PARSEBGP_FILTER_OUT;
   }
 
@@ -548,16 +571,27 @@ int bs_format_rislive_create(bgpstream_format_t *format,
 {
   BS_FORMAT_SET_METHODS(rislive, format);
 
-  if ((format->state = malloc_zero(sizeof(state_t))) == NULL) {
+  if ((format->state = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_FORMAT,
+                                                 sizeof(state_t))) == NULL) {
+    return -1;
+  }
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, sizeof(state_t));
+
+  if ((STATE->json_string_buffer =
+         bgpstream_mem_malloc_buffer(BGPSTREAM_MEM_FORMAT, JSON_BUFLEN)) ==
+      NULL) {
     return -1;
   }
 
-  if ((STATE->json_string_buffer = malloc(JSON_BUFLEN)) == NULL) {
+  if ((STATE->toks = malloc(sizeof(jsmntok_t) * JSON_INIT_TOKCOUNT)) == NULL) {
     return -1;
   }
+  STATE->toks_cnt = JSON_INIT_TOKCOUNT;
+  bgpstream_str_intern_cache_init(&STATE->collector_cache);
 
   parsebgp_opts_init(&STATE->opts);
-  bgpstream_parsebgp_opts_init(&STATE->opts);
+  bgpstream_parsebgp_opts_init(
+    &STATE->opts, bgpstream_filter_mgr_elem_fields(format->filter_mgr));
   STATE->opts.bgp.marker_omitted = 0;
   STATE->opts.bgp.asn_4_byte = 1;
 
@@ -580,9 +614,14 @@ retry:
   if (STATE->json_string_buffer_len < 0) {
     // corrupted record
     record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
-    record->collector_name[0] = '\0';
+    record->collector_name = "";
+    record->__int->collector_id = BGPSTREAM_STR_INTERN_EMPTY_ID;
     return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
   } else if (STATE->json_string_buffer_len == 0) {
+    // a stream with nothing to read yet (the reader will try again later)
+    if (format->res->duration == BGPSTREAM_FOREVER) {
+      return BGPSTREAM_FORMAT_END_OF_DUMP;
+    }
     // end of dump
     return BGPSTREAM_FORMAT_READ_ERROR;
   }
@@ -603,6 +642,18 @@ retry:
   }
   // valid message, and it passes our filters
   record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
+  switch (RDATA->msg_type) {
+  case RISLIVE_MSG_TYPE_UPDATE:
+    record->__int->elem_cnt_hint =
+      bgpstream_parsebgp_update_elem_cnt(RDATA->msg->types.bgp);
+    break;
+  case RISLIVE_MSG_TYPE_STATUS:
+  case RISLIVE_MSG_TYPE_OPEN:
+    record->__int->elem_cnt_hint = 1;
+    break;
+  default:
+    break;
+  }
   return BGPSTREAM_FORMAT_OK;
 }
 
@@ -619,7 +670,8 @@ int bs_format_rislive_get_next_elem(bgpstream_format_t *format,
 
   switch (RDATA->msg_type) {
   case RISLIVE_MSG_TYPE_UPDATE:
-    rc = bgpstream_parsebgp_process_update(&RDATA->upd_state, RDATA->elem,
+    rc = bgpstream_parsebgp_process_update(&RDATA->upd_state,
+                                           format->filter_mgr, RDATA->elem,
                                            RDATA->msg->types.bgp);
     if (rc <= 0) {
       return rc;
@@ -661,11 +713,9 @@ int bs_format_rislive_init_data(bgpstream_format_t *format, void **data)
     return -1;
   }
 
-  if ((rd->elem = bgpstream_elem_create()) == NULL) {
-    return -1;
-  }
-
-  if ((rd->msg = parsebgp_create_msg()) == NULL) {
+  if ((rd->elem = bgpstream_parsebgp_elem_get()) == NULL ||
+      (rd->msg = bgpstream_parsebgp_msg_get()) == NULL) {
+    bs_format_rislive_destroy_data(format, rd);
     return -1;
   }
 
@@ -690,16 +740,18 @@ void bs_format_rislive_destroy_data(bgpstream_format_t *format, void *data)
   if (rd == NULL) {
     return;
   }
-  bgpstream_elem_destroy(rd->elem);
+  bgpstream_parsebgp_elem_put(rd->elem);
   rd->elem = NULL;
-  parsebgp_destroy_msg(rd->msg);
+  bgpstream_parsebgp_msg_put(rd->msg);
   rd->msg = NULL;
   free(data);
 }
 
 void bs_format_rislive_destroy(bgpstream_format_t *format)
 {
-  free(STATE->json_string_buffer);
-  free(format->state);
+  bgpstream_mem_free_buffer(BGPSTREAM_MEM_FORMAT, STATE->json_string_buffer);
+  free(STATE->toks);
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_FORMAT, -(int64_t)sizeof(state_t));
+  bgpstream_mem_free(BGPSTREAM_MEM_FORMAT, format->state);
   format->state = NULL;
 }
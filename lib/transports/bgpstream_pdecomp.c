@@ -0,0 +1,744 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_pdecomp.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_LIBBZ2) && defined(HAVE_BZLIB_H)
+#define WITH_PDECOMP_BZIP2
+#include <bzlib.h>
+#endif
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#define WITH_PDECOMP_GZIP
+#include <zlib.h>
+#endif
+
+// number of chunks that may be queued for each thread, so that a thread can
+// move on to another chunk while the oldest one is being consumed
+#define SLOTS_PER_THREAD 4
+
+// how many times a chunk that fails to decompress is extended to the next
+// boundary before giving up. a boundary may be a false match of the magic
+// inside compressed data, in which case the chunk before it is cut short, and
+// the chunk after it is garbage (and is dropped once the previous chunk has
+// been extended over it)
+#define MAX_EXTEND 8
+
+// initial size of a chunk output buffer
+#define OUT_INIT_LEN (1024 * 1024)
+
+// bzip2 block and end-of-stream magic numbers (48 bits each)
+#define BZ_BLOCK_MAGIC 0x314159265359ULL
+#define BZ_EOS_MAGIC 0x177245385090ULL
+#define BZ_MAGIC_BITS 48
+#define BZ_MAGIC_MASK 0xffffffffffffULL
+
+// bzip2 stream header: "BZh" and the block size (1-9)
+#define BZ_HDR_LEN 4
+
+// minimum length of a gzip member header
+#define GZ_HDR_LEN 10
+
+typedef enum {
+  CODEC_BZIP2,
+  CODEC_GZIP,
+} codec_t;
+
+typedef struct slot {
+
+  // chunk of the compressed file (in bits for bzip2, and bytes for gzip)
+  uint64_t start;
+  uint64_t end;
+
+  // standalone bzip2 stream made from the chunk
+  uint8_t *in;
+  size_t in_alloc;
+
+  // decompressed chunk
+  uint8_t *out;
+  size_t out_len;
+  size_t out_alloc;
+
+  // was the chunk decompressed successfully
+  int ok;
+
+  // has the chunk been decompressed
+  int done;
+
+} slot_t;
+
+struct bgpstream_pdecomp {
+
+  codec_t codec;
+
+  // the entire compressed file (borrowed)
+  const uint8_t *buf;
+  size_t len;
+
+  // position (in chunk units) to look for the next chunk from
+  uint64_t scan_pos;
+  int scan_done;
+
+  // end of the last chunk that was returned. chunks that start before this
+  // were absorbed by an extended chunk
+  uint64_t out_end;
+
+  // ring of queued chunks. chunks are numbered in file order, and chunk N
+  // lives in slot N % slots_cnt
+  slot_t *slots;
+  int slots_cnt;
+
+  // number of the chunk being read by _read
+  uint64_t head;
+
+  // number of the next chunk to be decompressed by a thread
+  uint64_t next;
+
+  // number of the next chunk to be queued
+  uint64_t tail;
+
+  // is the head chunk being read, and how much of it has been read
+  int holding;
+  size_t head_offset;
+
+  // decompression threads
+  pthread_t *threads;
+  int threads_cnt;
+
+  pthread_mutex_t mutex;
+
+  // signalled when a chunk is queued (or on shutdown)
+  pthread_cond_t queued_cond;
+
+  // signalled when a chunk has been decompressed
+  pthread_cond_t decoded_cond;
+
+  int shutdown;
+};
+
+static int grow_out(slot_t *slot)
+{
+  size_t alloc = slot->out_alloc == 0 ? OUT_INIT_LEN : slot->out_alloc * 2;
+  uint8_t *tmp;
+
+  if ((tmp = realloc(slot->out, alloc)) == NULL) {
+    return -1;
+  }
+  slot->out = tmp;
+  slot->out_alloc = alloc;
+  return 0;
+}
+
+/* -------------------- BZIP2 -------------------- */
+
+#ifdef WITH_PDECOMP_BZIP2
+
+// for each value of the second byte of a 64 bit window, the bit offsets (in
+// the first byte) at which a block magic (low 8 bits) or an end-of-stream magic
+// (high 8 bits) could start
+static uint16_t bz_candidates[256];
+static pthread_once_t bz_candidates_once = PTHREAD_ONCE_INIT;
+
+static void bz_candidates_init(void)
+{
+  int s;
+
+  for (s = 0; s < 8; s++) {
+    bz_candidates[((BZ_BLOCK_MAGIC << (16 - s)) >> 48) & 0xff] |= 1 << s;
+    bz_candidates[((BZ_EOS_MAGIC << (16 - s)) >> 48) & 0xff] |= 1 << (s + 8);
+  }
+}
+
+static uint64_t bz_window(const bgpstream_pdecomp_t *pd, size_t i)
+{
+  uint64_t w = 0;
+  int j;
+
+  for (j = 0; j < 8; j++) {
+    w = (w << 8) | (i + j < pd->len ? pd->buf[i + j] : 0);
+  }
+  return w;
+}
+
+// find the next block or end-of-stream magic at or after the given bit, and
+// return its bit position (or UINT64_MAX if there is none)
+static uint64_t bz_find(const bgpstream_pdecomp_t *pd, uint64_t from, int *eos)
+{
+  uint64_t total = (uint64_t)pd->len * 8;
+  uint64_t w, pos, v;
+  size_t i;
+  uint16_t cand;
+  int s;
+
+  for (i = from / 8; i + 1 < pd->len; i++) {
+    if ((cand = bz_candidates[pd->buf[i + 1]]) == 0) {
+      continue;
+    }
+    w = bz_window(pd, i);
+    for (s = 0; s < 8; s++) {
+      if ((cand & (0x101 << s)) == 0) {
+        continue;
+      }
+      pos = (uint64_t)i * 8 + s;
+      if (pos < from || pos + BZ_MAGIC_BITS > total) {
+        continue;
+      }
+      v = (w >> (64 - BZ_MAGIC_BITS - s)) & BZ_MAGIC_MASK;
+      if (v == BZ_BLOCK_MAGIC || v == BZ_EOS_MAGIC) {
+        *eos = (v == BZ_EOS_MAGIC);
+        return pos;
+      }
+    }
+  }
+  return UINT64_MAX;
+}
+
+static uint32_t bz_get_bits(const uint8_t *buf, uint64_t pos, int n)
+{
+  uint32_t v = 0;
+
+  for (; n > 0; n--, pos++) {
+    v = (v << 1) | ((buf[pos / 8] >> (7 - pos % 8)) & 1);
+  }
+  return v;
+}
+
+static void bz_put_bits(uint8_t *buf, uint64_t *pos, uint64_t v, int n)
+{
+  for (n--; n >= 0; n--, (*pos)++) {
+    if ((v >> n) & 1) {
+      buf[*pos / 8] |= 0x80 >> (*pos % 8);
+    }
+  }
+}
+
+// wrap a single block in a stream header and trailer, so that it can be
+// decompressed independently of the blocks before it
+static int bz_make_stream(const bgpstream_pdecomp_t *pd, slot_t *slot,
+                          size_t *len)
+{
+  uint64_t nbits = slot->end - slot->start;
+  size_t first = slot->start / 8, nbytes = (nbits + 7) / 8, j;
+  int s = slot->start % 8;
+  uint64_t pos;
+  uint8_t *tmp;
+
+  *len = BZ_HDR_LEN + (nbits + BZ_MAGIC_BITS + 32 + 7) / 8;
+  if (*len > slot->in_alloc) {
+    if ((tmp = realloc(slot->in, *len)) == NULL) {
+      return -1;
+    }
+    slot->in = tmp;
+    slot->in_alloc = *len;
+  }
+  memset(slot->in, 0, *len);
+
+  // the largest block size, since we don't know what the block was written
+  // with
+  memcpy(slot->in, "BZh9", BZ_HDR_LEN);
+
+  // the block itself, shifted to start on a byte boundary
+  for (j = 0; j < nbytes; j++) {
+    slot->in[BZ_HDR_LEN + j] = pd->buf[first + j] << s;
+    if (s != 0 && first + j + 1 < pd->len) {
+      slot->in[BZ_HDR_LEN + j] |= pd->buf[first + j + 1] >> (8 - s);
+    }
+  }
+  if (nbits % 8 != 0) {
+    slot->in[BZ_HDR_LEN + nbytes - 1] &= 0xff << (8 - nbits % 8);
+  }
+
+  // the stream CRC of a single block stream is just the block CRC (which
+  // follows the block magic)
+  pos = BZ_HDR_LEN * 8 + nbits;
+  bz_put_bits(slot->in, &pos, BZ_EOS_MAGIC, BZ_MAGIC_BITS);
+  bz_put_bits(slot->in, &pos,
+              bz_get_bits(pd->buf, slot->start + BZ_MAGIC_BITS, 32), 32);
+  return 0;
+}
+
+static int bz_decode(const bgpstream_pdecomp_t *pd, slot_t *slot)
+{
+  bz_stream strm;
+  size_t in_len;
+  int rc = -1, bzrc;
+
+  if (slot->end - slot->start < BZ_MAGIC_BITS + 32 ||
+      bz_make_stream(pd, slot, &in_len) != 0) {
+    return -1;
+  }
+
+  memset(&strm, 0, sizeof(strm));
+  if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+    return -1;
+  }
+  strm.next_in = (char *)slot->in;
+  strm.avail_in = in_len;
+
+  slot->out_len = 0;
+  while (1) {
+    if (slot->out_len == slot->out_alloc && grow_out(slot) != 0) {
+      break;
+    }
+    strm.next_out = (char *)slot->out + slot->out_len;
+    strm.avail_out = slot->out_alloc - slot->out_len;
+    bzrc = BZ2_bzDecompress(&strm);
+    slot->out_len = slot->out_alloc - strm.avail_out;
+    if (bzrc == BZ_STREAM_END) {
+      rc = 0;
+      break;
+    }
+    if (bzrc != BZ_OK || (strm.avail_in == 0 && strm.avail_out != 0)) {
+      break;
+    }
+  }
+
+  BZ2_bzDecompressEnd(&strm);
+  return rc;
+}
+
+// queue the next block, skipping over stream trailers and headers
+static int bz_next_chunk(bgpstream_pdecomp_t *pd, uint64_t *start,
+                         uint64_t *end)
+{
+  int eos;
+
+  while ((*start = bz_find(pd, pd->scan_pos, &eos)) != UINT64_MAX && eos) {
+    pd->scan_pos = *start + BZ_MAGIC_BITS;
+  }
+  if (*start == UINT64_MAX) {
+    return 0;
+  }
+  if ((*end = bz_find(pd, *start + BZ_MAGIC_BITS, &eos)) == UINT64_MAX) {
+    *end = (uint64_t)pd->len * 8;
+  }
+  pd->scan_pos = *end;
+  return 1;
+}
+
+static uint64_t bz_extend(const bgpstream_pdecomp_t *pd, uint64_t end)
+{
+  int eos;
+  uint64_t next = bz_find(pd, end + BZ_MAGIC_BITS, &eos);
+  return next == UINT64_MAX ? (uint64_t)pd->len * 8 : next;
+}
+
+#endif
+
+/* -------------------- GZIP -------------------- */
+
+#ifdef WITH_PDECOMP_GZIP
+
+static int gz_is_member(const bgpstream_pdecomp_t *pd, size_t i)
+{
+  const uint8_t *p = pd->buf + i;
+
+  // magic, deflate, no reserved flags, a known XFL value and OS
+  return i + GZ_HDR_LEN <= pd->len && p[0] == 0x1f && p[1] == 0x8b &&
+         p[2] == 8 && (p[3] & 0xe0) == 0 &&
+         (p[8] == 0 || p[8] == 2 || p[8] == 4) && (p[9] <= 13 || p[9] == 255);
+}
+
+// find the next member header at or after the given byte, and return its
+// offset (or UINT64_MAX if there is none)
+static uint64_t gz_find(const bgpstream_pdecomp_t *pd, uint64_t from)
+{
+  const uint8_t *p;
+
+  while (from < pd->len &&
+         (p = memchr(pd->buf + from, 0x1f, pd->len - from)) != NULL) {
+    from = p - pd->buf;
+    if (gz_is_member(pd, from)) {
+      return from;
+    }
+    from++;
+  }
+  return UINT64_MAX;
+}
+
+static int gz_decode(const bgpstream_pdecomp_t *pd, slot_t *slot)
+{
+  z_stream z;
+  int rc = -1, zrc;
+
+  memset(&z, 0, sizeof(z));
+  // decode gzip members only
+  if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+    return -1;
+  }
+  z.next_in = (Bytef *)pd->buf + slot->start;
+  z.avail_in = slot->end - slot->start;
+
+  slot->out_len = 0;
+  while (1) {
+    if (slot->out_len == slot->out_alloc && grow_out(slot) != 0) {
+      break;
+    }
+    z.next_out = slot->out + slot->out_len;
+    z.avail_out = slot->out_alloc - slot->out_len;
+    zrc = inflate(&z, Z_NO_FLUSH);
+    slot->out_len = slot->out_alloc - z.avail_out;
+    if (zrc == Z_STREAM_END) {
+      if (z.avail_in == 0) {
+        rc = 0;
+        break;
+      }
+      // an extended chunk holds several members
+      if (gz_is_member(pd, slot->end - z.avail_in)) {
+        inflateReset(&z);
+        continue;
+      }
+      // like gzip, ignore trailing garbage at the end of the file
+      if (slot->end == pd->len) {
+        rc = 0;
+      }
+      break;
+    }
+    if ((zrc != Z_OK && zrc != Z_BUF_ERROR) ||
+        (z.avail_in == 0 && z.avail_out != 0)) {
+      break;
+    }
+  }
+
+  inflateEnd(&z);
+  return rc;
+}
+
+static int gz_next_chunk(bgpstream_pdecomp_t *pd, uint64_t *start,
+                         uint64_t *end)
+{
+  if (pd->scan_pos >= pd->len ||
+      (*start = gz_find(pd, pd->scan_pos)) == UINT64_MAX) {
+    return 0;
+  }
+  if ((*end = gz_find(pd, *start + GZ_HDR_LEN)) == UINT64_MAX) {
+    *end = pd->len;
+  }
+  pd->scan_pos = *end;
+  return 1;
+}
+
+static uint64_t gz_extend(const bgpstream_pdecomp_t *pd, uint64_t end)
+{
+  uint64_t next = gz_find(pd, end + GZ_HDR_LEN);
+  return next == UINT64_MAX ? pd->len : next;
+}
+
+#endif
+
+/* -------------------- CODEC DISPATCH -------------------- */
+
+static int decode(const bgpstream_pdecomp_t *pd, slot_t *slot)
+{
+  switch (pd->codec) {
+#ifdef WITH_PDECOMP_BZIP2
+  case CODEC_BZIP2:
+    return bz_decode(pd, slot);
+#endif
+#ifdef WITH_PDECOMP_GZIP
+  case CODEC_GZIP:
+    return gz_decode(pd, slot);
+#endif
+  default:
+    return -1;
+  }
+}
+
+static int next_chunk(bgpstream_pdecomp_t *pd, uint64_t *start, uint64_t *end)
+{
+  switch (pd->codec) {
+#ifdef WITH_PDECOMP_BZIP2
+  case CODEC_BZIP2:
+    return bz_next_chunk(pd, start, end);
+#endif
+#ifdef WITH_PDECOMP_GZIP
+  case CODEC_GZIP:
+    return gz_next_chunk(pd, start, end);
+#endif
+  default:
+    return 0;
+  }
+}
+
+static uint64_t extend(const bgpstream_pdecomp_t *pd, uint64_t end)
+{
+  switch (pd->codec) {
+#ifdef WITH_PDECOMP_BZIP2
+  case CODEC_BZIP2:
+    return bz_extend(pd, end);
+#endif
+#ifdef WITH_PDECOMP_GZIP
+  case CODEC_GZIP:
+    return gz_extend(pd, end);
+#endif
+  default:
+    return end;
+  }
+}
+
+static uint64_t total_len(const bgpstream_pdecomp_t *pd)
+{
+  return pd->codec == CODEC_BZIP2 ? (uint64_t)pd->len * 8 : pd->len;
+}
+
+/* -------------------- THREADS -------------------- */
+
+static void *decode_thread(void *user)
+{
+  bgpstream_pdecomp_t *pd = user;
+  slot_t *slot;
+  int i;
+
+  pthread_mutex_lock(&pd->mutex);
+  while (1) {
+    while (pd->shutdown == 0 && pd->next == pd->tail) {
+      pthread_cond_wait(&pd->queued_cond, &pd->mutex);
+    }
+    if (pd->shutdown != 0) {
+      break;
+    }
+    slot = &pd->slots[pd->next % pd->slots_cnt];
+    pd->next++;
+    pthread_mutex_unlock(&pd->mutex);
+
+    slot->ok = 0;
+    for (i = 0; i <= MAX_EXTEND; i++) {
+      if (decode(pd, slot) == 0) {
+        slot->ok = 1;
+        break;
+      }
+      if (slot->end >= total_len(pd)) {
+        break;
+      }
+      slot->end = extend(pd, slot->end);
+    }
+
+    pthread_mutex_lock(&pd->mutex);
+    slot->done = 1;
+    pthread_cond_broadcast(&pd->decoded_cond);
+  }
+  pthread_mutex_unlock(&pd->mutex);
+  return NULL;
+}
+
+// queue as many chunks as there are free slots for
+static void queue_chunks(bgpstream_pdecomp_t *pd)
+{
+  slot_t *slot;
+  uint64_t start, end;
+
+  // only the reader changes tail and head, so no need to lock to check
+  while (pd->scan_done == 0 && pd->tail - pd->head < (uint64_t)pd->slots_cnt) {
+    if (next_chunk(pd, &start, &end) == 0) {
+      pd->scan_done = 1;
+      break;
+    }
+    // no thread can be looking at this slot: it is neither queued nor held
+    slot = &pd->slots[pd->tail % pd->slots_cnt];
+    slot->start = start;
+    slot->end = end;
+    slot->done = 0;
+
+    pthread_mutex_lock(&pd->mutex);
+    pd->tail++;
+    pthread_cond_signal(&pd->queued_cond);
+    pthread_mutex_unlock(&pd->mutex);
+  }
+}
+
+/* ==================== PUBLIC API BELOW HERE ==================== */
+
+bgpstream_pdecomp_t *bgpstream_pdecomp_create(const uint8_t *buf, size_t len,
+                                              int threads,
+                                              const bgpstream_cpuset_t *cpus)
+{
+  bgpstream_pdecomp_t *pd;
+  codec_t codec;
+  int i;
+
+  assert(threads > 0);
+
+  if (len >= BZ_HDR_LEN && memcmp(buf, "BZh", 3) == 0 && buf[3] >= '1' &&
+      buf[3] <= '9') {
+    codec = CODEC_BZIP2;
+  } else if (len >= GZ_HDR_LEN && buf[0] == 0x1f && buf[1] == 0x8b) {
+    codec = CODEC_GZIP;
+  } else {
+    return NULL;
+  }
+
+  if ((pd = malloc_zero(sizeof(bgpstream_pdecomp_t))) == NULL) {
+    return NULL;
+  }
+  pd->codec = codec;
+  pd->buf = buf;
+  pd->len = len;
+  pthread_mutex_init(&pd->mutex, NULL);
+  pthread_cond_init(&pd->queued_cond, NULL);
+  pthread_cond_init(&pd->decoded_cond, NULL);
+
+  switch (codec) {
+#ifdef WITH_PDECOMP_BZIP2
+  case CODEC_BZIP2: {
+    int eos;
+    pthread_once(&bz_candidates_once, bz_candidates_init);
+    // the first block must directly follow the stream header
+    if (bz_find(pd, BZ_HDR_LEN * 8, &eos) != BZ_HDR_LEN * 8 || eos) {
+      goto err;
+    }
+    break;
+  }
+#endif
+#ifdef WITH_PDECOMP_GZIP
+  case CODEC_GZIP:
+    // a single member cannot be split
+    if (gz_is_member(pd, 0) == 0 || gz_find(pd, GZ_HDR_LEN) == UINT64_MAX) {
+      goto err;
+    }
+    break;
+#endif
+  default:
+    goto err;
+  }
+
+  pd->slots_cnt = threads * SLOTS_PER_THREAD;
+  if ((pd->slots = malloc_zero(sizeof(slot_t) * pd->slots_cnt)) == NULL) {
+    goto err;
+  }
+
+  if ((pd->threads = malloc_zero(sizeof(pthread_t) * threads)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < threads; i++) {
+    if (bgpstream_cpuset_thread_create(cpus, &pd->threads[i], decode_thread,
+                                       pd) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start decompression thread");
+      goto err;
+    }
+    pd->threads_cnt++;
+  }
+
+  return pd;
+
+err:
+  bgpstream_pdecomp_destroy(pd);
+  return NULL;
+}
+
+void bgpstream_pdecomp_destroy(bgpstream_pdecomp_t *pd)
+{
+  int i;
+
+  if (pd == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pd->mutex);
+  pd->shutdown = 1;
+  pthread_cond_broadcast(&pd->queued_cond);
+  pthread_mutex_unlock(&pd->mutex);
+  for (i = 0; i < pd->threads_cnt; i++) {
+    pthread_join(pd->threads[i], NULL);
+  }
+  free(pd->threads);
+
+  if (pd->slots != NULL) {
+    for (i = 0; i < pd->slots_cnt; i++) {
+      free(pd->slots[i].in);
+      free(pd->slots[i].out);
+    }
+    free(pd->slots);
+  }
+
+  pthread_cond_destroy(&pd->queued_cond);
+  pthread_cond_destroy(&pd->decoded_cond);
+  pthread_mutex_destroy(&pd->mutex);
+  free(pd);
+}
+
+int64_t bgpstream_pdecomp_read(bgpstream_pdecomp_t *pd, uint8_t *buf,
+                               int64_t len)
+{
+  slot_t *slot;
+  int64_t total = 0;
+  size_t cpy;
+
+  while (total < len) {
+    slot = &pd->slots[pd->head % pd->slots_cnt];
+
+    if (pd->holding != 0) {
+      if (pd->head_offset < slot->out_len) {
+        cpy = slot->out_len - pd->head_offset;
+        if (cpy > (uint64_t)(len - total)) {
+          cpy = len - total;
+        }
+        memcpy(buf + total, slot->out + pd->head_offset, cpy);
+        pd->head_offset += cpy;
+        total += cpy;
+        continue;
+      }
+      // done with this chunk
+      pd->head++;
+      pd->holding = 0;
+      continue;
+    }
+
+    queue_chunks(pd);
+    if (pd->tail == pd->head) {
+      // no more chunks
+      break;
+    }
+
+    pthread_mutex_lock(&pd->mutex);
+    while (slot->done == 0) {
+      pthread_cond_wait(&pd->decoded_cond, &pd->mutex);
+    }
+    pthread_mutex_unlock(&pd->mutex);
+
+    if (slot->start < pd->out_end) {
+      // absorbed by the previous (extended) chunk
+      pd->head++;
+      continue;
+    }
+    if (slot->ok == 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Could not decompress chunk at offset %" PRIu64,
+                    pd->codec == CODEC_BZIP2 ? slot->start / 8 : slot->start);
+      return -1;
+    }
+    pd->out_end = slot->end;
+    pd->holding = 1;
+    pd->head_offset = 0;
+  }
+
+  return total;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PDECOMP_H
+#define __BGPSTREAM_PDECOMP_H
+
+#include "bgpstream_cpuset.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for a pool of threads that decompress a bzip2 or gzip
+ * file in parallel.
+ *
+ * The compressed file is split into independently decodable chunks: bzip2
+ * blocks (found by their bit-aligned block magic), or gzip members. Chunks are
+ * decompressed by the threads, and the output is returned in file order, so it
+ * is identical to decompressing the file serially.
+ */
+
+/** Opaque structure representing a parallel decompressor */
+typedef struct bgpstream_pdecomp bgpstream_pdecomp_t;
+
+/** Create a parallel decompressor for the given compressed data
+ *
+ * @param buf           pointer to the entire compressed file (borrowed)
+ * @param len           length of the compressed file
+ * @param threads       number of decompression threads to start
+ * @param cpus          set of CPUs to pin the threads to (NULL to let them run
+ *                      anywhere)
+ * @return pointer to the decompressor if successful, NULL otherwise
+ *
+ * NULL is also returned if the data cannot be split (e.g., a single-member
+ * gzip file, or a codec that is not supported), in which case it should be
+ * decompressed serially. The buffer must remain valid until the decompressor
+ * is destroyed.
+ */
+bgpstream_pdecomp_t *bgpstream_pdecomp_create(const uint8_t *buf, size_t len,
+                                              int threads,
+                                              const bgpstream_cpuset_t *cpus);
+
+/** Stop the threads of the given decompressor and destroy it
+ *
+ * @param pd            pointer to the decompressor to destroy
+ */
+void bgpstream_pdecomp_destroy(bgpstream_pdecomp_t *pd);
+
+/** Read decompressed data
+ *
+ * @param pd            pointer to the decompressor to read from
+ * @param buf           pointer to the buffer to read into
+ * @param len           length of the buffer
+ * @return the number of bytes read, 0 at the end of the data, or -1 if the
+ * data could not be decompressed
+ */
+int64_t bgpstream_pdecomp_read(bgpstream_pdecomp_t *pd, uint8_t *buf,
+                               int64_t len);
+
+#endif /* __BGPSTREAM_PDECOMP_H */
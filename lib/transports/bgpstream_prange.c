@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_prange.h"
+#include "bgpstream_http.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#if defined(HAVE_LIBCURL) && defined(HAVE_CURL_CURL_H)
+#define WITH_PRANGE
+#include <curl/curl.h>
+#endif
+
+#ifdef WITH_PRANGE
+
+// files smaller than this are streamed, since a few extra round trips would
+// cost more than the parallel download saves
+#define MIN_FILE_LEN (8 * 1024 * 1024)
+
+// smallest chunk that one range request fetches
+#define MIN_CHUNK_LEN (1024 * 1024)
+
+// number of chunks per stream, so that a slow connection holds up only a small
+// part of the file while the others move on
+#define CHUNKS_PER_STREAM 4
+
+// how many times a failed chunk is requested again before giving up
+#define MAX_RETRIES 2
+
+// abort a connection that moves less than 1 byte/s for this many seconds
+#define STALL_TIMEOUT 60
+
+// https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/User-Agent
+#define USER_AGENT "libbgpstream/" PACKAGE_VERSION
+
+typedef struct xfer {
+
+  CURL *easy;
+
+  // descriptor of the temporary file to write into
+  int fd;
+
+  // byte range of the chunk being fetched
+  uint64_t start;
+  uint64_t len;
+
+  // number of bytes of the chunk received so far
+  uint64_t received;
+
+  // number of times the chunk has been requested again
+  int retries;
+
+} xfer_t;
+
+typedef struct probe {
+
+  // total length of the file, from the Content-Range header
+  uint64_t total_len;
+
+} probe_t;
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void init_curl(void)
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static size_t probe_header_cb(char *buf, size_t size, size_t nitems,
+                              void *user)
+{
+  static const char hdr[] = "Content-Range:";
+  probe_t *probe = user;
+  size_t len = size * nitems;
+  char line[256];
+  char *slash;
+
+  // e.g., "Content-Range: bytes 0-0/123456"
+  if (len > sizeof(hdr) - 1 && len < sizeof(line) &&
+      strncasecmp(buf, hdr, sizeof(hdr) - 1) == 0) {
+    memcpy(line, buf, len);
+    line[len] = '\0';
+    if ((slash = strchr(line, '/')) != NULL) {
+      probe->total_len = strtoull(slash + 1, NULL, 10);
+    }
+  }
+  return len;
+}
+
+static size_t discard_cb(char *buf, size_t size, size_t nmemb, void *user)
+{
+  return size * nmemb;
+}
+
+static size_t write_cb(char *buf, size_t size, size_t nmemb, void *user)
+{
+  xfer_t *xfer = user;
+  size_t len = size * nmemb;
+  size_t done = 0;
+  ssize_t ret;
+
+  if (len > xfer->len - xfer->received) {
+    // the server sent more than we asked for
+    return 0;
+  }
+  while (done < len) {
+    if ((ret = pwrite(xfer->fd, buf + done, len - done,
+                      xfer->start + xfer->received + done)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 0;
+    }
+    done += ret;
+  }
+  xfer->received += len;
+  return len;
+}
+
+static CURL *create_easy(const char *url)
+{
+  CURL *easy;
+
+  if ((easy = curl_easy_init()) == NULL) {
+    return NULL;
+  }
+  bgpstream_http_share(easy);
+  curl_easy_setopt(easy, CURLOPT_URL, url);
+  curl_easy_setopt(easy, CURLOPT_USERAGENT, USER_AGENT);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, (long)STALL_TIMEOUT);
+  return easy;
+}
+
+// ask for the first byte of the file, which tells us both whether the server
+// supports range requests and how long the file is
+static uint64_t probe_len(const char *url, char **effective_url)
+{
+  probe_t probe = {0};
+  char *eff = NULL;
+  long code = 0;
+  CURL *easy;
+
+  if ((easy = create_easy(url)) == NULL) {
+    return 0;
+  }
+  curl_easy_setopt(easy, CURLOPT_RANGE, "0-0");
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, probe_header_cb);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, &probe);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, discard_cb);
+  if (curl_easy_perform(easy) != CURLE_OK ||
+      curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code) != CURLE_OK ||
+      code != 206) {
+    probe.total_len = 0;
+  }
+  // use the final URL for the range requests, so that they don't all have to
+  // follow the same redirects
+  if (probe.total_len != 0 &&
+      (curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &eff) != CURLE_OK ||
+       eff == NULL || (*effective_url = strdup(eff)) == NULL)) {
+    probe.total_len = 0;
+  }
+  curl_easy_cleanup(easy);
+  return probe.total_len;
+}
+
+static void start_chunk(CURLM *multi, xfer_t *xfer, uint64_t start,
+                        uint64_t len)
+{
+  char range[64];
+
+  xfer->start = start;
+  xfer->len = len;
+  xfer->received = 0;
+  snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64, start,
+           start + len - 1);
+  // libcurl copies the range string
+  curl_easy_setopt(xfer->easy, CURLOPT_RANGE, range);
+  curl_multi_add_handle(multi, xfer->easy);
+}
+
+// start fetching the chunk at offset next, and return the offset of the chunk
+// after it
+static uint64_t start_next_chunk(CURLM *multi, xfer_t *xfer, uint64_t next,
+                                 uint64_t chunk_len, uint64_t total_len)
+{
+  uint64_t len = total_len - next;
+
+  if (len > chunk_len) {
+    len = chunk_len;
+  }
+  start_chunk(multi, xfer, next, len);
+  return next + len;
+}
+
+// fetch every chunk of the file into fd
+static int fetch_chunks(const char *url, int fd, uint64_t total_len,
+                        int streams)
+{
+  CURLM *multi = NULL;
+  xfer_t *xfers = NULL;
+  uint64_t chunk_len, next = 0;
+  int i, running, msgs, active = 0;
+  CURLMsg *msg;
+  long code;
+  int ret = -1;
+
+  chunk_len = total_len / ((uint64_t)streams * CHUNKS_PER_STREAM);
+  if (chunk_len < MIN_CHUNK_LEN) {
+    chunk_len = MIN_CHUNK_LEN;
+  }
+
+  if ((multi = curl_multi_init()) == NULL ||
+      (xfers = malloc_zero(sizeof(xfer_t) * streams)) == NULL) {
+    goto done;
+  }
+  for (i = 0; i < streams; i++) {
+    if ((xfers[i].easy = create_easy(url)) == NULL) {
+      goto done;
+    }
+    xfers[i].fd = fd;
+    curl_easy_setopt(xfers[i].easy, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(xfers[i].easy, CURLOPT_WRITEDATA, &xfers[i]);
+    curl_easy_setopt(xfers[i].easy, CURLOPT_PRIVATE, &xfers[i]);
+  }
+
+  for (i = 0; i < streams && next < total_len; i++) {
+    next = start_next_chunk(multi, &xfers[i], next, chunk_len, total_len);
+    active++;
+  }
+
+  while (active > 0) {
+    if (curl_multi_perform(multi, &running) != CURLM_OK ||
+        curl_multi_wait(multi, NULL, 0, 1000, NULL) != CURLM_OK) {
+      goto done;
+    }
+    while ((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      xfer_t *xfer;
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&xfer);
+      curl_multi_remove_handle(multi, xfer->easy);
+      active--;
+      code = 0;
+      curl_easy_getinfo(xfer->easy, CURLINFO_RESPONSE_CODE, &code);
+      if (msg->data.result != CURLE_OK || code != 206 ||
+          xfer->received != xfer->len) {
+        if (xfer->retries++ == MAX_RETRIES) {
+          bgpstream_log(BGPSTREAM_LOG_WARN,
+                        "WARNING: Could not fetch bytes %" PRIu64 "-%" PRIu64
+                        " of %s: %s",
+                        xfer->start, xfer->start + xfer->len - 1, url,
+                        msg->data.result != CURLE_OK ?
+                          curl_easy_strerror(msg->data.result) :
+                          "unexpected response");
+          goto done;
+        }
+        start_chunk(multi, xfer, xfer->start, xfer->len);
+        active++;
+        continue;
+      }
+      if (next < total_len) {
+        xfer->retries = 0;
+        next = start_next_chunk(multi, xfer, next, chunk_len, total_len);
+        active++;
+      }
+    }
+  }
+  ret = 0;
+
+done:
+  if (xfers != NULL) {
+    for (i = 0; i < streams; i++) {
+      if (xfers[i].easy != NULL) {
+        curl_multi_remove_handle(multi, xfers[i].easy);
+        curl_easy_cleanup(xfers[i].easy);
+      }
+    }
+    free(xfers);
+  }
+  if (multi != NULL) {
+    curl_multi_cleanup(multi);
+  }
+  return ret;
+}
+
+int bgpstream_prange_fetch(const char *url, int streams, char **path)
+{
+  const char *tmpdir;
+  char *effective_url = NULL;
+  uint64_t total_len;
+  int fd = -1;
+
+  *path = NULL;
+  if (streams < 2 || strncmp(url, "http", 4) != 0) {
+    return 1;
+  }
+  pthread_once(&curl_once, init_curl);
+
+  if ((total_len = probe_len(url, &effective_url)) < MIN_FILE_LEN) {
+    bgpstream_log(BGPSTREAM_LOG_FINE,
+                  "streaming %s (small, or no range request support)", url);
+    free(effective_url);
+    return 1;
+  }
+
+  if ((tmpdir = getenv("TMPDIR")) == NULL || *tmpdir == '\0') {
+    tmpdir = "/tmp";
+  }
+  if ((*path = malloc(strlen(tmpdir) + sizeof("/bgpstream-XXXXXX"))) == NULL) {
+    goto err;
+  }
+  sprintf(*path, "%s/bgpstream-XXXXXX", tmpdir);
+  if ((fd = mkstemp(*path)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not create temporary file in %s: %s", tmpdir,
+                  strerror(errno));
+    free(*path);
+    *path = NULL;
+    goto err;
+  }
+  if (ftruncate(fd, total_len) != 0 ||
+      fetch_chunks(effective_url, fd, total_len, streams) != 0) {
+    goto err;
+  }
+  close(fd);
+  free(effective_url);
+
+  bgpstream_log(BGPSTREAM_LOG_FINE,
+                "downloaded %s (%" PRIu64 " bytes) using %d connections", url,
+                total_len, streams);
+  return 0;
+
+err:
+  if (fd >= 0) {
+    close(fd);
+    unlink(*path);
+    free(*path);
+    *path = NULL;
+  }
+  free(effective_url);
+  return -1;
+}
+
+#else
+
+int bgpstream_prange_fetch(const char *url, int streams, char **path)
+{
+  *path = NULL;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PRANGE_H
+#define __BGPSTREAM_PRANGE_H
+
+/** @file
+ *
+ * @brief Header file for downloading a remote file using parallel HTTP range
+ * requests.
+ *
+ * A single TCP stream from a distant archive rarely fills a fast link. The file
+ * is split into chunks that are fetched over several concurrent connections
+ * and written in place into a local temporary file, which can then be read like
+ * any other local file.
+ */
+
+/** Download a remote file using parallel HTTP range requests
+ *
+ * @param url           URL of the file to download
+ * @param streams       number of range requests to run concurrently
+ * @param path          set to the path of a temporary file holding the
+ *                      download, which the caller must remove and free
+ * @return 0 if the file was downloaded, 1 if it should be streamed instead, or
+ * -1 if the download failed
+ *
+ * 1 is returned (without a temporary file) when the file is small, when the
+ * server does not support range requests, or when libbgpstream was built
+ * without libcurl.
+ */
+int bgpstream_prange_fetch(const char *url, int streams, char **path);
+
+#endif /* __BGPSTREAM_PRANGE_H */
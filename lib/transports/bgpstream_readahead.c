@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "bgpstream_readahead.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// size of each read. large enough for the disk to stream, small enough that
+// the first chunks are ready long before the end of the file
+#define CHUNK_LEN (2 * 1024 * 1024)
+
+struct bgpstream_readahead {
+
+  int fd;
+
+  uint64_t len;
+
+  // offset of the next chunk to read
+  uint64_t next;
+
+  pthread_t *threads;
+  int threads_cnt;
+
+  pthread_mutex_t mutex;
+
+  int shutdown;
+};
+
+// bring a chunk of the file into the page cache
+static void read_chunk(bgpstream_readahead_t *ra, uint64_t offset,
+                       uint8_t *scratch)
+{
+  size_t len = CHUNK_LEN;
+#ifndef HAVE_READAHEAD
+  ssize_t rc;
+#endif
+
+  if (ra->len - offset < len) {
+    len = ra->len - offset;
+  }
+
+#ifdef HAVE_READAHEAD
+  (void)scratch;
+  readahead(ra->fd, offset, len);
+#else
+  while (len > 0 && (rc = pread(ra->fd, scratch, len, offset)) > 0) {
+    offset += rc;
+    len -= rc;
+  }
+#endif
+}
+
+static void *read_thread(void *user)
+{
+  bgpstream_readahead_t *ra = user;
+  uint8_t *scratch = NULL;
+  uint64_t offset;
+
+#ifndef HAVE_READAHEAD
+  if ((scratch = malloc(CHUNK_LEN)) == NULL) {
+    return NULL;
+  }
+#endif
+
+  for (;;) {
+    pthread_mutex_lock(&ra->mutex);
+    if (ra->shutdown != 0 || ra->next >= ra->len) {
+      pthread_mutex_unlock(&ra->mutex);
+      break;
+    }
+    offset = ra->next;
+    ra->next += CHUNK_LEN;
+    pthread_mutex_unlock(&ra->mutex);
+
+    read_chunk(ra, offset, scratch);
+  }
+
+  free(scratch);
+  return NULL;
+}
+
+/* ==================== PUBLIC API BELOW HERE ==================== */
+
+bgpstream_readahead_t *bgpstream_readahead_start(int fd, uint64_t len,
+                                                 int depth)
+{
+  bgpstream_readahead_t *ra;
+  int i;
+
+  assert(depth > 0);
+
+  if ((ra = malloc_zero(sizeof(bgpstream_readahead_t))) == NULL) {
+    return NULL;
+  }
+  ra->fd = fd;
+  ra->len = len;
+  pthread_mutex_init(&ra->mutex, NULL);
+
+  // there is no point in more threads than chunks
+  if ((uint64_t)depth > (len + CHUNK_LEN - 1) / CHUNK_LEN) {
+    depth = (len + CHUNK_LEN - 1) / CHUNK_LEN;
+  }
+
+  if ((ra->threads = malloc_zero(sizeof(pthread_t) * depth)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < depth; i++) {
+    if (pthread_create(&ra->threads[i], NULL, read_thread, ra) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start readahead thread");
+      goto err;
+    }
+    ra->threads_cnt++;
+  }
+
+  return ra;
+
+err:
+  // the caller still owns the descriptor
+  ra->fd = -1;
+  bgpstream_readahead_stop(ra);
+  return NULL;
+}
+
+void bgpstream_readahead_stop(bgpstream_readahead_t *ra)
+{
+  int i;
+
+  if (ra == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&ra->mutex);
+  ra->shutdown = 1;
+  pthread_mutex_unlock(&ra->mutex);
+  for (i = 0; i < ra->threads_cnt; i++) {
+    pthread_join(ra->threads[i], NULL);
+  }
+  free(ra->threads);
+
+  pthread_mutex_destroy(&ra->mutex);
+  if (ra->fd >= 0) {
+    close(ra->fd);
+  }
+  free(ra);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_READAHEAD_H
+#define __BGPSTREAM_READAHEAD_H
+
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file for a pool of threads that read a local file ahead of
+ * its consumer.
+ *
+ * The file is split into fixed-size chunks, which the threads bring into the
+ * page cache in file order, with up to one outstanding read per thread. The
+ * consumer (e.g., a parser working on a mapping of the file, or the parallel
+ * decompressor) then finds the data in memory instead of stalling on the
+ * disk.
+ */
+
+/** Opaque structure representing a file readahead */
+typedef struct bgpstream_readahead bgpstream_readahead_t;
+
+/** Start reading the given file ahead of its consumer
+ *
+ * @param fd            descriptor of the file to read (owned by the readahead
+ *                      if successful)
+ * @param len           length of the file
+ * @param depth         number of reads to keep outstanding
+ * @return pointer to the readahead if successful, NULL otherwise
+ *
+ * If NULL is returned, the descriptor is left open for the caller to close.
+ */
+bgpstream_readahead_t *bgpstream_readahead_start(int fd, uint64_t len,
+                                                 int depth);
+
+/** Stop the threads of the given readahead, close its file and destroy it
+ *
+ * @param ra            pointer to the readahead to stop
+ *
+ * Chunks that are not yet being read are dropped, and the function waits
+ * for the reads that are in progress.
+ */
+void bgpstream_readahead_stop(bgpstream_readahead_t *ra);
+
+#endif /* __BGPSTREAM_READAHEAD_H */
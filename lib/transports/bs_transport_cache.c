@@ -31,9 +31,12 @@
 #include "bs_transport_cache.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bgpstream_prange.h"
 #include "utils.h"
 #include "wandio.h"
+#include <dirent.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -46,6 +49,35 @@
 #define CACHE_FILE_SUFFIX ".cache"
 #define CACHE_LOCK_FILE_SUFFIX ".lock"
 #define CACHE_TEMP_FILE_SUFFIX ".temp"
+#define CACHE_INDEX_FILE_SUFFIX ".idx"
+#define CACHE_DECODED_FILE_SUFFIX ".dec"
+
+// codecs that cache files can be written with. wandio detects the codec when
+// the file is read back, so any of these can be mixed in one cache directory
+static const struct {
+  const char *name;
+  int method;
+  int level;
+} cache_codecs[] = {
+  // ZLib default compression level is 6: https://zlib.net/manual.html
+  {"gzip", WANDIO_COMPRESS_ZLIB, 6},
+  // zstd and lz4 compress slightly worse, but decompress several times faster
+  {"zstd", WANDIO_COMPRESS_ZSTD, 3},
+  {"lz4", WANDIO_COMPRESS_LZ4, 1},
+  {"none", WANDIO_COMPRESS_NONE, 0},
+};
+
+/** A cached resource that may be evicted */
+typedef struct cache_entry {
+  /** absolute path of the cache file */
+  char *path;
+
+  /** total size of the cache file and its sidecars */
+  uint64_t size;
+
+  /** last time the cache file was read */
+  time_t atime;
+} cache_entry_t;
 
 typedef struct cache_state {
   /** absolute path for the local cache file */
@@ -57,6 +89,12 @@ typedef struct cache_state {
   /** absolute path for the local cache temporary file */
   char *temp_file_path;
 
+  /** absolute path for the sidecar index of the cache file */
+  char *index_file_path;
+
+  /** absolute path for the sidecar decoded records of the cache file */
+  char *decoded_file_path;
+
   /** filename or URL of reader */
   char *reader_name;
 
@@ -137,6 +175,10 @@ static int init_state(bgpstream_transport_t *transport)
                   cache_dir_path, resource_hash, CACHE_FILE_SUFFIX) < 0 ||
     bs_asprintf(&STATE->temp_file_path, "%s%s",
                 STATE->cache_file_path, CACHE_TEMP_FILE_SUFFIX) < 0 ||
+    bs_asprintf(&STATE->index_file_path, "%s%s",
+                STATE->cache_file_path, CACHE_INDEX_FILE_SUFFIX) < 0 ||
+    bs_asprintf(&STATE->decoded_file_path, "%s%s",
+                STATE->cache_file_path, CACHE_DECODED_FILE_SUFFIX) < 0 ||
     bs_asprintf(&STATE->lock_file_path, "%s%s",
                 STATE->cache_file_path, CACHE_LOCK_FILE_SUFFIX) < 0)
   {
@@ -148,34 +190,87 @@ static int init_state(bgpstream_transport_t *transport)
   return 0;
 }
 
+// Check that the lock we hold is on the file currently at the lock path.  The
+// path is removed when a lock is released, so a process that was waiting for
+// the lock may end up holding a lock on a file that no longer exists, while a
+// newcomer creates and locks a fresh one.
+static int lock_is_current(bgpstream_transport_t *transport)
+{
+  struct stat fd_st, path_st;
+
+  if (fstat(STATE->lock_fd, &fd_st) != 0 ||
+      stat(STATE->lock_file_path, &path_st) != 0) {
+    return 0;
+  }
+  return fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino;
+}
+
+// Become the (only) writer of the cache file.  If another process is already
+// writing it, wait for that process to finish rather than fetching the same
+// remote file, and return 1 once the cache file exists.
+// Returns 0 if we own the lock, 1 if the cache file is now complete, and -1 if
+// the cache can not be used.
 static int bs_transport_cache_lock(bgpstream_transport_t *transport)
 {
   // Note: POSIX fcntl(F_SETLK) locks can not synchronize different threads in
   // the same process.  BSD flock() can, but is not POSIX.
   struct flock lock;
+  int waited = 0;
 
   if (!STATE->lock_file_path)
     return -1;
 
-  if ((STATE->lock_fd = open(STATE->lock_file_path, O_CREAT | O_WRONLY, 0644)) < 0) {
-    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't open lock file %s: %s",
-        STATE->lock_file_path, strerror(errno));
-    return -1;
-  }
+  while (1) {
+    if ((STATE->lock_fd =
+           open(STATE->lock_file_path, O_CREAT | O_WRONLY, 0644)) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't open lock file %s: %s",
+                    STATE->lock_file_path, strerror(errno));
+      return -1;
+    }
 
-  lock.l_type = F_WRLCK;
-  lock.l_whence = SEEK_SET;
-  lock.l_start = 0;
-  lock.l_len = 0;
-  if (fcntl(STATE->lock_fd, F_SETLK, &lock) < 0) {
-    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't lock file %s: %s",
-        STATE->lock_file_path, strerror(errno));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0;
+    lock.l_len = 0;
+    if (fcntl(STATE->lock_fd, F_SETLK, &lock) < 0) {
+      if (errno != EACCES && errno != EAGAIN) {
+        bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't lock file %s: %s",
+                      STATE->lock_file_path, strerror(errno));
+        goto fail;
+      }
+      // another process is writing the cache; wait for it to finish
+      if (!waited) {
+        bgpstream_log(BGPSTREAM_LOG_FINE, "waiting for %s to be cached",
+                      STATE->cache_file_path);
+        waited = 1;
+      }
+      if (fcntl(STATE->lock_fd, F_SETLKW, &lock) < 0) {
+        // EDEADLK means the writer is (indirectly) waiting for us
+        bgpstream_log(BGPSTREAM_LOG_WARN,
+                      "WARNING: can't wait for lock file %s: %s",
+                      STATE->lock_file_path, strerror(errno));
+        goto fail;
+      }
+    }
+
+    if (lock_is_current(transport)) {
+      return 0;
+    }
+
+    // The lock was released (and its file removed) by a writer or an evictor
+    // while we were waiting.  If the writer succeeded, we're done; otherwise
+    // try to become the writer ourselves.
     close(STATE->lock_fd);
     STATE->lock_fd = -1;
-    return -1;
+    if (access(STATE->cache_file_path, R_OK) == 0) {
+      return 1;
+    }
   }
 
-  return 0;
+fail:
+  close(STATE->lock_fd);
+  STATE->lock_fd = -1;
+  return -1;
 }
 
 static void bs_transport_cache_unlock(bgpstream_transport_t *transport)
@@ -188,12 +283,179 @@ static void bs_transport_cache_unlock(bgpstream_transport_t *transport)
   STATE->lock_fd = -1;
 }
 
+// Record a use of a cache file, so that eviction can tell hot files from cold
+// ones.  The access time is set explicitly since cache directories are often
+// on file systems mounted with noatime.
+static void touch_cache_file(const char *path)
+{
+  struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+  utimensat(AT_FDCWD, path, times, 0);
+}
+
+static uint64_t file_size(const char *path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Size of the sidecar of a cache file with the given suffix
+static uint64_t sidecar_size(const char *cache_path, const char *suffix)
+{
+  char *path;
+  uint64_t size;
+
+  if (bs_asprintf(&path, "%s%s", cache_path, suffix) < 0) {
+    return 0;
+  }
+  size = file_size(path);
+  free(path);
+  return size;
+}
+
+static void remove_sidecar(const char *cache_path, const char *suffix)
+{
+  char *path;
+
+  if (bs_asprintf(&path, "%s%s", cache_path, suffix) < 0) {
+    return;
+  }
+  remove(path);
+  free(path);
+}
+
+// Remove a cached resource along with its sidecars, unless its lock is held
+// (i.e., it is being written).  Readers that already have the files open are
+// not affected.  Returns 0 if the resource was evicted, -1 otherwise.
+static int evict_entry(const char *cache_path)
+{
+  struct flock lock;
+  char *lock_path;
+  int fd;
+
+  if (bs_asprintf(&lock_path, "%s%s", cache_path, CACHE_LOCK_FILE_SUFFIX) < 0) {
+    return -1;
+  }
+  if ((fd = open(lock_path, O_CREAT | O_WRONLY, 0644)) < 0) {
+    free(lock_path);
+    return -1;
+  }
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;
+  if (fcntl(fd, F_SETLK, &lock) < 0) {
+    close(fd);
+    free(lock_path);
+    return -1;
+  }
+
+  // nobody can be writing this resource now
+  remove(cache_path);
+  remove_sidecar(cache_path, CACHE_INDEX_FILE_SUFFIX);
+  remove_sidecar(cache_path, CACHE_DECODED_FILE_SUFFIX);
+
+  remove(lock_path);
+  close(fd);
+  free(lock_path);
+  return 0;
+}
+
+static int cmp_entry_atime(const void *a, const void *b)
+{
+  const cache_entry_t *ea = a, *eb = b;
+  return (ea->atime > eb->atime) - (ea->atime < eb->atime);
+}
+
+// If the cache is limited in size, evict the least recently used resources
+// (other than ours) until it fits again
+static void evict_cache(bgpstream_transport_t *transport)
+{
+  const char *max_str = bgpstream_resource_get_attr(
+    transport->res, BGPSTREAM_RESOURCE_ATTR_CACHE_MAX_SIZE);
+  const char *dir_path = bgpstream_resource_get_attr(
+    transport->res, BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH);
+  size_t suffix_len = strlen(CACHE_FILE_SUFFIX);
+  cache_entry_t *entries = NULL, *tmp;
+  int entries_cnt = 0, entries_alloc = 0, i;
+  uint64_t max_size, size, total = 0;
+  struct dirent *de;
+  struct stat st;
+  size_t name_len;
+  char *path;
+  DIR *dir;
+
+  if (max_str == NULL || dir_path == NULL ||
+      (max_size = strtoull(max_str, NULL, 10)) == 0 ||
+      (dir = opendir(dir_path)) == NULL) {
+    return;
+  }
+
+  while ((de = readdir(dir)) != NULL) {
+    name_len = strlen(de->d_name);
+    if (name_len <= suffix_len ||
+        strcmp(de->d_name + name_len - suffix_len, CACHE_FILE_SUFFIX) != 0 ||
+        bs_asprintf(&path, "%s/%s", dir_path, de->d_name) < 0) {
+      continue;
+    }
+    if (stat(path, &st) != 0) {
+      free(path);
+      continue;
+    }
+    size = st.st_size + sidecar_size(path, CACHE_INDEX_FILE_SUFFIX) +
+           sidecar_size(path, CACHE_DECODED_FILE_SUFFIX);
+    total += size;
+
+    // we are still using our own resource, so it is never evicted
+    if (strcmp(path, STATE->cache_file_path) == 0) {
+      free(path);
+      continue;
+    }
+
+    if (entries_cnt == entries_alloc) {
+      entries_alloc = (entries_alloc == 0) ? 64 : entries_alloc * 2;
+      if ((tmp = realloc(entries, sizeof(cache_entry_t) * entries_alloc)) ==
+          NULL) {
+        free(path);
+        break;
+      }
+      entries = tmp;
+    }
+    entries[entries_cnt].path = path;
+    entries[entries_cnt].size = size;
+    entries[entries_cnt].atime = st.st_atime;
+    entries_cnt++;
+  }
+  closedir(dir);
+
+  qsort(entries, entries_cnt, sizeof(cache_entry_t), cmp_entry_atime);
+
+  for (i = 0; i < entries_cnt && total > max_size; i++) {
+    if (evict_entry(entries[i].path) == 0) {
+      bgpstream_log(BGPSTREAM_LOG_FINE, "evicted %s (%" PRIu64 " bytes)",
+                    entries[i].path, entries[i].size);
+      total -= entries[i].size;
+    }
+  }
+  if (total > max_size) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: cache %s is still over its size limit "
+                  "(%" PRIu64 " > %" PRIu64 " bytes)",
+                  dir_path, total, max_size);
+  }
+
+  for (i = 0; i < entries_cnt; i++) {
+    free(entries[i].path);
+  }
+  free(entries);
+}
+
 static int open_cache_reader(bgpstream_transport_t *transport)
 {
   // Create reader that reads from existing local cache file.
   STATE->reader_name = STATE->cache_file_path;
   if ((STATE->reader = wandio_create(STATE->reader_name))) {
     bgpstream_log(BGPSTREAM_LOG_FINE, "reading cache %s", STATE->reader_name);
+    touch_cache_file(STATE->cache_file_path);
     return 0; // success
   }
   bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: Could not read cache %s",
@@ -201,10 +463,90 @@ static int open_cache_reader(bgpstream_transport_t *transport)
   return -1;
 }
 
+static iow_t *open_cache_writer(bgpstream_transport_t *transport)
+{
+  const char *name = bgpstream_resource_get_attr(
+    transport->res, BGPSTREAM_RESOURCE_ATTR_CACHE_COMPRESSION);
+  iow_t *writer;
+  unsigned i = 0;
+
+  if (name != NULL) {
+    for (i = 0; i < ARR_CNT(cache_codecs); i++) {
+      if (strcmp(name, cache_codecs[i].name) == 0) {
+        break;
+      }
+    }
+    if (i == ARR_CNT(cache_codecs)) {
+      bgpstream_log(BGPSTREAM_LOG_WARN,
+                    "WARNING: Unknown cache compression '%s', using %s", name,
+                    cache_codecs[0].name);
+      i = 0;
+    }
+  }
+
+  if ((writer = wandio_wcreate(STATE->temp_file_path, cache_codecs[i].method,
+                               cache_codecs[i].level, O_CREAT)) == NULL &&
+      i != 0) {
+    // wandio may have been built without support for this codec
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not write %s cache, using %s",
+                  cache_codecs[i].name, cache_codecs[0].name);
+    writer = wandio_wcreate(STATE->temp_file_path, cache_codecs[0].method,
+                            cache_codecs[0].level, O_CREAT);
+  }
+  return writer;
+}
+
+static io_t *open_remote_reader(bgpstream_transport_t *transport)
+{
+  char *dl_path = NULL;
+  io_t *reader;
+
+  // download a large remote file over several connections, and then read the
+  // local copy (which goes away once it has been opened)
+  if (transport->filter_mgr != NULL && transport->filter_mgr->http_streams > 1 &&
+      bgpstream_prange_fetch(transport->res->url,
+                             transport->filter_mgr->http_streams,
+                             &dl_path) == 0) {
+    reader = wandio_create(dl_path);
+    unlink(dl_path);
+    free(dl_path);
+    return reader;
+  }
+  return wandio_create(transport->res->url);
+}
+
+static const char *
+bs_transport_cache_get_index_path(bgpstream_transport_t *transport)
+{
+  // only offer the index path if we have a complete set of cache paths
+  return STATE->lock_file_path != NULL ? STATE->index_file_path : NULL;
+}
+
+static const char *
+bs_transport_cache_get_decoded_path(bgpstream_transport_t *transport)
+{
+  const char *enabled = bgpstream_resource_get_attr(
+    transport->res, BGPSTREAM_RESOURCE_ATTR_CACHE_DECODED);
+
+  if (enabled == NULL || strcmp(enabled, "on") != 0) {
+    return NULL;
+  }
+  return STATE->lock_file_path != NULL ? STATE->decoded_file_path : NULL;
+}
+
+static int bs_transport_cache_is_caching(bgpstream_transport_t *transport)
+{
+  return STATE->writer != NULL;
+}
+
 int bs_transport_cache_create(bgpstream_transport_t *transport)
 {
   // reset transport method
   BS_TRANSPORT_SET_METHODS(cache, transport);
+  transport->get_index_path = bs_transport_cache_get_index_path;
+  transport->get_decoded_path = bs_transport_cache_get_decoded_path;
+  transport->is_caching = bs_transport_cache_is_caching;
 
   // initialize cache_state data structure
   if (init_state(transport) != 0) {
@@ -213,12 +555,21 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
 
   // Check cache access before acquiring the lock, so that most cache readers
   // never need to lock and multiple cache readers won't block each other.
+  // Cache files are only ever created complete (by renaming the temporary
+  // file), so a cache file that exists can always be read.
   if (STATE->cache_file_path && access(STATE->cache_file_path, R_OK) == 0) {
     if (open_cache_reader(transport) == 0)
       return 0; // reading from local cache
   }
 
-  if (bs_transport_cache_lock(transport) == 0) {
+  switch (bs_transport_cache_lock(transport)) {
+  case 1:
+    // another process has just finished writing the cache
+    if (open_cache_reader(transport) == 0)
+      return 0; // reading from local cache
+    break;
+
+  case 0:
     // We own the lock.
     // Check cache access again to avoid a race where another process finished
     // writing a cache between our first access() and our getting the lock.
@@ -236,11 +587,16 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
                     STATE->cache_file_path, strerror(errno));
       bs_transport_cache_unlock(transport);
     }
+    break;
+
+  default:
+    // can't use the cache; read the remote file without caching it
+    break;
   }
 
   // open reader that reads from remote file
   STATE->reader_name = transport->res->url;
-  if ((STATE->reader = wandio_create(STATE->reader_name)) == NULL) {
+  if ((STATE->reader = open_remote_reader(transport)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: Could not open %s for reading",
                   STATE->reader_name);
     return -1;
@@ -249,11 +605,8 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
 
   if (STATE->lock_fd >= 0) {
     // We own the lock.
-    // Create cache file writer using wandio with compression enabled at
-    // default compression level ZLib default compression level is 6:
-    // https://zlib.net/manual.html
-    STATE->writer = wandio_wcreate(STATE->temp_file_path,
-                                   WANDIO_COMPRESS_ZLIB, 6, O_CREAT);
+    // Create cache file writer using wandio with the configured compression
+    STATE->writer = open_cache_writer(transport);
     if (STATE->writer == NULL) {
       bgpstream_log(BGPSTREAM_LOG_WARN,
                     "WARNING: Could not open %s for local caching: %s",
@@ -277,6 +630,12 @@ int64_t bs_transport_cache_readline(bgpstream_transport_t *transport,
                               (read_cb_t *)bs_transport_cache_read);
 }
 
+int bs_transport_cache_get_fd(bgpstream_transport_t *transport)
+{
+  // wandio does not expose a pollable descriptor
+  return -1;
+}
+
 static void close_cache_writer(bgpstream_transport_t *transport, int valid)
 {
   if (!STATE->writer)
@@ -290,6 +649,7 @@ static void close_cache_writer(bgpstream_transport_t *transport, int valid)
     if (rename(STATE->temp_file_path, STATE->cache_file_path) != 0) {
       bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: failed to rename %s: %s",
                     STATE->temp_file_path, strerror(errno));
+      valid = 0;
     }
 
   } else {
@@ -301,6 +661,11 @@ static void close_cache_writer(bgpstream_transport_t *transport, int valid)
   }
 
   bs_transport_cache_unlock(transport);
+
+  // the cache just grew, so make room if it is limited in size
+  if (valid) {
+    evict_cache(transport);
+  }
 }
 
 int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
@@ -361,6 +726,8 @@ void bs_transport_cache_destroy(bgpstream_transport_t *transport)
   // free up file path variables' memory space
   free(STATE->cache_file_path);
   free(STATE->temp_file_path);
+  free(STATE->index_file_path);
+  free(STATE->decoded_file_path);
 
   // free up the cache_state_t's memory space
   free(transport->state);
@@ -27,41 +27,233 @@
 #include "bs_transport_file.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bgpstream_pdecomp.h"
+#include "bgpstream_prange.h"
+#include "bgpstream_readahead.h"
+#include "utils.h"
 #include "wandio.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STATE ((state_t *)(transport->state))
+
+typedef struct state {
+
+  // wandio handle (NULL if the file is mapped)
+  io_t *fh;
+
+  // mapping of the whole file (NULL if it is read using wandio)
+  uint8_t *map;
+  size_t map_len;
+
+  // how much of the mapping has been consumed by read
+  size_t map_offset;
+
+  // parallel decompressor for a mapped compressed file (NULL otherwise)
+  bgpstream_pdecomp_t *pdecomp;
+
+  // background reads of the mapped file (NULL if disabled)
+  bgpstream_readahead_t *readahead;
+
+} state_t;
+
+// is the start of the file a compression header that wandio would handle?
+static int is_compressed(const uint8_t *buf, size_t len)
+{
+  static const struct {
+    const char *magic;
+    size_t len;
+  } magics[] = {
+    {"\x1f\x8b", 2},                 // gzip
+    {"BZh", 3},                        // bzip2
+    {"\xfd" "7zXZ", 5},               // xz
+    {"\x04\x22\x4d\x18", 4},         // lz4
+    {"\x28\xb5\x2f\xfd", 4},         // zstd
+  };
+  unsigned i;
+
+  for (i = 0; i < ARR_CNT(magics); i++) {
+    if (len >= magics[i].len &&
+        memcmp(buf, magics[i].magic, magics[i].len) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// map a local uncompressed MRT or BMP file so that it can be parsed in place,
+// or a compressed one so that it can be decompressed in parallel
+static int map_file(bgpstream_transport_t *transport, const char *path)
+{
+  struct stat st;
+  void *map;
+  int fd;
+
+  if (transport->res->format_type != BGPSTREAM_RESOURCE_FORMAT_MRT &&
+      transport->res->format_type != BGPSTREAM_RESOURCE_FORMAT_BMP) {
+    return -1;
+  }
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    // probably a URL for wandio to handle
+    return -1;
+  }
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return -1;
+  }
+
+  // private and writable so that nothing can modify the file, even if something
+  // were to write to the buffer
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  if (is_compressed(map, st.st_size) != 0 &&
+      (transport->filter_mgr == NULL ||
+       transport->filter_mgr->decompress_threads <= 0 ||
+       (STATE->pdecomp = bgpstream_pdecomp_create(
+          map, st.st_size, transport->filter_mgr->decompress_threads,
+          transport->filter_mgr->worker_cpus)) == NULL)) {
+    // leave it to wandio
+    munmap(map, st.st_size);
+    close(fd);
+    return -1;
+  }
+
+  // keep the disk busy ahead of the parser (or the decompression threads) so
+  // that they do not stall on page faults
+  if (transport->filter_mgr == NULL || transport->filter_mgr->io_depth <= 0 ||
+      (STATE->readahead = bgpstream_readahead_start(
+         fd, st.st_size, transport->filter_mgr->io_depth)) == NULL) {
+    close(fd);
+  }
+
+  // it will be read through once from start to finish
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  if (STATE->pdecomp == NULL) {
+    madvise(map, st.st_size, MADV_HUGEPAGE);
+  }
+#endif
+
+  STATE->map = map;
+  STATE->map_len = st.st_size;
+  return 0;
+}
+
+static const uint8_t *
+bs_transport_file_get_contents(bgpstream_transport_t *transport, size_t *len)
+{
+  if (STATE->pdecomp != NULL) {
+    // the mapping is compressed
+    *len = 0;
+    return NULL;
+  }
+  *len = STATE->map_len;
+  return STATE->map;
+}
 
 int bs_transport_file_create(bgpstream_transport_t *transport)
 {
-  io_t *fh = NULL;
+  const char *path = transport->res->url;
+  char *dl_path = NULL;
+  int ret = 0;
 
   BS_TRANSPORT_SET_METHODS(file, transport);
+  transport->get_contents = bs_transport_file_get_contents;
 
-  if ((fh = wandio_create(transport->res->url)) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
-                  transport->res->url);
+  if ((transport->state = malloc_zero(sizeof(state_t))) == NULL) {
     return -1;
   }
 
-  transport->state = fh;
+  // download a large remote file over several connections, and then read the
+  // local copy (which goes away once it has been opened)
+  if (transport->filter_mgr != NULL && transport->filter_mgr->http_streams > 1 &&
+      bgpstream_prange_fetch(transport->res->url,
+                             transport->filter_mgr->http_streams,
+                             &dl_path) == 0) {
+    path = dl_path;
+  }
 
-  return 0;
+  if (map_file(transport, path) == 0) {
+    goto done;
+  }
+
+  if ((STATE->fh = wandio_create(path)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
+                  transport->res->url);
+    free(transport->state);
+    transport->state = NULL;
+    ret = -1;
+  }
+
+done:
+  if (dl_path != NULL) {
+    unlink(dl_path);
+    free(dl_path);
+  }
+  return ret;
 }
 
 int64_t bs_transport_file_read(bgpstream_transport_t *transport,
                                uint8_t *buffer, int64_t len)
 {
-  return wandio_read((io_t *)transport->state, buffer, len);
+  if (STATE->pdecomp != NULL) {
+    return bgpstream_pdecomp_read(STATE->pdecomp, buffer, len);
+  }
+  if (STATE->map != NULL) {
+    if ((uint64_t)len > STATE->map_len - STATE->map_offset) {
+      len = STATE->map_len - STATE->map_offset;
+    }
+    memcpy(buffer, STATE->map + STATE->map_offset, len);
+    STATE->map_offset += len;
+    return len;
+  }
+  return wandio_read(STATE->fh, buffer, len);
 }
 
 int64_t bs_transport_file_readline(bgpstream_transport_t *transport,
                                    uint8_t *buffer, int64_t len)
 {
-  return wandio_fgets((io_t *)transport->state, buffer, len, 1);
+  if (STATE->fh == NULL) {
+    // only MRT and BMP files are mapped, and they are not line-based
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Cannot read lines from %s",
+                  transport->res->url);
+    return -1;
+  }
+  return wandio_fgets(STATE->fh, buffer, len, 1);
+}
+
+int bs_transport_file_get_fd(bgpstream_transport_t *transport)
+{
+  // wandio does not expose a pollable descriptor
+  return -1;
 }
 
 void bs_transport_file_destroy(bgpstream_transport_t *transport)
 {
-  if (transport->state != NULL) {
-    wandio_destroy((io_t *)transport->state);
-    transport->state = NULL;
+  if (transport->state == NULL) {
+    return;
+  }
+  if (STATE->fh != NULL) {
+    wandio_destroy(STATE->fh);
+    STATE->fh = NULL;
+  }
+  // stop the decompression threads before the mapping goes away
+  bgpstream_pdecomp_destroy(STATE->pdecomp);
+  STATE->pdecomp = NULL;
+  bgpstream_readahead_stop(STATE->readahead);
+  STATE->readahead = NULL;
+  if (STATE->map != NULL) {
+    munmap(STATE->map, STATE->map_len);
+    STATE->map = NULL;
   }
+  free(transport->state);
+  transport->state = NULL;
 }
@@ -26,6 +26,7 @@
 
 #include "bs_transport_http.h"
 #include "bgpstream_transport_interface.h"
+#include "bgpstream_http.h"
 #include "bgpstream_log.h"
 #include "wandio.h"
 #include "config.h"
@@ -37,20 +38,22 @@ static char http_user_agent_hdr[] = "User-Agent: libbgpstream/"PACKAGE_VERSION;
 
 int bs_transport_http_create(bgpstream_transport_t *transport)
 {
-  io_t *fh = NULL;
+  bgpstream_http_t *http = NULL;
   char *http_hdr = http_user_agent_hdr;
 
   BS_TRANSPORT_SET_METHODS(http, transport);
 
   assert(strncmp(transport->res->url, "http", 4) == 0);
 
-  if ((fh = http_open_hdrs(transport->res->url, &http_hdr, 1)) == NULL) {
+  // requests share (keep-alive) connections with other resources and with the
+  // broker
+  if ((http = bgpstream_http_open(transport->res->url, &http_hdr, 1)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
                   transport->res->url);
     return -1;
   }
 
-  transport->state = fh;
+  transport->state = http;
 
   return 0;
 }
@@ -58,19 +61,26 @@ int bs_transport_http_create(bgpstream_transport_t *transport)
 int64_t bs_transport_http_read(bgpstream_transport_t *transport,
                                uint8_t *buffer, int64_t len)
 {
-  return wandio_read((io_t *)transport->state, buffer, len);
+  return bgpstream_http_read((bgpstream_http_t *)transport->state, buffer, len);
 }
 
 int64_t bs_transport_http_readline(bgpstream_transport_t *transport,
                                    uint8_t *buffer, int64_t len)
 {
-  return wandio_fgets((io_t *)transport->state, buffer, len, 1);
+  return wandio_generic_fgets(transport, buffer, len, 1,
+                              (read_cb_t *)bs_transport_http_read);
+}
+
+int bs_transport_http_get_fd(bgpstream_transport_t *transport)
+{
+  // wandio does not expose a pollable descriptor
+  return -1;
 }
 
 void bs_transport_http_destroy(bgpstream_transport_t *transport)
 {
   if (transport->state != NULL) {
-    wandio_destroy((io_t *)transport->state);
+    bgpstream_http_close((bgpstream_http_t *)transport->state);
     transport->state = NULL;
   }
 }
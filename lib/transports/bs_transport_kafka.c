@@ -27,16 +27,32 @@
 #include "bs_transport_kafka.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <librdkafka/rdkafka.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define STATE ((state_t *)(transport->state))
 
 #define POLL_TIMEOUT_MSEC 0
 
+/* How often the consumption of each partition is reported to the stats */
+#define STATS_INTERVAL_MSEC 1000
+
+/* Consumption of a partition since it was last reported */
+typedef struct part_stats {
+  char topic[BGPSTREAM_KAFKA_TOPIC_LEN];
+  int32_t partition;
+  // offset of the last message consumed
+  int64_t offset;
+  uint64_t msgs;
+  uint64_t bytes;
+} part_stats_t;
+
 typedef struct state {
 
   // convenience local copies of attrs
@@ -44,6 +60,17 @@ typedef struct state {
   char *group;
   char *offset;
 
+  // maximum number of messages to consume at once
+  int batch_size;
+
+  // batch of consumed messages, and the index of the next one to read
+  rd_kafka_message_t **batch;
+  ssize_t batch_cnt;
+  ssize_t batch_idx;
+
+  // message whose payload is currently lent to the caller (if any)
+  rd_kafka_message_t *lent;
+
   // rdkafka instance
   rd_kafka_t *rk;
 
@@ -56,11 +83,25 @@ typedef struct state {
   // has a fatal error occured?
   int fatal_error;
 
+  // consumer queue, and the pipe that rdkafka writes to when a message is
+  // added to it while it is empty
+  rd_kafka_queue_t *queue;
+  int event_fds[2];
+
+  // consumption of the partitions read from, and when it was last reported
+  part_stats_t *parts;
+  int parts_cnt;
+  int parts_alloc_cnt;
+  int parts_last;
+  uint64_t parts_msgs;
+  uint64_t parts_reported;
+
 } state_t;
 
 static int parse_attrs(bgpstream_transport_t *transport)
 {
   char buf[1024];
+  const char *attr;
   uint64_t ts;
 
   // Topic Name (required)
@@ -111,10 +152,21 @@ static int parse_attrs(bgpstream_transport_t *transport)
     }
   }
 
+  // Batch size (optional)
+  STATE->batch_size = BGPSTREAM_TRANSPORT_KAFKA_DEFAULT_BATCH_SIZE;
+  if ((attr = bgpstream_resource_get_attr(
+         transport->res, BGPSTREAM_RESOURCE_ATTR_KAFKA_BATCH_SIZE)) != NULL &&
+      (STATE->batch_size = strtol(attr, NULL, 10)) <= 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid Kafka batch size '%s'", attr);
+    return -1;
+  }
+
   bgpstream_log(
     BGPSTREAM_LOG_FINE,
-    "Kafka transport: brokers: '%s', topic: '%s', group: '%s', offset: %s",
-    transport->res->url, STATE->topic, STATE->group, STATE->offset);
+    "Kafka transport: brokers: '%s', topic: '%s', group: '%s', offset: %s, "
+    "batch size: %d",
+    transport->res->url, STATE->topic, STATE->group, STATE->offset,
+    STATE->batch_size);
   return 0;
 }
 
@@ -147,7 +199,17 @@ static void kafka_error_callback(rd_kafka_t *rk, int err, const char *reason,
 static int init_kafka_config(bgpstream_transport_t *transport,
                              rd_kafka_conf_t *conf)
 {
+  static const struct {
+    bgpstream_resource_attr_type_t attr;
+    const char *name;
+  } size_confs[] = {
+    {BGPSTREAM_RESOURCE_ATTR_KAFKA_FETCH_MAX_BYTES, "fetch.message.max.bytes"},
+    {BGPSTREAM_RESOURCE_ATTR_KAFKA_QUEUE_MAX_KBYTES,
+     "queued.max.messages.kbytes"},
+  };
   char errstr[512];
+  const char *value;
+  unsigned i;
 
   // Set the opaque pointer that will be passed to callbacks
   rd_kafka_conf_set_opaque(conf, transport);
@@ -178,6 +240,17 @@ static int init_kafka_config(bgpstream_transport_t *transport,
     return -1;
   }
 
+  // Configure the fetch and local queue sizes, if set
+  for (i = 0; i < ARR_CNT(size_confs); i++) {
+    if ((value = bgpstream_resource_get_attr(transport->res,
+                                             size_confs[i].attr)) != NULL &&
+        rd_kafka_conf_set(conf, size_confs[i].name, value, errstr,
+                          sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Config Error: %s", errstr);
+      return -1;
+    }
+  }
+
   return 0;
 }
 
@@ -223,10 +296,12 @@ int bs_transport_kafka_create(bgpstream_transport_t *transport)
   char errstr[512];
 
   BS_TRANSPORT_SET_METHODS(kafka, transport);
+  transport->read_lent = bs_transport_kafka_read_lent;
 
   if ((transport->state = malloc_zero(sizeof(state_t))) == NULL) {
     return -1;
   }
+  STATE->event_fds[0] = STATE->event_fds[1] = -1;
 
   if (parse_attrs(transport) != 0) {
     return -1;
@@ -271,6 +346,24 @@ int bs_transport_kafka_create(bgpstream_transport_t *transport)
   // switch to consumer poll mode
   rd_kafka_poll_set_consumer(STATE->rk);
 
+  // ask rdkafka to poke a pipe when messages arrive so that the reader can
+  // sleep on it rather than polling (not fatal if this fails)
+  if ((STATE->queue = rd_kafka_queue_get_consumer(STATE->rk)) != NULL &&
+      pipe(STATE->event_fds) == 0) {
+    fcntl(STATE->event_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(STATE->event_fds[1], F_SETFL, O_NONBLOCK);
+    rd_kafka_queue_io_event_enable(STATE->queue, STATE->event_fds[1], "1", 1);
+  } else {
+    STATE->event_fds[0] = STATE->event_fds[1] = -1;
+  }
+
+  // consume messages from the queue in batches, rather than one per read
+  if (STATE->queue != NULL && STATE->batch_size > 1 &&
+      (STATE->batch = malloc(sizeof(rd_kafka_message_t *) *
+                             STATE->batch_size)) == NULL) {
+    return -1;
+  }
+
   bgpstream_log(BGPSTREAM_LOG_FINE, "Kafka connected!");
   return 0;
 }
@@ -306,19 +399,153 @@ int64_t bs_transport_kafka_readline(bgpstream_transport_t *transport,
   return rc;
 }
 
-int64_t bs_transport_kafka_read(bgpstream_transport_t *transport,
-                                uint8_t *buffer, int64_t len)
+// get the next consumed message, or NULL if there are none waiting
+static rd_kafka_message_t *next_msg(bgpstream_transport_t *transport)
 {
-  rd_kafka_message_t *rk_msg;
+  ssize_t cnt;
 
-  // see if there is a message waiting for us
   // POLL_TIMEOUT_MSEC is set very low (0) since the transport should be
   // non-blocking
-  if ((rk_msg = rd_kafka_consumer_poll(STATE->rk, POLL_TIMEOUT_MSEC)) == NULL) {
-    return 0;
+  if (STATE->batch == NULL) {
+    return rd_kafka_consumer_poll(STATE->rk, POLL_TIMEOUT_MSEC);
+  }
+
+  if (STATE->batch_idx == STATE->batch_cnt) {
+    // the batch has been read; take whatever is waiting in the queue
+    if ((cnt = rd_kafka_consume_batch_queue(STATE->queue, POLL_TIMEOUT_MSEC,
+                                            STATE->batch,
+                                            STATE->batch_size)) <= 0) {
+      STATE->batch_idx = STATE->batch_cnt = 0;
+      return NULL;
+    }
+    STATE->batch_cnt = cnt;
+    STATE->batch_idx = 0;
+  }
+  return STATE->batch[STATE->batch_idx++];
+}
+
+static void count_msg(bgpstream_transport_t *transport,
+                      const rd_kafka_message_t *rk_msg)
+{
+  const char *topic = rd_kafka_topic_name(rk_msg->rkt);
+  part_stats_t *p = NULL;
+  int i;
+
+  // messages mostly come in runs from the same partition
+  if (STATE->parts_last < STATE->parts_cnt) {
+    p = &STATE->parts[STATE->parts_last];
+    if (p->partition != rk_msg->partition ||
+        strncmp(p->topic, topic, sizeof(p->topic) - 1) != 0) {
+      p = NULL;
+    }
+  }
+  for (i = 0; p == NULL && i < STATE->parts_cnt; i++) {
+    if (STATE->parts[i].partition == rk_msg->partition &&
+        strncmp(STATE->parts[i].topic, topic,
+                sizeof(STATE->parts[i].topic) - 1) == 0) {
+      p = &STATE->parts[i];
+      STATE->parts_last = i;
+    }
+  }
+  if (p == NULL) {
+    if (STATE->parts_cnt == STATE->parts_alloc_cnt) {
+      int new_cnt = STATE->parts_alloc_cnt ? STATE->parts_alloc_cnt * 2 : 8;
+      if ((p = realloc(STATE->parts, sizeof(part_stats_t) * new_cnt)) ==
+          NULL) {
+        return; // the stats are not worth failing for
+      }
+      STATE->parts = p;
+      STATE->parts_alloc_cnt = new_cnt;
+    }
+    STATE->parts_last = STATE->parts_cnt;
+    p = &STATE->parts[STATE->parts_cnt++];
+    memset(p, 0, sizeof(*p));
+    strncpy(p->topic, topic, sizeof(p->topic) - 1);
+    p->partition = rk_msg->partition;
+  }
+  p->offset = rk_msg->offset;
+  p->msgs++;
+  p->bytes += rk_msg->len;
+}
+
+// report the consumption of each partition, along with its lag behind the
+// high watermark that librdkafka last fetched
+static void report_parts(bgpstream_transport_t *transport, int force)
+{
+  uint64_t now = epoch_msec();
+  part_stats_t *p;
+  int64_t low, high, lag;
+  int i;
+
+  if (!force && now - STATE->parts_reported < STATS_INTERVAL_MSEC) {
+    return;
   }
-  if (rk_msg->err != 0) {
-    return handle_err_msg(transport, rk_msg);
+  STATE->parts_reported = now;
+
+  for (i = 0; i < STATE->parts_cnt; i++) {
+    p = &STATE->parts[i];
+    lag = -1;
+    if (rd_kafka_get_watermark_offsets(STATE->rk, p->topic, p->partition,
+                                       &low, &high) ==
+          RD_KAFKA_RESP_ERR_NO_ERROR &&
+        high >= 0) {
+      lag = high - (p->offset + 1);
+      if (lag < 0) {
+        lag = 0;
+      }
+    }
+    bgpstream_stats_kafka_update(p->topic, p->partition, lag, p->msgs,
+                                 p->bytes);
+    p->msgs = 0;
+    p->bytes = 0;
+  }
+}
+
+// get the next message, releasing the one that was lent out (if any). returns
+// 1 if a message was found, 0 if there are none waiting, -1 on error
+static int take_msg(bgpstream_transport_t *transport,
+                    rd_kafka_message_t **rk_msg)
+{
+  char drain[64];
+
+  if (STATE->lent != NULL) {
+    rd_kafka_message_destroy(STATE->lent);
+    STATE->lent = NULL;
+  }
+
+  // see if there is a message waiting for us
+  if ((*rk_msg = next_msg(transport)) == NULL) {
+    report_parts(transport, 0);
+    if (STATE->event_fds[0] == -1) {
+      return 0;
+    }
+    // the queue is empty, so clear the event pipe and then check once more in
+    // case a message was added before we drained it. anything added after
+    // this will write to the pipe again.
+    while (read(STATE->event_fds[0], drain, sizeof(drain)) > 0)
+      ;
+    if ((*rk_msg = next_msg(transport)) == NULL) {
+      return 0;
+    }
+  }
+  if ((*rk_msg)->err != 0) {
+    return handle_err_msg(transport, *rk_msg);
+  }
+  count_msg(transport, *rk_msg);
+  if ((++STATE->parts_msgs & 0xff) == 0) {
+    report_parts(transport, 0);
+  }
+  return 1;
+}
+
+int64_t bs_transport_kafka_read(bgpstream_transport_t *transport,
+                                uint8_t *buffer, int64_t len)
+{
+  rd_kafka_message_t *rk_msg;
+  int rc;
+
+  if ((rc = take_msg(transport, &rk_msg)) <= 0) {
+    return rc;
   }
 
   // is the message too long?
@@ -336,6 +563,27 @@ int64_t bs_transport_kafka_read(bgpstream_transport_t *transport,
   return len;
 }
 
+int64_t bs_transport_kafka_read_lent(bgpstream_transport_t *transport,
+                                     const uint8_t **buffer)
+{
+  rd_kafka_message_t *rk_msg;
+  int rc;
+
+  if ((rc = take_msg(transport, &rk_msg)) <= 0) {
+    return rc;
+  }
+
+  // hold on to the message until the caller asks for the next one
+  STATE->lent = rk_msg;
+  *buffer = rk_msg->payload;
+  return rk_msg->len;
+}
+
+int bs_transport_kafka_get_fd(bgpstream_transport_t *transport)
+{
+  return STATE->event_fds[0];
+}
+
 void bs_transport_kafka_destroy(bgpstream_transport_t *transport)
 {
   rd_kafka_resp_err_t err;
@@ -344,13 +592,32 @@ void bs_transport_kafka_destroy(bgpstream_transport_t *transport)
     return;
   }
 
+  if (STATE->lent != NULL) {
+    rd_kafka_message_destroy(STATE->lent);
+    STATE->lent = NULL;
+  }
+
+  // release any messages of the last batch that were not read
+  while (STATE->batch_idx < STATE->batch_cnt) {
+    rd_kafka_message_destroy(STATE->batch[STATE->batch_idx++]);
+  }
+  free(STATE->batch);
+  STATE->batch = NULL;
+
   if (STATE->rk != NULL) {
+    report_parts(transport, 1);
+
     // shut down consumer
     if ((err = rd_kafka_consumer_close(STATE->rk)) != 0) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Could not shut down consumer: %s",
                     rd_kafka_err2str(err));
     }
 
+    if (STATE->queue != NULL) {
+      rd_kafka_queue_destroy(STATE->queue);
+      STATE->queue = NULL;
+    }
+
     // destroy topics list
     rd_kafka_topic_partition_list_destroy(STATE->topics);
 
@@ -359,6 +626,12 @@ void bs_transport_kafka_destroy(bgpstream_transport_t *transport)
     STATE->rk = NULL;
   }
 
+  if (STATE->event_fds[0] != -1) {
+    close(STATE->event_fds[0]);
+    close(STATE->event_fds[1]);
+  }
+
+  free(STATE->parts);
   free(STATE->topic);
   free(STATE->group);
   free(STATE->offset);
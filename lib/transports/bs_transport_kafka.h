@@ -31,6 +31,11 @@
 
 BS_TRANSPORT_GENERATE_PROTOS(kafka)
 
+int64_t bs_transport_kafka_read_lent(bgpstream_transport_t *transport,
+                                     const uint8_t **buffer);
+
 #define BGPSTREAM_TRANSPORT_KAFKA_DEFAULT_OFFSET "latest"
 
+#define BGPSTREAM_TRANSPORT_KAFKA_DEFAULT_BATCH_SIZE 1000
+
 #endif /* __BS_TRANSPORT_KAFKA_H */
@@ -0,0 +1,1008 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_transport_websocket.h"
+#include "bgpstream_filter.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#if defined(HAVE_LIBCURL) && defined(HAVE_CURL_CURL_H)
+#define WITH_WEBSOCKET
+#include <curl/curl.h>
+#endif
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#define WITH_WEBSOCKET_DEFLATE
+#include <zlib.h>
+#endif
+
+#define STATE ((ws_state_t *)(transport->state))
+
+#ifdef WITH_WEBSOCKET
+
+// how long (in seconds) to wait for the connection and the handshake
+#define CONNECT_TIMEOUT 10
+
+// how long (in msec) to wait for a message to be sent
+#define SEND_TIMEOUT 5000
+
+// how long (in msec) to wait before reconnecting after the connection drops.
+// the delay doubles after every failed attempt, up to RETRY_MAX
+#define RETRY_MIN 1000
+#define RETRY_MAX 60000
+
+// how much to read from the connection at once
+#define READ_CHUNK_LEN 65536
+
+// messages (compressed or not) longer than this are a protocol error
+#define MAX_MSG_LEN (16 * 1024 * 1024)
+
+// maximum length of the handshake response headers
+#define MAX_HANDSHAKE_LEN 16384
+
+// maximum number of subscriptions to send. if the filters need more, the
+// prefixes (or the collectors) are not sent upstream and are only applied
+// locally
+#define MAX_SUBSCRIPTIONS 64
+
+// websocket opcodes
+#define OP_CONT 0x0
+#define OP_TEXT 0x1
+#define OP_BINARY 0x2
+#define OP_CLOSE 0x8
+#define OP_PING 0x9
+#define OP_PONG 0xA
+
+// https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/User-Agent
+#define USER_AGENT "libbgpstream/" PACKAGE_VERSION
+
+// compression is only offered if we can decompress
+#ifdef WITH_WEBSOCKET_DEFLATE
+#define HANDSHAKE_EXT "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+#else
+#define HANDSHAKE_EXT ""
+#endif
+
+// the opening handshake (path, host and key)
+#define HANDSHAKE_FMT                                                          \
+  "GET %s HTTP/1.1\r\n"                                                        \
+  "Host: %s\r\n"                                                               \
+  "User-Agent: " USER_AGENT "\r\n"                                             \
+  "Upgrade: websocket\r\n"                                                     \
+  "Connection: Upgrade\r\n"                                                    \
+  "Sec-WebSocket-Key: %s\r\n"                                                  \
+  "Sec-WebSocket-Version: 13\r\n" HANDSHAKE_EXT "\r\n"
+
+typedef struct ws_state {
+
+  // the URL that curl connects to (the websocket URL with its http(s) scheme),
+  // and the host and path to request in the handshake
+  char *conn_url;
+  char *host;
+  char *path;
+
+  // the connection (NULL while disconnected), and its socket
+  CURL *curl;
+  curl_socket_t fd;
+
+  // when (in msec) to next try to connect while disconnected, and the delay
+  // before the attempt after that
+  uint64_t retry_at;
+  uint64_t retry_delay;
+
+  // bytes read from the connection, of which the first in_start have already
+  // been parsed
+  uint8_t *in;
+  size_t in_start;
+  size_t in_len;
+  size_t in_alloc;
+
+  // the payload of the (possibly fragmented) message being received
+  uint8_t *msg;
+  size_t msg_len;
+  size_t msg_alloc;
+  int msg_active;
+  int msg_deflated;
+
+  // was permessage-deflate negotiated, and does the server reset its
+  // compression context after each message?
+  int deflate;
+  int deflate_reset;
+
+#ifdef WITH_WEBSOCKET_DEFLATE
+  z_stream zs;
+  int zs_init;
+
+  // the decompressed message
+  uint8_t *out;
+  size_t out_len;
+  size_t out_alloc;
+#endif
+
+  // state for generating masks and keys
+  uint32_t rand;
+
+} ws_state_t;
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void init_curl(void)
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+// masks only need to be unpredictable to the network, not secret
+static uint32_t ws_rand(ws_state_t *ws)
+{
+  uint32_t r = ws->rand;
+
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  ws->rand = r;
+  return r;
+}
+
+static void base64_encode(const uint8_t *in, size_t len, char *out)
+{
+  static const char tbl[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint32_t v;
+  size_t i;
+
+  for (i = 0; i + 2 < len; i += 3) {
+    v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    *out++ = tbl[(v >> 18) & 0x3f];
+    *out++ = tbl[(v >> 12) & 0x3f];
+    *out++ = tbl[(v >> 6) & 0x3f];
+    *out++ = tbl[v & 0x3f];
+  }
+  if (i < len) {
+    v = in[i] << 16;
+    if (i + 1 < len) {
+      v |= in[i + 1] << 8;
+    }
+    *out++ = tbl[(v >> 18) & 0x3f];
+    *out++ = tbl[(v >> 12) & 0x3f];
+    *out++ = (i + 1 < len) ? tbl[(v >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+  *out = '\0';
+}
+
+// split a ws:// or wss:// URL into the URL to connect to, the host and the
+// path
+static int parse_url(ws_state_t *ws, const char *url)
+{
+  const char *rest, *slash;
+  const char *scheme;
+
+  if (strncmp(url, "wss://", 6) == 0) {
+    scheme = "https://";
+    rest = url + 6;
+  } else if (strncmp(url, "ws://", 5) == 0) {
+    scheme = "http://";
+    rest = url + 5;
+  } else {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid websocket URL: %s", url);
+    return -1;
+  }
+
+  if ((slash = strchr(rest, '/')) == NULL) {
+    slash = rest + strlen(rest);
+  }
+  if (slash == rest) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid websocket URL: %s", url);
+    return -1;
+  }
+
+  if ((ws->conn_url = malloc(strlen(scheme) + strlen(rest) + 1)) == NULL ||
+      (ws->host = strndup(rest, slash - rest)) == NULL ||
+      (ws->path = strdup(*slash == '\0' ? "/" : slash)) == NULL) {
+    return -1;
+  }
+  strcpy(ws->conn_url, scheme);
+  strcat(ws->conn_url, rest);
+
+  return 0;
+}
+
+// wait for the connection to become readable (or writable), for at most the
+// given number of msec
+static int ws_wait(ws_state_t *ws, short events, int timeout)
+{
+  struct pollfd pfd;
+  int rc;
+
+  pfd.fd = ws->fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  if ((rc = poll(&pfd, 1, timeout)) < 0) {
+    return -1;
+  }
+  return rc;
+}
+
+static int ws_send_all(ws_state_t *ws, const uint8_t *buf, size_t len)
+{
+  size_t sent;
+  CURLcode rc;
+
+  while (len > 0) {
+    rc = curl_easy_send(ws->curl, buf, len, &sent);
+    if (rc == CURLE_AGAIN) {
+      if (ws_wait(ws, POLLOUT, SEND_TIMEOUT) <= 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (rc != CURLE_OK) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket send failed: %s",
+                    curl_easy_strerror(rc));
+      return -1;
+    }
+    buf += sent;
+    len -= sent;
+  }
+
+  return 0;
+}
+
+// send a (masked, unfragmented) frame
+static int ws_send_frame(ws_state_t *ws, int opcode, const uint8_t *payload,
+                         size_t len)
+{
+  uint8_t *frame;
+  size_t hdr_len = 2;
+  uint32_t mask = ws_rand(ws);
+  size_t i;
+  int rc;
+
+  if ((frame = malloc(14 + len)) == NULL) {
+    return -1;
+  }
+  frame[0] = 0x80 | opcode;
+  if (len < 126) {
+    frame[1] = 0x80 | len;
+  } else if (len <= UINT16_MAX) {
+    frame[1] = 0x80 | 126;
+    frame[2] = len >> 8;
+    frame[3] = len & 0xff;
+    hdr_len = 4;
+  } else {
+    frame[1] = 0x80 | 127;
+    for (i = 0; i < 8; i++) {
+      frame[2 + i] = ((uint64_t)len >> (56 - 8 * i)) & 0xff;
+    }
+    hdr_len = 10;
+  }
+  memcpy(&frame[hdr_len], &mask, 4);
+  for (i = 0; i < len; i++) {
+    frame[hdr_len + 4 + i] = payload[i] ^ frame[hdr_len + (i & 3)];
+  }
+
+  rc = ws_send_all(ws, frame, hdr_len + 4 + len);
+  free(frame);
+  return rc;
+}
+
+// read whatever is available from the connection. returns the number of bytes
+// read, 0 if there is nothing to read, or -1 if the connection was closed
+static int64_t ws_recv(ws_state_t *ws)
+{
+  uint8_t *tmp;
+  size_t got;
+  CURLcode rc;
+
+  // drop what has been parsed already
+  if (ws->in_start > 0) {
+    memmove(ws->in, ws->in + ws->in_start, ws->in_len - ws->in_start);
+    ws->in_len -= ws->in_start;
+    ws->in_start = 0;
+  }
+  if (ws->in_alloc - ws->in_len < READ_CHUNK_LEN) {
+    if ((tmp = realloc(ws->in, ws->in_len + READ_CHUNK_LEN)) == NULL) {
+      return -1;
+    }
+    ws->in = tmp;
+    ws->in_alloc = ws->in_len + READ_CHUNK_LEN;
+  }
+
+  rc = curl_easy_recv(ws->curl, ws->in + ws->in_len,
+                      ws->in_alloc - ws->in_len, &got);
+  if (rc == CURLE_AGAIN) {
+    return 0;
+  }
+  if (rc != CURLE_OK || got == 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Websocket connection to %s lost%s%s",
+                  ws->host, rc != CURLE_OK ? ": " : "",
+                  rc != CURLE_OK ? curl_easy_strerror(rc) : "");
+    return -1;
+  }
+  ws->in_len += got;
+  return got;
+}
+
+// find a header in the handshake response and return its value
+static const char *find_header(const char *hdrs, const char *name)
+{
+  const char *line = hdrs;
+  size_t name_len = strlen(name);
+
+  while ((line = strstr(line, "\r\n")) != NULL) {
+    line += 2;
+    if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      return line + name_len + 1;
+    }
+  }
+  return NULL;
+}
+
+static int ws_handshake(ws_state_t *ws)
+{
+  uint8_t key[16];
+  char key_b64[32];
+  char *req = NULL;
+  char *end;
+  const char *ext;
+  uint64_t deadline = epoch_msec() + CONNECT_TIMEOUT * 1000;
+  uint64_t now;
+  int64_t got;
+  int i, len;
+
+  for (i = 0; i < 16; i += 4) {
+    uint32_t r = ws_rand(ws);
+    memcpy(&key[i], &r, 4);
+  }
+  base64_encode(key, sizeof(key), key_b64);
+
+  len = snprintf(NULL, 0, HANDSHAKE_FMT, ws->path, ws->host, key_b64);
+  if ((req = malloc(len + 1)) == NULL) {
+    return -1;
+  }
+  snprintf(req, len + 1, HANDSHAKE_FMT, ws->path, ws->host, key_b64);
+  if (ws_send_all(ws, (uint8_t *)req, len) != 0) {
+    free(req);
+    return -1;
+  }
+  free(req);
+
+  // read the response headers. anything after them is already websocket data
+  // and is left in the input buffer
+  for (;;) {
+    if (ws->in_len > 0 && ws->in_len < ws->in_alloc) {
+      ws->in[ws->in_len] = '\0';
+      if ((end = strstr((char *)ws->in, "\r\n\r\n")) != NULL) {
+        break;
+      }
+    }
+    if (ws->in_len > MAX_HANDSHAKE_LEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket handshake response too long");
+      return -1;
+    }
+    if ((got = ws_recv(ws)) < 0) {
+      return -1;
+    }
+    if (got == 0) {
+      now = epoch_msec();
+      if (now >= deadline || ws_wait(ws, POLLIN, deadline - now) <= 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket handshake timed out");
+        return -1;
+      }
+    }
+  }
+  end[2] = '\0';
+
+  if (strncmp((char *)ws->in, "HTTP/1.1 101", 12) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket handshake refused: %.*s",
+                  (int)strcspn((char *)ws->in, "\r\n"), (char *)ws->in);
+    return -1;
+  }
+
+  // the connection is secured by TLS (or not at all), so the accept key is
+  // not checked
+  ws->deflate = 0;
+  ws->deflate_reset = 0;
+  if ((ext = find_header((char *)ws->in, "Sec-WebSocket-Extensions")) !=
+        NULL &&
+      strstr(ext, "permessage-deflate") != NULL) {
+    ws->deflate = 1;
+    ws->deflate_reset = strstr(ext, "server_no_context_takeover") != NULL;
+  }
+
+  ws->in_start = (end + 4) - (char *)ws->in;
+  return 0;
+}
+
+/* ---------- RIS Live subscriptions ---------- */
+
+struct sub_pfxs {
+  bgpstream_pfx_t pfxs[MAX_SUBSCRIPTIONS + 1];
+  int cnt;
+};
+
+static bgpstream_patricia_walk_cb_result_t
+collect_pfx(const bgpstream_patricia_tree_t *pt,
+            const bgpstream_patricia_node_t *node, void *data)
+{
+  struct sub_pfxs *sp = (struct sub_pfxs *)data;
+
+  sp->pfxs[sp->cnt++] = *bgpstream_patricia_tree_get_pfx(node);
+  return sp->cnt > MAX_SUBSCRIPTIONS ? BGPSTREAM_PATRICIA_WALK_END_ALL
+                                     : BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static int ws_subscribe_one(ws_state_t *ws, const char *host,
+                            const bgpstream_pfx_t *pfx, int updates_only)
+{
+  char buf[1024];
+  char pfx_str[INET6_ADDRSTRLEN + 4];
+  int more = 1, less = 0;
+  int len = 0;
+
+  len += snprintf(buf + len, sizeof(buf) - len,
+                  "{\"type\":\"ris_subscribe\",\"data\":{");
+  if (host != NULL) {
+    len += snprintf(buf + len, sizeof(buf) - len, "\"host\":\"%s\",", host);
+  }
+  if (pfx != NULL) {
+    switch (pfx->allowed_matches) {
+    case BGPSTREAM_PREFIX_MATCH_EXACT:
+      more = 0;
+      break;
+    case BGPSTREAM_PREFIX_MATCH_LESS:
+      more = 0;
+      less = 1;
+      break;
+    case BGPSTREAM_PREFIX_MATCH_ANY:
+      less = 1;
+      break;
+    default:
+      break;
+    }
+    bgpstream_pfx_snprintf(pfx_str, sizeof(pfx_str), pfx);
+    len += snprintf(buf + len, sizeof(buf) - len,
+                    "\"prefix\":\"%s\",\"moreSpecific\":%s,"
+                    "\"lessSpecific\":%s,",
+                    pfx_str, more ? "true" : "false", less ? "true" : "false");
+  }
+  if (updates_only != 0) {
+    len += snprintf(buf + len, sizeof(buf) - len, "\"type\":\"UPDATE\",");
+  }
+  len += snprintf(buf + len, sizeof(buf) - len,
+                  "\"socketOptions\":{\"includeRaw\":true}}}");
+  if (len >= (int)sizeof(buf)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket subscription too long");
+    return -1;
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_FINE, "Websocket subscription: %s", buf);
+  return ws_send_frame(ws, OP_TEXT, (uint8_t *)buf, len);
+}
+
+// subscribe to the messages that may pass the filters. the subscriptions only
+// need to be a superset of what the filters accept, since the format still
+// applies the filters itself. RIS Live takes one collector and one prefix per
+// subscription, so each combination is sent (unless there are too many).
+// peers are identified by address rather than ASN, so the peer ASN filter is
+// not sent.
+static int ws_subscribe(bgpstream_transport_t *transport)
+{
+  bgpstream_filter_mgr_t *fm = transport->filter_mgr;
+  struct sub_pfxs *sp = NULL;
+  char *hosts[MAX_SUBSCRIPTIONS];
+  char *host;
+  int hosts_cnt = 0;
+  int updates_only = 0;
+  int i, j;
+  int rc = -1;
+
+  if ((sp = malloc_zero(sizeof(struct sub_pfxs))) == NULL) {
+    return -1;
+  }
+
+  if (fm->collectors != NULL &&
+      bgpstream_str_set_size(fm->collectors) <= MAX_SUBSCRIPTIONS) {
+    bgpstream_str_set_rewind(fm->collectors);
+    while ((host = bgpstream_str_set_next(fm->collectors)) != NULL) {
+      hosts[hosts_cnt++] = host;
+    }
+  }
+  if (fm->prefixes != NULL) {
+    bgpstream_patricia_tree_walk(fm->prefixes, collect_pfx, sp);
+    if (sp->cnt > MAX_SUBSCRIPTIONS) {
+      sp->cnt = 0;
+    }
+  }
+  // too many combinations: keep whichever list is longer upstream
+  if (hosts_cnt > 0 && sp->cnt > 0 &&
+      hosts_cnt * sp->cnt > MAX_SUBSCRIPTIONS) {
+    if (sp->cnt >= hosts_cnt) {
+      hosts_cnt = 0;
+    } else {
+      sp->cnt = 0;
+    }
+  }
+  if (fm->elemtype_mask != 0 &&
+      (fm->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE) == 0) {
+    updates_only = 1;
+  }
+
+  for (i = 0; i < (hosts_cnt > 0 ? hosts_cnt : 1); i++) {
+    for (j = 0; j < (sp->cnt > 0 ? sp->cnt : 1); j++) {
+      if (ws_subscribe_one(STATE, hosts_cnt > 0 ? hosts[i] : NULL,
+                           sp->cnt > 0 ? &sp->pfxs[j] : NULL,
+                           updates_only) != 0) {
+        goto done;
+      }
+    }
+  }
+  rc = 0;
+
+done:
+  free(sp);
+  return rc;
+}
+
+/* ---------- connection ---------- */
+
+static void ws_disconnect(ws_state_t *ws)
+{
+  if (ws->curl != NULL) {
+    curl_easy_cleanup(ws->curl);
+    ws->curl = NULL;
+  }
+  ws->fd = CURL_SOCKET_BAD;
+  ws->in_start = 0;
+  ws->in_len = 0;
+  ws->msg_len = 0;
+  ws->msg_active = 0;
+#ifdef WITH_WEBSOCKET_DEFLATE
+  if (ws->zs_init != 0) {
+    inflateEnd(&ws->zs);
+    ws->zs_init = 0;
+  }
+#endif
+
+  // back off before connecting again
+  ws->retry_at = epoch_msec() + ws->retry_delay;
+  ws->retry_delay =
+    (ws->retry_delay * 2 > RETRY_MAX) ? RETRY_MAX : ws->retry_delay * 2;
+}
+
+static int ws_connect(bgpstream_transport_t *transport)
+{
+  ws_state_t *ws = STATE;
+  curl_socket_t fd;
+  CURLcode rc;
+
+  assert(ws->curl == NULL);
+
+  if ((ws->curl = curl_easy_init()) == NULL) {
+    return -1;
+  }
+  curl_easy_setopt(ws->curl, CURLOPT_URL, ws->conn_url);
+  curl_easy_setopt(ws->curl, CURLOPT_CONNECT_ONLY, 1L);
+  curl_easy_setopt(ws->curl, CURLOPT_CONNECTTIMEOUT, (long)CONNECT_TIMEOUT);
+  curl_easy_setopt(ws->curl, CURLOPT_NOSIGNAL, 1L);
+  if ((rc = curl_easy_perform(ws->curl)) != CURLE_OK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not connect to %s: %s",
+                  transport->res->url, curl_easy_strerror(rc));
+    return -1;
+  }
+  if (curl_easy_getinfo(ws->curl, CURLINFO_ACTIVESOCKET, &fd) != CURLE_OK ||
+      fd == CURL_SOCKET_BAD) {
+    return -1;
+  }
+  ws->fd = fd;
+
+  if (ws_handshake(ws) != 0) {
+    return -1;
+  }
+
+#ifdef WITH_WEBSOCKET_DEFLATE
+  if (ws->deflate != 0) {
+    memset(&ws->zs, 0, sizeof(ws->zs));
+    if (inflateInit2(&ws->zs, -MAX_WBITS) != Z_OK) {
+      return -1;
+    }
+    ws->zs_init = 1;
+  }
+#endif
+
+  if (transport->res->format_type == BGPSTREAM_RESOURCE_FORMAT_RISLIVE &&
+      ws_subscribe(transport) != 0) {
+    return -1;
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Connected to %s%s", transport->res->url,
+                ws->deflate != 0 ? " (compressed)" : "");
+  ws->retry_delay = RETRY_MIN;
+  return 0;
+}
+
+/* ---------- receiving ---------- */
+
+static int msg_append(ws_state_t *ws, const uint8_t *data, size_t len)
+{
+  uint8_t *tmp;
+  size_t alloc;
+
+  if (ws->msg_len + len > MAX_MSG_LEN) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket message too long");
+    return -1;
+  }
+  if (ws->msg_len + len > ws->msg_alloc) {
+    alloc = (ws->msg_alloc == 0) ? READ_CHUNK_LEN : ws->msg_alloc;
+    while (alloc < ws->msg_len + len) {
+      alloc *= 2;
+    }
+    if ((tmp = realloc(ws->msg, alloc)) == NULL) {
+      return -1;
+    }
+    ws->msg = tmp;
+    ws->msg_alloc = alloc;
+  }
+  memcpy(ws->msg + ws->msg_len, data, len);
+  ws->msg_len += len;
+  return 0;
+}
+
+// parse the next frame from the input buffer. returns 1 if a message is ready,
+// 2 if a frame was consumed but there is no message yet, 0 if more data is
+// needed, or -1 if the connection should be dropped
+static int ws_parse_frame(ws_state_t *ws)
+{
+  uint8_t *p = ws->in + ws->in_start;
+  size_t avail = ws->in_len - ws->in_start;
+  size_t hdr_len = 2;
+  uint64_t len;
+  uint8_t mask[4];
+  int fin, rsv1, opcode, masked;
+  size_t i;
+
+  if (avail < 2) {
+    return 0;
+  }
+  fin = (p[0] & 0x80) != 0;
+  rsv1 = (p[0] & 0x40) != 0;
+  opcode = p[0] & 0x0f;
+  masked = (p[1] & 0x80) != 0;
+  len = p[1] & 0x7f;
+
+  if (len == 126) {
+    if (avail < 4) {
+      return 0;
+    }
+    len = (p[2] << 8) | p[3];
+    hdr_len = 4;
+  } else if (len == 127) {
+    if (avail < 10) {
+      return 0;
+    }
+    len = 0;
+    for (i = 2; i < 10; i++) {
+      len = (len << 8) | p[i];
+    }
+    hdr_len = 10;
+  }
+  if (len > MAX_MSG_LEN) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket frame too long");
+    return -1;
+  }
+  if (masked != 0) {
+    if (avail < hdr_len + 4) {
+      return 0;
+    }
+    memcpy(mask, p + hdr_len, 4);
+    hdr_len += 4;
+  }
+  if (avail < hdr_len + len) {
+    return 0;
+  }
+  p += hdr_len;
+  ws->in_start += hdr_len + len;
+
+  // servers should not mask their frames, but it costs nothing to cope
+  if (masked != 0) {
+    for (i = 0; i < len; i++) {
+      p[i] ^= mask[i & 3];
+    }
+  }
+
+  switch (opcode) {
+  case OP_TEXT:
+  case OP_BINARY:
+    if (ws->msg_active != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Unexpected websocket frame");
+      return -1;
+    }
+    ws->msg_active = 1;
+    ws->msg_len = 0;
+    ws->msg_deflated = rsv1 && ws->deflate;
+    // fall through
+
+  case OP_CONT:
+    if (ws->msg_active == 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Unexpected websocket frame");
+      return -1;
+    }
+    if (msg_append(ws, p, len) != 0) {
+      return -1;
+    }
+    if (fin == 0) {
+      return 2;
+    }
+    ws->msg_active = 0;
+    return 1;
+
+  case OP_PING:
+    return ws_send_frame(ws, OP_PONG, p, len) == 0 ? 2 : -1;
+
+  case OP_PONG:
+    return 2;
+
+  case OP_CLOSE:
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Websocket connection to %s closed "
+                                      "by the server",
+                  ws->host);
+    return -1;
+
+  default:
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown websocket opcode %d", opcode);
+    return -1;
+  }
+}
+
+#ifdef WITH_WEBSOCKET_DEFLATE
+static int ws_inflate(ws_state_t *ws)
+{
+  static const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+  uint8_t *tmp;
+  int rc;
+
+  // the sender strips the end of the deflate block, which is put back here
+  if (msg_append(ws, tail, sizeof(tail)) != 0) {
+    return -1;
+  }
+
+  ws->out_len = 0;
+  ws->zs.next_in = ws->msg;
+  ws->zs.avail_in = ws->msg_len;
+  do {
+    if (ws->out_alloc - ws->out_len < READ_CHUNK_LEN) {
+      if (ws->out_alloc >= MAX_MSG_LEN) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Websocket message too long");
+        return -1;
+      }
+      if ((tmp = realloc(ws->out, ws->out_alloc * 2 + READ_CHUNK_LEN)) ==
+          NULL) {
+        return -1;
+      }
+      ws->out = tmp;
+      ws->out_alloc = ws->out_alloc * 2 + READ_CHUNK_LEN;
+    }
+    ws->zs.next_out = ws->out + ws->out_len;
+    ws->zs.avail_out = ws->out_alloc - ws->out_len;
+    rc = inflate(&ws->zs, Z_SYNC_FLUSH);
+    ws->out_len = ws->out_alloc - ws->zs.avail_out;
+    if (rc == Z_STREAM_END) {
+      inflateReset(&ws->zs);
+      break;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Could not decompress websocket message");
+      return -1;
+    }
+  } while (ws->zs.avail_in > 0 || ws->zs.avail_out == 0);
+
+  if (ws->deflate_reset != 0) {
+    inflateReset(&ws->zs);
+  }
+  return 0;
+}
+#endif
+
+// copy the received message into the caller's buffer. returns its length, 0
+// if it was dropped, or -1 if the connection should be dropped
+static int64_t ws_deliver(ws_state_t *ws, uint8_t *buffer, int64_t len)
+{
+  uint8_t *data = ws->msg;
+  size_t data_len = ws->msg_len;
+
+  if (ws->msg_deflated != 0) {
+#ifdef WITH_WEBSOCKET_DEFLATE
+    if (ws_inflate(ws) != 0) {
+      return -1;
+    }
+    data = ws->out;
+    data_len = ws->out_len;
+#else
+    return -1;
+#endif
+  }
+
+  if ((int64_t)data_len >= len) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Dropping %zu byte websocket message (longer than the "
+                  "%" PRId64 " byte buffer)",
+                  data_len, len);
+    return 0;
+  }
+  memcpy(buffer, data, data_len);
+  buffer[data_len] = '\0';
+  return data_len;
+}
+
+#endif /* WITH_WEBSOCKET */
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+int bs_transport_websocket_create(bgpstream_transport_t *transport)
+{
+#ifdef WITH_WEBSOCKET
+  ws_state_t *ws;
+
+  BS_TRANSPORT_SET_METHODS(websocket, transport);
+
+  pthread_once(&curl_once, init_curl);
+
+  if ((ws = malloc_zero(sizeof(ws_state_t))) == NULL) {
+    return -1;
+  }
+  transport->state = ws;
+  ws->fd = CURL_SOCKET_BAD;
+  ws->retry_delay = RETRY_MIN;
+  ws->rand = (uint32_t)epoch_msec() ^ ((uint32_t)getpid() << 16) ^
+             (uint32_t)(uintptr_t)ws;
+  if (ws->rand == 0) {
+    ws->rand = 1;
+  }
+
+  if (parse_url(ws, transport->res->url) != 0) {
+    goto err;
+  }
+
+  // the first connection must succeed, later ones are retried
+  if (ws_connect(transport) != 0) {
+    goto err;
+  }
+
+  return 0;
+
+err:
+  bs_transport_websocket_destroy(transport);
+  return -1;
+#else
+  bgpstream_log(BGPSTREAM_LOG_ERR,
+                "Could not open %s: libbgpstream was built without libcurl",
+                transport->res->url);
+  return -1;
+#endif
+}
+
+int64_t bs_transport_websocket_read(bgpstream_transport_t *transport,
+                                    uint8_t *buffer, int64_t len)
+{
+  // the stream is message based, so reads return one message at a time
+  return bs_transport_websocket_readline(transport, buffer, len);
+}
+
+int64_t bs_transport_websocket_readline(bgpstream_transport_t *transport,
+                                        uint8_t *buffer, int64_t len)
+{
+#ifdef WITH_WEBSOCKET
+  ws_state_t *ws = STATE;
+  int64_t rc;
+
+  // 0 tells the format that there is nothing to read yet
+  if (ws->curl == NULL) {
+    if (epoch_msec() < ws->retry_at) {
+      return 0;
+    }
+    bgpstream_log(BGPSTREAM_LOG_INFO, "Reconnecting to %s",
+                  transport->res->url);
+    if (ws_connect(transport) != 0) {
+      ws_disconnect(ws);
+      return 0;
+    }
+  }
+
+  for (;;) {
+    switch (ws_parse_frame(ws)) {
+    case 1:
+      if ((rc = ws_deliver(ws, buffer, len)) > 0) {
+        return rc;
+      }
+      if (rc < 0) {
+        ws_disconnect(ws);
+        return 0;
+      }
+      break;
+
+    case 2:
+      break;
+
+    case 0:
+      if ((rc = ws_recv(ws)) == 0) {
+        return 0;
+      }
+      if (rc < 0) {
+        ws_disconnect(ws);
+        return 0;
+      }
+      break;
+
+    default:
+      ws_disconnect(ws);
+      return 0;
+    }
+  }
+#else
+  return -1;
+#endif
+}
+
+int bs_transport_websocket_get_fd(bgpstream_transport_t *transport)
+{
+#ifdef WITH_WEBSOCKET
+  // while disconnected the reader falls back to polling on a timer
+  return STATE->curl != NULL ? (int)STATE->fd : -1;
+#else
+  return -1;
+#endif
+}
+
+void bs_transport_websocket_destroy(bgpstream_transport_t *transport)
+{
+#ifdef WITH_WEBSOCKET
+  ws_state_t *ws = STATE;
+
+  if (ws == NULL) {
+    return;
+  }
+  ws_disconnect(ws);
+  free(ws->conn_url);
+  free(ws->host);
+  free(ws->path);
+  free(ws->in);
+  free(ws->msg);
+#ifdef WITH_WEBSOCKET_DEFLATE
+  free(ws->out);
+#endif
+  free(ws);
+  transport->state = NULL;
+#endif
+}
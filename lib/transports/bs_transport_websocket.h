@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BS_TRANSPORT_WEBSOCKET_H
+#define __BS_TRANSPORT_WEBSOCKET_H
+
+#include "bgpstream_transport_interface.h"
+
+/** @file
+ *
+ * @brief Header file for the websocket transport.
+ *
+ * Reads the messages of a websocket stream (e.g., RIS Live at
+ * wss://ris-live.ripe.net/v1/ws/), one message per line. permessage-deflate
+ * compression is negotiated when libbgpstream is built with zlib, and for RIS
+ * Live the collector, prefix and message type filters of the stream are sent
+ * upstream as subscriptions so that only the messages that may match them are
+ * received. If the connection drops, the transport reconnects (with backoff)
+ * and subscribes again.
+ */
+
+BS_TRANSPORT_GENERATE_PROTOS(websocket)
+
+#endif /* __BS_TRANSPORT_WEBSOCKET_H */
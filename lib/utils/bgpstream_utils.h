@@ -53,10 +53,14 @@
 #include "bgpstream_utils_community.h"     /* Community utilities */
 #include "bgpstream_utils_id_set.h"        /* ID Set utilities */
 #include "bgpstream_utils_ip_counter.h"    /* IP Overlap Counter */
+#include "bgpstream_utils_lpm.h"           /* Longest-prefix match tables */
+#include "bgpstream_utils_mem.h"           /* Memory accounting */
 #include "bgpstream_utils_patricia.h"      /* Patricia Tree utilities */
+#include "bgpstream_utils_patricia_rcu.h"  /* Patricia Tree snapshots */
 #include "bgpstream_utils_peer_sig_map.h"  /* Peer Signature utilities */
 #include "bgpstream_utils_pfx.h"           /* Prefix utilities */
 #include "bgpstream_utils_pfx_set.h"       /* Prefix Set utilities */
+#include "bgpstream_utils_str_intern.h"    /* String Intern Table */
 #include "bgpstream_utils_str_set.h"       /* String Set utilities */
 #include "bgpstream_utils_time.h"          /* Time management utilities */
 
@@ -37,6 +37,7 @@
 
 #include "bgpstream_log.h"
 #include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_private.h"
 
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
  #define STATIC_ASSERT(cond, msg) _Static_assert((cond), #msg)
@@ -49,6 +50,142 @@
 STATIC_ASSERT(sizeof(khint32_t) == sizeof(uint32_t), khint32_t_is_not_32_bits);
 STATIC_ASSERT(sizeof(khint64_t) == sizeof(uint64_t), khint64_t_is_not_64_bits);
 
+int bgpstream_addr_ntop_len(char *buf, size_t len,
+                            const bgpstream_ip_addr_t *addr)
+{
+  int n;
+
+  if (addr->version == BGPSTREAM_ADDR_VERSION_IPV4 && len > BS_IPV4_STR_LEN) {
+    n = bs_ipv4_to_str(buf, (const uint8_t *)&addr->bs_ipv4.addr);
+    buf[n] = '\0';
+    return n;
+  }
+  if (addr->version == BGPSTREAM_ADDR_VERSION_IPV6 && len > BS_IPV6_STR_LEN) {
+    n = bs_ipv6_to_str(buf, addr->bs_ipv6.addr.s6_addr);
+    buf[n] = '\0';
+    return n;
+  }
+  if (bgpstream_addr_ntop(buf, len, addr) == NULL) {
+    return -1;
+  }
+  return strlen(buf);
+}
+
+int bs_str_to_ipv4(const char *str, size_t len, uint8_t *addr)
+{
+  const char *end = str + len;
+  uint8_t tmp[4];
+  uint32_t val = 0;
+  int octets = 0, digits = 0;
+
+  for (; str < end; str++) {
+    if (*str >= '0' && *str <= '9') {
+      /* no leading zeros, and at most 255 */
+      if ((digits > 0 && val == 0) ||
+          (val = val * 10 + (*str - '0')) > 255) {
+        return 0;
+      }
+      digits++;
+    } else if (*str == '.' && digits > 0 && octets < 3) {
+      tmp[octets++] = val;
+      val = 0;
+      digits = 0;
+    } else {
+      return 0;
+    }
+  }
+  if (octets != 3 || digits == 0) {
+    return 0;
+  }
+  tmp[3] = val;
+  memcpy(addr, tmp, 4);
+  return 1;
+}
+
+int bs_str_to_ipv6(const char *str, size_t len, uint8_t *addr)
+{
+  const char *end = str + len;
+  const char *tok;
+  uint8_t tmp[16];
+  int pos = 0, gap = -1, digits = 0, d;
+  uint32_t val = 0;
+  char c;
+
+  if (len == 0) {
+    return 0;
+  }
+  /* a leading colon must be the start of "::" */
+  if (*str == ':' && (++str == end || *str != ':')) {
+    return 0;
+  }
+
+  tok = str;
+  while (str < end) {
+    c = *str++;
+    if (c >= '0' && c <= '9') {
+      d = c - '0';
+    } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+      d = (c | 0x20) - 'a' + 10;
+    } else {
+      d = -1;
+    }
+    if (d >= 0) {
+      if (digits == 4) {
+        return 0;
+      }
+      val = val << 4 | d;
+      digits++;
+      continue;
+    }
+    if (c == ':') {
+      tok = str;
+      if (digits == 0) {
+        if (gap != -1) {
+          return 0;
+        }
+        gap = pos;
+        continue;
+      }
+      if (str == end || pos + 2 > 16) {
+        return 0;
+      }
+      tmp[pos++] = val >> 8;
+      tmp[pos++] = val;
+      digits = 0;
+      val = 0;
+      continue;
+    }
+    /* a trailing dotted quad */
+    if (c == '.' && pos + 4 <= 16 && bs_str_to_ipv4(tok, end - tok, &tmp[pos])) {
+      pos += 4;
+      digits = 0;
+      break;
+    }
+    return 0;
+  }
+  if (digits > 0) {
+    if (pos + 2 > 16) {
+      return 0;
+    }
+    tmp[pos++] = val >> 8;
+    tmp[pos++] = val;
+  }
+  if (gap != -1) {
+    /* expand the "::" */
+    if (pos == 16) {
+      return 0;
+    }
+    memmove(&tmp[16 - (pos - gap)], &tmp[gap], pos - gap);
+    memset(&tmp[gap], 0, 16 - pos);
+    pos = 16;
+  }
+  if (pos != 16) {
+    return 0;
+  }
+  memcpy(addr, tmp, 16);
+  return 1;
+}
+
 uint32_t
 bgpstream_ipv4_addr_hash(const bgpstream_ipv4_addr_t *addr)
 {
@@ -160,10 +297,12 @@ bgpstream_ip_addr_t *bgpstream_str2addr(const char *addr_str,
     return NULL;
   }
 
-  if (inet_pton(AF_INET, addr_str, &addr->bs_ipv4.addr) == 1) {
+  size_t len = strlen(addr_str);
+
+  if (bs_str_to_ipv4(addr_str, len, (uint8_t *)&addr->bs_ipv4.addr)) {
     addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
     return addr;
-  } else if (inet_pton(AF_INET6, addr_str, &addr->bs_ipv6.addr) == 1) {
+  } else if (bs_str_to_ipv6(addr_str, len, addr->bs_ipv6.addr.s6_addr)) {
     addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
     return addr;
   } else {
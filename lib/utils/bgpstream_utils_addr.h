@@ -147,6 +147,24 @@ typedef union union_bgpstream_ip_addr_t {
 #define bgpstream_addr_ntop(buf, len, bsaddr)                                  \
   inet_ntop((int)(bsaddr)->version, &(bsaddr)->addr, buf, (unsigned)len)
 
+/** Write the string representation of the given IP address into the given
+ * character buffer, and return its length.
+ *
+ * @param buf           pointer to a character buffer at least len bytes long
+ * @param len           length of the given character buffer
+ * @param addr          pointer to the bgpstream addr to convert to string
+ * @return the number of characters written (excluding the terminating nul) if
+ * successful.  Otherwise, returns -1 with errno set as by
+ * bgpstream_addr_ntop.
+ *
+ * The output is identical to that of bgpstream_addr_ntop (RFC 5952 form for
+ * IPv6), but addresses are formatted without calling inet_ntop when the
+ * buffer is large enough, and callers do not need to scan the buffer to find
+ * the end of the string.
+ */
+int bgpstream_addr_ntop_len(char *buf, size_t len,
+                            const bgpstream_ip_addr_t *addr);
+
 /** Hash the given IPv4 address into a 32bit number
  *
  * @param addr          pointer to the IPv4 address to hash
@@ -27,50 +27,55 @@
 #include <assert.h>
 #include <stdio.h>
 
-#include "khash.h"
 #include "utils.h"
 
 #include "bgpstream_utils_addr_set.h"
+#include "bgpstream_utils_swiss.h"
 
 /* PRIVATE */
 
-#define ADDR_HASH_VAL(arg) bgpstream_addr_hash(&(arg))
-#define ADDR_EQUAL_VAL(arg1, arg2) bgpstream_addr_equal(&(arg1), &(arg2))
+/* The sets store the raw address bits rather than whole address structures
+ * (the generic set keeps one table per version). */
 
-#define V4_HASH_VAL(arg) bgpstream_ipv4_addr_hash(&(arg))
-#define V4_EQUAL_VAL(arg1, arg2) bgpstream_ipv4_addr_equal(&(arg1), &(arg2))
+typedef uint32_t addr4_key_t;
 
-#define V6_HASH_VAL(arg) bgpstream_ipv6_addr_hash(&(arg))
-#define V6_EQUAL_VAL(arg1, arg2) bgpstream_ipv6_addr_equal(&(arg1), &(arg2))
+typedef struct addr6_key {
+  uint64_t hi;
+  uint64_t lo;
+} addr6_key_t;
+
+#define ADDR4_HASH(k) swiss_mix64(*(k))
+#define ADDR4_EQUAL(a, b) (*(a) == *(b))
+
+#define ADDR6_HASH(k) swiss_mix64((k)->hi ^ swiss_mix64((k)->lo))
+#define ADDR6_EQUAL(a, b) ((a)->lo == (b)->lo && (a)->hi == (b)->hi)
+
+SWISS_INIT(addr4, addr4_key_t, ADDR4_HASH, ADDR4_EQUAL)
+SWISS_INIT(addr6, addr6_key_t, ADDR6_HASH, ADDR6_EQUAL)
+
+static inline void addr6_key(const bgpstream_ipv6_addr_t *addr, addr6_key_t *k)
+{
+  memcpy(&k->hi, &addr->addr.s6_addr[0], sizeof(uint64_t));
+  memcpy(&k->lo, &addr->addr.s6_addr[8], sizeof(uint64_t));
+}
 
 /* GENERIC ADDR */
-KHASH_INIT(bgpstream_ip_addr_set /* name */,
-           bgpstream_ip_addr_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */, ADDR_HASH_VAL /*__hash_func */,
-           ADDR_EQUAL_VAL /* __hash_equal */)
 
 struct bgpstream_ip_addr_set {
-  khash_t(bgpstream_ip_addr_set) * hash;
+  swiss_addr4_t v4;
+  swiss_addr6_t v6;
 };
 
 /* IPv4 */
-KHASH_INIT(bgpstream_ipv4_addr_set /* name */,
-           bgpstream_ipv4_addr_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */, V4_HASH_VAL /*__hash_func */,
-           V4_EQUAL_VAL /* __hash_equal */)
 
 struct bgpstream_ipv4_addr_set {
-  khash_t(bgpstream_ipv4_addr_set) * hash;
+  swiss_addr4_t v4;
 };
 
 /* IPv6 */
-KHASH_INIT(bgpstream_ipv6_addr_set /* name */,
-           bgpstream_ipv6_addr_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */, V6_HASH_VAL /*__hash_func */,
-           V6_EQUAL_VAL /* __hash_equal */)
 
 struct bgpstream_ipv6_addr_set {
-  khash_t(bgpstream_ipv6_addr_set) * hash;
+  swiss_addr6_t v6;
 };
 
 /* PUBLIC FUNCTIONS */
@@ -86,42 +91,49 @@ bgpstream_ip_addr_set_t *bgpstream_ip_addr_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_ip_addr_set)) == NULL) {
-    bgpstream_ip_addr_set_destroy(set);
-    return NULL;
-  }
-
+  swiss_addr4_init(&set->v4);
+  swiss_addr6_init(&set->v6);
   return set;
 }
 
 int bgpstream_ip_addr_set_insert(bgpstream_ip_addr_set_t *set,
                                  bgpstream_ip_addr_t *addr)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ip_addr_set, set->hash, *addr)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_ip_addr_set, set->hash, *addr, &khret);
-    return 1;
+  addr4_key_t k4;
+  addr6_key_t k6;
+
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    k4 = addr->bs_ipv4.addr.s_addr;
+    return swiss_addr4_insert(&set->v4, &k4);
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    addr6_key(&addr->bs_ipv6, &k6);
+    return swiss_addr6_insert(&set->v6, &k6);
+  default:
+    return -1;
   }
-  return 0;
 }
 
 int bgpstream_ip_addr_set_size(bgpstream_ip_addr_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v4.size + set->v6.size;
 }
 
 int bgpstream_ip_addr_set_merge(bgpstream_ip_addr_set_t *dst_set,
                                 bgpstream_ip_addr_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_ip_addr_set_insert(dst_set,
-                                       &(kh_key(src_set->hash, k))) < 0) {
-        return -1;
-      }
+  const addr4_key_t *k4;
+  const addr6_key_t *k6;
+  uint64_t i;
+
+  for (i = 0; swiss_addr4_next(&src_set->v4, &i, &k4); i++) {
+    if (swiss_addr4_insert(&dst_set->v4, k4) < 0) {
+      return -1;
+    }
+  }
+  for (i = 0; swiss_addr6_next(&src_set->v6, &i, &k6); i++) {
+    if (swiss_addr6_insert(&dst_set->v6, k6) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -129,13 +141,15 @@ int bgpstream_ip_addr_set_merge(bgpstream_ip_addr_set_t *dst_set,
 
 void bgpstream_ip_addr_set_destroy(bgpstream_ip_addr_set_t *set)
 {
-  kh_destroy(bgpstream_ip_addr_set, set->hash);
+  swiss_addr4_free(&set->v4);
+  swiss_addr6_free(&set->v6);
   free(set);
 }
 
 void bgpstream_ip_addr_set_clear(bgpstream_ip_addr_set_t *set)
 {
-  kh_clear(bgpstream_ip_addr_set, set->hash);
+  swiss_addr4_clear(&set->v4);
+  swiss_addr6_clear(&set->v6);
 }
 
 /* IPv4 */
@@ -149,42 +163,31 @@ bgpstream_ipv4_addr_set_t *bgpstream_ipv4_addr_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_ipv4_addr_set)) == NULL) {
-    bgpstream_ipv4_addr_set_destroy(set);
-    return NULL;
-  }
-
+  swiss_addr4_init(&set->v4);
   return set;
 }
 
 int bgpstream_ipv4_addr_set_insert(bgpstream_ipv4_addr_set_t *set,
                                    bgpstream_ipv4_addr_t *addr)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv4_addr_set, set->hash, *addr)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_ipv4_addr_set, set->hash, *addr, &khret);
-    return 1;
-  }
-  return 0;
+  addr4_key_t k = addr->addr.s_addr;
+  return swiss_addr4_insert(&set->v4, &k);
 }
 
 int bgpstream_ipv4_addr_set_size(bgpstream_ipv4_addr_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v4.size;
 }
 
 int bgpstream_ipv4_addr_set_merge(bgpstream_ipv4_addr_set_t *dst_set,
                                   bgpstream_ipv4_addr_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_ipv4_addr_set_insert(dst_set, &(kh_key(src_set->hash, k))) <
-          0) {
-        return -1;
-      }
+  const addr4_key_t *k;
+  uint64_t i;
+
+  for (i = 0; swiss_addr4_next(&src_set->v4, &i, &k); i++) {
+    if (swiss_addr4_insert(&dst_set->v4, k) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -192,13 +195,13 @@ int bgpstream_ipv4_addr_set_merge(bgpstream_ipv4_addr_set_t *dst_set,
 
 void bgpstream_ipv4_addr_set_destroy(bgpstream_ipv4_addr_set_t *set)
 {
-  kh_destroy(bgpstream_ipv4_addr_set, set->hash);
+  swiss_addr4_free(&set->v4);
   free(set);
 }
 
 void bgpstream_ipv4_addr_set_clear(bgpstream_ipv4_addr_set_t *set)
 {
-  kh_clear(bgpstream_ipv4_addr_set, set->hash);
+  swiss_addr4_clear(&set->v4);
 }
 
 /* IPv6 */
@@ -212,42 +215,32 @@ bgpstream_ipv6_addr_set_t *bgpstream_ipv6_addr_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_ipv6_addr_set)) == NULL) {
-    bgpstream_ipv6_addr_set_destroy(set);
-    return NULL;
-  }
-
+  swiss_addr6_init(&set->v6);
   return set;
 }
 
 int bgpstream_ipv6_addr_set_insert(bgpstream_ipv6_addr_set_t *set,
                                    bgpstream_ipv6_addr_t *addr)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv6_addr_set, set->hash, *addr)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_ipv6_addr_set, set->hash, *addr, &khret);
-    return 1;
-  }
-  return 0;
+  addr6_key_t k;
+  addr6_key(addr, &k);
+  return swiss_addr6_insert(&set->v6, &k);
 }
 
 int bgpstream_ipv6_addr_set_size(bgpstream_ipv6_addr_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v6.size;
 }
 
 int bgpstream_ipv6_addr_set_merge(bgpstream_ipv6_addr_set_t *dst_set,
                                   bgpstream_ipv6_addr_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_ipv6_addr_set_insert(dst_set, &(kh_key(src_set->hash, k))) <
-          0) {
-        return -1;
-      }
+  const addr6_key_t *k;
+  uint64_t i;
+
+  for (i = 0; swiss_addr6_next(&src_set->v6, &i, &k); i++) {
+    if (swiss_addr6_insert(&dst_set->v6, k) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -255,11 +248,11 @@ int bgpstream_ipv6_addr_set_merge(bgpstream_ipv6_addr_set_t *dst_set,
 
 void bgpstream_ipv6_addr_set_destroy(bgpstream_ipv6_addr_set_t *set)
 {
-  kh_destroy(bgpstream_ipv6_addr_set, set->hash);
+  swiss_addr6_free(&set->v6);
   free(set);
 }
 
 void bgpstream_ipv6_addr_set_clear(bgpstream_ipv6_addr_set_t *set)
 {
-  kh_clear(bgpstream_ipv6_addr_set, set->hash);
+  swiss_addr6_clear(&set->v6);
 }
@@ -32,6 +32,8 @@
 
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
+#include "bgpstream_utils_private.h"
 #include "config.h"
 #include "khash.h"
 #include "utils.h"
@@ -117,7 +119,7 @@ int bgpstream_as_path_seg_snprintf(char *buf, size_t len,
 
   switch (seg->type) {
   case BGPSTREAM_AS_PATH_SEG_ASN:
-    return snprintf(buf, len, "%" PRIu32, seg->asn.asn);
+    return bs_u32_snprintf(buf, len, seg->asn.asn);
 
   case BGPSTREAM_AS_PATH_SEG_SET:
     /* {A,B,C} */
@@ -146,7 +148,7 @@ int bgpstream_as_path_seg_snprintf(char *buf, size_t len,
       ADD_CHAR(chars[1]);
     }
     size_t remain = (len <= written) ? 0 : len - written;
-    written += snprintf(buf + written, remain, "%" PRIu32, seg->set.asn[i]);
+    written += bs_u32_snprintf(buf + written, remain, seg->set.asn[i]);
   }
   ADD_CHAR(chars[2]);
   if (written < len) {
@@ -238,14 +240,64 @@ int bgpstream_as_path_snprintf(char *buf, size_t len,
   return written;
 }
 
+/* Make sure the path data buffer can hold len bytes. If keep is set, the
+ * current contents of the path (data_len bytes) are preserved */
+static int path_reserve(bgpstream_as_path_t *path, size_t len, int keep)
+{
+  uint8_t *buf;
+
+  if (path->data_alloc_len == UINT16_MAX) {
+    /* external memory: move the path into a buffer of our own */
+    buf = path->data;
+    path->data = NULL;
+    path->data_alloc_len = 0;
+    if (path_reserve(path, len, 0) != 0) {
+      return -1;
+    }
+    if (keep && path->data_len > 0) {
+      memcpy(path->data, buf, path->data_len);
+    }
+    return 0;
+  }
+
+  if (path->data != NULL && path->data_alloc_len >= len) {
+    return 0;
+  }
+
+  if (path->data == NULL && len <= BGPSTREAM_AS_PATH_INLINE_LEN) {
+    path->data = path->inline_data;
+    path->data_alloc_len = BGPSTREAM_AS_PATH_INLINE_LEN;
+    return 0;
+  }
+
+  if (path->data == NULL || path->data == path->inline_data) {
+    if ((buf = bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS, len)) == NULL) {
+      return -1;
+    }
+    if (keep && path->data != NULL && path->data_len > 0) {
+      memcpy(buf, path->data, path->data_len);
+    }
+  } else if ((buf = bgpstream_mem_realloc(BGPSTREAM_MEM_UTILS, path->data,
+                                           len)) == NULL) {
+    return -1;
+  }
+  path->data = buf;
+  path->data_alloc_len = len;
+  return 0;
+}
+
 bgpstream_as_path_t *bgpstream_as_path_create()
 {
   bgpstream_as_path_t *path;
 
-  if ((path = malloc_zero(sizeof(bgpstream_as_path_t))) == NULL) {
+  path = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_UTILS,
+                                   sizeof(bgpstream_as_path_t));
+  if (path == NULL) {
     return NULL;
   }
 
+  path->data = path->inline_data;
+  path->data_alloc_len = BGPSTREAM_AS_PATH_INLINE_LEN;
   path->origin_offset = UINT16_MAX;
 
   return path;
@@ -260,27 +312,23 @@ void bgpstream_as_path_clear(bgpstream_as_path_t *path)
 
 void bgpstream_as_path_destroy(bgpstream_as_path_t *path)
 {
-  if (path->data_alloc_len != UINT16_MAX) {
-    free(path->data);
+  if (path->data_alloc_len != UINT16_MAX && path->data != path->inline_data) {
+    bgpstream_mem_free(BGPSTREAM_MEM_UTILS, path->data);
   }
   path->data = NULL;
   path->data_alloc_len = 0;
   bgpstream_as_path_clear(path);
-  free(path);
+  bgpstream_mem_free(BGPSTREAM_MEM_UTILS, path);
 }
 
 int bgpstream_as_path_copy(bgpstream_as_path_t *dst,
     const bgpstream_as_path_t *src)
 {
-  if (dst->data_alloc_len == UINT16_MAX) {
-    /* no longer points to external memory */
-    dst->data_alloc_len = 0;
-  }
-  if (dst->data_alloc_len < src->data_len) {
-    if ((dst->data = realloc(dst->data, src->data_len)) == NULL) {
+  /* fast path: the buffer (usually the inline one) is already big enough */
+  if (dst->data_alloc_len == UINT16_MAX || dst->data_alloc_len < src->data_len) {
+    if (path_reserve(dst, src->data_len, 0) != 0) {
       return -1;
     }
-    dst->data_alloc_len = src->data_len;
   }
 
   memcpy(dst->data, src->data, src->data_len);
@@ -370,17 +418,8 @@ int bgpstream_as_path_populate_from_data(bgpstream_as_path_t *path,
 
   bgpstream_as_path_clear(path);
 
-  if (path->data_alloc_len == UINT16_MAX) {
-    /* the data is not owned by us */
-    path->data_alloc_len = 0;
-    path->data = NULL;
-  }
-
-  if (path->data_alloc_len < data_len) {
-    if ((path->data = realloc(path->data, data_len)) == NULL) {
-      return -1;
-    }
-    path->data_alloc_len = data_len;
+  if (path_reserve(path, data_len, 0) != 0) {
+    return -1;
   }
 
   memcpy(path->data, data, data_len);
@@ -398,6 +437,11 @@ int bgpstream_as_path_populate_from_data_zc(bgpstream_as_path_t *path,
 
   bgpstream_as_path_clear(path);
 
+  /* release our own heap buffer, if any */
+  if (path->data_alloc_len != UINT16_MAX && path->data != path->inline_data) {
+    bgpstream_mem_free(BGPSTREAM_MEM_UTILS, path->data);
+  }
+
   /* signal that this is external data */
   path->data_alloc_len = UINT16_MAX;
   path->data = data;
@@ -408,31 +452,95 @@ int bgpstream_as_path_populate_from_data_zc(bgpstream_as_path_t *path,
   return 0;
 }
 
-/* from http://burtleburtle.net/bob/hash/integer.html */
-static inline uint32_t mixbits(uint32_t a)
+/* The hash below follows the structure of wyhash (public domain), by Wang Yi:
+ * the path bytes are consumed 16 (or 48) at a time and folded with 64x64->128
+ * bit multiplies, which are much faster than SIMD for the short inputs AS
+ * paths are. */
+
+#define WY_S0 0xa0761d6478bd642fULL
+#define WY_S1 0xe7037ed1a0b428dbULL
+#define WY_S2 0x8ebc6af09c88c6e3ULL
+#define WY_S3 0x589965cc75374cc3ULL
+
+static inline uint64_t wymum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), lo, hi;
+  hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl);
+  lo = t + (rm1 << 32);
+  hi += (lo < t);
+  return lo ^ hi;
+#endif
+}
+
+static inline uint64_t wyr8(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t wyr4(const uint8_t *p)
 {
-  a = a ^ (a >> 4);
-  a = (a ^ 0xdeadbeef) + (a << 5);
-  a = a ^ (a >> 11);
-  return a;
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint64_t bgpstream_as_path_hash64(const bgpstream_as_path_t *path)
+{
+  const uint8_t *p = path->data;
+  size_t len = path->data_len, i = len;
+  uint64_t seed = WY_S0, see1, see2, a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+      b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    if (i > 48) {
+      see1 = see2 = seed;
+      do {
+        seed = wymum(wyr8(p) ^ WY_S1, wyr8(p + 8) ^ seed);
+        see1 = wymum(wyr8(p + 16) ^ WY_S2, wyr8(p + 24) ^ see1);
+        see2 = wymum(wyr8(p + 32) ^ WY_S3, wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wymum(wyr8(p) ^ WY_S1, wyr8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = wyr8(p + i - 16);
+    b = wyr8(p + i - 8);
+  }
+  return wymum(WY_S1 ^ len, wymum(a ^ WY_S1, b ^ seed));
 }
 
 uint32_t
 bgpstream_as_path_hash(const bgpstream_as_path_t *path)
 {
-  if (path->data_len > 0) {
-    /* put the peer (ish) hash into the top bits */
-    /* and put the origin hash into the bottom bits */
-    return mixbits(
-      ((bgpstream_as_path_seg_hash((const bgpstream_as_path_seg_t *)path->data) &
-        0xFFFF)
-       << 8) |
-      (bgpstream_as_path_seg_hash(
-         (const bgpstream_as_path_seg_t *)(path->data + path->origin_offset)) &
-       0xFFFF));
-  } else {
+  uint64_t h;
+
+  if (path->data_len == 0) {
     return 0;
   }
+  h = bgpstream_as_path_hash64(path);
+  return (uint32_t)(h ^ (h >> 32));
 }
 
 inline int bgpstream_as_path_equal(const bgpstream_as_path_t *path1,
@@ -529,11 +637,8 @@ int bgpstream_as_path_append(bgpstream_as_path_t *path,
     assert(new_len < UINT16_MAX);
   }
 
-  if (path->data_alloc_len < new_len) {
-    if ((path->data = realloc(path->data, new_len)) == NULL) {
-      return -1;
-    }
-    path->data_alloc_len = new_len;
+  if (path_reserve(path, new_len, 1) != 0) {
+    return -1;
   }
   path->data_len = new_len;
 
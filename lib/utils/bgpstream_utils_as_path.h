@@ -378,10 +378,23 @@ int bgpstream_as_path_populate_from_data_zc(bgpstream_as_path_t *path,
  *
  * @param path          pointer to the AS path to hash
  * @return 32bit hash of the AS path
+ *
+ * The hash covers every segment of the path. It is the 64bit hash returned by
+ * bgpstream_as_path_hash64, folded into 32 bits.
  */
 uint32_t
 bgpstream_as_path_hash(const bgpstream_as_path_t *path);
 
+/** Hash the given AS path into a 64bit number
+ *
+ * @param path          pointer to the AS path to hash
+ * @return 64bit hash of the AS path
+ *
+ * This is a fast, high quality hash of the entire path data, suitable as a
+ * key for large hash tables of paths (e.g., khash with a 64bit key).
+ */
+uint64_t bgpstream_as_path_hash64(const bgpstream_as_path_t *path);
+
 /** Compare two AS path for equality
  *
  * @param path1          pointer to the first AS path to compare
@@ -43,6 +43,10 @@
  *
  * @{ */
 
+/** Number of bytes of path data that can be stored inside the path structure
+ * itself (enough for 8 simple ASN segments). Longer paths use a heap buffer */
+#define BGPSTREAM_AS_PATH_INLINE_LEN 40
+
 /** @} */
 
 /**
@@ -66,7 +70,8 @@
 
 struct bgpstream_as_path {
 
-  /* byte array of segments */
+  /* byte array of segments. This either points to inline_data, to a heap
+   * buffer, or (if data_alloc_len is UINT16_MAX) to external memory */
   uint8_t *data;
 
   /* length of the byte array in use */
@@ -80,6 +85,9 @@ struct bgpstream_as_path {
 
   /* offset of the origin segment */
   uint16_t origin_offset;
+
+  /* inline storage for short paths */
+  uint8_t inline_data[BGPSTREAM_AS_PATH_INLINE_LEN];
 };
 
 /** @} */
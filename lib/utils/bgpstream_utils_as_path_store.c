@@ -27,161 +27,495 @@
 #include "config.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include "khash.h"
 #include "utils.h"
 
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_log.h"
 
 #include "bgpstream_utils_as_path_store.h"
+#include "bgpstream_utils_mem_int.h"
+
+/** Size of each block of the path data arena */
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+/** Initial number of slots in each shard's path index (power of 2) */
+#define INDEX_INIT_SIZE (1 << 16)
+
+/** Initial number of slots in each shard's path index for concurrent stores,
+    which spread the same number of paths over many shards */
+#define INDEX_INIT_SIZE_CONCURRENT (1 << 10)
+
+/** Number of index shards (each with their own lock) in a concurrent store
+    (power of 2) */
+#define CONCURRENT_SHARDS 64
+
+/** Paths are stored in chunks of 2^PATHS_CHUNK_BITS, so that a path never
+    moves once it has been added */
+#define PATHS_CHUNK_BITS 16
+#define PATHS_CHUNK_SIZE (1 << PATHS_CHUNK_BITS)
+#define PATHS_CHUNKS_MAX (1 << (32 - PATHS_CHUNK_BITS))
+
+/** Marks an unused slot in the path index */
+#define INDEX_EMPTY UINT32_MAX
+
+#define SNAPSHOT_MAGIC "BSPS"
+#define SNAPSHOT_VERSION 2
+
+/** Written in host byte order, to detect snapshots from foreign hosts */
+#define SNAPSHOT_BYTE_ORDER 0x01020304
 
 /* wrapper around an AS path */
 struct bgpstream_as_path_store_path {
 
-  /** Is this a core path? */
-  uint8_t is_core;
+  /** 64-bit hash of the path data (and core flag) */
+  uint64_t hash;
 
   /** Internal index of this path within the store */
   uint32_t idx;
 
-  /** Underlying AS Path structure */
+  /** Is this a core path? */
+  uint8_t is_core;
+
+  /** Underlying AS Path structure (the data lives in the store arena) */
   bgpstream_as_path_t path;
 };
 
-/** A per-origin set of AS Paths */
-typedef struct pathset {
+/** A slot in the open-addressing path index */
+typedef struct index_slot {
 
-  /** Array of AS Paths in the set */
-  bgpstream_as_path_store_path_t *paths;
+  /** Index of the path in the store, or INDEX_EMPTY */
+  uint32_t idx;
+
+  /** Top 32 bits of the path hash, to skip most mismatches without touching
+      the path itself */
+  uint32_t tag;
+
+} index_slot_t;
+
+/** Snapshot file header. A snapshot is laid out as the header, followed by
+ * paths_cnt snapshot_path_t records (in ID order), index_size index slots,
+ * and finally data_len bytes of path data. All fields are in host byte order
+ * and every section is 8-byte aligned, so that the file can be used directly
+ * once mapped */
+typedef struct snapshot_hdr {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t paths_cnt;
+  uint32_t index_size;
+  uint32_t unused;
+  uint64_t data_len;
+} snapshot_hdr_t;
+
+/** A path record in a snapshot */
+typedef struct snapshot_path {
+  uint64_t hash;
+  /** Offset of the path data within the data section */
+  uint64_t data_off;
+  uint16_t data_len;
+  uint16_t seg_cnt;
+  uint16_t origin_offset;
+  uint8_t is_core;
+  uint8_t unused;
+} snapshot_path_t;
+
+/** A shard of the path index, along with the arena for the data of the paths
+ * it indexes */
+typedef struct store_shard {
+
+  /** Protects everything in the shard (concurrent stores only) */
+  pthread_mutex_t lock;
 
-  /** Number of AS paths in the set */
-  uint16_t paths_cnt;
+  /** Linear-probing index from path hash to path ID */
+  index_slot_t *index;
 
-} __attribute__((packed)) pathset_t;
+  /** Number of slots in the index (power of 2) */
+  uint32_t index_size;
 
-KHASH_INIT(pathset, uint32_t, pathset_t, 1, kh_int_hash_func,
-           kh_int_hash_equal)
+  /** Number of paths in this shard */
+  uint32_t paths_cnt;
+
+  /** Blocks of path data. Blocks are never moved or freed until the store is
+      destroyed, so the data pointers of the stored paths remain valid */
+  uint8_t **arena;
+
+  /** Number of arena blocks */
+  int arena_cnt;
+
+  /** Number of bytes used in the last arena block */
+  size_t arena_used;
+
+} store_shard_t;
 
 struct bgpstream_as_path_store {
 
-  khash_t(pathset) * path_set;
+  /** Chunks of paths, indexed by (ID >> PATHS_CHUNK_BITS) */
+  bgpstream_as_path_store_path_t **chunks;
+
+  /** Protects the allocation of new chunks (concurrent stores only) */
+  pthread_mutex_t chunks_lock;
 
   /** The total number of paths in the store */
   uint32_t paths_cnt;
 
-  /** The currently iterated pathset */
-  khiter_t cur_pathset;
+  /** Index shards, selected using the path hash */
+  store_shard_t *shards;
 
-  /** The current path within the current pathset */
-  int cur_path;
+  /** Number of shards (power of 2) */
+  int shards_cnt;
+
+  /** Is this store safe for concurrent use? */
+  int concurrent;
+
+  /** The currently iterated path */
+  uint32_t cur_path;
+
+  /** Mapped snapshot (NULL unless the store was loaded from a snapshot, in
+      which case the store is read-only and has no shards) */
+  uint8_t *map;
+
+  /** Length of the mapped snapshot */
+  size_t map_len;
+
+  /** Path records, index and path data within the mapped snapshot */
+  const snapshot_path_t *snap_paths;
+  const index_slot_t *snap_index;
+  uint32_t snap_index_size;
+  const uint8_t *snap_data;
+  uint64_t snap_data_len;
 };
 
-static void store_path_destroy(bgpstream_as_path_store_path_t *spath)
+/* Hash of a store path. Core and non-core paths with the same data must not
+ * collide */
+static inline uint64_t store_path_hash(bgpstream_as_path_store_path_t *spath)
 {
-  if (spath == NULL) {
-    return;
+  return bgpstream_as_path_hash64(&spath->path) ^
+         (spath->is_core ? 0x9e3779b97f4a7c15ULL : 0);
+}
+
+static inline int store_path_equal(bgpstream_as_path_store_path_t *sp1,
+                                   bgpstream_as_path_store_path_t *sp2)
+{
+  return (sp1->hash == sp2->hash) && (sp1->is_core == sp2->is_core) &&
+         bgpstream_as_path_equal(&sp1->path, &sp2->path);
+}
+
+/* Get the store path with the given index. The chunk it lives in must already
+ * have been allocated */
+static inline bgpstream_as_path_store_path_t *
+store_path_get(bgpstream_as_path_store_t *store, uint32_t idx)
+{
+  bgpstream_as_path_store_path_t *chunk =
+    __atomic_load_n(&store->chunks[idx >> PATHS_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  return &chunk[idx & (PATHS_CHUNK_SIZE - 1)];
+}
+
+static int chunk_alloc(bgpstream_as_path_store_t *store, uint32_t idx)
+{
+  bgpstream_as_path_store_path_t **slot = &store->chunks[idx >> PATHS_CHUNK_BITS];
+  bgpstream_as_path_store_path_t *chunk;
+  int rc = 0;
+
+  if (__atomic_load_n(slot, __ATOMIC_ACQUIRE) != NULL) {
+    return 0;
   }
 
-  /* destroy the path's data */
-  assert(spath->path.data_alloc_len != UINT16_MAX);
-  free(spath->path.data);
-  spath->path.data = NULL;
-  spath->path.data_alloc_len = 0;
+  if (store->concurrent) {
+    pthread_mutex_lock(&store->chunks_lock);
+  }
+  /* another thread may have allocated it while we waited */
+  if (*slot == NULL) {
+    if ((chunk = bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS,
+                                      sizeof(bgpstream_as_path_store_path_t) *
+                                        PATHS_CHUNK_SIZE)) == NULL) {
+      rc = -1;
+    } else {
+      BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                            sizeof(bgpstream_as_path_store_path_t) *
+                              PATHS_CHUNK_SIZE);
+      __atomic_store_n(slot, chunk, __ATOMIC_RELEASE);
+    }
+  }
+  if (store->concurrent) {
+    pthread_mutex_unlock(&store->chunks_lock);
+  }
+  return rc;
 }
 
-static int store_path_dup(bgpstream_as_path_store_path_t *dst,
-                   bgpstream_as_path_store_path_t *src)
+/* Build the store paths of a chunk from the mapped snapshot records. The path
+ * data is used straight from the mapping */
+static bgpstream_as_path_store_path_t *
+snapshot_chunk_build(bgpstream_as_path_store_t *store, uint32_t idx)
 {
-  *dst = *src;
+  bgpstream_as_path_store_path_t **slot = &store->chunks[idx >> PATHS_CHUNK_BITS];
+  bgpstream_as_path_store_path_t *chunk;
+  bgpstream_as_path_store_path_t *spath;
+  const snapshot_path_t *rec;
+  uint32_t first = idx & ~(PATHS_CHUNK_SIZE - 1);
+  uint32_t i;
+
+  /* lookups on a snapshot may come from several threads */
+  pthread_mutex_lock(&store->chunks_lock);
+  if ((chunk = *slot) == NULL &&
+      (chunk = bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS,
+                                    sizeof(bgpstream_as_path_store_path_t) *
+                                      PATHS_CHUNK_SIZE)) != NULL) {
+    BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                          sizeof(bgpstream_as_path_store_path_t) *
+                            PATHS_CHUNK_SIZE);
+    for (i = first; i < store->paths_cnt && i - first < PATHS_CHUNK_SIZE;
+         i++) {
+      rec = &store->snap_paths[i];
+      spath = &chunk[i - first];
+      spath->hash = rec->hash;
+      spath->idx = i;
+      spath->is_core = rec->is_core;
+      spath->path.data_alloc_len = UINT16_MAX;
+      if (rec->data_off + rec->data_len > store->snap_data_len) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupt path %" PRIu32
+                      " in AS path store snapshot", i);
+        spath->path.data = NULL;
+        spath->path.data_len = 0;
+        spath->path.seg_cnt = 0;
+        spath->path.origin_offset = 0;
+        continue;
+      }
+      spath->path.data = (uint8_t *)store->snap_data + rec->data_off;
+      spath->path.data_len = rec->data_len;
+      spath->path.seg_cnt = rec->seg_cnt;
+      spath->path.origin_offset = rec->origin_offset;
+    }
+    __atomic_store_n(slot, chunk, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&store->chunks_lock);
 
-  /* copy the path data */
-  dst->path.data_alloc_len = 0;
-  if ((dst->path.data = malloc(src->path.data_len)) == NULL) {
-    goto err;
+  return (chunk == NULL) ? NULL : &chunk[idx - first];
+}
+
+/* Get the store path with the given index, or NULL if it does not exist */
+static bgpstream_as_path_store_path_t *
+store_path_lookup(bgpstream_as_path_store_t *store, uint32_t idx)
+{
+  bgpstream_as_path_store_path_t *chunk;
+
+  if (idx >= bgpstream_as_path_store_get_size(store)) {
+    return NULL;
+  }
+  chunk =
+    __atomic_load_n(&store->chunks[idx >> PATHS_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  if (chunk != NULL) {
+    return &chunk[idx & (PATHS_CHUNK_SIZE - 1)];
   }
-  dst->path.data_alloc_len = src->path.data_len;
-  dst->path.data_len = src->path.data_len;
-  memcpy(dst->path.data, src->path.data, src->path.data_len);
+  if (store->map != NULL) {
+    return snapshot_chunk_build(store, idx);
+  }
+  return NULL;
+}
 
-  return 0;
+static int snapshot_get_path_id(bgpstream_as_path_store_t *store,
+                                bgpstream_as_path_store_path_t *findme,
+                                bgpstream_as_path_store_path_id_t *id)
+{
+  const snapshot_path_t *rec;
+  uint32_t mask = store->snap_index_size - 1;
+  uint32_t tag = findme->hash >> 32;
+  uint32_t pos;
+
+  for (pos = findme->hash & mask; store->snap_index[pos].idx != INDEX_EMPTY;
+       pos = (pos + 1) & mask) {
+    if (store->snap_index[pos].tag != tag ||
+        store->snap_index[pos].idx >= store->paths_cnt) {
+      continue;
+    }
+    rec = &store->snap_paths[store->snap_index[pos].idx];
+    if (rec->hash == findme->hash && rec->is_core == findme->is_core &&
+        rec->data_len == findme->path.data_len &&
+        rec->data_off + rec->data_len <= store->snap_data_len &&
+        memcmp(store->snap_data + rec->data_off, findme->path.data,
+               rec->data_len) == 0) {
+      id->path_idx = store->snap_index[pos].idx;
+      return 0;
+    }
+  }
 
-err:
-  store_path_destroy(dst);
+  bgpstream_log(BGPSTREAM_LOG_ERR,
+                "Cannot add a path to a read-only AS path store snapshot");
   return -1;
 }
 
-static inline int store_path_equal(bgpstream_as_path_store_path_t *sp1,
-                                   bgpstream_as_path_store_path_t *sp2)
+/* Copy the given path data into the shard arena, returning a stable pointer */
+static uint8_t *arena_dup(store_shard_t *shard, const uint8_t *data,
+                          uint16_t len)
 {
-  return (sp1->is_core == sp2->is_core) &&
-         bgpstream_as_path_equal(&sp1->path, &sp2->path);
+  uint8_t **tmp;
+  uint8_t *dst;
+
+  if (shard->arena_cnt == 0 || shard->arena_used + len > ARENA_BLOCK_SIZE) {
+    if ((tmp = realloc(shard->arena,
+                       sizeof(uint8_t *) * (shard->arena_cnt + 1))) == NULL) {
+      return NULL;
+    }
+    shard->arena = tmp;
+    if ((shard->arena[shard->arena_cnt] =
+           bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS, ARENA_BLOCK_SIZE)) ==
+        NULL) {
+      return NULL;
+    }
+    BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS, ARENA_BLOCK_SIZE);
+    shard->arena_cnt++;
+    shard->arena_used = 0;
+  }
+
+  dst = shard->arena[shard->arena_cnt - 1] + shard->arena_used;
+  memcpy(dst, data, len);
+  shard->arena_used += len;
+  return dst;
 }
 
-static void pathset_destroy(pathset_t ps)
+static int shard_init(store_shard_t *shard, uint32_t index_size)
 {
-  int i;
+  uint32_t i;
 
-  /* destroy each store path */
-  for (i = 0; i < ps.paths_cnt; i++) {
-    store_path_destroy(&ps.paths[i]);
+  if ((shard->index = bgpstream_mem_malloc(
+         BGPSTREAM_MEM_UTILS, sizeof(index_slot_t) * index_size)) == NULL) {
+    return -1;
   }
-
-  /* destroy the array of paths */
-  free(ps.paths);
-  ps.paths = NULL;
-  ps.paths_cnt = 0;
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS, sizeof(index_slot_t) * index_size);
+  shard->index_size = index_size;
+  for (i = 0; i < index_size; i++) {
+    shard->index[i].idx = INDEX_EMPTY;
+  }
+  pthread_mutex_init(&shard->lock, NULL);
+  return 0;
 }
 
-static uint16_t pathset_get_path_id(bgpstream_as_path_store_t *store,
-                                    pathset_t *ps,
-                                    bgpstream_as_path_store_path_t *findme)
+static void shard_destroy(store_shard_t *shard)
 {
   int i;
-  uint32_t path_id;
 
-  /* check if it is already in the set */
-  for (i = 0; i < ps->paths_cnt; i++) {
-    if (store_path_equal(&ps->paths[i], findme) != 0) {
-      return i;
+  if (shard->index == NULL) {
+    /* never initialized */
+    return;
+  }
+  for (i = 0; i < shard->arena_cnt; i++) {
+    bgpstream_mem_free(BGPSTREAM_MEM_UTILS, shard->arena[i]);
+  }
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                        -(int64_t)ARENA_BLOCK_SIZE * shard->arena_cnt -
+                          (int64_t)sizeof(index_slot_t) * shard->index_size);
+  free(shard->arena);
+  bgpstream_mem_free(BGPSTREAM_MEM_UTILS, shard->index);
+  pthread_mutex_destroy(&shard->lock);
+}
+
+static int index_grow(bgpstream_as_path_store_t *store, store_shard_t *shard)
+{
+  index_slot_t *index;
+  uint32_t size = shard->index_size * 2;
+  uint32_t mask = size - 1;
+  uint32_t i, pos;
+  uint64_t h;
+
+  if ((index = bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS,
+                                    sizeof(index_slot_t) * size)) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < size; i++) {
+    index[i].idx = INDEX_EMPTY;
+  }
+
+  /* re-insert every path, using the hash saved in the path */
+  for (i = 0; i < shard->index_size; i++) {
+    if (shard->index[i].idx == INDEX_EMPTY) {
+      continue;
     }
+    h = store_path_get(store, shard->index[i].idx)->hash;
+    pos = h & mask;
+    while (index[pos].idx != INDEX_EMPTY) {
+      pos = (pos + 1) & mask;
+    }
+    index[pos] = shard->index[i];
   }
 
-  findme->idx = store->paths_cnt++;
+  BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                        sizeof(index_slot_t) * (size - shard->index_size));
+  bgpstream_mem_free(BGPSTREAM_MEM_UTILS, shard->index);
+  shard->index = index;
+  shard->index_size = size;
+  return 0;
+}
+
+static int add_path(bgpstream_as_path_store_t *store, store_shard_t *shard,
+                    bgpstream_as_path_store_path_t *findme, uint32_t *idx)
+{
+  bgpstream_as_path_store_path_t *spath;
 
-  /* need to append this path */
-  if ((ps->paths = realloc(ps->paths, sizeof(bgpstream_as_path_store_path_t) *
-                                        (ps->paths_cnt + 1))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc paths");
-    return UINT16_MAX;
+  if (__atomic_load_n(&store->paths_cnt, __ATOMIC_RELAXED) >= INDEX_EMPTY) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "AS path store is full");
+    return -1;
   }
-  if (store_path_dup(&ps->paths[ps->paths_cnt], findme) != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create store path");
-    return UINT16_MAX;
+  *idx = __atomic_fetch_add(&store->paths_cnt, 1, __ATOMIC_RELAXED);
+
+  if (chunk_alloc(store, *idx) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate paths");
+    return -1;
   }
-  path_id = ps->paths_cnt++;
-  assert(ps->paths_cnt <= UINT16_MAX);
 
-  return path_id;
-}
+  spath = store_path_get(store, *idx);
+  *spath = *findme;
+  spath->idx = *idx;
+  /* the path data is owned by the arena */
+  spath->path.data_alloc_len = UINT16_MAX;
+  spath->path.data = NULL;
+  if (findme->path.data_len > 0 &&
+      (spath->path.data =
+         arena_dup(shard, findme->path.data, findme->path.data_len)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not copy path data");
+    /* leave an empty path behind rather than a dangling one */
+    spath->path.data_len = 0;
+    return -1;
+  }
 
-/* ==================== PUBLIC FUNCTIONS ==================== */
+  shard->paths_cnt++;
+  return 0;
+}
 
-bgpstream_as_path_store_t *bgpstream_as_path_store_create()
+static bgpstream_as_path_store_t *store_create(int shards_cnt,
+                                               uint32_t index_size,
+                                               int concurrent)
 {
   bgpstream_as_path_store_t *store;
+  int i;
 
   if ((store = malloc_zero(sizeof(bgpstream_as_path_store_t))) == NULL) {
     return NULL;
   }
+  store->concurrent = concurrent;
+  pthread_mutex_init(&store->chunks_lock, NULL);
 
-  if ((store->path_set = kh_init(pathset)) == NULL) {
+  if ((store->chunks = malloc_zero(sizeof(bgpstream_as_path_store_path_t *) *
+                                   PATHS_CHUNKS_MAX)) == NULL) {
     goto err;
   }
-  /* pre-allocate to minimize resize events */
-  kh_resize(pathset, store->path_set, 1 << 24); /* 2^24 = 16.8M buckets */
+
+  if ((store->shards = malloc_zero(sizeof(store_shard_t) * shards_cnt)) ==
+      NULL) {
+    goto err;
+  }
+  store->shards_cnt = shards_cnt;
+  for (i = 0; i < shards_cnt; i++) {
+    if (shard_init(&store->shards[i], index_size) != 0) {
+      goto err;
+    }
+  }
 
   return store;
 
@@ -190,57 +524,110 @@ err:
   return NULL;
 }
 
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_create()
+{
+  return store_create(1, INDEX_INIT_SIZE, 0);
+}
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_create_concurrent()
+{
+  return store_create(CONCURRENT_SHARDS, INDEX_INIT_SIZE_CONCURRENT, 1);
+}
+
 void bgpstream_as_path_store_destroy(bgpstream_as_path_store_t *store)
 {
+  int i;
+
   if (store == NULL) {
     return;
   }
 
-  if (store->path_set != NULL) {
-    kh_free_vals(pathset, store->path_set, pathset_destroy);
-    kh_destroy(pathset, store->path_set);
-    store->path_set = NULL;
+  if (store->shards != NULL) {
+    for (i = 0; i < store->shards_cnt; i++) {
+      shard_destroy(&store->shards[i]);
+    }
+    free(store->shards);
   }
 
+  if (store->chunks != NULL) {
+    for (i = 0; i < PATHS_CHUNKS_MAX; i++) {
+      if (store->chunks[i] != NULL) {
+        BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                              -(int64_t)(sizeof(bgpstream_as_path_store_path_t) *
+                                         PATHS_CHUNK_SIZE));
+      }
+      bgpstream_mem_free(BGPSTREAM_MEM_UTILS, store->chunks[i]);
+    }
+    free(store->chunks);
+  }
+
+  if (store->map != NULL) {
+    munmap(store->map, store->map_len);
+  }
+
+  pthread_mutex_destroy(&store->chunks_lock);
   free(store);
 }
 
 uint32_t bgpstream_as_path_store_get_size(bgpstream_as_path_store_t *store)
 {
-  return store->paths_cnt;
+  return __atomic_load_n(&store->paths_cnt, __ATOMIC_RELAXED);
 }
 
 static int get_path_id(bgpstream_as_path_store_t *store,
                        bgpstream_as_path_store_path_t *findme,
                        bgpstream_as_path_store_path_id_t *id)
 {
-  khiter_t k;
-  int khret;
+  store_shard_t *shard;
+  uint32_t mask, pos, tag, idx;
+  int rc = -1;
 
-  id->path_hash = bgpstream_as_path_hash(&findme->path);
+  findme->hash = store_path_hash(findme);
+  if (store->map != NULL) {
+    return snapshot_get_path_id(store, findme, id);
+  }
+  tag = findme->hash >> 32;
+  shard = &store->shards[tag & (store->shards_cnt - 1)];
 
-  k = kh_put(pathset, store->path_set, id->path_hash, &khret);
-  if (khret == 1) {
-    /* just added this pathset */
-    /* clear the pathset fields */
-    kh_val(store->path_set, k).paths = NULL;
-    kh_val(store->path_set, k).paths_cnt = 0;
-  } else if (khret != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path set to the store");
-    goto err;
+  if (store->concurrent) {
+    pthread_mutex_lock(&shard->lock);
   }
 
-  /* now get the path id from the origin set */
-  if ((id->path_id = pathset_get_path_id(store, &kh_val(store->path_set, k),
-                                         findme)) == UINT16_MAX) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path to origin set");
-    goto err;
+  /* keep the load factor under 70% */
+  if ((uint64_t)(shard->paths_cnt + 1) * 10 > (uint64_t)shard->index_size * 7 &&
+      index_grow(store, shard) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not grow the path index");
+    goto done;
   }
 
-  return 0;
+  mask = shard->index_size - 1;
+  for (pos = findme->hash & mask; shard->index[pos].idx != INDEX_EMPTY;
+       pos = (pos + 1) & mask) {
+    if (shard->index[pos].tag == tag &&
+        store_path_equal(store_path_get(store, shard->index[pos].idx),
+                         findme) != 0) {
+      id->path_idx = shard->index[pos].idx;
+      rc = 0;
+      goto done;
+    }
+  }
 
-err:
-  return -1;
+  /* need to add this path */
+  if (add_path(store, shard, findme, &idx) != 0) {
+    goto done;
+  }
+  shard->index[pos].idx = idx;
+  shard->index[pos].tag = tag;
+  id->path_idx = idx;
+  rc = 0;
+
+done:
+  if (store->concurrent) {
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return rc;
 }
 
 int bgpstream_as_path_store_get_path_id(bgpstream_as_path_store_t *store,
@@ -255,8 +642,7 @@ int bgpstream_as_path_store_get_path_id(bgpstream_as_path_store_t *store,
 
   /* special case for empty path */
   if (path == NULL) {
-    id->path_hash = UINT32_MAX;
-    id->path_id = UINT16_MAX;
+    id->path_idx = BGPSTREAM_AS_PATH_STORE_NULL_PATH_IDX;
     return 0;
   }
 
@@ -302,46 +688,24 @@ int bgpstream_as_path_store_insert_path(bgpstream_as_path_store_t *store,
 
 void bgpstream_as_path_store_iter_first_path(bgpstream_as_path_store_t *store)
 {
-  store->cur_pathset = kh_begin(store->path_set);
-
-  while (!kh_exist(store->path_set, store->cur_pathset) &&
-         store->cur_pathset < kh_end(store->path_set)) {
-    store->cur_pathset++;
-  }
-
   store->cur_path = 0;
 }
 
 void bgpstream_as_path_store_iter_next_path(bgpstream_as_path_store_t *store)
 {
-  pathset_t *pathset;
-
-  if (store->cur_pathset >= kh_end(store->path_set)) {
-    return;
-  }
-
-  pathset = &kh_val(store->path_set, store->cur_pathset);
-  if (store->cur_path >= pathset->paths_cnt) {
-    /* move to the next pathset */
-    do {
-      store->cur_pathset++;
-    } while (store->cur_pathset < kh_end(store->path_set) &&
-             !kh_exist(store->path_set, store->cur_pathset));
-    store->cur_path = 0;
-  }
+  /* paths are contiguous, bgpstream_as_path_store_iter_get_path advances the
+     iterator */
 }
 
 int bgpstream_as_path_store_iter_has_more_path(bgpstream_as_path_store_t *store)
 {
-  return (store->cur_pathset < kh_end(store->path_set)) &&
-         (store->cur_path <
-          kh_val(store->path_set, store->cur_pathset).paths_cnt);
+  return store->cur_path < store->paths_cnt;
 }
 
 bgpstream_as_path_store_path_t *
 bgpstream_as_path_store_iter_get_path(bgpstream_as_path_store_t *store)
 {
-  return &kh_val(store->path_set, store->cur_pathset).paths[store->cur_path++];
+  return store_path_lookup(store, store->cur_path++);
 }
 
 bgpstream_as_path_store_path_id_t
@@ -349,8 +713,7 @@ bgpstream_as_path_store_iter_get_path_id(bgpstream_as_path_store_t *store)
 {
   bgpstream_as_path_store_path_id_t id;
 
-  id.path_hash = kh_key(store->path_set, store->cur_pathset);
-  id.path_id = store->cur_path;
+  id.path_idx = store->cur_path;
 
   return id;
 }
@@ -359,23 +722,178 @@ bgpstream_as_path_store_path_t *
 bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
                                        bgpstream_as_path_store_path_id_t id)
 {
-  khiter_t k;
+  /* also handles the special case for NULL path */
+  return store_path_lookup(store, id.path_idx);
+}
 
-  /* special case for NULL path */
-  if (id.path_hash == UINT32_MAX && id.path_id == UINT16_MAX) {
-    return NULL;
+int bgpstream_as_path_store_save(bgpstream_as_path_store_t *store,
+                                 const char *filename)
+{
+  char tmp_path[1024];
+  FILE *fp = NULL;
+  snapshot_hdr_t hdr;
+  snapshot_path_t rec;
+  bgpstream_as_path_store_path_t *spath;
+  index_slot_t *index = NULL;
+  static const uint8_t zeros[8] = {0};
+  size_t pad;
+  uint32_t i, mask, pos;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+  hdr.version = SNAPSHOT_VERSION;
+  hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+  hdr.paths_cnt = bgpstream_as_path_store_get_size(store);
+
+  /* build a single index for all the paths, with a load factor under 70% */
+  hdr.index_size = 16;
+  while ((uint64_t)hdr.paths_cnt * 10 > (uint64_t)hdr.index_size * 7) {
+    hdr.index_size *= 2;
   }
+  if ((index = malloc(sizeof(index_slot_t) * hdr.index_size)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < hdr.index_size; i++) {
+    index[i].idx = INDEX_EMPTY;
+  }
+  mask = hdr.index_size - 1;
+  for (i = 0; i < hdr.paths_cnt; i++) {
+    if ((spath = store_path_lookup(store, i)) == NULL) {
+      goto err;
+    }
+    for (pos = spath->hash & mask; index[pos].idx != INDEX_EMPTY;
+         pos = (pos + 1) & mask)
+      ;
+    index[pos].idx = i;
+    index[pos].tag = spath->hash >> 32;
+    hdr.data_len += spath->path.data_len;
+  }
+  /* keep the data section 8-byte aligned */
+  hdr.data_len = (hdr.data_len + 7) & ~(uint64_t)7;
 
-  if ((k = kh_get(pathset, store->path_set, id.path_hash)) ==
-      kh_end(store->path_set)) {
-    return NULL;
+  /* write to a temporary file, and only replace the snapshot once done */
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", filename) >=
+        (int)sizeof(tmp_path) ||
+      (fp = fopen(tmp_path, "w")) == NULL) {
+    goto err;
+  }
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+    goto err;
+  }
+  memset(&rec, 0, sizeof(rec));
+  for (i = 0; i < hdr.paths_cnt; i++) {
+    spath = store_path_lookup(store, i);
+    rec.hash = spath->hash;
+    rec.data_len = spath->path.data_len;
+    rec.seg_cnt = spath->path.seg_cnt;
+    rec.origin_offset = spath->path.origin_offset;
+    rec.is_core = spath->is_core;
+    if (fwrite(&rec, sizeof(rec), 1, fp) != 1) {
+      goto err;
+    }
+    rec.data_off += rec.data_len;
+  }
+  if (fwrite(index, sizeof(index_slot_t), hdr.index_size, fp) !=
+      hdr.index_size) {
+    goto err;
+  }
+  for (i = 0; i < hdr.paths_cnt; i++) {
+    spath = store_path_lookup(store, i);
+    if (spath->path.data_len > 0 &&
+        fwrite(spath->path.data, spath->path.data_len, 1, fp) != 1) {
+      goto err;
+    }
+  }
+  /* rec.data_off is now the unpadded length of the data section */
+  pad = hdr.data_len - rec.data_off;
+  if (pad > 0 && fwrite(zeros, 1, pad, fp) != pad) {
+    goto err;
+  }
+  if (fclose(fp) != 0) {
+    fp = NULL;
+    goto err;
+  }
+  fp = NULL;
+  if (rename(tmp_path, filename) != 0) {
+    goto err;
   }
 
-  if (id.path_id > kh_val(store->path_set, k).paths_cnt - 1) {
+  free(index);
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write AS path store snapshot %s",
+                filename);
+  if (fp != NULL) {
+    fclose(fp);
+    remove(tmp_path);
+  }
+  free(index);
+  return -1;
+}
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_load(const char *filename)
+{
+  bgpstream_as_path_store_t *store = NULL;
+  snapshot_hdr_t hdr;
+  struct stat st;
+  uint64_t len;
+  int fd;
+
+  if ((fd = open(filename, O_RDONLY)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open AS path store snapshot %s",
+                  filename);
     return NULL;
   }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hdr) ||
+      (store = malloc_zero(sizeof(bgpstream_as_path_store_t))) == NULL) {
+    goto err;
+  }
+  pthread_mutex_init(&store->chunks_lock, NULL);
+  store->map_len = st.st_size;
+  /* a shared mapping lets every process using the snapshot share the pages */
+  if ((store->map = mmap(NULL, store->map_len, PROT_READ, MAP_SHARED, fd,
+                         0)) == MAP_FAILED) {
+    store->map = NULL;
+    goto err;
+  }
+  close(fd);
+  fd = -1;
+
+  memcpy(&hdr, store->map, sizeof(hdr));
+  len = sizeof(hdr) + (uint64_t)hdr.paths_cnt * sizeof(snapshot_path_t) +
+        (uint64_t)hdr.index_size * sizeof(index_slot_t) + hdr.data_len;
+  if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.version != SNAPSHOT_VERSION ||
+      hdr.byte_order != SNAPSHOT_BYTE_ORDER || hdr.paths_cnt == INDEX_EMPTY ||
+      hdr.index_size == 0 || (hdr.index_size & (hdr.index_size - 1)) != 0 ||
+      hdr.index_size <= hdr.paths_cnt || len != store->map_len) {
+    goto err;
+  }
+
+  store->paths_cnt = hdr.paths_cnt;
+  store->snap_paths = (const snapshot_path_t *)(store->map + sizeof(hdr));
+  store->snap_index = (const index_slot_t *)(store->snap_paths + hdr.paths_cnt);
+  store->snap_index_size = hdr.index_size;
+  store->snap_data = (const uint8_t *)(store->snap_index + hdr.index_size);
+  store->snap_data_len = hdr.data_len;
+
+  /* store paths are built lazily, one chunk at a time */
+  if ((store->chunks = malloc_zero(sizeof(bgpstream_as_path_store_path_t *) *
+                                   PATHS_CHUNKS_MAX)) == NULL) {
+    goto err;
+  }
 
-  return &kh_val(store->path_set, k).paths[id.path_id];
+  return store;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid AS path store snapshot %s",
+                filename);
+  if (fd >= 0) {
+    close(fd);
+  }
+  bgpstream_as_path_store_destroy(store);
+  return NULL;
 }
 
 bgpstream_as_path_t *bgpstream_as_path_store_path_get_path(
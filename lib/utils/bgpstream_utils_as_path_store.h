@@ -43,6 +43,9 @@
  *
  * @{ */
 
+/** Path index used to represent a NULL (empty) path */
+#define BGPSTREAM_AS_PATH_STORE_NULL_PATH_IDX UINT32_MAX
+
 /** @} */
 
 /**
@@ -73,16 +76,16 @@ typedef struct bgpstream_as_path_store_path bgpstream_as_path_store_path_t;
 /** Represents a single path in the store
  *
  * A path ID should be treated as an opaque identifier.
+ *
+ * IDs are stable for the lifetime of the store: a path keeps the ID it was
+ * first assigned, and IDs are allocated densely starting from 0.
  */
 typedef struct bgpstream_as_path_store_path_id {
 
-  /** An internal hash of the origin ASN segment of the path */
-  uint32_t path_hash;
-
-  /** ID of the path within the origin pathset */
-  uint16_t path_id;
+  /** Index of the path within the store */
+  uint32_t path_idx;
 
-} __attribute__((packed)) bgpstream_as_path_store_path_id_t;
+} bgpstream_as_path_store_path_id_t;
 
 /** Store path iterator structure */
 typedef struct bgpstream_as_path_store_path_iter {
@@ -111,6 +114,52 @@ typedef struct bgpstream_as_path_store_path_iter {
  */
 bgpstream_as_path_store_t *bgpstream_as_path_store_create(void);
 
+/** Create a new AS Path Store that can be shared by multiple threads
+ *
+ * @return pointer to the created store if successful, NULL otherwise
+ *
+ * A concurrent store shards its path index over several independently locked
+ * shards, so that many threads can call bgpstream_as_path_store_get_path_id,
+ * bgpstream_as_path_store_insert_path and
+ * bgpstream_as_path_store_get_store_path at the same time, all sharing a
+ * single path ID space. Store paths never move once they have been added.
+ *
+ * @note the store iterator functions are not thread-safe, and must only be
+ * used once all inserting threads are done.
+ */
+bgpstream_as_path_store_t *bgpstream_as_path_store_create_concurrent(void);
+
+/** Load an AS Path Store from a snapshot file
+ *
+ * @param filename      path to a snapshot written by
+ *                      bgpstream_as_path_store_save
+ * @return pointer to the loaded store if successful, NULL otherwise
+ *
+ * The snapshot is mmap'ed read-only rather than read into memory, so loading
+ * is instant regardless of its size, and processes on the same host that load
+ * the same snapshot share its memory. Path lookups
+ * (bgpstream_as_path_store_get_path_id) and
+ * bgpstream_as_path_store_get_store_path work directly on the mapped file, and
+ * may be used from multiple threads.
+ *
+ * @note a loaded store is read-only: looking up a path that is not in the
+ * snapshot fails rather than adding it.
+ */
+bgpstream_as_path_store_t *bgpstream_as_path_store_load(const char *filename);
+
+/** Save a snapshot of the given AS Path Store
+ *
+ * @param store         pointer to the store to save
+ * @param filename      path of the snapshot file to write
+ * @return 0 if the snapshot was written successfully, -1 otherwise
+ *
+ * Path IDs are preserved in the snapshot. The file uses the byte order of the
+ * host that wrote it, and can only be loaded by hosts with the same byte
+ * order. The store must not be modified while it is being saved.
+ */
+int bgpstream_as_path_store_save(bgpstream_as_path_store_t *store,
+                                 const char *filename);
+
 /** Destroy the given AS Path Store
  *
  * @param store         pointer to the store to destroy
@@ -169,6 +218,8 @@ int bgpstream_as_path_store_get_path_id(bgpstream_as_path_store_t *store,
  *
  * If a native BGPStream path is required, use the
  * bgpstream_as_path_store_path_get_path function.
+ *
+ * The returned pointer remains valid until the store is destroyed.
  */
 bgpstream_as_path_store_path_t *
 bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
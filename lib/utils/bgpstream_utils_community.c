@@ -25,6 +25,7 @@
  */
 
 #include "bgpstream_utils_community_int.h"
+#include "bgpstream_utils_mem_int.h"
 #include "bgpstream_utils_private.h"
 #include "config.h"
 #include "khash.h"
@@ -35,8 +36,19 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define COMMUNITY_NEON
+#endif
+
 #define COMMUNITY_MAX_STR_LEN 16
 
+/* sets with up to this many communities are searched with a (vectorized)
+ * linear scan, larger ones also keep a sorted index for binary search */
+#define COMMUNITY_LINEAR_MAX 16
+
 /** Set of community values */
 struct bgpstream_community_set {
 
@@ -52,13 +64,165 @@ struct bgpstream_community_set {
   /** Communities hash (OR between
    *  all communities in the set) */
   bgpstream_community_t communities_hash;
+
+  /** Bloom filter of the communities in the set (two bits per community) */
+  uint64_t communities_bloom;
+
+  /** Sorted (asn << 16 | value) keys of the communities, only maintained
+   *  for sets larger than COMMUNITY_LINEAR_MAX */
+  uint32_t *sorted;
+
+  /** Number of valid keys in the sorted index (either 0 or communities_cnt) */
+  int sorted_cnt;
+
+  /** Number of keys allocated in the sorted index */
+  int sorted_alloc_cnt;
 };
 
+/* ========== PRIVATE FUNCTIONS ========== */
+
+static inline uint32_t comm_key(const bgpstream_community_t *c)
+{
+  return ((uint32_t)c->asn << 16) | c->value;
+}
+
+static inline uint64_t comm_bloom_bits(const bgpstream_community_t *c)
+{
+  uint64_t h = comm_key(c) * 0x9e3779b97f4a7c15ULL;
+  return (1ULL << (h >> 58)) | (1ULL << ((h >> 52) & 63));
+}
+
+/* index of the first key >= key in the sorted index */
+static int sorted_lower_bound(const uint32_t *keys, int cnt, uint32_t key)
+{
+  int lo = 0, hi = cnt, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *)a, kb = *(const uint32_t *)b;
+  return (ka > kb) - (ka < kb);
+}
+
+static int sorted_reserve(bgpstream_community_set_t *set, int cnt)
+{
+  int alloc = set->sorted_alloc_cnt;
+  uint32_t *keys;
+
+  if (alloc >= cnt) {
+    return 0;
+  }
+  while (alloc < cnt) {
+    alloc = (alloc == 0) ? COMMUNITY_LINEAR_MAX * 2 : alloc * 2;
+  }
+  if ((keys = bgpstream_mem_realloc(BGPSTREAM_MEM_UTILS, set->sorted,
+                                     sizeof(uint32_t) * alloc)) == NULL) {
+    return -1;
+  }
+  set->sorted = keys;
+  set->sorted_alloc_cnt = alloc;
+  return 0;
+}
+
+/* recompute the summary, the bloom filter and (for large sets) the sorted
+ * index from the community array */
+static int set_reindex(bgpstream_community_set_t *set)
+{
+  int i, j;
+  int cnt = set->communities_cnt;
+  uint32_t hash = 0, key;
+  uint64_t bloom = 0;
+
+  for (i = 0; i < cnt; i++) {
+    hash |= set->communities[i].ui32;
+    bloom |= comm_bloom_bits(&set->communities[i]);
+  }
+  set->communities_hash.ui32 = hash;
+  set->communities_bloom = bloom;
+  set->sorted_cnt = 0;
+
+  if (cnt <= COMMUNITY_LINEAR_MAX) {
+    return 0;
+  }
+  if (sorted_reserve(set, cnt) != 0) {
+    /* lookups fall back to a linear scan */
+    return -1;
+  }
+  for (i = 0; i < cnt; i++) {
+    set->sorted[i] = comm_key(&set->communities[i]);
+  }
+  if (cnt <= COMMUNITY_LINEAR_MAX * 4) {
+    /* insertion sort, community lists are often (nearly) sorted already */
+    for (i = 1; i < cnt; i++) {
+      key = set->sorted[i];
+      for (j = i; j > 0 && set->sorted[j - 1] > key; j--) {
+        set->sorted[j] = set->sorted[j - 1];
+      }
+      set->sorted[j] = key;
+    }
+  } else {
+    qsort(set->sorted, cnt, sizeof(uint32_t), key_cmp);
+  }
+  set->sorted_cnt = cnt;
+  return 0;
+}
+
+/* linear search for an exact community value */
+static int linear_find(const bgpstream_community_t *comms, int cnt,
+                       uint32_t ui32)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi32((int)ui32);
+  for (; i + 4 <= cnt; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&comms[i]);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, needle)) != 0) {
+      return 1;
+    }
+  }
+#elif defined(COMMUNITY_NEON)
+  const uint32x4_t needle = vdupq_n_u32(ui32);
+  for (; i + 4 <= cnt; i += 4) {
+    uint32x4_t v = vld1q_u32((const uint32_t *)&comms[i]);
+    if (vmaxvq_u32(vceqq_u32(v, needle)) != 0) {
+      return 1;
+    }
+  }
+#endif
+  for (; i < cnt; i++) {
+    if (comms[i].ui32 == ui32) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /* ========== PUBLIC FUNCTIONS ========== */
 
 int bgpstream_community_snprintf(char *buf, size_t len,
                                  const bgpstream_community_t *comm)
 {
+  int n;
+
+  /* two 5-digit values, the separator and the nul */
+  if (len > 11) {
+    n = bs_u32_to_str(buf, comm->asn);
+    buf[n++] = ':';
+    n += bs_u32_to_str(buf + n, comm->value);
+    buf[n] = '\0';
+    return n;
+  }
   return snprintf(buf, len, "%" PRIu16 ":%" PRIu16, comm->asn, comm->value);
 }
 
@@ -169,7 +333,9 @@ bgpstream_community_set_t *bgpstream_community_set_create()
 {
   bgpstream_community_set_t *set = NULL;
 
-  if ((set = malloc_zero(sizeof(bgpstream_community_set_t))) == NULL) {
+  set = bgpstream_mem_malloc_zero(BGPSTREAM_MEM_UTILS,
+                                  sizeof(bgpstream_community_set_t));
+  if (set == NULL) {
     return NULL;
   }
 
@@ -180,39 +346,63 @@ void bgpstream_community_set_clear(bgpstream_community_set_t *set)
 {
   set->communities_cnt = 0;
   set->communities_hash.ui32 = 0;
+  set->communities_bloom = 0;
+  set->sorted_cnt = 0;
 }
 
 void bgpstream_community_set_destroy(bgpstream_community_set_t *set)
 {
   /* alloc cnt is < 0 if owned externally */
   if (set->communities_alloc_cnt > 0) {
-    free(set->communities);
+    bgpstream_mem_free(BGPSTREAM_MEM_UTILS, set->communities);
   }
   set->communities = NULL;
   set->communities_cnt = 0;
   set->communities_alloc_cnt = 0;
   set->communities_hash.ui32 = 0;
+  bgpstream_mem_free(BGPSTREAM_MEM_UTILS, set->sorted);
+  set->sorted = NULL;
 
-  free(set);
+  bgpstream_mem_free(BGPSTREAM_MEM_UTILS, set);
 }
 
 int bgpstream_community_set_copy(bgpstream_community_set_t *dst,
                                  const bgpstream_community_set_t *src)
 {
+  if (dst->communities_alloc_cnt < 0) {
+    /* don't realloc memory we don't own */
+    dst->communities = NULL;
+    dst->communities_alloc_cnt = 0;
+  }
   if (dst->communities_alloc_cnt < src->communities_cnt) {
-    if ((dst->communities =
-           realloc(dst->communities, sizeof(bgpstream_community_t) *
-                                       src->communities_cnt)) == NULL) {
+    if ((dst->communities = bgpstream_mem_realloc(
+           BGPSTREAM_MEM_UTILS, dst->communities,
+           sizeof(bgpstream_community_t) * src->communities_cnt)) == NULL) {
       return -1;
     }
     dst->communities_alloc_cnt = src->communities_cnt;
   }
 
-  memcpy(dst->communities, src->communities,
-         sizeof(bgpstream_community_t) * src->communities_cnt);
+  if (src->communities_cnt > 0) {
+    memcpy(dst->communities, src->communities,
+           sizeof(bgpstream_community_t) * src->communities_cnt);
+  }
 
   dst->communities_cnt = src->communities_cnt;
   dst->communities_hash = src->communities_hash;
+  dst->communities_bloom = src->communities_bloom;
+  dst->sorted_cnt = 0;
+
+  if (src->sorted_cnt == 0) {
+    /* small set (or one whose index could not be allocated) */
+    return (src->communities_cnt > COMMUNITY_LINEAR_MAX) ? set_reindex(dst)
+                                                          : 0;
+  }
+  if (sorted_reserve(dst, src->sorted_cnt) != 0) {
+    return -1;
+  }
+  memcpy(dst->sorted, src->sorted, sizeof(uint32_t) * src->sorted_cnt);
+  dst->sorted_cnt = src->sorted_cnt;
 
   return 0;
 }
@@ -231,18 +421,57 @@ int bgpstream_community_set_size(const bgpstream_community_set_t *set)
 int bgpstream_community_set_insert(bgpstream_community_set_t *set,
                                    bgpstream_community_t *comm)
 {
-  if (set->communities_cnt == set->communities_alloc_cnt) {
-    if ((set->communities = realloc(
-           set->communities, sizeof(bgpstream_community_t) *
-                               (set->communities_alloc_cnt + 1))) == NULL) {
+  bgpstream_community_t *comms;
+  int alloc;
+  int pos;
+  uint32_t key;
+
+  if (set->communities_alloc_cnt < 0) {
+    /* the array is not ours, so take a private copy before modifying it */
+    if ((comms = bgpstream_mem_malloc(BGPSTREAM_MEM_UTILS,
+                                      sizeof(bgpstream_community_t) *
+                                        (set->communities_cnt + 1))) == NULL) {
+      return -1;
+    }
+    memcpy(comms, set->communities,
+           sizeof(bgpstream_community_t) * set->communities_cnt);
+    set->communities = comms;
+    set->communities_alloc_cnt = set->communities_cnt + 1;
+  } else if (set->communities_cnt == set->communities_alloc_cnt) {
+    alloc = (set->communities_alloc_cnt == 0) ? 4
+                                              : set->communities_alloc_cnt * 2;
+    if ((comms = bgpstream_mem_realloc(BGPSTREAM_MEM_UTILS, set->communities,
+                                       sizeof(bgpstream_community_t) *
+                                         alloc)) == NULL) {
       return -1;
     }
-    set->communities_alloc_cnt++;
+    set->communities = comms;
+    set->communities_alloc_cnt = alloc;
   }
 
   set->communities[set->communities_cnt] = *comm;
   set->communities_cnt++;
   set->communities_hash.ui32 |= comm->ui32;
+  set->communities_bloom |= comm_bloom_bits(comm);
+
+  if (set->communities_cnt <= COMMUNITY_LINEAR_MAX) {
+    return 0;
+  }
+  if (set->sorted_cnt != set->communities_cnt - 1) {
+    /* the set just outgrew the linear scan */
+    set_reindex(set);
+    return 0;
+  }
+  if (sorted_reserve(set, set->communities_cnt) != 0) {
+    set->sorted_cnt = 0;
+    return 0;
+  }
+  key = comm_key(comm);
+  pos = sorted_lower_bound(set->sorted, set->sorted_cnt, key);
+  memmove(&set->sorted[pos + 1], &set->sorted[pos],
+          sizeof(uint32_t) * (set->sorted_cnt - pos));
+  set->sorted[pos] = key;
+  set->sorted_cnt++;
   return 0;
 }
 
@@ -250,25 +479,37 @@ int bgpstream_community_set_populate_from_array(bgpstream_community_set_t *set,
                                                 bgpstream_community_t *comms,
                                                 int comms_cnt)
 {
-  bgpstream_community_set_t tmp;
-  if (bgpstream_community_set_populate_from_array_zc(&tmp, comms, comms_cnt) !=
-      0) {
-    return -1;
+  if (set->communities_alloc_cnt < 0) {
+    set->communities = NULL;
+    set->communities_alloc_cnt = 0;
+  }
+  if (set->communities_alloc_cnt < comms_cnt) {
+    if ((set->communities = bgpstream_mem_realloc(
+           BGPSTREAM_MEM_UTILS, set->communities,
+           sizeof(bgpstream_community_t) * comms_cnt)) == NULL) {
+      return -1;
+    }
+    set->communities_alloc_cnt = comms_cnt;
   }
-  return bgpstream_community_set_copy(set, &tmp);
+  if (comms_cnt > 0) {
+    memcpy(set->communities, comms, sizeof(bgpstream_community_t) * comms_cnt);
+  }
+  set->communities_cnt = comms_cnt;
+  set_reindex(set);
+  return 0;
 }
 
 int bgpstream_community_set_populate_from_array_zc(
   bgpstream_community_set_t *set, bgpstream_community_t *comms, int comms_cnt)
 {
+  if (set->communities_alloc_cnt > 0) {
+    bgpstream_mem_free(BGPSTREAM_MEM_UTILS, set->communities);
+  }
   set->communities_alloc_cnt = -1; /* signal that memory is not owned by us */
   set->communities = comms;
   set->communities_cnt = comms_cnt;
-  set->communities_hash.ui32 = 0;
-  int i;
-  for (i = 0; i < bgpstream_community_set_size(set); i++) {
-    set->communities_hash.ui32 |= set->communities[i].ui32;
-  }
+  /* the sorted index (if any) is still owned by the set */
+  set_reindex(set);
   return 0;
 }
 
@@ -292,13 +533,21 @@ bgpstream_community_set_hash(const bgpstream_community_set_t *set)
   return h;
 }
 
+bgpstream_community_t
+bgpstream_community_set_summary(const bgpstream_community_set_t *set)
+{
+  return set->communities_hash;
+}
+
 int bgpstream_community_set_equal(const bgpstream_community_set_t *set1,
                                   const bgpstream_community_set_t *set2)
 {
-  return (set1->communities_hash.ui32 == set2->communities_hash.ui32) &&
+  return (set1->communities_bloom == set2->communities_bloom) &&
+         (set1->communities_hash.ui32 == set2->communities_hash.ui32) &&
          (set1->communities_cnt == set2->communities_cnt) &&
-         memcmp(set1->communities, set2->communities,
-              sizeof(bgpstream_community_t) * set1->communities_cnt);
+         (set1->communities_cnt == 0 ||
+          memcmp(set1->communities, set2->communities,
+                 sizeof(bgpstream_community_t) * set1->communities_cnt) == 0);
 }
 
 /* ========== PROTECTED FUNCTIONS ========== */
@@ -318,9 +567,14 @@ int bgpstream_community_set_populate(bgpstream_community_set_t *set,
 
   cnt = len / sizeof(uint32_t);
 
+  if (set->communities_alloc_cnt < 0) {
+    set->communities = NULL;
+    set->communities_alloc_cnt = 0;
+  }
   if (set->communities_alloc_cnt < cnt) {
-    if ((set->communities = realloc(
-           set->communities, sizeof(bgpstream_community_t) * cnt)) == NULL) {
+    if ((set->communities = bgpstream_mem_realloc(
+           BGPSTREAM_MEM_UTILS, set->communities,
+           sizeof(bgpstream_community_t) * cnt)) == NULL) {
       return -1;
     }
     set->communities_alloc_cnt = cnt;
@@ -332,10 +586,10 @@ int bgpstream_community_set_populate(bgpstream_community_set_t *set,
     buf += sizeof(uint16_t);
     c->value = nptohs(buf);
     buf += sizeof(uint16_t);
-    set->communities_hash.ui32 |= c->ui32;
   }
 
   set->communities_cnt = cnt;
+  set_reindex(set);
 
   return 0;
 }
@@ -351,32 +605,61 @@ int bgpstream_community_set_match(const bgpstream_community_set_t *set,
                                   const bgpstream_community_t *com, uint8_t mask)
 {
   const bgpstream_community_t *hash = &set->communities_hash;
+  const bgpstream_community_t *c;
+  uint64_t bits;
+  uint32_t key;
+  int i, n, pos;
 
   /* first we verify if the hash is compatible */
-  if ((!(mask & BGPSTREAM_COMMUNITY_FILTER_ASN) ||
-       (hash->asn & com->asn) == com->asn) &&
-      (!(mask & BGPSTREAM_COMMUNITY_FILTER_VALUE) ||
-       (hash->value & com->value) == com->value)) {
-    const bgpstream_community_t *c;
-    int i;
-    int n = bgpstream_community_set_size(set);
+  if ((mask & BGPSTREAM_COMMUNITY_FILTER_ASN) &&
+      (hash->asn & com->asn) != com->asn) {
+    return 0;
+  }
+  if ((mask & BGPSTREAM_COMMUNITY_FILTER_VALUE) &&
+      (hash->value & com->value) != com->value) {
+    return 0;
+  }
+
+  n = bgpstream_community_set_size(set);
+
+  switch (mask & BGPSTREAM_COMMUNITY_FILTER_EXACT) {
+  case BGPSTREAM_COMMUNITY_FILTER_EXACT:
+    bits = comm_bloom_bits(com);
+    if ((set->communities_bloom & bits) != bits) {
+      return 0;
+    }
+    if (set->sorted_cnt == 0) {
+      return linear_find(set->communities, n, com->ui32);
+    }
+    key = comm_key(com);
+    pos = sorted_lower_bound(set->sorted, set->sorted_cnt, key);
+    return pos < set->sorted_cnt && set->sorted[pos] == key;
+
+  case BGPSTREAM_COMMUNITY_FILTER_ASN:
+    if (set->sorted_cnt != 0) {
+      /* all the values of an asn are adjacent in the index */
+      key = (uint32_t)com->asn << 16;
+      pos = sorted_lower_bound(set->sorted, set->sorted_cnt, key);
+      return pos < set->sorted_cnt && (set->sorted[pos] >> 16) == com->asn;
+    }
     for (i = 0; i < n; i++) {
-      c = bgpstream_community_set_get(set, i);
-      /* checking if asn match is requested and compatible */
-      if (mask & BGPSTREAM_COMMUNITY_FILTER_ASN) {
-        if (c->asn != com->asn) {
-          continue;
-        }
-      }
-      /* checking if value match is requested and compatible */
-      if (mask & BGPSTREAM_COMMUNITY_FILTER_VALUE) {
-        if (c->value != com->value) {
-          continue;
-        }
+      if (set->communities[i].asn == com->asn) {
+        return 1;
       }
+    }
+    return 0;
 
-      return 1;
+  case BGPSTREAM_COMMUNITY_FILTER_VALUE:
+    for (i = 0; i < n; i++) {
+      c = &set->communities[i];
+      if (c->value == com->value) {
+        return 1;
+      }
     }
+    return 0;
+
+  default:
+    /* wildcard, any community matches */
+    return n > 0;
   }
-  return 0;
 }
@@ -285,6 +285,17 @@ int bgpstream_community_set_populate_from_array_zc(
 uint32_t
 bgpstream_community_set_hash(const bgpstream_community_set_t *set);
 
+/** Get the summary of the given community set
+ *
+ * @param set           pointer to the community set
+ * @return the bitwise OR of all the communities in the set
+ *
+ * A community can only be in the set if all of its bits are set in the
+ * summary, so this can be used to reject sets without searching them.
+ */
+bgpstream_community_t
+bgpstream_community_set_summary(const bgpstream_community_set_t *set);
+
 /** Compare two community sets for equality
  *
  * @param set1          pointer to the first community set to compare
@@ -303,6 +314,9 @@ int bgpstream_community_set_equal(const bgpstream_community_set_t *set1,
  * @param com          pointer to the community set to search
  * @return 1 if the set contains the community, 0 if not
  *
+ * Most absent communities are rejected by the set's bloom filter. Small sets
+ * are then scanned (four communities at a time where SIMD is available),
+ * larger ones are binary searched in a sorted index kept alongside the set.
  */
 int bgpstream_community_set_exists(const bgpstream_community_set_t *set,
                                    const bgpstream_community_t *com);
@@ -315,6 +329,8 @@ int bgpstream_community_set_exists(const bgpstream_community_set_t *set,
  *                     the asn field or the value field
  * @return 1 if the set matches the community, 0 if not
  *
+ * Exact and ASN-only matches use the sorted index of large sets, value-only
+ * matches always scan the set.
  */
 int bgpstream_community_set_match(const bgpstream_community_set_t *set,
                                   const bgpstream_community_t *com, uint8_t mask);
@@ -26,6 +26,8 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "khash.h"
 #include "utils.h"
@@ -43,18 +45,274 @@ KHASH_INIT(bgpstream_id_set /* name */, uint32_t /* khkey_t */,
            kh_int_hash_func /*__hash_func */,
            kh_int_hash_equal /* __hash_equal */)
 
+/* Sets start out as hashes, and are converted to (Roaring-style) bitmap
+ * containers once they hold more than this many IDs: each container holds the
+ * IDs that share their high 16 bits, either as a sorted array of their low 16
+ * bits or, once that would be larger, as a bitmap of all 65536 of them */
+#define ID_SET_HASH_MAX 1024
+#define CONTAINER_ARRAY_MAX 4096
+#define CONTAINER_BITMAP_WORDS (65536 / 64)
+
+typedef struct id_container {
+  uint16_t high;
+  /* number of IDs in the container */
+  uint32_t cnt;
+  /* number of entries allocated for the array (0 if this is a bitmap) */
+  uint32_t alloc;
+  union {
+    uint16_t *array;
+    uint64_t *bitmap;
+  } u;
+} id_container_t;
+
 struct bgpstream_id_set {
   khiter_t k;
+  /* NULL once the set has been converted to containers */
   khash_t(bgpstream_id_set) * hash;
+
+  /* containers, sorted by high bits */
+  id_container_t *containers;
+  int containers_cnt;
+  int containers_alloc;
+  int size;
+
+  /* container iterator */
+  int iter_c;
+  uint32_t iter_i;
+  uint32_t iter_id;
 };
 
+#define IS_BITMAP(c) ((c)->alloc == 0)
+
+static int popcount64(uint64_t v)
+{
+  v = v - ((v >> 1) & UINT64_C(0x5555555555555555));
+  v = (v & UINT64_C(0x3333333333333333)) +
+      ((v >> 2) & UINT64_C(0x3333333333333333));
+  v = (v + (v >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+  return (int)((v * UINT64_C(0x0101010101010101)) >> 56);
+}
+
+/* index of the first entry of the (sorted) array that is >= low */
+static uint32_t array_lower_bound(const uint16_t *array, uint32_t cnt,
+                                  uint16_t low)
+{
+  uint32_t lo = 0, hi = cnt, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (array[mid] < low) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* index of the first container whose high bits are >= high */
+static int container_lower_bound(bgpstream_id_set_t *set, uint16_t high)
+{
+  int lo = 0, hi = set->containers_cnt, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (set->containers[mid].high < high) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static id_container_t *container_find(bgpstream_id_set_t *set, uint16_t high)
+{
+  int i;
+
+  // sets of ASNs typically have only a couple of containers
+  if (set->containers_cnt <= 4) {
+    for (i = 0; i < set->containers_cnt; i++) {
+      if (set->containers[i].high == high) {
+        return &set->containers[i];
+      }
+    }
+    return NULL;
+  }
+  i = container_lower_bound(set, high);
+  if (i < set->containers_cnt && set->containers[i].high == high) {
+    return &set->containers[i];
+  }
+  return NULL;
+}
+
+static int container_contains(const id_container_t *c, uint16_t low)
+{
+  uint32_t i;
+
+  if (IS_BITMAP(c)) {
+    return (c->u.bitmap[low / 64] >> (low % 64)) & 1;
+  }
+  i = array_lower_bound(c->u.array, c->cnt, low);
+  return i < c->cnt && c->u.array[i] == low;
+}
+
+/* get the container for the given high bits, adding an empty one if needed */
+static id_container_t *container_get(bgpstream_id_set_t *set, uint16_t high)
+{
+  id_container_t *c, *tmp;
+  int i;
+
+  i = container_lower_bound(set, high);
+  if (i < set->containers_cnt && set->containers[i].high == high) {
+    return &set->containers[i];
+  }
+
+  if (set->containers_cnt == set->containers_alloc) {
+    if ((tmp = realloc(set->containers, sizeof(id_container_t) *
+                                          (set->containers_alloc * 2 + 1))) ==
+        NULL) {
+      return NULL;
+    }
+    set->containers = tmp;
+    set->containers_alloc = set->containers_alloc * 2 + 1;
+  }
+  memmove(&set->containers[i + 1], &set->containers[i],
+          sizeof(id_container_t) * (set->containers_cnt - i));
+  set->containers_cnt++;
+
+  c = &set->containers[i];
+  c->high = high;
+  c->cnt = 0;
+  c->alloc = 4;
+  if ((c->u.array = malloc(sizeof(uint16_t) * c->alloc)) == NULL) {
+    memmove(&set->containers[i], &set->containers[i + 1],
+            sizeof(id_container_t) * (--set->containers_cnt - i));
+    return NULL;
+  }
+  return c;
+}
+
+static int container_to_bitmap(id_container_t *c)
+{
+  uint64_t *bitmap;
+  uint32_t i;
+
+  if ((bitmap = calloc(CONTAINER_BITMAP_WORDS, sizeof(uint64_t))) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < c->cnt; i++) {
+    bitmap[c->u.array[i] / 64] |= UINT64_C(1) << (c->u.array[i] % 64);
+  }
+  free(c->u.array);
+  c->u.bitmap = bitmap;
+  c->alloc = 0;
+  return 0;
+}
+
+/* returns 1 if the id was inserted, 0 if it already existed, -1 on error */
+static int container_insert(id_container_t *c, uint16_t low)
+{
+  uint16_t *tmp;
+  uint32_t i;
+
+  if (!IS_BITMAP(c)) {
+    i = array_lower_bound(c->u.array, c->cnt, low);
+    if (i < c->cnt && c->u.array[i] == low) {
+      return 0;
+    }
+    if (c->cnt < CONTAINER_ARRAY_MAX) {
+      if (c->cnt == c->alloc) {
+        if ((tmp = realloc(c->u.array, sizeof(uint16_t) * c->alloc * 2)) ==
+            NULL) {
+          return -1;
+        }
+        c->u.array = tmp;
+        c->alloc *= 2;
+      }
+      memmove(&c->u.array[i + 1], &c->u.array[i],
+              sizeof(uint16_t) * (c->cnt - i));
+      c->u.array[i] = low;
+      c->cnt++;
+      return 1;
+    }
+    // the array would now be larger than a bitmap
+    if (container_to_bitmap(c) != 0) {
+      return -1;
+    }
+  }
+
+  if ((c->u.bitmap[low / 64] >> (low % 64)) & 1) {
+    return 0;
+  }
+  c->u.bitmap[low / 64] |= UINT64_C(1) << (low % 64);
+  c->cnt++;
+  return 1;
+}
+
+static int containers_insert(bgpstream_id_set_t *set, uint32_t id)
+{
+  id_container_t *c;
+  int rc;
+
+  if ((c = container_get(set, id >> 16)) == NULL ||
+      (rc = container_insert(c, id & 0xffff)) < 0) {
+    return -1;
+  }
+  set->size += rc;
+  return rc;
+}
+
+static void containers_free(bgpstream_id_set_t *set)
+{
+  int i;
+
+  for (i = 0; i < set->containers_cnt; i++) {
+    if (IS_BITMAP(&set->containers[i])) {
+      free(set->containers[i].u.bitmap);
+    } else {
+      free(set->containers[i].u.array);
+    }
+  }
+  set->containers_cnt = 0;
+}
+
+static int hash_to_containers(bgpstream_id_set_t *set)
+{
+  khiter_t k;
+
+  for (k = kh_begin(set->hash); k != kh_end(set->hash); ++k) {
+    if (kh_exist(set->hash, k) &&
+        containers_insert(set, kh_key(set->hash, k)) < 0) {
+      containers_free(set);
+      set->size = 0;
+      return -1;
+    }
+  }
+  kh_destroy(bgpstream_id_set, set->hash);
+  set->hash = NULL;
+  return 0;
+}
+
+/* OR a bitmap container into another */
+static void bitmap_merge(id_container_t *dst, const id_container_t *src)
+{
+  int i, cnt = 0;
+
+  for (i = 0; i < CONTAINER_BITMAP_WORDS; i++) {
+    dst->u.bitmap[i] |= src->u.bitmap[i];
+    cnt += popcount64(dst->u.bitmap[i]);
+  }
+  dst->cnt = cnt;
+}
+
 /* PUBLIC FUNCTIONS */
 
 bgpstream_id_set_t *bgpstream_id_set_create()
 {
   bgpstream_id_set_t *set;
 
-  if ((set = (bgpstream_id_set_t *)malloc(sizeof(bgpstream_id_set_t))) ==
+  if ((set = (bgpstream_id_set_t *)malloc_zero(sizeof(bgpstream_id_set_t))) ==
       NULL) {
     return NULL;
   }
@@ -71,29 +329,74 @@ int bgpstream_id_set_insert(bgpstream_id_set_t *set, uint32_t id)
 {
   int khret;
   khiter_t k;
-  if ((k = kh_get(bgpstream_id_set, set->hash, id)) == kh_end(set->hash)) {
-    k = kh_put(bgpstream_id_set, set->hash, id, &khret);
-    return 1;
+
+  if (set->hash == NULL) {
+    return containers_insert(set, id);
   }
-  return 0;
+
+  if ((k = kh_get(bgpstream_id_set, set->hash, id)) != kh_end(set->hash)) {
+    return 0;
+  }
+  if (kh_size(set->hash) == ID_SET_HASH_MAX) {
+    if (hash_to_containers(set) != 0) {
+      return -1;
+    }
+    return containers_insert(set, id);
+  }
+  k = kh_put(bgpstream_id_set, set->hash, id, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  return 1;
 }
 
 int bgpstream_id_set_exists(bgpstream_id_set_t *set, uint32_t id)
 {
-  khiter_t k;
-  if ((k = kh_get(bgpstream_id_set, set->hash, id)) == kh_end(set->hash)) {
+  id_container_t *c;
+
+  if (set->hash != NULL) {
+    return kh_get(bgpstream_id_set, set->hash, id) != kh_end(set->hash);
+  }
+  if ((c = container_find(set, id >> 16)) == NULL) {
     return 0;
   }
-  return 1;
+  return container_contains(c, id & 0xffff);
 }
 
 int bgpstream_id_set_merge(bgpstream_id_set_t *dst_set,
                            bgpstream_id_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_id_set_insert(dst_set, kh_key(src_set->hash, k)) < 0) {
+  id_container_t *src, *dst;
+  uint32_t *id;
+  int i, rc;
+
+  if (dst_set->hash == NULL && src_set->hash == NULL) {
+    // merge container by container, OR-ing bitmaps a word at a time
+    for (i = 0; i < src_set->containers_cnt; i++) {
+      src = &src_set->containers[i];
+      if ((dst = container_get(dst_set, src->high)) == NULL) {
+        return -1;
+      }
+      if (IS_BITMAP(src)) {
+        if (!IS_BITMAP(dst) && container_to_bitmap(dst) != 0) {
+          return -1;
+        }
+        dst_set->size -= dst->cnt;
+        bitmap_merge(dst, src);
+        dst_set->size += dst->cnt;
+      } else {
+        for (uint32_t j = 0; j < src->cnt; j++) {
+          if ((rc = container_insert(dst, src->u.array[j])) < 0) {
+            return -1;
+          }
+          dst_set->size += rc;
+        }
+      }
+    }
+  } else {
+    bgpstream_id_set_rewind(src_set);
+    while ((id = bgpstream_id_set_next(src_set)) != NULL) {
+      if (bgpstream_id_set_insert(dst_set, *id) < 0) {
         return -1;
       }
     }
@@ -105,17 +408,52 @@ int bgpstream_id_set_merge(bgpstream_id_set_t *dst_set,
 
 void bgpstream_id_set_rewind(bgpstream_id_set_t *set)
 {
-  set->k = kh_begin(set->hash);
+  if (set->hash != NULL) {
+    set->k = kh_begin(set->hash);
+  }
+  set->iter_c = 0;
+  set->iter_i = 0;
 }
 
 uint32_t *bgpstream_id_set_next(bgpstream_id_set_t *set)
 {
   uint32_t *v = NULL;
-  for (; set->k != kh_end(set->hash); ++set->k) {
-    if (kh_exist(set->hash, set->k)) {
-      v = &kh_key(set->hash, set->k);
-      set->k++;
-      return v;
+  id_container_t *c;
+  uint64_t word;
+
+  if (set->hash != NULL) {
+    for (; set->k != kh_end(set->hash); ++set->k) {
+      if (kh_exist(set->hash, set->k)) {
+        v = &kh_key(set->hash, set->k);
+        set->k++;
+        return v;
+      }
+    }
+    return NULL;
+  }
+
+  for (; set->iter_c < set->containers_cnt; set->iter_c++, set->iter_i = 0) {
+    c = &set->containers[set->iter_c];
+    if (!IS_BITMAP(c)) {
+      if (set->iter_i < c->cnt) {
+        set->iter_id = ((uint32_t)c->high << 16) | c->u.array[set->iter_i++];
+        return &set->iter_id;
+      }
+      continue;
+    }
+    // iter_i is the next bit to look at
+    while (set->iter_i < 65536) {
+      word = c->u.bitmap[set->iter_i / 64] >> (set->iter_i % 64);
+      if (word == 0) {
+        set->iter_i = (set->iter_i / 64 + 1) * 64;
+        continue;
+      }
+      while ((word & 1) == 0) {
+        word >>= 1;
+        set->iter_i++;
+      }
+      set->iter_id = ((uint32_t)c->high << 16) | set->iter_i++;
+      return &set->iter_id;
     }
   }
   return NULL;
@@ -123,17 +461,30 @@ uint32_t *bgpstream_id_set_next(bgpstream_id_set_t *set)
 
 int bgpstream_id_set_size(bgpstream_id_set_t *set)
 {
-  return kh_size(set->hash);
+  if (set->hash != NULL) {
+    return kh_size(set->hash);
+  }
+  return set->size;
 }
 
 void bgpstream_id_set_destroy(bgpstream_id_set_t *set)
 {
-  kh_destroy(bgpstream_id_set, set->hash);
+  if (set->hash != NULL) {
+    kh_destroy(bgpstream_id_set, set->hash);
+  }
+  containers_free(set);
+  free(set->containers);
   free(set);
 }
 
 void bgpstream_id_set_clear(bgpstream_id_set_t *set)
 {
+  // a set that was converted to containers keeps using them, since it is
+  // likely to grow as large again
+  containers_free(set);
+  set->size = 0;
+  if (set->hash != NULL) {
+    kh_clear(bgpstream_id_set, set->hash);
+  }
   bgpstream_id_set_rewind(set);
-  kh_clear(bgpstream_id_set, set->hash);
 }
@@ -31,14 +31,15 @@
 #include "utils.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-/* static char buffer[INET6_ADDRSTRLEN]; */
+/* Initial number of intervals allocated for each address family */
+#define IPC_INTERVALS_INIT 64
 
 typedef struct struct_v4pfx_int_t {
   uint32_t start;
   uint32_t end;
-  struct struct_v4pfx_int_t *next;
 } v4pfx_int_t;
 
 typedef struct struct_v6pfx_int_t {
@@ -46,255 +47,244 @@ typedef struct struct_v6pfx_int_t {
   uint64_t start_ls;
   uint64_t end_ms;
   uint64_t end_ls;
-  struct struct_v6pfx_int_t *next;
 } v6pfx_int_t;
 
-/* IP Counter Linked List */
+/* IP Counter
+ *
+ * Each address family is kept as a contiguous array of disjoint intervals
+ * sorted by start address, so that lookups and the position of a new
+ * interval can be found with a binary search. */
 struct bgpstream_ip_counter {
-  v4pfx_int_t *v4list;
-  v6pfx_int_t *v6list;
+  v4pfx_int_t *v4;
+  size_t v4_cnt;
+  size_t v4_alloc;
+
+  v6pfx_int_t *v6;
+  size_t v6_cnt;
+  size_t v6_alloc;
 };
 
-/* static void */
-/* print_pfx_int_list(bgpstream_ip_counter_t *ipc) */
-/*  {  */
-/*    v4pfx_int_t *current4 = ipc->v4list; */
-/*    bgpstream_ipv4_addr_t ip4; */
-
-/*    ip4.version = BGPSTREAM_ADDR_VERSION_IPV4;  */
-/*    while(current4 != NULL)  */
-/*      {  */
-/*        ip4.addr.s_addr = htonl(current4->start);  */
-/*        bgpstream_addr_ntop(buffer, INET_ADDRSTRLEN, &ip4);  */
-/*        printf("IP space:\t%s\t", buffer);  */
-/*        ip4.addr.s_addr = htonl(current4->end);  */
-/*        bgpstream_addr_ntop(buffer, INET_ADDRSTRLEN, &ip4);  */
-/*        printf("%s\n", buffer);  */
-/*        current4 = current4->next;  */
-/*      } */
-
-/*    v6pfx_int_t *current6 = ipc->v6list;  */
-/*    bgpstream_ipv6_addr_t ip6; */
-/*    uint64_t tmp; */
-/*    ip6.version = BGPSTREAM_ADDR_VERSION_IPV6; */
-
-/*    while(current6 != NULL)  */
-/*      { */
-/*        tmp = htonll(current6->start_ms); */
-/*        memcpy(&ip6.addr.s6_addr[0], &tmp, sizeof(uint64_t)); */
-/*        tmp = htonll(current6->start_ls); */
-/*        memcpy(&ip6.addr.s6_addr[8], &tmp, sizeof(uint64_t)); */
-/*        bgpstream_addr_ntop(buffer, INET6_ADDRSTRLEN, &ip6);  */
-/*        printf("IP space:\t%s\t", buffer); */
-/*        tmp = htonll(current6->end_ms); */
-/*        memcpy(&ip6.addr.s6_addr[0], &tmp, sizeof(uint64_t)); */
-/*        tmp = htonll(current6->end_ls); */
-/*        memcpy(&ip6.addr.s6_addr[8],&tmp, sizeof(uint64_t)); */
-/*        bgpstream_addr_ntop(buffer, INET6_ADDRSTRLEN, &ip6);  */
-/*        printf("%s\n", buffer); */
-/*        current6 = current6->next;  */
-/*      } */
-/*  }  */
-
-static void one_step_merge4(v4pfx_int_t *pil)
+/* 128-bit comparisons on (ms, ls) pairs */
+#define V6_LT(a_ms, a_ls, b_ms, b_ls)                                          \
+  ((a_ms) < (b_ms) || ((a_ms) == (b_ms) && (a_ls) < (b_ls)))
+#define V6_LE(a_ms, a_ls, b_ms, b_ls)                                          \
+  ((a_ms) < (b_ms) || ((a_ms) == (b_ms) && (a_ls) <= (b_ls)))
+
+static int ensure_space(void **arr, size_t *alloc, size_t need, size_t esize)
 {
-  v4pfx_int_t *current = pil;
-  v4pfx_int_t *previous = pil;
-  if (current->next == NULL) {
-    return;
-  }
-  current = current->next;
+  size_t new_alloc;
+  void *tmp;
 
-  while (current != NULL) {
-    if (current->start <= previous->end) {
-      if (current->end > previous->end) {
-        previous->end = current->end;
-      }
-      previous->next = current->next;
-      free(current);
-      current = previous->next;
-    } else {
-      break;
-    }
+  if (need <= *alloc) {
+    return 0;
+  }
+  new_alloc = (*alloc == 0) ? IPC_INTERVALS_INIT : *alloc;
+  while (new_alloc < need) {
+    new_alloc *= 2;
+  }
+  if ((tmp = realloc(*arr, new_alloc * esize)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't realloc IP counter intervals");
+    return -1;
   }
+  *arr = tmp;
+  *alloc = new_alloc;
+  return 0;
 }
 
-static void one_step_merge6(v6pfx_int_t *pil)
+static void pfx_to_int4(bgpstream_ipv4_pfx_t *pfx, v4pfx_int_t *i)
 {
-  v6pfx_int_t *current = pil;
-  v6pfx_int_t *previous = pil;
-  if (current->next == NULL) {
-    return;
-  }
-  current = current->next;
+  uint32_t mask = ~(((uint64_t)1 << (32 - pfx->mask_len)) - 1);
+  i->start = ntohl(pfx->address.addr.s_addr) & mask;
+  i->end = i->start | (~mask);
+}
 
-  while (current != NULL) {
+static void pfx_to_int6(bgpstream_ipv6_pfx_t *pfx, v6pfx_int_t *i)
+{
+  uint64_t mask_ms;
+  uint64_t mask_ls;
 
-    /* current->start <= previous->end */
-    if (current->start_ms < previous->end_ms ||
-        (current->start_ms == previous->end_ms &&
-         current->start_ls <= previous->end_ls)) {
-      /* current->end > previous->end */
-      if (current->end_ms > previous->end_ms ||
-          (current->end_ms == previous->end_ms &&
-           current->end_ls > previous->end_ls)) {
-        previous->end_ms = current->end_ms;
-        previous->end_ls = current->end_ls;
-      }
-      previous->next = current->next;
-      free(current);
-      current = previous->next;
+  if (pfx->mask_len > 64) {
+    mask_ms = ~((uint64_t)0);
+    mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
+  } else {
+    mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
+    mask_ls = 0;
+  }
+  i->start_ms = nptohll(&pfx->address.addr.s6_addr[0]) & mask_ms;
+  i->end_ms = i->start_ms | (~mask_ms);
+  i->start_ls = nptohll(&pfx->address.addr.s6_addr[8]) & mask_ls;
+  i->end_ls = i->start_ls | (~mask_ls);
+}
+
+/* Index of the first interval whose end is >= start (i.e., the first one
+ * that is not entirely before the given address) */
+static size_t lower_bound4(bgpstream_ip_counter_t *ipc, uint32_t start)
+{
+  size_t lo = 0, hi = ipc->v4_cnt, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ipc->v4[mid].end < start) {
+      lo = mid + 1;
     } else {
-      break;
+      hi = mid;
     }
   }
+  return lo;
 }
 
-static int merge_in_sorted_queue4(v4pfx_int_t **pil, uint32_t start,
-                                  uint32_t end)
+static size_t lower_bound6(bgpstream_ip_counter_t *ipc, uint64_t start_ms,
+                           uint64_t start_ls)
 {
-  // create new v4pfx_int_t
-  v4pfx_int_t *p = NULL;
-  v4pfx_int_t *previous = *pil;
-  v4pfx_int_t *current = *pil;
-
-  while (current != NULL) {
-    if (start > current->end) {
-      previous = current;
-      current = current->next;
-      continue;
-    }
-    if (end < current->start) {
-      /* found a position where to insert  */
-      if ((p = (v4pfx_int_t *)malloc_zero(sizeof(v4pfx_int_t))) == NULL) {
-        bgpstream_log(BGPSTREAM_LOG_ERR,
-                      "can't malloc v4pfx_int_t structure");
-        return -1;
-      }
-      p->start = start;
-      p->end = end;
-      p->next = NULL;
-      if (previous != current) {
-        previous->next = p;
-      } else {
-        *pil = p;
-      }
-      p->next = current;
-      return 0;
-    }
-    /* At this point S <= cE and E >= cS
-     * so we can merge them */
-    if (current->start > start) {
-      current->start = start;
+  size_t lo = 0, hi = ipc->v6_cnt, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (V6_LT(ipc->v6[mid].end_ms, ipc->v6[mid].end_ls, start_ms, start_ls)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
-    if (current->end < end) {
-      current->end = end;
+  }
+  return lo;
+}
+
+static int merge_in_sorted_array4(bgpstream_ip_counter_t *ipc,
+                                  v4pfx_int_t *in)
+{
+  size_t i = lower_bound4(ipc, in->start);
+  size_t j;
+  v4pfx_int_t *cur;
+
+  if (i == ipc->v4_cnt || in->end < ipc->v4[i].start) {
+    /* no overlap: insert a new interval at position i */
+    if (ensure_space((void **)&ipc->v4, &ipc->v4_alloc, ipc->v4_cnt + 1,
+                     sizeof(v4pfx_int_t)) != 0) {
+      return -1;
     }
-    /* Now check from here on if there are other things
-     * to merge */
-    one_step_merge4(current);
+    memmove(&ipc->v4[i + 1], &ipc->v4[i],
+            (ipc->v4_cnt - i) * sizeof(v4pfx_int_t));
+    ipc->v4[i] = *in;
+    ipc->v4_cnt++;
     return 0;
   }
 
-  /*   if here we didn't find a place where to insert the
-   * interval, it is either the first position or the last */
-  if ((p = (v4pfx_int_t *)malloc_zero(sizeof(v4pfx_int_t))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v4pfx_int_t structure");
-    return -1;
+  /* At this point S <= cE and E >= cS so we can merge them, and then
+   * swallow any following interval that now overlaps */
+  cur = &ipc->v4[i];
+  if (in->start < cur->start) {
+    cur->start = in->start;
   }
-  p->start = start;
-  p->end = end;
-  p->next = NULL;
-  /* adding at the beginning of the queue */
-  if (previous == current) {
-    *pil = p;
-    return 0;
+  if (in->end > cur->end) {
+    cur->end = in->end;
+  }
+  for (j = i + 1; j < ipc->v4_cnt && ipc->v4[j].start <= cur->end; j++) {
+    if (ipc->v4[j].end > cur->end) {
+      cur->end = ipc->v4[j].end;
+    }
+  }
+  if (j > i + 1) {
+    memmove(&ipc->v4[i + 1], &ipc->v4[j],
+            (ipc->v4_cnt - j) * sizeof(v4pfx_int_t));
+    ipc->v4_cnt -= j - (i + 1);
   }
-  // adding at the end of the queue
-  previous->next = p;
   return 0;
 }
 
-static int merge_in_sorted_queue6(v6pfx_int_t **pil, uint64_t start_ms,
-                                  uint64_t start_ls, uint64_t end_ms,
-                                  uint64_t end_ls)
+static int merge_in_sorted_array6(bgpstream_ip_counter_t *ipc,
+                                  v6pfx_int_t *in)
 {
-  // create new v4pfx_int_t
-  v6pfx_int_t *p = NULL;
-  v6pfx_int_t *previous = *pil;
-  v6pfx_int_t *current = *pil;
-
-  while (current != NULL) {
-    /* start > current->end */
-    if (start_ms > current->end_ms ||
-        (start_ms == current->end_ms && start_ls > current->end_ls)) {
-      previous = current;
-      current = current->next;
-      continue;
+  size_t i = lower_bound6(ipc, in->start_ms, in->start_ls);
+  size_t j;
+  v6pfx_int_t *cur;
+
+  if (i == ipc->v6_cnt || V6_LT(in->end_ms, in->end_ls, ipc->v6[i].start_ms,
+                                ipc->v6[i].start_ls)) {
+    if (ensure_space((void **)&ipc->v6, &ipc->v6_alloc, ipc->v6_cnt + 1,
+                     sizeof(v6pfx_int_t)) != 0) {
+      return -1;
     }
-    /* end < current->start */
-    if (end_ms < current->start_ms ||
-        (end_ms == current->start_ms && end_ls < current->start_ls)) {
-      /* found a position where to insert  */
-      if ((p = (v6pfx_int_t *)malloc_zero(sizeof(v6pfx_int_t))) == NULL) {
-        bgpstream_log(BGPSTREAM_LOG_ERR,
-                      "can't malloc v6pfx_int_t structure");
-        return -1;
-      }
-      p->start_ms = start_ms;
-      p->start_ls = start_ls;
-      p->end_ms = end_ms;
-      p->end_ls = end_ls;
-      p->next = NULL;
-      if (previous != current) {
-        previous->next = p;
-      } else {
-        *pil = p;
-      }
-      p->next = current;
-      return 0;
-    }
-    /* At this point S <= cE and E >= cS
-     * so we can merge them */
-    /* current->start > start */
-    if (current->start_ms > start_ms ||
-        (current->start_ms == start_ms && current->start_ls > start_ls)) {
-      current->start_ms = start_ms;
-      current->start_ls = start_ls;
-    }
-    /* current->end < end */
-    if (current->end_ms < end_ms ||
-        (current->end_ms == end_ms && current->end_ls < end_ls)) {
-      current->end_ms = end_ms;
-      current->end_ls = end_ls;
-    }
-    /* Now check from here on if there are other things
-     * to merge */
-    one_step_merge6(current);
+    memmove(&ipc->v6[i + 1], &ipc->v6[i],
+            (ipc->v6_cnt - i) * sizeof(v6pfx_int_t));
+    ipc->v6[i] = *in;
+    ipc->v6_cnt++;
     return 0;
   }
 
-  /*   if here we didn't find a place where to insert the
-   * interval, it is either the first position or the last */
-  if ((p = (v6pfx_int_t *)malloc_zero(sizeof(v6pfx_int_t))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v6pfx_int_t structure");
-    return -1;
+  cur = &ipc->v6[i];
+  if (V6_LT(in->start_ms, in->start_ls, cur->start_ms, cur->start_ls)) {
+    cur->start_ms = in->start_ms;
+    cur->start_ls = in->start_ls;
   }
-  p->start_ms = start_ms;
-  p->start_ls = start_ls;
-  p->end_ms = end_ms;
-  p->end_ls = end_ls;
-  p->next = NULL;
-  /* adding at the beginning of the queue */
-  if (previous == current) {
-    *pil = p;
-    return 0;
+  if (V6_LT(cur->end_ms, cur->end_ls, in->end_ms, in->end_ls)) {
+    cur->end_ms = in->end_ms;
+    cur->end_ls = in->end_ls;
+  }
+  for (j = i + 1; j < ipc->v6_cnt && V6_LE(ipc->v6[j].start_ms,
+                                           ipc->v6[j].start_ls, cur->end_ms,
+                                           cur->end_ls);
+       j++) {
+    if (V6_LT(cur->end_ms, cur->end_ls, ipc->v6[j].end_ms,
+              ipc->v6[j].end_ls)) {
+      cur->end_ms = ipc->v6[j].end_ms;
+      cur->end_ls = ipc->v6[j].end_ls;
+    }
+  }
+  if (j > i + 1) {
+    memmove(&ipc->v6[i + 1], &ipc->v6[j],
+            (ipc->v6_cnt - j) * sizeof(v6pfx_int_t));
+    ipc->v6_cnt -= j - (i + 1);
   }
-  // adding at the end of the queue
-  previous->next = p;
   return 0;
 }
 
+static int int4_cmp(const void *a, const void *b)
+{
+  const v4pfx_int_t *x = a, *y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+static int int6_cmp(const void *a, const void *b)
+{
+  const v6pfx_int_t *x = a, *y = b;
+  if (x->start_ms != y->start_ms) {
+    return (x->start_ms > y->start_ms) ? 1 : -1;
+  }
+  return (x->start_ls > y->start_ls) - (x->start_ls < y->start_ls);
+}
+
+/* Coalesce overlapping intervals of an array sorted by start address */
+static size_t coalesce4(v4pfx_int_t *arr, size_t cnt)
+{
+  size_t i, out = 0;
+  for (i = 1; i < cnt; i++) {
+    if (arr[i].start <= arr[out].end) {
+      if (arr[i].end > arr[out].end) {
+        arr[out].end = arr[i].end;
+      }
+    } else {
+      arr[++out] = arr[i];
+    }
+  }
+  return (cnt == 0) ? 0 : out + 1;
+}
+
+static size_t coalesce6(v6pfx_int_t *arr, size_t cnt)
+{
+  size_t i, out = 0;
+  for (i = 1; i < cnt; i++) {
+    if (V6_LE(arr[i].start_ms, arr[i].start_ls, arr[out].end_ms,
+              arr[out].end_ls)) {
+      if (V6_LT(arr[out].end_ms, arr[out].end_ls, arr[i].end_ms,
+                arr[i].end_ls)) {
+        arr[out].end_ms = arr[i].end_ms;
+        arr[out].end_ls = arr[i].end_ls;
+      }
+    } else {
+      arr[++out] = arr[i];
+    }
+  }
+  return (cnt == 0) ? 0 : out + 1;
+}
+
 bgpstream_ip_counter_t *bgpstream_ip_counter_create()
 {
   bgpstream_ip_counter_t *ipc;
@@ -304,67 +294,226 @@ bgpstream_ip_counter_t *bgpstream_ip_counter_create()
                   "can't malloc bgpstream_ip_counter_t structure");
     return NULL;
   }
-  ipc->v4list = NULL;
-  ipc->v6list = NULL;
   return ipc;
 }
 
 int bgpstream_ip_counter_add(bgpstream_ip_counter_t *ipc, bgpstream_pfx_t *pfx)
 {
-  uint32_t start;
-  uint32_t end;
-  uint32_t mask;
-  unsigned char *tmp;
-  uint64_t start_ms = 0;
-  uint64_t start_ls = 0;
-  uint64_t end_ms = 0;
-  uint64_t end_ls = 0;
-  uint64_t mask_ms;
-  uint64_t mask_ls;
+  v4pfx_int_t i4;
+  v6pfx_int_t i6;
 
   if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
-    mask = ~(((uint64_t)1 << (32 - pfx->mask_len)) - 1);
-    start = ntohl(pfx->address.bs_ipv4.addr.s_addr);
-    start = start & mask;
-    end = start | (~mask);
-    return merge_in_sorted_queue4(&ipc->v4list, start, end);
-  } else {
-    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      tmp = &pfx->address.bs_ipv6.addr.s6_addr[0];
-      start_ms = nptohll(tmp);
-      tmp = &pfx->address.bs_ipv6.addr.s6_addr[8];
-      start_ls = nptohll(tmp);
-      /* printf("+++++++++  %"PRIu64" %"PRIu64"\n", start_ms, start_ls); */
-      if (pfx->mask_len > 64) {
-        /* len_ms = 0 */
-        mask_ms = ~((uint64_t)0);
-        /* len_ls = 64 - (pfx->mask_len - 64); */
-        mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
-      } else {
-        /* len_ms = 64 - pfx->mask_len; */
-        mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
-        /* len_ls = 64; */
-        /* mask_ls = ~( ((uint64_t)1 << 64) - 1); */
-        mask_ls = 0;
+    pfx_to_int4(&pfx->bs_ipv4, &i4);
+    return merge_in_sorted_array4(ipc, &i4);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    pfx_to_int6(&pfx->bs_ipv6, &i6);
+    return merge_in_sorted_array6(ipc, &i6);
+  }
+  return 0;
+}
+
+int bgpstream_ip_counter_add_bulk(bgpstream_ip_counter_t *ipc,
+                                  bgpstream_pfx_t *pfxs, size_t pfxs_cnt)
+{
+  size_t i;
+  size_t v4_old = ipc->v4_cnt;
+  size_t v6_old = ipc->v6_cnt;
+
+  if (pfxs_cnt == 0) {
+    return 0;
+  }
+  if (ensure_space((void **)&ipc->v4, &ipc->v4_alloc, ipc->v4_cnt + pfxs_cnt,
+                   sizeof(v4pfx_int_t)) != 0 ||
+      ensure_space((void **)&ipc->v6, &ipc->v6_alloc, ipc->v6_cnt + pfxs_cnt,
+                   sizeof(v6pfx_int_t)) != 0) {
+    return -1;
+  }
+
+  /* append all the new intervals, then sort and coalesce each family once */
+  for (i = 0; i < pfxs_cnt; i++) {
+    if (pfxs[i].address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      pfx_to_int4(&pfxs[i].bs_ipv4, &ipc->v4[ipc->v4_cnt++]);
+    } else if (pfxs[i].address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+      pfx_to_int6(&pfxs[i].bs_ipv6, &ipc->v6[ipc->v6_cnt++]);
+    }
+  }
+  if (ipc->v4_cnt != v4_old) {
+    qsort(ipc->v4, ipc->v4_cnt, sizeof(v4pfx_int_t), int4_cmp);
+    ipc->v4_cnt = coalesce4(ipc->v4, ipc->v4_cnt);
+  }
+  if (ipc->v6_cnt != v6_old) {
+    qsort(ipc->v6, ipc->v6_cnt, sizeof(v6pfx_int_t), int6_cmp);
+    ipc->v6_cnt = coalesce6(ipc->v6, ipc->v6_cnt);
+  }
+  return 0;
+}
+
+/* Merge two sorted arrays of intervals into a newly allocated one, coalescing
+ * overlapping intervals as they are appended */
+static int merge_arrays4(bgpstream_ip_counter_t *dst,
+                         const bgpstream_ip_counter_t *src)
+{
+  v4pfx_int_t *out, *next;
+  size_t i = 0, j = 0, cnt = 0;
+
+  if (src->v4_cnt == 0) {
+    return 0;
+  }
+  if ((out = malloc(sizeof(v4pfx_int_t) * (dst->v4_cnt + src->v4_cnt))) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc IP counter intervals");
+    return -1;
+  }
+  while (i < dst->v4_cnt || j < src->v4_cnt) {
+    if (j == src->v4_cnt ||
+        (i < dst->v4_cnt && dst->v4[i].start <= src->v4[j].start)) {
+      next = &dst->v4[i++];
+    } else {
+      next = &src->v4[j++];
+    }
+    if (cnt > 0 && next->start <= out[cnt - 1].end) {
+      if (next->end > out[cnt - 1].end) {
+        out[cnt - 1].end = next->end;
       }
+    } else {
+      out[cnt++] = *next;
+    }
+  }
+  free(dst->v4);
+  dst->v4 = out;
+  dst->v4_alloc = dst->v4_cnt + src->v4_cnt;
+  dst->v4_cnt = cnt;
+  return 0;
+}
+
+static int merge_arrays6(bgpstream_ip_counter_t *dst,
+                         const bgpstream_ip_counter_t *src)
+{
+  v6pfx_int_t *out, *next, *last;
+  size_t i = 0, j = 0, cnt = 0;
 
-      /* printf("MASKS:  %"PRIu64" %"PRIu64"\n", mask_ms, mask_ls); */
+  if (src->v6_cnt == 0) {
+    return 0;
+  }
+  if ((out = malloc(sizeof(v6pfx_int_t) * (dst->v6_cnt + src->v6_cnt))) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc IP counter intervals");
+    return -1;
+  }
+  while (i < dst->v6_cnt || j < src->v6_cnt) {
+    if (j == src->v6_cnt ||
+        (i < dst->v6_cnt &&
+         V6_LE(dst->v6[i].start_ms, dst->v6[i].start_ls, src->v6[j].start_ms,
+               src->v6[j].start_ls))) {
+      next = &dst->v6[i++];
+    } else {
+      next = &src->v6[j++];
+    }
+    if (cnt == 0 || V6_LT(out[cnt - 1].end_ms, out[cnt - 1].end_ls,
+                          next->start_ms, next->start_ls)) {
+      out[cnt++] = *next;
+      continue;
+    }
+    last = &out[cnt - 1];
+    if (V6_LT(last->end_ms, last->end_ls, next->end_ms, next->end_ls)) {
+      last->end_ms = next->end_ms;
+      last->end_ls = next->end_ls;
+    }
+  }
+  free(dst->v6);
+  dst->v6 = out;
+  dst->v6_alloc = dst->v6_cnt + src->v6_cnt;
+  dst->v6_cnt = cnt;
+  return 0;
+}
 
-      /* most significant */
-      start_ms = start_ms & mask_ms;
-      end_ms = start_ms | (~mask_ms);
-      /* printf("MS:  %"PRIu64" %"PRIu64"\n", start_ms, end_ms); */
+int bgpstream_ip_counter_merge(bgpstream_ip_counter_t *dst,
+                               const bgpstream_ip_counter_t *src)
+{
+  if (merge_arrays4(dst, src) != 0 || merge_arrays6(dst, src) != 0) {
+    return -1;
+  }
+  return 0;
+}
 
-      /* least significant */
-      start_ls = start_ls & mask_ls;
-      end_ls = start_ls | (~mask_ls);
-      /* printf("LS:  %"PRIu64" %"PRIu64"\n", start_ls, end_ls); */
+static uint64_t overlap4(const bgpstream_ip_counter_t *a,
+                         const bgpstream_ip_counter_t *b)
+{
+  size_t i = 0, j = 0;
+  uint32_t lo, hi;
+  uint64_t count = 0;
+
+  while (i < a->v4_cnt && j < b->v4_cnt) {
+    lo = (a->v4[i].start > b->v4[j].start) ? a->v4[i].start : b->v4[j].start;
+    hi = (a->v4[i].end < b->v4[j].end) ? a->v4[i].end : b->v4[j].end;
+    if (lo <= hi) {
+      count += (uint64_t)(hi - lo) + 1;
+    }
+    /* advance whichever interval ends first */
+    if (a->v4[i].end < b->v4[j].end) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return count;
+}
 
-      return merge_in_sorted_queue6(&ipc->v6list, start_ms, start_ls, end_ms,
-                                    end_ls);
+static uint64_t overlap6(const bgpstream_ip_counter_t *a,
+                         const bgpstream_ip_counter_t *b)
+{
+  size_t i = 0, j = 0;
+  const v6pfx_int_t *x, *y;
+  uint64_t lo_ms, lo_ls, hi_ms, hi_ls;
+  uint64_t count = 0;
+  /* last /64 that has been counted, so that intersections sharing a /64
+   * only count it once */
+  uint64_t last_ms = 0;
+  int counted = 0;
+
+  while (i < a->v6_cnt && j < b->v6_cnt) {
+    x = &a->v6[i];
+    y = &b->v6[j];
+    if (V6_LT(x->start_ms, x->start_ls, y->start_ms, y->start_ls)) {
+      lo_ms = y->start_ms;
+      lo_ls = y->start_ls;
+    } else {
+      lo_ms = x->start_ms;
+      lo_ls = x->start_ls;
+    }
+    if (V6_LT(x->end_ms, x->end_ls, y->end_ms, y->end_ls)) {
+      hi_ms = x->end_ms;
+      hi_ls = x->end_ls;
+      i++;
+    } else {
+      hi_ms = y->end_ms;
+      hi_ls = y->end_ls;
+      j++;
+    }
+    if (V6_LE(lo_ms, lo_ls, hi_ms, hi_ls)) {
+      if (counted && lo_ms <= last_ms) {
+        if (hi_ms <= last_ms) {
+          continue;
+        }
+        lo_ms = last_ms + 1;
+      }
+      count += (hi_ms - lo_ms) + 1;
+      last_ms = hi_ms;
+      counted = 1;
     }
   }
-  /* print_pfx_int_list(ipc); */
+  return count;
+}
+
+uint64_t bgpstream_ip_counter_overlap(const bgpstream_ip_counter_t *a,
+                                      const bgpstream_ip_counter_t *b,
+                                      bgpstream_addr_version_t v)
+{
+  if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return overlap4(a, b);
+  } else if (v == BGPSTREAM_ADDR_VERSION_IPV6) {
+    return overlap6(a, b);
+  }
   return 0;
 }
 
@@ -373,47 +522,38 @@ static uint32_t bgpstream_ip_counter_is_overlapping4(
     bgpstream_ipv4_pfx_t *pfx,
     uint8_t *more_specific)
 {
-  v4pfx_int_t *current = ipc->v4list;
-  uint32_t start = 0;
-  uint32_t end = 0;
-  uint32_t len = 0;
+  v4pfx_int_t p;
+  v4pfx_int_t *current;
   uint32_t pfx_size;
   uint32_t overlap_count = 0;
-  *more_specific = 0;
-  len = 32 - pfx->mask_len;
-  start = ntohl(pfx->address.addr.s_addr);
-  start = (start >> len) << len;
-  end = 0;
-  end = ~end;
-  end = (end >> len) << len;
-  end = start | (~end);
-  pfx_size = end - start + 1;
+  size_t i;
   /* intersection endpoints */
   uint32_t int_start;
   uint32_t int_end;
-  while (current != NULL) {
-    if (current->start > end) {
+
+  *more_specific = 0;
+  pfx_to_int4(pfx, &p);
+  pfx_size = p.end - p.start + 1;
+
+  for (i = lower_bound4(ipc, p.start); i < ipc->v4_cnt; i++) {
+    current = &ipc->v4[i];
+    if (current->start > p.end) {
       break;
     }
-    if (current->end < start) {
-      current = current->next;
-      continue;
-    }
     /* there is some overlap
      * max(start) and min(end) */
     int_start = current->start;
     int_end = current->end;
-    if (current->start < start) {
-      int_start = start;
+    if (current->start < p.start) {
+      int_start = p.start;
     }
-    if (current->end > end) {
-      int_end = end;
+    if (current->end > p.end) {
+      int_end = p.end;
     }
     if ((int_end - int_start + 1) == pfx_size) {
       *more_specific = 1;
     }
     overlap_count += int_end - int_start + 1;
-    current = current->next;
   }
   return overlap_count;
 }
@@ -423,105 +563,51 @@ static uint64_t bgpstream_ip_counter_is_overlapping6(
     bgpstream_ipv6_pfx_t *pfx,
     uint8_t *more_specific)
 {
-  v6pfx_int_t *current = ipc->v6list;
-  v6pfx_int_t *previous = ipc->v6list;
-
-  uint64_t start_ms = 0;
-  uint64_t start_ls = 0;
-  uint64_t end_ms = 0;
-  uint64_t end_ls = 0;
-  uint64_t mask_ms;
-  uint64_t mask_ls;
-  unsigned char *tmp;
+  v6pfx_int_t p;
+  v6pfx_int_t *current;
+  v6pfx_int_t *previous = NULL;
   uint64_t overlap_count = 0;
   uint64_t pfx_size;
-  *more_specific = 0;
-
-  tmp = &(pfx->address.addr.s6_addr[0]);
-  start_ms = nptohll(tmp);
-  tmp = &(pfx->address.addr.s6_addr[8]);
-  start_ls = nptohll(tmp);
-
-  /* printf("+++++++++  %"PRIu64" %"PRIu64"\n", start_ms, start_ls); */
-  if (pfx->mask_len > 64) {
-    /* len_ms = 0 */
-    mask_ms = ~((uint64_t)0);
-    /* len_ls = 64 - (pfx->mask_len - 64); */
-    mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
-  } else {
-    /* len_ms = 64 - pfx->mask_len; */
-    mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
-    /* len_ls = 64; */
-    /* mask_ls = ~( ((uint64_t)1 << 64) - 1); */
-    mask_ls = 0;
-  }
-
-  /* printf("MASKS:  %"PRIu64" %"PRIu64"\n", mask_ms, mask_ls); */
-
-  /* most significant */
-  start_ms = start_ms & mask_ms;
-  end_ms = start_ms | (~mask_ms);
-  /* printf("MS:  %"PRIu64" %"PRIu64"\n", start_ms, end_ms); */
-
-  /* least significant */
-  start_ls = start_ls & mask_ls;
-  end_ls = start_ls | (~mask_ls);
-  /* printf("LS:  %"PRIu64" %"PRIu64"\n", start_ls, end_ls); */
-
-  pfx_size = end_ms - start_ms + 1;
-
+  size_t i;
   /* intersection endpoints
    * (only most significant)*/
   uint64_t int_start_ms;
   uint64_t int_end_ms;
 
-  while (current != NULL) {
+  *more_specific = 0;
+  pfx_to_int6(pfx, &p);
+  pfx_size = p.end_ms - p.start_ms + 1;
+
+  i = lower_bound6(ipc, p.start_ms, p.start_ls);
+  if (i > 0) {
+    previous = &ipc->v6[i - 1];
+  }
+  for (; i < ipc->v6_cnt; i++) {
+    current = &ipc->v6[i];
     /* current->start > end */
-    if (current->start_ms > end_ms ||
-        (current->start_ms == end_ms && current->start_ls > end_ls)) {
+    if (V6_LT(p.end_ms, p.end_ls, current->start_ms, current->start_ls)) {
       break;
     }
-    /* current->end < start */
-    if (current->end_ms < start_ms ||
-        (current->end_ms == start_ms && current->end_ms < start_ls)) {
-      previous = current;
-      current = current->next;
-      continue;
-    }
     /* there is some overlap
      * max(start) and min(end) */
     int_start_ms = current->start_ms;
     int_end_ms = current->end_ms;
-    /* int_start_ls = current->start_ls; */
-    /* int_end_ls = current->end_ls; */
-    /* current->start < start */
-    if (current->start_ms < start_ms ||
-        (current->start_ms == start_ms && current->start_ms < start_ls)) {
-      int_start_ms = start_ms;
-      /* int_start_ls = start_ls; */
+    if (V6_LT(current->start_ms, current->start_ls, p.start_ms, p.start_ls)) {
+      int_start_ms = p.start_ms;
     }
-    /* current->end > end */
-    if (current->end_ms > end_ms ||
-        (current->end_ms == end_ms && current->end_ls > end_ls)) {
-      int_end_ms = end_ms;
-      /* int_end_ls = end_ls; */
+    if (V6_LT(p.end_ms, p.end_ls, current->end_ms, current->end_ls)) {
+      int_end_ms = p.end_ms;
     }
-    if (previous != current) {
-      if (current->start_ms != previous->start_ms ||
-          current->end_ms != previous->end_ms) {
-        if ((int_end_ms - int_start_ms + 1) == pfx_size) {
-          *more_specific = 1;
-        }
-        overlap_count += int_end_ms - int_start_ms + 1;
-      }
-    } else {
+    /* only count a /64 range once if the previous interval covered the
+     * same /64s (it could have been a /64+) */
+    if (previous == NULL || current->start_ms != previous->start_ms ||
+        current->end_ms != previous->end_ms) {
       if ((int_end_ms - int_start_ms + 1) == pfx_size) {
         *more_specific = 1;
       }
       overlap_count += int_end_ms - int_start_ms + 1;
     }
     previous = current;
-    current = current->next;
   }
   return overlap_count;
 }
@@ -547,32 +633,21 @@ uint64_t bgpstream_ip_counter_get_ipcount(bgpstream_ip_counter_t *ipc,
                                           bgpstream_addr_version_t v)
 {
   uint64_t ip_count = 0;
-
-  v4pfx_int_t *current4 = ipc->v4list;
-  v6pfx_int_t *current6 = ipc->v6list;
-  v6pfx_int_t *previous6 = ipc->v6list;
+  size_t i;
 
   if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
-    while (current4 != NULL) {
-      ip_count += (current4->end - current4->start) + 1;
-      current4 = current4->next;
+    for (i = 0; i < ipc->v4_cnt; i++) {
+      ip_count += (ipc->v4[i].end - ipc->v4[i].start) + 1;
     }
   } else {
     if (v == BGPSTREAM_ADDR_VERSION_IPV6) {
-      while (current6 != NULL) {
-
-        if (previous6 != current6) {
-          /* add a new /64 to the count if the previous one
-           * was different (it could have been a /64+ */
-          if (current6->start_ms != previous6->start_ms ||
-              current6->end_ms != previous6->end_ms) {
-            ip_count += (current6->end_ms - current6->start_ms) + 1;
-          }
-        } else { /* if it is the first interval, than we always add it */
-          ip_count += (current6->end_ms - current6->start_ms) + 1;
+      for (i = 0; i < ipc->v6_cnt; i++) {
+        /* add a new /64 to the count if the previous one
+         * was different (it could have been a /64+) */
+        if (i == 0 || ipc->v6[i].start_ms != ipc->v6[i - 1].start_ms ||
+            ipc->v6[i].end_ms != ipc->v6[i - 1].end_ms) {
+          ip_count += (ipc->v6[i].end_ms - ipc->v6[i].start_ms) + 1;
         }
-        previous6 = current6;
-        current6 = current6->next;
       }
     }
   }
@@ -581,28 +656,18 @@ uint64_t bgpstream_ip_counter_get_ipcount(bgpstream_ip_counter_t *ipc,
 
 void bgpstream_ip_counter_clear(bgpstream_ip_counter_t *ipc)
 {
-  v4pfx_int_t *current4 = ipc->v4list;
-  v4pfx_int_t *tmp4 = ipc->v4list;
-  v6pfx_int_t *current6 = ipc->v6list;
-  v6pfx_int_t *tmp6 = ipc->v6list;
-
-  while (tmp4 != NULL) {
-    current4 = tmp4;
-    tmp4 = tmp4->next;
-    free(current4);
-  }
-  ipc->v4list = NULL;
-
-  while (tmp6 != NULL) {
-    current6 = tmp6;
-    tmp6 = tmp6->next;
-    free(current6);
-  }
-  ipc->v6list = NULL;
+  /* keep the arrays around so that a cleared counter can be refilled
+   * without reallocating */
+  ipc->v4_cnt = 0;
+  ipc->v6_cnt = 0;
 }
 
 void bgpstream_ip_counter_destroy(bgpstream_ip_counter_t *ipc)
 {
-  bgpstream_ip_counter_clear(ipc);
+  if (ipc == NULL) {
+    return;
+  }
+  free(ipc->v4);
+  free(ipc->v6);
   free(ipc);
 }
@@ -27,6 +27,7 @@
 #ifndef __BGPSTREAM_UTILS_IPCNT_H
 #define __BGPSTREAM_UTILS_IPCNT_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "bgpstream_utils_pfx.h"
@@ -69,6 +70,21 @@ bgpstream_ip_counter_t *bgpstream_ip_counter_create(void);
  */
 int bgpstream_ip_counter_add(bgpstream_ip_counter_t *ipc, bgpstream_pfx_t *pfx);
 
+/** Add an array of prefixes to the IP Counter
+ *
+ * @param ipc          pointer to the IP Counter
+ * @param pfxs         array of prefixes to insert in IP Counter
+ * @param pfxs_cnt     number of prefixes in the array
+ * @return             0 if the prefixes were added correctly, -1 otherwise
+ *
+ * The prefixes do not need to be sorted. This is much faster than calling
+ * bgpstream_ip_counter_add for each prefix when loading a large number of
+ * prefixes (e.g., a full routing table), since the counter is sorted and
+ * coalesced only once.
+ */
+int bgpstream_ip_counter_add_bulk(bgpstream_ip_counter_t *ipc,
+                                  bgpstream_pfx_t *pfxs, size_t pfxs_cnt);
+
 /** Get the number of unique IPs in the IP Counter
  *
  * @param ipc            pointer to the IP Counter
@@ -92,6 +108,31 @@ uint64_t bgpstream_ip_counter_is_overlapping(bgpstream_ip_counter_t *ipc,
                                              bgpstream_pfx_t *pfx,
                                              uint8_t *more_specific);
 
+/** Merge the address space of one IP Counter into another
+ *
+ * @param dst            pointer to the IP Counter to modify
+ * @param src            pointer to the IP Counter to merge into dst
+ * @return               0 if the counters were merged correctly, -1 otherwise
+ *
+ * This is a linear sweep over the sorted intervals of both counters, so
+ * counters built independently (e.g., one per thread) can be combined
+ * cheaply at the end.
+ */
+int bgpstream_ip_counter_merge(bgpstream_ip_counter_t *dst,
+                               const bgpstream_ip_counter_t *src);
+
+/** Get the number of unique IPs covered by both IP Counters
+ *
+ * @param a              pointer to the first IP Counter
+ * @param b              pointer to the second IP Counter
+ * @param v              IP version
+ * @return               number of unique IPs in the intersection of a and b
+ *                       (unique /32 in IPv4, unique /64 in IPv6)
+ */
+uint64_t bgpstream_ip_counter_overlap(const bgpstream_ip_counter_t *a,
+                                      const bgpstream_ip_counter_t *b,
+                                      bgpstream_addr_version_t v);
+
 /** Empty the IP Counter
  *
  * @param ipc            pointer to the IP Counter to clear
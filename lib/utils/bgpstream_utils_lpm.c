@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bgpstream_log.h"
+#include "bgpstream_utils_lpm.h"
+#include "utils.h"
+
+/* The first level of a table is indexed by the first 16 bits of an address,
+ * and every level below it (a "chunk") by the next 8 bits. An entry is 0 if no
+ * prefix matches, the index of a chunk if LPM_CHUNK_FLAG is set, or else the
+ * index (plus one) of the result for the longest matching prefix. Prefixes are
+ * expanded into every entry they cover. */
+#define LPM_ROOT_SIZE 65536
+#define LPM_CHUNK_SIZE 256
+#define LPM_CHUNK_FLAG 0x80000000U
+
+/* number of addresses looked up together by the batch API */
+#define LPM_BATCH 8
+
+typedef struct lpm_result {
+  bgpstream_pfx_t pfx;
+  void *user;
+} lpm_result_t;
+
+struct bgpstream_lpm {
+  /* first level, for IPv4 and IPv6 (NULL if there are no such prefixes) */
+  uint32_t *root[2];
+
+  /* chunks, LPM_CHUNK_SIZE entries each */
+  uint32_t *chunks;
+  uint32_t chunks_cnt;
+  uint32_t chunks_alloc;
+
+  /* prefixes, sorted by mask length */
+  lpm_result_t *results;
+  uint32_t results_cnt;
+  uint32_t results_alloc;
+};
+
+#define LPM_VERSION_IDX(v) ((v) == BGPSTREAM_ADDR_VERSION_IPV6 ? 1 : 0)
+
+static bgpstream_patricia_walk_cb_result_t
+lpm_collect(const bgpstream_patricia_tree_t *pt,
+            const bgpstream_patricia_node_t *node, void *data)
+{
+  bgpstream_lpm_t *lpm = data;
+  lpm_result_t *res;
+
+  if (lpm->results_cnt == lpm->results_alloc) {
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  res = &lpm->results[lpm->results_cnt++];
+  bgpstream_pfx_copy(&res->pfx, bgpstream_patricia_tree_get_pfx(node));
+  bgpstream_addr_mask(&res->pfx.address, res->pfx.mask_len);
+  res->user = bgpstream_patricia_tree_get_user(bgpstream_nonconst_node(node));
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+static int lpm_result_cmp(const void *a, const void *b)
+{
+  return (int)((const lpm_result_t *)a)->pfx.mask_len -
+         (int)((const lpm_result_t *)b)->pfx.mask_len;
+}
+
+/* add a chunk with all entries set to fill, and return its index (or -1) */
+static int64_t lpm_chunk_alloc(bgpstream_lpm_t *lpm, uint32_t fill)
+{
+  uint32_t *tmp;
+  uint32_t alloc, i;
+
+  if (lpm->chunks_cnt == lpm->chunks_alloc) {
+    alloc = lpm->chunks_alloc ? lpm->chunks_alloc * 2 : 64;
+    if (alloc >= LPM_CHUNK_FLAG ||
+        (tmp = realloc(lpm->chunks, sizeof(uint32_t) * LPM_CHUNK_SIZE *
+                                      (size_t)alloc)) == NULL) {
+      return -1;
+    }
+    lpm->chunks = tmp;
+    lpm->chunks_alloc = alloc;
+  }
+  tmp = &lpm->chunks[(size_t)lpm->chunks_cnt * LPM_CHUNK_SIZE];
+  for (i = 0; i < LPM_CHUNK_SIZE; i++) {
+    tmp[i] = fill;
+  }
+  return lpm->chunks_cnt++;
+}
+
+static uint32_t *lpm_table(bgpstream_lpm_t *lpm, int v, int64_t chunk)
+{
+  return chunk < 0 ? lpm->root[v]
+                   : &lpm->chunks[(size_t)chunk * LPM_CHUNK_SIZE];
+}
+
+/* expand the given result into the table (results must be added shortest
+ * prefix first, so that longer prefixes overwrite the entries they share) */
+static int lpm_add(bgpstream_lpm_t *lpm, uint32_t res_idx)
+{
+  const bgpstream_pfx_t *pfx = &lpm->results[res_idx].pfx;
+  const uint8_t *bytes = pfx->address.addr;
+  int v = LPM_VERSION_IDX(pfx->address.version);
+  uint32_t *tbl, e, span, start, i;
+  int64_t cur = -1, chunk;
+  uint32_t idx = ((uint32_t)bytes[0] << 8) | bytes[1];
+  int pos = 16;
+
+  if (lpm->root[v] == NULL &&
+      (lpm->root[v] = calloc(LPM_ROOT_SIZE, sizeof(uint32_t))) == NULL) {
+    return -1;
+  }
+
+  // find (creating as needed) the level that holds the last bits of pfx
+  while (pfx->mask_len > pos) {
+    e = lpm_table(lpm, v, cur)[idx];
+    if ((e & LPM_CHUNK_FLAG) == 0) {
+      if ((chunk = lpm_chunk_alloc(lpm, e)) < 0) {
+        return -1;
+      }
+      e = LPM_CHUNK_FLAG | (uint32_t)chunk;
+      lpm_table(lpm, v, cur)[idx] = e;
+    }
+    cur = e & ~LPM_CHUNK_FLAG;
+    idx = bytes[pos / 8];
+    pos += 8;
+  }
+
+  span = 1U << (pos - pfx->mask_len);
+  start = idx & ~(span - 1);
+  tbl = lpm_table(lpm, v, cur);
+  for (i = start; i < start + span; i++) {
+    assert((tbl[i] & LPM_CHUNK_FLAG) == 0);
+    tbl[i] = res_idx + 1;
+  }
+  return 0;
+}
+
+/* PUBLIC FUNCTIONS */
+
+bgpstream_lpm_t *bgpstream_lpm_create(const bgpstream_patricia_tree_t *pt)
+{
+  bgpstream_lpm_t *lpm;
+  uint64_t cnt;
+  uint32_t i;
+
+  if ((lpm = malloc_zero(sizeof(bgpstream_lpm_t))) == NULL) {
+    return NULL;
+  }
+
+  cnt = bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) +
+        bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV6);
+  if (cnt >= LPM_CHUNK_FLAG) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Too many prefixes for an LPM table");
+    goto err;
+  }
+  if (cnt > 0 &&
+      (lpm->results = malloc(sizeof(lpm_result_t) * cnt)) == NULL) {
+    goto err;
+  }
+  lpm->results_alloc = cnt;
+  bgpstream_patricia_tree_walk(pt, lpm_collect, lpm);
+
+  qsort(lpm->results, lpm->results_cnt, sizeof(lpm_result_t), lpm_result_cmp);
+  for (i = 0; i < lpm->results_cnt; i++) {
+    if (lpm_add(lpm, i) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not build LPM table");
+      goto err;
+    }
+  }
+  return lpm;
+
+err:
+  bgpstream_lpm_destroy(lpm);
+  return NULL;
+}
+
+const bgpstream_pfx_t *bgpstream_lpm_lookup(const bgpstream_lpm_t *lpm,
+                                            const bgpstream_ip_addr_t *addr,
+                                            void **user)
+{
+  const uint32_t *root;
+  const uint8_t *bytes = addr->addr;
+  uint32_t e;
+  int pos = 16;
+
+  if (addr->version == BGPSTREAM_ADDR_VERSION_UNKNOWN ||
+      (root = lpm->root[LPM_VERSION_IDX(addr->version)]) == NULL) {
+    return NULL;
+  }
+
+  e = root[((uint32_t)bytes[0] << 8) | bytes[1]];
+  while (e & LPM_CHUNK_FLAG) {
+    e = lpm->chunks[(size_t)(e & ~LPM_CHUNK_FLAG) * LPM_CHUNK_SIZE +
+                    bytes[pos / 8]];
+    pos += 8;
+  }
+  if (e == 0) {
+    return NULL;
+  }
+  if (user != NULL) {
+    *user = lpm->results[e - 1].user;
+  }
+  return &lpm->results[e - 1].pfx;
+}
+
+void bgpstream_lpm_lookup_ipv4_batch(const bgpstream_lpm_t *lpm,
+                                     const bgpstream_ipv4_addr_t *addrs,
+                                     size_t cnt, const bgpstream_pfx_t **pfxs)
+{
+  const uint32_t *root = lpm->root[0];
+  const uint8_t *bytes[LPM_BATCH];
+  uint32_t e[LPM_BATCH];
+  size_t i, j, n;
+  int pos;
+
+  for (i = 0; i < cnt; i += n) {
+    n = (cnt - i < LPM_BATCH) ? cnt - i : LPM_BATCH;
+    for (j = 0; j < n; j++) {
+      bytes[j] = (const uint8_t *)&addrs[i + j].addr;
+      e[j] = root != NULL ? root[((uint32_t)bytes[j][0] << 8) | bytes[j][1]]
+                          : 0;
+    }
+    // an IPv4 table has at most two levels of chunks
+    for (pos = 16; pos < 32; pos += 8) {
+      for (j = 0; j < n; j++) {
+        if (e[j] & LPM_CHUNK_FLAG) {
+          e[j] = lpm->chunks[(size_t)(e[j] & ~LPM_CHUNK_FLAG) * LPM_CHUNK_SIZE +
+                             bytes[j][pos / 8]];
+        }
+      }
+    }
+    for (j = 0; j < n; j++) {
+      pfxs[i + j] = e[j] != 0 ? &lpm->results[e[j] - 1].pfx : NULL;
+    }
+  }
+}
+
+void *bgpstream_lpm_get_user(const bgpstream_lpm_t *lpm,
+                             const bgpstream_pfx_t *pfx)
+{
+  const lpm_result_t *res =
+    (const lpm_result_t *)((const char *)pfx - offsetof(lpm_result_t, pfx));
+
+  assert(res >= lpm->results && res < lpm->results + lpm->results_cnt);
+  return res->user;
+}
+
+uint64_t bgpstream_lpm_size(const bgpstream_lpm_t *lpm)
+{
+  return lpm->results_cnt;
+}
+
+void bgpstream_lpm_destroy(bgpstream_lpm_t *lpm)
+{
+  if (lpm == NULL) {
+    return;
+  }
+  free(lpm->root[0]);
+  free(lpm->root[1]);
+  free(lpm->chunks);
+  free(lpm->results);
+  free(lpm);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_LPM_H
+#define __BGPSTREAM_UTILS_LPM_H
+
+#include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_patricia.h"
+#include "bgpstream_utils_pfx.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream
+ * longest-prefix match tables: read-only snapshots of a Patricia Tree that are
+ * compiled into multibit tries, for fast lookups of addresses.
+ *
+ * A table has a 16-bit first level and 8-bit levels below it, so an IPv4
+ * lookup reads at most three table entries (rather than walking the binary
+ * trie one bit at a time), and an IPv6 lookup one more entry for every 8 bits
+ * of the matching prefix beyond /16.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a longest-prefix match table */
+typedef struct bgpstream_lpm bgpstream_lpm_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a longest-prefix match table from the prefixes of a Patricia Tree
+ *
+ * @param pt            pointer to the patricia tree to compile
+ * @return a pointer to the table, or NULL if an error occurred
+ *
+ * The table is a snapshot: it holds copies of the prefixes and of their user
+ * pointers, and is not affected by later changes to the tree.
+ */
+bgpstream_lpm_t *bgpstream_lpm_create(const bgpstream_patricia_tree_t *pt);
+
+/** Find the longest prefix that contains the given address
+ *
+ * @param lpm           pointer to the table to search
+ * @param addr          pointer to the address to look up
+ * @param[out] user     if not NULL, set to the user pointer of the prefix
+ *                      (when one is found)
+ * @return a borrowed pointer to the longest matching prefix, or NULL if no
+ * prefix contains the address
+ */
+const bgpstream_pfx_t *bgpstream_lpm_lookup(const bgpstream_lpm_t *lpm,
+                                            const bgpstream_ip_addr_t *addr,
+                                            void **user);
+
+/** Find the longest prefixes that contain each of an array of IPv4 addresses
+ *
+ * @param lpm           pointer to the table to search
+ * @param addrs         array of IPv4 addresses to look up
+ * @param cnt           number of addresses in the array
+ * @param[out] pfxs     array of cnt entries, each set to a borrowed pointer to
+ *                      the longest matching prefix (or NULL)
+ *
+ * The lookups are interleaved, so that the memory accesses of several
+ * addresses are in flight at once.
+ */
+void bgpstream_lpm_lookup_ipv4_batch(const bgpstream_lpm_t *lpm,
+                                     const bgpstream_ipv4_addr_t *addrs,
+                                     size_t cnt, const bgpstream_pfx_t **pfxs);
+
+/** Get the user pointer of a prefix returned by a lookup
+ *
+ * @param lpm           pointer to the table
+ * @param pfx           pointer to a prefix returned by a lookup on the table
+ * @return the user pointer that the prefix had in the tree
+ */
+void *bgpstream_lpm_get_user(const bgpstream_lpm_t *lpm,
+                             const bgpstream_pfx_t *pfx);
+
+/** Get the number of prefixes in the table
+ *
+ * @param lpm           pointer to the table
+ * @return the number of prefixes the table holds, of both IP versions
+ */
+uint64_t bgpstream_lpm_size(const bgpstream_lpm_t *lpm);
+
+/** Destroy the given table
+ *
+ * @param lpm           pointer to the table to destroy
+ */
+void bgpstream_lpm_destroy(bgpstream_lpm_t *lpm);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_LPM_H */
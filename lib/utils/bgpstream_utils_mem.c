@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_mem_int.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <string.h>
+#include <sys/mman.h>
+
+// transparent huge pages are this size on the platforms that have them
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+int bgpstream_mem_accounting = 0;
+
+bgpstream_allocator_t bgpstream_mem_allocator;
+
+int bgpstream_mem_used = 0;
+
+static int mem_hugepages = 0;
+
+/* buffers are preceded by the free function of the allocator they were
+ * allocated with (NULL for free(), which also takes the aligned memory used
+ * for huge pages), so that they are freed by the same one */
+typedef union buffer_hdr {
+  struct {
+    void (*free)(void *user, bgpstream_mem_subsys_t subsys, void *ptr);
+    void *user;
+  } alloc;
+  long double align;
+} buffer_hdr_t;
+
+/* the counters are updated by every thread that allocates memory, so they are
+ * only accessed atomically */
+static int64_t mem_current[_BGPSTREAM_MEM_SUBSYS_CNT];
+static int64_t mem_peak[_BGPSTREAM_MEM_SUBSYS_CNT];
+
+static const char *subsys_names[] = {
+  "reader",
+  "format",
+  "elem-generator",
+  "filter",
+  "utils",
+  "elem",
+};
+
+void bgpstream_mem_account_add(bgpstream_mem_subsys_t subsys, int64_t delta)
+{
+  int64_t cur, peak;
+
+  cur = __atomic_add_fetch(&mem_current[subsys], delta, __ATOMIC_RELAXED);
+  if (delta <= 0) {
+    return;
+  }
+  peak = __atomic_load_n(&mem_peak[subsys], __ATOMIC_RELAXED);
+  while (cur > peak &&
+         !__atomic_compare_exchange_n(&mem_peak[subsys], &peak, cur, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // peak has been reloaded, try again
+  }
+}
+
+void bgpstream_mem_set_accounting(int enabled)
+{
+  __atomic_store_n(&bgpstream_mem_accounting, enabled != 0, __ATOMIC_RELAXED);
+}
+
+void bgpstream_mem_get_usage(bgpstream_mem_usage_t *usage)
+{
+  int i;
+
+  for (i = 0; i < _BGPSTREAM_MEM_SUBSYS_CNT; i++) {
+    usage->current[i] = __atomic_load_n(&mem_current[i], __ATOMIC_RELAXED);
+    usage->peak[i] = __atomic_load_n(&mem_peak[i], __ATOMIC_RELAXED);
+  }
+}
+
+const char *bgpstream_mem_subsys_name(bgpstream_mem_subsys_t subsys)
+{
+  if ((int)subsys < 0 || (int)subsys >= ARR_CNT(subsys_names)) {
+    return NULL;
+  }
+  return subsys_names[subsys];
+}
+
+void *bgpstream_mem_malloc_zero(bgpstream_mem_subsys_t subsys, size_t size)
+{
+  void *ptr;
+
+  if ((ptr = bgpstream_mem_malloc(subsys, size)) != NULL) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+void *bgpstream_mem_malloc_buffer(bgpstream_mem_subsys_t subsys, size_t size)
+{
+  buffer_hdr_t *hdr;
+  size_t len = sizeof(buffer_hdr_t) + size;
+
+#ifdef MADV_HUGEPAGE
+  void *ptr;
+
+  if (mem_hugepages != 0 && bgpstream_mem_allocator.alloc == NULL) {
+    BGPSTREAM_MEM_USE();
+    len = (len + HUGEPAGE_SIZE - 1) & ~((size_t)HUGEPAGE_SIZE - 1);
+    if (posix_memalign(&ptr, HUGEPAGE_SIZE, len) != 0) {
+      return NULL;
+    }
+    // only a hint: if the kernel has no huge pages to spare, the buffer is
+    // simply backed by normal pages
+    madvise(ptr, len, MADV_HUGEPAGE);
+    hdr = ptr;
+    memset(hdr, 0, sizeof(buffer_hdr_t) + size);
+    return hdr + 1;
+  }
+#endif
+  if ((hdr = bgpstream_mem_malloc_zero(subsys, len)) == NULL) {
+    return NULL;
+  }
+  hdr->alloc.free = bgpstream_mem_allocator.free;
+  hdr->alloc.user = bgpstream_mem_allocator.user;
+  return hdr + 1;
+}
+
+void bgpstream_mem_free_buffer(bgpstream_mem_subsys_t subsys, void *ptr)
+{
+  buffer_hdr_t *hdr;
+
+  if (ptr == NULL) {
+    return;
+  }
+  hdr = (buffer_hdr_t *)ptr - 1;
+  if (hdr->alloc.free != NULL) {
+    hdr->alloc.free(hdr->alloc.user, subsys, hdr);
+  } else {
+    free(hdr);
+  }
+}
+
+int bgpstream_mem_set_allocator(const bgpstream_allocator_t *allocator)
+{
+  bgpstream_allocator_t tmp;
+
+  if (allocator == NULL) {
+    memset(&tmp, 0, sizeof(tmp));
+  } else if (allocator->alloc == NULL || allocator->realloc == NULL ||
+             allocator->free == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "An allocator must provide alloc, realloc and free");
+    return -1;
+  } else {
+    tmp = *allocator;
+  }
+
+  if (memcmp(&tmp, &bgpstream_mem_allocator, sizeof(tmp)) == 0) {
+    return 0;
+  }
+  // memory is freed by the allocator that is set at the time, so it can't be
+  // changed once anything has been allocated
+  if (__atomic_load_n(&bgpstream_mem_used, __ATOMIC_RELAXED) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "The allocator can't be changed once memory has been "
+                  "allocated");
+    return -1;
+  }
+  bgpstream_mem_allocator = tmp;
+  return 0;
+}
+
+void bgpstream_mem_set_hugepages(int enabled)
+{
+  mem_hugepages = enabled != 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_MEM_H
+#define __BGPSTREAM_UTILS_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream
+ * memory accounting: the number of bytes held by each subsystem of the
+ * library, to help size memory budgets and find what is growing.
+ *
+ * Accounting is opt-in. It covers the large allocations of each subsystem
+ * (e.g. reader and record structures, format parse buffers, elem arrays,
+ * filter caches, and the node slabs, arenas and indexes of the utility
+ * containers) rather than every allocation, so the totals are a lower bound.
+ *
+ * The same allocations (and those of elems, AS paths and community sets) can
+ * be handed to an application-provided allocator, which is told the subsystem
+ * of each one, so that each subsystem can be given its own arena.
+ *
+ */
+
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** Subsystems that memory is accounted to */
+typedef enum {
+
+  /** Readers and the records they decode into */
+  BGPSTREAM_MEM_READER,
+
+  /** Format instances (including their parse buffers) */
+  BGPSTREAM_MEM_FORMAT,
+
+  /** Elem generators */
+  BGPSTREAM_MEM_ELEM_GENERATOR,
+
+  /** Filter managers (excluding the containers they use) */
+  BGPSTREAM_MEM_FILTER,
+
+  /** Utility containers (Patricia Trees, AS path stores, AS paths and
+      community sets) */
+  BGPSTREAM_MEM_UTILS,
+
+  /** Elems */
+  BGPSTREAM_MEM_ELEM,
+
+  /** The number of subsystems */
+  _BGPSTREAM_MEM_SUBSYS_CNT,
+
+} bgpstream_mem_subsys_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Memory held by each subsystem */
+typedef struct bgpstream_mem_usage {
+
+  /** Bytes currently held, indexed by bgpstream_mem_subsys_t */
+  int64_t current[_BGPSTREAM_MEM_SUBSYS_CNT];
+
+  /** Most bytes held at once, indexed by bgpstream_mem_subsys_t */
+  int64_t peak[_BGPSTREAM_MEM_SUBSYS_CNT];
+
+} bgpstream_mem_usage_t;
+
+/** Allocator that the library's allocations are made with */
+typedef struct bgpstream_allocator {
+
+  /** Allocate size bytes for the given subsystem (as malloc) */
+  void *(*alloc)(void *user, bgpstream_mem_subsys_t subsys, size_t size);
+
+  /** Resize memory allocated for the given subsystem (as realloc, ptr may be
+      NULL) */
+  void *(*realloc)(void *user, bgpstream_mem_subsys_t subsys, void *ptr,
+                   size_t size);
+
+  /** Free memory allocated for the given subsystem (as free, ptr may be
+      NULL) */
+  void (*free)(void *user, bgpstream_mem_subsys_t subsys, void *ptr);
+
+  /** Passed to each of the functions */
+  void *user;
+
+} bgpstream_allocator_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Enable or disable memory accounting
+ *
+ * @param enabled       if non-zero, allocations are accounted
+ *
+ * Accounting is process-wide and disabled by default. It should be enabled
+ * before any stream (or utility container) is created: memory allocated while
+ * it is disabled is not counted, and neither is memory freed while it is
+ * disabled, so toggling it while objects are alive skews the totals.
+ */
+void bgpstream_mem_set_accounting(int enabled);
+
+/** Get the memory held by each subsystem
+ *
+ * @param usage         pointer to a structure to fill with the usage
+ */
+void bgpstream_mem_get_usage(bgpstream_mem_usage_t *usage);
+
+/** Get the name of a subsystem
+ *
+ * @param subsys        the subsystem to get the name of
+ * @return borrowed pointer to the name (e.g. "reader"), or NULL if the
+ * subsystem is not valid
+ */
+const char *bgpstream_mem_subsys_name(bgpstream_mem_subsys_t subsys);
+
+/** Set the allocator used by the library
+ *
+ * @param allocator     pointer to the allocator to use (copied), or NULL to go
+ *                      back to malloc, realloc and free
+ * @return 0 if the allocator was set, -1 if one of its functions is missing or
+ * memory has already been allocated
+ *
+ * All three functions must be provided; realloc is only ever called on memory
+ * returned by the same allocator, and free is never called with NULL.
+ *
+ * The allocator is process-wide. Since memory is freed by the allocator that
+ * is set at the time, it must be set before any stream (or utility container)
+ * is created: once the library has allocated memory, it can no longer be
+ * changed (setting the same allocator again is allowed). Memory is always
+ * freed for the subsystem it was allocated for, so an allocator that gives
+ * each subsystem its own arena may reset an arena once everything allocated
+ * from it has been destroyed (e.g., between RIB dumps). To keep
+ * that possible, the messages and elems that the decoders otherwise keep for
+ * reuse by each thread (which outlive the readers that released them) are
+ * destroyed straight away while an allocator is set. The functions may be
+ * called from any of the library's threads.
+ */
+int bgpstream_mem_set_allocator(const bgpstream_allocator_t *allocator);
+
+/** Enable or disable huge pages for large buffers
+ *
+ * @param enabled       if non-zero, large buffers are backed by huge pages
+ *
+ * Large buffers (e.g., the 1 MB buffer each format decodes from) are touched
+ * for every message, so backing them with huge pages saves TLB misses. When
+ * enabled, they are rounded up to a multiple of the huge page size and
+ * transparent huge pages are requested for them, at the cost of the unused
+ * rounding. This only applies when no allocator has been set, and has no
+ * effect if the platform doesn't support it. Like the allocator, it must be
+ * set before any stream is created.
+ */
+void bgpstream_mem_set_hugepages(int enabled);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_MEM_H */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_MEM_INT_H
+#define __BGPSTREAM_UTILS_MEM_INT_H
+
+#include "bgpstream_utils_mem.h"
+#include <stdlib.h>
+
+/** Non-zero if memory accounting is enabled */
+extern int bgpstream_mem_accounting;
+
+/** The allocator set with bgpstream_mem_set_allocator (all NULL if none) */
+extern bgpstream_allocator_t bgpstream_mem_allocator;
+
+/** Non-zero once memory has been allocated, after which the allocator can no
+ * longer be changed */
+extern int bgpstream_mem_used;
+
+/** Record that memory is about to be allocated (cheap once it has been) */
+#define BGPSTREAM_MEM_USE()                                                    \
+  do {                                                                         \
+    if (__atomic_load_n(&bgpstream_mem_used, __ATOMIC_RELAXED) == 0) {         \
+      __atomic_store_n(&bgpstream_mem_used, 1, __ATOMIC_RELAXED);              \
+    }                                                                          \
+  } while (0)
+
+/** Account for memory allocated (delta > 0) or freed (delta < 0)
+ *
+ * @param subsys        the subsystem that holds the memory
+ * @param delta         number of bytes allocated (or freed, if negative)
+ */
+void bgpstream_mem_account_add(bgpstream_mem_subsys_t subsys, int64_t delta);
+
+/** Account for memory if accounting is enabled (cheap when it is not) */
+#define BGPSTREAM_MEM_ACCOUNT(subsys, delta)                                   \
+  do {                                                                         \
+    if (__atomic_load_n(&bgpstream_mem_accounting, __ATOMIC_RELAXED) != 0) {   \
+      bgpstream_mem_account_add((subsys), (int64_t)(delta));                   \
+    }                                                                          \
+  } while (0)
+
+/** Allocate memory for the given subsystem (as malloc) */
+static inline void *bgpstream_mem_malloc(bgpstream_mem_subsys_t subsys,
+                                         size_t size)
+{
+  BGPSTREAM_MEM_USE();
+  if (bgpstream_mem_allocator.alloc != NULL) {
+    return bgpstream_mem_allocator.alloc(bgpstream_mem_allocator.user, subsys,
+                                         size);
+  }
+  return malloc(size);
+}
+
+/** Resize memory allocated for the given subsystem (as realloc) */
+static inline void *bgpstream_mem_realloc(bgpstream_mem_subsys_t subsys,
+                                          void *ptr, size_t size)
+{
+  BGPSTREAM_MEM_USE();
+  if (bgpstream_mem_allocator.realloc != NULL) {
+    if (ptr == NULL) {
+      return bgpstream_mem_allocator.alloc(bgpstream_mem_allocator.user,
+                                           subsys, size);
+    }
+    return bgpstream_mem_allocator.realloc(bgpstream_mem_allocator.user,
+                                           subsys, ptr, size);
+  }
+  return realloc(ptr, size);
+}
+
+/** Free memory allocated for the given subsystem (as free) */
+static inline void bgpstream_mem_free(bgpstream_mem_subsys_t subsys,
+                                      void *ptr)
+{
+  if (bgpstream_mem_allocator.free != NULL) {
+    if (ptr != NULL) {
+      bgpstream_mem_allocator.free(bgpstream_mem_allocator.user, subsys, ptr);
+    }
+    return;
+  }
+  free(ptr);
+}
+
+/** Allocate zeroed memory for the given subsystem (as malloc_zero) */
+void *bgpstream_mem_malloc_zero(bgpstream_mem_subsys_t subsys, size_t size);
+
+/** Allocate a large zeroed buffer for the given subsystem, backed by huge
+ * pages if they are enabled (see bgpstream_mem_set_hugepages). The buffer is
+ * freed with bgpstream_mem_free_buffer. */
+void *bgpstream_mem_malloc_buffer(bgpstream_mem_subsys_t subsys, size_t size);
+
+/** Free a buffer allocated with bgpstream_mem_malloc_buffer (ptr may be NULL),
+ * with the allocator it was allocated with */
+void bgpstream_mem_free_buffer(bgpstream_mem_subsys_t subsys, void *ptr);
+
+#endif /* __BGPSTREAM_UTILS_MEM_INT_H */
@@ -50,6 +50,7 @@
 #include <sys/types.h>
 
 #include "bgpstream_log.h"
+#include "bgpstream_utils_mem_int.h"
 #include "bgpstream_utils_patricia.h"
 #include "bgpstream_utils_pfx.h"
 #include "utils.h"
@@ -75,7 +76,7 @@ static int comp_with_mask(const void *addr, const void *dest, u_int mask)
 
   if (/* mask/8 == 0 || */ memcmp(addr, dest, mask / 8) == 0) {
     int n = mask / 8;
-    int m = ((-1) << (8 - (mask % 8)));
+    int m = (0xff << (8 - (mask % 8))) & 0xff;
 
     if (mask % 8 == 0 ||
         (((const u_char *)addr)[n] & m) == (((const u_char *)dest)[n] & m))
@@ -103,6 +104,21 @@ struct bgpstream_patricia_node {
   void *user;
 };
 
+/* Nodes are carved out of slabs owned by the tree, so that building a large
+ * tree costs few allocations and keeps nodes close together in memory, and
+ * clearing it is a linear walk over the slabs (which are kept for reuse).
+ * Slabs start small, so that small trees stay small, and double in size up to
+ * BGPSTREAM_PATRICIA_SLAB_MAX nodes. */
+#define BGPSTREAM_PATRICIA_SLAB_MIN 16
+#define BGPSTREAM_PATRICIA_SLAB_MAX 4096
+
+typedef struct bgpstream_patricia_slab {
+  struct bgpstream_patricia_slab *next;
+  /* number of nodes in this slab */
+  uint32_t size;
+  bgpstream_patricia_node_t nodes[];
+} bgpstream_patricia_slab_t;
+
 struct bgpstream_patricia_tree {
 
   /* IPv4 tree */
@@ -118,6 +134,15 @@ struct bgpstream_patricia_tree {
   /** Pointer to a function that destroys the user structure
    *  in the bgpstream_patricia_node_t structure */
   bgpstream_patricia_tree_destroy_user_t *node_user_destructor;
+
+  /* Node slabs, in allocation order: slabs before slab_cur are full, and
+   * slab_used nodes of slab_cur are in use (or on the free list) */
+  bgpstream_patricia_slab_t *slabs;
+  bgpstream_patricia_slab_t *slab_cur;
+  uint32_t slab_used;
+
+  /* Removed nodes, linked through their l pointer */
+  bgpstream_patricia_node_t *free_nodes;
 };
 
 /** Data structure containing a list of pointers to Patricia Tree nodes
@@ -174,6 +199,62 @@ static inline void bgpstream_patricia_tree_result_set_clear(
 
 /* ======================= PATRICIA NODE FUNCTIONS ======================= */
 
+static bgpstream_patricia_node_t *
+bgpstream_patricia_node_alloc(bgpstream_patricia_tree_t *pt)
+{
+  bgpstream_patricia_node_t *node;
+  bgpstream_patricia_slab_t *slab;
+  uint32_t size;
+
+  if ((node = pt->free_nodes) != NULL) {
+    pt->free_nodes = node->l;
+  } else {
+    if (pt->slab_cur == NULL || pt->slab_used == pt->slab_cur->size) {
+      if (pt->slab_cur != NULL && pt->slab_cur->next != NULL) {
+        // reuse a slab left over from before the tree was cleared
+        slab = pt->slab_cur->next;
+      } else {
+        size = pt->slab_cur == NULL ? BGPSTREAM_PATRICIA_SLAB_MIN
+                                    : pt->slab_cur->size * 2;
+        if (size > BGPSTREAM_PATRICIA_SLAB_MAX) {
+          size = BGPSTREAM_PATRICIA_SLAB_MAX;
+        }
+        if ((slab = bgpstream_mem_malloc(
+               BGPSTREAM_MEM_UTILS, sizeof(bgpstream_patricia_slab_t) +
+                                      sizeof(bgpstream_patricia_node_t) *
+                                        size)) == NULL) {
+          return NULL;
+        }
+        BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                              sizeof(bgpstream_patricia_slab_t) +
+                                sizeof(bgpstream_patricia_node_t) * size);
+        slab->next = NULL;
+        slab->size = size;
+        if (pt->slab_cur == NULL) {
+          pt->slabs = slab;
+        } else {
+          pt->slab_cur->next = slab;
+        }
+      }
+      pt->slab_cur = slab;
+      pt->slab_used = 0;
+    }
+    node = &pt->slab_cur->nodes[pt->slab_used++];
+  }
+
+  memset(node, 0, sizeof(bgpstream_patricia_node_t));
+  return node;
+}
+
+static void bgpstream_patricia_node_free(bgpstream_patricia_tree_t *pt,
+                                         bgpstream_patricia_node_t *node)
+{
+  // clearing the tree walks every slab node, including free ones
+  node->user = NULL;
+  node->l = pt->free_nodes;
+  pt->free_nodes = node;
+}
+
 static bgpstream_patricia_node_t *
 bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
                                const bgpstream_pfx_t *pfx)
@@ -184,7 +265,7 @@ bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
   assert(pfx->mask_len <= BGPSTREAM_PATRICIA_MAXBITS);
   assert(pfx->address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN);
 
-  if ((node = malloc_zero(sizeof(bgpstream_patricia_node_t))) == NULL) {
+  if ((node = bgpstream_patricia_node_alloc(pt)) == NULL) {
     return NULL;
   }
 
@@ -205,11 +286,11 @@ bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
 }
 
 static bgpstream_patricia_node_t *bgpstream_patricia_gluenode_create(
-  const bgpstream_pfx_t *pfx, uint8_t mask_len)
+  bgpstream_patricia_tree_t *pt, const bgpstream_pfx_t *pfx, uint8_t mask_len)
 {
   bgpstream_patricia_node_t *node;
 
-  if ((node = malloc_zero(sizeof(bgpstream_patricia_node_t))) == NULL) {
+  if ((node = bgpstream_patricia_node_alloc(pt)) == NULL) {
     return NULL;
   }
   bgpstream_addr_copy(&node->prefix.address, &pfx->address);
@@ -348,21 +429,6 @@ bgpstream_patricia_tree_find_more_specific(const bgpstream_patricia_node_t *node
     bgpstream_patricia_tree_find_more_specific(node->r);
 }
 
-static void bgpstream_patricia_tree_merge_tree(bgpstream_patricia_tree_t *dst,
-    const bgpstream_patricia_node_t *node)
-{
-  if (node == NULL) {
-    return;
-  }
-  /* Add the current node, if it is not a glue node */
-  if (node->actual) {
-    bgpstream_patricia_tree_insert(dst, &node->prefix);
-  }
-  /* Recursively add left and right node */
-  bgpstream_patricia_tree_merge_tree(dst, node->l);
-  bgpstream_patricia_tree_merge_tree(dst, node->r);
-}
-
 static bgpstream_patricia_walk_cb_result_t bpt_walk_children(
   const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
   bgpstream_patricia_tree_process_node_t *fun, void *data)
@@ -424,19 +490,26 @@ static void bgpstream_patricia_tree_print_tree(
   bgpstream_patricia_tree_print_tree(node->r);
 }
 
+/* destroy the user data of every node (free nodes have none) */
 static void
-bgpstream_patricia_tree_destroy_tree(bgpstream_patricia_tree_t *pt,
-                                     bgpstream_patricia_node_t *head)
+bgpstream_patricia_tree_destroy_users(bgpstream_patricia_tree_t *pt)
 {
-  if (head != NULL) {
-    bgpstream_patricia_node_t *l = head->l;
-    bgpstream_patricia_node_t *r = head->r;
-    bgpstream_patricia_tree_destroy_tree(pt, l);
-    bgpstream_patricia_tree_destroy_tree(pt, r);
-    if (head->user != NULL && pt->node_user_destructor != NULL) {
-      pt->node_user_destructor(head->user);
+  bgpstream_patricia_slab_t *slab;
+  uint32_t i, used;
+
+  if (pt->node_user_destructor == NULL) {
+    return;
+  }
+  for (slab = pt->slabs; slab != NULL; slab = slab->next) {
+    used = (slab == pt->slab_cur) ? pt->slab_used : slab->size;
+    for (i = 0; i < used; i++) {
+      if (slab->nodes[i].user != NULL) {
+        pt->node_user_destructor(slab->nodes[i].user);
+      }
+    }
+    if (slab == pt->slab_cur) {
+      break;
     }
-    free(head);
   }
 }
 
@@ -629,9 +702,11 @@ bpt_find_insert_point(bgpstream_patricia_node_t *node_it,
     node_it, pfx, relation, differ_bit_p));
 }
 
-bgpstream_patricia_node_t *
-bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
-                               const bgpstream_pfx_t *pfx)
+/* Insert pfx, searching for its insertion point from node_it, which must be
+ * the head of the tree or a node whose prefix covers pfx */
+static bgpstream_patricia_node_t *
+bpt_insert(bgpstream_patricia_tree_t *pt, bgpstream_patricia_node_t *node_it,
+           const bgpstream_pfx_t *pfx)
 {
   assert(pt);
   assert(pfx);
@@ -643,7 +718,6 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
 
   bgpstream_patricia_node_t *new_node = NULL;
   bgpstream_addr_version_t v = pfx->address.version;
-  bgpstream_patricia_node_t *node_it = bgpstream_patricia_get_head(pt, v);
 
   /* if Patricia Tree is empty, then insert new node */
   if (node_it == NULL) {
@@ -676,6 +750,7 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
      * prefix information and increment the right counter*/
     assert(bgpstream_pfx_equal(&node_it->prefix, pfx));
     node_it->actual = 1;
+    node_it->prefix.allowed_matches = pfx->allowed_matches;
     if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
       pt->ipv4_active_nodes++;
     } else {
@@ -742,7 +817,7 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
      * TO IT*/
 
     bgpstream_patricia_node_t *glue_node =
-      bgpstream_patricia_gluenode_create(pfx, differ_bit);
+      bgpstream_patricia_gluenode_create(pt, pfx, differ_bit);
 
     glue_node->parent = node_it->parent;
 
@@ -778,6 +853,113 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
   /* return new_node; */
 }
 
+bgpstream_patricia_node_t *
+bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
+                               const bgpstream_pfx_t *pfx)
+{
+  return bpt_insert(pt, bgpstream_patricia_get_head(pt, pfx->address.version),
+                    pfx);
+}
+
+/* Get the deepest node from node up to the root whose prefix covers pfx, or
+ * the head of the tree if there is none. When prefixes are inserted in
+ * order, this is where the search for the next insertion point can start,
+ * rather than at the root. */
+static bgpstream_patricia_node_t *
+bpt_insert_hint(bgpstream_patricia_tree_t *pt, bgpstream_patricia_node_t *node,
+                const bgpstream_pfx_t *pfx)
+{
+  const unsigned char *paddr = bgpstream_pfx_get_first_byte(pfx);
+
+  for (; node != NULL; node = node->parent) {
+    if (node->prefix.mask_len <= pfx->mask_len &&
+        comp_with_mask(bgpstream_pfx_get_first_byte(&node->prefix), paddr,
+                       node->prefix.mask_len)) {
+      return node;
+    }
+  }
+  return bgpstream_patricia_get_head(pt, pfx->address.version);
+}
+
+/* Compare prefixes in the order of a pre-order walk of the tree */
+static int bpt_pfx_cmp(const void *a, const void *b)
+{
+  const bgpstream_pfx_t *pa = a, *pb = b;
+  int rc;
+
+  if (pa->address.version != pb->address.version) {
+    return pa->address.version < pb->address.version ? -1 : 1;
+  }
+  if ((rc = memcmp(bgpstream_pfx_get_first_byte(pa),
+                   bgpstream_pfx_get_first_byte(pb),
+                   pa->address.version == BGPSTREAM_ADDR_VERSION_IPV4 ? 4
+                                                                      : 16)) !=
+      0) {
+    return rc;
+  }
+  return (int)pa->mask_len - (int)pb->mask_len;
+}
+
+int bgpstream_patricia_tree_insert_bulk(bgpstream_patricia_tree_t *pt,
+                                        bgpstream_pfx_t *pfxs, size_t pfxs_cnt)
+{
+  bgpstream_patricia_node_t *last[2] = {NULL, NULL};
+  bgpstream_patricia_node_t *node;
+  size_t i;
+  int v;
+
+  for (i = 1; i < pfxs_cnt; i++) {
+    if (bpt_pfx_cmp(&pfxs[i - 1], &pfxs[i]) > 0) {
+      qsort(pfxs, pfxs_cnt, sizeof(bgpstream_pfx_t), bpt_pfx_cmp);
+      break;
+    }
+  }
+
+  for (i = 0; i < pfxs_cnt; i++) {
+    v = pfxs[i].address.version == BGPSTREAM_ADDR_VERSION_IPV6;
+    if ((node = bpt_insert(pt, bpt_insert_hint(pt, last[v], &pfxs[i]),
+                           &pfxs[i])) == NULL) {
+      return -1;
+    }
+    last[v] = node;
+  }
+  return 0;
+}
+
+/* Insert the prefixes below node into dst, walking the tree in pre-order
+ * (i.e., in sorted order) without recursion, and optionally sharing their user
+ * pointers */
+static int bpt_merge_tree(bgpstream_patricia_tree_t *dst,
+                          const bgpstream_patricia_node_t *node, int copy_user)
+{
+  bgpstream_patricia_node_t *last = NULL;
+
+  while (node != NULL) {
+    if (node->actual) {
+      if ((last = bpt_insert(dst, bpt_insert_hint(dst, last, &node->prefix),
+                             &node->prefix)) == NULL) {
+        return -1;
+      }
+      if (copy_user) {
+        last->user = node->user;
+      }
+    }
+    if (node->l != NULL) {
+      node = node->l;
+    } else if (node->r != NULL) {
+      node = node->r;
+    } else {
+      /* go up to the first ancestor with a right subtree not yet visited */
+      while (node->parent != NULL &&
+             (node->parent->r == node || node->parent->r == NULL)) {
+        node = node->parent;
+      }
+      node = (node->parent != NULL) ? node->parent->r : NULL;
+    }
+  }
+  return 0;
+}
+
 void bgpstream_patricia_tree_walk_up_down(
     const bgpstream_patricia_tree_t *pt,
     const bgpstream_pfx_t *pfx,
@@ -942,7 +1124,7 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
   /* if node has no children */
   if (node->r == NULL && node->l == NULL) {
     parent = node->parent;
-    free(node);
+    bgpstream_patricia_node_free(pt, node);
     (*num_active_node) = (*num_active_node) - 1;
 
     /* removing head of tree */
@@ -986,7 +1168,7 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
     }
     /* the child parent, is now the grand-parent */
     child->parent = parent->parent;
-    free(parent);
+    bgpstream_patricia_node_free(pt, parent);
     return;
   }
 
@@ -1001,7 +1183,7 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
   parent = node->parent;
   child->parent = parent;
 
-  free(node);
+  bgpstream_patricia_node_free(pt, node);
   (*num_active_node) = (*num_active_node) - 1;
 
   if (parent == NULL) { /* if the parent is the head, then attach
@@ -1170,9 +1352,30 @@ void bgpstream_patricia_tree_merge(bgpstream_patricia_tree_t *dst,
     return;
   }
   /* Merge IPv4 */
-  bgpstream_patricia_tree_merge_tree(dst, src->head4);
+  if (bpt_merge_tree(dst, src->head4, 0) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not merge IPv4 prefixes");
+    return;
+  }
   /* Merge IPv6 */
-  bgpstream_patricia_tree_merge_tree(dst, src->head6);
+  if (bpt_merge_tree(dst, src->head6, 0) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not merge IPv6 prefixes");
+  }
+}
+
+bgpstream_patricia_tree_t *
+bgpstream_patricia_tree_copy(const bgpstream_patricia_tree_t *pt)
+{
+  bgpstream_patricia_tree_t *copy;
+
+  if ((copy = bgpstream_patricia_tree_create(NULL)) == NULL) {
+    return NULL;
+  }
+  if (bpt_merge_tree(copy, pt->head4, 1) != 0 ||
+      bpt_merge_tree(copy, pt->head6, 1) != 0) {
+    bgpstream_patricia_tree_destroy(copy);
+    return NULL;
+  }
+  return copy;
 }
 
 void bgpstream_patricia_tree_walk(const bgpstream_patricia_tree_t *pt,
@@ -1203,19 +1406,33 @@ void bgpstream_patricia_tree_clear(bgpstream_patricia_tree_t *pt)
 {
   assert(pt);
 
-  bgpstream_patricia_tree_destroy_tree(pt, pt->head4);
+  bgpstream_patricia_tree_destroy_users(pt);
+
   pt->ipv4_active_nodes = 0;
   pt->head4 = NULL;
-
-  bgpstream_patricia_tree_destroy_tree(pt, pt->head6);
   pt->ipv6_active_nodes = 0;
   pt->head6 = NULL;
+
+  /* keep the slabs, so that rebuilding the tree needs no allocations */
+  pt->slab_cur = pt->slabs;
+  pt->slab_used = 0;
+  pt->free_nodes = NULL;
 }
 
 void bgpstream_patricia_tree_destroy(bgpstream_patricia_tree_t *pt)
 {
+  bgpstream_patricia_slab_t *slab;
+
   if (pt != NULL) {
-    bgpstream_patricia_tree_clear(pt);
+    bgpstream_patricia_tree_destroy_users(pt);
+    while ((slab = pt->slabs) != NULL) {
+      pt->slabs = slab->next;
+      BGPSTREAM_MEM_ACCOUNT(BGPSTREAM_MEM_UTILS,
+                            -(int64_t)(sizeof(bgpstream_patricia_slab_t) +
+                                       sizeof(bgpstream_patricia_node_t) *
+                                         slab->size));
+      bgpstream_mem_free(BGPSTREAM_MEM_UTILS, slab);
+    }
     free(pt);
   }
 }
@@ -210,6 +210,22 @@ int bgpstream_patricia_tree_set_user(bgpstream_patricia_tree_t *pt,
                                      bgpstream_patricia_node_t *node,
                                      void *user);
 
+/** Insert an array of prefixes
+ *
+ * @param pt           pointer to the patricia tree to insert into
+ * @param pfxs         array of prefixes to insert, which is sorted in place if
+ *                     it is not already sorted
+ * @param pfxs_cnt     number of prefixes in the array
+ * @return 0 if all the prefixes were inserted, -1 if an error occurred
+ *
+ * This is equivalent to inserting the prefixes one at a time, but since they
+ * are inserted in order, the search for each insertion point starts from the
+ * previous prefix rather than from the root. Building a tree from a full
+ * table is then (close to) a single linear pass.
+ */
+int bgpstream_patricia_tree_insert_bulk(bgpstream_patricia_tree_t *pt,
+                                        bgpstream_pfx_t *pfxs, size_t pfxs_cnt);
+
 /** Merge the information of two Patricia Trees
  *
  * @param dst        pointer to the patricia tree to modify
@@ -218,6 +234,18 @@ int bgpstream_patricia_tree_set_user(bgpstream_patricia_tree_t *pt,
 void bgpstream_patricia_tree_merge(bgpstream_patricia_tree_t *dst,
                                    const bgpstream_patricia_tree_t *src);
 
+/** Create a copy of a Patricia Tree
+ *
+ * @param pt         pointer to the patricia tree to copy
+ * @return a pointer to the copy, or NULL if an error occurred
+ *
+ * The copy holds the same prefixes, with the same user pointers. It has no
+ * user destructor, so destroying it leaves the user structures to the
+ * original tree.
+ */
+bgpstream_patricia_tree_t *
+bgpstream_patricia_tree_copy(const bgpstream_patricia_tree_t *pt);
+
 /** Remove a prefix from the Patricia Tree (if it exists)
  *
  * @param pt           pointer to the patricia tree to lookup in
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bgpstream_log.h"
+#include "bgpstream_utils_patricia_rcu.h"
+#include "utils.h"
+
+/* Readers protect the snapshot they use with a hazard pointer: they announce
+ * it in their slot, then check that it is still the current one. The writer
+ * only destroys a replaced snapshot once it is in no slot. All accesses to
+ * the shared pointers are sequentially consistent, so that a reader that saw
+ * a snapshot as current is always seen by the writer. */
+
+/* size of a cache line, so that readers don't share slots' lines */
+#define RCU_CACHE_LINE 64
+
+struct bgpstream_patricia_rcu_reader {
+  bgpstream_patricia_rcu_t *rcu;
+  /* snapshot in use, or NULL */
+  const bgpstream_patricia_tree_t *hazard;
+  int used;
+} __attribute__((aligned(RCU_CACHE_LINE)));
+
+typedef struct rcu_retired {
+  bgpstream_patricia_tree_t *pt;
+  struct rcu_retired *next;
+} rcu_retired_t;
+
+struct bgpstream_patricia_rcu {
+  /* the latest snapshot */
+  bgpstream_patricia_tree_t *current;
+
+  /* reader slots */
+  bgpstream_patricia_rcu_reader_t *readers;
+  int readers_cnt;
+
+  /* replaced snapshots that readers may still hold (used by the writer
+   * only) */
+  rcu_retired_t *retired;
+};
+
+static int rcu_is_held(bgpstream_patricia_rcu_t *rcu,
+                       const bgpstream_patricia_tree_t *pt)
+{
+  int i;
+
+  for (i = 0; i < rcu->readers_cnt; i++) {
+    if (__atomic_load_n(&rcu->readers[i].hazard, __ATOMIC_SEQ_CST) == pt) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* destroy the retired snapshots that no reader holds */
+static void rcu_reclaim(bgpstream_patricia_rcu_t *rcu)
+{
+  rcu_retired_t **rp = &rcu->retired, *r;
+
+  while ((r = *rp) != NULL) {
+    if (rcu_is_held(rcu, r->pt)) {
+      rp = &r->next;
+      continue;
+    }
+    *rp = r->next;
+    bgpstream_patricia_tree_destroy(r->pt);
+    free(r);
+  }
+}
+
+/* PUBLIC FUNCTIONS */
+
+bgpstream_patricia_rcu_t *bgpstream_patricia_rcu_create(int max_readers)
+{
+  bgpstream_patricia_rcu_t *rcu;
+
+  if ((rcu = malloc_zero(sizeof(bgpstream_patricia_rcu_t))) == NULL) {
+    return NULL;
+  }
+  if (max_readers < 1 ||
+      posix_memalign((void **)&rcu->readers, RCU_CACHE_LINE,
+                     sizeof(bgpstream_patricia_rcu_reader_t) * max_readers) !=
+        0) {
+    rcu->readers = NULL;
+    goto err;
+  }
+  for (int i = 0; i < max_readers; i++) {
+    rcu->readers[i].rcu = rcu;
+    rcu->readers[i].hazard = NULL;
+    rcu->readers[i].used = 0;
+  }
+  rcu->readers_cnt = max_readers;
+
+  if ((rcu->current = bgpstream_patricia_tree_create(NULL)) == NULL) {
+    goto err;
+  }
+  return rcu;
+
+err:
+  bgpstream_patricia_rcu_destroy(rcu);
+  return NULL;
+}
+
+int bgpstream_patricia_rcu_publish(bgpstream_patricia_rcu_t *rcu,
+                                   const bgpstream_patricia_tree_t *pt)
+{
+  bgpstream_patricia_tree_t *snap, *old;
+  rcu_retired_t *r;
+
+  if ((r = malloc(sizeof(rcu_retired_t))) == NULL) {
+    return -1;
+  }
+  if ((snap = bgpstream_patricia_tree_copy(pt)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not copy patricia tree");
+    free(r);
+    return -1;
+  }
+
+  old = __atomic_exchange_n(&rcu->current, snap, __ATOMIC_SEQ_CST);
+  r->pt = old;
+  r->next = rcu->retired;
+  rcu->retired = r;
+
+  rcu_reclaim(rcu);
+  return 0;
+}
+
+bgpstream_patricia_rcu_reader_t *
+bgpstream_patricia_rcu_reader_register(bgpstream_patricia_rcu_t *rcu)
+{
+  int i, unused;
+
+  for (i = 0; i < rcu->readers_cnt; i++) {
+    unused = 0;
+    if (__atomic_compare_exchange_n(&rcu->readers[i].used, &unused, 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      return &rcu->readers[i];
+    }
+  }
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Too many patricia tree readers");
+  return NULL;
+}
+
+void bgpstream_patricia_rcu_reader_unregister(
+  bgpstream_patricia_rcu_reader_t *reader)
+{
+  assert(reader->hazard == NULL);
+  __atomic_store_n(&reader->used, 0, __ATOMIC_SEQ_CST);
+}
+
+const bgpstream_patricia_tree_t *
+bgpstream_patricia_rcu_read_lock(bgpstream_patricia_rcu_reader_t *reader)
+{
+  bgpstream_patricia_tree_t *pt;
+
+  assert(reader->hazard == NULL);
+  // retry until the snapshot announced is still the current one, at which
+  // point the writer cannot have missed it
+  do {
+    pt = __atomic_load_n(&reader->rcu->current, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->hazard, pt, __ATOMIC_SEQ_CST);
+  } while (__atomic_load_n(&reader->rcu->current, __ATOMIC_SEQ_CST) != pt);
+  return pt;
+}
+
+void bgpstream_patricia_rcu_read_unlock(
+  bgpstream_patricia_rcu_reader_t *reader)
+{
+  __atomic_store_n(&reader->hazard, NULL, __ATOMIC_SEQ_CST);
+}
+
+void bgpstream_patricia_rcu_destroy(bgpstream_patricia_rcu_t *rcu)
+{
+  rcu_retired_t *r;
+
+  if (rcu == NULL) {
+    return;
+  }
+  while ((r = rcu->retired) != NULL) {
+    rcu->retired = r->next;
+    bgpstream_patricia_tree_destroy(r->pt);
+    free(r);
+  }
+  if (rcu->current != NULL) {
+    bgpstream_patricia_tree_destroy(rcu->current);
+  }
+  free(rcu->readers);
+  free(rcu);
+}
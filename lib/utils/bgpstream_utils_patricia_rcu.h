@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_PATRICIA_RCU_H
+#define __BGPSTREAM_UTILS_PATRICIA_RCU_H
+
+#include "bgpstream_utils_patricia.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream
+ * Patricia Tree snapshots, which let one writer thread share a Patricia Tree
+ * with several reader threads without locking.
+ *
+ * The writer keeps updating its own tree, and periodically publishes a
+ * snapshot of it. Readers get the latest snapshot without taking any lock,
+ * and may only look it up (not modify it). A snapshot that has been replaced
+ * is destroyed (by the writer, at a later publish) once no reader still holds
+ * it.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a Patricia Tree snapshot publisher */
+typedef struct bgpstream_patricia_rcu bgpstream_patricia_rcu_t;
+
+/** Opaque structure containing the state of one reader thread */
+typedef struct bgpstream_patricia_rcu_reader bgpstream_patricia_rcu_reader_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new snapshot publisher
+ *
+ * @param max_readers   maximum number of readers that can be registered
+ * @return a pointer to the publisher, or NULL if an error occurred
+ *
+ * Until the first snapshot is published, readers get an empty tree.
+ */
+bgpstream_patricia_rcu_t *bgpstream_patricia_rcu_create(int max_readers);
+
+/** Publish a snapshot of the given tree
+ *
+ * @param rcu           pointer to the publisher
+ * @param pt            pointer to the tree to publish a copy of
+ * @return 0 if the snapshot was published, -1 if an error occurred
+ *
+ * The snapshot is a copy of the tree (see bgpstream_patricia_tree_copy), so
+ * the writer can keep modifying the tree afterwards, but must keep the user
+ * structures of published prefixes alive as long as a snapshot may refer to
+ * them. Snapshots that no reader holds any more are destroyed. Only one
+ * thread may publish at a time.
+ */
+int bgpstream_patricia_rcu_publish(bgpstream_patricia_rcu_t *rcu,
+                                   const bgpstream_patricia_tree_t *pt);
+
+/** Register a reader
+ *
+ * @param rcu           pointer to the publisher
+ * @return a pointer to the state of the reader, or NULL if max_readers
+ * readers are already registered
+ *
+ * Each reader thread must register once, and use its own reader state.
+ */
+bgpstream_patricia_rcu_reader_t *
+bgpstream_patricia_rcu_reader_register(bgpstream_patricia_rcu_t *rcu);
+
+/** Unregister a reader
+ *
+ * @param reader        pointer to the state of the reader (which must not hold
+ *                      a snapshot)
+ */
+void bgpstream_patricia_rcu_reader_unregister(
+  bgpstream_patricia_rcu_reader_t *reader);
+
+/** Get the latest snapshot
+ *
+ * @param reader        pointer to the state of the reader
+ * @return a borrowed pointer to the snapshot, which stays valid until
+ * bgpstream_patricia_rcu_read_unlock is called
+ *
+ * This never blocks. Each call must be paired with a call to
+ * bgpstream_patricia_rcu_read_unlock, and calls cannot be nested.
+ */
+const bgpstream_patricia_tree_t *
+bgpstream_patricia_rcu_read_lock(bgpstream_patricia_rcu_reader_t *reader);
+
+/** Release the snapshot returned by bgpstream_patricia_rcu_read_lock
+ *
+ * @param reader        pointer to the state of the reader
+ */
+void bgpstream_patricia_rcu_read_unlock(
+  bgpstream_patricia_rcu_reader_t *reader);
+
+/** Destroy the given publisher and its snapshots
+ *
+ * @param rcu           pointer to the publisher to destroy (all readers must
+ *                      have been unregistered)
+ */
+void bgpstream_patricia_rcu_destroy(bgpstream_patricia_rcu_t *rcu);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_PATRICIA_RCU_H */
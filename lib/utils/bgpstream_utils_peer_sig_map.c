@@ -25,128 +25,256 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
-#include "khash.h"
 #include "utils.h"
 
+#include "bgpstream_log.h"
 #include "bgpstream_utils_peer_sig_map.h"
 
-#define IPV4_ID_OFFSET 1
-#define IPV6_ID_OFFSET 1
+/** ID 0 is reserved to signal errors, so IDs are allocated from 1 */
+#define FIRST_ID 1
 
-/** Hash a peer signature into a 64bit number
- *
- * @param ps            the peer signature to hash
- * @return 64bit hash of the given peer signature
- */
-khint64_t bgpstream_peer_sig_hash(bgpstream_peer_sig_t *ps);
+/** Largest ID that can be allocated */
+#define MAX_ID UINT16_MAX
+
+/** Signatures are stored in chunks of 2^SIGS_CHUNK_BITS, so that a signature
+    never moves once it has been added (and can be read without the lock) */
+#define SIGS_CHUNK_BITS 8
+#define SIGS_CHUNK_SIZE (1 << SIGS_CHUNK_BITS)
+#define SIGS_CHUNKS_MAX ((MAX_ID >> SIGS_CHUNK_BITS) + 1)
+
+/** Initial number of slots in the index (power of 2) */
+#define INDEX_INIT_SIZE 256
+
+/** Marks an unused slot in the index (no peer has ID 0) */
+#define INDEX_EMPTY 0
 
-/** Check if two peer signatures are equal
+/** Open-addressing index from peer signature to peer ID.
  *
- * @param ps1           pointer to the first peer signature
- * @param ps2           pointer to the second peer signature
- * @return 0 if the signatures are not equal, non-zero if they are equal
+ * Each slot packs the peer ID in the low 16 bits and the top 16 bits of the
+ * signature hash in the high bits, so that a lookup can be done with a single
+ * atomic load per probe. A new (bigger) index is published when the current
+ * one is half full, and the old one is kept until the map is destroyed or
+ * cleared since readers may still be probing it.
  */
-int bgpstream_peer_sig_equal(bgpstream_peer_sig_t *ps1,
-                             bgpstream_peer_sig_t *ps2);
+typedef struct sig_index {
 
-/** Set the peer ID for the given collector/peer
- *
- * @param map           peer sig map to set peer ID for
- * @param peer_id       peer id to set
- * @param collector_str name of the collector the peer is associated with
- * @param peer_ip_addr  pointer to the peer IP address
- * @param peer_asnumber  AS number of the peer
- * @return 0 if the ID was associated successfully, -1 otherwise
+  /** Number of slots minus one */
+  uint32_t mask;
+
+  /** Next (older) index that has been replaced by this one */
+  struct sig_index *retired;
+
+  /** Array of slots */
+  uint32_t slots[];
+
+} sig_index_t;
+
+/** Structure representing an instance of a Peer Signature Map
  *
- * @note the peer sig map expects to be able to allocate IDs internally. This
- * function must be used with care.
+ * Lookups of existing peers are lock-free: they probe the current index and
+ * read signatures straight from their chunk. Only the insertion of a new peer
+ * takes the lock, so that IDs are allocated in the same order for every
+ * thread sharing the map.
  */
-int bgpstream_peer_sig_map_set(bgpstream_peer_sig_map_t *map,
-                               bgpstream_peer_id_t peer_id, char *collector_str,
-                               bgpstream_ip_addr_t *peer_ip_addr,
-                               uint32_t peer_asnumber);
+struct bgpstream_peer_sig_map {
 
-/** Map from peer signature to peer ID */
-KHASH_INIT(bgpstream_peer_sig_id_map, bgpstream_peer_sig_t *,
-           bgpstream_peer_id_t, 1, bgpstream_peer_sig_hash,
-           bgpstream_peer_sig_equal)
+  /** Current index (published with release semantics) */
+  sig_index_t *index;
 
-/** Map from peer ID to signature */
-KHASH_INIT(bgpstream_peer_id_sig_map, bgpstream_peer_id_t,
-           bgpstream_peer_sig_t *, 1, kh_int_hash_func, kh_int_hash_equal)
+  /** Chunks of signatures, indexed by ID >> SIGS_CHUNK_BITS */
+  bgpstream_peer_sig_t *chunks[SIGS_CHUNKS_MAX];
 
-/** Structure representing an instance of a Peer Signature Map */
-struct bgpstream_peer_sig_map {
-  khash_t(bgpstream_peer_sig_id_map) * ps_id;
-  khash_t(bgpstream_peer_id_sig_map) * id_ps;
-  bgpstream_peer_id_t v4_next_id;
-  bgpstream_peer_id_t v6_next_id;
+  /** Next ID to allocate. Signatures with a lower ID are fully written */
+  uint32_t next_id;
+
+  /** Serializes the insertion of new peers */
+  pthread_mutex_t lock;
 };
 
 /* PRIVATE FUNCTIONS (static) */
 
-static void sig_free(bgpstream_peer_sig_t *sig)
+static uint64_t sig_hash(const char *collector_str,
+                         bgpstream_ip_addr_t *peer_ip_addr)
+{
+  /* FNV-1a over the collector name, mixed with the address hash so that the
+   * same peer seen by several collectors does not collide */
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const unsigned char *c;
+
+  for (c = (const unsigned char *)collector_str; *c != '\0'; c++) {
+    h = (h ^ *c) * 0x100000001b3ULL;
+  }
+  h ^= (uint64_t)bgpstream_addr_hash(peer_ip_addr) * 0x9e3779b97f4a7c15ULL;
+
+  /* murmur3 finalizer, the index uses both the low and the high bits */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/** @note we do not need to take into account the peer AS number
+ *  to check whether a peer differs or not */
+static inline int sig_equal(bgpstream_peer_sig_t *ps, const char *collector_str,
+                            bgpstream_ip_addr_t *peer_ip_addr)
+{
+  return bgpstream_addr_equal(&ps->peer_ip_addr, peer_ip_addr) &&
+         strcmp(ps->collector_str, collector_str) == 0;
+}
+
+static inline uint32_t slot_make(uint64_t hash, bgpstream_peer_id_t id)
+{
+  return (uint32_t)(hash >> 48) << 16 | id;
+}
+
+static inline int slot_tag_match(uint32_t slot, uint64_t hash)
+{
+  return (slot >> 16) == (uint32_t)(hash >> 48);
+}
+
+/* Get the signature with the given ID. The chunk it lives in must already
+ * have been published */
+static inline bgpstream_peer_sig_t *sig_get(bgpstream_peer_sig_map_t *map,
+                                            bgpstream_peer_id_t id)
 {
-  free(sig);
+  bgpstream_peer_sig_t *chunk =
+    __atomic_load_n(&map->chunks[id >> SIGS_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  return &chunk[id & (SIGS_CHUNK_SIZE - 1)];
 }
 
-static bgpstream_peer_id_t
-bgpstream_peer_sig_map_set_and_get_ps(bgpstream_peer_sig_map_t *map,
-                                      bgpstream_peer_sig_t *ps)
+static sig_index_t *index_create(uint32_t size)
 {
-  khiter_t k;
-  int khret;
-  bgpstream_peer_id_t new_id;
+  sig_index_t *idx;
 
-  if ((k = kh_get(bgpstream_peer_sig_id_map, map->ps_id, ps)) ==
-      kh_end(map->ps_id)) {
-    /* was not already in the map */
-    /* what ID should we use? */
-    if (map->v4_next_id >= IPV6_ID_OFFSET) {
-      /* v4 peers are in v6 range */
-      /* regardless of the version, use the v6 id */
-      new_id = map->v6_next_id++;
-    } else if (ps->peer_ip_addr.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      assert(map->v4_next_id < IPV6_ID_OFFSET);
-      new_id = map->v6_next_id++;
-    } else {
-      new_id = map->v4_next_id++;
+  if ((idx = malloc_zero(sizeof(sig_index_t) + sizeof(uint32_t) * size)) ==
+      NULL) {
+    return NULL;
+  }
+  idx->mask = size - 1;
+  return idx;
+}
+
+/* Find the peer in the given index. Safe to call without the lock */
+static bgpstream_peer_id_t index_find(bgpstream_peer_sig_map_t *map,
+                                      sig_index_t *idx, uint64_t hash,
+                                      const char *collector_str,
+                                      bgpstream_ip_addr_t *peer_ip_addr)
+{
+  uint32_t i = (uint32_t)hash & idx->mask;
+  uint32_t slot;
+
+  while ((slot = __atomic_load_n(&idx->slots[i], __ATOMIC_ACQUIRE)) !=
+         INDEX_EMPTY) {
+    if (slot_tag_match(slot, hash) &&
+        sig_equal(sig_get(map, slot & 0xffff), collector_str, peer_ip_addr)) {
+      return slot & 0xffff;
     }
+    i = (i + 1) & idx->mask;
+  }
+  return 0;
+}
 
-    /* insert into both maps */
-    k = kh_put(bgpstream_peer_sig_id_map, map->ps_id, ps, &khret);
-    kh_value(map->ps_id, k) = new_id;
-    k = kh_put(bgpstream_peer_id_sig_map, map->id_ps, new_id, &khret);
-    kh_value(map->id_ps, k) = ps;
+/* Add a slot to the given index. Must be called with the lock held */
+static void index_add(sig_index_t *idx, uint32_t slot, uint64_t hash)
+{
+  uint32_t i = (uint32_t)hash & idx->mask;
 
-    return new_id;
-  } else {
-    /* already exists... */
-    free(ps); /* it was mallocd for us...*/
-    return kh_value(map->ps_id, k);
+  while (idx->slots[i] != INDEX_EMPTY) {
+    i = (i + 1) & idx->mask;
   }
+  __atomic_store_n(&idx->slots[i], slot, __ATOMIC_RELEASE);
 }
 
-/* PROTECTED FUNCTIONS (_int.h) */
+/* Replace the index with one twice the size. Must be called with the lock
+ * held */
+static int index_grow(bgpstream_peer_sig_map_t *map)
+{
+  sig_index_t *old = map->index;
+  sig_index_t *idx;
+  bgpstream_peer_sig_t *ps;
+  uint64_t hash;
+  uint32_t id;
 
-khint64_t bgpstream_peer_sig_hash(bgpstream_peer_sig_t *ps)
+  if ((idx = index_create((old->mask + 1) * 2)) == NULL) {
+    return -1;
+  }
+  for (id = FIRST_ID; id < map->next_id; id++) {
+    ps = sig_get(map, id);
+    hash = sig_hash(ps->collector_str, &ps->peer_ip_addr);
+    index_add(idx, slot_make(hash, id), hash);
+  }
+  idx->retired = old;
+  __atomic_store_n(&map->index, idx, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void index_free_retired(sig_index_t *idx)
 {
-  /* assuming that the number of peers that have the same ip and belong to two
-   * different collectors is low (in this specific case there will be a
-   * collision in terms of hash). */
-  return bgpstream_addr_hash(&ps->peer_ip_addr);
+  sig_index_t *next;
+
+  while (idx != NULL) {
+    next = idx->retired;
+    free(idx);
+    idx = next;
+  }
 }
 
-/** @note we do not need to take into account the peer AS number
- *  to check whether a peer differs or not */
-int bgpstream_peer_sig_equal(bgpstream_peer_sig_t *ps1,
-                             bgpstream_peer_sig_t *ps2)
+static bgpstream_peer_id_t sig_insert(bgpstream_peer_sig_map_t *map,
+                                      uint64_t hash, const char *collector_str,
+                                      bgpstream_ip_addr_t *peer_ip_addr,
+                                      uint32_t peer_asnumber)
 {
-  return (
-    bgpstream_addr_equal(&ps1->peer_ip_addr, &ps2->peer_ip_addr) &&
-    (strcmp(ps1->collector_str, ps2->collector_str) == 0));
+  bgpstream_peer_sig_t **chunk;
+  bgpstream_peer_sig_t *ps;
+  bgpstream_peer_id_t id;
+
+  pthread_mutex_lock(&map->lock);
+
+  /* another thread may have added it while we waited */
+  if ((id = index_find(map, map->index, hash, collector_str, peer_ip_addr)) !=
+      0) {
+    goto done;
+  }
+
+  if (map->next_id > MAX_ID) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Peer signature map is full");
+    goto done;
+  }
+
+  /* grow before adding, so the new peer is only ever published once */
+  if ((map->next_id - FIRST_ID + 1) * 2 > map->index->mask + 1 &&
+      index_grow(map) != 0) {
+    goto done;
+  }
+
+  chunk = &map->chunks[map->next_id >> SIGS_CHUNK_BITS];
+  if (*chunk == NULL) {
+    if ((ps = malloc(sizeof(bgpstream_peer_sig_t) * SIGS_CHUNK_SIZE)) ==
+        NULL) {
+      goto done;
+    }
+    __atomic_store_n(chunk, ps, __ATOMIC_RELEASE);
+  }
+
+  ps = sig_get(map, map->next_id);
+  bgpstream_addr_copy(&ps->peer_ip_addr, peer_ip_addr);
+  strncpy(ps->collector_str, collector_str, BGPSTREAM_UTILS_STR_NAME_LEN);
+  ps->collector_str[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+  ps->peer_asnumber = peer_asnumber;
+
+  id = map->next_id;
+  __atomic_store_n(&map->next_id, map->next_id + 1, __ATOMIC_RELEASE);
+  index_add(map->index, slot_make(hash, id), hash);
+
+done:
+  pthread_mutex_unlock(&map->lock);
+  return id;
 }
 
 /* PUBLIC FUNCTIONS */
@@ -159,16 +287,16 @@ bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create()
     return NULL;
   }
 
-  if ((map->ps_id = kh_init(bgpstream_peer_sig_id_map)) == NULL) {
-    goto err;
+  if (pthread_mutex_init(&map->lock, NULL) != 0) {
+    free(map);
+    return NULL;
   }
 
-  if ((map->id_ps = kh_init(bgpstream_peer_id_sig_map)) == NULL) {
+  if ((map->index = index_create(INDEX_INIT_SIZE)) == NULL) {
     goto err;
   }
 
-  map->v4_next_id = IPV4_ID_OFFSET;
-  map->v6_next_id = IPV6_ID_OFFSET;
+  map->next_id = FIRST_ID;
 
   return map;
 
@@ -181,58 +309,55 @@ bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
   bgpstream_peer_sig_map_t *map, const char *collector_str,
   bgpstream_ip_addr_t *peer_ip_addr, uint32_t peer_asnumber)
 {
-  bgpstream_peer_sig_t *new_ps;
-  if ((new_ps = malloc(sizeof(bgpstream_peer_sig_t))) == NULL) {
-    return -1;
-  }
+  uint64_t hash = sig_hash(collector_str, peer_ip_addr);
+  bgpstream_peer_id_t id;
 
-  bgpstream_addr_copy(&new_ps->peer_ip_addr, peer_ip_addr);
-  strcpy(new_ps->collector_str, collector_str);
-  new_ps->peer_asnumber = peer_asnumber;
+  /* fast path: the peer is already known */
+  if ((id = index_find(map, __atomic_load_n(&map->index, __ATOMIC_ACQUIRE),
+                       hash, collector_str, peer_ip_addr)) != 0) {
+    return id;
+  }
 
-  return bgpstream_peer_sig_map_set_and_get_ps(map, new_ps);
+  return sig_insert(map, hash, collector_str, peer_ip_addr, peer_asnumber);
 }
 
 bgpstream_peer_sig_t *
 bgpstream_peer_sig_map_get_sig(bgpstream_peer_sig_map_t *map,
                                bgpstream_peer_id_t id)
 {
-  bgpstream_peer_sig_t *ps = NULL;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_peer_id_sig_map, map->id_ps, id)) !=
-      kh_end(map->id_ps)) {
-    ps = kh_value(map->id_ps, k);
+  if (id < FIRST_ID || id >= __atomic_load_n(&map->next_id, __ATOMIC_ACQUIRE)) {
+    return NULL;
   }
-  return ps;
+  return sig_get(map, id);
 }
 
 int bgpstream_peer_sig_map_get_size(bgpstream_peer_sig_map_t *map)
 {
-  assert(kh_size(map->id_ps) == kh_size(map->ps_id));
-  return kh_size(map->id_ps);
+  return __atomic_load_n(&map->next_id, __ATOMIC_ACQUIRE) - FIRST_ID;
 }
 
 void bgpstream_peer_sig_map_destroy(bgpstream_peer_sig_map_t *map)
 {
-  if (map != NULL) {
-    if (map->ps_id != NULL) {
-      kh_destroy(bgpstream_peer_sig_id_map, map->ps_id);
-      map->ps_id = NULL;
-    }
-    if (map->id_ps != NULL) {
-      /* only call free vals on ONE map, they are shared */
-      kh_free_vals(bgpstream_peer_id_sig_map, map->id_ps, sig_free);
-      kh_destroy(bgpstream_peer_id_sig_map, map->id_ps);
-      map->id_ps = NULL;
-    }
-    free(map);
+  int i;
+
+  if (map == NULL) {
+    return;
+  }
+  index_free_retired(map->index);
+  map->index = NULL;
+  for (i = 0; i < SIGS_CHUNKS_MAX; i++) {
+    free(map->chunks[i]);
+    map->chunks[i] = NULL;
   }
+  pthread_mutex_destroy(&map->lock);
+  free(map);
 }
 
 void bgpstream_peer_sig_map_clear(bgpstream_peer_sig_map_t *map)
 {
-  /* only call free vals on ONE map, they are shared */
-  kh_free_vals(bgpstream_peer_id_sig_map, map->id_ps, sig_free);
-  kh_clear(bgpstream_peer_id_sig_map, map->id_ps);
-  kh_clear(bgpstream_peer_sig_id_map, map->ps_id);
+  /* the signature chunks are kept for reuse */
+  index_free_retired(map->index->retired);
+  map->index->retired = NULL;
+  memset(map->index->slots, 0, sizeof(uint32_t) * (map->index->mask + 1));
+  map->next_id = FIRST_ID;
 }
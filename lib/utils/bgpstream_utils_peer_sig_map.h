@@ -35,6 +35,11 @@
  * @brief Header file that exposes the public interface of the BGP Stream Peer
  * Signature Map.
  *
+ * A peer signature map may be shared by several threads: looking up the ID of
+ * a known peer (or the signature of an ID) is lock-free, and only the first
+ * lookup of a new peer takes a lock. A given peer gets the same ID in every
+ * thread.
+ *
  * @author Chiara Orsini
  *
  */
@@ -92,6 +97,7 @@ bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create(void);
  * @param peer_asnumber  AS number of the peer
  * @return the peer ID for this peer signature, 0 if an error occurred
  *
+ * @note this function may be called concurrently from several threads
  */
 bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
   bgpstream_peer_sig_map_t *map, const char *collector_str,
@@ -103,6 +109,9 @@ bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
  * @param peer_id       peer ID to retrieve signature for
  * @return pointer to the peer signature for the given peer ID, NULL if it was
  * not found
+ *
+ * @note the returned signature remains valid until the map is cleared or
+ * destroyed
  */
 bgpstream_peer_sig_t *
 bgpstream_peer_sig_map_get_sig(bgpstream_peer_sig_map_t *map,
@@ -124,6 +133,9 @@ void bgpstream_peer_sig_map_destroy(bgpstream_peer_sig_map_t *map);
 /** Empty the given peer signature map
  *
  * @param map           peer sig map
+ *
+ * @note this function must not be called while other threads are using the
+ * map
  */
 void bgpstream_peer_sig_map_clear(bgpstream_peer_sig_map_t *map);
 
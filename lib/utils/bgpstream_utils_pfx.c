@@ -36,25 +36,39 @@
 
 #include "khash.h"
 
+#include "bgpstream_log.h"
 #include "bgpstream_utils_pfx.h"
+#include "bgpstream_utils_private.h"
 
-char *bgpstream_pfx_snprintf(char *buf, size_t len, const bgpstream_pfx_t *pfx)
+int bgpstream_pfx_snprintf_len(char *buf, size_t len,
+                               const bgpstream_pfx_t *pfx)
 {
+  int written;
+
   /* print the address */
-  if (bgpstream_addr_ntop(buf, len, &(pfx->address)) == NULL) {
-    return NULL;
+  if ((written = bgpstream_addr_ntop_len(buf, len, &pfx->address)) < 0) {
+    return -1;
   }
 
-  size_t written = strlen(buf);
-
   /* print the mask length */
+  if (len - written > 4) {
+    buf[written++] = '/';
+    written += bs_u32_to_str(buf + written, pfx->mask_len);
+    buf[written] = '\0';
+    return written;
+  }
   written += snprintf(buf + written, len - written, "/%" PRIu8, pfx->mask_len);
 
   if (written >= len) {
     errno = ENOSPC;
-    return NULL;
+    return -1;
   }
-  return buf;
+  return written;
+}
+
+char *bgpstream_pfx_snprintf(char *buf, size_t len, const bgpstream_pfx_t *pfx)
+{
+  return bgpstream_pfx_snprintf_len(buf, len, pfx) < 0 ? NULL : buf;
 }
 
 void bgpstream_pfx_copy(bgpstream_pfx_t *dst, const bgpstream_pfx_t *src)
@@ -136,39 +150,37 @@ int bgpstream_pfx_contains(const bgpstream_pfx_t *outer, const bgpstream_pfx_t *
 
 bgpstream_pfx_t *bgpstream_str2pfx(const char *pfx_str, bgpstream_pfx_t *pfx)
 {
-  if (pfx_str == NULL || pfx == NULL) {
-    return NULL;
-  }
-
-  char pfx_copy[INET6_ADDRSTRLEN + 3];
-  char *endptr = NULL;
+  const char *slash;
+  const char *c;
+  unsigned int r = 0;
 
-  /* strncpy() functions copy at most len characters from src into
-   * dst.  If src is less than len characters long, the remainder of
-   * dst is filled with `\0' characters.  Otherwise, dst is not
-   * terminated. */
-  strncpy(pfx_copy, pfx_str, INET6_ADDRSTRLEN + 3);
-  if (pfx_copy[INET6_ADDRSTRLEN + 3 - 1] != '\0') {
+  if (pfx_str == NULL || pfx == NULL) {
     return NULL;
   }
 
   /* get pointer to ip/mask divisor */
-  char *found = strchr(pfx_copy, '/');
-  if (found == NULL) {
+  if ((slash = strchr(pfx_str, '/')) == NULL) {
     return NULL;
   }
 
-  *found = '\0';
-  /* get the ip address */
-  if (bgpstream_str2addr(pfx_copy, &pfx->address) == NULL) {
+  /* get the ip address (parsed in place, without copying the string) */
+  if (bs_str_to_ipv4(pfx_str, slash - pfx_str,
+                     (uint8_t *)&pfx->address.bs_ipv4.addr)) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+  } else if (bs_str_to_ipv6(pfx_str, slash - pfx_str,
+                            pfx->address.bs_ipv6.addr.s6_addr)) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+  } else {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not parse address string %.*s",
+                  (int)(slash - pfx_str), pfx_str);
     return NULL;
   }
 
   /* get the mask len */
-  errno = 0;
-  unsigned long int r = strtoul(found + 1, &endptr, 10);
-  int ret = errno;
-  if (!(endptr != NULL && *endptr == '\0') || ret != 0 ||
+  for (c = slash + 1; *c >= '0' && *c <= '9' && r <= 128; c++) {
+    r = r * 10 + (*c - '0');
+  }
+  if (c == slash + 1 || *c != '\0' ||
       (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4 && r > 32) ||
       (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6 && r > 128)) {
     return NULL;
@@ -158,6 +158,19 @@ typedef union union_bgpstream_pfx_t {
  */
 char *bgpstream_pfx_snprintf(char *buf, size_t len, const bgpstream_pfx_t *pfx);
 
+/** Write the string representation of the given prefix into the given
+ * character buffer, and return its length.
+ *
+ * @param buf           pointer to a character buffer at least len bytes long
+ * @param len           length of the given character buffer
+ * @param pfx           pointer to the bgpstream pfx to convert to string
+ * @return the number of characters written (excluding the terminating nul) if
+ * successful.  Otherwise, returns -1 with errno set as by
+ * bgpstream_pfx_snprintf.
+ */
+int bgpstream_pfx_snprintf_len(char *buf, size_t len,
+                               const bgpstream_pfx_t *pfx);
+
 /** Copy one prefix into another
  *
  * @param dst          pointer to the destination prefix
@@ -27,49 +27,58 @@
 #include <assert.h>
 #include <stdio.h>
 
-#include "khash.h"
 #include "utils.h"
 
 #include "bgpstream_utils_pfx_set.h"
+#include "bgpstream_utils_swiss.h"
 
-/** set of unique IP prefixes
- *  this structure maintains a set of unique
- *  prefixes (ipv4 and ipv6 prefixes, both hashed
- *  using a int64 type)
- */
-KHASH_INIT(bgpstream_pfx_set /* name */,
-           bgpstream_pfx_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */, bgpstream_pfx_hash_val /*__hash_func */,
-           bgpstream_pfx_equal_val /* __hash_equal */)
+/* The sets store compact keys rather than whole prefix structures: an IPv4
+ * prefix is packed into a single 64-bit word, an IPv6 prefix into two words
+ * and the mask length. The generic set keeps one table per version. */
 
-struct bgpstream_pfx_set {
-  khash_t(bgpstream_pfx_set) * hash;
-  uint64_t ipv4_size;
-  uint64_t ipv6_size;
-};
+/* (address << 8) | mask_len */
+typedef uint64_t pfx4_key_t;
 
-/* ipv4 specific set */
+typedef struct pfx6_key {
+  uint64_t hi;
+  uint64_t lo;
+  uint64_t mask_len;
+} pfx6_key_t;
 
-KHASH_INIT(bgpstream_ipv4_pfx_set /* name */,
-           bgpstream_ipv4_pfx_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */,
-           bgpstream_ipv4_pfx_hash_val /*__hash_func */,
-           bgpstream_ipv4_pfx_equal_val /* __hash_equal */)
+#define PFX4_HASH(k) swiss_mix64(*(k))
+#define PFX4_EQUAL(a, b) (*(a) == *(b))
 
-struct bgpstream_ipv4_pfx_set {
-  khash_t(bgpstream_ipv4_pfx_set) * hash;
-};
+#define PFX6_HASH(k)                                                           \
+  swiss_mix64((k)->hi ^ swiss_mix64((k)->lo ^ (k)->mask_len))
+#define PFX6_EQUAL(a, b)                                                       \
+  ((a)->lo == (b)->lo && (a)->hi == (b)->hi && (a)->mask_len == (b)->mask_len)
+
+SWISS_INIT(pfx4, pfx4_key_t, PFX4_HASH, PFX4_EQUAL)
+SWISS_INIT(pfx6, pfx6_key_t, PFX6_HASH, PFX6_EQUAL)
+
+static inline pfx4_key_t pfx4_key(const bgpstream_ipv4_pfx_t *pfx)
+{
+  return ((uint64_t)pfx->address.addr.s_addr << 8) | pfx->mask_len;
+}
+
+static inline void pfx6_key(const bgpstream_ipv6_pfx_t *pfx, pfx6_key_t *k)
+{
+  memcpy(&k->hi, &pfx->address.addr.s6_addr[0], sizeof(uint64_t));
+  memcpy(&k->lo, &pfx->address.addr.s6_addr[8], sizeof(uint64_t));
+  k->mask_len = pfx->mask_len;
+}
 
-/* ipv6 specific set */
+struct bgpstream_pfx_set {
+  swiss_pfx4_t v4;
+  swiss_pfx6_t v6;
+};
 
-KHASH_INIT(bgpstream_ipv6_pfx_set /* name */,
-           bgpstream_ipv6_pfx_t /* khkey_t */, char /* khval_t */,
-           0 /* kh_is_set */,
-           bgpstream_ipv6_pfx_hash_val /*__hash_func */,
-           bgpstream_ipv6_pfx_equal_val /* __hash_equal */)
+struct bgpstream_ipv4_pfx_set {
+  swiss_pfx4_t v4;
+};
 
 struct bgpstream_ipv6_pfx_set {
-  khash_t(bgpstream_ipv6_pfx_set) * hash;
+  swiss_pfx6_t v6;
 };
 
 /* STORAGE */
@@ -83,47 +92,50 @@ bgpstream_pfx_set_t *bgpstream_pfx_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_pfx_set)) == NULL) {
-    bgpstream_pfx_set_destroy(set);
-    return NULL;
-  }
-  set->ipv4_size = 0;
-  set->ipv6_size = 0;
+  swiss_pfx4_init(&set->v4);
+  swiss_pfx6_init(&set->v6);
   return set;
 }
 
 int bgpstream_pfx_set_insert(bgpstream_pfx_set_t *set,
                              bgpstream_pfx_t *pfx)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_pfx_set, set->hash, *pfx, &khret);
-    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
-      set->ipv4_size++;
-    } else {
-      set->ipv6_size++;
-    }
-    return 1;
+  pfx4_key_t k4;
+  pfx6_key_t k6;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    k4 = pfx4_key(&pfx->bs_ipv4);
+    return swiss_pfx4_insert(&set->v4, &k4);
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    pfx6_key(&pfx->bs_ipv6, &k6);
+    return swiss_pfx6_insert(&set->v6, &k6);
+  default:
+    return -1;
   }
-  return 0;
 }
 
 int bgpstream_pfx_set_exists(bgpstream_pfx_set_t *set,
                              bgpstream_pfx_t *pfx)
 {
-  khiter_t k;
-  if ((k = kh_get(bgpstream_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
+  pfx4_key_t k4;
+  pfx6_key_t k6;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    k4 = pfx4_key(&pfx->bs_ipv4);
+    return swiss_pfx4_exists(&set->v4, &k4);
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    pfx6_key(&pfx->bs_ipv6, &k6);
+    return swiss_pfx6_exists(&set->v6, &k6);
+  default:
     return 0;
   }
-  return 1;
 }
 
 int bgpstream_pfx_set_size(bgpstream_pfx_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v4.size + set->v6.size;
 }
 
 int bgpstream_pfx_set_version_size(bgpstream_pfx_set_t *set,
@@ -131,9 +143,9 @@ int bgpstream_pfx_set_version_size(bgpstream_pfx_set_t *set,
 {
   switch (v) {
   case BGPSTREAM_ADDR_VERSION_IPV4:
-    return set->ipv4_size;
+    return set->v4.size;
   case BGPSTREAM_ADDR_VERSION_IPV6:
-    return set->ipv6_size;
+    return set->v6.size;
   default:
     return -1;
   }
@@ -142,12 +154,18 @@ int bgpstream_pfx_set_version_size(bgpstream_pfx_set_t *set,
 int bgpstream_pfx_set_merge(bgpstream_pfx_set_t *dst_set,
                             bgpstream_pfx_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_pfx_set_insert(dst_set, &(kh_key(src_set->hash, k))) < 0) {
-        return -1;
-      }
+  const pfx4_key_t *k4;
+  const pfx6_key_t *k6;
+  uint64_t i;
+
+  for (i = 0; swiss_pfx4_next(&src_set->v4, &i, &k4); i++) {
+    if (swiss_pfx4_insert(&dst_set->v4, k4) < 0) {
+      return -1;
+    }
+  }
+  for (i = 0; swiss_pfx6_next(&src_set->v6, &i, &k6); i++) {
+    if (swiss_pfx6_insert(&dst_set->v6, k6) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -155,15 +173,15 @@ int bgpstream_pfx_set_merge(bgpstream_pfx_set_t *dst_set,
 
 void bgpstream_pfx_set_destroy(bgpstream_pfx_set_t *set)
 {
-  kh_destroy(bgpstream_pfx_set, set->hash);
+  swiss_pfx4_free(&set->v4);
+  swiss_pfx6_free(&set->v6);
   free(set);
 }
 
 void bgpstream_pfx_set_clear(bgpstream_pfx_set_t *set)
 {
-  kh_clear(bgpstream_pfx_set, set->hash);
-  set->ipv4_size = 0;
-  set->ipv6_size = 0;
+  swiss_pfx4_clear(&set->v4);
+  swiss_pfx6_clear(&set->v6);
 }
 
 /* IPv4 */
@@ -177,53 +195,38 @@ bgpstream_ipv4_pfx_set_t *bgpstream_ipv4_pfx_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_ipv4_pfx_set)) == NULL) {
-    bgpstream_ipv4_pfx_set_destroy(set);
-    return NULL;
-  }
-
+  swiss_pfx4_init(&set->v4);
   return set;
 }
 
 int bgpstream_ipv4_pfx_set_insert(bgpstream_ipv4_pfx_set_t *set,
                                   bgpstream_ipv4_pfx_t *pfx)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv4_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_ipv4_pfx_set, set->hash, *pfx, &khret);
-    return 1;
-  }
-  return 0;
+  pfx4_key_t k = pfx4_key(pfx);
+  return swiss_pfx4_insert(&set->v4, &k);
 }
 
 int bgpstream_ipv4_pfx_set_exists(bgpstream_ipv4_pfx_set_t *set,
                                   bgpstream_ipv4_pfx_t *pfx)
 {
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv4_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
-    return 0;
-  }
-  return 1;
+  pfx4_key_t k = pfx4_key(pfx);
+  return swiss_pfx4_exists(&set->v4, &k);
 }
 
 int bgpstream_ipv4_pfx_set_size(bgpstream_ipv4_pfx_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v4.size;
 }
 
 int bgpstream_ipv4_pfx_set_merge(bgpstream_ipv4_pfx_set_t *dst_set,
                                  bgpstream_ipv4_pfx_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_ipv4_pfx_set_insert(dst_set, &(kh_key(src_set->hash, k))) <
-          0) {
-        return -1;
-      }
+  const pfx4_key_t *k;
+  uint64_t i;
+
+  for (i = 0; swiss_pfx4_next(&src_set->v4, &i, &k); i++) {
+    if (swiss_pfx4_insert(&dst_set->v4, k) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -231,13 +234,13 @@ int bgpstream_ipv4_pfx_set_merge(bgpstream_ipv4_pfx_set_t *dst_set,
 
 void bgpstream_ipv4_pfx_set_destroy(bgpstream_ipv4_pfx_set_t *set)
 {
-  kh_destroy(bgpstream_ipv4_pfx_set, set->hash);
+  swiss_pfx4_free(&set->v4);
   free(set);
 }
 
 void bgpstream_ipv4_pfx_set_clear(bgpstream_ipv4_pfx_set_t *set)
 {
-  kh_clear(bgpstream_ipv4_pfx_set, set->hash);
+  swiss_pfx4_clear(&set->v4);
 }
 
 /* IPv6 */
@@ -251,53 +254,40 @@ bgpstream_ipv6_pfx_set_t *bgpstream_ipv6_pfx_set_create()
     return NULL;
   }
 
-  if ((set->hash = kh_init(bgpstream_ipv6_pfx_set)) == NULL) {
-    bgpstream_ipv6_pfx_set_destroy(set);
-    return NULL;
-  }
-
+  swiss_pfx6_init(&set->v6);
   return set;
 }
 
 int bgpstream_ipv6_pfx_set_insert(bgpstream_ipv6_pfx_set_t *set,
                                   bgpstream_ipv6_pfx_t *pfx)
 {
-  int khret;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv6_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
-    k = kh_put(bgpstream_ipv6_pfx_set, set->hash, *pfx, &khret);
-    return 1;
-  }
-  return 0;
+  pfx6_key_t k;
+  pfx6_key(pfx, &k);
+  return swiss_pfx6_insert(&set->v6, &k);
 }
 
 int bgpstream_ipv6_pfx_set_exists(bgpstream_ipv6_pfx_set_t *set,
                                   bgpstream_ipv6_pfx_t *pfx)
 {
-  khiter_t k;
-  if ((k = kh_get(bgpstream_ipv6_pfx_set, set->hash, *pfx)) ==
-      kh_end(set->hash)) {
-    return 0;
-  }
-  return 1;
+  pfx6_key_t k;
+  pfx6_key(pfx, &k);
+  return swiss_pfx6_exists(&set->v6, &k);
 }
 
 int bgpstream_ipv6_pfx_set_size(bgpstream_ipv6_pfx_set_t *set)
 {
-  return kh_size(set->hash);
+  return set->v6.size;
 }
 
 int bgpstream_ipv6_pfx_set_merge(bgpstream_ipv6_pfx_set_t *dst_set,
                                  bgpstream_ipv6_pfx_set_t *src_set)
 {
-  khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (bgpstream_ipv6_pfx_set_insert(dst_set, &(kh_key(src_set->hash, k))) <
-          0) {
-        return -1;
-      }
+  const pfx6_key_t *k;
+  uint64_t i;
+
+  for (i = 0; swiss_pfx6_next(&src_set->v6, &i, &k); i++) {
+    if (swiss_pfx6_insert(&dst_set->v6, k) < 0) {
+      return -1;
     }
   }
   return 0;
@@ -305,11 +295,11 @@ int bgpstream_ipv6_pfx_set_merge(bgpstream_ipv6_pfx_set_t *dst_set,
 
 void bgpstream_ipv6_pfx_set_destroy(bgpstream_ipv6_pfx_set_t *set)
 {
-  kh_destroy(bgpstream_ipv6_pfx_set, set->hash);
+  swiss_pfx6_free(&set->v6);
   free(set);
 }
 
 void bgpstream_ipv6_pfx_set_clear(bgpstream_ipv6_pfx_set_t *set)
 {
-  kh_clear(bgpstream_ipv6_pfx_set, set->hash);
+  swiss_pfx6_clear(&set->v6);
 }
@@ -27,6 +27,10 @@
 #ifndef __BGPSTREAM_UTILS_PRIVATE_H
 #define __BGPSTREAM_UTILS_PRIVATE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 /* Convert a network-order 16 bit integer pointed to by p to host order.
  * Safe even if value is unaligned, unlike ntohs(*(uint16_t*)p). */
 #define nptohs(p)                                                              \
@@ -56,4 +60,185 @@
    ((uint64_t)((const uint8_t*)(p))[6] << 8) |                                 \
    ((uint64_t)((const uint8_t*)(p))[7])))
 
+/* Fast text formatting helpers.
+ *
+ * The *_to_str functions write without a terminating nul and assume that the
+ * buffer is large enough; they return the number of characters written. The
+ * *_snprintf functions have the same semantics (return value, truncation and
+ * termination) as the equivalent snprintf call. */
+
+/* Maximum number of characters written by bs_u32_to_str */
+#define BS_U32_STR_LEN 10
+
+/* Maximum number of characters written by bs_ipv4_to_str */
+#define BS_IPV4_STR_LEN 15
+
+/* Maximum number of characters written by bs_ipv6_to_str */
+#define BS_IPV6_STR_LEN 45
+
+static const char bs_digit_pairs[] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+static inline int bs_u32_digits(uint32_t v)
+{
+  int n = 1;
+  while (v >= 10000) {
+    v /= 10000;
+    n += 4;
+  }
+  return n + (v >= 10) + (v >= 100) + (v >= 1000);
+}
+
+/* same output as "%" PRIu32 */
+static inline int bs_u32_to_str(char *p, uint32_t v)
+{
+  int n = bs_u32_digits(v);
+  char *e = p + n;
+
+  while (v >= 100) {
+    e -= 2;
+    memcpy(e, &bs_digit_pairs[(v % 100) * 2], 2);
+    v /= 100;
+  }
+  if (v >= 10) {
+    memcpy(e - 2, &bs_digit_pairs[v * 2], 2);
+  } else {
+    e[-1] = '0' + v;
+  }
+  return n;
+}
+
+/* same output as "%06" PRIu32 for v < 1000000 */
+static inline int bs_u32_to_str_pad6(char *p, uint32_t v)
+{
+  memcpy(p + 4, &bs_digit_pairs[(v % 100) * 2], 2);
+  v /= 100;
+  memcpy(p + 2, &bs_digit_pairs[(v % 100) * 2], 2);
+  v /= 100;
+  memcpy(p, &bs_digit_pairs[(v % 100) * 2], 2);
+  return 6;
+}
+
+/* same output as inet_ntop(AF_INET, ...) for the 4 network-order bytes */
+static inline int bs_ipv4_to_str(char *p, const uint8_t *addr)
+{
+  int n = 0, i;
+
+  for (i = 0; i < 4; i++) {
+    if (i > 0) {
+      p[n++] = '.';
+    }
+    n += bs_u32_to_str(p + n, addr[i]);
+  }
+  return n;
+}
+
+/* same output as inet_ntop(AF_INET6, ...) for the 16 network-order bytes:
+ * RFC 5952 form, with the longest (first on ties) run of two or more zero
+ * words shortened to "::", and IPv4-mapped/compatible addresses written with
+ * a dotted quad */
+static inline int bs_ipv6_to_str(char *p, const uint8_t *addr)
+{
+  static const char hex[] = "0123456789abcdef";
+  uint16_t words[8];
+  int best_base = -1, best_len = 0, cur_base = -1, cur_len = 0;
+  int n = 0, i, shift;
+
+  for (i = 0; i < 8; i++) {
+    words[i] = (uint16_t)(addr[i * 2] << 8 | addr[i * 2 + 1]);
+    if (words[i] == 0) {
+      if (cur_base == -1) {
+        cur_base = i;
+        cur_len = 0;
+      }
+      cur_len++;
+    } else {
+      cur_base = -1;
+    }
+    if (cur_base != -1 && cur_len > best_len) {
+      best_base = cur_base;
+      best_len = cur_len;
+    }
+  }
+  if (best_len < 2) {
+    best_base = -1;
+  }
+
+  for (i = 0; i < 8; i++) {
+    if (best_base != -1 && i >= best_base && i < best_base + best_len) {
+      if (i == best_base) {
+        p[n++] = ':';
+      }
+      continue;
+    }
+    if (i != 0) {
+      p[n++] = ':';
+    }
+    if (i == 6 && best_base == 0 &&
+        (best_len == 6 || (best_len == 5 && words[5] == 0xffff))) {
+      return n + bs_ipv4_to_str(p + n, addr + 12);
+    }
+    for (shift = 12; shift > 0 && (words[i] >> shift) == 0; shift -= 4)
+      ;
+    for (; shift >= 0; shift -= 4) {
+      p[n++] = hex[(words[i] >> shift) & 0xf];
+    }
+  }
+  if (best_base != -1 && best_base + best_len == 8) {
+    p[n++] = ':';
+  }
+  return n;
+}
+
+static inline int bs_u32_snprintf(char *buf, size_t len, uint32_t v)
+{
+  char tmp[BS_U32_STR_LEN];
+  int n;
+
+  if (len > BS_U32_STR_LEN) {
+    n = bs_u32_to_str(buf, v);
+    buf[n] = '\0';
+    return n;
+  }
+  n = bs_u32_to_str(tmp, v);
+  if (len > 0) {
+    size_t c = ((size_t)n < len) ? (size_t)n : len - 1;
+    memcpy(buf, tmp, c);
+    buf[c] = '\0';
+  }
+  return n;
+}
+
+/* same as snprintf(buf, len, "%s", str) where str has length str_len */
+static inline int bs_str_snprintf(char *buf, size_t len, const char *str,
+                                  size_t str_len)
+{
+  if (len > 0) {
+    size_t c = (str_len < len) ? str_len : len - 1;
+    memcpy(buf, str, c);
+    buf[c] = '\0';
+  }
+  return (int)str_len;
+}
+
+/* Fast text parsing helpers.
+ *
+ * These accept exactly what inet_pton accepts, but parse len characters of
+ * str (which need not be nul-terminated). They return 1 on success and 0 if
+ * the text is not a valid address. */
+
+/* parse an IPv4 address into 4 network-order bytes */
+int bs_str_to_ipv4(const char *str, size_t len, uint8_t *addr);
+
+/* parse an IPv6 address into 16 network-order bytes */
+int bs_str_to_ipv6(const char *str, size_t len, uint8_t *addr);
+
 #endif // __BGPSTREAM_UTILS_PRIVATE_H
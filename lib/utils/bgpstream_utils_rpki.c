@@ -28,11 +28,156 @@
  */
 
 #include "bgpstream_utils_rpki.h"
+#include "bgpstream_log.h"
 #include "config.h"
 #include "utils.h"
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+/** Number of entries in each set of the RPKI cache */
+#define RPKI_CACHE_WAYS 4
+
+/** Key of an RPKI cache entry */
+typedef struct rpki_cache_key {
+
+  /** Prefix address (IPv4 addresses use the first 4 bytes) */
+  uint8_t addr[16];
+
+  /** Origin ASN */
+  uint32_t asn;
+
+  /** ROA snapshot epoch */
+  uint32_t epoch;
+
+  /** IP version (BGPSTREAM_ADDR_VERSION_IPV4 or _IPV6) */
+  uint8_t version;
+
+  /** Prefix mask length */
+  uint8_t mask_len;
+
+} rpki_cache_key_t;
+
+/** An RPKI cache entry */
+typedef struct rpki_cache_entry {
+
+  rpki_cache_key_t key;
+
+  /** Validation result (owned), or NULL if the entry is unused */
+  char *result;
+
+  /** Tick of the last use (for LRU eviction within the set) */
+  uint64_t used;
+
+} rpki_cache_entry_t;
+
+struct bgpstream_rpki_cache {
+
+  /** Entries, in sets of RPKI_CACHE_WAYS consecutive entries */
+  rpki_cache_entry_t *entries;
+
+  /** Number of sets - 1 */
+  uint32_t set_mask;
+
+  /** Length of a ROA snapshot epoch (0 for a single epoch) */
+  uint32_t epoch_len;
+
+  /** LRU clock */
+  uint64_t tick;
+
+  /** Statistics */
+  uint64_t hits;
+  uint64_t misses;
+
+  /** Results evicted since the last call. These are only freed at the start of
+      the next call so that previously returned results remain valid. */
+  char **evicted;
+  int evicted_cnt;
+  int evicted_alloc;
+
+  /** Scratch buffers for the ROAFetchlib */
+  char prefix[INET6_ADDRSTRLEN];
+  char result[BGPSTREAM_RPKI_RESULT_LEN];
+};
+
+/** A record read ahead by an RPKI pipeline */
+typedef struct rpki_pipeline_rec {
+
+  /** Borrowed record */
+  bgpstream_record_t *record;
+
+  /** Index of the first elem of the record in the pipeline elem array */
+  int elem_first;
+
+  /** Number of elems of the record */
+  int elem_cnt;
+
+  /** Whether the elems of the record have been validated */
+  int done;
+
+} rpki_pipeline_rec_t;
+
+/** An elem copied out of a record by an RPKI pipeline */
+typedef struct rpki_pipeline_elem {
+
+  bgpstream_elem_t *elem;
+
+  /** Validation result (reused between batches) */
+  char *result;
+  size_t result_alloc;
+
+} rpki_pipeline_elem_t;
+
+/** State of an RPKI pipeline worker thread */
+typedef struct rpki_pipeline_worker {
+
+  struct bgpstream_rpki_pipeline *pipeline;
+
+  pthread_t thread;
+
+  rpki_cfg_t *cfg;
+
+  bgpstream_rpki_cache_t *cache;
+
+} rpki_pipeline_worker_t;
+
+struct bgpstream_rpki_pipeline {
+
+  bgpstream_t *bs;
+
+  rpki_pipeline_worker_t *workers;
+  int workers_cnt;
+  int workers_started;
+
+  /** Current batch of records */
+  bgpstream_record_t **batch;
+  rpki_pipeline_rec_t *recs;
+  int depth;
+  int rec_cnt;
+
+  /** Elems of the current batch */
+  rpki_pipeline_elem_t *elems;
+  int elem_cnt;
+  int elem_alloc;
+
+  /** Index of the next record to validate */
+  int next_job;
+
+  /** Number of validated records */
+  int done_cnt;
+
+  /** Consumer position */
+  int cur_rec;
+  int cur_elem;
+  int cur_ready;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t job_cond;
+  pthread_cond_t done_cond;
+  int shutdown;
+};
+
 bgpstream_rpki_input_t *bgpstream_rpki_create_input()
 {
   /* Create a BGPStream RPKI input struct instance */
@@ -118,6 +263,15 @@ void bgpstream_rpki_parse_default(bgpstream_rpki_input_t *inp)
 int bgpstream_rpki_validate(bgpstream_elem_t const *elem, char *result,
                             size_t size)
 {
+  /* Use the result of an RPKI pipeline if the elem was validated already */
+  if (elem->annotations.rpki_result != NULL) {
+    if (elem->annotations.rpki_result[0] == '\0') {
+      return 0;
+    }
+    snprintf(result, size, "%s", elem->annotations.rpki_result);
+    return 1;
+  }
+
   /* Validate a BGP elem with the ROAFetchlib */
   int val_rst = 0;
   char prefix[INET6_ADDRSTRLEN];
@@ -128,7 +282,15 @@ int bgpstream_rpki_validate(bgpstream_elem_t const *elem, char *result,
      (i.e. not a set). If the validation function of the ROAFetchlib
      returns 0 -> a valid result (val_rst = 1) is available */
   if (!bgpstream_as_path_get_origin_val(elem->as_path, &asn)) {
-    if (!rpki_validate(elem->annotations.cfg, elem->annotations.timestamp, asn,
+    if (elem->annotations.rpki_cache != NULL) {
+      const char *cached = bgpstream_rpki_cache_validate(
+        elem->annotations.rpki_cache, elem->annotations.cfg,
+        elem->annotations.timestamp, &elem->prefix, asn);
+      if (cached != NULL) {
+        snprintf(result, size, "%s", cached);
+        val_rst = 1;
+      }
+    } else if (!rpki_validate(elem->annotations.cfg, elem->annotations.timestamp, asn,
                        prefix, elem->prefix.mask_len, result, size)) {
       val_rst = 1;
     }
@@ -136,3 +298,563 @@ int bgpstream_rpki_validate(bgpstream_elem_t const *elem, char *result,
 
   return val_rst;
 }
+
+static void cache_free_evicted(bgpstream_rpki_cache_t *cache)
+{
+  int i;
+  for (i = 0; i < cache->evicted_cnt; i++) {
+    free(cache->evicted[i]);
+  }
+  cache->evicted_cnt = 0;
+}
+
+static int cache_evict(bgpstream_rpki_cache_t *cache, char *result)
+{
+  char **tmp;
+  int new_alloc;
+
+  if (cache->evicted_cnt == cache->evicted_alloc) {
+    new_alloc = cache->evicted_alloc * 2;
+    if ((tmp = realloc(cache->evicted, sizeof(char *) * new_alloc)) == NULL) {
+      return -1;
+    }
+    cache->evicted = tmp;
+    cache->evicted_alloc = new_alloc;
+  }
+  cache->evicted[cache->evicted_cnt++] = result;
+  return 0;
+}
+
+static inline int cache_key_eq(const rpki_cache_key_t *a,
+                               const rpki_cache_key_t *b)
+{
+  return a->asn == b->asn && a->epoch == b->epoch &&
+         a->mask_len == b->mask_len && a->version == b->version &&
+         memcmp(a->addr, b->addr, sizeof(a->addr)) == 0;
+}
+
+static inline uint32_t cache_key_hash(const rpki_cache_key_t *key)
+{
+  uint64_t h, w[2];
+  memcpy(w, key->addr, sizeof(w));
+  h = w[0] ^ (w[1] * 0x9e3779b97f4a7c15ULL);
+  h ^= ((uint64_t)key->asn << 32) | key->epoch;
+  h ^= ((uint64_t)key->mask_len << 8) | key->version;
+  /* murmur3 finalizer */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+static inline void cache_key_init(const bgpstream_rpki_cache_t *cache,
+                                  rpki_cache_key_t *key, uint8_t version,
+                                  const uint8_t *addr, uint8_t mask_len,
+                                  uint32_t asn, uint32_t timestamp)
+{
+  memset(key->addr, 0, sizeof(key->addr));
+  memcpy(key->addr, addr, version == BGPSTREAM_ADDR_VERSION_IPV4 ? 4 : 16);
+  key->version = version;
+  key->mask_len = mask_len;
+  key->asn = asn;
+  key->epoch = cache->epoch_len != 0 ? timestamp / cache->epoch_len : 0;
+}
+
+static const char *cache_lookup(bgpstream_rpki_cache_t *cache, rpki_cfg_t *cfg,
+                                const rpki_cache_key_t *key,
+                                uint32_t timestamp)
+{
+  rpki_cache_entry_t *set, *victim;
+  bgpstream_ip_addr_t addr;
+  char *result;
+  int i;
+
+  set = &cache->entries[(cache_key_hash(key) & cache->set_mask) *
+                        RPKI_CACHE_WAYS];
+  victim = &set[0];
+  for (i = 0; i < RPKI_CACHE_WAYS; i++) {
+    if (set[i].result != NULL && cache_key_eq(&set[i].key, key)) {
+      set[i].used = ++cache->tick;
+      cache->hits++;
+      return set[i].result;
+    }
+    if (victim->result != NULL &&
+        (set[i].result == NULL || set[i].used < victim->used)) {
+      victim = &set[i];
+    }
+  }
+  cache->misses++;
+
+  /* not cached, ask the ROAFetchlib */
+  if (key->version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    bgpstream_ipv4_addr_init(&addr, key->addr);
+  } else {
+    bgpstream_ipv6_addr_init(&addr, key->addr);
+  }
+  if (bgpstream_addr_ntop_len(cache->prefix, sizeof(cache->prefix), &addr) <
+      0) {
+    return NULL;
+  }
+  if (rpki_validate(cfg, timestamp, key->asn, cache->prefix, key->mask_len,
+                    cache->result, sizeof(cache->result)) != 0) {
+    /* failures are not cached */
+    return NULL;
+  }
+
+  if ((result = strdup(cache->result)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not cache RPKI result");
+    return NULL;
+  }
+  if (victim->result != NULL && cache_evict(cache, victim->result) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not evict RPKI result");
+    free(result);
+    return NULL;
+  }
+  victim->key = *key;
+  victim->result = result;
+  victim->used = ++cache->tick;
+  return result;
+}
+
+bgpstream_rpki_cache_t *bgpstream_rpki_cache_create(uint32_t size,
+                                                    uint32_t epoch_len)
+{
+  bgpstream_rpki_cache_t *cache = NULL;
+  uint32_t sets;
+
+  if (size == 0) {
+    size = BGPSTREAM_RPKI_CACHE_DEFAULT_SIZE;
+  }
+  sets = 1;
+  while (sets * RPKI_CACHE_WAYS < size && sets < (UINT32_MAX >> 3)) {
+    sets <<= 1;
+  }
+
+  if ((cache = malloc_zero(sizeof(bgpstream_rpki_cache_t))) == NULL) {
+    goto err;
+  }
+  if ((cache->entries = malloc_zero(sizeof(rpki_cache_entry_t) * sets *
+                                    RPKI_CACHE_WAYS)) == NULL) {
+    goto err;
+  }
+  cache->set_mask = sets - 1;
+  cache->epoch_len = epoch_len;
+
+  cache->evicted_alloc = RPKI_CACHE_WAYS;
+  if ((cache->evicted = malloc(sizeof(char *) * cache->evicted_alloc)) ==
+      NULL) {
+    goto err;
+  }
+
+  return cache;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create RPKI cache");
+  bgpstream_rpki_cache_destroy(cache);
+  return NULL;
+}
+
+void bgpstream_rpki_cache_destroy(bgpstream_rpki_cache_t *cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+  if (cache->entries != NULL) {
+    bgpstream_rpki_cache_clear(cache);
+  }
+  cache_free_evicted(cache);
+  free(cache->evicted);
+  free(cache->entries);
+  free(cache);
+}
+
+void bgpstream_rpki_cache_clear(bgpstream_rpki_cache_t *cache)
+{
+  uint64_t i;
+
+  cache_free_evicted(cache);
+  for (i = 0; i < ((uint64_t)cache->set_mask + 1) * RPKI_CACHE_WAYS; i++) {
+    free(cache->entries[i].result);
+    cache->entries[i].result = NULL;
+  }
+  cache->tick = 0;
+}
+
+void bgpstream_rpki_cache_get_stats(bgpstream_rpki_cache_t *cache,
+                                    uint64_t *hits, uint64_t *misses)
+{
+  *hits = cache->hits;
+  *misses = cache->misses;
+}
+
+const char *bgpstream_rpki_cache_validate(bgpstream_rpki_cache_t *cache,
+                                          rpki_cfg_t *cfg, uint32_t timestamp,
+                                          const bgpstream_pfx_t *pfx,
+                                          uint32_t asn)
+{
+  rpki_cache_key_t key;
+
+  cache_free_evicted(cache);
+
+  if (pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV4 &&
+      pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV6) {
+    return NULL;
+  }
+  cache_key_init(cache, &key, pfx->address.version, pfx->address.addr,
+                 pfx->mask_len, asn, timestamp);
+  return cache_lookup(cache, cfg, &key, timestamp);
+}
+
+int bgpstream_rpki_validate_batch(bgpstream_rpki_cache_t *cache,
+                                  rpki_cfg_t *cfg,
+                                  const bgpstream_elem_batch_t *batch,
+                                  const char **results)
+{
+  rpki_cache_key_t key, prev_key;
+  const char *prev = NULL;
+  uint8_t version;
+  int i, have_prev = 0, cnt = 0;
+
+  if (batch->time_sec == NULL || batch->type == NULL ||
+      batch->prefix_ip_version == NULL || batch->prefix_addr == NULL ||
+      batch->prefix_len == NULL || batch->origin_asn == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "RPKI batch validation requires the time, type, prefix and "
+                  "origin columns");
+    return -1;
+  }
+
+  cache_free_evicted(cache);
+
+  for (i = 0; i < batch->cnt; i++) {
+    results[i] = NULL;
+    if ((batch->type[i] != BGPSTREAM_ELEM_TYPE_RIB &&
+         batch->type[i] != BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) ||
+        batch->origin_asn[i] == 0) {
+      continue;
+    }
+    switch (batch->prefix_ip_version[i]) {
+    case 4:
+      version = BGPSTREAM_ADDR_VERSION_IPV4;
+      break;
+    case 6:
+      version = BGPSTREAM_ADDR_VERSION_IPV6;
+      break;
+    default:
+      continue;
+    }
+    cache_key_init(cache, &key, version, batch->prefix_addr[i],
+                   batch->prefix_len[i], batch->origin_asn[i],
+                   batch->time_sec[i]);
+
+    /* RIB dumps list all the peers of a prefix consecutively */
+    if (!have_prev || !cache_key_eq(&key, &prev_key)) {
+      prev = cache_lookup(cache, cfg, &key, batch->time_sec[i]);
+      prev_key = key;
+      have_prev = 1;
+    } else if (prev != NULL) {
+      cache->hits++;
+    }
+    if ((results[i] = prev) != NULL) {
+      cnt++;
+    }
+  }
+
+  return cnt;
+}
+
+static int pipeline_validate_elem(rpki_pipeline_worker_t *worker,
+                                  rpki_pipeline_elem_t *pe, uint32_t timestamp)
+{
+  bgpstream_elem_t *elem = pe->elem;
+  const char *res = NULL;
+  size_t len;
+  uint32_t asn;
+  char *tmp;
+
+  if ((elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+       elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) &&
+      !bgpstream_as_path_get_origin_val(elem->as_path, &asn)) {
+    res = bgpstream_rpki_cache_validate(worker->cache, worker->cfg, timestamp,
+                                        &elem->prefix, asn);
+  }
+  if (res == NULL) {
+    res = "";
+  }
+
+  elem->annotations.rpki_active = 1;
+  elem->annotations.cfg = worker->cfg;
+  elem->annotations.timestamp = timestamp;
+  elem->annotations.rpki_cache = NULL;
+  /* the configuration is owned by the worker, so the elem must never be
+     validated again by the consumer */
+  elem->annotations.rpki_result = "";
+
+  len = strlen(res) + 1;
+  if (len > pe->result_alloc) {
+    if ((tmp = realloc(pe->result, len)) == NULL) {
+      return -1;
+    }
+    pe->result = tmp;
+    pe->result_alloc = len;
+  }
+  memcpy(pe->result, res, len);
+  elem->annotations.rpki_result = pe->result;
+  return 0;
+}
+
+static void *pipeline_worker(void *arg)
+{
+  rpki_pipeline_worker_t *worker = arg;
+  bgpstream_rpki_pipeline_t *p = worker->pipeline;
+  rpki_pipeline_rec_t *rec;
+  int i, r;
+
+  pthread_mutex_lock(&p->mutex);
+  while (1) {
+    while (!p->shutdown && p->next_job >= p->rec_cnt) {
+      pthread_cond_wait(&p->job_cond, &p->mutex);
+    }
+    if (p->shutdown) {
+      break;
+    }
+    r = p->next_job++;
+    pthread_mutex_unlock(&p->mutex);
+
+    rec = &p->recs[r];
+    for (i = 0; i < rec->elem_cnt; i++) {
+      if (pipeline_validate_elem(worker, &p->elems[rec->elem_first + i],
+                                 rec->record->time_sec) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Could not store RPKI result");
+      }
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    rec->done = 1;
+    p->done_cnt++;
+    pthread_cond_broadcast(&p->done_cond);
+  }
+  pthread_mutex_unlock(&p->mutex);
+
+  return NULL;
+}
+
+/* copy the elems of a record out so that workers can validate them while the
+   consumer handles other records */
+static int pipeline_copy_elems(bgpstream_rpki_pipeline_t *p,
+                               rpki_pipeline_rec_t *rec)
+{
+  bgpstream_elem_t *elem;
+  rpki_pipeline_elem_t *tmp;
+  int new_alloc;
+  int rc;
+
+  rec->elem_first = p->elem_cnt;
+  rec->elem_cnt = 0;
+  if (rec->record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+    return 0;
+  }
+
+  while ((rc = bgpstream_record_get_next_elem(rec->record, &elem)) > 0) {
+    if (p->elem_cnt == p->elem_alloc) {
+      new_alloc = p->elem_alloc == 0 ? 1024 : p->elem_alloc * 2;
+      if ((tmp = realloc(p->elems, sizeof(rpki_pipeline_elem_t) * new_alloc)) ==
+          NULL) {
+        return -1;
+      }
+      memset(&tmp[p->elem_alloc], 0,
+             sizeof(rpki_pipeline_elem_t) * (new_alloc - p->elem_alloc));
+      p->elems = tmp;
+      p->elem_alloc = new_alloc;
+    }
+    if (p->elems[p->elem_cnt].elem == NULL &&
+        (p->elems[p->elem_cnt].elem = bgpstream_elem_create()) == NULL) {
+      return -1;
+    }
+    if (bgpstream_elem_copy(p->elems[p->elem_cnt].elem, elem) == NULL) {
+      return -1;
+    }
+    p->elem_cnt++;
+    rec->elem_cnt++;
+  }
+
+  return rc;
+}
+
+static int pipeline_fill(bgpstream_rpki_pipeline_t *p)
+{
+  int i, n;
+
+  /* wait for the workers to finish the previous batch */
+  pthread_mutex_lock(&p->mutex);
+  while (p->done_cnt < p->next_job) {
+    pthread_cond_wait(&p->done_cond, &p->mutex);
+  }
+  p->rec_cnt = p->next_job = p->done_cnt = 0;
+  pthread_mutex_unlock(&p->mutex);
+  p->elem_cnt = 0;
+
+  if ((n = bgpstream_get_next_records(p->bs, p->batch, p->depth)) <= 0) {
+    return n;
+  }
+
+  for (i = 0; i < n; i++) {
+    p->recs[i].record = p->batch[i];
+    p->recs[i].done = 0;
+    if (pipeline_copy_elems(p, &p->recs[i]) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not read RPKI pipeline elems");
+      return -1;
+    }
+  }
+
+  /* hand the whole batch to the workers */
+  pthread_mutex_lock(&p->mutex);
+  p->rec_cnt = n;
+  pthread_cond_broadcast(&p->job_cond);
+  pthread_mutex_unlock(&p->mutex);
+
+  return n;
+}
+
+bgpstream_rpki_pipeline_t *
+bgpstream_rpki_pipeline_create(bgpstream_t *bs, rpki_cfg_t **cfgs, int workers,
+                               int depth, uint32_t epoch_len)
+{
+  bgpstream_rpki_pipeline_t *p = NULL;
+  rpki_pipeline_worker_t *w;
+  int i;
+
+  if (workers < 1) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "An RPKI pipeline needs a worker");
+    return NULL;
+  }
+  if (depth <= 0) {
+    depth = BGPSTREAM_RPKI_PIPELINE_DEFAULT_DEPTH;
+  }
+
+  if ((p = malloc_zero(sizeof(bgpstream_rpki_pipeline_t))) == NULL) {
+    goto err;
+  }
+  p->bs = bs;
+  p->depth = depth;
+  p->cur_rec = -1;
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->job_cond, NULL);
+  pthread_cond_init(&p->done_cond, NULL);
+
+  if ((p->batch = malloc_zero(sizeof(bgpstream_record_t *) * depth)) == NULL ||
+      (p->recs = malloc_zero(sizeof(rpki_pipeline_rec_t) * depth)) == NULL ||
+      (p->workers = malloc_zero(sizeof(rpki_pipeline_worker_t) * workers)) ==
+        NULL) {
+    goto err;
+  }
+  p->workers_cnt = workers;
+
+  for (i = 0; i < workers; i++) {
+    w = &p->workers[i];
+    w->pipeline = p;
+    w->cfg = cfgs[i];
+    if ((w->cache = bgpstream_rpki_cache_create(0, epoch_len)) == NULL) {
+      goto err;
+    }
+  }
+  for (i = 0; i < workers; i++) {
+    if (pthread_create(&p->workers[i].thread, NULL, pipeline_worker,
+                       &p->workers[i]) != 0) {
+      goto err;
+    }
+    p->workers_started++;
+  }
+
+  return p;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create RPKI pipeline");
+  bgpstream_rpki_pipeline_destroy(p);
+  return NULL;
+}
+
+void bgpstream_rpki_pipeline_destroy(bgpstream_rpki_pipeline_t *p)
+{
+  int i;
+
+  if (p == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  p->shutdown = 1;
+  pthread_cond_broadcast(&p->job_cond);
+  pthread_mutex_unlock(&p->mutex);
+  for (i = 0; i < p->workers_started; i++) {
+    pthread_join(p->workers[i].thread, NULL);
+  }
+
+  if (p->workers != NULL) {
+    for (i = 0; i < p->workers_cnt; i++) {
+      bgpstream_rpki_cache_destroy(p->workers[i].cache);
+    }
+  }
+  for (i = 0; i < p->elem_alloc; i++) {
+    bgpstream_elem_destroy(p->elems[i].elem);
+    free(p->elems[i].result);
+  }
+  free(p->elems);
+  free(p->workers);
+  free(p->recs);
+  free(p->batch);
+
+  pthread_cond_destroy(&p->done_cond);
+  pthread_cond_destroy(&p->job_cond);
+  pthread_mutex_destroy(&p->mutex);
+  free(p);
+}
+
+int bgpstream_rpki_pipeline_get_next_record(bgpstream_rpki_pipeline_t *p,
+                                            bgpstream_record_t **record)
+{
+  int rc;
+
+  *record = NULL;
+  if (p->cur_rec + 1 >= p->rec_cnt) {
+    p->cur_rec = -1;
+    if ((rc = pipeline_fill(p)) <= 0) {
+      return rc;
+    }
+  }
+
+  p->cur_rec++;
+  p->cur_elem = 0;
+  p->cur_ready = 0;
+  *record = p->recs[p->cur_rec].record;
+  return 1;
+}
+
+int bgpstream_rpki_pipeline_get_next_elem(bgpstream_rpki_pipeline_t *p,
+                                          bgpstream_elem_t **elem)
+{
+  rpki_pipeline_rec_t *rec;
+
+  *elem = NULL;
+  if (p->cur_rec < 0) {
+    return 0;
+  }
+  rec = &p->recs[p->cur_rec];
+
+  if (!p->cur_ready) {
+    pthread_mutex_lock(&p->mutex);
+    while (!rec->done) {
+      pthread_cond_wait(&p->done_cond, &p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    p->cur_ready = 1;
+  }
+
+  if (p->cur_elem >= rec->elem_cnt) {
+    return 0;
+  }
+  *elem = p->elems[rec->elem_first + p->cur_elem++].elem;
+  return 1;
+}
@@ -30,7 +30,9 @@
 #ifndef __BGPSTREAM_UTILS_RPKI_H
 #define __BGPSTREAM_UTILS_RPKI_H
 
+#include "bgpstream.h"
 #include "bgpstream_elem.h"
+#include "bgpstream_record.h"
 #include <roafetchlib/roafetchlib.h>
 #include <stdint.h>
 
@@ -38,6 +40,34 @@
 #define RPKI_SSH_BUFLEN 2048
 #define RPKI_INTERVAL_LEN 22
 
+/** Size of the buffer used to hold a single validation result */
+#define BGPSTREAM_RPKI_RESULT_LEN 2048
+
+/** Default number of entries in a BGPStream RPKI cache */
+#define BGPSTREAM_RPKI_CACHE_DEFAULT_SIZE 65536
+
+/** Opaque handle for a cache of RPKI validation results
+ *
+ * Results are keyed by prefix, origin ASN and ROA snapshot epoch (see
+ * bgpstream_rpki_cache_create), so that the many elems announcing the same
+ * prefix from the same origin (e.g., one per peer in a RIB dump) are only
+ * validated by the ROAFetchlib once. A cache must only be used with a single
+ * ROAFetchlib configuration.
+ */
+typedef struct bgpstream_rpki_cache bgpstream_rpki_cache_t;
+
+/** Default number of records that an RPKI pipeline reads ahead */
+#define BGPSTREAM_RPKI_PIPELINE_DEFAULT_DEPTH 64
+
+/** Opaque handle for an RPKI validation pipeline
+ *
+ * A pipeline reads batches of records from a stream and validates their elems
+ * on a pool of worker threads while the consumer processes the elems that are
+ * already validated, so that the latency of the ROAFetchlib is hidden from
+ * the consumer.
+ */
+typedef struct bgpstream_rpki_pipeline bgpstream_rpki_pipeline_t;
+
 /** A BGPStream RPKI Input object */
 typedef struct bgpstream_rpki_input {
 
@@ -159,6 +189,10 @@ void bgpstream_rpki_destroy_cfg(rpki_cfg_t *cfg);
 /** Validate a BGP elem with the ROAFetchlib if the Annoucement contains an
  * unique origin AS
  *
+ * If the elem was already validated by an RPKI pipeline, the stored result is
+ * used. Otherwise, if the elem annotations reference an RPKI cache, the result
+ * is looked up in (and added to) the cache.
+ *
  * @param elem         Pointer to a BGPStream Elem instance
  * @param result       Pointer to buffer for the validation result
  * @param size         Size of the validation result buffer
@@ -167,4 +201,141 @@ void bgpstream_rpki_destroy_cfg(rpki_cfg_t *cfg);
 int bgpstream_rpki_validate(bgpstream_elem_t const *elem, char *result,
                             size_t size);
 
+/** Create a BGPStream RPKI validation cache
+ *
+ * @param size         Maximum number of cached results (rounded up to a power
+ *                     of two), or 0 to use the default size
+ * @param epoch_len    Length (in seconds) of a ROA snapshot epoch: elems whose
+ *                     timestamps fall into the same epoch share cached
+ *                     results. If 0, all timestamps share a single epoch
+ *                     (e.g., for live validation).
+ * @return             Pointer to the cache, or NULL if an error occurred
+ */
+bgpstream_rpki_cache_t *bgpstream_rpki_cache_create(uint32_t size,
+                                                    uint32_t epoch_len);
+
+/** Destroy a BGPStream RPKI validation cache
+ *
+ * @param cache        Pointer to the cache to destroy
+ */
+void bgpstream_rpki_cache_destroy(bgpstream_rpki_cache_t *cache);
+
+/** Remove all results from a BGPStream RPKI validation cache
+ *
+ * @param cache        Pointer to the cache to clear
+ *
+ * This must be called if the ROAFetchlib configuration used with the cache
+ * changes.
+ */
+void bgpstream_rpki_cache_clear(bgpstream_rpki_cache_t *cache);
+
+/** Get the hit and miss counters of a BGPStream RPKI validation cache
+ *
+ * @param cache        Pointer to the cache
+ * @param[out] hits    Set to the number of lookups answered from the cache
+ * @param[out] misses  Set to the number of lookups validated by the ROAFetchlib
+ */
+void bgpstream_rpki_cache_get_stats(bgpstream_rpki_cache_t *cache,
+                                    uint64_t *hits, uint64_t *misses);
+
+/** Validate a prefix and origin ASN using a BGPStream RPKI validation cache
+ *
+ * @param cache        Pointer to the cache
+ * @param cfg          Pointer to the ROAFetchlib configuration
+ * @param timestamp    Timestamp of the elem to validate
+ * @param pfx          Pointer to the prefix to validate
+ * @param asn          Origin ASN of the prefix
+ * @return             Borrowed pointer to the validation result, or NULL if
+ *                     the validation failed
+ *
+ * The returned string is owned by the cache and remains valid until the next
+ * call to a cache function.
+ */
+const char *bgpstream_rpki_cache_validate(bgpstream_rpki_cache_t *cache,
+                                          rpki_cfg_t *cfg, uint32_t timestamp,
+                                          const bgpstream_pfx_t *pfx,
+                                          uint32_t asn);
+
+/** Validate all the announcements in a batch of elems
+ *
+ * @param cache        Pointer to the cache
+ * @param cfg          Pointer to the ROAFetchlib configuration
+ * @param batch        Pointer to a batch filled by
+ *                     bgpstream_record_get_elem_batch. The time_sec, type,
+ *                     prefix and origin_asn columns must be set.
+ * @param[out] results Array of at least `batch->cnt` entries, each of which is
+ *                     set to the validation result of the corresponding elem,
+ *                     or NULL if the elem was not validated (e.g., it is a
+ *                     withdrawal or has no simple origin ASN)
+ * @return             Number of elems that were validated, or -1 if an error
+ *                     occurred
+ *
+ * Consecutive elems with the same prefix and origin (as is common in RIB
+ * dumps) share a single cache lookup. The result strings are owned by the cache
+ * and remain valid until the next call to a cache function.
+ */
+int bgpstream_rpki_validate_batch(bgpstream_rpki_cache_t *cache,
+                                  rpki_cfg_t *cfg,
+                                  const bgpstream_elem_batch_t *batch,
+                                  const char **results);
+
+/** Create an RPKI validation pipeline
+ *
+ * @param bs           Pointer to a started BGPStream instance to read from
+ * @param cfgs         Array of `workers` ROAFetchlib configurations, one for
+ *                     each worker (configurations are not shared between
+ *                     threads)
+ * @param workers      Number of worker threads
+ * @param depth        Maximum number of records to read ahead, or 0 to use
+ *                     the default
+ * @param epoch_len    Length of a ROA snapshot epoch for the per-worker result
+ *                     caches (see bgpstream_rpki_cache_create)
+ * @return             Pointer to the pipeline, or NULL if an error occurred
+ *
+ * Once a pipeline is created, records and elems must only be retrieved from
+ * the stream using bgpstream_rpki_pipeline_get_next_record and
+ * bgpstream_rpki_pipeline_get_next_elem. Since records are read ahead, the
+ * stream position (e.g., as saved by bgpstream_save_checkpoint) may be up to
+ * `depth` records past the last record returned by the pipeline.
+ */
+bgpstream_rpki_pipeline_t *
+bgpstream_rpki_pipeline_create(bgpstream_t *bs, rpki_cfg_t **cfgs, int workers,
+                               int depth, uint32_t epoch_len);
+
+/** Destroy an RPKI validation pipeline
+ *
+ * @param pipeline     Pointer to the pipeline to destroy
+ *
+ * The worker threads are stopped, but the stream and the ROAFetchlib
+ * configurations are not destroyed.
+ */
+void bgpstream_rpki_pipeline_destroy(bgpstream_rpki_pipeline_t *pipeline);
+
+/** Retrieve the next record from an RPKI validation pipeline
+ *
+ * @param pipeline     Pointer to the pipeline
+ * @param[out] record  Set to a borrowed pointer to the next record
+ * @return the same values as bgpstream_get_next_record
+ *
+ * The record remains valid until the next call to this function. Its elems
+ * must be retrieved using bgpstream_rpki_pipeline_get_next_elem.
+ */
+int bgpstream_rpki_pipeline_get_next_record(bgpstream_rpki_pipeline_t *pipeline,
+                                            bgpstream_record_t **record);
+
+/** Retrieve the next validated elem of the current pipeline record
+ *
+ * @param pipeline     Pointer to the pipeline
+ * @param[out] elem    Set to a borrowed pointer to the next elem
+ * @return 1 if a valid elem was returned, 0 if there are no more elems, -1 if
+ * an error occurred
+ *
+ * This blocks until the elems of the current record have been validated. The
+ * elem annotations are set as for bgpstream_rpki_validate, with the result in
+ * the rpki_result annotation. The elem remains valid until the next call to
+ * bgpstream_rpki_pipeline_get_next_record.
+ */
+int bgpstream_rpki_pipeline_get_next_elem(bgpstream_rpki_pipeline_t *pipeline,
+                                          bgpstream_elem_t **elem);
+
 #endif /* __BGPSTREAM_UTILS_RPKI_H */
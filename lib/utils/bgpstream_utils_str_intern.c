@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "khash.h"
+#include "utils.h"
+
+#include "bgpstream_utils_str_intern.h"
+
+/* PRIVATE */
+
+/* string -> id (the keys are the strings in the names array) */
+KHASH_INIT(bgpstream_str_intern, char *, uint32_t, 1, kh_str_hash_func,
+           kh_str_hash_equal)
+
+struct bgpstream_str_intern {
+  pthread_mutex_t mutex;
+  khash_t(bgpstream_str_intern) * hash;
+
+  /* id -> string */
+  char **names;
+  uint32_t names_cnt;
+  uint32_t names_alloc_cnt;
+};
+
+/* must be called with the mutex held */
+static uint32_t intern_locked(bgpstream_str_intern_t *tbl, const char *str)
+{
+  khiter_t k;
+  int khret;
+  char *cpy;
+  char **names;
+  uint32_t alloc;
+
+  if ((k = kh_get(bgpstream_str_intern, tbl->hash, (char *)str)) !=
+      kh_end(tbl->hash)) {
+    return kh_val(tbl->hash, k);
+  }
+
+  if (tbl->names_cnt == BGPSTREAM_STR_INTERN_NULL_ID) {
+    return BGPSTREAM_STR_INTERN_NULL_ID;
+  }
+  if (tbl->names_cnt == tbl->names_alloc_cnt) {
+    alloc = (tbl->names_alloc_cnt == 0) ? 16 : tbl->names_alloc_cnt * 2;
+    if ((names = realloc(tbl->names, sizeof(char *) * alloc)) == NULL) {
+      return BGPSTREAM_STR_INTERN_NULL_ID;
+    }
+    tbl->names = names;
+    tbl->names_alloc_cnt = alloc;
+  }
+  if ((cpy = strdup(str)) == NULL) {
+    return BGPSTREAM_STR_INTERN_NULL_ID;
+  }
+  k = kh_put(bgpstream_str_intern, tbl->hash, cpy, &khret);
+  if (khret < 0) {
+    free(cpy);
+    return BGPSTREAM_STR_INTERN_NULL_ID;
+  }
+  kh_val(tbl->hash, k) = tbl->names_cnt;
+  tbl->names[tbl->names_cnt] = cpy;
+  return tbl->names_cnt++;
+}
+
+static uint32_t intern_str(bgpstream_str_intern_t *tbl, const char *str,
+                           const char **interned)
+{
+  uint32_t id;
+
+  if (str[0] == '\0') {
+    *interned = "";
+    return BGPSTREAM_STR_INTERN_EMPTY_ID;
+  }
+  pthread_mutex_lock(&tbl->mutex);
+  id = intern_locked(tbl, str);
+  *interned = (id != BGPSTREAM_STR_INTERN_NULL_ID) ? tbl->names[id] : NULL;
+  pthread_mutex_unlock(&tbl->mutex);
+  return id;
+}
+
+/* PUBLIC FUNCTIONS */
+
+bgpstream_str_intern_t *bgpstream_str_intern_create()
+{
+  bgpstream_str_intern_t *tbl;
+
+  if ((tbl = malloc_zero(sizeof(bgpstream_str_intern_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&tbl->mutex, NULL);
+
+  if ((tbl->hash = kh_init(bgpstream_str_intern)) == NULL ||
+      intern_locked(tbl, "") != BGPSTREAM_STR_INTERN_EMPTY_ID) {
+    bgpstream_str_intern_destroy(tbl);
+    return NULL;
+  }
+
+  return tbl;
+}
+
+void bgpstream_str_intern_destroy(bgpstream_str_intern_t *tbl)
+{
+  uint32_t i;
+
+  if (tbl == NULL) {
+    return;
+  }
+  if (tbl->hash != NULL) {
+    kh_destroy(bgpstream_str_intern, tbl->hash);
+    tbl->hash = NULL;
+  }
+  for (i = 0; i < tbl->names_cnt; i++) {
+    free(tbl->names[i]);
+  }
+  free(tbl->names);
+  pthread_mutex_destroy(&tbl->mutex);
+  free(tbl);
+}
+
+uint32_t bgpstream_str_intern(bgpstream_str_intern_t *tbl, const char *str)
+{
+  uint32_t id;
+
+  if (str[0] == '\0') {
+    return BGPSTREAM_STR_INTERN_EMPTY_ID;
+  }
+  pthread_mutex_lock(&tbl->mutex);
+  id = intern_locked(tbl, str);
+  pthread_mutex_unlock(&tbl->mutex);
+  return id;
+}
+
+uint32_t bgpstream_str_intern_cached(bgpstream_str_intern_t *tbl,
+                                     bgpstream_str_intern_cache_t *cache,
+                                     const char *str)
+{
+  uint32_t id;
+
+  bgpstream_str_intern_cached_str(tbl, cache, str, &id);
+  return id;
+}
+
+const char *bgpstream_str_intern_cached_str(bgpstream_str_intern_t *tbl,
+                                            bgpstream_str_intern_cache_t *cache,
+                                            const char *str, uint32_t *id)
+{
+  size_t len = strlen(str);
+  const char *interned;
+
+  if (len == cache->len && cache->id != BGPSTREAM_STR_INTERN_NULL_ID &&
+      memcmp(cache->str, str, len) == 0) {
+    *id = cache->id;
+    return cache->interned;
+  }
+  *id = intern_str(tbl, str, &interned);
+  if (len < BGPSTREAM_STR_INTERN_CACHE_LEN) {
+    memcpy(cache->str, str, len);
+    cache->len = len;
+    cache->id = *id;
+    cache->interned = interned;
+  }
+  return interned;
+}
+
+uint32_t bgpstream_str_intern_lookup(bgpstream_str_intern_t *tbl,
+                                     const char *str)
+{
+  khiter_t k;
+  uint32_t id = BGPSTREAM_STR_INTERN_NULL_ID;
+
+  pthread_mutex_lock(&tbl->mutex);
+  if ((k = kh_get(bgpstream_str_intern, tbl->hash, (char *)str)) !=
+      kh_end(tbl->hash)) {
+    id = kh_val(tbl->hash, k);
+  }
+  pthread_mutex_unlock(&tbl->mutex);
+  return id;
+}
+
+const char *bgpstream_str_intern_get(bgpstream_str_intern_t *tbl, uint32_t id)
+{
+  const char *str = NULL;
+
+  pthread_mutex_lock(&tbl->mutex);
+  if (id < tbl->names_cnt) {
+    str = tbl->names[id];
+  }
+  pthread_mutex_unlock(&tbl->mutex);
+  return str;
+}
+
+int bgpstream_str_intern_size(bgpstream_str_intern_t *tbl)
+{
+  int size;
+
+  pthread_mutex_lock(&tbl->mutex);
+  size = (int)tbl->names_cnt;
+  pthread_mutex_unlock(&tbl->mutex);
+  return size;
+}
+
+void bgpstream_str_intern_cache_init(bgpstream_str_intern_cache_t *cache)
+{
+  cache->id = BGPSTREAM_STR_INTERN_NULL_ID;
+  cache->len = 0;
+  cache->interned = NULL;
+}
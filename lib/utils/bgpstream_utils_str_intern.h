@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_STR_INTERN_H
+#define __BGPSTREAM_UTILS_STR_INTERN_H
+
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream String
+ * Intern Table.
+ *
+ * An intern table gives each distinct string a small integer id, so that
+ * strings that are seen over and over (e.g., project, collector and router
+ * names) can be compared as integers. Ids are assigned in order starting at
+ * #BGPSTREAM_STR_INTERN_EMPTY_ID, and stay valid until the table is destroyed.
+ *
+ * All functions are thread-safe.
+ */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Id of the empty string (which is always interned) */
+#define BGPSTREAM_STR_INTERN_EMPTY_ID 0
+
+/** Id returned when a string is not (or could not be) interned */
+#define BGPSTREAM_STR_INTERN_NULL_ID UINT32_MAX
+
+/** Maximum length of a string remembered by an intern cache */
+#define BGPSTREAM_STR_INTERN_CACHE_LEN 64
+
+/** @} */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a string intern table instance */
+typedef struct bgpstream_str_intern bgpstream_str_intern_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Single-entry cache for bgpstream_str_intern_cached
+ *
+ * Owned by the caller (and not shared between threads), it remembers the last
+ * string that was interned through it, so that runs of the same string skip
+ * the table entirely. Initialize it with bgpstream_str_intern_cache_init.
+ */
+typedef struct bgpstream_str_intern_cache {
+
+  /** Id of the cached string */
+  uint32_t id;
+
+  /** Length of the cached string */
+  uint32_t len;
+
+  /** The interned copy of the cached string */
+  const char *interned;
+
+  /** The cached string */
+  char str[BGPSTREAM_STR_INTERN_CACHE_LEN];
+
+} bgpstream_str_intern_cache_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new string intern table instance
+ *
+ * @return a pointer to the structure, or NULL if an error occurred
+ */
+bgpstream_str_intern_t *bgpstream_str_intern_create(void);
+
+/** Destroy the given string intern table
+ *
+ * @param tbl           pointer to the intern table to destroy
+ */
+void bgpstream_str_intern_destroy(bgpstream_str_intern_t *tbl);
+
+/** Get the id of a string, interning it if needed
+ *
+ * @param tbl           pointer to the intern table
+ * @param str           the string to intern
+ * @return the id of the string, or #BGPSTREAM_STR_INTERN_NULL_ID if an error
+ * occurred
+ *
+ * @note this function copies the provided string
+ */
+uint32_t bgpstream_str_intern(bgpstream_str_intern_t *tbl, const char *str);
+
+/** Get the id of a string, interning it if needed, through a cache
+ *
+ * @param tbl           pointer to the intern table
+ * @param cache         pointer to a cache used only with this table
+ * @param str           the string to intern
+ * @return the id of the string, or #BGPSTREAM_STR_INTERN_NULL_ID if an error
+ * occurred
+ */
+uint32_t bgpstream_str_intern_cached(bgpstream_str_intern_t *tbl,
+                                     bgpstream_str_intern_cache_t *cache,
+                                     const char *str);
+
+/** Get the interned copy of a string, interning it if needed, through a cache
+ *
+ * @param tbl           pointer to the intern table
+ * @param cache         pointer to a cache used only with this table
+ * @param str           the string to intern
+ * @param[out] id       set to the id of the string, or
+ *                      #BGPSTREAM_STR_INTERN_NULL_ID if an error occurred
+ * @return a borrowed pointer to the interned string, or NULL if an error
+ * occurred
+ *
+ * The string is valid until the table is destroyed, so it can be shared by
+ * records instead of being copied into each of them.
+ */
+const char *bgpstream_str_intern_cached_str(bgpstream_str_intern_t *tbl,
+                                            bgpstream_str_intern_cache_t *cache,
+                                            const char *str, uint32_t *id);
+
+/** Get the id of an already interned string
+ *
+ * @param tbl           pointer to the intern table
+ * @param str           the string to look up
+ * @return the id of the string, or #BGPSTREAM_STR_INTERN_NULL_ID if it has
+ * not been interned
+ */
+uint32_t bgpstream_str_intern_lookup(bgpstream_str_intern_t *tbl,
+                                     const char *str);
+
+/** Get the string with the given id
+ *
+ * @param tbl           pointer to the intern table
+ * @param id            id of the string
+ * @return a borrowed pointer to the string, or NULL if the id is unknown
+ *
+ * The string is valid until the table is destroyed.
+ */
+const char *bgpstream_str_intern_get(bgpstream_str_intern_t *tbl, uint32_t id);
+
+/** Get the number of strings in the table
+ *
+ * @param tbl           pointer to the intern table
+ * @return the number of interned strings (including the empty string)
+ */
+int bgpstream_str_intern_size(bgpstream_str_intern_t *tbl);
+
+/** Initialize (or reset) an intern cache
+ *
+ * @param cache         pointer to the cache to initialize
+ */
+void bgpstream_str_intern_cache_init(bgpstream_str_intern_cache_t *cache);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_STR_INTERN_H */
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_SWISS_H
+#define __BGPSTREAM_UTILS_SWISS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Open-addressing hash sets in the style of SwissTable/F14.
+ *
+ * Slots are split into groups of SWISS_GROUP_LEN. Each slot has a control
+ * byte that is either SWISS_EMPTY or the low 7 bits of the key hash (h2), and
+ * the keys are kept in a separate dense array. A lookup starts at the group
+ * selected by the rest of the hash (h1), compares h2 against the whole group
+ * of control bytes at once, and only looks at the keys whose control byte
+ * matched. The probe stops at the first group with an empty slot (the sets
+ * never delete keys, only clear everything), and otherwise moves on to the
+ * next group with triangular probing, which visits every group.
+ *
+ * SWISS_INIT(name, key_t, hash_fn, equal_fn) generates swiss_<name>_t and its
+ * functions, where hash_fn(const key_t *) returns a well-mixed 64-bit hash,
+ * and equal_fn(const key_t *, const key_t *) is non-zero for equal keys.
+ */
+
+#define SWISS_GROUP_LEN 16
+#define SWISS_EMPTY ((uint8_t)0x80)
+
+/* smallest table capacity (one group) */
+#define SWISS_MIN_CAPACITY SWISS_GROUP_LEN
+
+/* number of keys that fit in a table before it grows (7/8 load factor) */
+#define SWISS_MAX_LOAD(cap) ((cap) - (cap) / 8)
+
+/* bit i is set if control byte i of the group equals h2 */
+static inline uint32_t swiss_group_match(const uint8_t *ctrl, uint8_t h2)
+{
+#if defined(__SSE2__)
+  __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2)));
+#else
+  uint32_t m = 0;
+  int i;
+  for (i = 0; i < SWISS_GROUP_LEN; i++) {
+    m |= (uint32_t)(ctrl[i] == h2) << i;
+  }
+  return m;
+#endif
+}
+
+/* bit i is set if slot i of the group is empty */
+static inline uint32_t swiss_group_match_empty(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+  return (uint32_t)_mm_movemask_epi8(
+    _mm_loadu_si128((const __m128i *)ctrl));
+#else
+  uint32_t m = 0;
+  int i;
+  for (i = 0; i < SWISS_GROUP_LEN; i++) {
+    m |= (uint32_t)(ctrl[i] >> 7) << i;
+  }
+  return m;
+#endif
+}
+
+/* 64-bit finalizer (from MurmurHash3) */
+static inline uint64_t swiss_mix64(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+#define SWISS_INIT(name, key_t, hash_fn, equal_fn)                             \
+  typedef struct swiss_##name {                                                \
+    uint8_t *ctrl;                                                             \
+    key_t *keys;                                                               \
+    uint64_t capacity;                                                         \
+    uint64_t size;                                                             \
+  } swiss_##name##_t;                                                          \
+                                                                               \
+  static inline void swiss_##name##_init(swiss_##name##_t *t)                  \
+  {                                                                            \
+    t->ctrl = NULL;                                                            \
+    t->keys = NULL;                                                            \
+    t->capacity = 0;                                                           \
+    t->size = 0;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void swiss_##name##_free(swiss_##name##_t *t)                  \
+  {                                                                            \
+    free(t->ctrl);                                                             \
+    free(t->keys);                                                             \
+    swiss_##name##_init(t);                                                    \
+  }                                                                            \
+                                                                               \
+  /* keeps the memory, like kh_clear */                                        \
+  static inline void swiss_##name##_clear(swiss_##name##_t *t)                 \
+  {                                                                            \
+    if (t->ctrl != NULL) {                                                     \
+      memset(t->ctrl, SWISS_EMPTY, t->capacity);                               \
+    }                                                                          \
+    t->size = 0;                                                               \
+  }                                                                            \
+                                                                               \
+  /* find the slot of key, or the empty slot it would be inserted in */        \
+  static inline uint64_t swiss_##name##_probe(const swiss_##name##_t *t,       \
+                                              const key_t *key, uint64_t h,    \
+                                              int *found)                      \
+  {                                                                            \
+    uint64_t groups_mask = (t->capacity / SWISS_GROUP_LEN) - 1;                \
+    uint64_t pos = (h >> 7) & groups_mask;                                     \
+    uint64_t step = 0, base;                                                   \
+    uint8_t h2 = (uint8_t)(h & 0x7f);                                          \
+    uint32_t m;                                                                \
+                                                                               \
+    for (;;) {                                                                 \
+      base = pos * SWISS_GROUP_LEN;                                            \
+      m = swiss_group_match(t->ctrl + base, h2);                               \
+      while (m != 0) {                                                         \
+        uint64_t i = base + __builtin_ctz(m);                                  \
+        if (equal_fn(&t->keys[i], key)) {                                      \
+          *found = 1;                                                          \
+          return i;                                                            \
+        }                                                                      \
+        m &= m - 1;                                                            \
+      }                                                                        \
+      if ((m = swiss_group_match_empty(t->ctrl + base)) != 0) {                \
+        *found = 0;                                                            \
+        return base + __builtin_ctz(m);                                        \
+      }                                                                        \
+      pos = (pos + ++step) & groups_mask;                                      \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline int swiss_##name##_exists(const swiss_##name##_t *t,           \
+                                          const key_t *key)                    \
+  {                                                                            \
+    int found;                                                                 \
+    if (t->size == 0) {                                                        \
+      return 0;                                                                \
+    }                                                                          \
+    swiss_##name##_probe(t, key, hash_fn(key), &found);                        \
+    return found;                                                              \
+  }                                                                            \
+                                                                               \
+  static inline int swiss_##name##_resize(swiss_##name##_t *t,                 \
+                                          uint64_t capacity)                   \
+  {                                                                            \
+    swiss_##name##_t nt;                                                       \
+    uint64_t i, j;                                                             \
+    int found;                                                                 \
+                                                                               \
+    nt.capacity = capacity;                                                    \
+    nt.size = t->size;                                                         \
+    if ((nt.ctrl = malloc(capacity)) == NULL ||                                \
+        (nt.keys = malloc(sizeof(key_t) * capacity)) == NULL) {                \
+      free(nt.ctrl);                                                           \
+      return -1;                                                               \
+    }                                                                          \
+    memset(nt.ctrl, SWISS_EMPTY, capacity);                                    \
+    for (i = 0; i < t->capacity; i++) {                                        \
+      if (t->ctrl[i] != SWISS_EMPTY) {                                         \
+        uint64_t h = hash_fn(&t->keys[i]);                                     \
+        j = swiss_##name##_probe(&nt, &t->keys[i], h, &found);                 \
+        nt.ctrl[j] = (uint8_t)(h & 0x7f);                                      \
+        nt.keys[j] = t->keys[i];                                               \
+      }                                                                        \
+    }                                                                          \
+    free(t->ctrl);                                                             \
+    free(t->keys);                                                             \
+    *t = nt;                                                                   \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* returns 1 if the key was inserted, 0 if it already existed, -1 if an      \
+   * error occurred */                                                         \
+  static inline int swiss_##name##_insert(swiss_##name##_t *t,                 \
+                                          const key_t *key)                    \
+  {                                                                            \
+    uint64_t h = hash_fn(key), i;                                              \
+    int found;                                                                 \
+                                                                               \
+    if (t->capacity != 0) {                                                    \
+      i = swiss_##name##_probe(t, key, h, &found);                             \
+      if (found) {                                                             \
+        return 0;                                                              \
+      }                                                                        \
+      if (t->size < SWISS_MAX_LOAD(t->capacity)) {                             \
+        goto put;                                                              \
+      }                                                                        \
+    }                                                                          \
+    if (swiss_##name##_resize(t, t->capacity == 0 ? SWISS_MIN_CAPACITY         \
+                                                  : t->capacity * 2) != 0) {   \
+      return -1;                                                               \
+    }                                                                          \
+    i = swiss_##name##_probe(t, key, h, &found);                               \
+  put:                                                                         \
+    t->ctrl[i] = (uint8_t)(h & 0x7f);                                          \
+    t->keys[i] = *key;                                                         \
+    t->size++;                                                                 \
+    return 1;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* iterate with: for (i = 0; swiss_name_next(t, &i, &key); i++) */           \
+  static inline int swiss_##name##_next(const swiss_##name##_t *t,             \
+                                        uint64_t *i, const key_t **key)        \
+  {                                                                            \
+    for (; *i < t->capacity; (*i)++) {                                         \
+      if (t->ctrl[*i] != SWISS_EMPTY) {                                        \
+        *key = &t->keys[*i];                                                   \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    return 0;                                                                  \
+  }
+
+#endif /* __BGPSTREAM_UTILS_SWISS_H */
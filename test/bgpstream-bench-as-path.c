@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for AS path hashing and comparison: builds a set of distinct,
+ * realistically shaped paths, reports how well the previous (peer and origin
+ * only) hash and the full-path hashes spread them, and compares the speed of
+ * each hash and of path equality. */
+
+#include "bgpstream.h"
+#include "bgpstream_utils_as_path_int.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* number of distinct paths */
+#define PATHS 200000
+
+/* each path is hashed/compared this many times per measurement */
+#define ITERATIONS 50
+
+typedef uint64_t(hash_func_t)(const bgpstream_as_path_t *path);
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the hash used before paths were hashed in full: only the first (peer) and
+ * origin segments contribute */
+static inline uint32_t legacy_mixbits(uint32_t a)
+{
+  a = a ^ (a >> 4);
+  a = (a ^ 0xdeadbeef) + (a << 5);
+  a = a ^ (a >> 11);
+  return a;
+}
+
+static uint64_t legacy_hash(const bgpstream_as_path_t *path)
+{
+  if (path->data_len == 0) {
+    return 0;
+  }
+  return legacy_mixbits(
+    ((bgpstream_as_path_seg_hash((const bgpstream_as_path_seg_t *)path->data) &
+      0xFFFF)
+     << 8) |
+    (bgpstream_as_path_seg_hash(
+       (const bgpstream_as_path_seg_t *)(path->data + path->origin_offset)) &
+     0xFFFF));
+}
+
+static uint64_t hash32(const bgpstream_as_path_t *path)
+{
+  return bgpstream_as_path_hash(path);
+}
+
+static uint64_t hash64(const bgpstream_as_path_t *path)
+{
+  return bgpstream_as_path_hash64(path);
+}
+
+/* a few hundred peers and tens of thousands of origins, with a handful of
+ * transit ASNs in between, occasional prepending and AS sets */
+static void build_path(bgpstream_as_path_t *path, uint32_t *x)
+{
+  uint32_t asns[16];
+  int len, i;
+
+#define RND() (*x = *x * 1103515245 + 12345, *x >> 8)
+  bgpstream_as_path_clear(path);
+  len = 2 + RND() % 6;
+  asns[0] = 1 + RND() % 300;
+  for (i = 1; i < len - 1; i++) {
+    asns[i] = 1000 + RND() % 5000;
+  }
+  asns[len - 1] = 10000 + RND() % 60000;
+  if (RND() % 8 == 0) {
+    /* prepend the origin */
+    asns[len] = asns[len + 1] = asns[len - 1];
+    len += 2;
+  }
+  bgpstream_as_path_append(path, BGPSTREAM_AS_PATH_SEG_ASN, asns, len);
+  if (RND() % 50 == 0) {
+    asns[0] = 70000 + RND() % 100;
+    asns[1] = asns[0] + 1;
+    bgpstream_as_path_append(path, BGPSTREAM_AS_PATH_SEG_SET, asns, 2);
+  }
+#undef RND
+}
+
+static int path_cmp(const void *a, const void *b)
+{
+  const bgpstream_as_path_t *x = *(bgpstream_as_path_t *const *)a;
+  const bgpstream_as_path_t *y = *(bgpstream_as_path_t *const *)b;
+  if (x->data_len != y->data_len) {
+    return (x->data_len < y->data_len) ? -1 : 1;
+  }
+  return memcmp(x->data, y->data, x->data_len);
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* count the distinct values the given hash takes over the paths */
+static int count_distinct(hash_func_t *hash, bgpstream_as_path_t **paths,
+                          int cnt)
+{
+  uint64_t *h = malloc(sizeof(uint64_t) * cnt);
+  int i, distinct = 0;
+
+  for (i = 0; i < cnt; i++) {
+    h[i] = hash(paths[i]);
+  }
+  qsort(h, cnt, sizeof(uint64_t), u64_cmp);
+  for (i = 0; i < cnt; i++) {
+    if (i == 0 || h[i] != h[i - 1]) {
+      distinct++;
+    }
+  }
+  free(h);
+  return distinct;
+}
+
+static double bench_hash(hash_func_t *hash, bgpstream_as_path_t **paths,
+                         int cnt, uint64_t *acc)
+{
+  uint64_t start = now_nsec();
+  int i, j;
+
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < cnt; j++) {
+      *acc += hash(paths[j]);
+    }
+  }
+  return (now_nsec() - start) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  bgpstream_as_path_t **paths, **copies;
+  uint32_t x = 42;
+  uint64_t acc = 0, start;
+  int cnt = 0, i, j, eq = 0;
+  double secs;
+
+  paths = malloc(sizeof(bgpstream_as_path_t *) * PATHS);
+  copies = malloc(sizeof(bgpstream_as_path_t *) * PATHS);
+
+  /* generate paths, then only keep the distinct ones */
+  for (i = 0; i < PATHS; i++) {
+    paths[i] = bgpstream_as_path_create();
+    build_path(paths[i], &x);
+  }
+  qsort(paths, PATHS, sizeof(bgpstream_as_path_t *), path_cmp);
+  for (i = 0; i < PATHS; i++) {
+    if (cnt > 0 && path_cmp(&paths[cnt - 1], &paths[i]) == 0) {
+      bgpstream_as_path_destroy(paths[i]);
+      continue;
+    }
+    paths[cnt] = paths[i];
+    copies[cnt] = bgpstream_as_path_create();
+    bgpstream_as_path_copy(copies[cnt], paths[cnt]);
+    cnt++;
+  }
+
+  printf("# %d distinct AS paths\n", cnt);
+  printf("%10s: %8d distinct hash values\n", "legacy",
+         count_distinct(legacy_hash, paths, cnt));
+  printf("%10s: %8d distinct hash values\n", "hash",
+         count_distinct(hash32, paths, cnt));
+  printf("%10s: %8d distinct hash values\n", "hash64",
+         count_distinct(hash64, paths, cnt));
+
+  printf("# hashing (x%d)\n", ITERATIONS);
+  secs = bench_hash(legacy_hash, paths, cnt, &acc);
+  printf("%10s: %10.3f ms total, %6.1f ns/path\n", "legacy", secs * 1e3,
+         secs * 1e9 / ((double)cnt * ITERATIONS));
+  secs = bench_hash(hash32, paths, cnt, &acc);
+  printf("%10s: %10.3f ms total, %6.1f ns/path\n", "hash", secs * 1e3,
+         secs * 1e9 / ((double)cnt * ITERATIONS));
+  secs = bench_hash(hash64, paths, cnt, &acc);
+  printf("%10s: %10.3f ms total, %6.1f ns/path\n", "hash64", secs * 1e3,
+         secs * 1e9 / ((double)cnt * ITERATIONS));
+
+  printf("# equality (x%d)\n", ITERATIONS);
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < cnt; j++) {
+      /* one equal comparison and one unequal one */
+      eq += bgpstream_as_path_equal(paths[j], copies[j]);
+      eq -= bgpstream_as_path_equal(paths[j], copies[(j + 1) % cnt]);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%10s: %10.3f ms total, %6.1f ns/comparison\n", "equal", secs * 1e3,
+         secs * 1e9 / ((double)cnt * ITERATIONS * 2));
+
+  for (i = 0; i < cnt; i++) {
+    bgpstream_as_path_destroy(paths[i]);
+    bgpstream_as_path_destroy(copies[i]);
+  }
+  free(paths);
+  free(copies);
+
+  /* also keeps the compiler from optimizing the measurements away */
+  if (acc == 42 || eq != cnt * ITERATIONS) {
+    fprintf(stderr, "ERROR: bad equality results\n");
+    return -1;
+  }
+  return 0;
+}
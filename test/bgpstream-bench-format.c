@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the text formatters: checks that the hand-rolled integer and
+ * address formatting matches snprintf/inet_ntop, compares the speed of each,
+ * and reports the throughput of the elem and bgpdump line formatters. */
+
+#include "bgpstream.h"
+#include "bgpstream_utils_as_path_int.h"
+#include "bgpstream_utils_private.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* number of distinct values/elems formatted per measurement */
+#define SAMPLES 4096
+
+/* each sample is formatted this many times per measurement */
+#define ITERATIONS 500
+
+#define BUFLEN 4096
+
+typedef struct sample {
+  bgpstream_record_t record;
+  bgpstream_elem_t *elem;
+} sample_t;
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rand_u32(void)
+{
+  /* mostly short values, like ASNs, MEDs and timestamps */
+  switch (random() % 4) {
+  case 0:
+    return random() % 100;
+  case 1:
+    return random() % 65536;
+  case 2:
+    return ((uint32_t)random() << 16) ^ (uint32_t)random();
+  default:
+    return random() % 1000000;
+  }
+}
+
+static void rand_addr(bgpstream_ip_addr_t *addr)
+{
+  uint32_t v4;
+  int i;
+
+  if (random() % 4 != 0) {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    v4 = ((uint32_t)random() << 16) ^ (uint32_t)random();
+    memcpy(&addr->bs_ipv4.addr, &v4, sizeof(v4));
+  } else {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    for (i = 0; i < 16; i++) {
+      addr->bs_ipv6.addr.s6_addr[i] = (random() % 3 == 0) ? random() : 0;
+    }
+  }
+}
+
+static int check_formatters(void)
+{
+  char a[BUFLEN], b[BUFLEN];
+  bgpstream_ip_addr_t addr;
+  bgpstream_community_t comm;
+  uint32_t v;
+  int i, n;
+
+  for (i = 0; i < SAMPLES * 16; i++) {
+    v = rand_u32();
+    n = bs_u32_snprintf(a, sizeof(a), v);
+    if (n != snprintf(b, sizeof(b), "%" PRIu32, v) || strcmp(a, b) != 0) {
+      fprintf(stderr, "ERROR: integer mismatch: '%s' != '%s'\n", a, b);
+      return -1;
+    }
+
+    rand_addr(&addr);
+    n = bgpstream_addr_ntop_len(a, sizeof(a), &addr);
+    if (bgpstream_addr_ntop(b, sizeof(b), &addr) == NULL ||
+        n != (int)strlen(b) || strcmp(a, b) != 0) {
+      fprintf(stderr, "ERROR: address mismatch: '%s' != '%s'\n", a, b);
+      return -1;
+    }
+
+    comm.asn = random();
+    comm.value = random();
+    n = bgpstream_community_snprintf(a, sizeof(a), &comm);
+    if (n != snprintf(b, sizeof(b), "%" PRIu16 ":%" PRIu16, comm.asn,
+                      comm.value) ||
+        strcmp(a, b) != 0) {
+      fprintf(stderr, "ERROR: community mismatch: '%s' != '%s'\n", a, b);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int make_samples(sample_t *samples)
+{
+  bgpstream_community_t comm;
+  uint32_t asns[8];
+  int i, j, cnt;
+
+  for (i = 0; i < SAMPLES; i++) {
+    sample_t *s = &samples[i];
+    memset(&s->record, 0, sizeof(s->record));
+    s->record.type = (i % 2) ? BGPSTREAM_UPDATE : BGPSTREAM_RIB;
+    s->record.time_sec = 1427846400 + i;
+    s->record.time_usec = random() % 1000000;
+    s->record.project_name = "ris";
+    s->record.collector_name = "rrc06";
+
+    if ((s->elem = bgpstream_elem_create()) == NULL) {
+      return -1;
+    }
+    s->elem->type = (i % 2) ? BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT
+                            : BGPSTREAM_ELEM_TYPE_RIB;
+    s->elem->peer_asn = rand_u32();
+    rand_addr(&s->elem->peer_ip);
+    rand_addr(&s->elem->prefix.address);
+    s->elem->prefix.mask_len =
+      (s->elem->prefix.address.version == BGPSTREAM_ADDR_VERSION_IPV4) ? 24
+                                                                       : 48;
+    rand_addr(&s->elem->nexthop);
+    s->elem->med = rand_u32();
+    s->elem->local_pref = 100;
+
+    cnt = 2 + random() % 6;
+    for (j = 0; j < cnt; j++) {
+      asns[j] = rand_u32();
+    }
+    if (bgpstream_as_path_append(s->elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                                 asns, cnt) != 0) {
+      return -1;
+    }
+    cnt = random() % 6;
+    for (j = 0; j < cnt; j++) {
+      comm.asn = random();
+      comm.value = random();
+      if (bgpstream_community_set_insert(s->elem->communities, &comm) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  static sample_t samples[SAMPLES];
+  static bgpstream_ip_addr_t addrs[SAMPLES];
+  static uint32_t vals[SAMPLES];
+  char buf[BUFLEN];
+  uint64_t start, bytes;
+  double secs;
+  int i, j;
+
+  srandom(1);
+
+  if (check_formatters() != 0) {
+    return -1;
+  }
+
+  for (i = 0; i < SAMPLES; i++) {
+    vals[i] = rand_u32();
+    rand_addr(&addrs[i]);
+  }
+
+  printf("# formatting of %d values/elems (x%d)\n", SAMPLES, ITERATIONS);
+
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      snprintf(buf, sizeof(buf), "%" PRIu32, vals[j]);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/value\n", "snprintf",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES));
+
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      bs_u32_snprintf(buf, sizeof(buf), vals[j]);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/value\n", "bs_u32_snprintf",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES));
+
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      bgpstream_addr_ntop(buf, sizeof(buf), &addrs[j]);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/addr\n", "inet_ntop",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES));
+
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      bgpstream_addr_ntop_len(buf, sizeof(buf), &addrs[j]);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/addr\n", "addr_ntop_len",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES));
+
+  if (make_samples(samples) != 0) {
+    fprintf(stderr, "ERROR: Could not create sample elems\n");
+    return -1;
+  }
+
+  bytes = 0;
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      if (bgpstream_record_elem_snprintf(buf, sizeof(buf), &samples[j].record,
+                                         samples[j].elem) == NULL) {
+        return -1;
+      }
+      bytes += strlen(buf);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/line, %8.1f MB/s\n", "elem",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES), bytes / secs / 1e6);
+
+  bytes = 0;
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < SAMPLES; j++) {
+      if (bgpstream_record_elem_bgpdump_snprintf(
+            buf, sizeof(buf), &samples[j].record, samples[j].elem) == NULL) {
+        return -1;
+      }
+      bytes += strlen(buf);
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  printf("%16s: %8.1f ns/line, %8.1f MB/s\n", "bgpdump",
+         secs * 1e9 / ((double)ITERATIONS * SAMPLES), bytes / secs / 1e6);
+
+  for (i = 0; i < SAMPLES; i++) {
+    bgpstream_elem_destroy(samples[i].elem);
+  }
+  return 0;
+}
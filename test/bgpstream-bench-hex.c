@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the hex decoder used by the RIS Live format: decodes the raw
+ * BGP messages found in a RIS Live stream with both the (possibly vectorized)
+ * decoder and the scalar reference decoder, checks that they agree, and
+ * reports the throughput of each. */
+
+#include "bgpstream_hex.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_STREAM "ris-live-stream.json"
+
+/* each message is decoded this many times per measurement */
+#define ITERATIONS 200000
+
+/* longest raw BGP message (in bytes) that RIS Live can send */
+#define MAX_MSG_LEN 4096
+
+typedef int(decode_func_t)(uint8_t *buf, const char *hex, size_t hex_len);
+
+typedef struct raw_msg {
+  const char *hex;
+  size_t hex_len;
+} raw_msg_t;
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char *load_file(const char *path)
+{
+  FILE *fp;
+  char *buf = NULL;
+  long len;
+
+  if ((fp = fopen(path, "r")) == NULL || fseek(fp, 0, SEEK_END) != 0 ||
+      (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0 ||
+      (buf = malloc(len + 1)) == NULL || fread(buf, 1, len, fp) != len) {
+    fprintf(stderr, "ERROR: Could not read %s\n", path);
+    free(buf);
+    buf = NULL;
+  } else {
+    buf[len] = '\0';
+  }
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  return buf;
+}
+
+/* find every "raw" field in the stream */
+static int find_msgs(const char *json, raw_msg_t *msgs, int msgs_max)
+{
+  const char *p = json, *end;
+  int cnt = 0;
+
+  while (cnt < msgs_max && (p = strstr(p, "\"raw\"")) != NULL) {
+    p += strlen("\"raw\"");
+    while (*p == ' ' || *p == ':') {
+      p++;
+    }
+    if (*p != '"' || (end = strchr(p + 1, '"')) == NULL) {
+      continue;
+    }
+    msgs[cnt].hex = p + 1;
+    msgs[cnt].hex_len = end - (p + 1);
+    if (msgs[cnt].hex_len <= MAX_MSG_LEN * 2) {
+      cnt++;
+    }
+    p = end;
+  }
+  return cnt;
+}
+
+static double bench(decode_func_t *decode, raw_msg_t *msgs, int msgs_cnt,
+                    uint64_t *bytes)
+{
+  uint8_t buf[MAX_MSG_LEN];
+  uint64_t start;
+  int i, j;
+
+  *bytes = 0;
+  start = now_nsec();
+  for (i = 0; i < ITERATIONS; i++) {
+    for (j = 0; j < msgs_cnt; j++) {
+      if (decode(buf, msgs[j].hex, msgs[j].hex_len) != 0) {
+        return -1;
+      }
+      *bytes += msgs[j].hex_len / 2;
+    }
+  }
+  return (now_nsec() - start) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = (argc > 1) ? argv[1] : DEFAULT_STREAM;
+  uint8_t a[MAX_MSG_LEN], b[MAX_MSG_LEN];
+  raw_msg_t msgs[1024];
+  int msgs_cnt, i;
+  uint64_t bytes;
+  double secs;
+  char *json;
+
+  if ((json = load_file(path)) == NULL) {
+    return -1;
+  }
+  if ((msgs_cnt = find_msgs(json, msgs, 1024)) == 0) {
+    fprintf(stderr, "ERROR: No raw messages found in %s\n", path);
+    free(json);
+    return -1;
+  }
+
+  // both decoders must produce exactly the same bytes
+  for (i = 0; i < msgs_cnt; i++) {
+    if (bgpstream_hex_decode(a, msgs[i].hex, msgs[i].hex_len) != 0 ||
+        bgpstream_hex_decode_scalar(b, msgs[i].hex, msgs[i].hex_len) != 0 ||
+        memcmp(a, b, msgs[i].hex_len / 2) != 0) {
+      fprintf(stderr, "ERROR: Decoders disagree on message %d\n", i);
+      free(json);
+      return -1;
+    }
+  }
+
+  printf("# hex decoding of %d RIS Live messages (x%d)\n", msgs_cnt,
+         ITERATIONS);
+  if ((secs = bench(bgpstream_hex_decode_scalar, msgs, msgs_cnt, &bytes)) < 0) {
+    free(json);
+    return -1;
+  }
+  printf("%10s: %10.3f ms total, %8.1f MB/s\n", "scalar", secs * 1e3,
+         bytes / secs / 1e6);
+  if ((secs = bench(bgpstream_hex_decode, msgs, msgs_cnt, &bytes)) < 0) {
+    free(json);
+    return -1;
+  }
+  printf("%10s: %10.3f ms total, %8.1f MB/s\n", "default", secs * 1e3,
+         bytes / secs / 1e6);
+
+  free(json);
+  return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the prefix sets: compares bgpstream_pfx_set against the
+ * khash-based table that it replaced, for one large set of unique prefixes
+ * and for many small windows that are counted and then cleared. */
+
+#include "bgpstream.h"
+#include "khash.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* distinct prefixes in the large set (each is inserted twice) */
+#define LARGE_CNT 4000000
+
+/* windows of WINDOW_INSERTS inserts drawn from WINDOW_CNT prefixes */
+#define WINDOWS 200
+#define WINDOW_INSERTS 100000
+#define WINDOW_CNT 40000
+
+/* the previous implementation */
+KHASH_INIT(bench_pfx_set, bgpstream_pfx_t, char, 0, bgpstream_pfx_hash_val,
+           bgpstream_pfx_equal_val)
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the i-th of a sequence of distinct prefixes, about 1 in 8 is IPv6 */
+static void make_pfx(uint32_t i, bgpstream_pfx_t *pfx)
+{
+  uint32_t a = i * 2654435761U;
+
+  memset(pfx, 0, sizeof(*pfx));
+  if (i % 8 != 7) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+    pfx->bs_ipv4.address.addr.s_addr = a;
+    pfx->mask_len = 24;
+  } else {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+    pfx->bs_ipv6.address.addr.s6_addr[0] = 0x2a;
+    memcpy(&pfx->bs_ipv6.address.addr.s6_addr[2], &a, sizeof(a));
+    pfx->mask_len = 48;
+  }
+}
+
+static void report(const char *name, const char *what, double secs,
+                   uint64_t ops)
+{
+  printf("%10s: %-8s %10.3f ms total, %6.1f ns/op\n", name, what, secs * 1e3,
+         secs * 1e9 / ops);
+}
+
+static int bench_khash(bgpstream_pfx_t *pfxs, uint32_t *window_idx)
+{
+  khash_t(bench_pfx_set) *h = kh_init(bench_pfx_set);
+  uint64_t start, hits = 0;
+  uint64_t bytes;
+  int i, w, khret;
+
+  start = now_nsec();
+  for (i = 0; i < LARGE_CNT * 2; i++) {
+    if (kh_get(bench_pfx_set, h, pfxs[i % LARGE_CNT]) == kh_end(h)) {
+      kh_put(bench_pfx_set, h, pfxs[i % LARGE_CNT], &khret);
+    }
+  }
+  report("khash", "insert", (now_nsec() - start) / 1e9, LARGE_CNT * 2);
+  /* keys and 2 bits of flags per bucket */
+  bytes = (uint64_t)kh_n_buckets(h) * sizeof(bgpstream_pfx_t) +
+          kh_n_buckets(h) / 4;
+
+  start = now_nsec();
+  for (i = 0; i < LARGE_CNT * 2; i++) {
+    hits += kh_get(bench_pfx_set, h, pfxs[i]) != kh_end(h);
+  }
+  report("khash", "lookup", (now_nsec() - start) / 1e9, LARGE_CNT * 2);
+  printf("%10s: %" PRIu64 " prefixes, %.1f MB (%.1f bytes/prefix)\n", "khash",
+         (uint64_t)kh_size(h), bytes / 1e6, (double)bytes / kh_size(h));
+  if (kh_size(h) != LARGE_CNT || hits != LARGE_CNT) {
+    return -1;
+  }
+
+  /* a new table, so that the windows are not spread over the large one */
+  kh_destroy(bench_pfx_set, h);
+  h = kh_init(bench_pfx_set);
+  start = now_nsec();
+  for (w = 0; w < WINDOWS; w++) {
+    kh_clear(bench_pfx_set, h);
+    for (i = 0; i < WINDOW_INSERTS; i++) {
+      bgpstream_pfx_t *pfx = &pfxs[window_idx[i] + w];
+      if (kh_get(bench_pfx_set, h, *pfx) == kh_end(h)) {
+        kh_put(bench_pfx_set, h, *pfx, &khret);
+      }
+    }
+  }
+  report("khash", "windows", (now_nsec() - start) / 1e9,
+         (uint64_t)WINDOWS * WINDOW_INSERTS);
+
+  kh_destroy(bench_pfx_set, h);
+  return 0;
+}
+
+static int bench_set(bgpstream_pfx_t *pfxs, uint32_t *window_idx)
+{
+  bgpstream_pfx_set_t *set = bgpstream_pfx_set_create();
+  uint64_t start, hits = 0, cap4 = 16, cap6 = 16, bytes;
+  int i, w, v4, v6;
+
+  start = now_nsec();
+  for (i = 0; i < LARGE_CNT * 2; i++) {
+    bgpstream_pfx_set_insert(set, &pfxs[i % LARGE_CNT]);
+  }
+  report("pfx_set", "insert", (now_nsec() - start) / 1e9, LARGE_CNT * 2);
+  /* the tables grow by doubling at a 7/8 load, with one control byte and a
+   * 8 (IPv4) or 24 (IPv6) byte key per slot */
+  v4 = bgpstream_pfx_set_version_size(set, BGPSTREAM_ADDR_VERSION_IPV4);
+  v6 = bgpstream_pfx_set_version_size(set, BGPSTREAM_ADDR_VERSION_IPV6);
+  while (cap4 - cap4 / 8 < (uint64_t)v4) {
+    cap4 *= 2;
+  }
+  while (cap6 - cap6 / 8 < (uint64_t)v6) {
+    cap6 *= 2;
+  }
+  bytes = cap4 * (1 + 8) + cap6 * (1 + 24);
+
+  start = now_nsec();
+  for (i = 0; i < LARGE_CNT * 2; i++) {
+    hits += bgpstream_pfx_set_exists(set, &pfxs[i]);
+  }
+  report("pfx_set", "lookup", (now_nsec() - start) / 1e9, LARGE_CNT * 2);
+  printf("%10s: %d prefixes, %.1f MB (%.1f bytes/prefix)\n", "pfx_set",
+         bgpstream_pfx_set_size(set), bytes / 1e6,
+         (double)bytes / bgpstream_pfx_set_size(set));
+  if (bgpstream_pfx_set_size(set) != LARGE_CNT || hits != LARGE_CNT) {
+    return -1;
+  }
+
+  bgpstream_pfx_set_destroy(set);
+  set = bgpstream_pfx_set_create();
+  start = now_nsec();
+  for (w = 0; w < WINDOWS; w++) {
+    bgpstream_pfx_set_clear(set);
+    for (i = 0; i < WINDOW_INSERTS; i++) {
+      bgpstream_pfx_set_insert(set, &pfxs[window_idx[i] + w]);
+    }
+  }
+  report("pfx_set", "windows", (now_nsec() - start) / 1e9,
+         (uint64_t)WINDOWS * WINDOW_INSERTS);
+
+  bgpstream_pfx_set_destroy(set);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  bgpstream_pfx_t *pfxs;
+  uint32_t *window_idx;
+  uint32_t x = 42;
+  int i, rc = 0;
+
+  /* twice as many as in the set, so that half of the lookups miss */
+  if ((pfxs = malloc(sizeof(bgpstream_pfx_t) * LARGE_CNT * 2)) == NULL ||
+      (window_idx = malloc(sizeof(uint32_t) * WINDOW_INSERTS)) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < LARGE_CNT * 2; i++) {
+    make_pfx(i, &pfxs[i]);
+  }
+  for (i = 0; i < WINDOW_INSERTS; i++) {
+    x = x * 1103515245 + 12345;
+    window_idx[i] = (x >> 8) % WINDOW_CNT;
+  }
+
+  printf("# %d prefixes inserted twice, then looked up (half miss)\n",
+         LARGE_CNT);
+  printf("# %d windows of %d inserts from %d prefixes\n", WINDOWS,
+         WINDOW_INSERTS, WINDOW_CNT);
+  if (bench_khash(pfxs, window_idx) != 0 || bench_set(pfxs, window_idx) != 0) {
+    fprintf(stderr, "ERROR: bad set results\n");
+    rc = -1;
+  }
+
+  free(pfxs);
+  free(window_idx);
+  return rc;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the resource manager queue: measures how the cost of inserting
+ * a resource scales with the number of resources (and distinct timestamps)
+ * already queued. Insertion is the same operation used to re-sort a resource
+ * each time the time of its next record changes. */
+
+#include "bgpstream_filter.h"
+#include "bgpstream_resource_mgr.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* resources are spread over this many seconds (one day of updates files) */
+#define TIME_SPAN 86400
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_push(int res_cnt)
+{
+  bgpstream_filter_mgr_t *filter_mgr = NULL;
+  bgpstream_resource_mgr_t *q = NULL;
+  uint64_t start, elapsed;
+  uint32_t time;
+  char url[32];
+  int i;
+
+  if ((filter_mgr = bgpstream_filter_mgr_create()) == NULL ||
+      (q = bgpstream_resource_mgr_create(filter_mgr)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create resource manager\n");
+    return -1;
+  }
+
+  srand(res_cnt);
+  start = now_nsec();
+  for (i = 0; i < res_cnt; i++) {
+    time = 1427846400 + (rand() % TIME_SPAN);
+    // distinct files, since duplicates are dropped
+    snprintf(url, sizeof(url), "bench.%d.mrt", i);
+    if (bgpstream_resource_mgr_push(
+          q, BGPSTREAM_RESOURCE_TRANSPORT_FILE, BGPSTREAM_RESOURCE_FORMAT_MRT,
+          url, time, 300, "bench", "bench", BGPSTREAM_UPDATE, NULL) != 1) {
+      fprintf(stderr, "ERROR: Could not push resource\n");
+      return -1;
+    }
+  }
+  elapsed = now_nsec() - start;
+
+  printf("%10d resources: %10.3f ms total, %8.1f ns/insert\n", res_cnt,
+         elapsed / 1e6, (double)elapsed / res_cnt);
+
+  bgpstream_resource_mgr_destroy(q);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
+int main()
+{
+  int res_cnt;
+
+  printf("# resource queue insertion (random times over %d seconds)\n",
+         TIME_SPAN);
+  for (res_cnt = 1000; res_cnt <= 1000000; res_cnt *= 10) {
+    if (bench_push(res_cnt) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the whole stream: reads the bundled RIB and update dumps with
+ * no filters, with some common filters, and with each output formatter, and
+ * reports records/s and elems/s as tab-separated values (one line per run),
+ * so that the results can be compared across releases.
+ *
+ * Usage: bgpstream-bench-stream [<data-dir>] (default: current directory) */
+
+#include "bgpstream.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUFLEN 65536
+
+/* the bundled test dumps */
+static const struct {
+  const char *name;
+  const char *option;
+  const char *file;
+} datasets[] = {
+  {"ribs-ris", "rib-file", "ris.rrc06.ribs.1427846400.gz"},
+  {"ribs-routeviews", "rib-file",
+   "routeviews.route-views.jinx.ribs.1427846400.bz2"},
+  {"updates-ris", "upd-file", "ris.rrc06.updates.1427846400.gz"},
+  {"updates-routeviews", "upd-file",
+   "routeviews.route-views.jinx.updates.1427846400.bz2"},
+};
+
+/* filters, each run without a formatter */
+static const struct {
+  const char *name;
+  const char *filter;
+} filters[] = {
+  {"none", NULL},
+  {"ipversion", "ipversion 4"},
+  {"prefix", "prefix more 192.0.0.0/8"},
+  {"peer", "peer 3356"},
+  {"community", "community 3356:*"},
+  {"aspath", "aspath _3356_"},
+};
+
+/* output formatters, each run without filters */
+typedef enum {
+  FORMAT_NONE,
+  FORMAT_ELEM,
+  FORMAT_BGPDUMP,
+  FORMAT_BINARY,
+} format_t;
+
+static const char *format_names[] = {"none", "elem", "bgpdump", "binary"};
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int format_elem(format_t format, bgpstream_record_t *record,
+                       bgpstream_elem_t *elem, char *buf, uint64_t *bytes)
+{
+  ssize_t len;
+
+  switch (format) {
+  case FORMAT_NONE:
+    return 0;
+  case FORMAT_ELEM:
+    if (bgpstream_record_elem_snprintf(buf, BUFLEN, record, elem) == NULL) {
+      return -1;
+    }
+    break;
+  case FORMAT_BGPDUMP:
+    if (bgpstream_record_elem_bgpdump_snprintf(buf, BUFLEN, record, elem) ==
+        NULL) {
+      return -1;
+    }
+    break;
+  case FORMAT_BINARY:
+    if ((len = bgpstream_record_elem_binary_write((uint8_t *)buf, BUFLEN,
+                                                  record, elem)) < 0) {
+      return -1;
+    }
+    *bytes += len;
+    return 0;
+  }
+  *bytes += strlen(buf);
+  return 0;
+}
+
+static int run(const char *dir, int dataset, int filter, format_t format)
+{
+  static char buf[BUFLEN];
+  char path[1024];
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+  bgpstream_record_t *record;
+  bgpstream_elem_t *elem;
+  uint64_t records = 0, elems = 0, bytes = 0, start;
+  double secs;
+  int rc, ret = -1;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, datasets[dataset].file);
+
+  if ((bs = bgpstream_create()) == NULL) {
+    return -1;
+  }
+  if ((di_id = bgpstream_get_data_interface_id_by_name(bs, "singlefile")) ==
+        0 ||
+      (option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, datasets[dataset].option)) == NULL) {
+    fprintf(stderr, "ERROR: The singlefile data interface is not available\n");
+    goto done;
+  }
+  bgpstream_set_data_interface(bs, di_id);
+  if (bgpstream_set_data_interface_option(bs, option, path) != 0) {
+    goto done;
+  }
+  if (filters[filter].filter != NULL &&
+      bgpstream_parse_filter_string(bs, filters[filter].filter) == 0) {
+    fprintf(stderr, "ERROR: Could not parse filter '%s'\n",
+            filters[filter].filter);
+    goto done;
+  }
+
+  start = now_nsec();
+  if (bgpstream_start(bs) < 0) {
+    goto done;
+  }
+  while ((rc = bgpstream_get_next_record(bs, &record)) > 0) {
+    if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    records++;
+    while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+      elems++;
+      if (format_elem(format, record, elem, buf, &bytes) != 0) {
+        fprintf(stderr, "ERROR: Could not format elem\n");
+        goto done;
+      }
+    }
+    if (rc < 0) {
+      break;
+    }
+  }
+  secs = (now_nsec() - start) / 1e9;
+  if (rc < 0) {
+    fprintf(stderr, "ERROR: Could not read %s\n", path);
+    goto done;
+  }
+
+  printf("%s\t%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%.3f\t%.0f\t%.0f"
+         "\n",
+         datasets[dataset].name, filters[filter].name, format_names[format],
+         records, elems, bytes, secs, records / secs, elems / secs);
+  fflush(stdout);
+  ret = 0;
+
+done:
+  bgpstream_destroy(bs);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = argc > 1 ? argv[1] : ".";
+  unsigned i, j;
+
+  printf("# dataset\tfilter\tformat\trecords\telems\tbytes\tsecs\trecords/s\t"
+         "elems/s\n");
+
+  for (i = 0; i < sizeof(datasets) / sizeof(datasets[0]); i++) {
+    // the first filter is none, so this also runs the plain decode
+    for (j = 0; j < sizeof(filters) / sizeof(filters[0]); j++) {
+      if (run(dir, i, j, FORMAT_NONE) != 0) {
+        return -1;
+      }
+    }
+    for (j = FORMAT_ELEM; j <= FORMAT_BINARY; j++) {
+      if (run(dir, i, 0, j) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
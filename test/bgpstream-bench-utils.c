@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark for the utils containers: loads the elems of a bundled RIB dump
+ * and, for each container, reports the time per operation and the heap memory
+ * per entry as tab-separated values (one line per operation).
+ *
+ * Usage: bgpstream-bench-utils [<rib-file>] */
+
+#include "bgpstream.h"
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_RIB "ris.rrc06.ribs.1427846400.gz"
+
+/* maximum number of elems loaded from the dump */
+#define MAX_SAMPLES 1000000
+
+/* the collection of the sample elems */
+#define COLLECTOR "rrc06"
+
+typedef struct sample {
+  bgpstream_pfx_t pfx;
+  bgpstream_ip_addr_t peer_ip;
+  bgpstream_ip_addr_t nexthop;
+  uint32_t peer_asn;
+  uint32_t origin_asn;
+  bgpstream_as_path_t *path;
+
+  /* communities of the elem, in the comms array */
+  uint32_t comm_off;
+  uint32_t comm_cnt;
+} sample_t;
+
+static sample_t *samples;
+static int samples_cnt;
+static bgpstream_community_t *comms;
+static uint32_t comms_cnt;
+static uint32_t comms_alloc;
+
+static uint64_t now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* bytes of heap in use, or 0 if unknown */
+static size_t heap_used(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static void report(const char *container, const char *op, uint64_t ops,
+                   uint64_t start, uint64_t entries, size_t mem_before)
+{
+  double ns = (now_nsec() - start) / (double)(ops > 0 ? ops : 1);
+  size_t mem = heap_used();
+
+  printf("%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%.1f\t", container, op, ops,
+         entries, ns);
+  if (mem_before != 0 && mem >= mem_before && entries > 0) {
+    printf("%.1f\n", (mem - mem_before) / (double)entries);
+  } else {
+    printf("-\n");
+  }
+}
+
+static int load_samples(const char *path)
+{
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+  bgpstream_record_t *record;
+  bgpstream_elem_t *elem;
+  bgpstream_community_t *tmp;
+  sample_t *s;
+  int i, cnt, rc, ret = -1;
+
+  if ((samples = malloc(sizeof(sample_t) * MAX_SAMPLES)) == NULL ||
+      (bs = bgpstream_create()) == NULL) {
+    return -1;
+  }
+  if ((di_id = bgpstream_get_data_interface_id_by_name(bs, "singlefile")) ==
+        0 ||
+      (option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "rib-file")) == NULL) {
+    fprintf(stderr, "ERROR: The singlefile data interface is not available\n");
+    goto done;
+  }
+  bgpstream_set_data_interface(bs, di_id);
+  if (bgpstream_set_data_interface_option(bs, option, path) != 0 ||
+      bgpstream_start(bs) < 0) {
+    goto done;
+  }
+
+  while (samples_cnt < MAX_SAMPLES &&
+         (rc = bgpstream_get_next_record(bs, &record)) > 0) {
+    if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    while (samples_cnt < MAX_SAMPLES &&
+           bgpstream_record_get_next_elem(record, &elem) > 0) {
+      s = &samples[samples_cnt];
+      s->pfx = elem->prefix;
+      s->peer_ip = elem->peer_ip;
+      s->nexthop = elem->nexthop;
+      s->peer_asn = elem->peer_asn;
+      if (bgpstream_as_path_get_origin_val(elem->as_path, &s->origin_asn) !=
+          0) {
+        s->origin_asn = 0;
+      }
+      if ((s->path = bgpstream_as_path_create()) == NULL ||
+          bgpstream_as_path_copy(s->path, elem->as_path) != 0) {
+        goto done;
+      }
+
+      cnt = bgpstream_community_set_size(elem->communities);
+      if (comms_cnt + cnt > comms_alloc) {
+        comms_alloc = (comms_cnt + cnt) * 2;
+        if ((tmp = realloc(comms, sizeof(bgpstream_community_t) *
+                                    comms_alloc)) == NULL) {
+          goto done;
+        }
+        comms = tmp;
+      }
+      s->comm_off = comms_cnt;
+      s->comm_cnt = cnt;
+      for (i = 0; i < cnt; i++) {
+        comms[comms_cnt++] = *bgpstream_community_set_get(elem->communities, i);
+      }
+      samples_cnt++;
+    }
+  }
+  if (samples_cnt == 0) {
+    fprintf(stderr, "ERROR: Could not read any elems from %s\n", path);
+    goto done;
+  }
+  ret = 0;
+
+done:
+  bgpstream_destroy(bs);
+  return ret;
+}
+
+static int bench_patricia(void)
+{
+  bgpstream_patricia_tree_t *pt;
+  size_t mem = heap_used();
+  uint64_t start, found = 0;
+  int i;
+
+  if ((pt = bgpstream_patricia_tree_create(NULL)) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_patricia_tree_insert(pt, &samples[i].pfx) == NULL) {
+      return -1;
+    }
+  }
+  report("patricia", "insert", samples_cnt, start,
+         bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) +
+           bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV6),
+         mem);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    found += bgpstream_patricia_tree_search_exact(pt, &samples[i].pfx) != NULL;
+  }
+  report("patricia", "search-exact", samples_cnt, start, found, 0);
+
+  bgpstream_patricia_tree_destroy(pt);
+  return 0;
+}
+
+static int bench_pfx_set(void)
+{
+  bgpstream_pfx_set_t *set;
+  size_t mem = heap_used();
+  uint64_t start, found = 0;
+  int i;
+
+  if ((set = bgpstream_pfx_set_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_pfx_set_insert(set, &samples[i].pfx) < 0) {
+      return -1;
+    }
+  }
+  report("pfx_set", "insert", samples_cnt, start,
+         bgpstream_pfx_set_size(set), mem);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    found += bgpstream_pfx_set_exists(set, &samples[i].pfx);
+  }
+  report("pfx_set", "exists", samples_cnt, start, found, 0);
+
+  bgpstream_pfx_set_destroy(set);
+  return 0;
+}
+
+static int bench_addr_set(void)
+{
+  bgpstream_ip_addr_set_t *set;
+  size_t mem = heap_used();
+  uint64_t start;
+  int i;
+
+  if ((set = bgpstream_ip_addr_set_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_ip_addr_set_insert(set, &samples[i].nexthop) < 0) {
+      return -1;
+    }
+  }
+  report("addr_set", "insert-nexthop", samples_cnt, start,
+         bgpstream_ip_addr_set_size(set), mem);
+
+  bgpstream_ip_addr_set_destroy(set);
+  return 0;
+}
+
+static int bench_id_set(void)
+{
+  bgpstream_id_set_t *set;
+  size_t mem = heap_used();
+  uint64_t start, found = 0;
+  int i;
+
+  if ((set = bgpstream_id_set_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_id_set_insert(set, samples[i].origin_asn) < 0) {
+      return -1;
+    }
+  }
+  report("id_set", "insert-origin", samples_cnt, start,
+         bgpstream_id_set_size(set), mem);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    found += bgpstream_id_set_exists(set, samples[i].peer_asn);
+  }
+  report("id_set", "exists-peer", samples_cnt, start, found, 0);
+
+  bgpstream_id_set_destroy(set);
+  return 0;
+}
+
+static int bench_as_path_store(void)
+{
+  bgpstream_as_path_store_t *store;
+  bgpstream_as_path_store_path_id_t id;
+  size_t mem = heap_used();
+  uint64_t start;
+  int i;
+
+  if ((store = bgpstream_as_path_store_create()) == NULL) {
+    return -1;
+  }
+  // the first pass inserts, the second only finds the paths
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_as_path_store_get_path_id(store, samples[i].path,
+                                            samples[i].peer_asn, &id) != 0) {
+      return -1;
+    }
+  }
+  report("as_path_store", "get-path-id-insert", samples_cnt, start,
+         bgpstream_as_path_store_get_size(store), mem);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_as_path_store_get_path_id(store, samples[i].path,
+                                            samples[i].peer_asn, &id) != 0) {
+      return -1;
+    }
+  }
+  report("as_path_store", "get-path-id-find", samples_cnt, start,
+         bgpstream_as_path_store_get_size(store), 0);
+
+  bgpstream_as_path_store_destroy(store);
+  return 0;
+}
+
+static int bench_community(void)
+{
+  bgpstream_community_set_t *set;
+  bgpstream_community_t probe;
+  uint64_t start, found = 0, populated = 0;
+  int i;
+
+  probe.asn = 3356;
+  probe.value = 3;
+
+  if ((set = bgpstream_community_set_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_community_set_populate_from_array(
+          set, &comms[samples[i].comm_off], samples[i].comm_cnt) != 0) {
+      return -1;
+    }
+    populated += samples[i].comm_cnt;
+  }
+  report("community", "populate-set", samples_cnt, start, populated, 0);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    bgpstream_community_set_populate_from_array(
+      set, &comms[samples[i].comm_off], samples[i].comm_cnt);
+    found += bgpstream_community_set_exists(set, &probe);
+  }
+  report("community", "populate-exists", samples_cnt, start, found, 0);
+
+  bgpstream_community_set_destroy(set);
+  return 0;
+}
+
+static int bench_ip_counter(void)
+{
+  bgpstream_ip_counter_t *ipc;
+  bgpstream_pfx_t *pfxs;
+  size_t mem = heap_used();
+  uint64_t start, overlap = 0;
+  uint8_t more;
+  int i;
+
+  if ((ipc = bgpstream_ip_counter_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_ip_counter_add(ipc, &samples[i].pfx) != 0) {
+      return -1;
+    }
+  }
+  report("ip_counter", "add", samples_cnt, start, samples_cnt, mem);
+
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    overlap += bgpstream_ip_counter_is_overlapping(ipc, &samples[i].pfx,
+                                                   &more) != 0;
+  }
+  report("ip_counter", "is-overlapping", samples_cnt, start, overlap, 0);
+
+  // adding the whole table at once sorts and merges it only once
+  if ((pfxs = malloc(sizeof(bgpstream_pfx_t) * samples_cnt)) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < samples_cnt; i++) {
+    pfxs[i] = samples[i].pfx;
+  }
+  bgpstream_ip_counter_clear(ipc);
+  start = now_nsec();
+  if (bgpstream_ip_counter_add_bulk(ipc, pfxs, samples_cnt) != 0) {
+    return -1;
+  }
+  report("ip_counter", "add-bulk", samples_cnt, start, samples_cnt, 0);
+  free(pfxs);
+
+  bgpstream_ip_counter_destroy(ipc);
+  return 0;
+}
+
+static int bench_peer_sig_map(void)
+{
+  bgpstream_peer_sig_map_t *map;
+  size_t mem = heap_used();
+  uint64_t start;
+  int i;
+
+  if ((map = bgpstream_peer_sig_map_create()) == NULL) {
+    return -1;
+  }
+  start = now_nsec();
+  for (i = 0; i < samples_cnt; i++) {
+    if (bgpstream_peer_sig_map_get_id(map, COLLECTOR, &samples[i].peer_ip,
+                                      samples[i].peer_asn) == 0) {
+      return -1;
+    }
+  }
+  report("peer_sig_map", "get-id", samples_cnt, start,
+         bgpstream_peer_sig_map_get_size(map), mem);
+
+  bgpstream_peer_sig_map_destroy(map);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = (argc > 1) ? argv[1] : DEFAULT_RIB;
+  int i;
+
+  if (load_samples(path) != 0) {
+    return -1;
+  }
+
+  printf("# %d elems from %s, memory is heap bytes per entry\n", samples_cnt,
+         path);
+  printf("# container\top\tops\tentries\tns/op\tbytes/entry\n");
+
+  if (bench_patricia() != 0 || bench_pfx_set() != 0 ||
+      bench_addr_set() != 0 || bench_id_set() != 0 ||
+      bench_as_path_store() != 0 || bench_community() != 0 ||
+      bench_ip_counter() != 0 || bench_peer_sig_map() != 0) {
+    fprintf(stderr, "ERROR: Benchmark failed\n");
+    return -1;
+  }
+
+  for (i = 0; i < samples_cnt; i++) {
+    bgpstream_as_path_destroy(samples[i].path);
+  }
+  free(samples);
+  free(comms);
+  return 0;
+}
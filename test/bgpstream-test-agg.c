@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RESULTS 8
+
+static bgpstream_agg_result_t results[MAX_RESULTS];
+static int results_cnt = 0;
+
+static int save_result(const bgpstream_agg_result_t *result, void *user)
+{
+  if (results_cnt < MAX_RESULTS) {
+    results[results_cnt++] = *result;
+  }
+  return 0;
+}
+
+static void set_elem(bgpstream_elem_t *elem, bgpstream_elem_type_t type,
+                     const char *pfx, uint32_t origin)
+{
+  uint32_t seq[] = {65000, origin};
+
+  elem->type = type;
+  bgpstream_str2pfx(pfx, &elem->prefix);
+  bgpstream_as_path_clear(elem->as_path);
+  if (origin != 0) {
+    bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, seq, 2);
+  }
+}
+
+static const bgpstream_agg_result_t *find_result(uint32_t bin_time,
+                                                 uint32_t origin)
+{
+  int i;
+
+  for (i = 0; i < results_cnt; i++) {
+    if (results[i].bin_time == bin_time && results[i].origin_asn == origin) {
+      return &results[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  bgpstream_record_t rec;
+  bgpstream_elem_t *elem = bgpstream_elem_create();
+  bgpstream_agg_t *agg;
+  const bgpstream_agg_result_t *res;
+
+  agg = bgpstream_agg_create(60, BGPSTREAM_AGG_KEY_COLLECTOR |
+                                   BGPSTREAM_AGG_KEY_ORIGIN,
+                             save_result, NULL);
+  CHECK("agg create", elem != NULL && agg != NULL);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = BGPSTREAM_UPDATE;
+  rec.project_name = "ris";
+  rec.collector_name = "rrc06";
+  elem->peer_asn = 65000;
+  bgpstream_str2addr("192.0.2.1", &elem->peer_ip);
+
+  // first minute: two announcements from 64500 (one prefix twice), one from
+  // 64501, and a withdrawal
+  rec.time_sec = 1427846400;
+  set_elem(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.0/24", 64500);
+  CHECK("agg add", bgpstream_agg_add(agg, &rec, elem) == 0 &&
+                     bgpstream_agg_add(agg, &rec, elem) == 0);
+  set_elem(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "198.51.100.0/24", 64501);
+  CHECK("agg add", bgpstream_agg_add(agg, &rec, elem) == 0);
+  rec.time_sec += 59;
+  set_elem(elem, BGPSTREAM_ELEM_TYPE_WITHDRAWAL, "192.0.2.0/24", 0);
+  CHECK("agg add", bgpstream_agg_add(agg, &rec, elem) == 0);
+  CHECK("agg bin open", results_cnt == 0);
+
+  // the next minute closes the first bin
+  rec.time_sec += 1;
+  set_elem(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "203.0.113.0/24", 64500);
+  CHECK("agg add next bin", bgpstream_agg_add(agg, &rec, elem) == 0);
+  CHECK("agg bin closed", results_cnt == 3);
+
+  res = find_result(1427846400, 64500);
+  CHECK("agg origin group",
+        res != NULL && res->bin_size == 60 &&
+          strcmp(res->collector, "rrc06") == 0 &&
+          strcmp(res->project, "ris") == 0 &&
+          res->elem_cnt[BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT] == 2 &&
+          res->pfx_cnt == 1 && res->origin_cnt == 1 && res->peer_asn == 0);
+  res = find_result(1427846400, 0);
+  CHECK("agg no origin group",
+        res != NULL && res->elem_cnt[BGPSTREAM_ELEM_TYPE_WITHDRAWAL] == 1 &&
+          res->elem_cnt[BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT] == 0 &&
+          res->pfx_cnt == 1 && res->origin_cnt == 0);
+
+  CHECK("agg flush", bgpstream_agg_flush(agg) == 0 && results_cnt == 4);
+  res = find_result(1427846460, 64500);
+  CHECK("agg reused group",
+        res != NULL && res->elem_cnt[BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT] == 1 &&
+          res->pfx_cnt == 1);
+
+  // a record built without names is grouped under empty names
+  rec.project_name = NULL;
+  rec.collector_name = NULL;
+  rec.time_sec += 60;
+  CHECK("agg add unnamed record", bgpstream_agg_add(agg, &rec, elem) == 0 &&
+                                    bgpstream_agg_flush(agg) == 0);
+  res = find_result(1427846520, 64500);
+  CHECK("agg unnamed group", res != NULL && strcmp(res->collector, "") == 0 &&
+                               strcmp(res->project, "") == 0);
+
+  bgpstream_agg_destroy(agg);
+  bgpstream_elem_destroy(elem);
+
+  ENDTEST;
+  return 0;
+}
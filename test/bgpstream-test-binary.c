@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_decoded_cache.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUFLEN 1024
+
+int main(int argc, char *argv[])
+{
+  uint8_t buf[BUFLEN];
+  char str1[BUFLEN], str2[BUFLEN];
+  bgpstream_record_t rec1, rec2;
+  bgpstream_elem_t *elem1 = bgpstream_elem_create();
+  bgpstream_elem_t *elem2 = bgpstream_elem_create();
+  uint32_t seq[] = {65000, 3356, 174};
+  uint32_t set[] = {64512, 64513};
+  bgpstream_community_t comm;
+  bgpstream_decoded_writer_t *w;
+  bgpstream_decoded_reader_t *r;
+  char path[BUFLEN];
+  const uint8_t *elems;
+  size_t elems_len;
+  uint32_t sec, usec;
+  ssize_t len;
+  int i;
+
+  CHECK("elem create", elem1 != NULL && elem2 != NULL);
+
+  memset(&rec1, 0, sizeof(rec1));
+  memset(&rec2, 0, sizeof(rec2));
+  rec1.type = BGPSTREAM_UPDATE;
+  rec1.dump_pos = BGPSTREAM_DUMP_MIDDLE;
+  rec1.time_sec = 1427846400;
+  rec1.project_name = "ris";
+  rec1.collector_name = "rrc06";
+
+  elem1->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  elem1->orig_time_sec = 1427846400;
+  elem1->peer_asn = 65000;
+  CHECK("elem populate",
+        bgpstream_str2addr("192.0.2.1", &elem1->peer_ip) != NULL &&
+          bgpstream_str2pfx("2001:db8::/32", &elem1->prefix) != NULL &&
+          bgpstream_str2addr("2001:db8::1", &elem1->nexthop) != NULL &&
+          bgpstream_as_path_append(elem1->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                                   seq, 3) == 0 &&
+          bgpstream_as_path_append(elem1->as_path, BGPSTREAM_AS_PATH_SEG_SET,
+                                   set, 2) == 0);
+  comm.asn = 65000;
+  comm.value = 100;
+  CHECK("elem community",
+        bgpstream_community_set_insert(elem1->communities, &comm) == 0);
+
+  len = bgpstream_record_elem_binary_write(buf, sizeof(buf), &rec1, elem1);
+  CHECK("binary write", len > BGPSTREAM_BINARY_HDR_LEN);
+  // (a failed write leaves a partial frame behind, so write it again)
+  CHECK("binary write short buffer",
+        bgpstream_record_elem_binary_write(buf, len - 1, &rec1, elem1) == -1 &&
+          bgpstream_record_elem_binary_write(buf, sizeof(buf), &rec1, elem1) ==
+            len);
+
+  CHECK("binary read partial frame",
+        bgpstream_record_elem_binary_read(buf, len - 1, &rec2, elem2) == 0);
+  CHECK("binary read",
+        bgpstream_record_elem_binary_read(buf, len, &rec2, elem2) == len);
+
+  bgpstream_record_elem_snprintf(str1, sizeof(str1), &rec1, elem1);
+  bgpstream_record_elem_snprintf(str2, sizeof(str2), &rec2, elem2);
+  CHECK_MSG("binary round trip", str2, strcmp(str1, str2) == 0);
+
+  CHECK("binary round trip path",
+        bgpstream_as_path_equal(elem1->as_path, elem2->as_path));
+
+  // every single-byte corruption must be rejected or decoded safely
+  for (i = BGPSTREAM_BINARY_HDR_LEN; i < len; i++) {
+    uint8_t bad[BUFLEN];
+    memcpy(bad, buf, len);
+    bad[i] ^= 0xff;
+    bgpstream_record_elem_binary_read(bad, len, &rec2, elem2);
+  }
+  CHECK("binary read corrupted frames", 1);
+
+  // elems alone, as stored in the decoded record cache
+  len = bgpstream_elem_binary_write(buf, sizeof(buf), elem1);
+  CHECK("elem binary write", len > 0);
+  CHECK("elem binary read truncated",
+        bgpstream_elem_binary_read(buf, len - 1, elem2) == -1);
+  CHECK("elem binary read", bgpstream_elem_binary_read(buf, len, elem2) == len);
+  bgpstream_record_elem_snprintf(str2, sizeof(str2), &rec1, elem2);
+  CHECK_MSG("elem binary round trip", str2, strcmp(str1, str2) == 0);
+
+  snprintf(path, sizeof(path), "bgpstream-test-binary.%d.dec", getpid());
+  w = bgpstream_decoded_writer_create(path);
+  CHECK("decoded cache create", w != NULL);
+  CHECK("decoded cache write",
+        bgpstream_decoded_writer_add_record(w, 1427846400, 5) == 0 &&
+          bgpstream_decoded_writer_add_elem(w, elem1) == 0 &&
+          bgpstream_decoded_writer_add_elem(w, elem1) == 0 &&
+          bgpstream_decoded_writer_add_record(w, 1427846401, 0) == 0 &&
+          bgpstream_decoded_writer_commit(w) == 0);
+
+  r = bgpstream_decoded_reader_open(path);
+  CHECK("decoded cache open", r != NULL);
+  CHECK("decoded cache record",
+        bgpstream_decoded_reader_next(r, &sec, &usec, &elems, &elems_len) ==
+            1 &&
+          sec == 1427846400 && usec == 5 && elems_len == 2 * len);
+  CHECK("decoded cache elem",
+        bgpstream_elem_binary_read(elems, elems_len, elem2) == len &&
+          bgpstream_elem_binary_read(elems + len, elems_len - len, elem2) ==
+            len);
+  CHECK("decoded cache empty record",
+        bgpstream_decoded_reader_next(r, &sec, &usec, &elems, &elems_len) ==
+            1 &&
+          sec == 1427846401 && elems_len == 0);
+  CHECK("decoded cache end",
+        bgpstream_decoded_reader_next(r, &sec, &usec, &elems, &elems_len) ==
+          0);
+  bgpstream_decoded_reader_destroy(r);
+  remove(path);
+
+  bgpstream_elem_destroy(elem1);
+  bgpstream_elem_destroy(elem2);
+
+  ENDTEST;
+  return 0;
+}
@@ -26,10 +26,15 @@
 
 #include "bgpstream_test.h"
 
+#include "bgpstream_filter.h"
+#include "bgpstream_resource_mgr.h"
+#include "bgpstream_utils_as_path_int.h"
 #include "utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <wandio.h>
 
 #ifdef WITH_DATA_INTERFACE_BROKER
@@ -160,10 +165,784 @@ static int test_bgpstream_filters()
 
 #endif
 
+/* AS path expression, path (0-terminated ASNs; a set if set_asn is not 0),
+ * and whether the path should pass the filter */
+static const struct {
+  const char *expr;
+  uint32_t asns[8];
+  uint32_t set_asn;
+  int match;
+} aspath_tests[] = {
+  {"_2914_", {25152, 2914, 3356, 0}, 0, 1},
+  {"_291_", {25152, 2914, 3356, 0}, 0, 0},
+  {"^25152_", {25152, 2914, 3356, 0}, 0, 1},
+  {"^2914_", {25152, 2914, 3356, 0}, 0, 0},
+  {"_3356$", {25152, 2914, 3356, 0}, 0, 1},
+  {"!_3356$", {25152, 2914, 3356, 0}, 0, 0},
+  {"^25152 2914_", {25152, 2914, 3356, 0}, 0, 1},
+  {"_25152_.*_3356_", {25152, 2914, 3356, 0}, 0, 1},
+  {"_25152_.*_2914_", {25152, 2914, 3356, 0}, 0, 0},
+  {"^[0-9]+_(174|2914)_", {25152, 2914, 3356, 0}, 0, 1},
+  {"^$", {0}, 0, 1},
+  {"^$", {37105, 0}, 0, 0},
+  {"_13620_", {2914, 0}, 13620, 1}, // has to be matched as a string
+  {"2914_", {12914, 0}, 0, 1},      // has to be matched as a string
+  {NULL, {0}, 0, 0},
+};
+
+static int test_aspath_filters()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_as_path_t *path;
+  uint32_t set[2];
+  int i, j, pass;
+
+  for (i = 0; aspath_tests[i].expr != NULL; i++) {
+    filter_mgr = bgpstream_filter_mgr_create();
+    path = bgpstream_as_path_create();
+    CHECK("aspath filter add",
+          bgpstream_filter_mgr_filter_add(filter_mgr,
+                                          BGPSTREAM_FILTER_TYPE_ELEM_ASPATH,
+                                          aspath_tests[i].expr) != 0);
+    for (j = 0; aspath_tests[i].asns[j] != 0; j++) {
+      bgpstream_as_path_append(path, BGPSTREAM_AS_PATH_SEG_ASN,
+                               (uint32_t *)&aspath_tests[i].asns[j], 1);
+    }
+    if (aspath_tests[i].set_asn != 0) {
+      set[0] = aspath_tests[i].set_asn;
+      set[1] = aspath_tests[i].set_asn + 1;
+      bgpstream_as_path_append(path, BGPSTREAM_AS_PATH_SEG_SET, set, 2);
+    }
+    // the second time, the result comes from the cache
+    for (j = 0; j < 2; j++) {
+      pass = bgpstream_filter_mgr_aspath_match(filter_mgr, path);
+      CHECK(aspath_tests[i].expr, pass == aspath_tests[i].match);
+    }
+    bgpstream_as_path_destroy(path);
+    bgpstream_filter_mgr_destroy(filter_mgr);
+  }
+  return 0;
+}
+
+/* community filters (NULL-terminated), communities of the elem, and whether
+ * the elem should pass the filter */
+static const struct {
+  const char *filters[4];
+  const char *comms[4];
+  int match;
+} community_tests[] = {
+  {{"2914:410", NULL}, {"2914:410", "2914:1408", NULL}, 1},
+  {{"2914:411", NULL}, {"2914:410", "2914:1408", NULL}, 0},
+  {{"2914:*", NULL}, {"37105:300", "2914:1408", NULL}, 1},
+  {{"*:300", NULL}, {"37105:300", NULL}, 1},
+  {{"*:300", "3356:*", NULL}, {"37105:301", "2914:300", NULL}, 1},
+  {{"*:300", "3356:*", NULL}, {"37105:301", "2914:301", NULL}, 0},
+  {{"10:0", "10:*", NULL}, {"10:5", NULL}, 1},
+  {{"*:*", NULL}, {"1:1", NULL}, 1},
+  {{"*:*", NULL}, {NULL}, 0},
+  {{NULL}, {NULL}, 0},
+};
+
+static int test_community_filters()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_community_set_t *set;
+  bgpstream_community_t comm;
+  int i, j;
+
+  for (i = 0; community_tests[i].filters[0] != NULL; i++) {
+    filter_mgr = bgpstream_filter_mgr_create();
+    set = bgpstream_community_set_create();
+    for (j = 0; community_tests[i].filters[j] != NULL; j++) {
+      CHECK("community filter add",
+            bgpstream_filter_mgr_filter_add(
+              filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_COMMUNITY,
+              community_tests[i].filters[j]) != 0);
+    }
+    for (j = 0; community_tests[i].comms[j] != NULL; j++) {
+      bgpstream_str2community(community_tests[i].comms[j], &comm);
+      bgpstream_community_set_insert(set, &comm);
+    }
+    CHECK(community_tests[i].filters[0],
+          bgpstream_filter_mgr_community_match(filter_mgr, set) ==
+            community_tests[i].match);
+    bgpstream_community_set_destroy(set);
+    bgpstream_filter_mgr_destroy(filter_mgr);
+  }
+  return 0;
+}
+
+static int test_elem_checks()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_elem_t *elem;
+  uint32_t asn = 37105;
+  int i, ok = 1;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  elem = bgpstream_elem_create();
+  bgpstream_filter_mgr_filter_add(filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_TYPE,
+                                  "announcements");
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "25152");
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_ORIGIN_ASN,
+                                  "37105");
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, &asn, 1);
+
+  // run enough elems for the checks to be reordered a few times, and make
+  // sure that the results don't depend on the order
+  for (i = 0; i < BGPSTREAM_ELEM_CHECKS_REORDER_INTERVAL * 4; i++) {
+    elem->peer_asn = (i % 3 == 0) ? 25152 : 3356;
+    elem->type = (i % 5 == 0) ? BGPSTREAM_ELEM_TYPE_WITHDRAWAL
+                              : BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+    if (bgpstream_filter_mgr_elem_check(filter_mgr, elem) !=
+        (i % 3 == 0 && i % 5 != 0)) {
+      ok = 0;
+    }
+  }
+  CHECK("elem checks", ok);
+  // the peer ASN check (cost 2) rejects the most elems, so it should now be
+  // ahead of the elem type check (cost 1)
+  CHECK("elem checks reordered", filter_mgr->elem_checks[0].cost == 2);
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
+static int test_elem_filters()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_elem_filter_func_t *f_peer, *f_origin, *f_pfx, *f_ipv, *f_all;
+  bgpstream_elem_t *elem;
+  uint32_t asn = 37105;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  elem = bgpstream_elem_create();
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  elem->peer_asn = 25152;
+  bgpstream_str2pfx("192.0.2.0/24", &elem->prefix);
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, &asn, 1);
+
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+  CHECK("elem filter none",
+        bgpstream_filter_mgr_get_elem_filter(filter_mgr) == NULL &&
+          bgpstream_filter_mgr_elem_check(filter_mgr, elem) == 1);
+
+  // each single filter gets its own function, which is replaced once the
+  // filters change
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "25152");
+  f_peer = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
+  CHECK("elem filter peer",
+        f_peer != NULL && f_peer(filter_mgr, elem, 1) == 1 &&
+          bgpstream_filter_mgr_elem_check(filter_mgr, elem) == 1);
+  elem->peer_asn = 3356;
+  CHECK("elem filter peer reject", f_peer(filter_mgr, elem, 1) == 0);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_ORIGIN_ASN,
+                                  "37105");
+  f_origin = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
+  CHECK("elem filter origin",
+        f_origin != NULL && f_origin != f_peer &&
+          f_origin(filter_mgr, elem, 1) == 1);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_filter_add(filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX,
+                                  "192.0.0.0/16");
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+  f_pfx = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
+  CHECK("elem filter prefix",
+        f_pfx != NULL && f_pfx != f_peer && f_pfx != f_origin &&
+          f_pfx(filter_mgr, elem, 1) == 1);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_IP_VERSION, "6");
+  f_ipv = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
+  CHECK("elem filter ipversion",
+        f_ipv != NULL && f_ipv(filter_mgr, elem, 1) == 0);
+
+  bgpstream_filter_mgr_filter_add(filter_mgr,
+                                  BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "3356");
+  f_all = bgpstream_filter_mgr_get_elem_filter(filter_mgr);
+  CHECK("elem filter several", f_all != NULL && f_all != f_ipv &&
+                                 f_all(filter_mgr, elem, 1) == 0 &&
+                                 filter_mgr->elem_checks_cnt == 2);
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
+static int test_sample()
+{
+  bgpstream_filter_mgr_t *mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_t *big = bgpstream_filter_mgr_create();
+  bgpstream_elem_t *elem = bgpstream_elem_create();
+  char buf[32];
+  int i, kept = 0, subset = 1, stable = 1, res;
+
+  CHECK("sample invalid", bgpstream_filter_mgr_filter_add(
+                            mgr, BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE,
+                            "prefix 2/1") == 0);
+  bgpstream_filter_mgr_filter_add(mgr, BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE,
+                                  "prefix 1/16");
+  bgpstream_filter_mgr_filter_add(big, BGPSTREAM_FILTER_TYPE_ELEM_SAMPLE,
+                                  "4/16");
+
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  for (i = 0; i < 4096; i++) {
+    snprintf(buf, sizeof(buf), "10.%d.%d.0/24", i >> 8, i & 0xff);
+    bgpstream_str2pfx(buf, &elem->prefix);
+    elem->peer_asn = i; // the peer doesn't matter to a prefix sample
+    res = bgpstream_filter_mgr_elem_check(mgr, elem);
+    kept += res;
+    if (res && !bgpstream_filter_mgr_elem_check(big, elem)) {
+      subset = 0;
+    }
+    elem->peer_asn = 0;
+    if (res != bgpstream_filter_mgr_elem_check(mgr, elem)) {
+      stable = 0;
+    }
+  }
+  // 1/16 of 4096 prefixes, give or take
+  CHECK("sample ratio", kept > 192 && kept < 320);
+  CHECK("sample subset", subset);
+  CHECK("sample stable", stable);
+
+  elem->type = BGPSTREAM_ELEM_TYPE_PEERSTATE;
+  CHECK("sample peerstate", bgpstream_filter_mgr_elem_check(mgr, elem) == 1);
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(big);
+  bgpstream_filter_mgr_destroy(mgr);
+  return 0;
+}
+
+static int test_dedup()
+{
+  bgpstream_dedup_t *dedup = bgpstream_dedup_create(60);
+  bgpstream_record_t rec;
+  bgpstream_elem_t *elem = bgpstream_elem_create();
+  uint32_t path[] = {25152, 2914};
+
+  memset(&rec, 0, sizeof(rec));
+  rec.time_sec = 1427846400;
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  elem->peer_asn = 25152;
+  bgpstream_str2addr("202.249.2.185", &elem->peer_ip);
+  bgpstream_str2pfx("202.70.88.0/21", &elem->prefix);
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, path, 2);
+
+  // the same update from a second collector is dropped
+  CHECK("dedup first update", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+  rec.collector_name = "rrc00";
+  rec.time_sec += 10;
+  CHECK("dedup duplicate", bgpstream_dedup_check(dedup, &rec, elem) == 1);
+
+  // but a flap (or the same update after the window) is not
+  elem->type = BGPSTREAM_ELEM_TYPE_WITHDRAWAL;
+  CHECK("dedup withdrawal", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  CHECK("dedup flap", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+  rec.time_sec += 61;
+  CHECK("dedup window", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+
+  // duplicates are still found across the start of a new window
+  elem->type = BGPSTREAM_ELEM_TYPE_WITHDRAWAL;
+  rec.time_sec += 50;
+  CHECK("dedup withdrawal", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+  rec.time_sec += 14;
+  CHECK("dedup previous window",
+        bgpstream_dedup_check(dedup, &rec, elem) == 1);
+  rec.time_sec += 600;
+  CHECK("dedup expired", bgpstream_dedup_check(dedup, &rec, elem) == 0);
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_dedup_destroy(dedup);
+  return 0;
+}
+
+static int test_filter_sets()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_elem_t *elem;
+  bgpstream_pfx_t pfx[2];
+  uint32_t origins[2] = {37105, 15169};
+  uint64_t mask, expected;
+  int i, ok = 1;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  elem = bgpstream_elem_create();
+  bgpstream_str2pfx("192.0.2.0/25", &pfx[0]);
+  bgpstream_str2pfx("198.51.100.0/24", &pfx[1]);
+
+  CHECK("filter set add",
+        bgpstream_filter_mgr_filter_set_add(filter_mgr, "peer") == 0 &&
+          bgpstream_filter_mgr_filter_set_add(filter_mgr, "origin") == 1 &&
+          bgpstream_filter_mgr_filter_set_add(filter_mgr, "prefix") == 2 &&
+          bgpstream_filter_mgr_filter_set_add(filter_mgr, "both") == 3);
+  CHECK("filter set duplicate",
+        bgpstream_filter_mgr_filter_set_add(filter_mgr, "peer") == -1);
+  CHECK("filter set name",
+        strcmp(bgpstream_filter_mgr_filter_set_name(filter_mgr, 2),
+               "prefix") == 0 &&
+          bgpstream_filter_mgr_filter_set_name(filter_mgr, 4) == NULL);
+  CHECK("filter set record filter",
+        bgpstream_filter_mgr_filter_set_filter_add(
+          filter_mgr, 0, BGPSTREAM_FILTER_TYPE_COLLECTOR, "rrc00") == 0);
+
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 0, BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "25152");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 1, BGPSTREAM_FILTER_TYPE_ELEM_ORIGIN_ASN, "37105");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 1, BGPSTREAM_FILTER_TYPE_ELEM_TYPE, "announcements");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 2, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, "192.0.2.0/24");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 3, BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "25152");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 3, BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN, "3356");
+  bgpstream_filter_mgr_filter_set_filter_add(
+    filter_mgr, 3, BGPSTREAM_FILTER_TYPE_ELEM_ORIGIN_ASN, "15169");
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+
+  for (i = 0; i < 64; i++) {
+    elem->type = (i % 4 == 0) ? BGPSTREAM_ELEM_TYPE_WITHDRAWAL
+                              : BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+    elem->peer_asn = (i % 3 == 0) ? 25152 : (i % 3 == 1) ? 3356 : 174;
+    bgpstream_pfx_copy(&elem->prefix, &pfx[(i / 2) % 2]);
+    bgpstream_as_path_clear(elem->as_path);
+    bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                             &origins[(i / 8) % 2], 1);
+
+    expected = 0;
+    if (elem->peer_asn == 25152) {
+      expected |= 1 << 0;
+    }
+    if (elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT &&
+        origins[(i / 8) % 2] == 37105) {
+      expected |= 1 << 1;
+    }
+    if ((i / 2) % 2 == 0) {
+      expected |= 1 << 2;
+    }
+    if (elem->peer_asn != 174 &&
+        elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT &&
+        origins[(i / 8) % 2] == 15169) {
+      expected |= 1 << 3;
+    }
+    mask = bgpstream_filter_mgr_elem_sets_check(filter_mgr, elem);
+    if (mask != expected) {
+      ok = 0;
+    }
+  }
+  CHECK("filter set masks", ok);
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
+static int test_name_filters()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_str_intern_t *names;
+  uint32_t rrc00, rrc01;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  names = filter_mgr->names;
+
+  CHECK("name filter add",
+        bgpstream_filter_mgr_filter_add(filter_mgr,
+                                        BGPSTREAM_FILTER_TYPE_COLLECTOR,
+                                        "rrc00") != 0 &&
+          bgpstream_filter_mgr_filter_add(
+            filter_mgr, BGPSTREAM_FILTER_TYPE_PROJECT, "ris") != 0);
+
+  rrc00 = bgpstream_str_intern_lookup(names, "rrc00");
+  rrc01 = bgpstream_str_intern(names, "rrc01");
+  CHECK("name interning",
+        rrc00 != BGPSTREAM_STR_INTERN_NULL_ID && rrc01 != rrc00 &&
+          bgpstream_str_intern(names, "rrc00") == rrc00 &&
+          bgpstream_str_intern(names, "") == BGPSTREAM_STR_INTERN_EMPTY_ID &&
+          strcmp(bgpstream_str_intern_get(names, rrc01), "rrc01") == 0 &&
+          bgpstream_str_intern_lookup(names, "rrc02") ==
+            BGPSTREAM_STR_INTERN_NULL_ID);
+
+  CHECK("name filter ids",
+        bgpstream_id_set_exists(filter_mgr->collector_ids, rrc00) &&
+          !bgpstream_id_set_exists(filter_mgr->collector_ids, rrc01) &&
+          bgpstream_id_set_exists(filter_mgr->project_ids,
+                                  bgpstream_str_intern(names, "ris")) &&
+          filter_mgr->router_ids == NULL);
+
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
+#define LIST_PFX_CNT 5000
+
+// a string literal, and its length
+#define LIST(str) (str), (sizeof(str) - 1)
+
+static int test_filter_lists()
+{
+  bgpstream_filter_mgr_t *filter_mgr, *ref_mgr;
+  bgpstream_elem_t *elem;
+  char *buf, *p, line[64];
+  char path[] = "/tmp/bgpstream-test-filters-XXXXXX";
+  uint32_t x = 1;
+  int i, fd, ok = 1;
+  FILE *f;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  ref_mgr = bgpstream_filter_mgr_create();
+  elem = bgpstream_elem_create();
+
+  // a prefix list (with comments, blank lines and stray whitespace), added at
+  // once and one prefix at a time
+  buf = p = malloc(LIST_PFX_CNT * 64);
+  p += sprintf(p, "# watchlist\n\n");
+  for (i = 0; i < LIST_PFX_CNT; i++) {
+    x = x * 1103515245 + 12345;
+    if (i % 2 == 0) {
+      sprintf(line, "%d.%d.%d.0/%d", (x >> 24) & 0xff, (x >> 16) & 0xff,
+              (x >> 8) & 0xff, 16 + x % 9);
+    } else {
+      sprintf(line, "2001:db8:%x::/%d", (x >> 8) & 0xffff, 32 + x % 17);
+    }
+    bgpstream_filter_mgr_filter_add(ref_mgr,
+                                    BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE,
+                                    line);
+    p += sprintf(p, "%s%s\n", (i % 7 == 0) ? "  " : "", line);
+  }
+  CHECK("filter list add (prefixes)",
+        bgpstream_filter_mgr_filter_list_add(
+          filter_mgr, -1, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, buf,
+          p - buf) == 1);
+
+  // the list is only a faster way to add the same filters
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  for (i = 0; i < LIST_PFX_CNT * 4; i++) {
+    x = x * 1103515245 + 12345;
+    if (i % 2 == 0) {
+      sprintf(line, "%d.%d.%d.%d/%d", (x >> 24) & 0xff, (x >> 16) & 0xff,
+              (x >> 8) & 0xff, x & 0xff, 8 + x % 25);
+    } else {
+      sprintf(line, "2001:db8:%x::/%d", (x >> 8) & 0xffff, 24 + x % 41);
+    }
+    bgpstream_str2pfx(line, &elem->prefix);
+    if (bgpstream_filter_mgr_elem_check(filter_mgr, elem) !=
+        bgpstream_filter_mgr_elem_check(ref_mgr, elem)) {
+      ok = 0;
+    }
+  }
+  CHECK("filter list check (prefixes)", ok);
+
+  // other filter types, and filter sets
+  CHECK("filter list add (ASNs)",
+        bgpstream_filter_mgr_filter_list_add(
+          filter_mgr, -1, BGPSTREAM_FILTER_TYPE_ELEM_PEER_ASN,
+          LIST("25152\n 3356 \n# comment\n174")) == 1 &&
+          bgpstream_id_set_size(filter_mgr->peer_asns) == 3 &&
+          bgpstream_id_set_exists(filter_mgr->peer_asns, 174));
+  CHECK("filter list add (invalid value)",
+        bgpstream_filter_mgr_filter_list_add(
+          filter_mgr, -1, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY,
+          LIST("192.0.2.0/24\n192.0.2.0/33\n")) == 0);
+  CHECK("filter set add", bgpstream_filter_mgr_filter_set_add(filter_mgr,
+                                                              "list") == 0);
+  CHECK("filter list add (filter set)",
+        bgpstream_filter_mgr_filter_list_add(
+          filter_mgr, 0, BGPSTREAM_FILTER_TYPE_ELEM_COMMUNITY,
+          LIST("65000:1\n65000:2\n")) == 1 &&
+          bgpstream_filter_mgr_filter_list_add(
+            filter_mgr, 0, BGPSTREAM_FILTER_TYPE_COLLECTOR,
+            LIST("rrc00")) == 0);
+
+  // the same list, from a file
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  filter_mgr = bgpstream_filter_mgr_create();
+  if ((fd = mkstemp(path)) >= 0 && (f = fdopen(fd, "w")) != NULL) {
+    fwrite(buf, 1, p - buf, f);
+    fclose(f);
+  }
+  CHECK("filter file add",
+        bgpstream_filter_mgr_filter_file_add(
+          filter_mgr, -1, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, path) == 1 &&
+          bgpstream_patricia_prefix_count(filter_mgr->prefixes,
+                                          BGPSTREAM_ADDR_VERSION_IPV4) +
+              bgpstream_patricia_prefix_count(filter_mgr->prefixes,
+                                              BGPSTREAM_ADDR_VERSION_IPV6) ==
+            bgpstream_patricia_prefix_count(ref_mgr->prefixes,
+                                            BGPSTREAM_ADDR_VERSION_IPV4) +
+              bgpstream_patricia_prefix_count(ref_mgr->prefixes,
+                                              BGPSTREAM_ADDR_VERSION_IPV6));
+  unlink(path);
+  CHECK("filter file add (missing file)",
+        bgpstream_filter_mgr_filter_file_add(
+          filter_mgr, -1, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, path) == 0);
+
+  free(buf);
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  bgpstream_filter_mgr_destroy(ref_mgr);
+  return 0;
+}
+
+static int test_time_windows()
+{
+  bgpstream_filter_mgr_t *mgr = bgpstream_filter_mgr_create();
+  bgpstream_resource_mgr_t *rmgr;
+
+  CHECK("time windows none",
+        bgpstream_filter_mgr_time_wanted(mgr, 1000) == 1 &&
+          bgpstream_filter_mgr_time_overlaps(mgr, 0, 10) == 1);
+
+  // added out of order, with two that touch
+  bgpstream_filter_mgr_interval_filter_add(mgr, 5000, 5999);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 1000, 1999);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 2000, 2499);
+  CHECK("time windows valid", bgpstream_filter_mgr_validate(mgr) == 0 &&
+                                mgr->time_windows_cnt == 2 &&
+                                mgr->time_interval->begin_time == 1000 &&
+                                mgr->time_interval->end_time == 5999);
+
+  CHECK("time windows wanted",
+        bgpstream_filter_mgr_time_wanted(mgr, 999) == 0 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 1000) == 1 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 2499) == 1 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 2500) == 0 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 5500) == 1 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 6000) == 0);
+  CHECK("time windows overlaps",
+        bgpstream_filter_mgr_time_overlaps(mgr, 2500, 4999) == 0 &&
+          bgpstream_filter_mgr_time_overlaps(mgr, 2400, 3000) == 1 &&
+          bgpstream_filter_mgr_time_overlaps(mgr, 4000, 5000) == 1 &&
+          bgpstream_filter_mgr_time_overlaps(mgr, 0, 999) == 0);
+  CHECK("time windows next",
+        bgpstream_filter_mgr_time_next(mgr, 0) == 1000 &&
+          bgpstream_filter_mgr_time_next(mgr, 1500) == 1500 &&
+          bgpstream_filter_mgr_time_next(mgr, 3000) == 5000 &&
+          bgpstream_filter_mgr_time_next(mgr, 7000) == 0);
+
+  // a live window swallows the ones after it
+  bgpstream_filter_mgr_interval_filter_add(mgr, 5500, BGPSTREAM_FOREVER);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 9000, 9999);
+  CHECK("time windows live",
+        bgpstream_filter_mgr_validate(mgr) == 0 &&
+          mgr->time_windows_cnt == 2 &&
+          mgr->time_interval->end_time == BGPSTREAM_FOREVER &&
+          bgpstream_filter_mgr_time_wanted(mgr, UINT32_MAX) == 1);
+
+  bgpstream_filter_mgr_interval_filter_add(mgr, 10, 5);
+  CHECK("time windows invalid", bgpstream_filter_mgr_validate(mgr) != 0);
+  bgpstream_filter_mgr_destroy(mgr);
+
+  // resuming from a checkpoint drops the data before it, whether or not the
+  // windows have been validated yet
+  mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_interval_filter_add(mgr, 5000, 5999);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 1000, 1999);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 3000, 3999);
+  bgpstream_filter_mgr_time_clip(mgr, 3500);
+  CHECK("time windows resume",
+        bgpstream_filter_mgr_validate(mgr) == 0 &&
+          mgr->time_windows_cnt == 2 &&
+          mgr->time_interval->begin_time == 3500 &&
+          mgr->time_interval->end_time == 5999 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 3499) == 0 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 3500) == 1 &&
+          bgpstream_filter_mgr_time_next(mgr, 1000) == 3500 &&
+          bgpstream_filter_mgr_time_next(mgr, 4000) == 5000);
+  bgpstream_filter_mgr_time_clip(mgr, 9000);
+  CHECK("time windows resume after end",
+        mgr->time_windows_cnt == 1 &&
+          bgpstream_filter_mgr_time_next(mgr, 1000) == 5999 &&
+          bgpstream_filter_mgr_time_wanted(mgr, 5000) == 0);
+  bgpstream_filter_mgr_destroy(mgr);
+
+  // and so does a checkpoint given to the resource manager
+  mgr = bgpstream_filter_mgr_create();
+  bgpstream_filter_mgr_interval_filter_add(mgr, 1000, 1999);
+  bgpstream_filter_mgr_interval_filter_add(mgr, 3000, 3999);
+  rmgr = bgpstream_resource_mgr_create(mgr);
+  CHECK("checkpoint resume windows",
+        rmgr != NULL &&
+          bgpstream_resource_mgr_set_checkpoint(
+            rmgr, "BGPSTREAM-CHECKPOINT 1\ntime 3200\n") == 0 &&
+          bgpstream_filter_mgr_validate(mgr) == 0 &&
+          mgr->time_windows_cnt == 1 &&
+          bgpstream_filter_mgr_time_next(mgr, 1000) == 3200);
+  bgpstream_resource_mgr_destroy(rmgr);
+  bgpstream_filter_mgr_destroy(mgr);
+  return 0;
+}
+
+#define INDEX_PFX_CNT 512
+
+static const struct {
+  const char *pfx;
+  int match;
+} pfx_index_tests[] = {
+  {"192.0.2.0/24", 1},      {"192.0.2.0/25", 0},    {"192.0.0.0/16", 0},
+  {"198.51.100.0/24", 1},   {"198.51.0.0/16", 1},   {"198.51.100.0/25", 0},
+  {"203.0.113.0/24", 1},    {"203.0.113.128/25", 1}, {"203.0.0.0/16", 0},
+  {"0.0.0.0/0", 1},         {"10.0.0.0/8", 0},      {"2001:db8::/32", 1},
+  {"2001:db8::/48", 0},     {"2001:db8:1::/48", 1}, {"2001:db8:1:2::/64", 1},
+  {"2001::/16", 1},         {"2001:db8:2::/56", 1}, {"2001:db8:2::/47", 1},
+  {"2001:db8:4::/48", 0},
+};
+
+static const char *pfx_index_str(uint32_t x, int v6, int len)
+{
+  static char buf[64];
+
+  if (v6) {
+    snprintf(buf, sizeof(buf), "2001:db8:%x:%x::/%d", (x >> 20) & 0x3,
+             (x >> 4) & 0xffff, len);
+  } else {
+    snprintf(buf, sizeof(buf), "10.%d.%d.%d/%d", (x >> 22) & 0x3,
+             (x >> 8) & 0xff, x & 0xff, len);
+  }
+  return buf;
+}
+
+static int test_prefix_index()
+{
+  static const bgpstream_filter_type_t types[] = {
+    BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE,
+    BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS,
+    BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT,
+    BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY,
+  };
+  static const uint8_t matches[] = {
+    BGPSTREAM_PREFIX_MATCH_MORE,
+    BGPSTREAM_PREFIX_MATCH_LESS,
+    BGPSTREAM_PREFIX_MATCH_EXACT,
+    BGPSTREAM_PREFIX_MATCH_ANY,
+  };
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_elem_t *elem;
+  bgpstream_pfx_t *pfxs;
+  uint8_t *allowed;
+  uint32_t x = 7;
+  int i, j, k, v6, len, expected, ok = 1;
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  elem = bgpstream_elem_create();
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT, "192.0.2.0/24");
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_LESS, "198.51.100.0/24");
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, "203.0.113.0/24");
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_EXACT, "2001:db8::/32");
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_MORE, "2001:db8:1::/48");
+  bgpstream_filter_mgr_filter_add(
+    filter_mgr, BGPSTREAM_FILTER_TYPE_ELEM_PREFIX_ANY, "2001:db8:2::/48");
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+  for (i = 0; i < (int)ARR_CNT(pfx_index_tests); i++) {
+    bgpstream_str2pfx(pfx_index_tests[i].pfx, &elem->prefix);
+    CHECK(pfx_index_tests[i].pfx,
+          bgpstream_filter_mgr_elem_check(filter_mgr, elem) ==
+            pfx_index_tests[i].match);
+  }
+  bgpstream_filter_mgr_destroy(filter_mgr);
+
+  filter_mgr = bgpstream_filter_mgr_create();
+  pfxs = malloc(sizeof(bgpstream_pfx_t) * INDEX_PFX_CNT);
+  allowed = malloc(INDEX_PFX_CNT);
+
+  // filters of all kinds, crowded into a small part of the address space so
+  // that many of them overlap
+  for (i = 0; i < INDEX_PFX_CNT; i++) {
+    x = x * 1103515245 + 12345;
+    v6 = i % 2;
+    len = v6 ? 48 + (x >> 8) % 17 : 16 + (x >> 8) % 17;
+    bgpstream_str2pfx(pfx_index_str(x >> 4, v6, len), &pfxs[i]);
+    bgpstream_filter_mgr_filter_add(filter_mgr, types[(x >> 16) % 4],
+                                    pfx_index_str(x >> 4, v6, len));
+    allowed[i] = matches[(x >> 16) % 4];
+  }
+  CHECK("filter validate", bgpstream_filter_mgr_validate(filter_mgr) == 0);
+  CHECK("prefix index compiled", filter_mgr->pfx_index != NULL);
+
+  // compare with every filter, where the first one added for a prefix wins
+  for (i = 0; i < INDEX_PFX_CNT * 8; i++) {
+    x = x * 1103515245 + 12345;
+    v6 = i % 2;
+    len = v6 ? 24 + (x >> 8) % 49 : (x >> 8) % 33;
+    bgpstream_str2pfx(pfx_index_str(x >> 4, v6, len), &elem->prefix);
+    if (i % 16 == 0) {
+      // hit the filters exactly now and then
+      bgpstream_pfx_copy(&elem->prefix, &pfxs[(x >> 16) % INDEX_PFX_CNT]);
+    }
+    expected = 0;
+    for (j = 0; j < INDEX_PFX_CNT && !expected; j++) {
+      for (k = 0; k < j; k++) {
+        if (bgpstream_pfx_equal(&pfxs[j], &pfxs[k])) {
+          break;
+        }
+      }
+      if (k < j) {
+        continue;
+      }
+      if (bgpstream_pfx_equal(&pfxs[j], &elem->prefix)) {
+        expected = 1;
+      } else if (bgpstream_pfx_contains(&pfxs[j], &elem->prefix)) {
+        expected = allowed[j] == BGPSTREAM_PREFIX_MATCH_ANY ||
+                   allowed[j] == BGPSTREAM_PREFIX_MATCH_MORE;
+      } else if (bgpstream_pfx_contains(&elem->prefix, &pfxs[j])) {
+        expected = allowed[j] == BGPSTREAM_PREFIX_MATCH_ANY ||
+                   allowed[j] == BGPSTREAM_PREFIX_MATCH_LESS;
+      }
+    }
+    if (bgpstream_filter_mgr_elem_check(filter_mgr, elem) != expected) {
+      ok = 0;
+    }
+  }
+  CHECK("prefix index matches", ok);
+
+  free(allowed);
+  free(pfxs);
+  bgpstream_elem_destroy(elem);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
 int main()
 {
   int rc = 0;
 
+  test_aspath_filters();
+  test_community_filters();
+  test_name_filters();
+  test_elem_checks();
+  test_elem_filters();
+  test_sample();
+  test_time_windows();
+  test_dedup();
+  test_filter_sets();
+  test_filter_lists();
+  test_prefix_index();
+
 #ifdef WITH_DATA_INTERFACE_BROKER
   rc = test_bgpstream_filters();
 #else
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int count_pfx(const bgpstream_pfx_t *pfx,
+                     const bgpstream_origins_entry_t *origins, int origins_cnt,
+                     void *user)
+{
+  (*(int *)user)++;
+  return 0;
+}
+
+static int stop_first(const bgpstream_pfx_t *pfx,
+                      const bgpstream_origins_entry_t *origins, int origins_cnt,
+                      void *user)
+{
+  return 1;
+}
+
+static void set_route(bgpstream_elem_t *elem, bgpstream_elem_type_t type,
+                      const char *peer, const char *pfx, uint32_t origin)
+{
+  uint32_t seq[] = {65000, origin};
+
+  elem->type = type;
+  bgpstream_str2addr(peer, &elem->peer_ip);
+  bgpstream_str2pfx(pfx, &elem->prefix);
+  bgpstream_as_path_clear(elem->as_path);
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, seq, 2);
+}
+
+int main(int argc, char *argv[])
+{
+  bgpstream_record_t rec;
+  bgpstream_elem_t *elem = bgpstream_elem_create();
+  bgpstream_origins_t *origins = bgpstream_origins_create();
+  const bgpstream_origins_entry_t *entries;
+  bgpstream_pfx_t pfx;
+  int cnt;
+
+  CHECK("origins create", elem != NULL && origins != NULL);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.project_name = "ris";
+  rec.collector_name = "rrc06";
+  elem->peer_asn = 65000;
+
+  // two peers see the same origin, a third a different one
+  rec.type = BGPSTREAM_UPDATE;
+  rec.dump_pos = BGPSTREAM_DUMP_MIDDLE;
+  rec.time_sec = 1000;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.1",
+            "10.0.0.0/8", 64500);
+  CHECK("origins new origin",
+        bgpstream_origins_apply(origins, &rec, elem) == 1);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.2",
+            "10.0.0.0/8", 64500);
+  CHECK("origins same origin",
+        bgpstream_origins_apply(origins, &rec, elem) == 0);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.3",
+            "10.0.0.0/8", 64496);
+  CHECK("origins second origin",
+        bgpstream_origins_apply(origins, &rec, elem) == 1);
+  CHECK("origins lookup",
+        bgpstream_origins_lookup(origins, &elem->prefix, &entries) == 2 &&
+          entries[0].asn == 64496 && entries[0].peer_cnt == 1 &&
+          entries[1].asn == 64500 && entries[1].peer_cnt == 2);
+
+  // a more specific of it, and an unrelated prefix
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.1",
+            "10.1.0.0/16", 64511);
+  CHECK("origins more specific",
+        bgpstream_origins_apply(origins, &rec, elem) == 1);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.1",
+            "2001:db8::/32", 64501);
+  CHECK("origins ipv6", bgpstream_origins_apply(origins, &rec, elem) == 1 &&
+                          bgpstream_origins_get_pfx_cnt(origins) == 3);
+
+  cnt = 0;
+  bgpstream_str2pfx("10.1.2.0/24", &pfx);
+  CHECK("origins covering",
+        bgpstream_origins_get_covering(origins, &pfx, count_pfx, &cnt) == 0 &&
+          cnt == 2);
+  cnt = 0;
+  bgpstream_str2pfx("10.0.0.0/8", &pfx);
+  CHECK("origins covering exact",
+        bgpstream_origins_get_covering(origins, &pfx, count_pfx, &cnt) == 0 &&
+          cnt == 1);
+  cnt = 0;
+  CHECK("origins more specifics",
+        bgpstream_origins_get_more_specifics(origins, &pfx, count_pfx, &cnt) ==
+            0 &&
+          cnt == 1);
+  CHECK("origins query stop",
+        bgpstream_origins_get_covering(origins, &pfx, stop_first, NULL) == 1);
+
+  // an implicit withdrawal moves a peer to another origin
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.3",
+            "10.0.0.0/8", 64500);
+  CHECK("origins origin change",
+        bgpstream_origins_apply(origins, &rec, elem) == 1 &&
+          bgpstream_origins_lookup(origins, &elem->prefix, &entries) == 1 &&
+          entries[0].peer_cnt == 3);
+
+  // withdrawals only remove the origin once no peer uses it
+  set_route(elem, BGPSTREAM_ELEM_TYPE_WITHDRAWAL, "192.0.2.2", "10.0.0.0/8",
+            0);
+  CHECK("origins withdrawal",
+        bgpstream_origins_apply(origins, &rec, elem) == 0 &&
+          bgpstream_origins_lookup(origins, &elem->prefix, &entries) == 1 &&
+          entries[0].peer_cnt == 2);
+  CHECK("origins repeated withdrawal",
+        bgpstream_origins_apply(origins, &rec, elem) == 0);
+
+  // a session going down drops the routes of that peer
+  elem->type = BGPSTREAM_ELEM_TYPE_PEERSTATE;
+  elem->new_state = BGPSTREAM_ELEM_PEERSTATE_IDLE;
+  bgpstream_str2addr("192.0.2.1", &elem->peer_ip);
+  CHECK("origins peer down",
+        bgpstream_origins_apply(origins, &rec, elem) == 1 &&
+          bgpstream_origins_get_pfx_cnt(origins) == 1);
+
+  // a RIB dump drops the routes that it did not refresh
+  rec.type = BGPSTREAM_RIB;
+  rec.time_sec = rec.dump_time_sec = 2000;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "192.0.2.1", "198.51.100.0/24",
+            64502);
+  CHECK("origins dump", bgpstream_origins_apply(origins, &rec, elem) == 1);
+  rec.dump_pos = BGPSTREAM_DUMP_END;
+  CHECK("origins dump end",
+        bgpstream_origins_apply(origins, &rec, NULL) == 1 &&
+          bgpstream_origins_get_pfx_cnt(origins) == 1 &&
+          bgpstream_origins_lookup(origins, &elem->prefix, &entries) == 1 &&
+          entries[0].asn == 64502);
+
+  bgpstream_origins_destroy(origins);
+  bgpstream_elem_destroy(elem);
+
+  ENDTEST;
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_plan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNITS 3
+#define UPDATES_CNT 30
+
+static int add_resource(bgpstream_plan_t *plan, const char *url,
+                        uint32_t time, uint32_t duration,
+                        bgpstream_record_type_t type)
+{
+  bgpstream_resource_t *res;
+  int rc;
+
+  res = bgpstream_resource_create(BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+                                  BGPSTREAM_RESOURCE_FORMAT_MRT, url, time,
+                                  duration, "routeviews", "route-views2",
+                                  type);
+  if (res == NULL) {
+    return -1;
+  }
+  rc = bgpstream_plan_add(plan, res);
+  bgpstream_resource_destroy(res);
+  return rc;
+}
+
+// count the rows of a work unit file, checking that they are in time order
+static int count_rows(const char *path, int *sorted)
+{
+  char line[1024];
+  unsigned long time, prev = 0;
+  const char *p;
+  FILE *f;
+  int cnt = 0;
+
+  if ((f = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    // the fifth column is the initial time of the dump
+    p = line;
+    for (int i = 0; i < 4 && p != NULL; i++) {
+      if ((p = strchr(p, ',')) != NULL) {
+        p++;
+      }
+    }
+    time = p != NULL ? strtoul(p, NULL, 10) : 0;
+    if (time < prev) {
+      *sorted = 0;
+    }
+    prev = time;
+    cnt++;
+  }
+  fclose(f);
+  return cnt;
+}
+
+static int test_plan()
+{
+  bgpstream_plan_t *plan;
+  char dir[] = "/tmp/bgpstream-test-plan.XXXXXX";
+  char prefix[64], path[96], url[64];
+  uint64_t w, wmin = UINT64_MAX, wmax = 0;
+  int i, ok = 1, sorted = 1, rows = 0, cnt;
+
+  CHECK("plan create (no units)", bgpstream_plan_create(0) == NULL);
+  CHECK("plan create", (plan = bgpstream_plan_create(UNITS)) != NULL);
+
+  // two RIBs and a long run of updates, none of which can be stat'ed
+  for (i = 0; i < UPDATES_CNT; i++) {
+    snprintf(url, sizeof(url), "/nonexistent/updates.%d.bz2", i);
+    if (add_resource(plan, url, 1427846400 + i * 900, 900, BGPSTREAM_UPDATE) !=
+        1) {
+      ok = 0;
+    }
+  }
+  CHECK("plan add updates", ok);
+  CHECK("plan add ribs",
+        add_resource(plan, "/nonexistent/rib.0.bz2", 1427846400, 120,
+                     BGPSTREAM_RIB) == 1 &&
+          add_resource(plan, "/nonexistent/rib.1.bz2", 1427875200, 120,
+                       BGPSTREAM_RIB) == 1);
+  CHECK("plan skip stream",
+        add_resource(plan, "/nonexistent/stream", 1427846400,
+                     BGPSTREAM_FOREVER, BGPSTREAM_UPDATE) == 0);
+
+  // the RIBs outweigh the updates, so they get a unit each and the third
+  // unit gets most of the updates
+  bgpstream_plan_assign(plan);
+  for (i = 0; i < UNITS; i++) {
+    w = bgpstream_plan_get_unit_weight(plan, i);
+    wmin = w < wmin ? w : wmin;
+    wmax = w > wmax ? w : wmax;
+  }
+  CHECK("plan balanced", wmax - wmin <= 96 * 1024 * 1024);
+
+  CHECK("plan temp dir", mkdtemp(dir) != NULL);
+  snprintf(prefix, sizeof(prefix), "%s/unit", dir);
+  CHECK("plan write", bgpstream_plan_write(plan, prefix) == UPDATES_CNT + 2);
+  for (i = 0; i < UNITS; i++) {
+    snprintf(path, sizeof(path), "%s-%d.csv", prefix, i);
+    if ((cnt = count_rows(path, &sorted)) < 0) {
+      ok = 0;
+    } else {
+      rows += cnt;
+    }
+    unlink(path);
+  }
+  rmdir(dir);
+  CHECK("plan units written", ok && rows == UPDATES_CNT + 2);
+  CHECK("plan units sorted", sorted);
+
+  bgpstream_plan_destroy(plan);
+  return 0;
+}
+
+int main()
+{
+  test_plan();
+
+  ENDTEST;
+  return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_churn.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int diff_cnt[3];
+
+static int count_diff(bgpstream_rib_diff_type_t type,
+                      bgpstream_peer_id_t peer_id, const bgpstream_pfx_t *pfx,
+                      const bgpstream_rib_route_t *old_route,
+                      const bgpstream_rib_route_t *new_route, void *user)
+{
+  diff_cnt[type]++;
+  return 0;
+}
+
+static int count_route(bgpstream_peer_id_t peer_id, const bgpstream_pfx_t *pfx,
+                       const bgpstream_rib_route_t *route, void *user)
+{
+  (*(int *)user)++;
+  return 0;
+}
+
+static void set_route(bgpstream_elem_t *elem, bgpstream_elem_type_t type,
+                      const char *pfx, uint32_t origin)
+{
+  uint32_t seq[] = {65000, origin};
+
+  elem->type = type;
+  bgpstream_str2pfx(pfx, &elem->prefix);
+  bgpstream_as_path_clear(elem->as_path);
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, seq, 2);
+}
+
+int main(int argc, char *argv[])
+{
+  bgpstream_record_t rec;
+  bgpstream_elem_t *elem = bgpstream_elem_create();
+  bgpstream_rib_t *rib = bgpstream_rib_create();
+  bgpstream_rib_t *snap;
+  bgpstream_churn_t *churn;
+  bgpstream_elem_t *removed;
+  const bgpstream_rib_route_t *route;
+  bgpstream_community_t comm;
+  bgpstream_pfx_t pfx;
+  bgpstream_peer_id_t peer_id;
+  int walked = 0;
+
+  CHECK("rib create", elem != NULL && rib != NULL);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.project_name = "ris";
+  rec.collector_name = "rrc06";
+  elem->peer_asn = 65000;
+  bgpstream_str2addr("192.0.2.1", &elem->peer_ip);
+
+  // a RIB dump installs two routes
+  rec.type = BGPSTREAM_RIB;
+  rec.dump_pos = BGPSTREAM_DUMP_START;
+  rec.time_sec = rec.dump_time_sec = 1000;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "192.0.2.0/24", 64500);
+  CHECK("rib apply dump", bgpstream_rib_apply(rib, &rec, elem) == 1);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "2001:db8::/32", 64501);
+  comm.asn = 65000;
+  comm.value = 100;
+  bgpstream_community_set_insert(elem->communities, &comm);
+  CHECK("rib apply dump", bgpstream_rib_apply(rib, &rec, elem) == 1 &&
+                            bgpstream_rib_apply(rib, &rec, NULL) == 0);
+  bgpstream_community_set_clear(elem->communities);
+
+  peer_id = bgpstream_peer_sig_map_get_id(bgpstream_rib_get_peer_sig_map(rib),
+                                          "rrc06", &elem->peer_ip, 65000);
+  CHECK("rib route count", bgpstream_rib_get_route_cnt(rib, 0) == 2 &&
+                             bgpstream_rib_get_route_cnt(rib, peer_id) == 2);
+  route = bgpstream_rib_lookup(rib, peer_id, &elem->prefix);
+  CHECK("rib lookup",
+        route != NULL && route->time == 1000 && route->comms_id != 0 &&
+          bgpstream_community_set_size(
+            bgpstream_rib_get_communities(rib, route->comms_id)) == 1);
+
+  // updates change the live RIB, but not a snapshot
+  snap = bgpstream_rib_snapshot(rib);
+  CHECK("rib snapshot", snap != NULL);
+  rec.type = BGPSTREAM_UPDATE;
+  rec.dump_pos = BGPSTREAM_DUMP_MIDDLE;
+  rec.time_sec = 1100;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "192.0.2.0/24", 64502);
+  CHECK("rib apply announcement", bgpstream_rib_apply(rib, &rec, elem) == 1);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, "198.51.100.0/24", 64500);
+  CHECK("rib apply announcement", bgpstream_rib_apply(rib, &rec, elem) == 1);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_WITHDRAWAL, "2001:db8::/32", 0);
+  CHECK("rib apply withdrawal", bgpstream_rib_apply(rib, &rec, elem) == 1);
+  CHECK("rib snapshot unchanged",
+        bgpstream_rib_get_route_cnt(snap, 0) == 2 &&
+          bgpstream_rib_lookup(snap, peer_id, &elem->prefix) != NULL &&
+          bgpstream_rib_lookup(rib, peer_id, &elem->prefix) == NULL);
+
+  CHECK("rib diff", bgpstream_rib_diff(snap, rib, count_diff, NULL) == 0 &&
+                      diff_cnt[BGPSTREAM_RIB_DIFF_ADDED] == 1 &&
+                      diff_cnt[BGPSTREAM_RIB_DIFF_REMOVED] == 1 &&
+                      diff_cnt[BGPSTREAM_RIB_DIFF_CHANGED] == 1);
+  CHECK("rib walk", bgpstream_rib_walk(rib, count_route, &walked) == 0 &&
+                      walked == 2);
+  bgpstream_rib_destroy(snap);
+
+  // a new dump drops the routes it did not refresh
+  rec.type = BGPSTREAM_RIB;
+  rec.dump_pos = BGPSTREAM_DUMP_END;
+  rec.time_sec = rec.dump_time_sec = 1200;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "198.51.100.0/24", 64500);
+  CHECK("rib apply unchanged route",
+        bgpstream_rib_apply(rib, &rec, elem) == 0 &&
+          bgpstream_rib_apply(rib, &rec, NULL) == 1);
+  bgpstream_str2pfx("192.0.2.0/24", &pfx);
+  CHECK("rib stale routes removed",
+        bgpstream_rib_get_route_cnt(rib, 0) == 1 &&
+          bgpstream_rib_lookup(rib, peer_id, &pfx) == NULL);
+
+  // and a session going down drops everything
+  rec.type = BGPSTREAM_UPDATE;
+  elem->type = BGPSTREAM_ELEM_TYPE_PEERSTATE;
+  elem->new_state = BGPSTREAM_ELEM_PEERSTATE_IDLE;
+  CHECK("rib apply peer down", bgpstream_rib_apply(rib, &rec, elem) == 1 &&
+                                 bgpstream_rib_get_route_cnt(rib, 0) == 0);
+
+  bgpstream_rib_destroy(rib);
+
+  // RIB diff mode: a second dump only yields what changed
+  churn = bgpstream_churn_create();
+  CHECK("churn create", churn != NULL);
+  rec.type = BGPSTREAM_RIB;
+  rec.dump_pos = BGPSTREAM_DUMP_MIDDLE;
+  rec.time_sec = rec.dump_time_sec = 2000;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "192.0.2.0/24", 64500);
+  CHECK("churn new route", bgpstream_churn_check(churn, &rec, elem) == 1 &&
+                             elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT);
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "198.51.100.0/24", 64500);
+  CHECK("churn new route", bgpstream_churn_check(churn, &rec, elem) == 1);
+
+  rec.time_sec = rec.dump_time_sec = 3000;
+  set_route(elem, BGPSTREAM_ELEM_TYPE_RIB, "192.0.2.0/24", 64500);
+  CHECK("churn unchanged route",
+        bgpstream_churn_check(churn, &rec, elem) == 0);
+  rec.dump_pos = BGPSTREAM_DUMP_END;
+  CHECK("churn removed route",
+        bgpstream_churn_get_removed(churn, &rec, &removed) == 1 &&
+          removed->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
+          removed->peer_asn == 65000 &&
+          bgpstream_str2pfx("198.51.100.0/24", &pfx) != NULL &&
+          bgpstream_pfx_equal(&removed->prefix, &pfx));
+  CHECK("churn removed end",
+        bgpstream_churn_get_removed(churn, &rec, &removed) == 0 &&
+          removed == NULL);
+  bgpstream_churn_destroy(churn);
+
+  bgpstream_elem_destroy(elem);
+
+  ENDTEST;
+  return 0;
+}
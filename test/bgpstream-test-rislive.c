@@ -27,6 +27,7 @@
 #include "bgpstream.h"
 #include "bgpstream_test.h"
 #include "utils.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -70,6 +71,7 @@ static int test_bgpstream_rislive()
 {
   /* Declare BGPStream requirements */
   int rrc = 0, count = 0, rcount = 0, erc = 0;
+  uint32_t rec_elems;
   bgpstream_t *bs = bgpstream_create();
   bgpstream_elem_t *elem;
   bgpstream_record_t *rec = NULL;
@@ -104,6 +106,7 @@ static int test_bgpstream_rislive()
     fprintf(stderr, "checking entry %d\n", rcount);
     switch (rec->status) {
     case BGPSTREAM_RECORD_STATUS_VALID_RECORD:
+      rec_elems = 0;
 
       while ((erc = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
 
@@ -123,8 +126,16 @@ static int test_bgpstream_rislive()
         }
         fprintf(stderr, "VALID: %s\n", buf);
         count++;
+        rec_elems++;
         buf[0] = '\0';
       }
+      // with no elem filters, the record yields exactly what it announced
+      if (rec_elems != bgpstream_record_get_elem_cnt_hint(rec)) {
+        fprintf(stderr,
+                "record %d has %" PRIu32 " elems, expected %" PRIu32 "\n",
+                rcount, rec_elems, bgpstream_record_get_elem_cnt_hint(rec));
+        goto err;
+      }
       fprintf(stderr, "correctly valid record %d\n\n", rcount);
       break;
 
@@ -159,6 +159,140 @@ int test_rpki_validate()
   }
   return 0;
 }
+
+int test_rpki_cache()
+{
+
+  /* Declare BGPStream requirements */
+  int rrc = 0, erc = 0, cnt = 0;
+  uint64_t hits = 0, misses = 0;
+  bgpstream_elem_t *bs_elem;
+  bgpstream_t *bs = bgpstream_create();
+  bgpstream_record_t *rec = NULL;
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+  bgpstream_data_interface_option_t *option;
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  bgpstream_start(bs);
+
+  bgpstream_rpki_input_t *input = bgpstream_rpki_create_input();
+  bgpstream_rpki_parse_collectors(VALIDATE_TESTCASE_1, input);
+  uint32_t interval_start = 1427846400;
+  uint32_t interval_end = 1427846500;
+  bgpstream_rpki_parse_interval(input, interval_start, interval_end);
+  bgpstream_add_interval_filter(bs, interval_start, interval_end);
+  rpki_cfg_t *cfg = bgpstream_rpki_set_cfg(input);
+
+  /* Use a tiny cache so that evictions are exercised too */
+  bgpstream_rpki_cache_t *cache = bgpstream_rpki_cache_create(8, 1);
+  CHECK_RPKI_RESULT("Create Cache", cache != NULL);
+
+  /* Cached results must be identical to uncached ones */
+  char val_result[VALIDATION_BUF];
+  char val_cached[VALIDATION_BUF];
+  while ((rrc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      while ((erc = bgpstream_record_get_next_elem(rec, &bs_elem)) > 0) {
+        if (bs_elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
+          bs_elem->annotations.cfg = cfg;
+          bs_elem->annotations.rpki_active = input->rpki_active;
+          bs_elem->annotations.timestamp = rec->time_sec;
+          bs_elem->annotations.rpki_cache = NULL;
+          val_result[0] = val_cached[0] = '\0';
+          bgpstream_rpki_validate(bs_elem, val_result, sizeof(val_result));
+          bs_elem->annotations.rpki_cache = cache;
+          bgpstream_rpki_validate(bs_elem, val_cached, sizeof(val_cached));
+          if (check_val_result(val_cached, val_result, cnt++) != 0) {
+            return -1;
+          }
+        }
+      }
+    }
+  }
+
+  bgpstream_rpki_cache_get_stats(cache, &hits, &misses);
+  CHECK_RPKI_RESULT("Cache Statistics", hits + misses == (uint64_t)cnt);
+
+  bgpstream_rpki_cache_clear(cache);
+  bgpstream_rpki_cache_destroy(cache);
+  bgpstream_rpki_destroy_cfg(cfg);
+  bgpstream_rpki_destroy_input(input);
+  bgpstream_destroy(bs);
+  return 0;
+}
+
+#define PIPELINE_WORKERS 2
+
+int test_rpki_pipeline()
+{
+
+  /* Declare BGPStream requirements */
+  int rrc = 0, erc = 0, cnt = 0, i;
+  bgpstream_elem_t *bs_elem;
+  bgpstream_t *bs = bgpstream_create();
+  bgpstream_record_t *rec = NULL;
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+  bgpstream_data_interface_option_t *option;
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+
+  bgpstream_rpki_input_t *input = bgpstream_rpki_create_input();
+  bgpstream_rpki_parse_collectors(VALIDATE_TESTCASE_1, input);
+  uint32_t interval_start = 1427846400;
+  uint32_t interval_end = 1427846500;
+  bgpstream_rpki_parse_interval(input, interval_start, interval_end);
+  bgpstream_add_interval_filter(bs, interval_start, interval_end);
+  bgpstream_start(bs);
+
+  /* One configuration to check against, and one per worker */
+  rpki_cfg_t *cfg = bgpstream_rpki_set_cfg(input);
+  rpki_cfg_t *cfgs[PIPELINE_WORKERS];
+  for (i = 0; i < PIPELINE_WORKERS; i++) {
+    cfgs[i] = bgpstream_rpki_set_cfg(input);
+  }
+
+  /* Use a small depth so that several batches are read */
+  bgpstream_rpki_pipeline_t *pipeline =
+    bgpstream_rpki_pipeline_create(bs, cfgs, PIPELINE_WORKERS, 4, 1);
+  CHECK_RPKI_RESULT("Create Pipeline", pipeline != NULL);
+
+  /* Results computed ahead must be identical to inline ones */
+  char val_result[VALIDATION_BUF];
+  char val_piped[VALIDATION_BUF];
+  bgpstream_elem_t *check = bgpstream_elem_create();
+  while ((rrc = bgpstream_rpki_pipeline_get_next_record(pipeline, &rec)) > 0) {
+    while ((erc = bgpstream_rpki_pipeline_get_next_elem(pipeline, &bs_elem)) >
+           0) {
+      if (bs_elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
+        val_result[0] = val_piped[0] = '\0';
+        bgpstream_rpki_validate(bs_elem, val_piped, sizeof(val_piped));
+        bgpstream_elem_copy(check, bs_elem);
+        check->annotations.cfg = cfg;
+        check->annotations.rpki_result = NULL;
+        bgpstream_rpki_validate(check, val_result, sizeof(val_result));
+        if (check_val_result(val_piped, val_result, cnt++) != 0) {
+          return -1;
+        }
+      }
+    }
+    CHECK_RPKI_RESULT("Pipeline elems", erc == 0);
+  }
+  CHECK_RPKI_RESULT("Pipeline records", rrc == 0 && cnt > 0);
+
+  bgpstream_elem_destroy(check);
+  bgpstream_rpki_pipeline_destroy(pipeline);
+  for (i = 0; i < PIPELINE_WORKERS; i++) {
+    bgpstream_rpki_destroy_cfg(cfgs[i]);
+  }
+  bgpstream_rpki_destroy_cfg(cfg);
+  bgpstream_rpki_destroy_input(input);
+  bgpstream_destroy(bs);
+  return 0;
+}
 #endif // WITH_RPKI
 
 int main()
@@ -167,6 +301,8 @@ int main()
   CHECK_RPKI_SECTION("RPKI Input", !test_rpki_create_input());
   CHECK_RPKI_SECTION("RPKI Parsing", !test_rpki_parse_input());
   CHECK_RPKI_SECTION("RPKI Validation", !test_rpki_validate());
+  CHECK_RPKI_SECTION("RPKI Cache", !test_rpki_cache());
+  CHECK_RPKI_SECTION("RPKI Pipeline", !test_rpki_pipeline());
 #else
   SKIPPED_SECTION("RPKI");
 #endif
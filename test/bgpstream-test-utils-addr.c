@@ -233,10 +233,138 @@ static int test_addresses_ipv6()
   return 0;
 }
 
+#define SET_ADDR_CNT 50000
+
+static int test_address_sets()
+{
+  bgpstream_ip_addr_set_t *set, *other;
+  bgpstream_ipv6_addr_set_t *set6;
+  bgpstream_ip_addr_t addr;
+  uint32_t i, a;
+  int ok = 1;
+
+  set = bgpstream_ip_addr_set_create();
+  other = bgpstream_ip_addr_set_create();
+  set6 = bgpstream_ipv6_addr_set_create();
+
+  /* distinct v4 and v6 addresses that share their low 32 bits */
+  for (i = 0; i < SET_ADDR_CNT; i++) {
+    memset(&addr, 0, sizeof(addr));
+    a = htonl(i * 2654435761U);
+    if (i % 2 == 0) {
+      addr.version = BGPSTREAM_ADDR_VERSION_IPV4;
+      addr.bs_ipv4.addr.s_addr = a;
+    } else {
+      addr.version = BGPSTREAM_ADDR_VERSION_IPV6;
+      memcpy(&addr.bs_ipv6.addr.s6_addr[12], &a, sizeof(a));
+      if (bgpstream_ipv6_addr_set_insert(set6, &addr.bs_ipv6) != 1) {
+        ok = 0;
+      }
+    }
+    if (bgpstream_ip_addr_set_insert(set, &addr) != 1 ||
+        bgpstream_ip_addr_set_insert(set, &addr) != 0 ||
+        bgpstream_ip_addr_set_insert(other, &addr) != 1) {
+      ok = 0;
+    }
+  }
+  CHECK("address set insert",
+        ok && bgpstream_ip_addr_set_size(set) == SET_ADDR_CNT &&
+          bgpstream_ipv6_addr_set_size(set6) == SET_ADDR_CNT / 2);
+
+  CHECK("address set merge",
+        bgpstream_ip_addr_set_merge(set, other) == 0 &&
+          bgpstream_ip_addr_set_size(set) == SET_ADDR_CNT);
+
+  bgpstream_ip_addr_set_clear(set);
+  CHECK("address set clear",
+        bgpstream_ip_addr_set_size(set) == 0 &&
+          bgpstream_ip_addr_set_insert(set, &addr) == 1);
+
+  bgpstream_ip_addr_set_destroy(set);
+  bgpstream_ip_addr_set_destroy(other);
+  bgpstream_ipv6_addr_set_destroy(set6);
+  return 0;
+}
+
+#define TEXT_ADDR_CNT 100000
+
+/* strings that exercise the corner cases of inet_pton */
+static const char *text_addrs[] = {
+  "0.0.0.0", "255.255.255.255", "1.2.3.4", "01.2.3.4", "1.2.3", "1.2.3.4.5",
+  "256.1.1.1", "1..2.3", "1.2.3.", ".1.2.3", "1.2.3.4 ", "", "::", "::1",
+  "1::", ":", ":::", "1:::2", "::ffff:1.2.3.4", "::1.2.3.4", "1:2:3:4:5:6:7:8",
+  "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8", "1:2:3:4:5:6:7:",
+  ":1:2:3:4:5:6:7", "12345::", "fFfF::AbCd", "0000:0000::0001",
+  "1:2:3:4:5:6:1.2.3.4", "1:2:3:4:5:6:7:1.2.3.4", "::1.2.3", "g::",
+  "1::2::3", "2001:db8::1/32", NULL};
+
+static int test_addresses_text()
+{
+  bgpstream_ip_addr_t addr, back;
+  struct in6_addr ref6;
+  struct in_addr ref4;
+  char ref[INET6_ADDRSTRLEN];
+  char buf[INET6_ADDRSTRLEN];
+  uint32_t x = 1;
+  int i, j, ok_ntop = 1, ok_pton = 1, ok_parse = 1;
+  const char **str;
+
+  for (i = 0; i < TEXT_ADDR_CNT; i++) {
+    memset(&addr, 0, sizeof(addr));
+    addr.version = BGPSTREAM_ADDR_VERSION_IPV6;
+    /* mostly-zero words, to exercise "::" shortening and embedded IPv4 */
+    for (j = 0; j < 16; j += 2) {
+      x = x * 1103515245 + 12345;
+      if ((x >> 16) % 3 != 0) {
+        addr.bs_ipv6.addr.s6_addr[j] = (x >> 24) & ((x & 0x100) ? 0xff : 0);
+        addr.bs_ipv6.addr.s6_addr[j + 1] = (x >> 8);
+      }
+    }
+    if (i % 7 == 0) {
+      memset(&addr.bs_ipv6.addr, 0, 10);
+      addr.bs_ipv6.addr.s6_addr[10] = addr.bs_ipv6.addr.s6_addr[11] = 0xff;
+    }
+    if (i % 2 == 1) {
+      addr.version = BGPSTREAM_ADDR_VERSION_IPV4;
+      addr.bs_ipv4.addr.s_addr = x ^ (x << 13);
+    }
+    inet_ntop(addr.version, &addr.bs_ipv4.addr, ref, sizeof(ref));
+    if (bgpstream_addr_ntop_len(buf, sizeof(buf), &addr) != strlen(ref) ||
+        strcmp(buf, ref) != 0) {
+      ok_ntop = 0;
+    }
+    if (bgpstream_str2addr(buf, &back) == NULL ||
+        !bgpstream_addr_equal(&back, &addr)) {
+      ok_parse = 0;
+    }
+  }
+  CHECK("address to string (same as inet_ntop)", ok_ntop);
+  CHECK("address from string (round trip)", ok_parse);
+
+  for (str = text_addrs; *str != NULL; str++) {
+    if (inet_pton(AF_INET, *str, &ref4) == 1) {
+      ok_pton = ok_pton && bgpstream_str2addr(*str, &addr) != NULL &&
+                addr.version == BGPSTREAM_ADDR_VERSION_IPV4 &&
+                addr.bs_ipv4.addr.s_addr == ref4.s_addr;
+    } else if (inet_pton(AF_INET6, *str, &ref6) == 1) {
+      ok_pton = ok_pton && bgpstream_str2addr(*str, &addr) != NULL &&
+                addr.version == BGPSTREAM_ADDR_VERSION_IPV6 &&
+                memcmp(&addr.bs_ipv6.addr, &ref6, 16) == 0;
+    } else {
+      ok_pton = ok_pton && bgpstream_str2addr(*str, &addr) == NULL;
+    }
+  }
+  CHECK("address from string (same as inet_pton)", ok_pton);
+
+  return 0;
+}
+
 int main()
 {
   CHECK_SECTION("IPv4 addresses", test_addresses_ipv4() == 0);
   CHECK_SECTION("IPv6 addresses", test_addresses_ipv6() == 0);
+  CHECK_SECTION("Address text conversion", test_addresses_text() == 0);
+  CHECK_SECTION("Address sets", test_address_sets() == 0);
   ENDTEST;
   return 0;
 }
@@ -27,6 +27,7 @@
 #include "bgpstream_test.h"
 #include "bgpstream_utils_as_path_int.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,6 +47,187 @@ static struct {
   { 0,                                0, { 0 },              NULL },
 };
 
+#define STORE_SNAPSHOT "bgpstream-test-as-path-store.snapshot"
+
+static int test_as_path_store(bgpstream_as_path_t *path)
+{
+  bgpstream_as_path_store_t *store;
+  bgpstream_as_path_store_path_id_t id1, id2, id;
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_t *p, *copy;
+  uint32_t asns[3];
+  int i, ok = 1;
+
+  CHECK("as_path_store create", (store = bgpstream_as_path_store_create()));
+
+  /* the path starts with ASN 11, so it is stored as a core path for peer 11 */
+  CHECK("as_path_store get_path_id",
+        bgpstream_as_path_store_get_path_id(store, path, 11, &id1) == 0 &&
+          bgpstream_as_path_store_get_path_id(store, path, 11, &id2) == 0 &&
+          id1.path_idx == id2.path_idx &&
+          bgpstream_as_path_store_get_size(store) == 1);
+  spath = bgpstream_as_path_store_get_store_path(store, id1);
+  CHECK("as_path_store core path",
+        spath && bgpstream_as_path_store_path_is_core(spath));
+  copy = bgpstream_as_path_store_path_get_path(spath, 11);
+  CHECK("as_path_store path roundtrip",
+        copy && bgpstream_as_path_equal(copy, path));
+  bgpstream_as_path_destroy(copy);
+
+  /* many distinct paths with the same peer and origin used to collide */
+  p = bgpstream_as_path_create();
+  for (i = 0; i < 100000; i++) {
+    asns[0] = 1;
+    asns[1] = i;
+    asns[2] = 2;
+    bgpstream_as_path_clear(p);
+    bgpstream_as_path_append(p, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+    if (bgpstream_as_path_store_get_path_id(store, p, 0, &id) != 0 ||
+        id.path_idx != (uint32_t)i + 1) {
+      ok = 0;
+    }
+  }
+  CHECK("as_path_store insert distinct",
+        ok && bgpstream_as_path_store_get_size(store) == 100001);
+
+  asns[1] = 4242;
+  bgpstream_as_path_clear(p);
+  bgpstream_as_path_append(p, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+  CHECK("as_path_store stable id",
+        bgpstream_as_path_store_get_path_id(store, p, 0, &id) == 0 &&
+          id.path_idx == 4243 &&
+          bgpstream_as_path_store_get_path_id(store, path, 11, &id2) == 0 &&
+          id2.path_idx == id1.path_idx);
+  bgpstream_as_path_destroy(p);
+
+  i = 0;
+  bgpstream_as_path_store_iter_first_path(store);
+  while (bgpstream_as_path_store_iter_has_more_path(store)) {
+    spath = bgpstream_as_path_store_iter_get_path(store);
+    if (bgpstream_as_path_store_path_get_idx(spath) != (uint32_t)i++) {
+      ok = 0;
+    }
+    bgpstream_as_path_store_iter_next_path(store);
+  }
+  CHECK("as_path_store iterate", ok && i == 100001);
+
+  CHECK("as_path_store save",
+        bgpstream_as_path_store_save(store, STORE_SNAPSHOT) == 0);
+  bgpstream_as_path_store_destroy(store);
+
+  CHECK("as_path_store load",
+        (store = bgpstream_as_path_store_load(STORE_SNAPSHOT)) != NULL &&
+          bgpstream_as_path_store_get_size(store) == 100001);
+  remove(STORE_SNAPSHOT);
+
+  p = bgpstream_as_path_create();
+  asns[1] = 4242;
+  bgpstream_as_path_append(p, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+  CHECK("as_path_store snapshot ids",
+        bgpstream_as_path_store_get_path_id(store, p, 0, &id) == 0 &&
+          id.path_idx == 4243 &&
+          bgpstream_as_path_store_get_path_id(store, path, 11, &id2) == 0 &&
+          id2.path_idx == id1.path_idx);
+  spath = bgpstream_as_path_store_get_store_path(store, id1);
+  copy = bgpstream_as_path_store_path_get_path(spath, 11);
+  CHECK("as_path_store snapshot path",
+        spath && bgpstream_as_path_store_path_is_core(spath) && copy &&
+          bgpstream_as_path_equal(copy, path));
+  bgpstream_as_path_destroy(copy);
+
+  asns[1] = 200000;
+  bgpstream_as_path_clear(p);
+  bgpstream_as_path_append(p, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+  CHECK("as_path_store snapshot read-only",
+        bgpstream_as_path_store_get_path_id(store, p, 0, &id) != 0);
+  bgpstream_as_path_destroy(p);
+
+  bgpstream_as_path_store_destroy(store);
+  return 0;
+}
+
+#define STORE_THREADS 4
+#define STORE_THREAD_PATHS 50000
+
+typedef struct store_thread {
+  bgpstream_as_path_store_t *store;
+  int offset;
+  uint32_t *ids;
+  int failed;
+} store_thread_t;
+
+/* each thread inserts the same paths, starting at a different offset */
+static void *store_thread_run(void *arg)
+{
+  store_thread_t *t = arg;
+  bgpstream_as_path_t *p = bgpstream_as_path_create();
+  bgpstream_as_path_store_path_id_t id;
+  uint32_t asns[3] = {1, 0, 2};
+  int i, n;
+
+  for (i = 0; i < STORE_THREAD_PATHS; i++) {
+    n = (i + t->offset) % STORE_THREAD_PATHS;
+    asns[1] = n;
+    bgpstream_as_path_clear(p);
+    bgpstream_as_path_append(p, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+    if (bgpstream_as_path_store_get_path_id(t->store, p, 0, &id) != 0) {
+      t->failed = 1;
+    }
+    t->ids[n] = id.path_idx;
+  }
+  bgpstream_as_path_destroy(p);
+  return NULL;
+}
+
+static int test_as_path_store_concurrent()
+{
+  bgpstream_as_path_store_t *store;
+  pthread_t threads[STORE_THREADS];
+  store_thread_t ts[STORE_THREADS];
+  bgpstream_as_path_store_path_id_t id;
+  bgpstream_as_path_seg_t *seg;
+  int i, j, ok = 1;
+
+  CHECK("as_path_store create concurrent",
+        (store = bgpstream_as_path_store_create_concurrent()));
+
+  for (i = 0; i < STORE_THREADS; i++) {
+    ts[i].store = store;
+    ts[i].offset = i * (STORE_THREAD_PATHS / STORE_THREADS);
+    ts[i].ids = malloc(sizeof(uint32_t) * STORE_THREAD_PATHS);
+    ts[i].failed = 0;
+    pthread_create(&threads[i], NULL, store_thread_run, &ts[i]);
+  }
+  for (i = 0; i < STORE_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    ok = ok && !ts[i].failed;
+  }
+  CHECK("as_path_store concurrent insert",
+        ok && bgpstream_as_path_store_get_size(store) == STORE_THREAD_PATHS);
+
+  /* every thread must have been given the same id for the same path */
+  for (j = 0; j < STORE_THREAD_PATHS; j++) {
+    for (i = 1; i < STORE_THREADS; i++) {
+      if (ts[i].ids[j] != ts[0].ids[j]) {
+        ok = 0;
+      }
+    }
+    id.path_idx = ts[0].ids[j];
+    seg = bgpstream_as_path_store_path_get_origin_seg(
+      bgpstream_as_path_store_get_store_path(store, id));
+    if (seg == NULL || seg->asn.asn != 2) {
+      ok = 0;
+    }
+  }
+  CHECK("as_path_store concurrent ids", ok);
+
+  for (i = 0; i < STORE_THREADS; i++) {
+    free(ts[i].ids);
+  }
+  bgpstream_as_path_store_destroy(store);
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
   int test_cnt = 0;
@@ -84,6 +266,10 @@ int main(int argc, char *argv[])
 
   CHECK("as_path len", bgpstream_as_path_get_len(path1) == test_cnt);
 
+  CHECK_SECTION("as_path_store", test_as_path_store(path1) == 0);
+  CHECK_SECTION("as_path_store concurrent",
+                test_as_path_store_concurrent() == 0);
+
   ENDTEST;
   return 0;
 }
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEXT_RAND(x) ((x) = (x)*1103515245 + 12345)
+
+#define COMMS_MAX 200
+
+/* reference implementation of bgpstream_community_set_match */
+static int ref_match(const bgpstream_community_t *comms, int cnt,
+                     const bgpstream_community_t *com, uint8_t mask)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    if ((!(mask & BGPSTREAM_COMMUNITY_FILTER_ASN) ||
+         comms[i].asn == com->asn) &&
+        (!(mask & BGPSTREAM_COMMUNITY_FILTER_VALUE) ||
+         comms[i].value == com->value)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* check the set against the reference for a mix of present and absent
+ * communities */
+static int check_set(const bgpstream_community_set_t *set,
+                     const bgpstream_community_t *comms, int cnt, uint32_t *x)
+{
+  bgpstream_community_t com;
+  uint8_t mask;
+  int i;
+
+  for (i = 0; i < 300; i++) {
+    if (cnt > 0 && i % 2 == 0) {
+      com = comms[NEXT_RAND(*x) % cnt];
+    } else {
+      com.asn = (NEXT_RAND(*x) >> 16) % 64;
+      com.value = (NEXT_RAND(*x) >> 16) % 64;
+    }
+    for (mask = 0; mask <= BGPSTREAM_COMMUNITY_FILTER_EXACT; mask++) {
+      if (bgpstream_community_set_match(set, &com, mask) !=
+          ref_match(comms, cnt, &com, mask)) {
+        return 0;
+      }
+    }
+    if (bgpstream_community_set_exists(set, &com) !=
+        ref_match(comms, cnt, &com, BGPSTREAM_COMMUNITY_FILTER_EXACT)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int test_community_set_lookup()
+{
+  bgpstream_community_set_t *set, *cpy;
+  bgpstream_community_t comms[COMMS_MAX + 1];
+  uint32_t x = 1;
+  int cnt, i, ok_insert = 1, ok_copy = 1, ok_array = 1, ok_zc = 1;
+
+  set = bgpstream_community_set_create();
+  cpy = bgpstream_community_set_create();
+
+  /* small ranges so that asn-only and value-only matches also hit */
+  for (i = 0; i < COMMS_MAX; i++) {
+    comms[i].asn = (NEXT_RAND(x) >> 16) % 64;
+    comms[i].value = (NEXT_RAND(x) >> 16) % 64;
+  }
+
+  /* grow one community at a time, across the linear scan threshold */
+  for (cnt = 0; cnt <= COMMS_MAX; cnt++) {
+    if (cnt > 0 && bgpstream_community_set_insert(set, &comms[cnt - 1]) != 0) {
+      ok_insert = 0;
+    }
+    if (!check_set(set, comms, cnt, &x)) {
+      ok_insert = 0;
+    }
+    if (cnt % 10 == 0) {
+      if (bgpstream_community_set_copy(cpy, set) != 0 ||
+          !bgpstream_community_set_equal(cpy, set) ||
+          !check_set(cpy, comms, cnt, &x)) {
+        ok_copy = 0;
+      }
+    }
+  }
+  CHECK("community set insert/match", ok_insert);
+  CHECK("community set copy", ok_copy);
+
+  /* insertion order is preserved */
+  for (i = 0; i < COMMS_MAX; i++) {
+    if (!bgpstream_community_equal(bgpstream_community_set_get(set, i),
+                                   &comms[i])) {
+      ok_insert = 0;
+    }
+  }
+  CHECK("community set order", ok_insert);
+
+  for (cnt = 0; cnt <= COMMS_MAX; cnt += 7) {
+    if (bgpstream_community_set_populate_from_array(set, comms, cnt) != 0 ||
+        !check_set(set, comms, cnt, &x)) {
+      ok_array = 0;
+    }
+    if (bgpstream_community_set_populate_from_array_zc(cpy, comms, cnt) != 0 ||
+        !check_set(cpy, comms, cnt, &x) ||
+        !bgpstream_community_set_equal(cpy, set)) {
+      ok_zc = 0;
+    }
+  }
+  CHECK("community set populate from array", ok_array);
+  CHECK("community set populate from array (zero-copy)", ok_zc);
+
+  /* inserting into a zero-copy set must not touch the caller's array */
+  comms[COMMS_MAX].asn = 65000;
+  comms[COMMS_MAX].value = 1;
+  bgpstream_community_set_populate_from_array_zc(cpy, comms, 20);
+  CHECK("community set insert (zero-copy)",
+        bgpstream_community_set_insert(cpy, &comms[COMMS_MAX]) == 0 &&
+          bgpstream_community_set_size(cpy) == 21 &&
+          bgpstream_community_set_exists(cpy, &comms[COMMS_MAX]) &&
+          !bgpstream_community_equal(&comms[20], &comms[COMMS_MAX]));
+
+  CHECK("community set not equal",
+        !bgpstream_community_set_equal(cpy, set));
+
+  bgpstream_community_set_clear(set);
+  CHECK("community set clear",
+        bgpstream_community_set_size(set) == 0 &&
+          !bgpstream_community_set_exists(set, &comms[0]));
+
+  bgpstream_community_set_destroy(set);
+  bgpstream_community_set_destroy(cpy);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Community set lookup", test_community_set_lookup() == 0);
+
+  ENDTEST;
+  return 0;
+}
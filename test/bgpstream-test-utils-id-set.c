@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* insert ids from a simple LCG, so that the sets cover several containers */
+#define NEXT_ID(x) ((x) = (x)*1103515245 + 12345)
+
+static int test_id_set_growth()
+{
+  bgpstream_id_set_t *set;
+  uint32_t x = 1, id, *p;
+  int i, ok = 1, cnt = 0;
+
+  set = bgpstream_id_set_create();
+
+  /* enough ids for the set to switch to containers, and for the dense
+   * 16-bit range to switch to a bitmap */
+  for (i = 0; i < 70000; i++) {
+    id = (i % 2 == 0) ? (uint32_t)(i / 2) : NEXT_ID(x);
+    if (bgpstream_id_set_insert(set, id) < 0) {
+      ok = 0;
+    }
+  }
+  CHECK("id set insert", ok);
+  CHECK("id set duplicate insert", bgpstream_id_set_insert(set, 17) == 0);
+
+  x = 1;
+  for (i = 0; i < 70000; i++) {
+    id = (i % 2 == 0) ? (uint32_t)(i / 2) : NEXT_ID(x);
+    if (bgpstream_id_set_exists(set, id) == 0) {
+      ok = 0;
+    }
+  }
+  CHECK("id set exists", ok);
+  CHECK("id set not exists", bgpstream_id_set_exists(set, 40000) == 0);
+
+  bgpstream_id_set_rewind(set);
+  while ((p = bgpstream_id_set_next(set)) != NULL) {
+    if (bgpstream_id_set_exists(set, *p) == 0) {
+      ok = 0;
+    }
+    cnt++;
+  }
+  CHECK("id set iterate", ok && cnt == bgpstream_id_set_size(set));
+
+  bgpstream_id_set_clear(set);
+  CHECK("id set clear", bgpstream_id_set_size(set) == 0 &&
+                          bgpstream_id_set_exists(set, 17) == 0);
+  CHECK("id set insert after clear",
+        bgpstream_id_set_insert(set, 17) == 1 &&
+          bgpstream_id_set_exists(set, 17) != 0 &&
+          bgpstream_id_set_size(set) == 1);
+
+  bgpstream_id_set_destroy(set);
+  return 0;
+}
+
+static int test_id_set_merge()
+{
+  bgpstream_id_set_t *a, *b, *small;
+  uint32_t id;
+  int ok = 1;
+
+  a = bgpstream_id_set_create();
+  b = bgpstream_id_set_create();
+  small = bgpstream_id_set_create();
+
+  /* a: even ids, b: multiples of 3, small: a few 32-bit ids */
+  for (id = 0; id < 20000; id += 2) {
+    bgpstream_id_set_insert(a, id);
+  }
+  for (id = 0; id < 20000; id += 3) {
+    bgpstream_id_set_insert(b, id);
+  }
+  bgpstream_id_set_insert(small, 1);
+  bgpstream_id_set_insert(small, 4200000000U);
+
+  CHECK("id set merge (containers)", bgpstream_id_set_merge(a, b) == 0);
+  CHECK("id set merge (hash)", bgpstream_id_set_merge(a, small) == 0);
+
+  for (id = 0; id < 20000; id++) {
+    if (bgpstream_id_set_exists(a, id) !=
+        (id % 2 == 0 || id % 3 == 0 || id == 1)) {
+      ok = 0;
+    }
+  }
+  CHECK("id set merge result",
+        ok && bgpstream_id_set_exists(a, 4200000000U) != 0 &&
+          bgpstream_id_set_size(a) == 10000 + 6667 - 3334 + 2);
+
+  bgpstream_id_set_destroy(a);
+  bgpstream_id_set_destroy(b);
+  bgpstream_id_set_destroy(small);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("ID set growth", test_id_set_growth() == 0);
+  CHECK_SECTION("ID set merge", test_id_set_merge() == 0);
+
+  ENDTEST;
+  return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *pfxs_v4[] = {
+  "10.0.0.0/24", "10.0.2.0/24", "10.0.1.0/24", "10.0.0.128/25",
+  "192.168.0.0/16", "192.168.10.0/24", "172.16.0.0/12", NULL,
+};
+
+static const char *pfxs_v6[] = {
+  "2001:db8::/48", "2001:db8:1::/48", "2001:db8::/64", "2001:db8::/65",
+  "2001:db8:8000::/33", NULL,
+};
+
+static int add_all(bgpstream_ip_counter_t *ipc, const char **strs)
+{
+  bgpstream_pfx_t pfx;
+  for (; *strs != NULL; strs++) {
+    if (bgpstream_str2pfx(*strs, &pfx) == NULL ||
+        bgpstream_ip_counter_add(ipc, &pfx) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int test_ip_counter_add()
+{
+  bgpstream_ip_counter_t *ipc;
+  bgpstream_pfx_t pfx;
+  uint8_t more_specific;
+
+  CHECK("ip counter create", (ipc = bgpstream_ip_counter_create()) != NULL);
+
+  CHECK("ip counter add", add_all(ipc, pfxs_v4) == 0 &&
+                            add_all(ipc, pfxs_v6) == 0);
+
+  /* 10.0.0.0/23 + 10.0.2.0/24, 192.168.0.0/16 and 172.16.0.0/12 */
+  CHECK("ip counter v4 count",
+        bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV4) ==
+          768 + 65536 + 1048576);
+  /* two /48s and a /33, in /64s */
+  CHECK("ip counter v6 count",
+        bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV6) ==
+          2 * 65536 + ((uint64_t)1 << 31));
+
+  bgpstream_str2pfx("10.0.0.0/22", &pfx);
+  CHECK("ip counter overlap (less specific)",
+        bgpstream_ip_counter_is_overlapping(ipc, &pfx, &more_specific) ==
+            768 &&
+          more_specific == 0);
+  bgpstream_str2pfx("192.168.10.128/25", &pfx);
+  CHECK("ip counter overlap (more specific)",
+        bgpstream_ip_counter_is_overlapping(ipc, &pfx, &more_specific) ==
+            128 &&
+          more_specific == 1);
+  bgpstream_str2pfx("8.8.8.0/24", &pfx);
+  CHECK("ip counter overlap (none)",
+        bgpstream_ip_counter_is_overlapping(ipc, &pfx, &more_specific) == 0);
+  bgpstream_str2pfx("2001:db8::/32", &pfx);
+  CHECK("ip counter v6 overlap",
+        bgpstream_ip_counter_is_overlapping(ipc, &pfx, &more_specific) ==
+          2 * 65536 + ((uint64_t)1 << 31));
+
+  bgpstream_ip_counter_clear(ipc);
+  CHECK("ip counter clear",
+        bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV4) ==
+            0 &&
+          bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            0);
+
+  bgpstream_ip_counter_destroy(ipc);
+  return 0;
+}
+
+static int test_ip_counter_bulk()
+{
+  bgpstream_ip_counter_t *one, *bulk;
+  bgpstream_pfx_t *pfxs;
+  uint32_t x = 1;
+  int i, cnt = 50000;
+  int ok = 1;
+  uint8_t ms1, ms2;
+
+  one = bgpstream_ip_counter_create();
+  bulk = bgpstream_ip_counter_create();
+  pfxs = malloc(sizeof(bgpstream_pfx_t) * cnt);
+
+  for (i = 0; i < cnt; i++) {
+    x = x * 1103515245 + 12345;
+    memset(&pfxs[i], 0, sizeof(bgpstream_pfx_t));
+    pfxs[i].address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+    pfxs[i].address.bs_ipv4.addr.s_addr = htonl(x);
+    pfxs[i].mask_len = 16 + (x >> 28);
+    bgpstream_ip_counter_add(one, &pfxs[i]);
+  }
+
+  CHECK("ip counter bulk add",
+        bgpstream_ip_counter_add_bulk(bulk, pfxs, cnt) == 0);
+  CHECK("ip counter bulk count",
+        bgpstream_ip_counter_get_ipcount(bulk, BGPSTREAM_ADDR_VERSION_IPV4) ==
+          bgpstream_ip_counter_get_ipcount(one, BGPSTREAM_ADDR_VERSION_IPV4));
+
+  for (i = 0; i < cnt; i += 97) {
+    if (bgpstream_ip_counter_is_overlapping(one, &pfxs[i], &ms1) !=
+          bgpstream_ip_counter_is_overlapping(bulk, &pfxs[i], &ms2) ||
+        ms1 != ms2) {
+      ok = 0;
+    }
+  }
+  CHECK("ip counter bulk overlap", ok);
+
+  free(pfxs);
+  bgpstream_ip_counter_destroy(one);
+  bgpstream_ip_counter_destroy(bulk);
+  return 0;
+}
+
+static int test_ip_counter_merge()
+{
+  bgpstream_ip_counter_t *a, *b;
+  bgpstream_pfx_t pfx;
+  static const char *pfxs_a[] = {"10.0.0.0/24", "10.0.4.0/22",
+                                 "2001:db8::/65", NULL};
+  static const char *pfxs_b[] = {"10.0.0.128/25", "10.0.6.0/23",
+                                 "10.1.0.0/16", "2001:db8:0:0:8000::/65",
+                                 NULL};
+
+  a = bgpstream_ip_counter_create();
+  b = bgpstream_ip_counter_create();
+  add_all(a, pfxs_a);
+  add_all(b, pfxs_b);
+
+  /* 10.0.0.128/25 and 10.0.6.0/23 */
+  CHECK("ip counter v4 overlap",
+        bgpstream_ip_counter_overlap(a, b, BGPSTREAM_ADDR_VERSION_IPV4) ==
+          128 + 512);
+  CHECK("ip counter v6 overlap (disjoint halves)",
+        bgpstream_ip_counter_overlap(a, b, BGPSTREAM_ADDR_VERSION_IPV6) == 0);
+
+  CHECK("ip counter merge", bgpstream_ip_counter_merge(a, b) == 0);
+  CHECK("ip counter merge v4 count",
+        bgpstream_ip_counter_get_ipcount(a, BGPSTREAM_ADDR_VERSION_IPV4) ==
+          256 + 1024 + 65536);
+  CHECK("ip counter merge v6 count",
+        bgpstream_ip_counter_get_ipcount(a, BGPSTREAM_ADDR_VERSION_IPV6) == 1);
+
+  /* the merged counter now covers the whole /64 */
+  bgpstream_ip_counter_clear(b);
+  bgpstream_str2pfx("2001:db8::/64", &pfx);
+  bgpstream_ip_counter_add(b, &pfx);
+  CHECK("ip counter v6 overlap after merge",
+        bgpstream_ip_counter_overlap(a, b, BGPSTREAM_ADDR_VERSION_IPV6) == 1);
+
+  bgpstream_ip_counter_destroy(a);
+  bgpstream_ip_counter_destroy(b);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("IP counter add", test_ip_counter_add() == 0);
+  CHECK_SECTION("IP counter bulk add", test_ip_counter_bulk() == 0);
+  CHECK_SECTION("IP counter merge", test_ip_counter_merge() == 0);
+
+  ENDTEST;
+  return 0;
+}
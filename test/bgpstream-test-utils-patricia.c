@@ -25,10 +25,12 @@
  */
 
 #include "bgpstream_test.h"
+#include "bgpstream_utils_mem_int.h"
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -171,9 +173,364 @@ static int test_patricia()
   return 0;
 }
 
+#define BULK_PFX_CNT 20000
+
+static int test_patricia_bulk()
+{
+  bgpstream_patricia_tree_t *bulk, *single, *merged;
+  bgpstream_pfx_t *pfxs;
+  char buf[64];
+  uint32_t x = 1;
+  int i, ok = 1;
+
+  pfxs = malloc(sizeof(bgpstream_pfx_t) * BULK_PFX_CNT);
+  for (i = 0; i < BULK_PFX_CNT; i++) {
+    x = x * 1103515245 + 12345;
+    if (i % 4 == 0) {
+      snprintf(buf, sizeof(buf), "2001:%x:%x::/%d", (x >> 16) & 0xff,
+               x & 0xffff, 32 + (x >> 24) % 33);
+    } else {
+      snprintf(buf, sizeof(buf), "%d.%d.%d.0/%d", (x >> 24) % 16,
+               (x >> 16) & 0xff, (x >> 8) & 0xff, 8 + x % 17);
+    }
+    bgpstream_str2pfx(buf, &pfxs[i]);
+    /* mask the address, as a RIB would */
+    bgpstream_addr_mask(&pfxs[i].address, pfxs[i].mask_len);
+  }
+
+  single = bgpstream_patricia_tree_create(NULL);
+  for (i = 0; i < BULK_PFX_CNT; i++) {
+    bgpstream_patricia_tree_insert(single, &pfxs[i]);
+  }
+
+  bulk = bgpstream_patricia_tree_create(NULL);
+  CHECK("Patricia Tree bulk insert",
+        bgpstream_patricia_tree_insert_bulk(bulk, pfxs, BULK_PFX_CNT) == 0);
+
+  merged = bgpstream_patricia_tree_create(NULL);
+  bgpstream_patricia_tree_insert_bulk(merged, pfxs, BULK_PFX_CNT / 2);
+  bgpstream_patricia_tree_merge(merged, single);
+
+  for (i = 0; i < BULK_PFX_CNT; i++) {
+    if (bgpstream_patricia_tree_search_exact(bulk, &pfxs[i]) == NULL ||
+        bgpstream_patricia_tree_search_exact(merged, &pfxs[i]) == NULL) {
+      ok = 0;
+    }
+  }
+  CHECK("Patricia Tree bulk insert search exact", ok);
+  CHECK("Patricia Tree bulk insert counts",
+        BPT_pfx_count(bulk, BGPSTREAM_ADDR_VERSION_IPV4) ==
+            BPT_pfx_count(single, BGPSTREAM_ADDR_VERSION_IPV4) &&
+          BPT_pfx_count(bulk, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            BPT_pfx_count(single, BGPSTREAM_ADDR_VERSION_IPV6) &&
+          bgpstream_patricia_tree_count_24subnets(bulk) ==
+            bgpstream_patricia_tree_count_24subnets(single));
+  CHECK("Patricia Tree merge counts",
+        BPT_pfx_count(merged, BGPSTREAM_ADDR_VERSION_IPV4) ==
+            BPT_pfx_count(single, BGPSTREAM_ADDR_VERSION_IPV4) &&
+          BPT_pfx_count(merged, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            BPT_pfx_count(single, BGPSTREAM_ADDR_VERSION_IPV6));
+
+  bgpstream_patricia_tree_destroy(bulk);
+  bgpstream_patricia_tree_destroy(single);
+  bgpstream_patricia_tree_destroy(merged);
+  free(pfxs);
+  return 0;
+}
+
+#define LPM_PFX_CNT 3000
+#define LPM_ADDR_CNT 3000
+
+static int test_lpm()
+{
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_patricia_node_t *node;
+  bgpstream_lpm_t *lpm;
+  bgpstream_pfx_t *pfxs, host;
+  bgpstream_ipv4_addr_t *addrs4;
+  const bgpstream_pfx_t **batch, *best, *found;
+  long user;
+  uint8_t *hbytes;
+  char buf[64];
+  uint32_t x = 7;
+  int i, j, ok = 1, batch_ok = 1, users_ok = 1, v4_cnt = 0;
+
+  pfxs = malloc(sizeof(bgpstream_pfx_t) * LPM_PFX_CNT);
+  addrs4 = malloc(sizeof(bgpstream_ipv4_addr_t) * LPM_ADDR_CNT);
+  batch = malloc(sizeof(bgpstream_pfx_t *) * LPM_ADDR_CNT);
+
+  pt = bgpstream_patricia_tree_create(NULL);
+  for (i = 0; i < LPM_PFX_CNT; i++) {
+    x = x * 1103515245 + 12345;
+    /* few distinct leading bits, so that prefixes nest */
+    if (i % 3 == 0) {
+      snprintf(buf, sizeof(buf), "2001:%x:%x::/%d", (x >> 20) & 0x3,
+               x & 0xffff, 8 + (x >> 24) % 57);
+    } else {
+      snprintf(buf, sizeof(buf), "10.%d.%d.%d/%d", (x >> 24) & 0x3,
+               (x >> 16) & 0xff, (x >> 8) & 0xff, 1 + x % 32);
+    }
+    bgpstream_str2pfx(buf, &pfxs[i]);
+    bgpstream_addr_mask(&pfxs[i].address, pfxs[i].mask_len);
+    node = bgpstream_patricia_tree_insert(pt, &pfxs[i]);
+    bgpstream_patricia_tree_set_user(pt, node, (void *)(long)(i + 1));
+  }
+
+  CHECK("LPM table create", (lpm = bgpstream_lpm_create(pt)) != NULL);
+  CHECK("LPM table size",
+        bgpstream_lpm_size(lpm) ==
+          BPT_pfx_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) +
+            BPT_pfx_count(pt, BGPSTREAM_ADDR_VERSION_IPV6));
+
+  /* look up addresses inside (and next to) the prefixes, and compare with a
+   * linear search for the longest match */
+  for (i = 0; i < LPM_ADDR_CNT; i++) {
+    x = x * 1103515245 + 12345;
+    bgpstream_pfx_copy(&host, &pfxs[i % LPM_PFX_CNT]);
+    hbytes = (uint8_t *)&host.address.addr;
+    hbytes[(x >> 8) % (host.address.version == BGPSTREAM_ADDR_VERSION_IPV4
+                         ? 4
+                         : 16)] ^= (uint8_t)x;
+    host.mask_len = host.address.version == BGPSTREAM_ADDR_VERSION_IPV4 ? 32
+                                                                        : 128;
+    best = NULL;
+    for (j = 0; j < LPM_PFX_CNT; j++) {
+      if (bgpstream_pfx_contains(&pfxs[j], &host) &&
+          (best == NULL || pfxs[j].mask_len > best->mask_len)) {
+        best = &pfxs[j];
+      }
+    }
+    found = bgpstream_lpm_lookup(lpm, &host.address, (void **)&user);
+    if ((best == NULL) != (found == NULL) ||
+        (best != NULL && !bgpstream_pfx_equal(best, found))) {
+      ok = 0;
+    }
+    if (found != NULL &&
+        (user != (long)bgpstream_lpm_get_user(lpm, found) ||
+         !bgpstream_pfx_equal(&pfxs[user - 1], found))) {
+      users_ok = 0;
+    }
+    if (host.address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      bgpstream_addr_copy((bgpstream_ip_addr_t *)&addrs4[v4_cnt],
+                          &host.address);
+      batch[v4_cnt++] = found;
+    }
+  }
+  CHECK("LPM table lookup", ok);
+  CHECK("LPM table user pointers", users_ok);
+
+  /* the batch results must be those of the single lookups */
+  for (i = 0; i < v4_cnt; i++) {
+    found = batch[i];
+    bgpstream_lpm_lookup_ipv4_batch(lpm, &addrs4[i], 1, &batch[i]);
+    if (batch[i] != found) {
+      batch_ok = 0;
+    }
+  }
+  bgpstream_lpm_lookup_ipv4_batch(lpm, addrs4, v4_cnt, batch);
+  for (i = 0; i < v4_cnt; i++) {
+    if (batch[i] != bgpstream_lpm_lookup(lpm,
+                                         (bgpstream_ip_addr_t *)&addrs4[i],
+                                         NULL)) {
+      batch_ok = 0;
+    }
+  }
+  CHECK("LPM table batch lookup", batch_ok);
+
+  bgpstream_lpm_destroy(lpm);
+  bgpstream_patricia_tree_destroy(pt);
+  free(pfxs);
+  free(addrs4);
+  free(batch);
+  return 0;
+}
+
+#define RCU_READERS 4
+#define RCU_PUBLISHES 200
+
+static int rcu_done;
+
+/* each snapshot k holds 10.0.0.0/24 .. 10.0.k.0/24, and the user pointer of
+ * 10.0.0.0/24 is k: readers check that those always agree */
+static void *rcu_reader(void *arg)
+{
+  bgpstream_patricia_rcu_reader_t *reader;
+  const bgpstream_patricia_tree_t *pt;
+  const bgpstream_patricia_node_t *node;
+  bgpstream_pfx_t pfx;
+  long k;
+  int ok = 1;
+
+  reader = bgpstream_patricia_rcu_reader_register(arg);
+  bgpstream_str2pfx("10.0.0.0/24", &pfx);
+  while (!__atomic_load_n(&rcu_done, __ATOMIC_SEQ_CST)) {
+    pt = bgpstream_patricia_rcu_read_lock(reader);
+    if ((node = bgpstream_patricia_tree_search_exact_const(pt, &pfx)) != NULL) {
+      k = (long)bgpstream_patricia_tree_get_user(
+        bgpstream_nonconst_node(node));
+      if (BPT_pfx_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) != (uint64_t)k + 1) {
+        ok = 0;
+      }
+    }
+    bgpstream_patricia_rcu_read_unlock(reader);
+  }
+  bgpstream_patricia_rcu_reader_unregister(reader);
+  return ok ? arg : NULL;
+}
+
+static int test_patricia_rcu()
+{
+  bgpstream_patricia_rcu_t *rcu;
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_patricia_node_t *first;
+  pthread_t readers[RCU_READERS];
+  bgpstream_pfx_t pfx;
+  void *ret;
+  char buf[64];
+  int i, ok = 1;
+
+  CHECK("Patricia Tree snapshot create",
+        (rcu = bgpstream_patricia_rcu_create(RCU_READERS)) != NULL);
+  pt = bgpstream_patricia_tree_create(NULL);
+  bgpstream_str2pfx("10.0.0.0/24", &pfx);
+  first = bgpstream_patricia_tree_insert(pt, &pfx);
+
+  for (i = 0; i < RCU_READERS; i++) {
+    pthread_create(&readers[i], NULL, rcu_reader, rcu);
+  }
+  for (i = 0; i < RCU_PUBLISHES; i++) {
+    snprintf(buf, sizeof(buf), "10.0.%d.0/24", i);
+    bgpstream_patricia_tree_insert(pt, bgpstream_str2pfx(buf, &pfx));
+    bgpstream_patricia_tree_set_user(pt, first, (void *)(long)i);
+    if (bgpstream_patricia_rcu_publish(rcu, pt) != 0) {
+      ok = 0;
+    }
+  }
+  __atomic_store_n(&rcu_done, 1, __ATOMIC_SEQ_CST);
+  for (i = 0; i < RCU_READERS; i++) {
+    pthread_join(readers[i], &ret);
+    if (ret == NULL) {
+      ok = 0;
+    }
+  }
+  CHECK("Patricia Tree snapshot readers", ok);
+
+  bgpstream_patricia_rcu_destroy(rcu);
+  bgpstream_patricia_tree_destroy(pt);
+  return 0;
+}
+
+static int test_patricia_mem()
+{
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_mem_usage_t before, during, after;
+  bgpstream_pfx_t pfx;
+  char buf[64];
+  int i;
+
+  bgpstream_mem_set_accounting(1);
+  bgpstream_mem_get_usage(&before);
+
+  pt = bgpstream_patricia_tree_create(NULL);
+  for (i = 0; i < IPV4_TEST_24_CNT * 4; i++) {
+    snprintf(buf, sizeof(buf), "10.%d.%d.0/24", i >> 8, i & 0xff);
+    bgpstream_str2pfx(buf, &pfx);
+    bgpstream_patricia_tree_insert(pt, &pfx);
+  }
+  bgpstream_mem_get_usage(&during);
+  bgpstream_patricia_tree_destroy(pt);
+  bgpstream_mem_get_usage(&after);
+  bgpstream_mem_set_accounting(0);
+
+  CHECK("Memory accounting subsystem names",
+        strcmp(bgpstream_mem_subsys_name(BGPSTREAM_MEM_UTILS), "utils") == 0 &&
+          bgpstream_mem_subsys_name(_BGPSTREAM_MEM_SUBSYS_CNT) == NULL);
+  CHECK("Memory accounting of tree nodes",
+        during.current[BGPSTREAM_MEM_UTILS] >
+          before.current[BGPSTREAM_MEM_UTILS]);
+  CHECK("Memory accounting peak",
+        after.peak[BGPSTREAM_MEM_UTILS] >= during.current[BGPSTREAM_MEM_UTILS]);
+  CHECK("Memory accounting after destroy",
+        after.current[BGPSTREAM_MEM_UTILS] ==
+          before.current[BGPSTREAM_MEM_UTILS]);
+
+  return 0;
+}
+
+/* counts live allocations per subsystem (the later tests allocate from
+ * several threads) */
+static int alloc_live[_BGPSTREAM_MEM_SUBSYS_CNT];
+
+static void *count_alloc(void *user, bgpstream_mem_subsys_t subsys,
+                         size_t size)
+{
+  __atomic_add_fetch(&alloc_live[subsys], 1, __ATOMIC_RELAXED);
+  return malloc(size);
+}
+
+static void *count_realloc(void *user, bgpstream_mem_subsys_t subsys,
+                           void *ptr, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+static void count_free(void *user, bgpstream_mem_subsys_t subsys, void *ptr)
+{
+  __atomic_sub_fetch(&alloc_live[subsys], 1, __ATOMIC_RELAXED);
+  free(ptr);
+}
+
+static int test_patricia_allocator()
+{
+  bgpstream_allocator_t allocator = {count_alloc, count_realloc, count_free,
+                                     NULL};
+  bgpstream_allocator_t partial = {count_alloc, NULL, count_free, NULL};
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_pfx_t pfx;
+  char buf[64];
+  void *buffer;
+  int during;
+  int i;
+
+  CHECK("Allocator without realloc",
+        bgpstream_mem_set_allocator(&partial) == -1);
+  CHECK("Allocator set", bgpstream_mem_set_allocator(&allocator) == 0);
+  pt = bgpstream_patricia_tree_create(NULL);
+  for (i = 0; i < IPV4_TEST_24_CNT * 4; i++) {
+    snprintf(buf, sizeof(buf), "10.%d.%d.0/24", i >> 8, i & 0xff);
+    bgpstream_str2pfx(buf, &pfx);
+    bgpstream_patricia_tree_insert(pt, &pfx);
+  }
+  during = alloc_live[BGPSTREAM_MEM_UTILS];
+  bgpstream_patricia_tree_destroy(pt);
+
+  CHECK("Allocator subsystem names",
+        strcmp(bgpstream_mem_subsys_name(BGPSTREAM_MEM_ELEM), "elem") == 0);
+  CHECK("Allocator used for tree nodes", during > 0);
+  CHECK("Allocator frees everything it allocated",
+        alloc_live[BGPSTREAM_MEM_UTILS] == 0);
+
+  buffer = bgpstream_mem_malloc_buffer(BGPSTREAM_MEM_FORMAT, 4096);
+  CHECK("Allocator used for buffers",
+        buffer != NULL && alloc_live[BGPSTREAM_MEM_FORMAT] == 1);
+  bgpstream_mem_free_buffer(BGPSTREAM_MEM_FORMAT, buffer);
+  CHECK("Allocator frees buffers", alloc_live[BGPSTREAM_MEM_FORMAT] == 0);
+
+  CHECK("Allocator set again", bgpstream_mem_set_allocator(&allocator) == 0);
+  CHECK("Allocator fixed once used", bgpstream_mem_set_allocator(NULL) == -1);
+
+  return 0;
+}
+
 int main()
 {
+  // the allocator can only be set before anything is allocated
+  CHECK_SECTION("Patricia Tree allocator", test_patricia_allocator() == 0);
   CHECK_SECTION("Patricia Tree", test_patricia() == 0);
+  CHECK_SECTION("Patricia Tree bulk insert", test_patricia_bulk() == 0);
+  CHECK_SECTION("LPM table", test_lpm() == 0);
+  CHECK_SECTION("Patricia Tree snapshots", test_patricia_rcu() == 0);
+  CHECK_SECTION("Patricia Tree memory accounting", test_patricia_mem() == 0);
   ENDTEST;
   return 0;
 }
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PEERS_CNT 3000
+#define THREADS 4
+
+static const char *collectors[] = {"rrc00", "route-views2", "rrc06"};
+
+/* peer n is the IPv4 or IPv6 address n (alternating) on collector n % 3 */
+static void peer_make(int n, bgpstream_ip_addr_t *addr,
+                      const char **collector)
+{
+  memset(addr, 0, sizeof(*addr));
+  if (n % 2 == 0) {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    addr->bs_ipv4.addr.s_addr = htonl(0x0a000000 | n / 3);
+  } else {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    addr->bs_ipv6.addr.s6_addr[0] = 0x20;
+    addr->bs_ipv6.addr.s6_addr[1] = 0x01;
+    addr->bs_ipv6.addr.s6_addr[14] = (n / 3) >> 8;
+    addr->bs_ipv6.addr.s6_addr[15] = (n / 3) & 0xff;
+  }
+  *collector = collectors[n % 3];
+}
+
+static int test_peer_sig_map()
+{
+  bgpstream_peer_sig_map_t *map;
+  bgpstream_peer_sig_t *ps;
+  bgpstream_ip_addr_t addr;
+  const char *collector;
+  bgpstream_peer_id_t ids[PEERS_CNT];
+  int i, ok_insert = 1, ok_lookup = 1, ok_sig = 1;
+
+  CHECK("peer sig map create", (map = bgpstream_peer_sig_map_create()));
+
+  for (i = 0; i < PEERS_CNT; i++) {
+    peer_make(i, &addr, &collector);
+    if ((ids[i] = bgpstream_peer_sig_map_get_id(map, collector, &addr, i)) ==
+        0) {
+      ok_insert = 0;
+    }
+  }
+  CHECK("peer sig map insert",
+        ok_insert && bgpstream_peer_sig_map_get_size(map) == PEERS_CNT);
+
+  for (i = 0; i < PEERS_CNT; i++) {
+    peer_make(i, &addr, &collector);
+    /* the AS number is not part of the signature */
+    if (bgpstream_peer_sig_map_get_id(map, collector, &addr, 0) != ids[i]) {
+      ok_lookup = 0;
+    }
+    if ((ps = bgpstream_peer_sig_map_get_sig(map, ids[i])) == NULL ||
+        strcmp(ps->collector_str, collector) != 0 ||
+        !bgpstream_addr_equal(&ps->peer_ip_addr, &addr) ||
+        ps->peer_asnumber != (uint32_t)i) {
+      ok_sig = 0;
+    }
+  }
+  CHECK("peer sig map lookup",
+        ok_lookup && bgpstream_peer_sig_map_get_size(map) == PEERS_CNT);
+  CHECK("peer sig map get sig", ok_sig);
+
+  CHECK("peer sig map get sig (unknown id)",
+        bgpstream_peer_sig_map_get_sig(map, 0) == NULL &&
+          bgpstream_peer_sig_map_get_sig(map, PEERS_CNT + 1) == NULL);
+
+  bgpstream_peer_sig_map_clear(map);
+  peer_make(5, &addr, &collector);
+  CHECK("peer sig map clear",
+        bgpstream_peer_sig_map_get_size(map) == 0 &&
+          bgpstream_peer_sig_map_get_sig(map, ids[0]) == NULL &&
+          bgpstream_peer_sig_map_get_id(map, collector, &addr, 5) == 1 &&
+          bgpstream_peer_sig_map_get_size(map) == 1);
+
+  bgpstream_peer_sig_map_destroy(map);
+  return 0;
+}
+
+typedef struct map_thread {
+  bgpstream_peer_sig_map_t *map;
+  int offset;
+  bgpstream_peer_id_t ids[PEERS_CNT];
+  int failed;
+} map_thread_t;
+
+/* each thread looks up the same peers, starting at a different offset */
+static void *map_thread_run(void *arg)
+{
+  map_thread_t *t = arg;
+  bgpstream_ip_addr_t addr;
+  const char *collector;
+  int i, n;
+
+  for (i = 0; i < PEERS_CNT; i++) {
+    n = (i + t->offset) % PEERS_CNT;
+    peer_make(n, &addr, &collector);
+    if ((t->ids[n] = bgpstream_peer_sig_map_get_id(t->map, collector, &addr,
+                                                   n)) == 0 ||
+        bgpstream_peer_sig_map_get_sig(t->map, t->ids[n]) == NULL) {
+      t->failed = 1;
+    }
+  }
+  return NULL;
+}
+
+static int test_peer_sig_map_concurrent()
+{
+  bgpstream_peer_sig_map_t *map;
+  pthread_t threads[THREADS];
+  map_thread_t *ts;
+  bgpstream_peer_sig_t *ps;
+  bgpstream_ip_addr_t addr;
+  const char *collector;
+  int i, j, ok = 1;
+
+  CHECK("peer sig map create", (map = bgpstream_peer_sig_map_create()));
+  ts = malloc(sizeof(map_thread_t) * THREADS);
+
+  for (i = 0; i < THREADS; i++) {
+    ts[i].map = map;
+    ts[i].offset = i * (PEERS_CNT / THREADS);
+    ts[i].failed = 0;
+    pthread_create(&threads[i], NULL, map_thread_run, &ts[i]);
+  }
+  for (i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    ok = ok && !ts[i].failed;
+  }
+  CHECK("peer sig map concurrent insert",
+        ok && bgpstream_peer_sig_map_get_size(map) == PEERS_CNT);
+
+  /* every thread must have been given the same id for the same peer */
+  for (j = 0; j < PEERS_CNT; j++) {
+    for (i = 1; i < THREADS; i++) {
+      if (ts[i].ids[j] != ts[0].ids[j]) {
+        ok = 0;
+      }
+    }
+    peer_make(j, &addr, &collector);
+    if ((ps = bgpstream_peer_sig_map_get_sig(map, ts[0].ids[j])) == NULL ||
+        strcmp(ps->collector_str, collector) != 0 ||
+        !bgpstream_addr_equal(&ps->peer_ip_addr, &addr)) {
+      ok = 0;
+    }
+  }
+  CHECK("peer sig map concurrent ids", ok);
+
+  free(ts);
+  bgpstream_peer_sig_map_destroy(map);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Peer signature map", test_peer_sig_map() == 0);
+  CHECK_SECTION("Concurrent peer signature map",
+                test_peer_sig_map_concurrent() == 0);
+
+  ENDTEST;
+  return 0;
+}
@@ -118,6 +118,21 @@ static int test_prefixes_ipv6()
   CHECK_SNPRINTF("IPv6 prefix to string", IPV6_TEST_PFX_A, BUFFER_LEN,
     CHAR_P, bgpstream_pfx_snprintf(cs_buf, cs_len, &a));
 
+  /* malformed prefixes are rejected */
+  CHECK("IPv6 prefix from invalid string",
+        bgpstream_str2pfx("2001:db8::/129", &a_child) == NULL &&
+          bgpstream_str2pfx("2001:db8::/", &a_child) == NULL &&
+          bgpstream_str2pfx("2001:db8::/32x", &a_child) == NULL &&
+          bgpstream_str2pfx("2001:db8::", &a_child) == NULL &&
+          bgpstream_str2pfx("2001:db8:::/32", &a_child) == NULL &&
+          bgpstream_str2pfx("10.0.0.0/33", &a_child) == NULL);
+
+  /* the address is masked to the prefix length */
+  CHECK_SNPRINTF("IPv6 prefix from string (masked)", "2001:db8:8000::/33",
+    BUFFER_LEN, CHAR_P,
+    bgpstream_pfx_snprintf(cs_buf, cs_len,
+                           bgpstream_str2pfx("2001:DB8:ffff::1/33", &a_child)));
+
   /* STORAGE CHECKS */
 
   /* populate pfx b (storage) */
@@ -160,10 +175,115 @@ static int test_prefixes_ipv6()
   return 0;
 }
 
+/* the i-th of a sequence of distinct prefixes (v6 for odd i) */
+static void make_pfx(uint32_t i, bgpstream_pfx_t *pfx)
+{
+  memset(pfx, 0, sizeof(*pfx));
+  if (i % 2 == 0) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+    pfx->bs_ipv4.address.addr.s_addr = htonl((i / 2) * 2654435761U);
+    pfx->mask_len = 24 + (i / 2) % 9;
+  } else {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+    pfx->bs_ipv6.address.addr.s6_addr[0] = 0x20;
+    pfx->bs_ipv6.address.addr.s6_addr[1] = 0x01;
+    memcpy(&pfx->bs_ipv6.address.addr.s6_addr[12], &i, sizeof(i));
+    pfx->mask_len = 48 + (i / 2) % 81;
+  }
+}
+
+#define SET_PFX_CNT 100000
+
+static int test_prefix_sets()
+{
+  bgpstream_pfx_set_t *set, *other;
+  bgpstream_ipv4_pfx_set_t *set4;
+  bgpstream_ipv6_pfx_set_t *set6;
+  bgpstream_pfx_t pfx;
+  uint32_t i;
+  int ok_insert = 1, ok_exists = 1, ok_typed = 1;
+
+  set = bgpstream_pfx_set_create();
+  other = bgpstream_pfx_set_create();
+  set4 = bgpstream_ipv4_pfx_set_create();
+  set6 = bgpstream_ipv6_pfx_set_create();
+
+  for (i = 0; i < SET_PFX_CNT; i++) {
+    make_pfx(i, &pfx);
+    if (bgpstream_pfx_set_insert(set, &pfx) != 1 ||
+        bgpstream_pfx_set_insert(set, &pfx) != 0) {
+      ok_insert = 0;
+    }
+    if (pfx.address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      if (bgpstream_ipv4_pfx_set_insert(set4, &pfx.bs_ipv4) != 1) {
+        ok_typed = 0;
+      }
+    } else if (bgpstream_ipv6_pfx_set_insert(set6, &pfx.bs_ipv6) != 1) {
+      ok_typed = 0;
+    }
+  }
+  CHECK("prefix set insert",
+        ok_insert && bgpstream_pfx_set_size(set) == SET_PFX_CNT &&
+          bgpstream_pfx_set_version_size(set, BGPSTREAM_ADDR_VERSION_IPV4) ==
+            SET_PFX_CNT / 2 &&
+          bgpstream_pfx_set_version_size(set, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            SET_PFX_CNT / 2);
+
+  for (i = 0; i < SET_PFX_CNT * 2; i++) {
+    make_pfx(i, &pfx);
+    if (bgpstream_pfx_set_exists(set, &pfx) != (i < SET_PFX_CNT)) {
+      ok_exists = 0;
+    }
+    if (pfx.address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      if (bgpstream_ipv4_pfx_set_exists(set4, &pfx.bs_ipv4) !=
+          (i < SET_PFX_CNT)) {
+        ok_typed = 0;
+      }
+    } else if (bgpstream_ipv6_pfx_set_exists(set6, &pfx.bs_ipv6) !=
+               (i < SET_PFX_CNT)) {
+      ok_typed = 0;
+    }
+  }
+  CHECK("prefix set exists", ok_exists);
+  CHECK("prefix set (per version)",
+        ok_typed && bgpstream_ipv4_pfx_set_size(set4) == SET_PFX_CNT / 2 &&
+          bgpstream_ipv6_pfx_set_size(set6) == SET_PFX_CNT / 2);
+
+  /* prefixes that only differ by their mask length */
+  make_pfx(0, &pfx);
+  pfx.mask_len = 8;
+  CHECK("prefix set mask length", bgpstream_pfx_set_exists(set, &pfx) == 0);
+
+  /* other: the second half of the set, and as many new prefixes */
+  for (i = SET_PFX_CNT / 2; i < SET_PFX_CNT + SET_PFX_CNT / 2; i++) {
+    make_pfx(i, &pfx);
+    bgpstream_pfx_set_insert(other, &pfx);
+  }
+  CHECK("prefix set merge",
+        bgpstream_pfx_set_merge(set, other) == 0 &&
+          bgpstream_pfx_set_size(set) == SET_PFX_CNT + SET_PFX_CNT / 2);
+
+  bgpstream_pfx_set_clear(set);
+  make_pfx(1, &pfx);
+  CHECK("prefix set clear",
+        bgpstream_pfx_set_size(set) == 0 &&
+          bgpstream_pfx_set_exists(set, &pfx) == 0 &&
+          bgpstream_pfx_set_insert(set, &pfx) == 1 &&
+          bgpstream_pfx_set_version_size(set, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            1);
+
+  bgpstream_pfx_set_destroy(set);
+  bgpstream_pfx_set_destroy(other);
+  bgpstream_ipv4_pfx_set_destroy(set4);
+  bgpstream_ipv6_pfx_set_destroy(set6);
+  return 0;
+}
+
 int main()
 {
   CHECK_SECTION("IPv4 prefixes", test_prefixes_ipv4() == 0);
   CHECK_SECTION("IPv6 prefixes", test_prefixes_ipv6() == 0);
+  CHECK_SECTION("Prefix sets", test_prefix_sets() == 0);
 
   ENDTEST;
   return 0;
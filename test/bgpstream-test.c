@@ -28,6 +28,7 @@
 
 #include "utils.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <wandio.h>
@@ -85,10 +86,13 @@ static int test_bgpstream()
 }
 
 #ifdef WITH_DATA_INTERFACE_SINGLEFILE
-static int test_singlefile()
+static int test_singlefile_threads(int decompress_threads)
 {
   SETUP;
 
+  CHECK("set decompression threads",
+        bgpstream_set_decompress_threads(bs, decompress_threads) == 0);
+
   CHECK_SET_INTERFACE(singlefile);
 
   CHECK("get option (rib-file)",
@@ -110,6 +114,349 @@ static int test_singlefile()
   TEARDOWN;
   return 0;
 }
+
+static int test_singlefile()
+{
+  return test_singlefile_threads(0);
+}
+
+// the same records must be read when decompressing in parallel
+static int test_singlefile_pdecomp()
+{
+  return test_singlefile_threads(2);
+}
+
+// length of an MRT message (common header plus body) from its header
+#define MRT_MSG_LEN(buf)                                                       \
+  (12 + (((uint32_t)(buf)[8] << 24) | ((uint32_t)(buf)[9] << 16) |             \
+         ((uint32_t)(buf)[10] << 8) | (uint32_t)(buf)[11]))
+
+static int test_singlefile_raw()
+{
+  const uint8_t *raw;
+  size_t len;
+  int ret;
+  int counter = 0;
+  int raw_ok = 1;
+  int preamble_cnt = 0;
+  int preamble_ok = 1;
+
+  SETUP;
+
+  CHECK_SET_INTERFACE(singlefile);
+
+  CHECK("get option (rib-file)",
+        (option = bgpstream_get_data_interface_option_by_name(
+           bs, di_id, "rib-file")) != NULL);
+  CHECK("set option (rib-file)",
+        bgpstream_set_data_interface_option(
+          bs, option, "routeviews.route-views.jinx.ribs.1427846400.bz2") == 0);
+
+  bgpstream_set_keep_raw_records(bs, 1);
+
+  CHECK("stream start (raw records)", bgpstream_start(bs) == 0);
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    counter++;
+    // every record must hold exactly one complete MRT message
+    if (bgpstream_record_get_raw(rec, &raw, &len) != 1 || len < 12 ||
+        MRT_MSG_LEN(raw) != len) {
+      raw_ok = 0;
+    }
+    // and only the first carries the (TABLE_DUMP_V2) peer index table
+    if (bgpstream_record_get_raw_preamble(rec, &raw, &len) == 1) {
+      preamble_cnt++;
+      if (counter != 1 || len < 12 || MRT_MSG_LEN(raw) != len ||
+          raw[4] != 0 || raw[5] != 13 || raw[6] != 0 || raw[7] != 1) {
+        preamble_ok = 0;
+      }
+    }
+  }
+  CHECK("final return code (raw records)", ret == 0);
+  CHECK("read records (raw records)", counter > 0);
+  CHECK("raw record bytes", raw_ok);
+  CHECK("single peer index preamble", preamble_cnt == 1 && preamble_ok);
+
+  TEARDOWN;
+  return 0;
+}
+
+#define WORKERS 4
+#define WORKERS_MAX_PEERS 256
+#define WORKERS_STOP_AFTER 1000
+
+struct workers_peer {
+  bgpstream_ip_addr_t addr;
+  int worker;
+  uint32_t last_time;
+};
+
+struct workers_state {
+  pthread_mutex_t mutex;
+  struct workers_peer peers[WORKERS_MAX_PEERS];
+  int peers_cnt;
+  int elems[WORKERS];
+  int same_worker;
+  int in_order;
+  int stop_after;
+};
+
+static int workers_cb(int worker, bgpstream_record_t *record,
+                      bgpstream_elem_t *elem, void *user)
+{
+  struct workers_state *st = (struct workers_state *)user;
+  struct workers_peer *peer = NULL;
+  int i, stop = 0;
+
+  pthread_mutex_lock(&st->mutex);
+  st->elems[worker]++;
+  for (i = 0; i < st->peers_cnt; i++) {
+    if (bgpstream_addr_equal(&st->peers[i].addr, &elem->peer_ip)) {
+      peer = &st->peers[i];
+      break;
+    }
+  }
+  if (peer == NULL && st->peers_cnt < WORKERS_MAX_PEERS) {
+    peer = &st->peers[st->peers_cnt++];
+    bgpstream_addr_copy(&peer->addr, &elem->peer_ip);
+    peer->worker = worker;
+    peer->last_time = record->time_sec;
+  }
+  // every elem of a peer goes to the same worker, in stream order
+  if (peer != NULL) {
+    if (peer->worker != worker) {
+      st->same_worker = 0;
+    }
+    if (record->time_sec < peer->last_time) {
+      st->in_order = 0;
+    }
+    peer->last_time = record->time_sec;
+  }
+  if (st->stop_after > 0 && --st->stop_after == 0) {
+    stop = 1;
+  }
+  pthread_mutex_unlock(&st->mutex);
+
+  return stop;
+}
+
+static void setup_updates_stream()
+{
+  SETUP;
+  bgpstream_set_data_interface(
+    bs, bgpstream_get_data_interface_id_by_name(bs, "singlefile"));
+  option = bgpstream_get_data_interface_option_by_name(
+    bs, bgpstream_get_data_interface_id_by_name(bs, "singlefile"), "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+}
+
+static int test_singlefile_workers()
+{
+  struct workers_state st;
+  bgpstream_elem_t *elem;
+  int elem_cnt = 0;
+  int total = 0;
+  int i, ret;
+
+  // count the elems with a single consumer
+  setup_updates_stream();
+  CHECK("stream start (single consumer)", bgpstream_start(bs) == 0);
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    while (bgpstream_record_get_next_elem(rec, &elem) > 0) {
+      elem_cnt++;
+    }
+  }
+  CHECK("final return code (single consumer)", ret == 0);
+  TEARDOWN;
+
+  memset(&st, 0, sizeof(st));
+  pthread_mutex_init(&st.mutex, NULL);
+  st.same_worker = st.in_order = 1;
+
+  setup_updates_stream();
+  CHECK("stream start (workers)", bgpstream_start(bs) == 0);
+  CHECK("run workers",
+        bgpstream_run_workers(bs, WORKERS, BGPSTREAM_DISPATCH_PEER, workers_cb,
+                              &st) == 0);
+  TEARDOWN;
+
+  for (i = 0; i < WORKERS; i++) {
+    total += st.elems[i];
+  }
+  CHECK("worker elems", total == elem_cnt && total > 0);
+  CHECK("peer elems on a single worker", st.same_worker);
+  CHECK("peer elems in order", st.in_order);
+
+  // a callback can stop the stream
+  memset(&st, 0, sizeof(st));
+  pthread_mutex_init(&st.mutex, NULL);
+  st.stop_after = WORKERS_STOP_AFTER;
+
+  setup_updates_stream();
+  CHECK("stream start (stopped workers)", bgpstream_start(bs) == 0);
+  CHECK("stop workers",
+        bgpstream_run_workers(bs, WORKERS, BGPSTREAM_DISPATCH_PREFIX,
+                              workers_cb, &st) == 1);
+  TEARDOWN;
+
+  total = 0;
+  for (i = 0; i < WORKERS; i++) {
+    total += st.elems[i];
+  }
+  CHECK("stopped worker elems", total >= WORKERS_STOP_AFTER && total < elem_cnt);
+
+  return 0;
+}
+
+struct run_state {
+  int records;
+  int elems;
+  int skip_elems;
+  int stop_after;
+};
+
+static int run_record_cb(bgpstream_record_t *record, void *user)
+{
+  struct run_state *st = (struct run_state *)user;
+  st->records++;
+  return st->skip_elems;
+}
+
+static int run_elem_cb(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                       void *user)
+{
+  struct run_state *st = (struct run_state *)user;
+  st->elems++;
+  return st->stop_after > 0 && st->elems == st->stop_after;
+}
+
+static int test_singlefile_run()
+{
+  struct run_state st;
+  bgpstream_elem_t *elem;
+  int rec_cnt = 0;
+  int elem_cnt = 0;
+  int ret;
+
+  // pull the records and elems
+  setup_updates_stream();
+  CHECK("stream start (pull)", bgpstream_start(bs) == 0);
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    rec_cnt++;
+    while (bgpstream_record_get_next_elem(rec, &elem) > 0) {
+      elem_cnt++;
+    }
+  }
+  CHECK("final return code (pull)", ret == 0);
+  TEARDOWN;
+
+  // the same records and elems must be pushed
+  memset(&st, 0, sizeof(st));
+  setup_updates_stream();
+  CHECK("stream start (push)", bgpstream_start(bs) == 0);
+  CHECK("run (push)", bgpstream_run(bs, run_record_cb, run_elem_cb, &st) == 0);
+  TEARDOWN;
+  CHECK("pushed records", st.records == rec_cnt && rec_cnt > 0);
+  CHECK("pushed elems", st.elems == elem_cnt && elem_cnt > 0);
+
+  // a record callback can skip the elems
+  memset(&st, 0, sizeof(st));
+  st.skip_elems = 1;
+  setup_updates_stream();
+  CHECK("stream start (skip elems)", bgpstream_start(bs) == 0);
+  CHECK("run (skip elems)",
+        bgpstream_run(bs, run_record_cb, run_elem_cb, &st) == 0);
+  TEARDOWN;
+  CHECK("skipped elems", st.records == rec_cnt && st.elems == 0);
+
+  // and an elem callback can stop the stream
+  memset(&st, 0, sizeof(st));
+  st.stop_after = 10;
+  setup_updates_stream();
+  CHECK("stream start (stop)", bgpstream_start(bs) == 0);
+  CHECK("run (stop)", bgpstream_run(bs, NULL, run_elem_cb, &st) == 1);
+  TEARDOWN;
+  CHECK("stopped elems", st.elems == 10);
+
+  return 0;
+}
+
+#define STAT_DELTA(stat) (after.values[stat] - before.values[stat])
+
+static int test_singlefile_stats()
+{
+  bgpstream_stats_t before, after;
+  bgpstream_elem_t *elem;
+  int rec_cnt = 0;
+  int elem_cnt = 0;
+  int timed_cnt = 0;
+  int ordered = 1;
+  uint64_t lag_cnt = 0;
+  int i, ret;
+
+  CHECK("stat names", bgpstream_stat_name(BGPSTREAM_STAT_MRT_RECORDS) != NULL &&
+                        bgpstream_stat_name(_BGPSTREAM_STAT_CNT) == NULL);
+  for (i = 0; i < _BGPSTREAM_STAT_CNT; i++) {
+    if (bgpstream_stat_name(i) == NULL) {
+      break;
+    }
+  }
+  CHECK("all stats named", i == _BGPSTREAM_STAT_CNT);
+
+  bgpstream_set_stats_timers(1);
+  bgpstream_get_stats(&before);
+  setup_updates_stream();
+  CHECK("add filter (announcements)",
+        bgpstream_add_filter(bs, BGPSTREAM_FILTER_TYPE_ELEM_TYPE,
+                             "announcements") == 0);
+  CHECK("stream start (stats)", bgpstream_start(bs) == 0);
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      rec_cnt++;
+    }
+    if (rec->time_sec != 0) {
+      timed_cnt++;
+    }
+    if (rec->listed_time_sec == 0 || rec->read_time_sec < rec->listed_time_sec ||
+        rec->delivered_time_sec < rec->read_time_sec) {
+      ordered = 0;
+    }
+    while (bgpstream_record_get_next_elem(rec, &elem) > 0) {
+      elem_cnt++;
+    }
+  }
+  CHECK("final return code (stats)", ret == 0);
+  CHECK("record listed, read and delivery times", ordered);
+  TEARDOWN;
+  bgpstream_get_stats(&after);
+  bgpstream_set_stats_timers(0);
+
+  CHECK("resources opened", STAT_DELTA(BGPSTREAM_STAT_RESOURCES_OPENED) == 1);
+  CHECK("file bytes read", STAT_DELTA(BGPSTREAM_STAT_FILE_BYTES) > 0);
+  CHECK("mrt records decoded",
+        STAT_DELTA(BGPSTREAM_STAT_MRT_RECORDS) == (uint64_t)rec_cnt);
+  CHECK("elems generated and filtered",
+        STAT_DELTA(BGPSTREAM_STAT_ELEMS_GENERATED) ==
+            (uint64_t)elem_cnt +
+              STAT_DELTA(BGPSTREAM_STAT_ELEMS_FILTERED_ELEMTYPE) &&
+          STAT_DELTA(BGPSTREAM_STAT_ELEMS_FILTERED_ELEMTYPE) > 0);
+  CHECK("decode time", STAT_DELTA(BGPSTREAM_STAT_DECODE_NS) > 0);
+  for (i = 0; i < BGPSTREAM_LAG_BUCKET_CNT; i++) {
+    lag_cnt += after.lag[BGPSTREAM_LAG_DELIVERED][i] -
+               before.lag[BGPSTREAM_LAG_DELIVERED][i];
+  }
+  CHECK("delivery lag histogram", lag_cnt == (uint64_t)timed_cnt);
+  // historical data is years behind the wall clock
+  CHECK("delivery lag of historical data",
+        after.lag[BGPSTREAM_LAG_DELIVERED][BGPSTREAM_LAG_BUCKET_CNT - 1] -
+            before.lag[BGPSTREAM_LAG_DELIVERED][BGPSTREAM_LAG_BUCKET_CNT - 1] ==
+          (uint64_t)timed_cnt);
+
+  return 0;
+}
 #endif
 
 #ifdef WITH_DATA_INTERFACE_CSVFILE
@@ -186,8 +533,20 @@ int main()
 
 #ifdef WITH_DATA_INTERFACE_SINGLEFILE
   CHECK_SECTION("singlefile data interface", test_singlefile() == 0);
+  CHECK_SECTION("singlefile raw records", test_singlefile_raw() == 0);
+  CHECK_SECTION("singlefile parallel decompression",
+                test_singlefile_pdecomp() == 0);
+  CHECK_SECTION("singlefile worker callbacks",
+                test_singlefile_workers() == 0);
+  CHECK_SECTION("singlefile push callbacks", test_singlefile_run() == 0);
+  CHECK_SECTION("singlefile statistics", test_singlefile_stats() == 0);
 #else
   SKIPPED_SECTION("singlefile data interface");
+  SKIPPED_SECTION("singlefile raw records");
+  SKIPPED_SECTION("singlefile parallel decompression");
+  SKIPPED_SECTION("singlefile worker callbacks");
+  SKIPPED_SECTION("singlefile push callbacks");
+  SKIPPED_SECTION("singlefile statistics");
 #endif
 
 #ifdef WITH_DATA_INTERFACE_CSVFILE
@@ -40,10 +40,14 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/ioctl.h> // for TIOCGWINSZ
+#include <sys/stat.h>
+#include <sys/time.h>
 #ifdef WITH_RPKI
 #include "utils/bgpstream_utils_rpki.h"
 #endif
 #include "bgpstream.h"
+#include "bgpreader_output.h"
+#include "khash.h"
 #include "utils.h"
 #include "getopt.h"
 
@@ -74,7 +78,34 @@ enum rpki_options {
   RPKI_OPTION_COLLECTORS = 501,
   RPKI_OPTION_LIVE = 502,
   RPKI_OPTION_UNIFIED = 503,
-  RPKI_OPTION_DEFAULT = 504
+  RPKI_OPTION_DEFAULT = 504,
+  RPKI_OPTION_WORKERS = 505
+};
+
+enum tuning_options {
+  TUNING_OPTION_READER_THREADS = 600,
+  TUNING_OPTION_PREFETCH_DEPTH = 601,
+  TUNING_OPTION_MEMORY_BUDGET = 602,
+  TUNING_OPTION_SHARD = 603,
+  CHECKPOINT_OPTION = 604,
+  TUNING_OPTION_REORDER_DELAY = 605,
+  TUNING_OPTION_ELEM_FIELDS = 606,
+  TUNING_OPTION_RIB_DECODE_THREADS = 607,
+  TUNING_OPTION_DECOMPRESS_THREADS = 608,
+  TUNING_OPTION_DOWNLOAD_AHEAD = 609,
+  TUNING_OPTION_DOWNLOAD_RATE = 610,
+  TUNING_OPTION_HTTP_STREAMS = 611,
+  MEM_STATS_OPTION = 612,
+  OUTPUT_QUEUE_OPTION = 613,
+  OUTPUT_DIRECT_OPTION = 614,
+  OUTPUT_TEMPLATE_OPTION = 615,
+  STATS_INTERVAL_OPTION = 616,
+  RIB_DIFF_OPTION = 617,
+  DEDUP_WINDOW_OPTION = 618,
+  PLAN_OPTION = 619,
+  TUNING_OPTION_IO_DEPTH = 620,
+  TUNING_OPTION_WORKER_CPUS = 621,
+  TUNING_OPTION_BMP_DECODE_THREADS = 622,
 };
 
 struct bs_options_t {
@@ -121,7 +152,8 @@ static struct bs_options_t bs_opts[] =
    "<start>[,<end>]",
    "process records within the given time window.  <start> and <end> may be in "
    "'Y-m-d [H:M[:S]]' format (in UTC) or in unix epoch time.  Omitting <end> "
-   "enables live mode."},
+   "enables live mode.  With several windows, only the data that falls in "
+   "one of them is processed*"},
   {{"rib-period", required_argument, 0, 'P'},
    "<period>",
    "process a rib files every <period> seconds (bgp time)"},
@@ -160,9 +192,123 @@ static struct bs_options_t bs_opts[] =
    "",
    "print info "
    "for each BGP record (used mostly for debugging BGPStream)"},
+  {{"output-binary", no_argument, 0, 'b'},
+   "",
+   "write each element of a BGP record as a length-prefixed binary frame "
+   "(see bgpstream_binary.h)"},
+  {{"output-mrt", no_argument, 0, 'M'},
+   "",
+   "write the original MRT bytes of each BGP record that has at least one "
+   "matching element, producing a (filtered) MRT dump"},
   {{"output-headers", no_argument, 0, 'i'},
    "",
    "print format information before output"},
+  {{"reader-threads", required_argument, 0, TUNING_OPTION_READER_THREADS},
+   "<threads>",
+   "use at most <threads> threads to open dump files in the background "
+   "(0 uses one thread per file; default: based on the number of CPUs)"},
+  {{"prefetch-depth", required_argument, 0, TUNING_OPTION_PREFETCH_DEPTH},
+   "<records>",
+   "decode up to <records> records ahead for each dump file using the reader "
+   "threads (default: 0, decode on demand)"},
+  {{"rib-decode-threads", required_argument, 0,
+    TUNING_OPTION_RIB_DECODE_THREADS},
+   "<threads>",
+   "decode each RIB dump using <threads> threads, keeping records in dump "
+   "order (default: 0, decode serially)"},
+  {{"bmp-decode-threads", required_argument, 0,
+    TUNING_OPTION_BMP_DECODE_THREADS},
+   "<threads>",
+   "decode each BMP feed using <threads> threads, keeping records in feed "
+   "order (default: 0, decode serially)"},
+  {{"decompress-threads", required_argument, 0,
+    TUNING_OPTION_DECOMPRESS_THREADS},
+   "<threads>",
+   "decompress each local bzip2 or multi-member gzip dump file using "
+   "<threads> threads (default: 0, decompress serially)"},
+  {{"io-depth", required_argument, 0, TUNING_OPTION_IO_DEPTH},
+   "<depth>",
+   "keep <depth> background reads outstanding for each local dump file "
+   "(default: 0, read on demand)"},
+  {{"worker-cpus", required_argument, 0, TUNING_OPTION_WORKER_CPUS},
+   "<cpus>",
+   "pin the reader, decoding and decompression threads to <cpus> (e.g., "
+   "0-7,16-23) (default: any CPU)"},
+  {{"http-streams", required_argument, 0, TUNING_OPTION_HTTP_STREAMS},
+   "<streams>",
+   "download each large remote dump file over <streams> parallel HTTP range "
+   "requests (default: 0, one connection per file)"},
+  {{"memory-budget", required_argument, 0, TUNING_OPTION_MEMORY_BUDGET},
+   "<MiB>",
+   "open overlapping dump files only while their (estimated) memory use "
+   "stays under <MiB> (default: 0, no limit)"},
+  {{"download-ahead", required_argument, 0, TUNING_OPTION_DOWNLOAD_AHEAD},
+   "<timestamps>",
+   "download the dump files of the next <timestamps> timestamps into the "
+   "cache while the current ones are read (requires a broker cache-dir; "
+   "default: 0, download on open)"},
+  {{"download-rate", required_argument, 0, TUNING_OPTION_DOWNLOAD_RATE},
+   "<KiB/s>",
+   "limit --download-ahead transfers to <KiB/s> (default: 0, no limit)"},
+  {{"shard", required_argument, 0, TUNING_OPTION_SHARD},
+   "<i/N>",
+   "process only shard <i> (0 to N-1) of the dump files, so that N "
+   "instances can split the work between them"},
+  {{"reorder-delay", required_argument, 0, TUNING_OPTION_REORDER_DELAY},
+   "<sec>",
+   "in live mode, wait at most <sec> seconds for a dump file to open before "
+   "returning records from other files without it (default: 0, always wait)"},
+  {{"elem-fields", required_argument, 0, TUNING_OPTION_ELEM_FIELDS},
+   "<list>",
+   "decode only the given comma-separated optional elem fields (as-path, "
+   "next-hop, communities, origin, med, local-pref, aggregator), leaving the "
+   "others empty (default: all)"},
+  {{"checkpoint", required_argument, 0, CHECKPOINT_OPTION},
+   "<file>",
+   "resume from the position saved in <file> (if it exists), and save the "
+   "position there periodically and when finished"},
+  {{"mem-stats", no_argument, 0, MEM_STATS_OPTION},
+   "",
+   "account the memory used by each subsystem, and print it (current and "
+   "peak bytes) to stderr when finished"},
+  {{"output-queue", required_argument, 0, OUTPUT_QUEUE_OPTION},
+   "<buffers>",
+   "write the output from a separate thread, queueing up to <buffers> 1 MiB "
+   "buffers so that a slow consumer does not stall the stream (default: 0, "
+   "write from the stream thread)"},
+  {{"output-direct", no_argument, 0, OUTPUT_DIRECT_OPTION},
+   "",
+   "when the output (queue) is a regular file, write it with direct I/O, "
+   "bypassing the page cache"},
+  {{"output-template", required_argument, 0, OUTPUT_TEMPLATE_OPTION},
+   "<template>",
+   "write the output to one file per collector (or router, or peer) instead "
+   "of stdout, in parallel. <template> is a path that may contain %project%, "
+   "%collector%, %router%, %peer-asn%, %peer-ip% (elem output only) and %fmt% "
+   "(the output format), e.g., 'out/%collector%.%fmt%.gz'. Files are "
+   "compressed by extension (.gz, .bz2, .xz, .zst, .lz4), each by its own "
+   "thread"},
+  {{"stats-interval", required_argument, 0, STATS_INTERVAL_OPTION},
+   "<seconds>",
+   "every <seconds> seconds, print the throughput (records/s, elems/s, MB/s "
+   "read), the stream time and its lag behind the wall clock, and the number "
+   "of open resources to stderr"},
+  {{"rib-diff", no_argument, 0, RIB_DIFF_OPTION},
+   "",
+   "only output the routes that changed since the previous RIB dump of each "
+   "collector: new and changed routes as announcements, and routes the dump "
+   "no longer has as withdrawals (cannot be combined with -r or -M)"},
+  {{"dedup-window", required_argument, 0, DEDUP_WINDOW_OPTION},
+   "<seconds>",
+   "drop announcements and withdrawals identical to the last update of the "
+   "same peer and prefix received (from any collector) in the last <seconds> "
+   "seconds"},
+  {{"plan", required_argument, 0, PLAN_OPTION},
+   "<N:prefix>",
+   "instead of reading the stream, split its dump files into <N> work units "
+   "of about the same size, written to <prefix>-0.csv to <prefix>-<N-1>.csv. "
+   "Each unit can be read by another bgpreader with '-d csvfile -o "
+   "csv-file=<unit file>'"},
   {{"version", no_argument, 0, 'v'},
    "",
    "print the version of bgpreader"},
@@ -185,6 +331,10 @@ static struct bs_options_t bs_opts[] =
   {{"rpki-ssh", required_argument, 0, RPKI_OPTION_SSH},
    "<user,hostkey,private key>",
    "enable SSH encryption for the live connection to the RTR server"},
+  {{"rpki-workers", required_argument, 0, RPKI_OPTION_WORKERS},
+   "<num>",
+   "validate elems on <num> threads ahead of output (default: validate "
+   "elems as they are output)"},
 #endif
   {{"help", no_argument, 0, 'h'}, "", "print this help menu"},
   {{0, 0, 0, 0}, "", "" }
@@ -192,12 +342,25 @@ static struct bs_options_t bs_opts[] =
 
 #define OPTIONS_CNT (ARR_CNT(bs_opts) - 1)
 
+/* how many records to read between checkpoints */
+#define CHECKPOINT_INTERVAL 100000
+
 static struct option long_options[OPTIONS_CNT + 1];
 static char short_options[OPTIONS_CNT * 2 + 1];
 
 static char buf[65536];
 
 static bgpstream_t *bs;
+static bgpreader_output_t *output = NULL;
+
+/* output path -> output (with --output-template) */
+KHASH_INIT(bgpreader_outputs, char *, bgpreader_output_t *, 1, kh_str_hash_func,
+           kh_str_hash_equal)
+static khash_t(bgpreader_outputs) *outputs = NULL;
+static const char *output_template = NULL;
+static const char *output_fmt = NULL;
+static char output_header[2048];
+static int output_bufs = 2;
 static bgpstream_data_interface_id_t di_id_default = 0;
 static bgpstream_data_interface_id_t di_id = 0;
 static bgpstream_data_interface_info_t *di_info = NULL;
@@ -322,10 +485,26 @@ static void usage()
 
 // print / utility functions
 
+static int parse_elem_fields(char *list, uint8_t *fields);
+static int load_checkpoint(const char *path);
+static int save_checkpoint(const char *path);
+static void print_mem_stats(void);
+static void print_progress(uint32_t stream_time);
+static int expand_template(char *path, size_t len, bgpstream_record_t *record,
+                           bgpstream_elem_t *elem);
+static int get_output(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                      bgpreader_output_t **out);
+static int flush_outputs(void);
+static int destroy_outputs(void);
+static int output_write(bgpreader_output_t *out, const void *data, size_t len);
+static int output_line(bgpreader_output_t *out, const char *line);
 static int print_record(bgpstream_record_t *record);
 static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem);
 static int print_elem_bgpdump(bgpstream_record_t *record,
                               bgpstream_elem_t *elem);
+static int print_elem_binary(bgpstream_record_t *record,
+                             bgpstream_elem_t *elem);
+static int print_record_mrt(bgpstream_record_t *record, int preamble);
 
 int main(int argc, char *argv[])
 {
@@ -342,18 +521,57 @@ int main(int argc, char *argv[])
 
 #ifdef WITH_RPKI
   bgpstream_rpki_input_t *rpki_input = bgpstream_rpki_create_input();
+  rpki_cfg_t *cfg = NULL;
+  bgpstream_rpki_cache_t *rpki_cache = NULL;
+  int rpki_workers = 0;
+  rpki_cfg_t **rpki_worker_cfgs = NULL;
+  bgpstream_rpki_pipeline_t *rpki_pipeline = NULL;
 #endif
 
   char *filterstring = NULL;
   char *intervalstring = NULL;
   uint32_t interval_start = 0;
   uint32_t interval_end = BGPSTREAM_FOREVER;
+  struct {
+    uint32_t start;
+    uint32_t end;
+  } windows[1024];
+  int windows_cnt = 0;
   int rib_period = 0;
+  int reader_threads = -1;
+  int prefetch_depth = -1;
+  int rib_decode_threads = -1;
+  int bmp_decode_threads = -1;
+  int decompress_threads = -1;
+  int io_depth = -1;
+  char *worker_cpus = NULL;
+  int http_streams = -1;
+  long memory_budget = -1;
+  int download_ahead = 0;
+  long download_rate = 0;
+  int shard_idx = 0;
+  int shard_cnt = 0;
+  const char *checkpoint_file = NULL;
+  long reorder_delay = -1;
+  uint8_t elem_fields = BGPSTREAM_ELEM_FIELD_ALL;
   int live = 0;
   int output_info = 0;
   int record_output_on = 0;
   int record_bgpdump_output_on = 0;
   int elem_output_on = 0;
+  int binary_output_on = 0;
+  int mrt_output_on = 0;
+  int mrt_elem_cnt = 0;
+  int mem_stats = 0;
+  int stats_interval = 0;
+  time_t now, next_report = 0;
+  int output_queue = 0;
+  int output_direct = 0;
+  int rib_diff = 0;
+  long dedup_window = 0;
+  long plan_units = 0;
+  const char *plan_prefix = NULL;
+  int ret;
   int exitstatus = -1; // fail, until proven otherwise
 
   int rec_limit = -1;
@@ -362,6 +580,14 @@ int main(int argc, char *argv[])
 
   int i;
 
+  /* memory accounting must be enabled before anything is allocated, so look
+     for the option before the stream is created */
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--mem-stats") == 0) {
+      bgpstream_mem_set_accounting(1);
+    }
+  }
+
   /* required to be created before usage is called */
   bs = bgpstream_create();
   if (!bs) {
@@ -450,13 +676,18 @@ int main(int argc, char *argv[])
     case 'w':
     {
       char *end;
-      end = bgpstream_parse_time(optarg, &interval_start);
+      uint32_t start_time, end_time = BGPSTREAM_FOREVER;
+      if (windows_cnt == ARR_CNT(windows)) {
+        fprintf(stderr, "ERROR: A maximum of %lu time windows (-w) can be "
+                        "specified on the command line\n",
+                ARR_CNT(windows));
+        goto done;
+      }
+      end = bgpstream_parse_time(optarg, &start_time);
       char *label = "start";
       if (end) {
-        if (*end == '\0') {
-          interval_end = BGPSTREAM_FOREVER;
-        } else if (*end == ',') {
-          end = bgpstream_parse_time(end+1, &interval_end);
+        if (*end == ',') {
+          end = bgpstream_parse_time(end+1, &end_time);
           label = "end";
         }
       }
@@ -464,6 +695,16 @@ int main(int argc, char *argv[])
         fprintf(stderr, "ERROR: bad %s time in '%s'\n", label, optarg);
         goto done;
       }
+      windows[windows_cnt].start = start_time;
+      windows[windows_cnt].end = end_time;
+      // interval_start and interval_end cover all the windows
+      if (windows_cnt++ == 0 || start_time < interval_start) {
+        interval_start = start_time;
+      }
+      if (windows_cnt == 1 || end_time == BGPSTREAM_FOREVER ||
+          (interval_end != BGPSTREAM_FOREVER && end_time > interval_end)) {
+        interval_end = end_time;
+      }
       break;
     }
     case 'P':
@@ -494,6 +735,12 @@ int main(int argc, char *argv[])
     case 'e':
       elem_output_on = 1;
       break;
+    case 'b':
+      binary_output_on = 1;
+      break;
+    case 'M':
+      mrt_output_on = 1;
+      break;
     case 'i':
       output_info = 1;
       break;
@@ -503,6 +750,153 @@ int main(int argc, char *argv[])
     case 'I':
       intervalstring = optarg;
       break;
+    case TUNING_OPTION_READER_THREADS:
+      reader_threads = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || reader_threads < 0) {
+        fprintf(stderr, "ERROR: Invalid number of reader threads '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_HTTP_STREAMS:
+      http_streams = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || http_streams < 0) {
+        fprintf(stderr, "ERROR: Invalid number of HTTP streams '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_DECOMPRESS_THREADS:
+      decompress_threads = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || decompress_threads < 0) {
+        fprintf(stderr, "ERROR: Invalid number of decompression threads '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_IO_DEPTH:
+      io_depth = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || io_depth < 0) {
+        fprintf(stderr, "ERROR: Invalid I/O depth '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_WORKER_CPUS:
+      worker_cpus = optarg;
+      break;
+    case TUNING_OPTION_RIB_DECODE_THREADS:
+      rib_decode_threads = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || rib_decode_threads < 0) {
+        fprintf(stderr, "ERROR: Invalid number of RIB decode threads '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_BMP_DECODE_THREADS:
+      bmp_decode_threads = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || bmp_decode_threads < 0) {
+        fprintf(stderr, "ERROR: Invalid number of BMP decode threads '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_PREFETCH_DEPTH:
+      prefetch_depth = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || prefetch_depth < 0) {
+        fprintf(stderr, "ERROR: Invalid prefetch depth '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_MEMORY_BUDGET:
+      memory_budget = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || memory_budget < 0) {
+        fprintf(stderr, "ERROR: Invalid memory budget '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_DOWNLOAD_AHEAD:
+      download_ahead = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || download_ahead < 0) {
+        fprintf(stderr, "ERROR: Invalid download-ahead depth '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_DOWNLOAD_RATE:
+      download_rate = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || download_rate < 0) {
+        fprintf(stderr, "ERROR: Invalid download rate '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_SHARD:
+      shard_idx = strtol(optarg, &endp, 10);
+      if (*endp != '/' ||
+          (shard_cnt = strtol(endp + 1, &endp, 10)) <= 0 || *endp != '\0' ||
+          shard_idx < 0 || shard_idx >= shard_cnt) {
+        fprintf(stderr, "ERROR: Invalid shard '%s' (expecting <i/N>)\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_REORDER_DELAY:
+      reorder_delay = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || reorder_delay < 0 || reorder_delay > 86400) {
+        fprintf(stderr, "ERROR: Invalid reorder delay '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case TUNING_OPTION_ELEM_FIELDS:
+      if (parse_elem_fields(optarg, &elem_fields) != 0) {
+        fprintf(stderr, "ERROR: Invalid elem field list '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case CHECKPOINT_OPTION:
+      checkpoint_file = optarg;
+      break;
+    case MEM_STATS_OPTION:
+      mem_stats = 1;
+      break;
+    case OUTPUT_QUEUE_OPTION:
+      output_queue = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || output_queue < 0) {
+        fprintf(stderr, "ERROR: Invalid number of output buffers '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
+    case OUTPUT_DIRECT_OPTION:
+      output_direct = 1;
+      break;
+    case OUTPUT_TEMPLATE_OPTION:
+      output_template = optarg;
+      break;
+    case RIB_DIFF_OPTION:
+      rib_diff = 1;
+      break;
+    case DEDUP_WINDOW_OPTION:
+      dedup_window = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || dedup_window <= 0 || dedup_window > UINT32_MAX) {
+        fprintf(stderr, "ERROR: Invalid dedup window '%s'\n", optarg);
+        goto done;
+      }
+      break;
+    case PLAN_OPTION:
+      plan_units = strtol(optarg, &endp, 10);
+      if (*endp != ':' || plan_units <= 0 || plan_units > INT_MAX ||
+          endp[1] == '\0') {
+        fprintf(stderr, "ERROR: Invalid plan '%s' (expecting <N:prefix>)\n",
+                optarg);
+        goto done;
+      }
+      plan_prefix = endp + 1;
+      break;
+    case STATS_INTERVAL_OPTION:
+      stats_interval = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || stats_interval <= 0) {
+        fprintf(stderr, "ERROR: Invalid stats interval '%s'\n", optarg);
+        goto done;
+      }
+      break;
     case 'v':
       fprintf(stderr, "bgpreader version %d.%d.%d\n", BGPSTREAM_MAJOR_VERSION,
               BGPSTREAM_MID_VERSION, BGPSTREAM_MINOR_VERSION);
@@ -524,6 +918,14 @@ int main(int argc, char *argv[])
     case RPKI_OPTION_DEFAULT:
       bgpstream_rpki_parse_default(rpki_input);
       break;
+    case RPKI_OPTION_WORKERS:
+      rpki_workers = strtol(optarg, &endp, 10);
+      if (*endp != '\0' || rpki_workers < 0) {
+        fprintf(stderr, "ERROR: Invalid number of RPKI workers '%s'\n",
+                optarg);
+        goto done;
+      }
+      break;
 #endif
     case 'h':
       usage();
@@ -574,11 +976,74 @@ int main(int argc, char *argv[])
     error_cnt++;
   }
 
+  // Binary output cannot be mixed with any of the text formats
+  if (binary_output_on &&
+      (elem_output_on || record_bgpdump_output_on || record_output_on ||
+       output_info)) {
+    fprintf(stderr, "ERROR: Binary output (-b) cannot be combined with text "
+                    "output (-e, -m, -r, -i).\n");
+    error_cnt++;
+  }
+
+  // MRT output cannot be mixed with any other format
+  if (mrt_output_on &&
+      (elem_output_on || record_bgpdump_output_on || record_output_on ||
+       binary_output_on || output_info)) {
+    fprintf(stderr, "ERROR: MRT output (-M) cannot be combined with other "
+                    "output (-e, -m, -r, -b, -i).\n");
+    error_cnt++;
+  }
+
+  // records are not filtered by the RIB diff mode, only their elems
+  if (rib_diff && (record_output_on || mrt_output_on)) {
+    fprintf(stderr, "ERROR: RIB diff mode (--rib-diff) cannot be combined "
+                    "with record output (-r, -M).\n");
+    error_cnt++;
+  }
+
+  // a plan lists the dump files of a finite stream, and reads none of them
+  if (plan_units > 0 && live != 0) {
+    fprintf(stderr, "ERROR: Work units (--plan) cannot be planned in live "
+                    "mode.\n");
+    error_cnt++;
+  }
+
+  if (output_direct && output_queue == 0) {
+    fprintf(stderr, "ERROR: Direct output (--output-direct) requires an "
+                    "output queue (--output-queue).\n");
+    error_cnt++;
+  }
+
   // if the user did not specify any output format, default to per elem
-  if (!record_output_on && !elem_output_on && !record_bgpdump_output_on) {
+  if (!record_output_on && !elem_output_on && !record_bgpdump_output_on &&
+      !binary_output_on && !mrt_output_on) {
     elem_output_on = 1;
   }
 
+  if (output_template != NULL) {
+    if (output_direct) {
+      fprintf(stderr, "ERROR: Direct output (--output-direct) cannot be "
+                      "combined with an output template.\n");
+      error_cnt++;
+    }
+    // a dry run finds unknown placeholders and per-peer templates
+    ret = expand_template(buf, sizeof(buf), NULL, NULL);
+    if (ret == -1 ||
+        (ret == -2 && (record_output_on || mrt_output_on))) {
+      fprintf(stderr, "ERROR: Invalid output template '%s'%s\n",
+              output_template,
+              ret == -2 ? " (peer fields need elem output)" : "");
+      error_cnt++;
+    }
+    output_fmt = mrt_output_on ? "mrt"
+                 : binary_output_on ? "bin"
+                 : record_bgpdump_output_on ? "bgpdump"
+                 : elem_output_on ? "elems" : "records";
+    if (output_queue > 0) {
+      output_bufs = output_queue;
+    }
+  }
+
   // Parse the filter string
   if (filterstring) {
     if (!bgpstream_parse_filter_string(bs, filterstring)) {
@@ -592,8 +1057,8 @@ int main(int argc, char *argv[])
   }
 
   // windows
-  if (interval_start != 0) {
-    if (!bgpstream_add_interval_filter(bs, interval_start, interval_end))
+  for (i = 0; i < windows_cnt; i++) {
+    if (!bgpstream_add_interval_filter(bs, windows[i].start, windows[i].end))
       error_cnt++;
   }
 
@@ -613,7 +1078,7 @@ int main(int argc, char *argv[])
     goto done;
   }
 
-  if (interval_start == 0 && !intervalstring) {
+  if (windows_cnt == 0 && !intervalstring) {
     if (di_id == BGPSTREAM_DATA_INTERFACE_BROKER) {
       fprintf(stderr, "WARN: No time window specified, defaulting to live mode\n");
       interval_start = epoch_sec();
@@ -636,17 +1101,135 @@ int main(int argc, char *argv[])
     bgpstream_set_live_mode(bs);
   }
 
+  if (reader_threads >= 0 &&
+      bgpstream_set_reader_threads(bs, reader_threads) != 0) {
+    fprintf(stderr, "ERROR: Could not set the number of reader threads\n");
+    goto done;
+  }
+
+  if (decompress_threads >= 0 &&
+      bgpstream_set_decompress_threads(bs, decompress_threads) != 0) {
+    fprintf(stderr, "ERROR: Could not set the number of decompression "
+                    "threads\n");
+    goto done;
+  }
+
+  if (io_depth >= 0 && bgpstream_set_io_depth(bs, io_depth) != 0) {
+    fprintf(stderr, "ERROR: Could not set the I/O depth\n");
+    goto done;
+  }
+
+  if (worker_cpus != NULL && bgpstream_set_worker_cpus(bs, worker_cpus) != 0) {
+    fprintf(stderr, "ERROR: Invalid worker CPU list '%s'\n", worker_cpus);
+    goto done;
+  }
+
+  if (http_streams >= 0 && bgpstream_set_http_streams(bs, http_streams) != 0) {
+    fprintf(stderr, "ERROR: Could not set the number of HTTP streams\n");
+    goto done;
+  }
+
+  if (rib_decode_threads >= 0 &&
+      bgpstream_set_rib_decode_threads(bs, rib_decode_threads) != 0) {
+    fprintf(stderr, "ERROR: Could not set the number of RIB decode threads\n");
+    goto done;
+  }
+
+  if (bmp_decode_threads >= 0 &&
+      bgpstream_set_bmp_decode_threads(bs, bmp_decode_threads) != 0) {
+    fprintf(stderr, "ERROR: Could not set the number of BMP decode threads\n");
+    goto done;
+  }
+
+  if (mrt_output_on) {
+    bgpstream_set_keep_raw_records(bs, 1);
+  }
+
+  if (rib_diff) {
+    bgpstream_set_rib_diff_mode(bs, 1);
+  }
+
+  if (dedup_window > 0) {
+    bgpstream_set_dedup_window(bs, dedup_window);
+  }
+
+  if (prefetch_depth >= 0 &&
+      bgpstream_set_prefetch_depth(bs, prefetch_depth) != 0) {
+    fprintf(stderr, "ERROR: Could not set the prefetch depth\n");
+    goto done;
+  }
+
+  if (memory_budget >= 0) {
+    bgpstream_set_memory_budget(bs, (uint64_t)memory_budget * 1024 * 1024);
+  }
+
+  if (download_ahead > 0 &&
+      bgpstream_set_download_ahead(bs, download_ahead,
+                                   (uint64_t)download_rate * 1024) != 0) {
+    fprintf(stderr, "ERROR: Could not set the download-ahead depth\n");
+    goto done;
+  }
+
+  if (shard_cnt > 0 && bgpstream_set_shard(bs, shard_idx, shard_cnt) != 0) {
+    fprintf(stderr, "ERROR: Could not set the shard\n");
+    goto done;
+  }
+
+  if (reorder_delay > 0) {
+    bgpstream_set_live_reorder_delay(bs, reorder_delay);
+  }
+
+  if (elem_fields != BGPSTREAM_ELEM_FIELD_ALL) {
+    bgpstream_set_elem_fields(bs, elem_fields);
+  }
+
+  if (checkpoint_file != NULL && load_checkpoint(checkpoint_file) != 0) {
+    goto done;
+  }
+
   /* turn on interface */
   if (bgpstream_start(bs) < 0) {
     return -1;
   }
 
+  if (plan_units > 0) {
+    if ((ret = bgpstream_plan_work_units(bs, plan_units, plan_prefix)) < 0) {
+      fprintf(stderr, "ERROR: Could not plan the work units\n");
+      goto done;
+    }
+    fprintf(stderr, "INFO: Split %d dump files into %ld work units\n", ret,
+            plan_units);
+    exitstatus = 0; // success
+    goto done;
+  }
+  if (stats_interval > 0) {
+    // take the first snapshot
+    print_progress(0);
+    next_report = time(NULL) + stats_interval;
+  }
+
+  if (output_template != NULL) {
+    if ((outputs = kh_init(bgpreader_outputs)) == NULL) {
+      goto done;
+    }
+  } else if (output_queue > 0 &&
+             (output = bgpreader_output_create(STDOUT_FILENO, output_queue,
+                                               output_direct)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create the output queue\n");
+    goto done;
+  }
+
+  // with an output template, every file gets the headers when it is created
   if (output_info) {
     if (record_output_on) {
-      printf(BGPSTREAM_RECORD_OUTPUT_FORMAT);
+      strcat(output_header, BGPSTREAM_RECORD_OUTPUT_FORMAT);
     }
     if (elem_output_on) {
-      printf(BGPSTREAM_ELEM_OUTPUT_FORMAT);
+      strcat(output_header, BGPSTREAM_ELEM_OUTPUT_FORMAT);
+    }
+    if (output_template == NULL &&
+        output_write(output, output_header, strlen(output_header)) != 0) {
+      goto done;
     }
   }
 
@@ -654,21 +1237,80 @@ int main(int argc, char *argv[])
   int rrc = 0, erc = 0, rec_cnt = 0;
   bgpstream_elem_t *bs_elem;
 
+  // with RPKI workers, records and elems come from the validation pipeline
+#ifdef WITH_RPKI
+#define NEXT_RECORD(rec)                                                       \
+  (rpki_pipeline != NULL                                                       \
+     ? bgpstream_rpki_pipeline_get_next_record(rpki_pipeline, (rec))           \
+     : bgpstream_get_next_record(bs, (rec)))
+#define NEXT_ELEM(rec, elem)                                                   \
+  (rpki_pipeline != NULL                                                       \
+     ? bgpstream_rpki_pipeline_get_next_elem(rpki_pipeline, (elem))            \
+     : bgpstream_record_get_next_elem((rec), (elem)))
+#else
+#define NEXT_RECORD(rec) bgpstream_get_next_record(bs, (rec))
+#define NEXT_ELEM(rec, elem) bgpstream_record_get_next_elem((rec), (elem))
+#endif
+
 #ifdef WITH_RPKI
-  rpki_cfg_t *cfg = NULL;
   if (rpki_input != NULL && rpki_input->rpki_active) {
     if (!bgpstream_rpki_parse_interval(rpki_input, interval_start, interval_end)) {
       fprintf(stderr, "ERROR: Could not parse time window for RPKI\n");
       goto done;
     }
     cfg = bgpstream_rpki_set_cfg(rpki_input);
+    if (rpki_workers > 0) {
+      // records are read ahead, so the stream position is not the output one
+      if (checkpoint_file != NULL) {
+        fprintf(stderr,
+                "ERROR: RPKI workers cannot be used with checkpoints\n");
+        goto done;
+      }
+      if ((rpki_worker_cfgs = malloc_zero(sizeof(rpki_cfg_t *) *
+                                          rpki_workers)) == NULL) {
+        goto done;
+      }
+      for (i = 0; i < rpki_workers; i++) {
+        if ((rpki_worker_cfgs[i] = bgpstream_rpki_set_cfg(rpki_input)) ==
+            NULL) {
+          fprintf(stderr, "ERROR: Could not configure RPKI worker\n");
+          goto done;
+        }
+      }
+      if ((rpki_pipeline = bgpstream_rpki_pipeline_create(
+             bs, rpki_worker_cfgs, rpki_workers, 0,
+             rpki_input->rpki_live ? 0 : 1)) == NULL) {
+        fprintf(stderr, "ERROR: Could not create RPKI pipeline\n");
+        goto done;
+      }
+    }
+    /* live validation always uses the current ROAs, historical validation
+       may use a different ROA dump for every record timestamp */
+    if ((rpki_cache = bgpstream_rpki_cache_create(
+           0, rpki_input->rpki_live ? 0 : 1)) == NULL) {
+      fprintf(stderr, "ERROR: Could not create RPKI cache\n");
+      goto done;
+    }
   }
 #endif
 
-  while ((rec_limit < 0 || rec_cnt < rec_limit) &&
-         (rrc = bgpstream_get_next_record(bs, &bs_record)) > 0) {
+  while (rec_limit < 0 || rec_cnt < rec_limit) {
+    // everything up to the last record has been output
+    if (checkpoint_file != NULL && rec_cnt > 0 &&
+        rec_cnt % CHECKPOINT_INTERVAL == 0 &&
+        save_checkpoint(checkpoint_file) != 0) {
+      goto done;
+    }
+    if ((rrc = NEXT_RECORD(&bs_record)) <= 0) {
+      break;
+    }
     rec_cnt++;
 
+    if (stats_interval > 0 && (now = time(NULL)) >= next_report) {
+      print_progress(bs_record->time_sec);
+      next_report = now + stats_interval;
+    }
+
     if (bs_record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
       continue;
     }
@@ -679,19 +1321,29 @@ int main(int argc, char *argv[])
 
     /* check if the record is of type RIB, in case extract the ID */
     /* print the RIB start line */
-    if (bs_record->type == BGPSTREAM_RIB &&
+    if (!binary_output_on && !mrt_output_on &&
+        bs_record->type == BGPSTREAM_RIB &&
         bs_record->dump_pos == BGPSTREAM_DUMP_START &&
         print_record(bs_record) != 0) {
       goto done;
     }
 
-    if (record_bgpdump_output_on || elem_output_on) {
-      while ((erc = bgpstream_record_get_next_elem(bs_record, &bs_elem)) > 0) {
+    // the peer index table is needed even if this record is not written
+    if (mrt_output_on && print_record_mrt(bs_record, 1) != 0) {
+      goto done;
+    }
+
+    if (record_bgpdump_output_on || elem_output_on || binary_output_on ||
+        mrt_output_on) {
+      mrt_elem_cnt = 0;
+      while ((erc = NEXT_ELEM(bs_record, &bs_elem)) > 0) {
 #ifdef WITH_RPKI
-        if (rpki_input != NULL && rpki_input->rpki_active) {
+        if (rpki_input != NULL && rpki_input->rpki_active &&
+            rpki_pipeline == NULL) {
           bs_elem->annotations.cfg = cfg;
           bs_elem->annotations.rpki_active = rpki_input->rpki_active;
           bs_elem->annotations.timestamp = bs_record->time_sec;
+          bs_elem->annotations.rpki_cache = rpki_cache;
         }
 #endif
         // print record following bgpdump format
@@ -700,16 +1352,28 @@ int main(int argc, char *argv[])
           goto done;
         } else if (elem_output_on && print_elem(bs_record, bs_elem) != 0) {
           goto done;
+        } else if (binary_output_on &&
+                   print_elem_binary(bs_record, bs_elem) != 0) {
+          goto done;
+        } else if (mrt_output_on) {
+          // the whole record is written once we know an elem matched
+          mrt_elem_cnt++;
+          break;
         }
       }
 
-      if (erc != 0) {
+      if (erc < 0) {
         fprintf(stderr, "ERROR: Failed to get elem from record\n");
         goto done;
       }
 
+      if (mrt_elem_cnt > 0 && print_record_mrt(bs_record, 0) != 0) {
+        goto done;
+      }
+
       /* check if end of RIB has been reached */
-      if (bs_record->type == BGPSTREAM_RIB &&
+      if (!binary_output_on && !mrt_output_on &&
+          bs_record->type == BGPSTREAM_RIB &&
           bs_record->dump_pos == BGPSTREAM_DUMP_END &&
           print_record(bs_record) != 0) {
         goto done;
@@ -719,56 +1383,529 @@ int main(int argc, char *argv[])
 
   if (rrc < 0) {
     fprintf(stderr, "ERROR: Failed to get record from stream\n");
-  } else {
+  } else if (checkpoint_file == NULL || save_checkpoint(checkpoint_file) == 0) {
     exitstatus = 0; // success
   }
 
 done:
+  // everything must be written before we report success
+  if ((bgpreader_output_destroy(output) != 0) + (destroy_outputs() != 0) != 0) {
+    fprintf(stderr, "ERROR: Could not write output\n");
+    exitstatus = -1;
+  }
+  output = NULL;
+
 #ifdef WITH_RPKI
   if (rpki_input != NULL && rpki_input->rpki_active) {
+    bgpstream_rpki_pipeline_destroy(rpki_pipeline);
+    if (rpki_worker_cfgs != NULL) {
+      for (i = 0; i < rpki_workers; i++) {
+        bgpstream_rpki_destroy_cfg(rpki_worker_cfgs[i]);
+      }
+      free(rpki_worker_cfgs);
+    }
+    bgpstream_rpki_cache_destroy(rpki_cache);
     bgpstream_rpki_destroy_cfg(cfg);
     bgpstream_rpki_destroy_input(rpki_input);
   }
 #endif
 
+  if (mem_stats != 0) {
+    print_mem_stats();
+  }
+
   /* deallocate memory for interface */
   bgpstream_destroy(bs);
   return exitstatus;
 }
 
+/* elem field utility functions */
+
+static int parse_elem_fields(char *list, uint8_t *fields)
+{
+  static const struct {
+    const char *name;
+    uint8_t field;
+  } names[] = {
+    {"as-path", BGPSTREAM_ELEM_FIELD_AS_PATH},
+    {"next-hop", BGPSTREAM_ELEM_FIELD_NEXT_HOP},
+    {"communities", BGPSTREAM_ELEM_FIELD_COMMUNITIES},
+    {"origin", BGPSTREAM_ELEM_FIELD_ORIGIN},
+    {"med", BGPSTREAM_ELEM_FIELD_MED},
+    {"local-pref", BGPSTREAM_ELEM_FIELD_LOCAL_PREF},
+    {"aggregator", BGPSTREAM_ELEM_FIELD_AGGREGATOR},
+  };
+  char *tok, *saveptr = NULL;
+  int i;
+
+  *fields = 0;
+  for (tok = strtok_r(list, ",", &saveptr); tok != NULL;
+       tok = strtok_r(NULL, ",", &saveptr)) {
+    for (i = 0; i < ARR_CNT(names); i++) {
+      if (strcmp(tok, names[i].name) == 0) {
+        *fields |= names[i].field;
+        break;
+      }
+    }
+    if (i == ARR_CNT(names)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* checkpoint utility functions */
+
+static int load_checkpoint(const char *path)
+{
+  FILE *fp;
+  size_t len;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    if (errno == ENOENT) {
+      // nothing to resume from yet
+      return 0;
+    }
+    fprintf(stderr, "ERROR: Could not open checkpoint file %s\n", path);
+    return -1;
+  }
+  len = fread(buf, 1, sizeof(buf) - 1, fp);
+  if (ferror(fp) || len == sizeof(buf) - 1) {
+    fprintf(stderr, "ERROR: Could not read checkpoint file %s\n", path);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  buf[len] = '\0';
+
+  if (bgpstream_set_checkpoint(bs, buf) != 0) {
+    fprintf(stderr, "ERROR: Could not resume from checkpoint %s\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+static int save_checkpoint(const char *path)
+{
+  char tmp_path[1024];
+  FILE *fp;
+  int len;
+
+  // the checkpoint must not get ahead of what we have actually output
+  if ((output != NULL ? bgpreader_output_flush(output) : fflush(stdout)) !=
+        0 ||
+      flush_outputs() != 0) {
+    fprintf(stderr, "ERROR: Could not flush output\n");
+    return -1;
+  }
+
+  if ((len = bgpstream_get_checkpoint(bs, buf, sizeof(buf))) < 0 ||
+      (size_t)len >= sizeof(buf)) {
+    fprintf(stderr, "ERROR: Could not create checkpoint\n");
+    return -1;
+  }
+
+  // write a new file and then swap it in so that a crash can't leave a
+  // partial checkpoint behind
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >=
+        (int)sizeof(tmp_path) ||
+      (fp = fopen(tmp_path, "w")) == NULL) {
+    fprintf(stderr, "ERROR: Could not create checkpoint file %s\n", path);
+    return -1;
+  }
+  if ((fwrite(buf, 1, len, fp) != (size_t)len) + (fclose(fp) != 0) != 0 ||
+      rename(tmp_path, path) != 0) {
+    fprintf(stderr, "ERROR: Could not write checkpoint file %s\n", path);
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+static void print_mem_stats(void)
+{
+  bgpstream_mem_usage_t usage;
+  int i;
+
+  bgpstream_mem_get_usage(&usage);
+  fprintf(stderr, "# memory: <subsystem> <current-bytes> <peak-bytes>\n");
+  for (i = 0; i < _BGPSTREAM_MEM_SUBSYS_CNT; i++) {
+    fprintf(stderr, "# memory: %s %" PRId64 " %" PRId64 "\n",
+            bgpstream_mem_subsys_name(i), usage.current[i], usage.peak[i]);
+  }
+}
+
+// maximum number of kafka partitions listed by print_progress
+#define KAFKA_PROGRESS_MAX 64
+
+// prints the throughput since the previous call (the first call only takes a
+// snapshot)
+static void print_progress(uint32_t stream_time)
+{
+  static bgpstream_stats_t prev;
+  static struct timeval prev_tv;
+  bgpstream_stats_t cur;
+  bgpstream_kafka_stats_t kafka[KAFKA_PROGRESS_MAX];
+  struct timeval tv;
+  uint64_t recs, elems, bytes;
+  double secs;
+  int i, kafka_cnt;
+
+  gettimeofday(&tv, NULL);
+  bgpstream_get_stats(&cur);
+
+  if (prev_tv.tv_sec != 0 &&
+      (secs = (tv.tv_sec - prev_tv.tv_sec) +
+              (tv.tv_usec - prev_tv.tv_usec) / 1e6) > 0) {
+#define DELTA(stat) (cur.values[stat] - prev.values[stat])
+    recs = DELTA(BGPSTREAM_STAT_MRT_RECORDS) +
+           DELTA(BGPSTREAM_STAT_BMP_RECORDS) +
+           DELTA(BGPSTREAM_STAT_RISLIVE_RECORDS);
+    elems = DELTA(BGPSTREAM_STAT_ELEMS_GENERATED);
+    for (i = BGPSTREAM_STAT_ELEMS_FILTERED_ELEMTYPE;
+         i <= BGPSTREAM_STAT_ELEMS_DUPLICATE; i++) {
+      elems -= DELTA(i);
+    }
+    bytes = DELTA(BGPSTREAM_STAT_FILE_BYTES) +
+            DELTA(BGPSTREAM_STAT_KAFKA_BYTES) +
+            DELTA(BGPSTREAM_STAT_CACHE_BYTES) +
+            DELTA(BGPSTREAM_STAT_HTTP_BYTES) +
+            DELTA(BGPSTREAM_STAT_WEBSOCKET_BYTES);
+#undef DELTA
+    fprintf(stderr,
+            "# stats: %.0f rec/s %.0f elem/s %.2f MB/s stream-time %" PRIu32
+            " lag %" PRId64 "s open %" PRIu64 "\n",
+            recs / secs, elems / secs, bytes / secs / 1e6, stream_time,
+            stream_time != 0 ? (int64_t)tv.tv_sec - stream_time : 0,
+            cur.values[BGPSTREAM_STAT_RESOURCES_OPENED] -
+              cur.values[BGPSTREAM_STAT_RESOURCES_CLOSED]);
+
+    kafka_cnt = bgpstream_get_kafka_stats(kafka, KAFKA_PROGRESS_MAX);
+    for (i = 0; i < kafka_cnt && i < KAFKA_PROGRESS_MAX; i++) {
+      fprintf(stderr,
+              "# kafka: %s %" PRId32 " lag %" PRId64 " %.0f msg/s %.2f MB/s\n",
+              kafka[i].topic, kafka[i].partition, kafka[i].consumer_lag,
+              kafka[i].msgs_per_sec, kafka[i].bytes_per_sec / 1e6);
+    }
+  }
+
+  prev = cur;
+  prev_tv = tv;
+}
+
+/* output utility functions */
+
+// copies a record name into a template value, failing if it is too long (names
+// are interned, not truncated)
+static int expand_name(char *val, size_t len, const char *name)
+{
+  if (strlen(name) >= len) {
+    return -1;
+  }
+  strcpy(val, name);
+  return 0;
+}
+
+// expands the output template for the given record (and elem). a NULL record
+// checks the template. returns -1 if the template has an unknown placeholder,
+// and -2 if it needs an elem that was not given.
+static int expand_template(char *path, size_t len, bgpstream_record_t *record,
+                           bgpstream_elem_t *elem)
+{
+  const char *p = output_template, *end;
+  char val[BGPSTREAM_UTILS_STR_NAME_LEN];
+  size_t n, used = 0;
+  int rc = 0;
+
+  while (*p != '\0') {
+    if (*p != '%' || (end = strchr(p + 1, '%')) == NULL) {
+      n = 1;
+      memcpy(val, p, 1);
+      p++;
+    } else {
+      n = end - p - 1;
+      if (n == strlen("project") && strncmp(p + 1, "project", n) == 0) {
+        if (expand_name(val, sizeof(val),
+                        record != NULL
+                          ? bgpstream_record_get_project_name(record)
+                          : "x") != 0) {
+          return -1;
+        }
+      } else if (n == strlen("collector") &&
+                 strncmp(p + 1, "collector", n) == 0) {
+        if (expand_name(val, sizeof(val),
+                        record != NULL
+                          ? bgpstream_record_get_collector_name(record)
+                          : "x") != 0) {
+          return -1;
+        }
+      } else if (n == strlen("router") && strncmp(p + 1, "router", n) == 0) {
+        if (expand_name(val, sizeof(val),
+                        record == NULL ||
+                            bgpstream_record_get_router_name(record)[0] == '\0'
+                          ? "x"
+                          : bgpstream_record_get_router_name(record)) != 0) {
+          return -1;
+        }
+      } else if (n == strlen("fmt") && strncmp(p + 1, "fmt", n) == 0) {
+        strcpy(val, output_fmt != NULL ? output_fmt : "x");
+      } else if (n == strlen("peer-asn") &&
+                 strncmp(p + 1, "peer-asn", n) == 0) {
+        rc = -2;
+        snprintf(val, sizeof(val), "%" PRIu32,
+                 elem != NULL ? elem->peer_asn : 0);
+      } else if (n == strlen("peer-ip") && strncmp(p + 1, "peer-ip", n) == 0) {
+        rc = -2;
+        if (elem == NULL ||
+            bgpstream_addr_ntop(val, sizeof(val), &elem->peer_ip) == NULL) {
+          strcpy(val, "x");
+        }
+      } else {
+        return -1;
+      }
+      n = strlen(val);
+      p = end + 1;
+    }
+    if (used + n >= len) {
+      return -1;
+    }
+    memcpy(path + used, val, n);
+    used += n;
+  }
+  path[used] = '\0';
+
+  // a real expansion only fails if the elem is missing
+  return (record == NULL || elem == NULL) ? rc : 0;
+}
+
+static int make_parent_dirs(char *path)
+{
+  char *p;
+
+  for (p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+    *p = '\0';
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+      fprintf(stderr, "ERROR: Could not create output directory %s\n", path);
+      *p = '/';
+      return -1;
+    }
+    *p = '/';
+  }
+  return 0;
+}
+
+// finds the output for the given record (and elem), creating it if needed.
+// returns 1 if there is no output for the record (i.e., record lines with a
+// per-peer template).
+static int get_output(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                      bgpreader_output_t **out)
+{
+  static char path[4096];
+  bgpreader_output_t *o;
+  khiter_t k;
+  int khret;
+  int rc;
+  char *key;
+
+  *out = output;
+  if (output_template == NULL) {
+    return 0;
+  }
+
+  if ((rc = expand_template(path, sizeof(path), record, elem)) != 0) {
+    return rc == -2 ? 1 : -1;
+  }
+  if ((k = kh_get(bgpreader_outputs, outputs, path)) != kh_end(outputs)) {
+    *out = kh_val(outputs, k);
+    return 0;
+  }
+
+  if (make_parent_dirs(path) != 0 || (key = strdup(path)) == NULL) {
+    return -1;
+  }
+  if ((o = bgpreader_output_create_file(path, output_bufs)) == NULL) {
+    free(key);
+    return -1;
+  }
+  k = kh_put(bgpreader_outputs, outputs, key, &khret);
+  if (khret < 0) {
+    bgpreader_output_destroy(o);
+    free(key);
+    return -1;
+  }
+  kh_val(outputs, k) = o;
+
+  *out = o;
+  return output_write(o, output_header, strlen(output_header));
+}
+
+static int flush_outputs(void)
+{
+  khiter_t k;
+  int rc = 0;
+
+  if (outputs == NULL) {
+    return 0;
+  }
+  for (k = kh_begin(outputs); k != kh_end(outputs); k++) {
+    if (kh_exist(outputs, k) && bgpreader_output_flush(kh_val(outputs, k))) {
+      rc = -1;
+    }
+  }
+  return rc;
+}
+
+static int destroy_outputs(void)
+{
+  khiter_t k;
+  int rc = 0;
+
+  if (outputs == NULL) {
+    return 0;
+  }
+  for (k = kh_begin(outputs); k != kh_end(outputs); k++) {
+    if (kh_exist(outputs, k)) {
+      if (bgpreader_output_destroy(kh_val(outputs, k)) != 0) {
+        rc = -1;
+      }
+      free(kh_key(outputs, k));
+    }
+  }
+  kh_destroy(bgpreader_outputs, outputs);
+  outputs = NULL;
+  return rc;
+}
+
+static int output_write(bgpreader_output_t *out, const void *data, size_t len)
+{
+  if (out != NULL) {
+    return bgpreader_output_write(out, data, len);
+  }
+  return fwrite(data, 1, len, stdout) == len ? 0 : -1;
+}
+
+static int output_line(bgpreader_output_t *out, const char *line)
+{
+  if (out == NULL) {
+    printf("%s\n", line);
+    return 0;
+  }
+  if (bgpreader_output_write(out, line, strlen(line)) != 0 ||
+      bgpreader_output_write(out, "\n", 1) != 0) {
+    fprintf(stderr, "ERROR: Could not write output\n");
+    return -1;
+  }
+  return 0;
+}
+
 /* print utility functions */
 
 static int print_record(bgpstream_record_t *record)
 {
+  bgpreader_output_t *out;
+  int rc;
+
+  if ((rc = get_output(record, NULL, &out)) != 0) {
+    return rc < 0 ? -1 : 0;
+  }
+
   if (bgpstream_record_snprintf(buf, sizeof(buf), record) == NULL) {
     fprintf(stderr, "ERROR: Could not convert record to string\n");
     return -1;
   }
 
-  printf("%s\n", buf);
-  return 0;
+  return output_line(out, buf);
 }
 
 static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem)
 {
+  bgpreader_output_t *out;
+  int rc;
+
+  if ((rc = get_output(record, elem, &out)) != 0) {
+    return rc < 0 ? -1 : 0;
+  }
+
   if (bgpstream_record_elem_snprintf(buf, sizeof(buf), record, elem) == NULL) {
     fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
     return -1;
   }
 
-  printf("%s\n", buf);
-  return 0;
+  return output_line(out, buf);
 }
 
 static int print_elem_bgpdump(bgpstream_record_t *record,
                               bgpstream_elem_t *elem)
 {
+  bgpreader_output_t *out;
+  int rc;
+
+  if ((rc = get_output(record, elem, &out)) != 0) {
+    return rc < 0 ? -1 : 0;
+  }
+
   if (bgpstream_record_elem_bgpdump_snprintf(buf, sizeof(buf), record, elem) ==
       NULL) {
     fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
     return -1;
   }
 
-  printf("%s\n", buf);
+  return output_line(out, buf);
+}
+
+static int print_elem_binary(bgpstream_record_t *record,
+                             bgpstream_elem_t *elem)
+{
+  bgpreader_output_t *out;
+  ssize_t len;
+  int rc;
+
+  if ((rc = get_output(record, elem, &out)) != 0) {
+    return rc < 0 ? -1 : 0;
+  }
+
+  if ((len = bgpstream_record_elem_binary_write((uint8_t *)buf, sizeof(buf),
+                                                record, elem)) < 0) {
+    fprintf(stderr, "ERROR: Could not convert record/elem to binary\n");
+    return -1;
+  }
+
+  if (output_write(out, buf, len) != 0) {
+    fprintf(stderr, "ERROR: Could not write binary output\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int print_record_mrt(bgpstream_record_t *record, int preamble)
+{
+  static int warned = 0;
+  bgpreader_output_t *out;
+  const uint8_t *raw;
+  size_t len;
+  int rc;
+
+  if (preamble != 0) {
+    rc = bgpstream_record_get_raw_preamble(record, &raw, &len);
+  } else {
+    rc = bgpstream_record_get_raw(record, &raw, &len);
+  }
+  if (rc == 0) {
+    // only records read from MRT dumps have raw bytes
+    if (preamble == 0 && warned == 0) {
+      fprintf(stderr, "WARN: Skipping records that were not read from MRT "
+                      "dumps\n");
+      warned = 1;
+    }
+    return 0;
+  }
+
+  if ((rc = get_output(record, NULL, &out)) != 0) {
+    return rc < 0 ? -1 : 0;
+  }
+  if (output_write(out, raw, len) != 0) {
+    fprintf(stderr, "ERROR: Could not write MRT output\n");
+    return -1;
+  }
   return 0;
 }
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpreader_output.h"
+#include "config.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <wandio.h>
+
+/* Alignment of the buffers (and of direct writes) */
+#define OUTPUT_ALIGN 4096
+
+/* Maximum number of buffers written by one writev call */
+#define OUTPUT_IOV_MAX 64
+
+/* Compression of output files, by extension */
+static const struct {
+  const char *ext;
+  int method;
+  int level;
+} output_codecs[] = {
+  {".gz", WANDIO_COMPRESS_ZLIB, 6},  {".bz2", WANDIO_COMPRESS_BZ2, 6},
+  {".xz", WANDIO_COMPRESS_LZMA, 6},  {".zst", WANDIO_COMPRESS_ZSTD, 3},
+  {".lz4", WANDIO_COMPRESS_LZ4, 1},
+};
+
+typedef struct output_buf {
+
+  char *data;
+
+  size_t len;
+
+} output_buf_t;
+
+struct bgpreader_output {
+
+  int fd;
+
+  /* file writer (instead of fd) */
+  iow_t *iow;
+
+  /* non-zero while the fd is in direct mode */
+  int direct;
+
+  /* all the buffers */
+  output_buf_t *bufs;
+  int buf_cnt;
+
+  /* the buffer being filled by the stream thread */
+  output_buf_t *cur;
+
+  /* buffers that are not in use */
+  output_buf_t **free;
+  int free_cnt;
+
+  /* ring of full buffers waiting for the writer */
+  output_buf_t **full;
+  int full_head;
+  int full_cnt;
+
+  /* number of buffers the writer is currently writing */
+  int writing;
+
+  /* errno of the first failed write (0 if none) */
+  int error;
+
+  int shutdown;
+
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t mutex;
+  pthread_cond_t full_cond;
+  pthread_cond_t free_cond;
+};
+
+static void set_direct(bgpreader_output_t *out, int direct)
+{
+#ifdef O_DIRECT
+  int flags;
+
+  if ((flags = fcntl(out->fd, F_GETFL)) < 0 ||
+      fcntl(out->fd, F_SETFL,
+            direct != 0 ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) < 0) {
+    direct = 0;
+  }
+#else
+  direct = 0;
+#endif
+  out->direct = direct;
+}
+
+// write the given buffers, resuming after partial writes. called by the
+// writer thread without the lock held.
+static int write_bufs(bgpreader_output_t *out, output_buf_t **bufs, int cnt)
+{
+  struct iovec iov[OUTPUT_IOV_MAX];
+  struct iovec *v = iov;
+  ssize_t wlen;
+  int i;
+
+  if (out->iow != NULL) {
+    for (i = 0; i < cnt; i++) {
+      if (wandio_wwrite(out->iow, bufs[i]->data, bufs[i]->len) !=
+          (int64_t)bufs[i]->len) {
+        errno = EIO;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    iov[i].iov_base = bufs[i]->data;
+    iov[i].iov_len = bufs[i]->len;
+    // direct writes must be whole blocks
+    if (out->direct != 0 && bufs[i]->len % OUTPUT_ALIGN != 0) {
+      set_direct(out, 0);
+    }
+  }
+
+  while (cnt > 0) {
+    if ((wlen = writev(out->fd, v, cnt)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EINVAL && out->direct != 0) {
+        // the file system does not like our direct writes after all
+        set_direct(out, 0);
+        continue;
+      }
+      return -1;
+    }
+    // skip whatever was written
+    while (cnt > 0 && (size_t)wlen >= v->iov_len) {
+      wlen -= v->iov_len;
+      v++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      v->iov_base = (char *)v->iov_base + wlen;
+      v->iov_len -= wlen;
+      // further direct writes would not be aligned
+      if (out->direct != 0 && wlen % OUTPUT_ALIGN != 0) {
+        set_direct(out, 0);
+      }
+    }
+  }
+  return 0;
+}
+
+static void *writer_thread(void *user)
+{
+  bgpreader_output_t *out = (bgpreader_output_t *)user;
+  output_buf_t *bufs[OUTPUT_IOV_MAX];
+  int i, cnt, err;
+
+  pthread_mutex_lock(&out->mutex);
+  while (1) {
+    while (out->full_cnt == 0 && out->shutdown == 0) {
+      pthread_cond_wait(&out->full_cond, &out->mutex);
+    }
+    if (out->full_cnt == 0) {
+      // shut down, and everything has been written
+      break;
+    }
+
+    // take everything that is ready
+    cnt = out->full_cnt < OUTPUT_IOV_MAX ? out->full_cnt : OUTPUT_IOV_MAX;
+    for (i = 0; i < cnt; i++) {
+      bufs[i] = out->full[out->full_head];
+      out->full_head = (out->full_head + 1) % out->buf_cnt;
+    }
+    out->full_cnt -= cnt;
+    out->writing = cnt;
+
+    // once a write has failed, the rest of the output is dropped
+    err = out->error;
+    pthread_mutex_unlock(&out->mutex);
+    if (err == 0 && write_bufs(out, bufs, cnt) != 0) {
+      err = errno;
+    }
+    pthread_mutex_lock(&out->mutex);
+
+    if (out->error == 0) {
+      out->error = err;
+    }
+    for (i = 0; i < cnt; i++) {
+      bufs[i]->len = 0;
+      out->free[out->free_cnt++] = bufs[i];
+    }
+    out->writing = 0;
+    pthread_cond_broadcast(&out->free_cond);
+  }
+  pthread_mutex_unlock(&out->mutex);
+
+  return NULL;
+}
+
+// hand the current buffer to the writer and get a free one. must be called
+// with the lock held.
+static int swap_buf(bgpreader_output_t *out)
+{
+  int tail;
+
+  if (out->cur->len > 0) {
+    tail = (out->full_head + out->full_cnt) % out->buf_cnt;
+    out->full[tail] = out->cur;
+    out->full_cnt++;
+    out->cur = NULL;
+    pthread_cond_signal(&out->full_cond);
+  }
+
+  while (out->cur == NULL) {
+    if (out->free_cnt > 0) {
+      out->cur = out->free[--out->free_cnt];
+      break;
+    }
+    pthread_cond_wait(&out->free_cond, &out->mutex);
+  }
+
+  return out->error == 0 ? 0 : -1;
+}
+
+static bgpreader_output_t *output_alloc(int fd, int buf_cnt)
+{
+  bgpreader_output_t *out;
+  int i;
+
+  if (buf_cnt < 2) {
+    buf_cnt = 2;
+  }
+
+  if ((out = malloc_zero(sizeof(bgpreader_output_t))) == NULL) {
+    return NULL;
+  }
+  out->fd = fd;
+  pthread_mutex_init(&out->mutex, NULL);
+  pthread_cond_init(&out->full_cond, NULL);
+  pthread_cond_init(&out->free_cond, NULL);
+
+  if ((out->bufs = malloc_zero(sizeof(output_buf_t) * buf_cnt)) == NULL ||
+      (out->free = malloc_zero(sizeof(output_buf_t *) * buf_cnt)) == NULL ||
+      (out->full = malloc_zero(sizeof(output_buf_t *) * buf_cnt)) == NULL) {
+    goto err;
+  }
+  out->buf_cnt = buf_cnt;
+  for (i = 0; i < buf_cnt; i++) {
+    // aligned so that the buffers can be written directly
+    if (posix_memalign((void **)&out->bufs[i].data, OUTPUT_ALIGN,
+                       BGPREADER_OUTPUT_BUF_SIZE) != 0) {
+      out->bufs[i].data = NULL;
+      goto err;
+    }
+    out->free[out->free_cnt++] = &out->bufs[i];
+  }
+  out->cur = out->free[--out->free_cnt];
+
+  return out;
+
+err:
+  bgpreader_output_destroy(out);
+  return NULL;
+}
+
+static int output_start(bgpreader_output_t *out)
+{
+  if (pthread_create(&out->thread, NULL, writer_thread, out) != 0) {
+    fprintf(stderr, "ERROR: Could not start the output thread\n");
+    return -1;
+  }
+  out->thread_started = 1;
+  return 0;
+}
+
+bgpreader_output_t *bgpreader_output_create(int fd, int buf_cnt, int direct)
+{
+  bgpreader_output_t *out;
+  struct stat st;
+
+  if ((out = output_alloc(fd, buf_cnt)) == NULL) {
+    return NULL;
+  }
+
+  if (direct != 0) {
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      fprintf(stderr, "WARN: Direct output is only used for regular files\n");
+    } else {
+      set_direct(out, 1);
+      if (out->direct == 0) {
+        fprintf(stderr, "WARN: Could not enable direct output\n");
+      }
+    }
+  }
+
+  if (output_start(out) != 0) {
+    bgpreader_output_destroy(out);
+    return NULL;
+  }
+  return out;
+}
+
+bgpreader_output_t *bgpreader_output_create_file(const char *path,
+                                                 int buf_cnt)
+{
+  bgpreader_output_t *out;
+  size_t len = strlen(path), elen;
+  int method = WANDIO_COMPRESS_NONE;
+  int level = 0;
+  unsigned i;
+
+  for (i = 0; i < ARR_CNT(output_codecs); i++) {
+    elen = strlen(output_codecs[i].ext);
+    if (len > elen && strcmp(path + len - elen, output_codecs[i].ext) == 0) {
+      method = output_codecs[i].method;
+      level = output_codecs[i].level;
+      break;
+    }
+  }
+
+  if ((out = output_alloc(-1, buf_cnt)) == NULL) {
+    return NULL;
+  }
+  if ((out->iow = wandio_wcreate(path, method, level, O_CREAT)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create output file %s\n", path);
+    goto err;
+  }
+  if (output_start(out) != 0) {
+    goto err;
+  }
+  return out;
+
+err:
+  bgpreader_output_destroy(out);
+  return NULL;
+}
+
+int bgpreader_output_write(bgpreader_output_t *out, const void *data,
+                           size_t len)
+{
+  const char *p = (const char *)data;
+  size_t n;
+
+  while (len > 0) {
+    // only this thread fills the current buffer, so no lock is needed
+    if (out->cur->len == BGPREADER_OUTPUT_BUF_SIZE) {
+      pthread_mutex_lock(&out->mutex);
+      if (swap_buf(out) != 0) {
+        pthread_mutex_unlock(&out->mutex);
+        return -1;
+      }
+      pthread_mutex_unlock(&out->mutex);
+    }
+    n = BGPREADER_OUTPUT_BUF_SIZE - out->cur->len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(out->cur->data + out->cur->len, p, n);
+    out->cur->len += n;
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+int bgpreader_output_flush(bgpreader_output_t *out)
+{
+  int rc;
+
+  pthread_mutex_lock(&out->mutex);
+  if (out->cur->len > 0) {
+    swap_buf(out);
+  }
+  while (out->full_cnt > 0 || out->writing > 0) {
+    pthread_cond_wait(&out->free_cond, &out->mutex);
+  }
+  rc = out->error == 0 ? 0 : -1;
+  pthread_mutex_unlock(&out->mutex);
+
+  return rc;
+}
+
+int bgpreader_output_destroy(bgpreader_output_t *out)
+{
+  int rc = 0;
+  int i;
+
+  if (out == NULL) {
+    return 0;
+  }
+
+  if (out->thread_started != 0) {
+    rc = bgpreader_output_flush(out);
+    pthread_mutex_lock(&out->mutex);
+    out->shutdown = 1;
+    pthread_cond_signal(&out->full_cond);
+    pthread_mutex_unlock(&out->mutex);
+    pthread_join(out->thread, NULL);
+  }
+
+  if (out->direct != 0) {
+    set_direct(out, 0);
+  }
+  if (out->iow != NULL) {
+    wandio_wdestroy(out->iow);
+  }
+
+  if (out->bufs != NULL) {
+    for (i = 0; i < out->buf_cnt; i++) {
+      free(out->bufs[i].data);
+    }
+  }
+  free(out->bufs);
+  free(out->free);
+  free(out->full);
+
+  pthread_cond_destroy(&out->free_cond);
+  pthread_cond_destroy(&out->full_cond);
+  pthread_mutex_destroy(&out->mutex);
+  free(out);
+
+  return rc;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPREADER_OUTPUT_H
+#define __BGPREADER_OUTPUT_H
+
+#include <stddef.h>
+
+/** @file
+ *
+ * @brief Buffered output stage of bgpreader. Output is copied into large
+ * buffers that a dedicated thread writes (using writev), so that a slow
+ * consumer only stalls the stream once all the buffers are full. An output
+ * stage can also write (and compress) a file, in which case its thread does
+ * the compression.
+ */
+
+/** Size of each output buffer */
+#define BGPREADER_OUTPUT_BUF_SIZE (1024 * 1024)
+
+/** Opaque structure for an output stage */
+typedef struct bgpreader_output bgpreader_output_t;
+
+/** Create an output stage for the given file descriptor
+ *
+ * @param fd            file descriptor to write to (e.g., STDOUT_FILENO)
+ * @param buf_cnt       number of buffers (i.e., the maximum number of full
+ *                      buffers waiting for the writer, plus one)
+ * @param direct        if non-zero and fd is a regular file, bypass the page
+ *                      cache (O_DIRECT)
+ * @return pointer to the output stage if successful, NULL otherwise
+ *
+ * Direct I/O needs block-aligned writes, so it is turned off if a partial
+ * buffer has to be written (e.g., by bgpreader_output_flush) before the end.
+ */
+bgpreader_output_t *bgpreader_output_create(int fd, int buf_cnt, int direct);
+
+/** Create an output stage that writes the given file
+ *
+ * @param path          path of the file to create (or truncate)
+ * @param buf_cnt       number of buffers (see bgpreader_output_create)
+ * @return pointer to the output stage if successful, NULL otherwise
+ *
+ * The file is compressed according to its extension (".gz", ".bz2", ".xz",
+ * ".zst" or ".lz4"), and is not compressed otherwise.
+ */
+bgpreader_output_t *bgpreader_output_create_file(const char *path,
+                                                 int buf_cnt);
+
+/** Write data to the output stage
+ *
+ * @param out           pointer to the output stage
+ * @param data          pointer to the data to write
+ * @param len           number of bytes to write
+ * @return 0 if the data was queued, -1 if the output failed
+ *
+ * Blocks while all buffers are waiting to be written.
+ */
+int bgpreader_output_write(bgpreader_output_t *out, const void *data,
+                           size_t len);
+
+/** Wait until everything written to the output stage has been written out
+ *
+ * @param out           pointer to the output stage
+ * @return 0 if all the data was written, -1 if the output failed
+ */
+int bgpreader_output_flush(bgpreader_output_t *out);
+
+/** Flush and destroy the given output stage
+ *
+ * @param out           pointer to the output stage to destroy
+ * @return 0 if all the data was written, -1 if the output failed
+ */
+int bgpreader_output_destroy(bgpreader_output_t *out);
+
+#endif /* __BGPREADER_OUTPUT_H */
@@ -62,9 +62,20 @@ def create_tables(db_conn):
                  bgp_type_id integer,
                  time_span integer,
                  PRIMARY KEY(collector_id, bgp_type_id))''')
+    create_indexes(c)
     db_conn.commit()
 
 
+def create_indexes(c):
+    # covering indexes for the queries made by the sqlite data interface:
+    # libbgpstream reads the files one window of file time at a time, and then
+    # polls for files added since its last query
+    c.execute('''CREATE INDEX IF NOT EXISTS bgp_data_file_time
+                 ON bgp_data (file_time, ts, collector_id, type_id, file_path)''')
+    c.execute('''CREATE INDEX IF NOT EXISTS bgp_data_ts
+                 ON bgp_data (ts, file_time, collector_id, type_id, file_path)''')
+
+
 def add_new_bgp_data(db_conn, mrt_file, project, collector, bgp_type, file_time, updates_time_span):
     c = db_conn.cursor()
     col_id = 0